@@ -0,0 +1,698 @@
+//
+//  flat_hash_graph.hpp
+//  
+//  Contains a variant of HashGraph that stores its node records in a single
+//  flat table, with a lower memory overhead per node
+//
+
+#ifndef BDSG_FLAT_HASH_GRAPH_HPP_INCLUDED
+#define BDSG_FLAT_HASH_GRAPH_HPP_INCLUDED
+
+#include <handlegraph/mutable_path_deletable_handle_graph.hpp>
+#include <handlegraph/serializable_handle_graph.hpp>
+
+#include "bdsg/internal/hash_map.hpp"
+#include "bdsg/internal/utility.hpp"
+#include "bdsg/internal/endianness.hpp"
+#include "bdsg/internal/linked_path.hpp"
+
+namespace bdsg {
+    
+using namespace std;
+using namespace handlegraph;
+
+
+/**
+ * FlatHashGraph is a HandleGraph implementation with the same capabilities
+ * and path representation as HashGraph, but with much less memory overhead
+ * per node. Node records are stored contiguously and located through an
+ * open-addressing hash table of IDs, and their sequences, edge lists and path
+ * occurrences are slices of arenas that are shared by the whole graph, so
+ * creating a node or an edge does not usually allocate any memory of its own.
+ *
+ * The space freed by deleting or shrinking nodes and edges is reclaimed by
+ * optimize(), or when enough of it accumulates as new nodes are created.
+ */
+class FlatHashGraph : public MutablePathDeletableHandleGraph, public SerializableHandleGraph {
+        
+public:
+    
+    FlatHashGraph();
+    ~FlatHashGraph();
+    
+    ////////////////////////////////////////////////////////////////////////////
+    // I/O methods
+    ////////////////////////////////////////////////////////////////////////////
+    
+    /// Deserialize from a stream of data
+    FlatHashGraph(istream& in);
+    
+private:
+    
+    /// Write the graph to an out stream (called from the inherited 'serialize'  method)
+    void serialize_members(ostream& out) const;
+    
+    /// Read the graph from an in stream (called from the inherited 'deserialize'  method)
+    void deserialize_members(istream& in);
+    
+public:
+    
+    ////////////////////////////////////////////////////////////////////////////
+    // Handle methods
+    ////////////////////////////////////////////////////////////////////////////
+    
+    /// Method to check if a node exists by ID
+    bool has_node(nid_t node_id) const;
+    
+    /// Look up the handle for the node with the given ID in the given orientation
+    handle_t get_handle(const nid_t& node_id, bool is_reverse = false) const;
+    
+    /// Get the ID from a handle
+    nid_t get_id(const handle_t& handle) const;
+    
+    /// Get the orientation of a handle
+    bool get_is_reverse(const handle_t& handle) const;
+    
+    /// Invert the orientation of a handle (potentially without getting its ID)
+    handle_t flip(const handle_t& handle) const;
+    
+    /// Get the length of a node
+    size_t get_length(const handle_t& handle) const;
+    
+    /// Get the sequence of a node, presented in the handle's local forward orientation.
+    string get_sequence(const handle_t& handle) const;
+    
+    /// Get the sequence of a node, presented in the handle's local forward
+    /// orientation, into a buffer, reusing its capacity.
+    void get_sequence_into(const handle_t& handle, string& buffer) const;
+    
+    /// Loop over consecutive pieces of the sequence of a node, in the handle's
+    /// local forward orientation, as (pointer, length) pairs that are only
+    /// valid during the call. The forward strand comes in a single piece that
+    /// points into the graph itself. The iteratee may return bool or void.
+    /// Returns true if we finished and false if we stopped early.
+    template<typename Iteratee>
+    bool for_each_sequence_chunk(const handle_t& handle, const Iteratee& iteratee) const;
+    
+    /// Loop over all the handles to next/previous (right/left) nodes. Passes
+    /// them to a callback which returns false to stop iterating and true to
+    /// continue. Returns true if we finished and false if we stopped early.
+    bool follow_edges_impl(const handle_t& handle, bool go_left, const std::function<bool(const handle_t&)>& iteratee) const;
+    
+    /// Loop over all the nodes in the graph in their local forward
+    /// orientations, in their internal stored order. Stop if the iteratee
+    /// returns false. Can be told to run in parallel, in which case stopping
+    /// after a false return value is on a best-effort basis and iteration
+    /// order is not defined.
+    bool for_each_handle_impl(const std::function<bool(const handle_t&)>& iteratee, bool parallel = false) const;
+    
+    /// Templated version of follow_edges() that callers holding a FlatHashGraph
+    /// can use to have the iteratee inlined into the loop, instead of paying
+    /// for a virtual call and a std::function call per edge. The iteratee may
+    /// return bool or void.
+    template<typename Iteratee>
+    bool follow_edges_fast(const handle_t& handle, bool go_left, const Iteratee& iteratee) const;
+    
+    /// Templated, serial version of for_each_handle(), for inlining the
+    /// iteratee. The iteratee may return bool or void.
+    template<typename Iteratee>
+    bool for_each_handle_fast(const Iteratee& iteratee) const;
+    
+    /// Return the number of nodes in the graph
+    /// TODO: can't be node_count because XG has a field named node_count.
+    size_t get_node_count(void) const;
+    
+    /// Return the smallest ID in the graph, or some smaller number if the
+    /// smallest ID is unavailable. Return value is unspecified if the graph is empty.
+    nid_t min_node_id(void) const;
+    
+    /// Return the largest ID in the graph, or some larger number if the
+    /// largest ID is unavailable. Return value is unspecified if the graph is empty.
+    nid_t max_node_id(void) const;
+    
+    /// Efficiently get the number of edges attached to one side of a handle.
+    size_t get_degree(const handle_t& handle, bool go_left) const;
+    
+    /// Returns one base of a handle's sequence, in the orientation of the
+    /// handle.
+    char get_base(const handle_t& handle, size_t index) const;
+    
+    /// Returns a substring of a handle's sequence, in the orientation of the
+    /// handle. If the indicated substring would extend beyond the end of the
+    /// handle's sequence, the return value is truncated to the sequence's end.
+    string get_subsequence(const handle_t& handle, size_t index, size_t size) const;
+
+    /// Create a new node with the given sequence and return the handle.
+    /// The sequence may not be empty.
+    handle_t create_handle(const std::string& sequence);
+
+    /// Create a new node with the given id and sequence, then return the handle.
+    /// The sequence may not be empty.
+    /// The ID must be strictly greater than 0, and not already in use.
+    handle_t create_handle(const std::string& sequence, const nid_t& id);
+    
+    /// Remove the node belonging to the given handle and all of its edges.
+    /// Destroys any paths in which the node participates.
+    /// Invalidates the destroyed handle.
+    /// May be called during serial for_each_handle iteration **ONLY** on the node being iterated.
+    /// May **NOT** be called during parallel for_each_handle iteration.
+    /// May **NOT** be called on the node from which edges are being followed during follow_edges.
+    /// May **NOT** be called during iteration over paths, if it would destroy a path.
+    /// May **NOT** be called during iteration along a path, if it would destroy that path.
+    void destroy_handle(const handle_t& handle);
+    
+    /// Create an edge connecting the given handles in the given order and orientations.
+    /// Ignores existing edges.
+    void create_edge(const handle_t& left, const handle_t& right);
+    
+    /// Remove the edge connecting the given handles in the given order and orientations.
+    /// Ignores nonexistent edges.
+    /// Does not update any stored paths.
+    void destroy_edge(const handle_t& left, const handle_t& right);
+    
+    /// Shorten a node by truncating either the left or right side of the node, relative to the orientation
+    /// of the handle, starting from a given offset along the nodes sequence. Any edges on the truncated
+    /// end of the node are deleted. Returns a (possibly altered) handle to the truncated node.
+    /// May invalid stored paths.
+    handle_t truncate_handle(const handle_t& handle, bool trunc_left, size_t offset);
+    
+    /// Remove all nodes and edges. Does not update any stored paths.
+    void clear(void);
+    
+    /// Alter the node that the given handle corresponds to so the orientation
+    /// indicated by the handle becomes the node's local forward orientation.
+    /// Rewrites all edges pointing to the node and the node's sequence to
+    /// reflect this. Invalidates all handles to the node (including the one
+    /// passed). Returns a new, valid handle to the node in its new forward
+    /// orientation. Note that it is possible for the node's ID to change.
+    /// Does not update any stored paths. May change the ordering of the underlying
+    /// graph.
+    handle_t apply_orientation(const handle_t& handle);
+    
+    /// Split a handle's underlying node at the given offsets in the handle's
+    /// orientation. Returns all of the handles to the parts. Other handles to
+    /// the node being split may be invalidated. The split pieces stay in the
+    /// same local forward orientation as the original node, but the returned
+    /// handles come in the order and orientation appropriate for the handle
+    /// passed in.
+    /// Updates stored paths.
+    vector<handle_t> divide_handle(const handle_t& handle, const std::vector<size_t>& offsets);
+    
+    /// Adjust the representation of the graph in memory to improve performance.
+    /// Optionally, allow the node IDs to be reassigned to further improve
+    /// performance. Reclaims the space in the shared arenas that was freed by
+    /// deleting or shrinking nodes, edges and path steps.
+    /// Note: Ideally, this method is called one time once there is expected to be
+    /// few graph modifications in the future.
+    void optimize(bool allow_id_reassignment = true);
+    
+    /// Reorder the graph's internal structure to match that given.
+    /// This sets the order that is used for iteration in functions like for_each_handle.
+    /// If compact_ids is true, may (but will not necessarily) compact the id space of the graph to match the ordering, from 1->|ordering|.
+    /// In other cases, node IDs will be preserved.
+    /// This may be a no-op in the case of graph implementations that do not have any mechanism to maintain an ordering.
+    /// This may invalidate outstanding handles.
+    /// Returns true if node IDs actually were adjusted to match the given order, and false if they remain unchanged.
+    bool apply_ordering(const vector<handle_t>& order, bool compact_ids = false);
+    
+    ////////////////////////////////////////////////////////////////////////////
+    // Path handle interface
+    ////////////////////////////////////////////////////////////////////////////
+    
+    /// Returns the number of paths stored in the graph
+    size_t get_path_count() const;
+
+    /// Determine if a path name exists and is legal to get a path handle for.
+    bool has_path(const std::string& path_name) const;
+
+    /// Look up the path handle for the given path name.
+    /// The path with that name must exist.
+    path_handle_t get_path_handle(const std::string& path_name) const;
+
+    /// Look up the name of a path from a handle to it
+    string get_path_name(const path_handle_t& path_handle) const;
+    
+    /// Look up whether a path is circular
+    bool get_is_circular(const path_handle_t& path_handle) const;
+
+    /// Returns the number of node steps in the path
+    size_t get_step_count(const path_handle_t& path_handle) const;
+
+    /// Get a node handle (node ID and orientation) from a handle to a step on a path
+    handle_t get_handle_of_step(const step_handle_t& step_handle) const;
+
+    /// Returns a handle to the path that a step is on
+    path_handle_t get_path_handle_of_step(const step_handle_t& step_handle) const;
+    
+    /// Get a handle to the first step, or in a circular path to an arbitrary step
+    /// considered "first". If the path is empty, returns the past-the-last step
+    /// returned by path_end.
+    step_handle_t path_begin(const path_handle_t& path_handle) const;
+    
+    /// Get a handle to a fictitious position past the end of a path. This position is
+    /// return by get_next_step for the final step in a path in a non-circular path.
+    /// Note that get_next_step will *NEVER* return this value for a circular path.
+    step_handle_t path_end(const path_handle_t& path_handle) const;
+    
+    /// Get a handle to the last step, which will be an arbitrary step in a circular path that
+    /// we consider "last" based on our construction of the path. If the path is empty
+    /// then the implementation must return the same value as path_front_end().
+    step_handle_t path_back(const path_handle_t& path_handle) const;
+    
+    /// Get a handle to a fictitious position before the beginning of a path. This position is
+    /// return by get_previous_step for the first step in a path in a non-circular path.
+    /// Note: get_previous_step will *NEVER* return this value for a circular path.
+    step_handle_t path_front_end(const path_handle_t& path_handle) const;
+    
+    /// Returns true if the step is not the last step in a non-circular path.
+    bool has_next_step(const step_handle_t& step_handle) const;
+    
+    /// Returns true if the step is not the first step in a non-circular path.
+    bool has_previous_step(const step_handle_t& step_handle) const;
+    
+    /// Returns a handle to the next step on the path. If the given step is the final step
+    /// of a non-circular path, returns the past-the-last step that is also returned by
+    /// path_end. In a circular path, the "last" step will loop around to the "first" (i.e.
+    /// the one returned by path_begin).
+    /// Note: to iterate over each step one time, even in a circular path, consider
+    /// for_each_step_in_path.
+    step_handle_t get_next_step(const step_handle_t& step_handle) const;
+    
+    /// Returns a handle to the previous step on the path. If the given step is the first
+    /// step of a non-circular path, this method has undefined behavior. In a circular path,
+    /// it will loop around from the "first" step (i.e. the one returned by path_begin) to
+    /// the "last" step.
+    /// Note: to iterate over each step one time, even in a circular path, consider
+    /// for_each_step_in_path.
+    step_handle_t get_previous_step(const step_handle_t& step_handle) const;
+    
+    /// Execute a function on each path in the graph
+    bool for_each_path_handle_impl(const std::function<bool(const path_handle_t&)>& iteratee) const;
+    
+    /// Calls a function with all steps of a node on paths.
+    bool for_each_step_on_handle_impl(const handle_t& handle,
+                                      const function<bool(const step_handle_t&)>& iteratee) const;
+    
+    /// Templated version of for_each_step_on_handle(), for inlining the
+    /// iteratee. The iteratee may return bool or void.
+    template<typename Iteratee>
+    bool for_each_step_on_handle_fast(const handle_t& handle, const Iteratee& iteratee) const;
+    
+    // Keep the PathHandleGraph iteration templates visible next to the
+    // parallel overloads
+    using PathHandleGraph::for_each_path_handle;
+    using PathHandleGraph::for_each_step_in_path;
+    
+    /// Execute a function on each path in the graph, possibly in parallel. In
+    /// parallel, paths are handed out to OMP tasks longest first, with short
+    /// paths grouped together, so the work is balanced by step count.
+    /// Stopping after a false return value is on a best-effort basis and
+    /// iteration order is not defined.
+    bool for_each_path_handle(const std::function<bool(const path_handle_t&)>& iteratee, bool parallel) const;
+    
+    /// Execute a function on each step of a path, possibly in parallel. In
+    /// parallel, one thread follows the path and hands out chunks of steps to
+    /// OMP tasks, and the order is not defined. Stopping after a false return
+    /// value is on a best-effort basis.
+    bool for_each_step_in_path(const path_handle_t& path_handle,
+                               const std::function<bool(const step_handle_t&)>& iteratee, bool parallel) const;
+    
+    /**
+     * Destroy the given path. Invalidates handles to the path and its node steps.
+     */
+    void destroy_path(const path_handle_t& path);
+
+    /**
+     * Create a path with the given name. The caller must ensure that no path
+     * with the given name exists already, or the behavior is undefined.
+     * Returns a handle to the created empty path. Handles to other paths must
+     * remain valid.
+     */
+    path_handle_t create_path_handle(const string& name, bool is_circular = false);
+
+    /**
+     * Append a visit to a node to the given path. Returns a handle to the new
+     * final step on the path which is appended. If the path is cirular, the new
+     * step is placed between the steps considered "last" and "first" by the
+     * method path_begin. Handles to prior steps on the path, and to other paths,
+     * must remain valid.
+     */
+    step_handle_t append_step(const path_handle_t& path, const handle_t& to_append);
+
+    /**
+     * Prepend a visit to a node to the given path. Returns a handle to the new
+     * first step on the path which is appended. If the path is cirular, the new
+     * step is placed between the steps considered "last" and "first" by the
+     * method path_begin. Handles to later steps on the path, and to other paths,
+     * must remain valid.
+     */
+    step_handle_t prepend_step(const path_handle_t& path, const handle_t& to_prepend);
+    
+    /**
+     * Delete a segment of a path and rewrite it as some other sequence of
+     * steps. Returns a pair of step_handle_t's that indicate the range of the
+     * new segment in the path. The segment to delete should be designated by
+     * the first (begin) and past-last (end) step handles.  If the step that is
+     * returned by path_begin is deleted, path_begin will now return the first
+     * step from the new segment or, in the case that the new segment is empty,
+     * the step used as segment_end. Empty ranges consist of two copies of the
+     * same step handle. Empty ranges in empty paths consist of two copies of
+     * the end sentinel handle for the path. Rewriting an empty range inserts
+     * before the provided end handle.
+     */
+    pair<step_handle_t, step_handle_t> rewrite_segment(const step_handle_t& segment_begin,
+                                                       const step_handle_t& segment_end,
+                                                       const std::vector<handle_t>& new_segment);
+    
+    /**
+     * Make a path circular or non-circular. If the path is becoming circular, the
+     * last step is joined to the first step. If the path is becoming linear, the
+     * step considered "last" is unjoined from the step considered "first" according
+     * to the method path_begin.
+     */
+    void set_circularity(const path_handle_t& path, bool circular);
+
+    /**
+     * Set a minimum id to increment the id space by, used as a hint during construction.
+     * May have no effect on a backing implementation.
+     */
+    void set_id_increment(const nid_t& min_id);
+
+    /**
+     * Add the given value to all node IDs
+     */
+    void increment_node_ids(nid_t increment);
+    
+    /**
+     * Reassign all node IDs as specified by the old->new mapping function.
+     */
+    void reassign_node_ids(const std::function<nid_t(const nid_t&)>& get_new_id);
+
+    ////////////////////////////////////////////////////////////////////////////
+    // I/O helper function
+    ////////////////////////////////////////////////////////////////////////////
+    
+    /// Returns a static high-entropy number to indicate the class
+    uint32_t get_magic_number() const;
+    
+    /// Measure how many bytes each internal component of the graph takes, as
+    /// a tree of component names and sizes. Takes time linear in the size of
+    /// the graph.
+    MemoryBreakdown memory_breakdown() const;
+    
+private:
+    
+    /// A record representing a single node in an embedded path
+    typedef LinkedPathStep path_mapping_t;
+    
+    /// An embedded path
+    typedef LinkedPath path_t;
+    
+    /// Parallel iteration hands out this many steps, or paths' worth of
+    /// steps, at a time
+    constexpr static size_t PARALLEL_ITERATION_CHUNK_SIZE = 1024;
+    
+    /*
+     * A list of items stored in one of the shared arenas
+     */
+    struct slice_t {
+        /// The position of the first item in the arena
+        uint64_t offset = 0;
+        /// The number of items in the list
+        uint32_t size = 0;
+        /// The number of items the list can hold before it is moved
+        uint32_t capacity = 0;
+    };
+    
+    /*
+     * A node record
+     */
+    struct node_t {
+        /// The ID of the node, or 0 if the node has been destroyed
+        nid_t id = 0;
+        /// The interval of the sequence arena that holds the node's sequence
+        uint64_t seq_offset = 0;
+        uint64_t seq_length = 0;
+        /// Adjacency list from the left side of the node
+        slice_t left_edges;
+        /// Adjacency list from the right side of the node
+        slice_t right_edges;
+        /// The occurrences of this node on paths
+        slice_t occurrences;
+    };
+    
+    /*
+     * A slot in the hash table of node IDs
+     */
+    struct slot_t {
+        /// The ID of the node, or 0 if the slot is empty
+        nid_t id = 0;
+        /// The index of the node's record
+        uint64_t record = 0;
+    };
+    
+    /// The largest fraction of the hash table's slots that can be in use
+    static const double MAX_LOAD_FACTOR;
+    /// The number of destroyed node records and free arena items that must
+    /// accumulate before they are reclaimed automatically
+    static const size_t MIN_GARBAGE_TO_COMPACT = 1 << 16;
+    
+    /// Get the slot of the hash table that holds the given node ID, or the
+    /// number of slots if the node doesn't exist.
+    inline size_t find_slot(const nid_t& node_id) const;
+    
+    /// Get the record for a node that exists in the graph
+    inline node_t& get_node(const nid_t& node_id);
+    inline const node_t& get_node(const nid_t& node_id) const;
+    
+    /// Make an empty record for a node that doesn't exist yet
+    node_t& insert_node(const nid_t& node_id);
+    
+    /// Remove a node's slot from the hash table
+    void erase_slot(size_t slot);
+    
+    /// Rebuild the hash table with the given number of slots, which must be a
+    /// power of 2
+    void rehash(size_t num_slots);
+    
+    /// Rewrite the records and arenas to hold only the current nodes, edges
+    /// and occurrences, with the records in the given order (or their current
+    /// order if none is given). Invalidates all references into the records
+    /// and arenas.
+    void compact(const vector<handle_t>* order = nullptr);
+    
+    /// Compact the graph if destroyed records or free arena space are taking
+    /// up more memory than they are worth
+    void compact_if_wasteful();
+    
+    /// Get the edge list on one side of a node
+    inline slice_t& edge_list(node_t& node, bool left_side);
+    inline const slice_t& edge_list(const node_t& node, bool left_side) const;
+    
+    /// Add an item to the end of a list in one of the arenas
+    template<typename T>
+    inline void push_back(slice_t& slice, vector<T>& arena, size_t& arena_garbage, const T& item);
+    
+    /// Remove the item at an index in a list in one of the arenas, by
+    /// replacing it with the last item
+    template<typename T>
+    inline void remove(slice_t& slice, vector<T>& arena, size_t index);
+    
+    /// Empty a list in one of the arenas and release its space
+    inline void release(slice_t& slice, size_t& arena_garbage);
+    
+    /// Remove the occurrence record of a path step from its node
+    void remove_occurrence(path_mapping_t* mapping);
+    
+    /// Add an occurrence record of a path step to its node
+    inline void add_occurrence(path_mapping_t* mapping);
+    
+    /// The maximum ID in the graph
+    nid_t max_id = 0;
+    /// The minimum ID in the graph
+    nid_t min_id = numeric_limits<nid_t>::max();
+    
+    /// The node records, in the order of iteration, including records for
+    /// destroyed nodes
+    vector<node_t> records;
+    /// The open-addressing hash table from node IDs to their records, with
+    /// linear probing and a power of 2 slots
+    vector<slot_t> slots;
+    /// The number of nodes in the graph
+    size_t num_nodes = 0;
+    
+    /// The sequences of all nodes
+    string sequences;
+    /// The edge lists of all nodes
+    vector<handle_t> edges;
+    /// The occurrences on paths of all nodes
+    vector<path_mapping_t*> occurrences;
+    /// The number of items in the arenas that no longer belong to any node
+    size_t sequence_garbage = 0;
+    size_t edge_garbage = 0;
+    size_t occurrence_garbage = 0;
+    
+    /// Maps path names to path IDs
+    string_hash_map<string, int64_t> path_id;
+    
+    /// Maps path IDs to the actual paths
+    hash_map<int64_t, path_t> paths;
+    
+    /// The next path ID we will assign to a new path
+    int64_t next_path_id = 1;
+    
+    /// Replace the ID in a handle with a different number
+    static handle_t set_id(const handle_t& internal, nid_t new_id);
+    
+public:
+    /// Move/copy constructors/assignment operators
+    FlatHashGraph(const FlatHashGraph& other);
+    FlatHashGraph& operator=(const FlatHashGraph& other);
+    FlatHashGraph(FlatHashGraph&& other);
+    FlatHashGraph& operator=(FlatHashGraph&& other);
+};
+
+inline size_t FlatHashGraph::find_slot(const nid_t& node_id) const {
+    if (slots.empty() || node_id <= 0) {
+        return slots.size();
+    }
+    size_t mask = slots.size() - 1;
+    for (size_t i = wang_hash_64(node_id) & mask; ; i = (i + 1) & mask) {
+        if (slots[i].id == node_id) {
+            return i;
+        }
+        if (slots[i].id == 0) {
+            return slots.size();
+        }
+    }
+}
+
+inline FlatHashGraph::node_t& FlatHashGraph::get_node(const nid_t& node_id) {
+    size_t slot = find_slot(node_id);
+    if (slot == slots.size()) {
+        throw std::out_of_range("error:[FlatHashGraph] node " + std::to_string(node_id) + " does not exist");
+    }
+    return records[slots[slot].record];
+}
+
+inline const FlatHashGraph::node_t& FlatHashGraph::get_node(const nid_t& node_id) const {
+    size_t slot = find_slot(node_id);
+    if (slot == slots.size()) {
+        throw std::out_of_range("error:[FlatHashGraph] node " + std::to_string(node_id) + " does not exist");
+    }
+    return records[slots[slot].record];
+}
+
+inline FlatHashGraph::slice_t& FlatHashGraph::edge_list(node_t& node, bool left_side) {
+    return left_side ? node.left_edges : node.right_edges;
+}
+
+inline const FlatHashGraph::slice_t& FlatHashGraph::edge_list(const node_t& node, bool left_side) const {
+    return left_side ? node.left_edges : node.right_edges;
+}
+
+template<typename T>
+inline void FlatHashGraph::push_back(slice_t& slice, vector<T>& arena, size_t& arena_garbage, const T& item) {
+    if (slice.size == slice.capacity) {
+        uint32_t new_capacity = max<uint32_t>(2, 2 * slice.capacity);
+        if (slice.capacity != 0 && slice.offset + slice.capacity == arena.size()) {
+            // the list is at the end of the arena, so it can grow in place
+            arena.resize(slice.offset + new_capacity);
+        }
+        else {
+            // move the list to the end of the arena
+            size_t new_offset = arena.size();
+            arena.resize(new_offset + new_capacity);
+            copy(arena.begin() + slice.offset, arena.begin() + slice.offset + slice.size, arena.begin() + new_offset);
+            arena_garbage += slice.capacity;
+            slice.offset = new_offset;
+        }
+        slice.capacity = new_capacity;
+    }
+    arena[slice.offset + slice.size] = item;
+    ++slice.size;
+}
+
+template<typename T>
+inline void FlatHashGraph::remove(slice_t& slice, vector<T>& arena, size_t index) {
+    arena[slice.offset + index] = arena[slice.offset + slice.size - 1];
+    --slice.size;
+}
+
+inline void FlatHashGraph::release(slice_t& slice, size_t& arena_garbage) {
+    arena_garbage += slice.capacity;
+    slice = slice_t();
+}
+
+inline void FlatHashGraph::add_occurrence(path_mapping_t* mapping) {
+    push_back(get_node(get_id(mapping->handle)).occurrences, occurrences, occurrence_garbage, mapping);
+}
+
+template<typename Iteratee>
+bool FlatHashGraph::follow_edges_fast(const handle_t& handle, bool go_left, const Iteratee& iteratee) const {
+    
+    // copy the list, and index into the arena on each iteration, so that
+    // edges can be added to other nodes while we go
+    slice_t edge_slice = edge_list(get_node(get_id(handle)), get_is_reverse(handle) != go_left);
+    
+    bool keep_going = true;
+    for (size_t i = 0; i < edge_slice.size && keep_going; ++i) {
+        handle_t next = edges[edge_slice.offset + i];
+        keep_going = call_iteratee(iteratee, go_left ? flip(next) : next);
+    }
+    return keep_going;
+}
+
+template<typename Iteratee>
+bool FlatHashGraph::for_each_handle_fast(const Iteratee& iteratee) const {
+    bool keep_going = true;
+    for (size_t i = 0; i < records.size() && keep_going; ++i) {
+        if (records[i].id != 0) {
+            keep_going = call_iteratee(iteratee, get_handle(records[i].id));
+        }
+    }
+    return keep_going;
+}
+
+template<typename Iteratee>
+bool FlatHashGraph::for_each_sequence_chunk(const handle_t& handle, const Iteratee& iteratee) const {
+    const node_t& node = get_node(get_id(handle));
+    if (!get_is_reverse(handle)) {
+        return call_iteratee(iteratee, sequences.data() + node.seq_offset, (size_t) node.seq_length);
+    }
+    // reverse complement through a fixed buffer, starting from the end
+    static const size_t chunk_size = 1024;
+    char buffer[chunk_size];
+    const char* seq = sequences.data() + node.seq_offset;
+    for (size_t end = node.seq_length; end > 0;) {
+        size_t count = std::min(chunk_size, end);
+        for (size_t i = 0; i < count; ++i) {
+            buffer[i] = reverse_complement(seq[end - i - 1]);
+        }
+        end -= count;
+        if (!call_iteratee(iteratee, (const char*) buffer, count)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+template<typename Iteratee>
+bool FlatHashGraph::for_each_step_on_handle_fast(const handle_t& handle, const Iteratee& iteratee) const {
+    slice_t occurrence_slice = get_node(get_id(handle)).occurrences;
+    for (size_t i = 0; i < occurrence_slice.size; ++i) {
+        path_mapping_t* mapping = occurrences[occurrence_slice.offset + i];
+        step_handle_t step;
+        as_integers(step)[0] = mapping->path_id;
+        as_integers(step)[1] = intptr_t(mapping);
+        
+        if (!call_iteratee(iteratee, step)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+}
+
+#endif
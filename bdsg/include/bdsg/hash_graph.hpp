@@ -11,15 +11,22 @@
 #include <handlegraph/mutable_path_deletable_handle_graph.hpp>
 #include <handlegraph/serializable_handle_graph.hpp>
 
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+
 #include "bdsg/internal/hash_map.hpp"
 #include "bdsg/internal/utility.hpp"
 #include "bdsg/internal/endianness.hpp"
+#include "bdsg/internal/linked_path.hpp"
 
 namespace bdsg {
     
 using namespace std;
 using namespace handlegraph;
 
+class PackedGraph;
+class MappedPackedGraph;
 
 /**
  * HashGraph is a HandleGraph implementation designed for simplicity. Nodes are
@@ -43,8 +50,44 @@ public:
     /// Deserialize from a stream of data
     HashGraph(istream& in);
     
+    ////////////////////////////////////////////////////////////////////////////
+    // Conversion
+    ////////////////////////////////////////////////////////////////////////////
+    
+    /// Make a copy of a PackedGraph. The node table is sized up front and
+    /// each node's edge lists are filled in directly, without going through
+    /// create_handle() and create_edge().
+    static HashGraph from(const PackedGraph& other);
+    
+    /// Make a copy of a MappedPackedGraph, in the same way.
+    static HashGraph from(const MappedPackedGraph& other);
+    
+    ////////////////////////////////////////////////////////////////////////////
+    // Concurrent construction
+    ////////////////////////////////////////////////////////////////////////////
+    
+    /// Set whether the graph can be built from several threads at once,
+    /// which is off by default. In concurrent mode, create_handle(),
+    /// create_edge(), create_path_handle(), append_step() and prepend_step()
+    /// may be called concurrently with each other. Edges and steps lock only
+    /// the nodes and path they touch, using a fixed set of locks shared out
+    /// by ID, so threads working on different parts of the graph rarely wait
+    /// on each other. Creating a node or a path briefly locks the whole node
+    /// or path table, because inserting can rehash it. Other methods,
+    /// including queries, must not run during concurrent mutation. Must not
+    /// be called while other threads are using the graph.
+    void set_concurrent_mutation(bool concurrent);
+    
+    /// Returns true if the graph is in concurrent mutation mode.
+    bool get_concurrent_mutation() const;
+    
 private:
     
+    /// Replace our contents with a copy of another graph, which must provide
+    /// for_each_handle_fast() and follow_edges_fast().
+    template<typename Graph>
+    void assign_graph(const Graph& other);
+    
     /// Write the graph to an out stream (called from the inherited 'serialize'  method)
     void serialize_members(ostream& out) const;
     
@@ -78,6 +121,18 @@ public:
     /// Get the sequence of a node, presented in the handle's local forward orientation.
     string get_sequence(const handle_t& handle) const;
     
+    /// Get the sequence of a node, presented in the handle's local forward
+    /// orientation, into a buffer, reusing its capacity.
+    void get_sequence_into(const handle_t& handle, string& buffer) const;
+    
+    /// Loop over consecutive pieces of the sequence of a node, in the handle's
+    /// local forward orientation, as (pointer, length) pairs that are only
+    /// valid during the call. The forward strand comes in a single piece that
+    /// points into the graph itself. The iteratee may return bool or void.
+    /// Returns true if we finished and false if we stopped early.
+    template<typename Iteratee>
+    bool for_each_sequence_chunk(const handle_t& handle, const Iteratee& iteratee) const;
+    
     /// Loop over all the handles to next/previous (right/left) nodes. Passes
     /// them to a callback which returns false to stop iterating and true to
     /// continue. Returns true if we finished and false if we stopped early.
@@ -90,6 +145,18 @@ public:
     /// order is not defined.
     bool for_each_handle_impl(const std::function<bool(const handle_t&)>& iteratee, bool parallel = false) const;
     
+    /// Templated version of follow_edges() that callers holding a HashGraph
+    /// can use to have the iteratee inlined into the loop, instead of paying
+    /// for a virtual call and a std::function call per edge. The iteratee may
+    /// return bool or void.
+    template<typename Iteratee>
+    bool follow_edges_fast(const handle_t& handle, bool go_left, const Iteratee& iteratee) const;
+    
+    /// Templated, serial version of for_each_handle(), for inlining the
+    /// iteratee. The iteratee may return bool or void.
+    template<typename Iteratee>
+    bool for_each_handle_fast(const Iteratee& iteratee) const;
+    
     /// Return the number of nodes in the graph
     /// TODO: can't be node_count because XG has a field named node_count.
     size_t get_node_count(void) const;
@@ -264,6 +331,30 @@ public:
     bool for_each_step_on_handle_impl(const handle_t& handle,
                                       const function<bool(const step_handle_t&)>& iteratee) const;
     
+    /// Templated version of for_each_step_on_handle(), for inlining the
+    /// iteratee. The iteratee may return bool or void.
+    template<typename Iteratee>
+    bool for_each_step_on_handle_fast(const handle_t& handle, const Iteratee& iteratee) const;
+    
+    // Keep the PathHandleGraph iteration templates visible next to the
+    // parallel overloads
+    using PathHandleGraph::for_each_path_handle;
+    using PathHandleGraph::for_each_step_in_path;
+    
+    /// Execute a function on each path in the graph, possibly in parallel. In
+    /// parallel, paths are handed out to OMP tasks longest first, with short
+    /// paths grouped together, so the work is balanced by step count.
+    /// Stopping after a false return value is on a best-effort basis and
+    /// iteration order is not defined.
+    bool for_each_path_handle(const std::function<bool(const path_handle_t&)>& iteratee, bool parallel) const;
+    
+    /// Execute a function on each step of a path, possibly in parallel. In
+    /// parallel, one thread follows the path and hands out chunks of steps to
+    /// OMP tasks, and the order is not defined. Stopping after a false return
+    /// value is on a best-effort basis.
+    bool for_each_step_in_path(const path_handle_t& path_handle,
+                               const std::function<bool(const step_handle_t&)>& iteratee, bool parallel) const;
+    
     /**
      * Destroy the given path. Invalidates handles to the path and its node steps.
      */
@@ -342,21 +433,16 @@ public:
     /// Returns a static high-entropy number to indicate the class
     uint32_t get_magic_number() const;
     
+    /// Measure how many bytes each internal component of the graph takes, as
+    /// a tree of component names and sizes. Takes time linear in the size of
+    /// the graph.
+    MemoryBreakdown memory_breakdown() const;
+    
 private:
     
     
-    /*
-     * A linked list record representing a single node in an embedded path
-     */
-    struct path_mapping_t {
-        path_mapping_t(const handle_t& handle,
-                       const int64_t& path_id) : handle(handle), path_id(path_id) {}
-        
-        handle_t handle;
-        int64_t path_id;
-        struct path_mapping_t* prev = nullptr;
-        struct path_mapping_t* next = nullptr;
-    };
+    /// A record representing a single node in an embedded path
+    typedef LinkedPathStep path_mapping_t;
     
     /*
      * A node object with the sequence and its edge lists
@@ -379,64 +465,57 @@ private:
         void deserialize(istream& in);
     };
     
-    /*
-     * A simple linked list implementation of an embedded path
-     */
-    class path_t {
-    public:
-        
-        path_t();
-        path_t(const string& name, const int64_t& path_id, bool is_circular = false);
-        
-        /// Move constructor
-        path_t(path_t&& other);
-        
-        /// Move assignment
-        path_t& operator=(path_t&& other);
-        
-        /// Copy constructor
-        path_t(const path_t& other);
-        
-        /// Copy assignment
-        path_t& operator=(const path_t& other);
-        
-        ~path_t();
-        
-        /// Add a node to the end of the path
-        path_mapping_t* push_back(const handle_t& handle);
-        
-        /// Add a node to the front of the path
-        path_mapping_t* push_front(const handle_t& handle);
-        
-        /// Remove the mapping from the path and free its memory
-        void remove(path_mapping_t* mapping);
-        
-        /// Insert a new node into the middle of the path. If the the provided node
-        /// is null, inserts at the end.
-        path_mapping_t* insert_before(const handle_t& handle, path_mapping_t* mapping);
-        
-        /// Write the path to an out stream, applying the given offset to all
-        /// node IDs referenced by the path.
-        void serialize(ostream& out) const;
-        
-        /// Read the path (in the format written by serialize()) from an in stream.
-        void deserialize(istream& in);
-        
-        path_mapping_t* head = nullptr;
-        path_mapping_t* tail = nullptr;
-        size_t count = 0;
-        int64_t path_id = 0;
-        string name;
-        bool is_circular = false;
+    /// An embedded path
+    typedef LinkedPath path_t;
+    
+    /// The number of locks that the nodes, and the paths, are shared out
+    /// among in concurrent mode
+    constexpr static size_t NUM_LOCK_STRIPES = 1024;
+    
+    /// The locks used in concurrent mutation mode
+    struct MutationLocks {
+        /// Held exclusively to insert into the node table, and shared to
+        /// change the nodes in it
+        std::shared_timed_mutex node_table;
+        /// The same for the path table
+        std::shared_timed_mutex path_table;
+        /// Guard the nodes and paths, by ID
+        std::mutex node_stripes[NUM_LOCK_STRIPES];
+        std::mutex path_stripes[NUM_LOCK_STRIPES];
     };
     
+    /// The locks held while changing some nodes and possibly a path. Empty
+    /// outside of concurrent mode.
+    struct HeldLocks {
+        std::shared_lock<std::shared_timed_mutex> node_table;
+        std::shared_lock<std::shared_timed_mutex> path_table;
+        std::unique_lock<std::mutex> path;
+        std::unique_lock<std::mutex> first_node;
+        std::unique_lock<std::mutex> second_node;
+    };
+    
+    /// Lock the two nodes of an edge, which may be the same, if in
+    /// concurrent mode
+    HeldLocks lock_nodes(const nid_t& id1, const nid_t& id2);
+    
+    /// Lock a path and the node that a step on it is on, if in concurrent mode
+    HeldLocks lock_step(const path_handle_t& path, const nid_t& id);
+    
+    /// Add a node without any locking
+    handle_t insert_node(const std::string& sequence, const nid_t& id);
+    
+    /// Parallel iteration hands out this many steps, or paths' worth of
+    /// steps, at a time
+    constexpr static size_t PARALLEL_ITERATION_CHUNK_SIZE = 1024;
+    
     /// The maximum ID in the graph
     nid_t max_id = 0;
     /// The minimum ID in the graph
     nid_t min_id = numeric_limits<nid_t>::max();
     
-    /// Encodes the graph topology
-    hash_map<nid_t, node_t> graph;
+    /// Encodes the graph topology. Nearly every operation looks nodes up
+    /// here, so we use the flat hash table, which is faster to query.
+    HashMapFor<STLBackend, SwissHashTables>::type<nid_t, node_t> graph;
     
     /// Maps path names to path IDs
     string_hash_map<string, int64_t> path_id;
@@ -447,6 +526,9 @@ private:
     /// The next path ID we will assign to a new path
     int64_t next_path_id = 1;
     
+    /// The locks for concurrent mutation, or null if not in concurrent mode
+    unique_ptr<MutationLocks> mutation_locks;
+    
     /// Replace the ID in a handle with a different number
     static handle_t set_id(const handle_t& internal, nid_t new_id);
     
@@ -457,7 +539,64 @@ public:
     HashGraph(HashGraph&& other);
     HashGraph& operator=(HashGraph&& other);
 };
-    
+
+template<typename Iteratee>
+bool HashGraph::follow_edges_fast(const handle_t& handle, bool go_left, const Iteratee& iteratee) const {
+    
+    auto& edge_list = get_is_reverse(handle) != go_left ? graph.at(get_id(handle)).left_edges
+                                                        : graph.at(get_id(handle)).right_edges;
+    
+    bool keep_going = true;
+    for (auto it = edge_list.begin(); it != edge_list.end() && keep_going; it++) {
+        keep_going = call_iteratee(iteratee, go_left ? flip(*it) : *it);
+    }
+    return keep_going;
+}
+
+template<typename Iteratee>
+bool HashGraph::for_each_handle_fast(const Iteratee& iteratee) const {
+    bool keep_going = true;
+    for (auto it = graph.begin(); it != graph.end() && keep_going; it++) {
+        keep_going = call_iteratee(iteratee, get_handle(it->first));
+    }
+    return keep_going;
+}
+
+template<typename Iteratee>
+bool HashGraph::for_each_sequence_chunk(const handle_t& handle, const Iteratee& iteratee) const {
+    const string& seq = graph.at(get_id(handle)).sequence;
+    if (!get_is_reverse(handle)) {
+        return call_iteratee(iteratee, seq.data(), seq.size());
+    }
+    // reverse complement through a fixed buffer, starting from the end
+    static const size_t chunk_size = 1024;
+    char buffer[chunk_size];
+    for (size_t end = seq.size(); end > 0;) {
+        size_t count = std::min(chunk_size, end);
+        for (size_t i = 0; i < count; ++i) {
+            buffer[i] = reverse_complement(seq[end - i - 1]);
+        }
+        end -= count;
+        if (!call_iteratee(iteratee, (const char*) buffer, count)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+template<typename Iteratee>
+bool HashGraph::for_each_step_on_handle_fast(const handle_t& handle, const Iteratee& iteratee) const {
+    for (path_mapping_t* mapping : graph.at(get_id(handle)).occurrences) {
+        step_handle_t step;
+        as_integers(step)[0] = mapping->path_id;
+        as_integers(step)[1] = intptr_t(mapping);
+        
+        if (!call_iteratee(iteratee, step)) {
+            return false;
+        }
+    }
+    return true;
+}
     
 
 } // end dankness
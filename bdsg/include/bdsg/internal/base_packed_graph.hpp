@@ -9,6 +9,13 @@
 #define BDSG_BASE_PACKED_GRAPH_HPP_INCLUDED
 
 #include <utility>
+#include <fstream>
+#include <unordered_set>
+#include <unordered_map>
+#include <cstring>
+#include <tuple>
+#include <atomic>
+#include <array>
 
 #include <handlegraph/util.hpp>
 
@@ -17,6 +24,8 @@
 #include "bdsg/internal/hash_map.hpp"
 #include "bdsg/internal/utility.hpp"
 #include "bdsg/internal/eades_algorithm.hpp"
+#include "bdsg/internal/perf_counters.hpp"
+#include "bdsg/internal/block_compression.hpp"
 #include "bdsg/graph_proxy.hpp"
 
 #include <arpa/inet.h>
@@ -36,7 +45,8 @@ using namespace handlegraph;
  * Since removals of elements can cause slots in the internal vectors to become
  * unused, the graph will occasionally defragment itself after some
  * modification operations, which involves copying its internal data
- * structures.
+ * structures. This can be turned off with set_automatic_defragmentation(),
+ * and the work done a piece at a time with defragment_step() instead.
  *
  * This implementation is a good choice when working with very large graphs,
  * where the final memory usage of the constructed graph must be minimized. It
@@ -57,6 +67,10 @@ class BasePackedGraph {
     // methods it wants to proxy.
     friend class GraphProxy<BasePackedGraph>;
     
+    // And with the versions of us that use other backends, so we can copy
+    // between them.
+    template<typename OtherBackend> friend class BasePackedGraph;
+    
 public:
     BasePackedGraph();
     ~BasePackedGraph();
@@ -76,6 +90,45 @@ private:
     /// Read the graph from an in stream (called from the 'deserialize'  method)
     void deserialize_members(istream& in);
     
+    /// Read the graph from an in stream that is positioned just after the
+    /// magic number. If a filename is provided, the stream is reading that
+    /// file, and sections of the graph may be loaded by reopening it in
+    /// parallel.
+    void load_members(istream& in, const string& filename);
+    
+    /// Read the graph from an in stream in the original, unsectioned format,
+    /// after the max ID has already been read.
+    void load_unsectioned_members(istream& in);
+    
+    /// Read nid_to_graph_iv as it was stored before revision 5 of the
+    /// sectioned format, as a dense PackedDeque.
+    void deserialize_dense_nid_to_graph(istream& in);
+    
+    /// Write one section of the sectioned serialization format
+    void serialize_section(size_t section, ostream& out) const;
+    
+    /// Read one section of the sectioned serialization format, as written by
+    /// the given format revision. Sections may be read concurrently, provided
+    /// the paths vector is already sized.
+    void deserialize_section(size_t section, istream& in, uint32_t revision);
+    
+    /// Write the graph in the block-compressed format, after its magic number
+    void serialize_compressed_members(ostream& out) const;
+    
+    /// Read the graph in the block-compressed format from an in stream that
+    /// is positioned just after the magic number. If a filename is provided,
+    /// the stream is reading that file, and the blocks are found with the
+    /// block index that follows them and read by reopening it in parallel.
+    void load_compressed_members(istream& in, const string& filename);
+    
+    /// Rebuild the mappings from path names, once all the sections of a
+    /// serialized graph have been loaded.
+    void index_loaded_paths();
+    
+    /// Read and check the magic number at the start of a serialized graph.
+    /// Returns true if it is the magic number of the block-compressed format.
+    bool check_magic_number(istream& in) const;
+    
 public:
     
     ////////////////////////////////////////////////////////////////////////////
@@ -103,6 +156,18 @@ public:
     /// Get the sequence of a node, presented in the handle's local forward orientation.
     string get_sequence(const handle_t& handle) const;
     
+    /// Get the sequence of a node, presented in the handle's local forward
+    /// orientation, into a buffer, reusing its capacity.
+    void get_sequence_into(const handle_t& handle, string& buffer) const;
+    
+    /// Loop over consecutive pieces of the sequence of a node, in the handle's
+    /// local forward orientation, as (pointer, length) pairs that are only
+    /// valid during the call. The sequence is decoded through a fixed buffer,
+    /// so nothing is allocated. The iteratee may return bool or void. Returns
+    /// true if we finished and false if we stopped early.
+    template<typename Iteratee>
+    bool for_each_sequence_chunk(const handle_t& handle, const Iteratee& iteratee) const;
+    
     /// Loop over all the handles to next/previous (right/left) nodes. Passes
     /// them to a callback which returns false to stop iterating and true to
     /// continue. Returns true if we finished and false if we stopped early.
@@ -115,6 +180,53 @@ public:
     /// order is not defined.
     bool for_each_handle(const std::function<bool(const handle_t&)>& iteratee, bool parallel = false) const;
     
+    /// Loop over the nodes with IDs in the half-open range [begin_id, end_id)
+    /// in their local forward orientations, in ID order. Stop if the iteratee
+    /// returns false. Returns true if we finished and false if we stopped
+    /// early.
+    bool for_each_handle_in_range(const nid_t& begin_id, const nid_t& end_id,
+                                  const std::function<bool(const handle_t&)>& iteratee) const;
+    
+    /// Templated version of follow_edges() that callers holding the concrete
+    /// graph type can use to have the iteratee inlined into the loop, instead
+    /// of paying for a std::function call per edge. The iteratee may return
+    /// bool or void.
+    template<typename Iteratee>
+    bool follow_edges_fast(const handle_t& handle, bool go_left, const Iteratee& iteratee) const;
+    
+    /// Templated, serial version of for_each_handle(), for inlining the
+    /// iteratee. The iteratee may return bool or void.
+    template<typename Iteratee>
+    bool for_each_handle_fast(const Iteratee& iteratee) const;
+    
+    /// Templated version of for_each_handle_in_range(), for inlining the
+    /// iteratee. The iteratee may return bool or void.
+    template<typename Iteratee>
+    bool for_each_handle_in_range_fast(const nid_t& begin_id, const nid_t& end_id,
+                                       const Iteratee& iteratee) const;
+    
+    /// Get the handles for a batch of node IDs, all in the given orientation,
+    /// into out, which is resized to match. Handles here come from the IDs
+    /// alone, so this also prefetches where to find each node's records, for
+    /// a get_sequences_lengths() or follow_edges_batch() call right after.
+    void get_handles(const vector<nid_t>& ids, vector<handle_t>& out, bool is_reverse = false) const;
+    
+    /// Get the lengths of a batch of nodes into out, which is resized to
+    /// match. Each lookup in the chain from node ID to length is prefetched
+    /// for a window of the batch before any of them are used, so their memory
+    /// latencies overlap instead of adding up.
+    void get_sequences_lengths(const vector<handle_t>& handles, vector<size_t>& out) const;
+    
+    /// Loop over the handles on the right (go_left = false) or left (go_left =
+    /// true) side of each handle in a batch, like follow_edges_fast(), with
+    /// the lookups up to the first edge of each handle prefetched across a
+    /// window of the batch. The iteratee gets the index in the batch of the
+    /// handle the edge is on and the handle on the other side, and may return
+    /// bool or void. Returns true if we finished and false if we stopped
+    /// early.
+    template<typename Iteratee>
+    bool follow_edges_batch(const vector<handle_t>& handles, bool go_left, const Iteratee& iteratee) const;
+    
     /// Return the total number of edges in the graph. If not overridden,
     /// counts them all in linear time.
     size_t get_edge_count() const;
@@ -224,6 +336,19 @@ public:
         return std::make_pair(parts.front(), parts.back());
     }
     
+    /// Create all of the given edges at once. Edges that already exist, or
+    /// that are given more than once, are only made once. The edge records
+    /// are packed into the edge lists in one pass instead of one at a time.
+    void create_edges(const vector<edge_t>& edges);
+    
+    /// Divide every node longer than the given maximum length into pieces of
+    /// that length, with a shorter last piece, and update the stored paths to
+    /// go through the pieces. The first piece of each node keeps its ID, and
+    /// the others get new IDs after the current maximum. The graph's records
+    /// are rebuilt in parallel, so this is much faster than dividing the nodes
+    /// one at a time. Invalidates all handles.
+    void chop(size_t max_length);
+    
     /// Adjust the representation of the graph in memory to improve performance.
     /// Optionally, allow the node IDs to be reassigned to further improve
     /// performance.
@@ -231,6 +356,14 @@ public:
     /// few graph modifications in the future.
     void optimize(bool allow_id_reassignment = true);
     
+    /// Lay out the path memberships of each node contiguously, sorted by path
+    /// and then by step within the path, so that for_each_step_on_handle()
+    /// reads a node's steps in one sequential scan and visits them in path
+    /// order. Best called after optimize(), since steps added to a node
+    /// afterward go to the front of its list, out of order. Handles remain
+    /// valid.
+    void sort_path_memberships();
+    
     /// Reorder the graph's internal structure to match that given.
     /// This sets the order that is used for iteration in functions like for_each_handle.
     /// If compact_ids is true, may (but will not necessarily) compact the id space of the graph to match the ordering, from 1->|ordering|.
@@ -240,6 +373,44 @@ public:
     /// Returns true if node IDs actually were adjusted to match the given order, and false if they remain unchanged.
     bool apply_ordering(const vector<handle_t>& order, bool compact_ids = false);
     
+    /// Set whether the graph defragments itself during mutating operations
+    /// once enough of its records have been orphaned, which is on by default.
+    /// Turning it off avoids long pauses while editing, but then
+    /// defragment_step() or optimize() must be called to reclaim the space.
+    void set_automatic_defragmentation(bool automatic);
+    
+    /// Set whether optimize() finishes by compressing the steps of the paths,
+    /// which is off by default. A compressed path stores its steps in a
+    /// fraction of the memory, and reads them a little more slowly. It is
+    /// decompressed again the first time it is changed.
+    void set_path_compression(bool compress);
+    
+    /// Set whether serialize() writes the block-compressed format, which is
+    /// off by default. Each section of the graph is split into blocks of the
+    /// given number of bytes, which are compressed independently so that they
+    /// can be decompressed in parallel when the graph is loaded. A trailing
+    /// block index lets a file be read in any order. deserialize() recognizes
+    /// both formats by their magic numbers. Throws if libbdsg was built
+    /// without zlib.
+    void set_serialization_compression(bool compress, size_t block_size = COMPRESSION_BLOCK_SIZE);
+    
+    /// Returns true if enough records have been orphaned that
+    /// defragment_step() has work to do.
+    bool needs_defragmentation() const;
+    
+    /// Returns true if the graph contains no reversing edges. The answer is
+    /// remembered until a change to the graph could alter it, so repeated
+    /// checks are cheap.
+    bool is_single_stranded() const;
+    
+    /// Do part of the pending defragmentation work. The graph's node records,
+    /// edge lists, path memberships and each path are defragmented as
+    /// separate units, and units are taken until the next one would move more
+    /// than max_records records in total. The first unit is always taken, so
+    /// that each call makes progress. Returns true if there is still work to
+    /// do. Invalidates step handles on the paths that are defragmented.
+    bool defragment_step(size_t max_records);
+    
     ////////////////////////////////////////////////////////////////////////////
     // Path handle interface
     ////////////////////////////////////////////////////////////////////////////
@@ -253,6 +424,21 @@ public:
     /// Look up the path handle for the given path name.
     /// The path with that name must exist.
     path_handle_t get_path_handle(const std::string& path_name) const;
+    
+    /// Sort the path names into an index that lets has_path() and
+    /// get_path_handle() look names up without allocating, and lets
+    /// for_each_path_with_prefix() and for_each_path_matching() find the
+    /// paths of a sample without checking every path. Loading or optimizing
+    /// the graph does this automatically. Creating or destroying a path drops
+    /// the index, and lookups go back to hashing the name until this is
+    /// called again.
+    void index_path_names();
+    
+    /// Loop through all the paths whose names start with the given prefix,
+    /// in no particular order. Returns false and stops if the iteratee
+    /// returns false.
+    bool for_each_path_with_prefix(const std::string& prefix,
+                                   const std::function<bool(const path_handle_t&)>& iteratee) const;
 
     /// Look up the name of a path from a handle to it
     string get_path_name(const path_handle_t& path_handle) const;
@@ -317,9 +503,37 @@ public:
     /// Execute a function on each path in the graph
     bool for_each_path_handle(const std::function<bool(const path_handle_t&)>& iteratee) const;
     
+    /// Execute a function on each path in the graph, possibly in parallel. In
+    /// parallel, paths are handed out to OMP tasks longest first, with short
+    /// paths grouped together, so the work is balanced by step count.
+    /// Stopping after a false return value is on a best-effort basis and
+    /// iteration order is not defined.
+    bool for_each_path_handle(const std::function<bool(const path_handle_t&)>& iteratee, bool parallel) const;
+    
     /// Calls the given function for each step of the given handle on a path.
     bool for_each_step_on_handle(const handle_t& handle,
                                  const function<bool(const step_handle_t&)>& iteratee) const;
+    
+    /// Templated version of for_each_step_on_handle(), for inlining the
+    /// iteratee. The iteratee may return bool or void.
+    template<typename Iteratee>
+    bool for_each_step_on_handle_fast(const handle_t& handle, const Iteratee& iteratee) const;
+    
+    /// Templated version of for_each_step_in_path(), for inlining the
+    /// iteratee. The iteratee may return bool or void. Runs through the
+    /// path's records a page at a time wherever its steps are laid out in
+    /// order, as they are after defragmentation.
+    template<typename Iteratee>
+    bool for_each_step_in_path_fast(const path_handle_t& path_handle, const Iteratee& iteratee) const;
+    
+    /// Execute a function on each step of a path, possibly in parallel. In
+    /// parallel, the steps are handed out in chunks to OMP tasks, and the
+    /// order is not defined. If the path has no deleted steps, the chunks are
+    /// ranges of its records and the links are never followed; otherwise one
+    /// thread follows them and hands out the chunks as it goes. Stopping after
+    /// a false return value is on a best-effort basis.
+    bool for_each_step_in_path(const path_handle_t& path_handle,
+                               const std::function<bool(const step_handle_t&)>& iteratee, bool parallel) const;
                                       
     /// Returns a vector of all steps of a node on paths. Optionally restricts to
     /// steps that match the handle in orientation.
@@ -333,6 +547,14 @@ public:
      * Destroy the given path. Invalidates handles to the path and its node steps.
      */
     void destroy_path(const path_handle_t& path);
+    
+    /**
+     * Destroy all of the given paths at once. Each node that the paths visit
+     * has its memberships filtered once, in parallel, instead of once per
+     * path. Invalidates handles to the paths and their steps. Repeated paths
+     * are only destroyed once.
+     */
+    void destroy_paths(const vector<path_handle_t>& paths);
 
     /**
      * Create a path with the given name. The caller must ensure that no path
@@ -358,6 +580,21 @@ public:
      */
     step_handle_t prepend_step(const path_handle_t& path, const handle_t& to_prepend);
     
+    /**
+     * Append a run of visits to nodes to the given path. Equivalent to calling
+     * append_step on each handle in order, but writes the records in bulk.
+     * Returns a handle to the new final step on the path, or the past-the-end
+     * step if nothing was appended.
+     */
+    step_handle_t append_steps(const path_handle_t& path, const vector<handle_t>& to_append);
+    
+    /**
+     * Append a run of visits to nodes to each of several distinct paths. The
+     * path records are built in parallel, and the node membership records are
+     * then merged in the order that the paths are given.
+     */
+    void append_steps(const vector<path_handle_t>& path_handles, const vector<vector<handle_t>>& to_append);
+    
     /**
      * Delete a segment of a path and rewrite it as some other sequence of
      * steps. Returns a pair of step_handle_t's that indicate the range of the
@@ -463,6 +700,14 @@ public:
     bool for_each_step_of_sense(const handle_t& visited,
                                 const PathSense& sense,
                                 const std::function<bool(const step_handle_t&)>& iteratee) const;
+    
+    /// Rebuild the index of the paths by sense, sample and locus that
+    /// for_each_path_matching() and for_each_step_of_sense() use. The index
+    /// is built when the graph is loaded and rebuilt once enough paths have
+    /// been created since, so this only catches up on the newest paths. Queries
+    /// never build it themselves, so they can run on a read-only graph. The
+    /// index is saved with the graph.
+    void index_path_metadata();
 
     ////////////////////////////////////////////////////////////////////////////
     // Serializable interface
@@ -471,6 +716,10 @@ public:
     /// Returns a static high-entropy number to indicate the class
     uint32_t get_magic_number() const;
     
+    /// Returns the magic number that starts graphs serialized in the
+    /// block-compressed format
+    uint32_t get_compressed_magic_number() const;
+    
     /// Write the contents of this object to an ostream. Makes sure to include a
     /// leading magic number.
     void serialize(std::ostream& out) const;
@@ -495,9 +744,46 @@ public:
     /// Write the contents of this object to a named file. Makes sure to include
     /// a leading magic number.
     void serialize(const std::string& filename);
-    
+
+    ////////////////////////////////////////////////////////////////////////////
+    // GFA import
+    ////////////////////////////////////////////////////////////////////////////
+
+    /// Replace the contents of the graph with a GFA 1 graph, read from a
+    /// seekable stream. The stream is scanned once to count the records and
+    /// size the graph's vectors, and then read again in batches of lines that
+    /// are parsed in parallel, so no intermediate graph is built.
+    ///
+    /// If every segment name is a positive integer, the names are used as node
+    /// IDs. Otherwise nodes are numbered from 1 in the order of the S lines.
+    /// P lines are loaded as paths named by the path name, and W lines as
+    /// haplotype paths. Overlaps other than 0M, and segments without
+    /// sequence, are not supported.
+    void load_gfa(std::istream& in);
+    /// Replace the contents of the graph with a GFA 1 graph from a named file.
+    void load_gfa(const std::string& filename);
+
+    ////////////////////////////////////////////////////////////////////////////
+    // Conversion
+    ////////////////////////////////////////////////////////////////////////////
+
+    /// Replace the contents of the graph with a copy of a packed graph that
+    /// uses a different backend, such as a memory-mapped one. Each structure
+    /// is copied whole, and different structures are copied in parallel.
+    template<typename OtherBackend>
+    void assign(const BasePackedGraph<OtherBackend>& other);
+
+    /// Replace the contents of the graph with a copy of another type of
+    /// graph, which must provide for_each_handle_fast() and
+    /// follow_edges_fast(). The vectors are sized up front, the edge lists
+    /// are written directly instead of being checked for duplicates, and the
+    /// steps of paths are collected in parallel, in batches. The nodes are
+    /// stored in ID order.
+    template<typename Graph>
+    void assign_graph(const Graph& other);
+
 private:
-    
+
     // Forward declaration so we can use it as an argument to methods
     struct PackedPath;
     
@@ -525,6 +811,23 @@ private:
     /// even if we have not deleted many things.
     void defragment(bool force = false);
     
+    /// Reallocate one of the graph's structures without its orphaned records
+    void defragment_node_records();
+    void defragment_edge_records();
+    /// Optionally, also sort each node's membership list by path and step.
+    void defragment_membership_records(bool sort_by_path = false);
+    /// Reallocate the path names without the names of deleted paths. Unlike
+    /// eject_deleted_paths(), this leaves the path handles as they are.
+    void defragment_path_names();
+    
+    /// Check whether enough records of one of the graph's structures have
+    /// been orphaned to warrant defragmenting it
+    bool node_records_fragmented() const;
+    bool edge_records_fragmented() const;
+    bool membership_records_fragmented() const;
+    bool path_names_fragmented() const;
+    bool path_fragmented(const int64_t& path_idx) const;
+    
     /// Check if have orphaned enough records in the linked list of the path to warrant
     /// reallocating and defragmenting it. If so, do it. Optionally, defragment even if
     /// we have not deleted many things.
@@ -548,6 +851,27 @@ private:
     /// Extract the internal representation of a path name, but do not decode it.
     PackedVector<> extract_encoded_path_name(const int64_t& path_idx) const;
     
+    /// Compare the name of a path to the given name in the order of the path
+    /// name index. Returns a negative number if the path's name comes first,
+    /// 0 if they are the same, or if prefix_only is set and the path's name
+    /// starts with the given name, and a positive number otherwise.
+    int compare_path_name(const int64_t& path_idx, const string& name, bool prefix_only) const;
+    
+    /// Get the range of path_name_order_iv holding the paths with the given
+    /// name, or whose names start with it if prefix_only is set.
+    pair<size_t, size_t> find_indexed_path_names(const string& name, bool prefix_only) const;
+    
+    /// Build the path metadata index if it is missing or too many paths have
+    /// been created since it was built.
+    void update_path_metadata_index();
+    
+    /// Build the path metadata index over all the current paths.
+    void build_path_metadata_index();
+    
+    /// Translate a section number of the given serialization format revision
+    /// into a SerializedSection, or a path section
+    static size_t translate_section(size_t section, uint32_t revision);
+    
     /// Defragment data structures when the orphaned records are this fraction of the whole.
     const static double defrag_factor;
     
@@ -555,6 +879,84 @@ private:
     constexpr static size_t NARROW_PAGE_WIDTH = 256;
     constexpr static size_t WIDE_PAGE_WIDTH = 1024;
     
+    /// Parallel iteration hands out nodes in chunks of this many IDs, in whole
+    /// narrow pages so that a chunk over a graph in ID order stays on its own
+    /// pages of graph_iv
+    constexpr static size_t PARALLEL_ITERATION_CHUNK_SIZE = 4 * NARROW_PAGE_WIDTH;
+    
+    /// The most entries that parallel_fill computes before packing them
+    constexpr static size_t PARALLEL_FILL_BATCH_SIZE = 1 << 20;
+    
+    /// How many handles the batch lookups prefetch for at once, enough to
+    /// keep the memory system busy without evicting the early ones
+    constexpr static size_t PREFETCH_BATCH_SIZE = 32;
+    
+    /// Copy the steps of a path into new vectors in path order, leaving out any
+    /// deleted steps, and record the translation from old to new step offsets.
+    /// Only modifies the path's own vectors, so different paths can be
+    /// straightened in parallel. Returns the offset of the new last step, or 0
+    /// if the path is empty.
+    size_t straighten_path(const int64_t& path_idx, PagedVector<NARROW_PAGE_WIDTH>& offset_translator);
+    
+    /// Finish defragmenting a path after straightening it by updating its head
+    /// and tail and the steps in the membership records of its nodes.
+    void finish_defragment_path(const int64_t& path_idx, const size_t& new_tail,
+                                const PagedVector<NARROW_PAGE_WIDTH>& offset_translator);
+    
+    /// Get the offsets in graph_iv of the records of all nodes, in ID order.
+    vector<size_t> graph_indexes_in_id_order() const;
+    
+    /// Reassign node IDs as in reassign_node_ids, optionally translating edges
+    /// and path steps in parallel, in which case get_new_id must be safe to
+    /// call from multiple threads.
+    void translate_node_ids(const std::function<nid_t(const nid_t&)>& get_new_id, bool parallel);
+    
+    /// Fill in a vector that is being rebuilt, which must already be sized to
+    /// hold every entry. Item i of num_items gets the entries from
+    /// get_offset(i) to get_offset(i + 1), which write_item(i, out) computes.
+    /// Items are computed in parallel in batches of bounded size, and each
+    /// batch is packed in order, so the result does not depend on the number
+    /// of threads.
+    template<typename Vec, typename GetOffset, typename WriteItem>
+    static void parallel_fill(Vec& vec, size_t num_items, const GetOffset& get_offset,
+                              const WriteItem& write_item);
+    
+    /// Written in place of the max ID to mark the sectioned serialization
+    /// format, which begins with a table of section lengths so that its
+    /// sections can be loaded in parallel. Never a valid max ID.
+    constexpr static nid_t SECTIONED_FORMAT_MARKER = std::numeric_limits<nid_t>::min();
+    /// The revision of the sectioned serialization format that we write.
+    /// Revision 2 added the sequence exception runs, revision 3 added the
+    /// path metadata index, revision 4 added compressed paths, and revision 5
+    /// made the ID to record mapping sparse.
+    constexpr static uint32_t SECTIONED_FORMAT_REVISION = 5;
+    /// The default number of uncompressed bytes in each block of the
+    /// block-compressed format. The last block of a section may be shorter.
+    constexpr static size_t COMPRESSION_BLOCK_SIZE = 4 << 20;
+    /// Written at the very end of the block-compressed format, after the
+    /// block index and its length, so that the index can be checked once it
+    /// has been found from the length of the blocks in the header
+    constexpr static uint64_t COMPRESSED_INDEX_MARKER = 0x78646e496b636c42;
+    /// The sections of the sectioned serialization format that come before
+    /// one section per path
+    enum SerializedSection {
+        HEADER_SECTION = 0,
+        GRAPH_SECTION,
+        SEQ_START_SECTION,
+        SEQ_LENGTH_SECTION,
+        EDGE_LISTS_SECTION,
+        NID_TO_GRAPH_SECTION,
+        SEQ_SECTION,
+        MEMBERSHIP_NODE_SECTION,
+        MEMBERSHIP_ID_SECTION,
+        MEMBERSHIP_OFFSET_SECTION,
+        MEMBERSHIP_NEXT_SECTION,
+        PATH_NAMES_SECTION,
+        PATH_METADATA_SECTION,
+        PATH_METADATA_INDEX_SECTION,
+        NUM_FIXED_SECTIONS
+    };
+    
     /// The maximum ID in the graph
     nid_t max_id = 0;
     /// The minimum ID in the graph
@@ -589,18 +991,27 @@ private:
     const static size_t EDGE_TRAV_OFFSET;
     const static size_t EDGE_NEXT_OFFSET;
     
-    // TODO: template out the deque and back nid_to_graph_iv with a paged vector? might
-    // provide better compression now that it can handle 0's gracefully. unsure how the
-    // wrapping around would act with pages though...
-    
     /// Encodes the 1-based offset of an ID in graph_iv in units of GRAPH_RECORD_SIZE.
     /// If no node with that ID exists, contains a 0. The index of a given ID is
-    /// computed by (ID - min ID).
-    PackedDeque<Backend> nid_to_graph_iv;
-
-    /// Encodes all of the sequences of all nodes in the graph.
+    /// computed by (ID - min ID). Ranges of the ID space with no nodes in them
+    /// take up almost no space, so graphs with widely separated ID ranges don't
+    /// need to have their IDs compacted.
+    SparsePackedDeque<Backend> nid_to_graph_iv;
+
+    /// Encodes all of the sequences of all nodes in the graph, 2 bits per
+    /// base. Bases other than A, C, G and T are stored as a placeholder and
+    /// recorded in the exception runs below. (Graphs built before exceptions
+    /// existed may instead have N's stored directly as a 5th value, which is
+    /// still decoded correctly.)
     PackedVector<Backend> seq_iv;
     
+    /// Runs of a single character other than A, C, G or T in seq_iv, sorted
+    /// by start position. Dividing a node can leave a run that extends across
+    /// the boundary between two nodes' sequences.
+    PackedVector<Backend> seq_exception_start_iv;
+    PackedVector<Backend> seq_exception_length_iv;
+    PackedVector<Backend> seq_exception_char_iv;
+    
     /// Encodes the membership of a node in all paths. In the same order as graph_iv.
     /// Consists of 1-based offset to the corresponding heads of linked lists in
     /// path_membership_value_iv, which contains the actual pointers into the paths.
@@ -667,7 +1078,26 @@ private:
         /// The traversal value is stored in a separate vector at the matching index.
         /// {ID|orientation (bit-packed)}
         RobustPagedVector<NARROW_PAGE_WIDTH, Backend> steps_iv;
+        
+        /// If the path is compressed, the number of steps on it, and otherwise
+        /// 0. A compressed path has empty links_iv and steps_iv. Its steps run
+        /// in order from index 1, so its links are implicit, and each block
+        /// of traversals is bit-packed as offsets from the smallest one.
+        uint64_t compressed_steps = 0;
+        /// Whether the compressed path loops back to its start
+        bool compressed_circular = false;
+        /// The smallest traversal in each block
+        PackedVector<Backend> block_bases_iv;
+        /// The bits used for each step in each block
+        PackedVector<Backend> block_widths_iv;
+        /// The bit in packed_steps_iv where each block starts
+        PackedVector<Backend> block_starts_iv;
+        /// The traversals less their block's base, bit-packed into 32-bit
+        /// words, since PackedVector can't hold the top bit of a 64-bit word
+        PackedVector<Backend> packed_steps_iv;
     };
+    /// The number of steps in a block of a compressed path
+    constexpr static size_t COMPRESSED_BLOCK_SIZE = 32;
     const static size_t PATH_RECORD_SIZE;
     const static size_t PATH_PREV_OFFSET;
     const static size_t PATH_NEXT_OFFSET;
@@ -692,6 +1122,30 @@ private:
     inline char decode_nucleotide(const uint64_t& val) const;
     /// Complement nucleotide encoded as [0, 4]
     inline uint64_t complement_encoded_nucleotide(const uint64_t& val) const;
+    /// Decode len nucleotides of seq_iv beginning at seq_start into out
+    inline void decode_sequence(const size_t& seq_start, const size_t& len, char* out) const;
+    /// Decode the reverse complement of the len nucleotides of seq_iv
+    /// beginning at seq_start into out
+    inline void decode_reverse_complement(const size_t& seq_start, const size_t& len, char* out) const;
+    /// Decode the packed nucleotides without applying the exception runs,
+    /// optionally reverse complemented
+    inline void decode_packed(const size_t& seq_start, const size_t& len, char* out, bool reverse) const;
+    /// Overwrite the bases of the len nucleotides beginning at seq_start that
+    /// are covered by exception runs in out, which holds the decoded sequence,
+    /// optionally reverse complemented
+    inline void apply_exceptions(const size_t& seq_start, const size_t& len, char* out, bool reverse) const;
+    /// Get the index of the first exception run that ends after the given
+    /// position in seq_iv
+    inline size_t first_exception_after(const size_t& position) const;
+    /// Get the character to store as an exception for a nucleotide, or 0 if it
+    /// is an A, C, G or T that seq_iv stores directly
+    inline char exception_char(const char& nt) const;
+    /// Append a node's sequence to seq_iv, recording its exceptions
+    void append_sequence(const string& sequence);
+    /// Reverse the order of the exception runs in the given interval of
+    /// seq_iv and complement their characters, when the interval's sequence
+    /// has been reverse complemented in place
+    void reverse_exceptions(const size_t& seq_start, const size_t& len);
     
     /// Get the integer assignment of a char, or numeric_limits<uint64_t>::max()
     /// if no assignment has been made
@@ -724,17 +1178,190 @@ private:
     inline uint64_t get_step_trav(const PackedPath& path, const uint64_t& step_index) const;
     inline uint64_t get_step_prev(const PackedPath& path, const uint64_t& step_index) const;
     inline uint64_t get_step_next(const PackedPath& path, const uint64_t& step_index) const;
+    /// Call the iteratee with the index of each step on the path, in path
+    /// order. The iteratee returns false to stop, in which case this returns
+    /// false. Follows the links through a page-decoding iterator, so steps
+    /// laid out in order decode each page of links only once.
+    template<typename Iteratee>
+    inline bool for_each_step_index(const int64_t& path_idx, const Iteratee& iteratee) const;
     inline void set_step_trav(PackedPath& path, const uint64_t& step_index, const uint64_t& trav);
     inline void set_step_prev(PackedPath& path, const uint64_t& step_index, const uint64_t& prev_index);
     inline void set_step_next(PackedPath& path, const uint64_t& step_index, const uint64_t& next_index);
     
+    /// Compress the steps of a path, if its links run straight through its
+    /// steps in order, as they do after the path is defragmented. Returns
+    /// true if the path was compressed.
+    bool compress_path(const int64_t& path_idx);
+    /// Restore the steps and links of a path if it is compressed, so that it
+    /// can be changed. The step indexes on the path stay the same.
+    void decompress_path(PackedPath& path);
+    
+    /// Write the linked list records for a run of new steps at the end of a path,
+    /// and fill in the node membership index of each new step. The new head and
+    /// tail of the path are reported rather than stored, so this can be called
+    /// concurrently on different paths.
+    void append_step_records(const path_handle_t& path, const vector<handle_t>& to_append,
+                             uint64_t& head, uint64_t& tail, vector<uint64_t>& node_member_indexes);
+    
+    /// Record the node memberships for a run of new steps on a path, which
+    /// occupy consecutive offsets starting at the given one.
+    void append_membership_records(const path_handle_t& path, const uint64_t& first_step_offset,
+                                   const vector<uint64_t>& node_member_indexes);
+    
     uint64_t deleted_node_records = 0;
     uint64_t deleted_edge_records = 0;
     uint64_t deleted_membership_records = 0;
     uint64_t deleted_bases = 0;
     uint64_t reversing_self_edge_records = 0;
     uint64_t deleted_reversing_self_edge_records = 0;
+    /// The length of the names of deleted paths that are still in the path
+    /// names. Not serialized, so names orphaned before saving are only
+    /// reclaimed by optimize().
+    uint64_t deleted_path_name_length = 0;
+    
+    /// Whether mutating operations defragment the graph when they orphan
+    /// enough records. Not serialized.
+    bool automatic_defragmentation = true;
+    /// Whether optimize() compresses the paths. Not serialized.
+    bool path_compression = false;
+    /// Whether serialize() uses the block-compressed format. Not serialized.
+    bool serialization_compression = false;
+    /// The size of the blocks that serialize() compresses. Not serialized.
+    size_t serialization_block_size = COMPRESSION_BLOCK_SIZE;
+    /// The path that defragment_step() will check first
+    size_t next_path_to_defragment = 0;
+    
+    /// A byte that can be read and written atomically, but that copies by
+    /// value so that the graph stays copyable.
+    struct AtomicByte {
+        AtomicByte(uint8_t value = 0) : value(value) {}
+        AtomicByte(const AtomicByte& other) : value(other.load()) {}
+        AtomicByte& operator=(const AtomicByte& other) {
+            store(other.load());
+            return *this;
+        }
+        AtomicByte& operator=(uint8_t new_value) {
+            store(new_value);
+            return *this;
+        }
+        operator uint8_t() const {
+            return load();
+        }
+        uint8_t load() const {
+            return value.load(std::memory_order_relaxed);
+        }
+        void store(uint8_t new_value) {
+            value.store(new_value, std::memory_order_relaxed);
+        }
+    private:
+        std::atomic<uint8_t> value;
+    };
+    
+    /// Whether the graph is known to have no reversing edges: 0 if not known,
+    /// 1 if it has none, and 2 if it has some. Not serialized. Atomic because
+    /// is_single_stranded() fills it in from const queries, which it only
+    /// does when the graph's memory is writable.
+    mutable AtomicByte single_stranded_state;
+    
+    /// The live paths in the order of their encoded names, for looking up
+    /// paths by name or name prefix. Only valid while path_names_indexed is
+    /// set. Not serialized.
+    PackedVector<Backend> path_name_order_iv;
+    /// One more than the assignment of each character when the path names
+    /// were indexed, or 0 for characters that had none
+    std::array<uint16_t, 256> path_name_char_codes;
+    /// Whether path_name_order_iv matches the current paths
+    bool path_names_indexed = false;
     
+    /*
+     * The paths that were live when the path metadata index was built,
+     * grouped by one field of their metadata.
+     */
+    struct PathMetadataGroups {
+        PathMetadataGroups() = default;
+        
+        /// Fill in the groups from the group of each path, leaving out the
+        /// deleted paths.
+        void assign(const vector<size_t>& path_groups, size_t num_groups,
+                    const PackedVector<Backend>& path_is_deleted_iv);
+        /// Fill in the groups from the name of each path's group, leaving out
+        /// the deleted paths. Groups are numbered in order of name.
+        void assign(const vector<string>& path_group_names,
+                    const PackedVector<Backend>& path_is_deleted_iv);
+        /// Get the number of the group with the given name, or the number of
+        /// groups if there is no such group.
+        size_t find(const string& name) const;
+        /// Get the name of the given group.
+        string get_name(size_t group) const;
+        
+        void clear();
+        void serialize(ostream& out) const;
+        void deserialize(istream& in);
+        size_t memory_usage() const;
+        
+        /// The names of the groups in sorted order, concatenated, if the
+        /// groups are named
+        PackedVector<Backend> names_iv;
+        /// Where each group's name starts in names_iv, and then the length of
+        /// names_iv
+        PackedVector<Backend> name_starts_iv;
+        /// Where each group's paths start in paths_iv, and then the length of
+        /// paths_iv
+        PackedVector<Backend> path_starts_iv;
+        /// The indexes of the paths, group by group, and in order within each
+        /// group
+        PackedVector<Backend> paths_iv;
+        /// The group of each path that was indexed, by path index
+        PackedVector<Backend> path_groups_iv;
+    };
+    
+    /// The indexed paths by PathSense
+    PathMetadataGroups paths_by_sense;
+    /// The indexed paths by sample name
+    PathMetadataGroups paths_by_sample;
+    /// The indexed paths by locus name
+    PathMetadataGroups paths_by_locus;
+    /// The path metadata index covers the paths below this index. Paths
+    /// created since then are checked by parsing their names.
+    size_t path_metadata_indexed_count = 0;
+    /// Whether the path metadata index has been built. Destroying paths
+    /// leaves it usable, since deleted paths are skipped, but renumbering
+    /// paths rebuilds it.
+    bool path_metadata_indexed = false;
+    /// Creating a path rebuilds the path metadata index when more than this
+    /// many paths, or a quarter of the indexed paths, have been created since
+    /// it was built.
+    constexpr static size_t MAX_UNINDEXED_PATHS = 1024;
+
+    ///////////////////////////
+    /// GFA import helpers
+    ///////////////////////////
+
+    /// Read the next batch of lines from a GFA stream, keeping those whose
+    /// record type is one of the given characters, along with their 1-based
+    /// line numbers. Returns false if there were no more such lines.
+    static bool read_gfa_batch(istream& in, const char* types, vector<string>& lines,
+                               vector<size_t>& line_numbers, size_t& line_number);
+
+    /// Split a GFA line into its tab-separated fields.
+    static void split_gfa_line(const string& line, vector<string>& fields);
+
+    /// Parse a segment name as a node ID, if it is a positive integer.
+    static bool parse_gfa_id(const string& name, nid_t& id);
+
+    /// Throw the error for the first line in a batch that had one, if any.
+    static void throw_gfa_error(const vector<string>& errors, const vector<size_t>& line_numbers);
+
+    /// The most lines, and about the most bytes, to read in one GFA batch.
+    constexpr static size_t GFA_BATCH_LINES = 1 << 16;
+    constexpr static size_t GFA_BATCH_BYTES = 1 << 26;
+    
+    /// assign_graph() fetches the sequences of this many nodes at a time
+    constexpr static size_t CONVERSION_BATCH_NODES = 1 << 16;
+    /// assign_graph() collects at least this many path steps at a time,
+    /// unless there aren't that many left
+    constexpr static size_t CONVERSION_BATCH_STEPS = 1 << 24;
+
 public:
     
     /// Debugging function, prints a text representation of the internal coding
@@ -744,6 +1371,10 @@ public:
     /// Debugging function, measures memory and prints a report to an ostream.
     /// Optionally reports memory usage for every path individually.
     void report_memory(ostream& out, bool individual_paths = false) const;
+    
+    /// Measure how many bytes each internal component of the graph takes, as
+    /// a tree of component names and sizes.
+    MemoryBreakdown memory_breakdown() const;
 };
     
 template<typename Backend>    
@@ -791,6 +1422,177 @@ inline char BasePackedGraph<Backend>::decode_nucleotide(const uint64_t& val) con
     return alphabet[val];
 }
 
+/*
+ * Decodes 2-bit packed nucleotides a word at a time
+ */
+struct PackedNucleotideDecoder {
+    
+    /// Get the shared decoder
+    inline static const PackedNucleotideDecoder& get() {
+        static const PackedNucleotideDecoder decoder;
+        return decoder;
+    }
+    
+    /// Decode the 32 nucleotides packed in a word, with the first in the
+    /// lowest bits, into out
+    inline void decode_word(uint64_t word, char* out) const {
+        for (size_t i = 0; i < 8; ++i) {
+            memcpy(out + 4 * i, byte_bases[(word >> (8 * i)) & 0xFF], 4);
+        }
+    }
+    
+    /// Reverse complement the 32 nucleotides packed in a word
+    inline static uint64_t reverse_complement_word(uint64_t word) {
+        // A/T and C/G are bitwise complements of each other in the encoding
+        word = ~word;
+        // reverse the 2-bit fields in each byte, then the bytes
+        word = ((word >> 2) & 0x3333333333333333ull) | ((word & 0x3333333333333333ull) << 2);
+        word = ((word >> 4) & 0x0F0F0F0F0F0F0F0Full) | ((word & 0x0F0F0F0F0F0F0F0Full) << 4);
+        return __builtin_bswap64(word);
+    }
+    
+private:
+    
+    PackedNucleotideDecoder() {
+        static const char* alphabet = "ACGT";
+        for (size_t i = 0; i < 256; ++i) {
+            for (size_t j = 0; j < 4; ++j) {
+                byte_bases[i][j] = alphabet[(i >> (2 * j)) & 3];
+            }
+        }
+    }
+    
+    /// The four nucleotides packed in each possible byte
+    char byte_bases[256][4];
+};
+
+template<typename Backend>
+inline void BasePackedGraph<Backend>::decode_sequence(const size_t& seq_start, const size_t& len, char* out) const {
+    decode_packed(seq_start, len, out, false);
+    apply_exceptions(seq_start, len, out, false);
+}
+
+template<typename Backend>
+inline void BasePackedGraph<Backend>::decode_reverse_complement(const size_t& seq_start, const size_t& len, char* out) const {
+    decode_packed(seq_start, len, out, true);
+    apply_exceptions(seq_start, len, out, true);
+}
+
+template<typename Backend>
+inline void BasePackedGraph<Backend>::decode_packed(const size_t& seq_start, const size_t& len, char* out,
+                                                    bool reverse) const {
+    
+    if (seq_iv.width() == 2) {
+        // decode a full word of 32 bases at a time
+        const PackedNucleotideDecoder& decoder = PackedNucleotideDecoder::get();
+        size_t i = 0;
+        for (; i + 32 <= len; i += 32) {
+            if (reverse) {
+                // the last bases we haven't decoded come out first
+                uint64_t word = seq_iv.get_bits(seq_start + len - i - 32, 32);
+                decoder.decode_word(PackedNucleotideDecoder::reverse_complement_word(word), out + i);
+            }
+            else {
+                decoder.decode_word(seq_iv.get_bits(seq_start + i, 32), out + i);
+            }
+        }
+        if (i < len) {
+            size_t remaining = len - i;
+            uint64_t word;
+            if (reverse) {
+                // the remaining bases are the first ones, and reversing moves
+                // them to the high bits
+                word = PackedNucleotideDecoder::reverse_complement_word(seq_iv.get_bits(seq_start, remaining))
+                    >> (64 - 2 * remaining);
+            }
+            else {
+                word = seq_iv.get_bits(seq_start + i, remaining);
+            }
+            char buffer[32];
+            decoder.decode_word(word, buffer);
+            memcpy(out + i, buffer, remaining);
+        }
+    }
+    else {
+        // the vector is narrower (only A's and C's so far) or wider (N's
+        // stored directly), so decode in chunks so each run of packed bases
+        // is only unpacked once
+        static const size_t chunk_size = 256;
+        uint64_t encoded[chunk_size];
+        for (size_t i = 0; i < len; i += chunk_size) {
+            size_t count = std::min(chunk_size, len - i);
+            seq_iv.get_range(seq_start + i, count, encoded);
+            for (size_t j = 0; j < count; ++j) {
+                out[i + j] = decode_nucleotide(encoded[j]);
+            }
+        }
+        if (reverse) {
+            std::reverse(out, out + len);
+            for (size_t i = 0; i < len; ++i) {
+                out[i] = reverse_complement(out[i]);
+            }
+        }
+    }
+}
+
+template<typename Backend>
+inline size_t BasePackedGraph<Backend>::first_exception_after(const size_t& position) const {
+    // the runs don't overlap, so their ends are sorted along with their starts
+    size_t low = 0, high = seq_exception_start_iv.size();
+    while (low < high) {
+        size_t mid = (low + high) / 2;
+        if (seq_exception_start_iv.get(mid) + seq_exception_length_iv.get(mid) > position) {
+            high = mid;
+        }
+        else {
+            low = mid + 1;
+        }
+    }
+    return low;
+}
+
+template<typename Backend>
+inline void BasePackedGraph<Backend>::apply_exceptions(const size_t& seq_start, const size_t& len, char* out,
+                                                       bool reverse) const {
+    if (seq_exception_start_iv.empty()) {
+        return;
+    }
+    size_t seq_end = seq_start + len;
+    for (size_t i = first_exception_after(seq_start); i < seq_exception_start_iv.size(); ++i) {
+        size_t run_start = seq_exception_start_iv.get(i);
+        if (run_start >= seq_end) {
+            break;
+        }
+        size_t run_end = std::min<size_t>(run_start + seq_exception_length_iv.get(i), seq_end);
+        run_start = std::max(run_start, seq_start);
+        char c = (char) seq_exception_char_iv.get(i);
+        if (reverse) {
+            std::fill(out + (seq_end - run_end), out + (seq_end - run_start), reverse_complement(c));
+        }
+        else {
+            std::fill(out + (run_start - seq_start), out + (run_end - seq_start), c);
+        }
+    }
+}
+
+template<typename Backend>
+inline char BasePackedGraph<Backend>::exception_char(const char& nt) const {
+    switch (nt) {
+        case 'A': case 'C': case 'G': case 'T':
+        case 'a': case 'c': case 'g': case 't':
+            return 0;
+        case 'R': case 'Y': case 'S': case 'W': case 'K': case 'M':
+        case 'B': case 'D': case 'H': case 'V': case 'N':
+            return nt;
+        case 'r': case 'y': case 's': case 'w': case 'k': case 'm':
+        case 'b': case 'd': case 'h': case 'v': case 'n':
+            return nt - 'a' + 'A';
+        default:
+            // anything else isn't a nucleotide
+            return 'N';
+    }
+}
+
 template<typename Backend>
 inline size_t BasePackedGraph<Backend>::graph_iv_index(const handle_t& handle) const {
     return (nid_to_graph_iv.get(get_id(handle) - min_id) - 1) * GRAPH_RECORD_SIZE;
@@ -868,19 +1670,74 @@ inline void BasePackedGraph<Backend>::set_membership_path(const uint64_t& member
 
 template<typename Backend>
 inline uint64_t BasePackedGraph<Backend>::get_step_trav(const PackedPath& path, const uint64_t& step_index) const {
+    if (path.compressed_steps) {
+        size_t block = (step_index - 1) / COMPRESSED_BLOCK_SIZE;
+        uint64_t width = path.block_widths_iv.get(block);
+        uint64_t trav = path.block_bases_iv.get(block);
+        // pull the step's bits out of the words they are in
+        size_t bit = path.block_starts_iv.get(block) + ((step_index - 1) % COMPRESSED_BLOCK_SIZE) * width;
+        for (uint64_t filled = 0; filled < width;) {
+            uint64_t shift = (bit + filled) % 32;
+            uint64_t taking = std::min<uint64_t>(32 - shift, width - filled);
+            uint64_t bits = (path.packed_steps_iv.get((bit + filled) / 32) >> shift) & ((uint64_t(1) << taking) - 1);
+            trav += bits << filled;
+            filled += taking;
+        }
+        return trav;
+    }
     return path.steps_iv.get((step_index - 1) * STEP_RECORD_SIZE);
 }
 
 template<typename Backend>
 inline uint64_t BasePackedGraph<Backend>::get_step_prev(const PackedPath& path, const uint64_t& step_index) const {
+    if (path.compressed_steps) {
+        return step_index > 1 ? step_index - 1 : (path.compressed_circular ? path.compressed_steps : 0);
+    }
     return path.links_iv.get((step_index - 1) * PATH_RECORD_SIZE + PATH_PREV_OFFSET);
 }
 
 template<typename Backend>
 inline uint64_t BasePackedGraph<Backend>::get_step_next(const PackedPath& path, const uint64_t& step_index) const {
+    if (path.compressed_steps) {
+        return step_index < path.compressed_steps ? step_index + 1 : (path.compressed_circular ? 1 : 0);
+    }
     return path.links_iv.get((step_index - 1) * PATH_RECORD_SIZE + PATH_NEXT_OFFSET);
 }
 
+template<typename Backend>
+template<typename Iteratee>
+inline bool BasePackedGraph<Backend>::for_each_step_index(const int64_t& path_idx, const Iteratee& iteratee) const {
+    const PackedPath& path = paths[path_idx];
+    size_t head = path_head_iv.get(path_idx);
+    if (head == 0) {
+        return true;
+    }
+    if (path.compressed_steps) {
+        // the links are implicit, and each step comes once even on a circular path
+        for (size_t here = 1; here <= path.compressed_steps; ++here) {
+            if (!iteratee(here)) {
+                return false;
+            }
+        }
+        return true;
+    }
+    auto next_link = path.links_iv.begin();
+    size_t link_position = 0;
+    bool first_iter = true;
+    for (size_t here = head; here != 0 && (first_iter || here != head); first_iter = false) {
+        if (!iteratee(here)) {
+            return false;
+        }
+        // move the iterator to this step's next link, which stays on the
+        // already-decoded page if the next step was stored right after
+        size_t position = (here - 1) * PATH_RECORD_SIZE + PATH_NEXT_OFFSET;
+        next_link += std::ptrdiff_t(position) - std::ptrdiff_t(link_position);
+        link_position = position;
+        here = *next_link;
+    }
+    return true;
+}
+
 template<typename Backend>
 inline void BasePackedGraph<Backend>::set_step_trav(PackedPath& path, const uint64_t& step_index, const uint64_t& trav) {
     path.steps_iv.set((step_index - 1) * STEP_RECORD_SIZE, trav);
@@ -968,6 +1825,15 @@ const size_t BasePackedGraph<Backend>::PATH_NEXT_OFFSET = 1;
 template<typename Backend>
 const double BasePackedGraph<Backend>::PATH_RESIZE_FACTOR = 1.25;
 
+template<typename Backend>
+constexpr nid_t BasePackedGraph<Backend>::SECTIONED_FORMAT_MARKER;
+template<typename Backend>
+constexpr uint32_t BasePackedGraph<Backend>::SECTIONED_FORMAT_REVISION;
+template<typename Backend>
+constexpr size_t BasePackedGraph<Backend>::COMPRESSION_BLOCK_SIZE;
+template<typename Backend>
+constexpr uint64_t BasePackedGraph<Backend>::COMPRESSED_INDEX_MARKER;
+
 template<typename Backend>
 BasePackedGraph<Backend>::BasePackedGraph() {
     
@@ -989,125 +1855,797 @@ BasePackedGraph<Backend>::~BasePackedGraph() {
 
 template<typename Backend>
 void BasePackedGraph<Backend>::serialize_members(ostream& out) const {
-    sdsl::write_member(max_id, out);
-    sdsl::write_member(min_id, out);
-    
-    graph_iv.serialize(out);
-    seq_start_iv.serialize(out);
-    seq_length_iv.serialize(out);
-    edge_lists_iv.serialize(out);
-    nid_to_graph_iv.serialize(out);
-    seq_iv.serialize(out);
-    
-    path_membership_node_iv.serialize(out);
-    path_membership_id_iv.serialize(out);
-    path_membership_offset_iv.serialize(out);
-    path_membership_next_iv.serialize(out);
-    
-    // it's sufficient to only serialize one direction of the mapping
-    sdsl::write_member(inverse_char_assignment, out);
-    
-    path_names_iv.serialize(out);
-    path_name_start_iv.serialize(out);
-    path_name_length_iv.serialize(out);
-    path_is_deleted_iv.serialize(out);
-    path_is_circular_iv.serialize(out);
-    path_head_iv.serialize(out);
-    path_tail_iv.serialize(out);
-    path_deleted_steps_iv.serialize(out);
-    
-    for (const PackedPath& path : paths) {
-        path.links_iv.serialize(out);
-        path.steps_iv.serialize(out);
-    }
-    // note: path_id can be reconstructed from the paths
-    sdsl::write_member(deleted_node_records, out);
-    sdsl::write_member(deleted_edge_records, out);
-    sdsl::write_member(deleted_membership_records, out);
-    sdsl::write_member(deleted_bases, out);
-    sdsl::write_member(reversing_self_edge_records, out);
-    sdsl::write_member(deleted_reversing_self_edge_records, out);
-}
-
-template<typename Backend>
-void BasePackedGraph<Backend>::deserialize_members(istream& in) {
-    sdsl::read_member(max_id, in);
-    sdsl::read_member(min_id, in);
-    
-    graph_iv.deserialize(in);
-    seq_start_iv.deserialize(in);
-    seq_length_iv.deserialize(in);
-    edge_lists_iv.deserialize(in);
-    nid_to_graph_iv.deserialize(in);
-    seq_iv.deserialize(in);
-    
-    path_membership_node_iv.deserialize(in);
-    path_membership_id_iv.deserialize(in);
-    path_membership_offset_iv.deserialize(in);
-    path_membership_next_iv.deserialize(in);
     
-    sdsl::read_member(inverse_char_assignment, in);
-    // reconstruct the forward char assignments
-    for (size_t i = 0; i < inverse_char_assignment.size(); ++i) {
-        char_assignment[inverse_char_assignment[i]] = i;
-    }
+    // the marker takes the place of the max ID in the unsectioned format
+    sdsl::write_member(SECTIONED_FORMAT_MARKER, out);
+    sdsl::write_member(SECTIONED_FORMAT_REVISION, out);
     
-    path_names_iv.deserialize(in);
-    path_name_start_iv.deserialize(in);
-    path_name_length_iv.deserialize(in);
-    path_is_deleted_iv.deserialize(in);
-    path_is_circular_iv.deserialize(in);
-    path_head_iv.deserialize(in);
-    path_tail_iv.deserialize(in);
-    path_deleted_steps_iv.deserialize(in);
+    uint64_t num_sections = NUM_FIXED_SECTIONS + paths.size();
+    sdsl::write_member(num_sections, out);
     
-    paths.reserve(path_name_start_iv.size());
-    for (size_t i = 0; i < path_name_start_iv.size(); i++) {
-        paths.emplace_back();
-        PackedPath& path = paths.back();
-        path.links_iv.deserialize(in);
-        path.steps_iv.deserialize(in);
+    vector<uint64_t> section_lengths(num_sections);
+    std::streampos table_start = out.tellp();
+    if (table_start != std::streampos(-1)) {
+        // leave room for the table of section lengths, and come back to fill
+        // it in once the sections are written
+        for (const uint64_t& section_length : section_lengths) {
+            sdsl::write_member(section_length, out);
+        }
+        std::streampos section_start = out.tellp();
+        for (size_t i = 0; i < num_sections; ++i) {
+            serialize_section(i, out);
+            std::streampos section_end = out.tellp();
+            section_lengths[i] = section_end - section_start;
+            section_start = section_end;
+        }
+        out.seekp(table_start);
+        for (const uint64_t& section_length : section_lengths) {
+            sdsl::write_member(section_length, out);
+        }
+        out.seekp(section_start);
     }
-    
-    // reconstruct the path_id mapping
-    for (int64_t i = 0; i < paths.size(); i++) {
-        if (!path_is_deleted_iv.get(i)) {
-            path_id[extract_encoded_path_name(i)] = i;
+    else {
+        // we can't go back in this stream, so the table has to be written
+        // before the sections, which means they have to be written to memory
+        // first to measure them
+        vector<string> section_bytes(num_sections);
+        std::exception_ptr error;
+#pragma omp parallel for schedule(dynamic, 1)
+        for (size_t i = 0; i < num_sections; ++i) {
+            try {
+                std::ostringstream section_out;
+                serialize_section(i, section_out);
+                section_bytes[i] = section_out.str();
+            } catch (...) {
+#pragma omp critical (serialize_members_error)
+                {
+                    if (!error) {
+                        error = std::current_exception();
+                    }
+                }
+            }
+        }
+        if (error) {
+            std::rethrow_exception(error);
+        }
+        for (const string& bytes : section_bytes) {
+            sdsl::write_member((uint64_t) bytes.size(), out);
+        }
+        for (string& bytes : section_bytes) {
+            out.write(bytes.data(), bytes.size());
+            // free the buffer
+            string().swap(bytes);
         }
     }
-    
-    sdsl::read_member(deleted_node_records, in);
-    sdsl::read_member(deleted_edge_records, in);
-    sdsl::read_member(deleted_membership_records, in);
-    sdsl::read_member(deleted_bases, in);
-    sdsl::read_member(reversing_self_edge_records, in);
-    sdsl::read_member(deleted_reversing_self_edge_records, in);
-}
-
-template<typename Backend>
-uint32_t BasePackedGraph<Backend>::get_magic_number() const {
-    return 3080648541ul;
 }
 
 template<typename Backend>
-void BasePackedGraph<Backend>::serialize(std::ostream& out) const {
-    // TODO: we're duplicating code from libhandlegraph serialize here, because
-    // we aren't allowed virtual methods.
-    uint32_t magic_number = htonl(get_magic_number());
-    out.write((char*) &magic_number, sizeof(magic_number) / sizeof(char));
-    serialize_members(out);
+void BasePackedGraph<Backend>::serialize_section(size_t section, ostream& out) const {
+    switch (section) {
+        case HEADER_SECTION:
+            sdsl::write_member(max_id, out);
+            sdsl::write_member(min_id, out);
+            // it's sufficient to only serialize one direction of the mapping
+            sdsl::write_member(inverse_char_assignment, out);
+            sdsl::write_member(deleted_node_records, out);
+            sdsl::write_member(deleted_edge_records, out);
+            sdsl::write_member(deleted_membership_records, out);
+            sdsl::write_member(deleted_bases, out);
+            sdsl::write_member(reversing_self_edge_records, out);
+            sdsl::write_member(deleted_reversing_self_edge_records, out);
+            break;
+        case GRAPH_SECTION:
+            graph_iv.serialize(out);
+            break;
+        case SEQ_START_SECTION:
+            seq_start_iv.serialize(out);
+            break;
+        case SEQ_LENGTH_SECTION:
+            seq_length_iv.serialize(out);
+            break;
+        case EDGE_LISTS_SECTION:
+            edge_lists_iv.serialize(out);
+            break;
+        case NID_TO_GRAPH_SECTION:
+            nid_to_graph_iv.serialize(out);
+            break;
+        case SEQ_SECTION:
+            seq_iv.serialize(out);
+            seq_exception_start_iv.serialize(out);
+            seq_exception_length_iv.serialize(out);
+            seq_exception_char_iv.serialize(out);
+            break;
+        case MEMBERSHIP_NODE_SECTION:
+            path_membership_node_iv.serialize(out);
+            break;
+        case MEMBERSHIP_ID_SECTION:
+            path_membership_id_iv.serialize(out);
+            break;
+        case MEMBERSHIP_OFFSET_SECTION:
+            path_membership_offset_iv.serialize(out);
+            break;
+        case MEMBERSHIP_NEXT_SECTION:
+            path_membership_next_iv.serialize(out);
+            break;
+        case PATH_NAMES_SECTION:
+            path_names_iv.serialize(out);
+            break;
+        case PATH_METADATA_SECTION:
+            path_name_start_iv.serialize(out);
+            path_name_length_iv.serialize(out);
+            path_is_deleted_iv.serialize(out);
+            path_is_circular_iv.serialize(out);
+            path_head_iv.serialize(out);
+            path_tail_iv.serialize(out);
+            path_deleted_steps_iv.serialize(out);
+            break;
+        case PATH_METADATA_INDEX_SECTION:
+        {
+            uint64_t indexed_count = path_metadata_indexed ? path_metadata_indexed_count : 0;
+            sdsl::write_member(path_metadata_indexed, out);
+            sdsl::write_member(indexed_count, out);
+            if (path_metadata_indexed) {
+                paths_by_sense.serialize(out);
+                paths_by_sample.serialize(out);
+                paths_by_locus.serialize(out);
+            }
+            break;
+        }
+        default:
+        {
+            // note: path_id can be reconstructed from the paths
+            const PackedPath& path = paths.at(section - NUM_FIXED_SECTIONS);
+            path.links_iv.serialize(out);
+            path.steps_iv.serialize(out);
+            sdsl::write_member(path.compressed_steps, out);
+            if (path.compressed_steps) {
+                sdsl::write_member(path.compressed_circular, out);
+                path.block_bases_iv.serialize(out);
+                path.block_widths_iv.serialize(out);
+                path.block_starts_iv.serialize(out);
+                path.packed_steps_iv.serialize(out);
+            }
+            break;
+        }
+    }
 }
 
 template<typename Backend>
-void BasePackedGraph<Backend>::serialize(const std::string& filename) const {
-    // TODO: we're duplicating code from libhandlegraph serialize here, because
-    // we aren't allowed virtual methods.
-    std::ofstream out(filename);
-    serialize(out);
+void BasePackedGraph<Backend>::deserialize_members(istream& in) {
+    load_members(in, "");
 }
 
 template<typename Backend>
-void BasePackedGraph<Backend>::deserialize(std::istream& in) {
+void BasePackedGraph<Backend>::load_members(istream& in, const string& filename) {
+    
+    single_stranded_state = 0;
+    path_metadata_indexed = false;
+    
+    nid_t first_member;
+    sdsl::read_member(first_member, in);
+    if (first_member != SECTIONED_FORMAT_MARKER) {
+        // this is the original format, which starts with the max ID
+        max_id = first_member;
+        load_unsectioned_members(in);
+        return;
+    }
+    
+    uint32_t revision;
+    sdsl::read_member(revision, in);
+    if (revision > SECTIONED_FORMAT_REVISION) {
+        throw std::runtime_error("error:[BasePackedGraph] serialized graph uses format revision " + std::to_string(revision) +
+                                 ", but only revisions up to " + std::to_string(SECTIONED_FORMAT_REVISION) + " are supported");
+    }
+    
+    uint64_t num_sections;
+    sdsl::read_member(num_sections, in);
+    // older revisions have fewer sections before the paths
+    size_t num_fixed_sections = NUM_FIXED_SECTIONS;
+    if (revision < 3) {
+        num_fixed_sections -= 1;
+    }
+    if (num_sections < num_fixed_sections) {
+        throw std::runtime_error("error:[BasePackedGraph] serialized graph is missing sections");
+    }
+    vector<uint64_t> section_lengths(num_sections);
+    for (uint64_t& section_length : section_lengths) {
+        sdsl::read_member(section_length, in);
+    }
+    
+    // make the paths now so that they can be loaded concurrently
+    paths.reserve(num_sections - num_fixed_sections);
+    for (size_t i = num_fixed_sections; i < num_sections; ++i) {
+        paths.emplace_back();
+    }
+    
+    if (!in) {
+        throw std::runtime_error("error:[BasePackedGraph] header of serialized graph is truncated");
+    }
+    
+    std::exception_ptr error;
+    auto record_error = [&]() {
+#pragma omp critical (load_members_error)
+        {
+            if (!error) {
+                error = std::current_exception();
+            }
+        }
+    };
+    
+    if (!filename.empty()) {
+        // we can reopen the file, so each thread reads its sections directly
+        vector<uint64_t> section_offsets(num_sections);
+        uint64_t offset = in.tellg();
+        for (size_t i = 0; i < num_sections; ++i) {
+            section_offsets[i] = offset;
+            offset += section_lengths[i];
+        }
+        in.seekg(0, std::ios_base::end);
+        if (!in || (uint64_t) in.tellg() < offset) {
+            throw std::runtime_error("error:[BasePackedGraph] serialized graph is truncated");
+        }
+#pragma omp parallel
+        {
+            std::ifstream section_in(filename);
+#pragma omp for schedule(dynamic, 1)
+            for (size_t i = 0; i < num_sections; ++i) {
+                try {
+                    section_in.seekg(section_offsets[i]);
+                    deserialize_section(translate_section(i, revision), section_in, revision);
+                    if (!section_in) {
+                        throw std::runtime_error("error:[BasePackedGraph] section of serialized graph is truncated");
+                    }
+                } catch (...) {
+                    record_error();
+                }
+            }
+        }
+        // leave the stream after the graph, as if we had read it
+        in.seekg(offset);
+    }
+    else {
+        // read the sections sequentially, and decode each of them in its own
+        // task as soon as its bytes are in memory
+        vector<string> section_buffers(num_sections);
+#pragma omp parallel
+#pragma omp single
+        {
+            for (size_t i = 0; i < num_sections; ++i) {
+                section_buffers[i].resize(section_lengths[i]);
+                in.read(&section_buffers[i][0], section_lengths[i]);
+                if (!in) {
+                    try {
+                        throw std::runtime_error("error:[BasePackedGraph] serialized graph is truncated");
+                    } catch (...) {
+                        record_error();
+                    }
+                    break;
+                }
+#pragma omp task firstprivate(i) shared(section_buffers)
+                {
+                    try {
+                        MemoryStreambuf buffer(section_buffers[i].data(), section_buffers[i].size());
+                        istream section_in(&buffer);
+                        deserialize_section(translate_section(i, revision), section_in, revision);
+                        if (!section_in) {
+                            throw std::runtime_error("error:[BasePackedGraph] section of serialized graph is truncated");
+                        }
+                    } catch (...) {
+                        record_error();
+                    }
+                    // free the buffer
+                    string().swap(section_buffers[i]);
+                }
+            }
+        }
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+    
+    index_loaded_paths();
+}
+
+template<typename Backend>
+void BasePackedGraph<Backend>::index_loaded_paths() {
+    // reconstruct the path_id mapping
+    for (int64_t i = 0; i < paths.size(); i++) {
+        if (!path_is_deleted_iv.get(i)) {
+            path_id[extract_encoded_path_name(i)] = i;
+        }
+    }
+    index_path_names();
+    // the saved metadata index may be missing or behind
+    update_path_metadata_index();
+}
+
+template<typename Backend>
+void BasePackedGraph<Backend>::serialize_compressed_members(ostream& out) const {
+    
+    uint64_t num_sections = NUM_FIXED_SECTIONS + paths.size();
+    vector<uint64_t> section_lengths(num_sections);
+    vector<vector<string>> compressed_blocks(num_sections);
+    
+    // each section is written out in its own task, which compresses its
+    // blocks in tasks of their own, so that the big sections are compressed
+    // by many threads while the small ones are still being written
+    size_t block_size = serialization_block_size;
+    std::exception_ptr error;
+#pragma omp parallel
+#pragma omp single
+    {
+        for (size_t i = 0; i < num_sections; ++i) {
+#pragma omp task firstprivate(i) shared(section_lengths, compressed_blocks, error)
+            {
+                std::ostringstream section_out;
+                serialize_section(i, section_out);
+                string bytes = section_out.str();
+                section_lengths[i] = bytes.size();
+                compressed_blocks[i].resize((bytes.size() + block_size - 1) / block_size);
+                for (size_t j = 0; j < compressed_blocks[i].size(); ++j) {
+#pragma omp task firstprivate(i, j) shared(bytes, compressed_blocks, error)
+                    {
+                        try {
+                            size_t offset = j * block_size;
+                            compress_block(bytes.data() + offset, std::min(block_size, bytes.size() - offset),
+                                           compressed_blocks[i][j]);
+                        } catch (...) {
+#pragma omp critical (serialize_compressed_members_error)
+                            {
+                                if (!error) {
+                                    error = std::current_exception();
+                                }
+                            }
+                        }
+                    }
+                }
+                // the block tasks read the section's bytes
+#pragma omp taskwait
+            }
+        }
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+    
+    sdsl::write_member(SECTIONED_FORMAT_REVISION, out);
+    sdsl::write_member((uint64_t) block_size, out);
+    sdsl::write_member(num_sections, out);
+    for (const uint64_t& section_length : section_lengths) {
+        sdsl::write_member(section_length, out);
+    }
+    
+    // each block is prefixed with its length, so that it can be read from a
+    // stream, and the index points from the start of the first block to the
+    // length of each one, so that they can be read from a file in any order.
+    // the header says how long the blocks are, so that the index can be found
+    // without assuming that the graph is the last thing in the file.
+    vector<uint64_t> block_index;
+    uint64_t offset = 0;
+    for (const vector<string>& section_blocks : compressed_blocks) {
+        for (const string& block : section_blocks) {
+            block_index.push_back(offset);
+            offset += sizeof(uint64_t) + block.size();
+        }
+    }
+    sdsl::write_member(offset, out);
+    for (const vector<string>& section_blocks : compressed_blocks) {
+        for (const string& block : section_blocks) {
+            uint64_t block_length = block.size();
+            sdsl::write_member(block_length, out);
+            out.write(block.data(), block_length);
+        }
+    }
+    for (const uint64_t& block_offset : block_index) {
+        sdsl::write_member(block_offset, out);
+    }
+    sdsl::write_member((uint64_t) block_index.size(), out);
+    sdsl::write_member(COMPRESSED_INDEX_MARKER, out);
+}
+
+template<typename Backend>
+void BasePackedGraph<Backend>::load_compressed_members(istream& in, const string& filename) {
+    
+    single_stranded_state = 0;
+    path_metadata_indexed = false;
+    
+    if (!block_compression_available()) {
+        throw std::runtime_error("error:[BasePackedGraph] serialized graph is block-compressed, but libbdsg was built without zlib");
+    }
+    
+    uint32_t revision;
+    sdsl::read_member(revision, in);
+    if (revision > SECTIONED_FORMAT_REVISION) {
+        throw std::runtime_error("error:[BasePackedGraph] serialized graph uses format revision " + std::to_string(revision) +
+                                 ", but only revisions up to " + std::to_string(SECTIONED_FORMAT_REVISION) + " are supported");
+    }
+    uint64_t block_size;
+    sdsl::read_member(block_size, in);
+    uint64_t num_sections;
+    sdsl::read_member(num_sections, in);
+    // older revisions have fewer sections before the paths
+    size_t num_fixed_sections = NUM_FIXED_SECTIONS;
+    if (revision < 3) {
+        num_fixed_sections -= 1;
+    }
+    if (!in || block_size == 0 || num_sections < num_fixed_sections) {
+        throw std::runtime_error("error:[BasePackedGraph] header of compressed graph is corrupt");
+    }
+    vector<uint64_t> section_lengths(num_sections);
+    for (uint64_t& section_length : section_lengths) {
+        sdsl::read_member(section_length, in);
+    }
+    uint64_t blocks_length;
+    sdsl::read_member(blocks_length, in);
+    if (!in) {
+        throw std::runtime_error("error:[BasePackedGraph] header of compressed graph is corrupt");
+    }
+    
+    // make the paths now so that they can be loaded concurrently
+    paths.reserve(num_sections - num_fixed_sections);
+    for (size_t i = num_fixed_sections; i < num_sections; ++i) {
+        paths.emplace_back();
+    }
+    
+    // lay out the blocks of each section in its buffer
+    vector<string> section_buffers(num_sections);
+    vector<std::atomic<size_t>> blocks_remaining(num_sections);
+    vector<size_t> block_sections;
+    for (size_t i = 0; i < num_sections; ++i) {
+        section_buffers[i].resize(section_lengths[i]);
+        size_t num_blocks = (section_lengths[i] + block_size - 1) / block_size;
+        blocks_remaining[i] = num_blocks;
+        for (size_t j = 0; j < num_blocks; ++j) {
+            block_sections.push_back(i);
+        }
+    }
+    vector<size_t> block_offsets(block_sections.size());
+    for (size_t j = 1; j < block_sections.size(); ++j) {
+        block_offsets[j] = block_sections[j] == block_sections[j - 1] ? block_offsets[j - 1] + block_size : 0;
+    }
+    
+    // decompress a block into its section, which is loaded by whichever
+    // thread decompresses the last of its blocks
+    auto load_block = [&](size_t block, const string& compressed) {
+        size_t section = block_sections[block];
+        size_t offset = block_offsets[block];
+        string& buffer = section_buffers[section];
+        decompress_block(compressed.data(), compressed.size(), &buffer[offset],
+                         std::min<size_t>(block_size, buffer.size() - offset));
+        if (--blocks_remaining[section] == 0) {
+            MemoryStreambuf section_buffer(buffer.data(), buffer.size());
+            istream section_in(&section_buffer);
+            deserialize_section(translate_section(section, revision), section_in, revision);
+            // free the buffer
+            string().swap(buffer);
+        }
+    };
+    
+    std::exception_ptr error;
+    auto record_error = [&]() {
+#pragma omp critical (load_compressed_members_error)
+        {
+            if (!error) {
+                error = std::current_exception();
+            }
+        }
+    };
+    
+    if (!filename.empty()) {
+        // the block index comes right after the blocks
+        uint64_t blocks_start = in.tellg();
+        in.seekg(blocks_start + blocks_length);
+        uint64_t num_blocks = block_sections.size();
+        vector<uint64_t> block_index(num_blocks);
+        for (uint64_t& block_offset : block_index) {
+            sdsl::read_member(block_offset, in);
+        }
+        uint64_t index_length, marker;
+        sdsl::read_member(index_length, in);
+        sdsl::read_member(marker, in);
+        if (!in || marker != COMPRESSED_INDEX_MARKER || index_length != num_blocks) {
+            throw std::runtime_error("error:[BasePackedGraph] block index of compressed graph is missing or corrupt");
+        }
+        
+#pragma omp parallel
+        {
+            std::ifstream block_in(filename);
+            string compressed;
+#pragma omp for schedule(dynamic, 1)
+            for (size_t j = 0; j < num_blocks; ++j) {
+                try {
+                    block_in.seekg(blocks_start + block_index[j]);
+                    uint64_t block_length;
+                    sdsl::read_member(block_length, block_in);
+                    compressed.resize(block_length);
+                    block_in.read(&compressed[0], block_length);
+                    if (!block_in) {
+                        throw std::runtime_error("error:[BasePackedGraph] compressed graph is truncated");
+                    }
+                    load_block(j, compressed);
+                } catch (...) {
+                    record_error();
+                }
+            }
+        }
+        // the stream is already after the graph, as if we had read it
+    }
+    else {
+        // read the blocks sequentially, and decompress each of them in its
+        // own task as soon as it is in memory
+        vector<string> compressed_blocks(block_sections.size());
+#pragma omp parallel
+#pragma omp single
+        {
+            for (size_t j = 0; j < compressed_blocks.size(); ++j) {
+                uint64_t block_length;
+                sdsl::read_member(block_length, in);
+                compressed_blocks[j].resize(block_length);
+                in.read(&compressed_blocks[j][0], block_length);
+                if (!in) {
+                    try {
+                        throw std::runtime_error("error:[BasePackedGraph] compressed graph is truncated");
+                    } catch (...) {
+                        record_error();
+                    }
+                    break;
+                }
+#pragma omp task firstprivate(j) shared(compressed_blocks)
+                {
+                    try {
+                        load_block(j, compressed_blocks[j]);
+                    } catch (...) {
+                        record_error();
+                    }
+                    string().swap(compressed_blocks[j]);
+                }
+            }
+        }
+        if (!error) {
+            // skip over the trailing block index
+            uint64_t block_offset, num_blocks, marker;
+            for (size_t j = 0; j < compressed_blocks.size(); ++j) {
+                sdsl::read_member(block_offset, in);
+            }
+            sdsl::read_member(num_blocks, in);
+            sdsl::read_member(marker, in);
+            if (!in || marker != COMPRESSED_INDEX_MARKER || num_blocks != compressed_blocks.size()) {
+                throw std::runtime_error("error:[BasePackedGraph] block index of compressed graph is missing or corrupt");
+            }
+        }
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+    
+    // sections with no bytes have no blocks to trigger their loading
+    for (size_t i = 0; i < num_sections; ++i) {
+        if (section_lengths[i] == 0) {
+            MemoryStreambuf section_buffer(nullptr, 0);
+            istream section_in(&section_buffer);
+            deserialize_section(translate_section(i, revision), section_in, revision);
+        }
+    }
+    
+    index_loaded_paths();
+}
+
+template<typename Backend>
+size_t BasePackedGraph<Backend>::translate_section(size_t section, uint32_t revision) {
+    if (revision < 3 && section >= PATH_METADATA_INDEX_SECTION) {
+        // the path metadata index section didn't exist yet
+        return section + 1;
+    }
+    return section;
+}
+
+template<typename Backend>
+void BasePackedGraph<Backend>::deserialize_section(size_t section, istream& in, uint32_t revision) {
+    switch (section) {
+        case HEADER_SECTION:
+            sdsl::read_member(max_id, in);
+            sdsl::read_member(min_id, in);
+            sdsl::read_member(inverse_char_assignment, in);
+            // reconstruct the forward char assignments
+            for (size_t i = 0; i < inverse_char_assignment.size(); ++i) {
+                char_assignment[inverse_char_assignment[i]] = i;
+            }
+            sdsl::read_member(deleted_node_records, in);
+            sdsl::read_member(deleted_edge_records, in);
+            sdsl::read_member(deleted_membership_records, in);
+            sdsl::read_member(deleted_bases, in);
+            sdsl::read_member(reversing_self_edge_records, in);
+            sdsl::read_member(deleted_reversing_self_edge_records, in);
+            break;
+        case GRAPH_SECTION:
+            graph_iv.deserialize(in);
+            break;
+        case SEQ_START_SECTION:
+            seq_start_iv.deserialize(in);
+            break;
+        case SEQ_LENGTH_SECTION:
+            seq_length_iv.deserialize(in);
+            break;
+        case EDGE_LISTS_SECTION:
+            edge_lists_iv.deserialize(in);
+            break;
+        case NID_TO_GRAPH_SECTION:
+            if (revision >= 5) {
+                nid_to_graph_iv.deserialize(in);
+            }
+            else {
+                deserialize_dense_nid_to_graph(in);
+            }
+            break;
+        case SEQ_SECTION:
+            seq_iv.deserialize(in);
+            if (revision >= 2) {
+                seq_exception_start_iv.deserialize(in);
+                seq_exception_length_iv.deserialize(in);
+                seq_exception_char_iv.deserialize(in);
+            }
+            break;
+        case MEMBERSHIP_NODE_SECTION:
+            path_membership_node_iv.deserialize(in);
+            break;
+        case MEMBERSHIP_ID_SECTION:
+            path_membership_id_iv.deserialize(in);
+            break;
+        case MEMBERSHIP_OFFSET_SECTION:
+            path_membership_offset_iv.deserialize(in);
+            break;
+        case MEMBERSHIP_NEXT_SECTION:
+            path_membership_next_iv.deserialize(in);
+            break;
+        case PATH_NAMES_SECTION:
+            path_names_iv.deserialize(in);
+            break;
+        case PATH_METADATA_SECTION:
+            path_name_start_iv.deserialize(in);
+            path_name_length_iv.deserialize(in);
+            path_is_deleted_iv.deserialize(in);
+            path_is_circular_iv.deserialize(in);
+            path_head_iv.deserialize(in);
+            path_tail_iv.deserialize(in);
+            path_deleted_steps_iv.deserialize(in);
+            break;
+        case PATH_METADATA_INDEX_SECTION:
+        {
+            uint64_t indexed_count;
+            sdsl::read_member(path_metadata_indexed, in);
+            sdsl::read_member(indexed_count, in);
+            path_metadata_indexed_count = indexed_count;
+            if (path_metadata_indexed) {
+                paths_by_sense.deserialize(in);
+                paths_by_sample.deserialize(in);
+                paths_by_locus.deserialize(in);
+            }
+            break;
+        }
+        default:
+        {
+            PackedPath& path = paths.at(section - NUM_FIXED_SECTIONS);
+            path.links_iv.deserialize(in);
+            path.steps_iv.deserialize(in);
+            if (revision >= 4) {
+                sdsl::read_member(path.compressed_steps, in);
+                if (path.compressed_steps) {
+                    sdsl::read_member(path.compressed_circular, in);
+                    path.block_bases_iv.deserialize(in);
+                    path.block_widths_iv.deserialize(in);
+                    path.block_starts_iv.deserialize(in);
+                    path.packed_steps_iv.deserialize(in);
+                }
+            }
+            break;
+        }
+    }
+}
+
+template<typename Backend>
+void BasePackedGraph<Backend>::deserialize_dense_nid_to_graph(istream& in) {
+    PackedDeque<> dense;
+    dense.deserialize(in);
+    nid_to_graph_iv.clear();
+    nid_to_graph_iv.extend_back(dense.size());
+    for (size_t i = 0; i < dense.size(); ++i) {
+        uint64_t value = dense.get(i);
+        if (value) {
+            nid_to_graph_iv.set(i, value);
+        }
+    }
+}
+
+template<typename Backend>
+void BasePackedGraph<Backend>::load_unsectioned_members(istream& in) {
+    sdsl::read_member(min_id, in);
+    
+    graph_iv.deserialize(in);
+    seq_start_iv.deserialize(in);
+    seq_length_iv.deserialize(in);
+    edge_lists_iv.deserialize(in);
+    deserialize_dense_nid_to_graph(in);
+    seq_iv.deserialize(in);
+    
+    path_membership_node_iv.deserialize(in);
+    path_membership_id_iv.deserialize(in);
+    path_membership_offset_iv.deserialize(in);
+    path_membership_next_iv.deserialize(in);
+    
+    sdsl::read_member(inverse_char_assignment, in);
+    // reconstruct the forward char assignments
+    for (size_t i = 0; i < inverse_char_assignment.size(); ++i) {
+        char_assignment[inverse_char_assignment[i]] = i;
+    }
+    
+    path_names_iv.deserialize(in);
+    path_name_start_iv.deserialize(in);
+    path_name_length_iv.deserialize(in);
+    path_is_deleted_iv.deserialize(in);
+    path_is_circular_iv.deserialize(in);
+    path_head_iv.deserialize(in);
+    path_tail_iv.deserialize(in);
+    path_deleted_steps_iv.deserialize(in);
+    
+    paths.reserve(path_name_start_iv.size());
+    for (size_t i = 0; i < path_name_start_iv.size(); i++) {
+        paths.emplace_back();
+        PackedPath& path = paths.back();
+        path.links_iv.deserialize(in);
+        path.steps_iv.deserialize(in);
+    }
+    
+    // reconstruct the path_id mapping
+    for (int64_t i = 0; i < paths.size(); i++) {
+        if (!path_is_deleted_iv.get(i)) {
+            path_id[extract_encoded_path_name(i)] = i;
+        }
+    }
+    index_path_names();
+    update_path_metadata_index();
+    
+    sdsl::read_member(deleted_node_records, in);
+    sdsl::read_member(deleted_edge_records, in);
+    sdsl::read_member(deleted_membership_records, in);
+    sdsl::read_member(deleted_bases, in);
+    sdsl::read_member(reversing_self_edge_records, in);
+    sdsl::read_member(deleted_reversing_self_edge_records, in);
+}
+
+template<typename Backend>
+uint32_t BasePackedGraph<Backend>::get_magic_number() const {
+    return 3080648541ul;
+}
+
+template<typename Backend>
+uint32_t BasePackedGraph<Backend>::get_compressed_magic_number() const {
+    return 2773406081ul;
+}
+
+template<typename Backend>
+void BasePackedGraph<Backend>::serialize(std::ostream& out) const {
+    // TODO: we're duplicating code from libhandlegraph serialize here, because
+    // we aren't allowed virtual methods.
+    uint32_t magic_number = htonl(serialization_compression ? get_compressed_magic_number() : get_magic_number());
+    out.write((char*) &magic_number, sizeof(magic_number) / sizeof(char));
+    if (serialization_compression) {
+        serialize_compressed_members(out);
+    }
+    else {
+        serialize_members(out);
+    }
+}
+
+template<typename Backend>
+void BasePackedGraph<Backend>::serialize(const std::string& filename) const {
+    // TODO: we're duplicating code from libhandlegraph serialize here, because
+    // we aren't allowed virtual methods.
+    std::ofstream out(filename);
+    serialize(out);
+}
+
+template<typename Backend>
+bool BasePackedGraph<Backend>::check_magic_number(std::istream& in) const {
     // This is simplified from the libhandelgraph version
     
     // Make sure our byte wrangling is likely to work
@@ -1118,30 +2656,646 @@ void BasePackedGraph<Backend>::deserialize(std::istream& in) {
     in.read(magic_bytes, 4);
     
     uint32_t magic_number = ntohl(*((uint32_t*) magic_bytes));
+    if (magic_number == get_compressed_magic_number()) {
+        return true;
+    }
     if (magic_number != get_magic_number()) {
         throw std::runtime_error("Serialized object is not a BasePackedGraph.");
     }
-    deserialize_members(in);
+    return false;
+}
+
+template<typename Backend>
+void BasePackedGraph<Backend>::deserialize(std::istream& in) {
+    if (check_magic_number(in)) {
+        load_compressed_members(in, "");
+    }
+    else {
+        load_members(in, "");
+    }
+}
+
+template<typename Backend>
+void BasePackedGraph<Backend>::deserialize(const std::string& filename) {
+    // TODO: we're duplicating code from libhandlegraph serialize here, because
+    // we aren't allowed virtual methods.
+    std::ifstream in(filename);
+    // give the filename along so that we can load sections in parallel
+    if (check_magic_number(in)) {
+        load_compressed_members(in, filename);
+    }
+    else {
+        load_members(in, filename);
+    }
+}
+
+template<typename Backend>
+void BasePackedGraph<Backend>::serialize(std::ostream& out) {
+    // Just use const serialization
+    ((const BasePackedGraph<Backend>*) this)->serialize(out);
+}
+
+template<typename Backend>
+void BasePackedGraph<Backend>::serialize(const std::string& filename) {
+    // Just use const serialization
+    ((const BasePackedGraph<Backend>*) this)->serialize(filename);
+}
+
+template<typename Backend>
+void BasePackedGraph<Backend>::load_gfa(const std::string& filename) {
+    std::ifstream in(filename);
+    if (!in) {
+        throw std::runtime_error("error:[BasePackedGraph] could not open GFA file " + filename);
+    }
+    load_gfa(in);
+}
+
+template<typename Backend>
+void BasePackedGraph<Backend>::load_gfa(std::istream& in) {
+
+    auto start = in.tellg();
+    if (start == std::istream::pos_type(-1)) {
+        throw std::runtime_error("error:[BasePackedGraph] GFA import needs a seekable stream");
+    }
+
+    clear();
+
+    // count up the records in a first pass, so that we can size our vectors
+    // once instead of growing them as we go
+    size_t num_segments = 0;
+    size_t total_seq_len = 0;
+    size_t num_links = 0;
+    size_t num_steps = 0;
+    bool numeric_names = true;
+    nid_t min_name = std::numeric_limits<nid_t>::max();
+    nid_t max_name = 0;
+    vector<string> lines;
+    vector<size_t> line_numbers;
+    size_t line_number = 0;
+    vector<string> fields;
+    while (read_gfa_batch(in, "SLPW", lines, line_numbers, line_number)) {
+        for (size_t i = 0; i < lines.size(); ++i) {
+            const string& line = lines[i];
+            if (line[0] == 'L') {
+                ++num_links;
+                continue;
+            }
+            split_gfa_line(line, fields);
+            if (fields.size() < (line[0] == 'W' ? 7 : 3)) {
+                throw_gfa_error(vector<string>(1, "too few fields"), vector<size_t>(1, line_numbers[i]));
+            }
+            if (line[0] == 'S') {
+                ++num_segments;
+                total_seq_len += fields[2].size();
+                nid_t id;
+                if (numeric_names && parse_gfa_id(fields[1], id)) {
+                    min_name = std::min(min_name, id);
+                    max_name = std::max(max_name, id);
+                }
+                else {
+                    numeric_names = false;
+                }
+            }
+            else if (line[0] == 'P') {
+                num_steps += std::count(fields[2].begin(), fields[2].end(), ',') + 1;
+            }
+            else {
+                num_steps += std::count(fields[6].begin(), fields[6].end(), '>') + std::count(fields[6].begin(), fields[6].end(), '<');
+            }
+        }
+    }
+    if (in.bad()) {
+        throw std::runtime_error("error:[BasePackedGraph] could not read GFA from stream");
+    }
+
+    graph_iv.reserve(num_segments * GRAPH_RECORD_SIZE);
+    seq_start_iv.reserve(num_segments * SEQ_START_RECORD_SIZE);
+    seq_length_iv.reserve(num_segments * SEQ_LENGTH_RECORD_SIZE);
+    path_membership_node_iv.reserve(num_segments * NODE_MEMBER_RECORD_SIZE);
+    if (num_segments != 0) {
+        nid_to_graph_iv.reserve(numeric_names ? max_name - min_name + 1 : num_segments);
+    }
+    seq_iv.reserve(total_seq_len);
+    // each link is recorded on both of the sides it joins
+    edge_lists_iv.reserve(2 * num_links * EDGE_RECORD_SIZE);
+    path_membership_id_iv.reserve(num_steps * MEMBERSHIP_ID_RECORD_SIZE);
+    path_membership_offset_iv.reserve(num_steps * MEMBERSHIP_OFFSET_RECORD_SIZE);
+    path_membership_next_iv.reserve(num_steps * MEMBERSHIP_NEXT_RECORD_SIZE);
+
+    // make the nodes in a second pass, so that they all exist before anything
+    // refers to them
+    unordered_map<string, nid_t> segment_ids;
+    in.clear();
+    in.seekg(start);
+    line_number = 0;
+    while (read_gfa_batch(in, "S", lines, line_numbers, line_number)) {
+        vector<string> names(lines.size());
+        vector<string> sequences(lines.size());
+        vector<string> errors(lines.size());
+#pragma omp parallel for
+        for (size_t i = 0; i < lines.size(); ++i) {
+            vector<string> segment_fields;
+            split_gfa_line(lines[i], segment_fields);
+            if (segment_fields[2] == "*") {
+                errors[i] = "segment " + segment_fields[1] + " has no sequence";
+            }
+            else {
+                names[i] = std::move(segment_fields[1]);
+                sequences[i] = std::move(segment_fields[2]);
+            }
+        }
+        throw_gfa_error(errors, line_numbers);
+
+        for (size_t i = 0; i < lines.size(); ++i) {
+            nid_t id;
+            if (numeric_names) {
+                parse_gfa_id(names[i], id);
+            }
+            else {
+                id = segment_ids.size() + 1;
+                if (!segment_ids.emplace(names[i], id).second) {
+                    throw_gfa_error(vector<string>(1, "segment " + names[i] + " is defined more than once"),
+                                    vector<size_t>(1, line_numbers[i]));
+                }
+            }
+            if (has_node(id)) {
+                throw_gfa_error(vector<string>(1, "segment " + names[i] + " is defined more than once"),
+                                vector<size_t>(1, line_numbers[i]));
+            }
+            create_handle(sequences[i], id);
+        }
+    }
+
+    // find the node for a segment name, which is safe to do from many threads
+    // now that the nodes are all made
+    auto get_segment_handle = [&](const string& name, bool is_reverse, handle_t& handle) {
+        nid_t id = 0;
+        if (numeric_names) {
+            if (!parse_gfa_id(name, id) || !has_node(id)) {
+                return false;
+            }
+        }
+        else {
+            auto found = segment_ids.find(name);
+            if (found == segment_ids.end()) {
+                return false;
+            }
+            id = found->second;
+        }
+        handle = get_handle(id, is_reverse);
+        return true;
+    };
+
+    // add the links and paths in a third pass
+    in.clear();
+    in.seekg(start);
+    line_number = 0;
+    while (read_gfa_batch(in, "LPW", lines, line_numbers, line_number)) {
+        vector<pair<handle_t, handle_t>> links(lines.size());
+        vector<string> path_names(lines.size());
+        vector<vector<handle_t>> path_steps(lines.size());
+        vector<size_t> haplotypes(lines.size());
+        vector<subrange_t> subranges(lines.size());
+        vector<string> loci(lines.size());
+        vector<string> errors(lines.size());
+#pragma omp parallel for schedule(dynamic, 1)
+        for (size_t i = 0; i < lines.size(); ++i) {
+            vector<string> record_fields;
+            split_gfa_line(lines[i], record_fields);
+            string& error = errors[i];
+            if (lines[i][0] == 'L') {
+                if (record_fields.size() < 5) {
+                    error = "too few fields";
+                }
+                else if ((record_fields[2] != "+" && record_fields[2] != "-") ||
+                         (record_fields[4] != "+" && record_fields[4] != "-")) {
+                    error = "link has an invalid orientation";
+                }
+                else if (record_fields.size() > 5 && record_fields[5] != "*" && record_fields[5] != "0M") {
+                    error = "link has overlap " + record_fields[5] + ", but only 0M overlaps are supported";
+                }
+                else if (!get_segment_handle(record_fields[1], record_fields[2] == "-", links[i].first)) {
+                    error = "link refers to missing segment " + record_fields[1];
+                }
+                else if (!get_segment_handle(record_fields[3], record_fields[4] == "-", links[i].second)) {
+                    error = "link refers to missing segment " + record_fields[3];
+                }
+            }
+            else if (lines[i][0] == 'P') {
+                // P name seg+,seg-,... overlaps
+                if (record_fields.size() > 3 && record_fields[3] != "*") {
+                    size_t begin = 0;
+                    while (begin <= record_fields[3].size()) {
+                        size_t end = std::min(record_fields[3].find(',', begin), record_fields[3].size());
+                        string overlap = record_fields[3].substr(begin, end - begin);
+                        if (overlap != "0M" && overlap != "*") {
+                            error = "path has overlap " + overlap + ", but only 0M overlaps are supported";
+                            break;
+                        }
+                        begin = end + 1;
+                    }
+                }
+                const string& segments = record_fields[2];
+                size_t begin = 0;
+                while (error.empty() && begin < segments.size()) {
+                    size_t end = std::min(segments.find(',', begin), segments.size());
+                    handle_t handle;
+                    if (end - begin < 2 || (segments[end - 1] != '+' && segments[end - 1] != '-')) {
+                        error = "path has an invalid step " + segments.substr(begin, end - begin);
+                    }
+                    else if (!get_segment_handle(segments.substr(begin, end - begin - 1), segments[end - 1] == '-', handle)) {
+                        error = "path refers to missing segment " + segments.substr(begin, end - begin - 1);
+                    }
+                    else {
+                        path_steps[i].push_back(handle);
+                    }
+                    begin = end + 1;
+                }
+                path_names[i] = std::move(record_fields[1]);
+            }
+            else {
+                // W sample haplotype sequence start end walk
+                nid_t number;
+                haplotypes[i] = parse_gfa_id(record_fields[2], number) ? number : 0;
+                if (record_fields[2] != "0" && haplotypes[i] == 0) {
+                    error = "walk has an invalid haplotype " + record_fields[2];
+                }
+                subranges[i] = PathMetadata::NO_SUBRANGE;
+                if (record_fields[4] != "*" && record_fields[4] != "0") {
+                    nid_t end_position;
+                    if (!parse_gfa_id(record_fields[4], number)) {
+                        error = "walk has an invalid start " + record_fields[4];
+                    }
+                    else if (record_fields[5] == "*") {
+                        subranges[i] = subrange_t(number, PathMetadata::NO_END_POSITION);
+                    }
+                    else if (!parse_gfa_id(record_fields[5], end_position)) {
+                        error = "walk has an invalid end " + record_fields[5];
+                    }
+                    else {
+                        subranges[i] = subrange_t(number, end_position);
+                    }
+                }
+                const string& walk = record_fields[6];
+                size_t begin = 0;
+                while (error.empty() && begin < walk.size()) {
+                    size_t end = walk.find_first_of("<>", begin + 1);
+                    if (end == string::npos) {
+                        end = walk.size();
+                    }
+                    handle_t handle;
+                    if (end - begin < 2 || (walk[begin] != '>' && walk[begin] != '<')) {
+                        error = "walk has an invalid step " + walk.substr(begin, end - begin);
+                    }
+                    else if (!get_segment_handle(walk.substr(begin + 1, end - begin - 1), walk[begin] == '<', handle)) {
+                        error = "walk refers to missing segment " + walk.substr(begin + 1, end - begin - 1);
+                    }
+                    else {
+                        path_steps[i].push_back(handle);
+                    }
+                    begin = end;
+                }
+                path_names[i] = std::move(record_fields[1]);
+                loci[i] = std::move(record_fields[3]);
+            }
+        }
+        throw_gfa_error(errors, line_numbers);
+
+        // the graph structure can only be changed from one thread, except
+        // for filling in the steps of distinct paths
+        vector<path_handle_t> batch_paths;
+        vector<vector<handle_t>> batch_steps;
+        for (size_t i = 0; i < lines.size(); ++i) {
+            if (lines[i][0] == 'L') {
+                create_edge(links[i].first, links[i].second);
+                continue;
+            }
+            if (lines[i][0] == 'P') {
+                if (has_path(path_names[i])) {
+                    throw_gfa_error(vector<string>(1, "path " + path_names[i] + " is defined more than once"),
+                                    vector<size_t>(1, line_numbers[i]));
+                }
+                batch_paths.push_back(create_path_handle(path_names[i]));
+            }
+            else {
+                batch_paths.push_back(create_path(PathSense::HAPLOTYPE, path_names[i], loci[i], haplotypes[i],
+                                                  PathMetadata::NO_PHASE_BLOCK, subranges[i]));
+            }
+            batch_steps.emplace_back(std::move(path_steps[i]));
+        }
+        append_steps(batch_paths, batch_steps);
+    }
+    if (in.bad()) {
+        throw std::runtime_error("error:[BasePackedGraph] could not read GFA from stream");
+    }
+}
+
+template<typename Backend>
+bool BasePackedGraph<Backend>::read_gfa_batch(istream& in, const char* types, vector<string>& lines,
+                                              vector<size_t>& line_numbers, size_t& line_number) {
+    lines.clear();
+    line_numbers.clear();
+    size_t batch_bytes = 0;
+    string line;
+    while (lines.size() < GFA_BATCH_LINES && batch_bytes < GFA_BATCH_BYTES && getline(in, line)) {
+        ++line_number;
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        if (!line.empty() && strchr(types, line[0]) != nullptr) {
+            batch_bytes += line.size();
+            lines.emplace_back(std::move(line));
+            line_numbers.push_back(line_number);
+        }
+    }
+    return !lines.empty();
 }
 
 template<typename Backend>
-void BasePackedGraph<Backend>::deserialize(const std::string& filename) {
-    // TODO: we're duplicating code from libhandlegraph serialize here, because
-    // we aren't allowed virtual methods.
-    std::ifstream in(filename);
-    deserialize(in);
+void BasePackedGraph<Backend>::split_gfa_line(const string& line, vector<string>& fields) {
+    fields.clear();
+    size_t begin = 0;
+    while (true) {
+        size_t end = line.find('\t', begin);
+        if (end == string::npos) {
+            fields.emplace_back(line, begin);
+            break;
+        }
+        fields.emplace_back(line, begin, end - begin);
+        begin = end + 1;
+    }
 }
 
 template<typename Backend>
-void BasePackedGraph<Backend>::serialize(std::ostream& out) {
-    // Just use const serialization
-    ((const BasePackedGraph<Backend>*) this)->serialize(out);
+bool BasePackedGraph<Backend>::parse_gfa_id(const string& name, nid_t& id) {
+    // leave out leading zeros, so that each ID has only one name, and
+    // anything long enough that it could overflow
+    if (name.empty() || name.size() > 18 || name[0] == '0') {
+        return false;
+    }
+    id = 0;
+    for (char c : name) {
+        if (c < '0' || c > '9') {
+            return false;
+        }
+        id = id * 10 + (c - '0');
+    }
+    return true;
 }
 
 template<typename Backend>
-void BasePackedGraph<Backend>::serialize(const std::string& filename) {
-    // Just use const serialization
-    ((const BasePackedGraph<Backend>*) this)->serialize(filename);
+void BasePackedGraph<Backend>::throw_gfa_error(const vector<string>& errors, const vector<size_t>& line_numbers) {
+    for (size_t i = 0; i < errors.size(); ++i) {
+        if (!errors[i].empty()) {
+            throw std::runtime_error("error:[BasePackedGraph] malformed GFA on line " + std::to_string(line_numbers[i])
+                                     + ": " + errors[i]);
+        }
+    }
+}
+
+template<typename Backend>
+template<typename OtherBackend>
+void BasePackedGraph<Backend>::assign(const BasePackedGraph<OtherBackend>& other) {
+    
+    clear();
+    
+    max_id = other.max_id;
+    min_id = other.min_id;
+    inverse_char_assignment = other.inverse_char_assignment;
+    char_assignment.clear();
+    for (size_t i = 0; i < inverse_char_assignment.size(); ++i) {
+        char_assignment[inverse_char_assignment[i]] = i;
+    }
+    deleted_node_records = other.deleted_node_records;
+    deleted_edge_records = other.deleted_edge_records;
+    deleted_membership_records = other.deleted_membership_records;
+    deleted_bases = other.deleted_bases;
+    reversing_self_edge_records = other.reversing_self_edge_records;
+    deleted_reversing_self_edge_records = other.deleted_reversing_self_edge_records;
+    deleted_path_name_length = other.deleted_path_name_length;
+    automatic_defragmentation = other.automatic_defragmentation;
+    path_compression = other.path_compression;
+    serialization_compression = other.serialization_compression;
+    serialization_block_size = other.serialization_block_size;
+    next_path_to_defragment = other.next_path_to_defragment;
+    single_stranded_state = other.single_stranded_state.load();
+    path_name_char_codes = other.path_name_char_codes;
+    
+    // make all the paths first, so that they can be filled in concurrently
+    paths.resize(other.paths.size());
+    
+    auto copy_groups = [](PathMetadataGroups& to, const typename BasePackedGraph<OtherBackend>::PathMetadataGroups& from) {
+        to.names_iv = from.names_iv;
+        to.name_starts_iv = from.name_starts_iv;
+        to.path_starts_iv = from.path_starts_iv;
+        to.paths_iv = from.paths_iv;
+        to.path_groups_iv = from.path_groups_iv;
+    };
+    
+    // none of the structures share anything, so they can be copied at the
+    // same time; the biggest ones go first
+#pragma omp parallel
+    {
+#pragma omp single
+        {
+#pragma omp task
+            seq_iv = other.seq_iv;
+#pragma omp task
+            edge_lists_iv = other.edge_lists_iv;
+#pragma omp task
+            path_membership_id_iv = other.path_membership_id_iv;
+#pragma omp task
+            path_membership_offset_iv = other.path_membership_offset_iv;
+#pragma omp task
+            path_membership_next_iv = other.path_membership_next_iv;
+#pragma omp task
+            graph_iv = other.graph_iv;
+#pragma omp task
+            seq_start_iv = other.seq_start_iv;
+#pragma omp task
+            seq_length_iv = other.seq_length_iv;
+#pragma omp task
+            nid_to_graph_iv = other.nid_to_graph_iv;
+#pragma omp task
+            path_membership_node_iv = other.path_membership_node_iv;
+#pragma omp task
+            {
+                seq_exception_start_iv = other.seq_exception_start_iv;
+                seq_exception_length_iv = other.seq_exception_length_iv;
+                seq_exception_char_iv = other.seq_exception_char_iv;
+            }
+#pragma omp task
+            {
+                path_names_iv = other.path_names_iv;
+                path_name_start_iv = other.path_name_start_iv;
+                path_name_length_iv = other.path_name_length_iv;
+                path_is_deleted_iv = other.path_is_deleted_iv;
+                path_is_circular_iv = other.path_is_circular_iv;
+                path_head_iv = other.path_head_iv;
+                path_tail_iv = other.path_tail_iv;
+                path_deleted_steps_iv = other.path_deleted_steps_iv;
+                path_name_order_iv = other.path_name_order_iv;
+            }
+#pragma omp task
+            {
+                copy_groups(paths_by_sense, other.paths_by_sense);
+                copy_groups(paths_by_sample, other.paths_by_sample);
+                copy_groups(paths_by_locus, other.paths_by_locus);
+            }
+            for (size_t i = 0; i < paths.size(); ++i) {
+#pragma omp task
+                {
+                    PackedPath& path = paths[i];
+                    const auto& other_path = other.paths[i];
+                    path.links_iv = other_path.links_iv;
+                    path.steps_iv = other_path.steps_iv;
+                    path.compressed_steps = other_path.compressed_steps;
+                    path.compressed_circular = other_path.compressed_circular;
+                    path.block_bases_iv = other_path.block_bases_iv;
+                    path.block_widths_iv = other_path.block_widths_iv;
+                    path.block_starts_iv = other_path.block_starts_iv;
+                    path.packed_steps_iv = other_path.packed_steps_iv;
+                }
+            }
+        }
+    }
+    
+    // the name lookup table is keyed by our own vectors, so it has to be
+    // rebuilt, as when loading
+    for (int64_t i = 0; i < paths.size(); i++) {
+        if (!path_is_deleted_iv.get(i)) {
+            path_id[extract_encoded_path_name(i)] = i;
+        }
+    }
+    path_names_indexed = other.path_names_indexed;
+    path_metadata_indexed_count = other.path_metadata_indexed_count;
+    path_metadata_indexed = other.path_metadata_indexed;
+}
+
+template<typename Backend>
+template<typename Graph>
+void BasePackedGraph<Backend>::assign_graph(const Graph& other) {
+    
+    clear();
+    
+    // put the nodes in ID order
+    vector<pair<nid_t, handle_t>> nodes;
+    nodes.reserve(other.get_node_count());
+    other.for_each_handle_fast([&](const handle_t& handle) {
+        nodes.emplace_back(other.get_id(handle), handle);
+    });
+    std::sort(nodes.begin(), nodes.end(), [](const pair<nid_t, handle_t>& a, const pair<nid_t, handle_t>& b) {
+        return a.first < b.first;
+    });
+    
+    // measure everything so we can size our vectors once
+    size_t total_seq_len = 0;
+    size_t num_edge_records = 0;
+#pragma omp parallel for reduction(+:total_seq_len, num_edge_records)
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        total_seq_len += other.get_length(nodes[i].second);
+        for (const handle_t& side : {nodes[i].second, other.flip(nodes[i].second)}) {
+            other.follow_edges_fast(side, false, [&](const handle_t& next) {
+                ++num_edge_records;
+            });
+        }
+    }
+    
+    graph_iv.reserve(nodes.size() * GRAPH_RECORD_SIZE);
+    seq_start_iv.reserve(nodes.size() * SEQ_START_RECORD_SIZE);
+    seq_length_iv.reserve(nodes.size() * SEQ_LENGTH_RECORD_SIZE);
+    path_membership_node_iv.reserve(nodes.size() * NODE_MEMBER_RECORD_SIZE);
+    if (!nodes.empty()) {
+        nid_to_graph_iv.reserve(nodes.back().first - nodes.front().first + 1);
+    }
+    seq_iv.reserve(total_seq_len);
+    // each edge gets a record for each time it is listed
+    edge_lists_iv.reserve(num_edge_records * EDGE_RECORD_SIZE);
+    
+    // fetch the sequences in parallel, in batches, and make the nodes
+    vector<string> sequences;
+    for (size_t batch_start = 0; batch_start < nodes.size(); batch_start += CONVERSION_BATCH_NODES) {
+        size_t batch_end = std::min(nodes.size(), batch_start + CONVERSION_BATCH_NODES);
+        sequences.resize(batch_end - batch_start);
+#pragma omp parallel for
+        for (size_t i = batch_start; i < batch_end; ++i) {
+            sequences[i - batch_start] = other.get_sequence(nodes[i].second);
+        }
+        for (size_t i = batch_start; i < batch_end; ++i) {
+            create_handle(sequences[i - batch_start], nodes[i].first);
+        }
+    }
+    
+    // write each side's edge list directly, in the same order as the other
+    // graph lists them, since we know there are no duplicates
+    bool reversing = false;
+    vector<handle_t> targets;
+    for (const pair<nid_t, handle_t>& node : nodes) {
+        handle_t here = get_handle(node.first, false);
+        for (bool is_reverse : {false, true}) {
+            targets.clear();
+            other.follow_edges_fast(is_reverse ? other.flip(node.second) : node.second, false,
+                                    [&](const handle_t& next) {
+                targets.push_back(get_handle(other.get_id(next), other.get_is_reverse(next)));
+            });
+            size_t g_iv_side = graph_iv_index(here) + (is_reverse ? GRAPH_START_EDGES_OFFSET : GRAPH_END_EDGES_OFFSET);
+            // each record becomes the head of the list, so go backward
+            for (auto it = targets.rbegin(); it != targets.rend(); ++it) {
+                edge_lists_iv.append(encode_traversal(*it));
+                edge_lists_iv.append(graph_iv.get(g_iv_side));
+                graph_iv.set(g_iv_side, edge_lists_iv.size() / EDGE_RECORD_SIZE);
+                if (get_is_reverse(*it) != is_reverse) {
+                    reversing = true;
+                }
+                if (*it == (is_reverse ? here : flip(here))) {
+                    ++reversing_self_edge_records;
+                }
+            }
+        }
+    }
+    single_stranded_state = reversing ? 2 : 1;
+    
+    // get all the paths, including haplotypes
+    vector<path_handle_t> other_paths;
+    size_t num_steps = 0;
+    other.for_each_path_matching(nullptr, nullptr, nullptr, [&](const path_handle_t& path) {
+        other_paths.push_back(path);
+        num_steps += other.get_step_count(path);
+    });
+    path_membership_id_iv.reserve(num_steps * MEMBERSHIP_ID_RECORD_SIZE);
+    path_membership_offset_iv.reserve(num_steps * MEMBERSHIP_OFFSET_RECORD_SIZE);
+    path_membership_next_iv.reserve(num_steps * MEMBERSHIP_NEXT_RECORD_SIZE);
+    
+    // collect the steps of batches of paths in parallel, and add them
+    vector<path_handle_t> batch_paths;
+    vector<vector<handle_t>> batch_steps;
+    size_t next_path = 0;
+    while (next_path < other_paths.size()) {
+        size_t batch_end = next_path;
+        size_t batch_size = 0;
+        while (batch_end < other_paths.size() && (batch_end == next_path || batch_size < CONVERSION_BATCH_STEPS)) {
+            batch_size += other.get_step_count(other_paths[batch_end]);
+            ++batch_end;
+        }
+        batch_paths.clear();
+        for (size_t i = next_path; i < batch_end; ++i) {
+            batch_paths.push_back(create_path_handle(other.get_path_name(other_paths[i]),
+                                                     other.get_is_circular(other_paths[i])));
+        }
+        batch_steps.clear();
+        batch_steps.resize(batch_end - next_path);
+#pragma omp parallel for schedule(dynamic, 1)
+        for (size_t i = next_path; i < batch_end; ++i) {
+            vector<handle_t>& steps = batch_steps[i - next_path];
+            steps.reserve(other.get_step_count(other_paths[i]));
+            other.for_each_step_in_path(other_paths[i], [&](const step_handle_t& step) {
+                handle_t handle = other.get_handle_of_step(step);
+                steps.push_back(get_handle(other.get_id(handle), other.get_is_reverse(handle)));
+            });
+        }
+        append_steps(batch_paths, batch_steps);
+        next_path = batch_end;
+    }
 }
 
 template<typename Backend>
@@ -1164,13 +3318,11 @@ size_t BasePackedGraph<Backend>::new_node_record(nid_t node_id) {
     if (nid_to_graph_iv.empty()) {
         nid_to_graph_iv.append_back(0);
     }
-    else {
-        for (int64_t i = node_id; i < min_id; i++) {
-            nid_to_graph_iv.append_front(0);
-        }
-        for (int64_t i = nid_to_graph_iv.size(); i <= node_id - min_id; i++) {
-            nid_to_graph_iv.append_back(0);
-        }
+    else if (node_id < min_id) {
+        nid_to_graph_iv.extend_front(min_id - node_id);
+    }
+    else if (node_id - min_id >= nid_to_graph_iv.size()) {
+        nid_to_graph_iv.extend_back(node_id - min_id + 1 - nid_to_graph_iv.size());
     }
     
     // update the min and max ID
@@ -1204,11 +3356,90 @@ handle_t BasePackedGraph<Backend>::create_handle(const string& sequence, const n
     seq_length_iv.set(graph_index_to_seq_len_index(g_iv_idx), sequence.size());
     
     // encode the sequence interval
+    append_sequence(sequence);
+    
+    return get_handle(id);
+}
+
+template<typename Backend>
+void BasePackedGraph<Backend>::append_sequence(const string& sequence) {
+    
+    size_t seq_start = seq_iv.size();
+    bool in_run = false;
     for (size_t i = 0; i < sequence.size(); i++) {
-        seq_iv.append(encode_nucleotide(sequence[i]));
+        char exception = exception_char(sequence[i]);
+        if (exception) {
+            size_t last = seq_exception_start_iv.size() - 1;
+            if (in_run && seq_exception_char_iv.get(last) == exception) {
+                // extend the run
+                seq_exception_length_iv.set(last, seq_exception_length_iv.get(last) + 1);
+            }
+            else {
+                seq_exception_start_iv.append(seq_start + i);
+                seq_exception_length_iv.append(1);
+                seq_exception_char_iv.append(exception);
+            }
+            // the exception is stored as an A
+            seq_iv.append(0);
+        }
+        else {
+            seq_iv.append(encode_nucleotide(sequence[i]));
+        }
+        in_run = exception;
     }
+}
+
+template<typename Backend>
+void BasePackedGraph<Backend>::reverse_exceptions(const size_t& seq_start, const size_t& len) {
     
-    return get_handle(id);
+    size_t seq_end = seq_start + len;
+    size_t begin = first_exception_after(seq_start);
+    size_t end = begin;
+    while (end < seq_exception_start_iv.size() && seq_exception_start_iv.get(end) < seq_end) {
+        ++end;
+    }
+    if (begin == end) {
+        return;
+    }
+    
+    // runs that overlap the interval, as (start, length, char); runs that
+    // extend past the interval are split and their outside parts kept in place
+    std::vector<std::tuple<size_t, size_t, char>> runs;
+    size_t first_start = seq_exception_start_iv.get(begin);
+    if (first_start < seq_start) {
+        runs.emplace_back(first_start, seq_start - first_start, (char) seq_exception_char_iv.get(begin));
+    }
+    for (size_t i = end; i > begin; --i) {
+        size_t run_start = seq_exception_start_iv.get(i - 1);
+        size_t run_end = std::min<size_t>(run_start + seq_exception_length_iv.get(i - 1), seq_end);
+        run_start = std::max(run_start, seq_start);
+        // mirror the run across the interval
+        runs.emplace_back(seq_start + seq_end - run_end, run_end - run_start,
+                          reverse_complement((char) seq_exception_char_iv.get(i - 1)));
+    }
+    size_t last_end = seq_exception_start_iv.get(end - 1) + seq_exception_length_iv.get(end - 1);
+    if (last_end > seq_end) {
+        runs.emplace_back(seq_end, last_end - seq_end, (char) seq_exception_char_iv.get(end - 1));
+    }
+    
+    // make room for the runs that were split, if necessary
+    size_t prev_size = seq_exception_start_iv.size();
+    size_t added = runs.size() - (end - begin);
+    if (added) {
+        seq_exception_start_iv.resize(prev_size + added);
+        seq_exception_length_iv.resize(prev_size + added);
+        seq_exception_char_iv.resize(prev_size + added);
+        for (size_t i = prev_size; i > end; --i) {
+            seq_exception_start_iv.set(i - 1 + added, seq_exception_start_iv.get(i - 1));
+            seq_exception_length_iv.set(i - 1 + added, seq_exception_length_iv.get(i - 1));
+            seq_exception_char_iv.set(i - 1 + added, seq_exception_char_iv.get(i - 1));
+        }
+    }
+    for (size_t i = 0; i < runs.size(); ++i) {
+        seq_exception_start_iv.set(begin + i, std::get<0>(runs[i]));
+        seq_exception_length_iv.set(begin + i, std::get<1>(runs[i]));
+        seq_exception_char_iv.set(begin + i, std::get<2>(runs[i]));
+    }
 }
 
 template<typename Backend>
@@ -1224,6 +3455,11 @@ void BasePackedGraph<Backend>::create_edge(const handle_t& left, const handle_t&
         return;
     }
     
+    if (get_is_reverse(left) != get_is_reverse(right)) {
+        // this edge reverses strand
+        single_stranded_state = 2;
+    }
+    
     // get the location of the edge list pointer in the graph vector
     size_t g_iv_left = graph_iv_index(left) + (get_is_reverse(left) ?
                                                GRAPH_START_EDGES_OFFSET :
@@ -1287,20 +3523,63 @@ size_t BasePackedGraph<Backend>::get_length(const handle_t& handle) const {
 }
 
 template<typename Backend>
-string BasePackedGraph<Backend>::get_sequence(const handle_t& handle) const {
+void BasePackedGraph<Backend>::get_sequence_into(const handle_t& handle, string& buffer) const {
+    BDSG_TIME_EVENT(GRAPH_GET_SEQUENCE);
+    size_t g_iv_index = graph_iv_index(handle);
+    size_t seq_start = seq_start_iv.get(graph_index_to_seq_start_index(g_iv_index));
+    size_t seq_len = seq_length_iv.get(graph_index_to_seq_len_index(g_iv_index));
+    buffer.resize(seq_len);
+    if (get_is_reverse(handle)) {
+        decode_reverse_complement(seq_start, seq_len, &buffer[0]);
+    }
+    else {
+        decode_sequence(seq_start, seq_len, &buffer[0]);
+    }
+}
+
+template<typename Backend>
+template<typename Iteratee>
+bool BasePackedGraph<Backend>::for_each_sequence_chunk(const handle_t& handle, const Iteratee& iteratee) const {
     size_t g_iv_index = graph_iv_index(handle);
     size_t seq_start = seq_start_iv.get(graph_index_to_seq_start_index(g_iv_index));
     size_t seq_len = seq_length_iv.get(graph_index_to_seq_len_index(g_iv_index));
-    string seq(seq_len, 'N');
-    for (size_t i = 0; i < seq_len; i++) {
-        seq[i] = decode_nucleotide(seq_iv.get(seq_start + i));
+    bool is_reverse = get_is_reverse(handle);
+    // a multiple of the 32 bases that are decoded per word
+    static const size_t chunk_size = 1024;
+    char buffer[chunk_size];
+    for (size_t i = 0; i < seq_len; i += chunk_size) {
+        size_t count = std::min(chunk_size, seq_len - i);
+        if (is_reverse) {
+            decode_reverse_complement(seq_start + seq_len - i - count, count, buffer);
+        }
+        else {
+            decode_sequence(seq_start + i, count, buffer);
+        }
+        if (!call_iteratee(iteratee, (const char*) buffer, count)) {
+            return false;
+        }
     }
-    return get_is_reverse(handle) ? reverse_complement(seq) : seq;
+    return true;
+}
+
+template<typename Backend>
+string BasePackedGraph<Backend>::get_sequence(const handle_t& handle) const {
+    string seq;
+    get_sequence_into(handle, seq);
+    return seq;
 }
 
 template<typename Backend>
 bool BasePackedGraph<Backend>::follow_edges(const handle_t& handle, bool go_left,
                                     const std::function<bool(const handle_t&)>& iteratee) const {
+    return follow_edges_fast(handle, go_left, iteratee);
+}
+
+template<typename Backend>
+template<typename Iteratee>
+bool BasePackedGraph<Backend>::follow_edges_fast(const handle_t& handle, bool go_left,
+                                                 const Iteratee& iteratee) const {
+    BDSG_TIME_EVENT(GRAPH_FOLLOW_EDGES);
     // toward start = true, toward end = false
     bool direction = get_is_reverse(handle) != go_left;
     // get the head of the linked list from the graph vector
@@ -1316,7 +3595,7 @@ bool BasePackedGraph<Backend>::follow_edges(const handle_t& handle, bool go_left
             edge_target = flip(edge_target);
         }
         
-        keep_going = iteratee(edge_target);
+        keep_going = call_iteratee(iteratee, edge_target);
         edge_idx = get_next_edge_index(edge_idx);
     }
     
@@ -1344,7 +3623,7 @@ size_t BasePackedGraph<Backend>::get_degree(const handle_t& handle, bool go_left
     // implementation, which we can't use because we're not allowed virtual
     // methods.
     size_t count = 0;
-    follow_edges(handle, go_left, [&](const handle_t& ignored) {
+    follow_edges_fast(handle, go_left, [&](const handle_t& ignored) {
         // Just manually count every edge we get by looking at the handle in
         // that orientation
         count++;
@@ -1359,7 +3638,7 @@ bool BasePackedGraph<Backend>::has_edge(const handle_t& left, const handle_t& ri
     // implementation, which we can't use because we're not allowed virtual
     // methods.
     bool not_seen = true;
-    follow_edges(left, false, [&](const handle_t& next) {
+    follow_edges_fast(left, false, [&](const handle_t& next) {
         not_seen = (next != right);
         return not_seen;
     });
@@ -1371,29 +3650,140 @@ bool BasePackedGraph<Backend>::for_each_handle(const std::function<bool(const ha
                                        bool parallel) const {
     
     if (parallel) {
-        // TODO: would task based parallelism be better?
+        // nodes can need very different amounts of work, so we hand out small
+        // chunks as tasks that idle threads pick up
         atomic<bool> keep_going(true);
-#pragma omp parallel for
-        for (size_t i = 0; i < nid_to_graph_iv.size(); i++) {
-            if (keep_going && nid_to_graph_iv.get(i)) {
-                if (!iteratee(get_handle(i + min_id))) {
-                    keep_going = false;
+#pragma omp parallel
+        {
+#pragma omp single
+            {
+                // start each chunk at a node, so we skip over empty ranges of IDs
+                for (size_t chunk_start = nid_to_graph_iv.next_nonzero(0);
+                     chunk_start < nid_to_graph_iv.size() && keep_going;
+                     chunk_start = nid_to_graph_iv.next_nonzero(chunk_start + PARALLEL_ITERATION_CHUNK_SIZE)) {
+#pragma omp task firstprivate(chunk_start) shared(keep_going)
+                    {
+                        nid_t begin_id = min_id + chunk_start;
+                        for_each_handle_in_range_fast(begin_id, begin_id + PARALLEL_ITERATION_CHUNK_SIZE,
+                                                      [&](const handle_t& handle) {
+                            if (!iteratee(handle)) {
+                                keep_going = false;
+                            }
+                            return keep_going.load();
+                        });
+                    }
                 }
             }
         }
         return keep_going;
     }
     else {
-        for (size_t i = 0; i < nid_to_graph_iv.size(); i++) {
-            if (nid_to_graph_iv.get(i)) {
-                if (!iteratee(get_handle(i + min_id))) {
+        return for_each_handle_fast(iteratee);
+    }
+}
+
+template<typename Backend>
+template<typename Iteratee>
+bool BasePackedGraph<Backend>::for_each_handle_fast(const Iteratee& iteratee) const {
+    return for_each_handle_in_range_fast(min_id, min_id + nid_to_graph_iv.size(), iteratee);
+}
+
+template<typename Backend>
+bool BasePackedGraph<Backend>::for_each_handle_in_range(const nid_t& begin_id, const nid_t& end_id,
+                                                        const std::function<bool(const handle_t&)>& iteratee) const {
+    return for_each_handle_in_range_fast(begin_id, end_id, iteratee);
+}
+
+template<typename Backend>
+template<typename Iteratee>
+bool BasePackedGraph<Backend>::for_each_handle_in_range_fast(const nid_t& begin_id, const nid_t& end_id,
+                                                             const Iteratee& iteratee) const {
+    
+    // clip the range to the IDs we have records for
+    if (nid_to_graph_iv.empty() || end_id <= min_id) {
+        return true;
+    }
+    size_t begin = begin_id > min_id ? begin_id - min_id : 0;
+    size_t end = min<size_t>(end_id - min_id, nid_to_graph_iv.size());
+    
+    for (size_t i = nid_to_graph_iv.next_nonzero(begin, end); i < end; i = nid_to_graph_iv.next_nonzero(i + 1, end)) {
+        if (!call_iteratee(iteratee, get_handle(i + min_id))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+template<typename Backend>
+void BasePackedGraph<Backend>::get_handles(const vector<nid_t>& ids, vector<handle_t>& out, bool is_reverse) const {
+    out.resize(ids.size());
+    for (size_t i = 0; i < ids.size(); i++) {
+        out[i] = get_handle(ids[i], is_reverse);
+        if (ids[i] >= min_id && ids[i] - min_id < nid_to_graph_iv.size()) {
+            nid_to_graph_iv.prefetch(ids[i] - min_id);
+        }
+    }
+}
+
+template<typename Backend>
+void BasePackedGraph<Backend>::get_sequences_lengths(const vector<handle_t>& handles, vector<size_t>& out) const {
+    out.resize(handles.size());
+    size_t seq_len_indexes[PREFETCH_BATCH_SIZE];
+    for (size_t begin = 0; begin < handles.size(); begin += PREFETCH_BATCH_SIZE) {
+        size_t count = min(PREFETCH_BATCH_SIZE, handles.size() - begin);
+        const handle_t* batch = handles.data() + begin;
+        for (size_t i = 0; i < count; i++) {
+            nid_to_graph_iv.prefetch(get_id(batch[i]) - min_id);
+        }
+        for (size_t i = 0; i < count; i++) {
+            seq_len_indexes[i] = graph_index_to_seq_len_index(graph_iv_index(batch[i]));
+            seq_length_iv.prefetch(seq_len_indexes[i]);
+        }
+        for (size_t i = 0; i < count; i++) {
+            out[begin + i] = seq_length_iv.get(seq_len_indexes[i]);
+        }
+    }
+}
+
+template<typename Backend>
+template<typename Iteratee>
+bool BasePackedGraph<Backend>::follow_edges_batch(const vector<handle_t>& handles, bool go_left,
+                                                  const Iteratee& iteratee) const {
+    BDSG_TIME_EVENT(GRAPH_FOLLOW_EDGES);
+    size_t edge_idxs[PREFETCH_BATCH_SIZE];
+    for (size_t begin = 0; begin < handles.size(); begin += PREFETCH_BATCH_SIZE) {
+        size_t count = min(PREFETCH_BATCH_SIZE, handles.size() - begin);
+        const handle_t* batch = handles.data() + begin;
+        for (size_t i = 0; i < count; i++) {
+            nid_to_graph_iv.prefetch(get_id(batch[i]) - min_id);
+        }
+        for (size_t i = 0; i < count; i++) {
+            // toward start = true, toward end = false
+            bool direction = get_is_reverse(batch[i]) != go_left;
+            edge_idxs[i] = graph_iv_index(batch[i]) + (direction ? GRAPH_START_EDGES_OFFSET : GRAPH_END_EDGES_OFFSET);
+            graph_iv.prefetch(edge_idxs[i]);
+        }
+        for (size_t i = 0; i < count; i++) {
+            // replace the graph vector position with the head of the linked list
+            edge_idxs[i] = graph_iv.get(edge_idxs[i]);
+            if (edge_idxs[i]) {
+                edge_lists_iv.prefetch((edge_idxs[i] - 1) * EDGE_RECORD_SIZE + EDGE_TRAV_OFFSET);
+            }
+        }
+        for (size_t i = 0; i < count; i++) {
+            for (size_t edge_idx = edge_idxs[i]; edge_idx; edge_idx = get_next_edge_index(edge_idx)) {
+                handle_t edge_target = decode_traversal(get_edge_target(edge_idx));
+                if (go_left) {
+                    // match the orientation encoding
+                    edge_target = flip(edge_target);
+                }
+                if (!call_iteratee(iteratee, begin + i, edge_target)) {
                     return false;
                 }
             }
         }
-        return true;
     }
-    
+    return true;
 }
 
 template<typename Backend>
@@ -1414,13 +3804,20 @@ template<typename Backend>
 char BasePackedGraph<Backend>::get_base(const handle_t& handle, size_t index) const {
     size_t g_iv_index = graph_iv_index(handle);
     size_t seq_start = seq_start_iv.get(graph_index_to_seq_start_index(g_iv_index));
-    if (get_is_reverse(handle)) {
-        size_t seq_len = seq_length_iv.get(graph_index_to_seq_len_index(g_iv_index));
-        return reverse_complement(decode_nucleotide(seq_iv.get(seq_start + seq_len - index - 1)));
+    bool is_reverse = get_is_reverse(handle);
+    size_t seq_idx = seq_start + index;
+    if (is_reverse) {
+        seq_idx = seq_start + seq_length_iv.get(graph_index_to_seq_len_index(g_iv_index)) - index - 1;
+    }
+    char base;
+    size_t exception_idx = first_exception_after(seq_idx);
+    if (exception_idx < seq_exception_start_iv.size() && seq_exception_start_iv.get(exception_idx) <= seq_idx) {
+        base = (char) seq_exception_char_iv.get(exception_idx);
     }
     else {
-        return decode_nucleotide(seq_iv.get(seq_start + index));
+        base = decode_nucleotide(seq_iv.get(seq_idx));
     }
+    return is_reverse ? reverse_complement(base) : base;
 }
 
 template<typename Backend>
@@ -1433,10 +3830,13 @@ string BasePackedGraph<Backend>::get_subsequence(const handle_t& handle, size_t
     size_t subseq_start = get_is_reverse(handle) ? seq_start + seq_len - size - index : seq_start + index;
     
     string subseq(size, 'N');
-    for (size_t i = 0; i < size; i++) {
-        subseq[i] = decode_nucleotide(seq_iv.get(subseq_start + i));
+    if (get_is_reverse(handle)) {
+        decode_reverse_complement(subseq_start, size, &subseq[0]);
+    }
+    else {
+        decode_sequence(subseq_start, size, &subseq[0]);
     }
-    return get_is_reverse(handle) ? reverse_complement(subseq) : subseq;
+    return subseq;
 }
 
 template<typename Backend>
@@ -1445,6 +3845,9 @@ handle_t BasePackedGraph<Backend>::apply_orientation(const handle_t& handle) {
     if (get_is_reverse(handle)) {
         size_t g_iv_idx = graph_iv_index(handle);
         
+        // this flips which of the node's edges reverse strand
+        single_stranded_state = 0;
+        
         // swap the edge lists
         size_t tmp = graph_iv.get(g_iv_idx + GRAPH_START_EDGES_OFFSET);
         graph_iv.set(g_iv_idx + GRAPH_START_EDGES_OFFSET, graph_iv.get(g_iv_idx + GRAPH_END_EDGES_OFFSET));
@@ -1490,6 +3893,7 @@ handle_t BasePackedGraph<Backend>::apply_orientation(const handle_t& handle) {
             size_t j = seq_start + seq_len / 2;
             seq_iv.set(j, complement_encoded_nucleotide(seq_iv.get(j)));
         }
+        reverse_exceptions(seq_start, seq_len);
         
         // reverse the orientation of the node on all paths
         
@@ -1498,6 +3902,7 @@ handle_t BasePackedGraph<Backend>::apply_orientation(const handle_t& handle) {
             
             // get the path that this membership record is on
             PackedPath& packed_path = paths[get_membership_path(path_membership)];
+            decompress_path(packed_path);
             
             // access and flip the step on the path
             size_t occ_idx = get_membership_step(path_membership);
@@ -1616,6 +4021,7 @@ std::vector<handle_t> BasePackedGraph<Backend>::divide_handle(const handle_t& ha
         
         // get the path that this membership record is on
         PackedPath& packed_path = paths[get_membership_path(path_membership)];
+        decompress_path(packed_path);
         
         // split up the occurrence on the path
         size_t occ_idx = get_membership_step(path_membership);
@@ -1669,37 +4075,342 @@ std::vector<handle_t> BasePackedGraph<Backend>::divide_handle(const handle_t& ha
                 set_step_prev(packed_path, other_idx, divided_trav_offsets.back());
                 set_step_next(packed_path, divided_trav_offsets.back(), other_idx);
             }
-            
-            // update the tail of the path, if necessary
-            if (path_tail_iv.get(get_membership_path(path_membership)) == occ_idx) {
-                path_tail_iv.set(get_membership_path(path_membership), divided_trav_offsets.back());
+            
+            // update the tail of the path, if necessary
+            if (path_tail_iv.get(get_membership_path(path_membership)) == occ_idx) {
+                path_tail_iv.set(get_membership_path(path_membership), divided_trav_offsets.back());
+            }
+               
+            
+            // add connections between the divided segments
+            for (size_t i = 1; i < divided_trav_offsets.size(); i++) {
+                set_step_next(packed_path, divided_trav_offsets[i - 1], divided_trav_offsets[i]);
+                set_step_prev(packed_path, divided_trav_offsets[i], divided_trav_offsets[i - 1]);
+            }
+        }
+        
+        // move to the next membership record
+        path_membership = get_next_membership(path_membership);
+    }
+    
+    if (get_is_reverse(handle)) {
+        // reverse the vector to the orientation of the input handle
+        reverse(return_val.begin(), return_val.end());
+        for (handle_t& ret_handle : return_val) {
+            ret_handle = flip(ret_handle);
+        }
+    }
+    
+    return return_val;
+}
+
+template<typename Backend>
+void BasePackedGraph<Backend>::create_edges(const vector<edge_t>& edges) {
+    
+    // write each edge the way around that starts from the smaller handle, so
+    // that the two ways of writing the same edge sort together
+    vector<edge_t> to_add(edges.size());
+    for (size_t i = 0; i < edges.size(); ++i) {
+        handle_t left = flip(edges[i].second);
+        handle_t right = flip(edges[i].first);
+        if (as_integer(edges[i].first) < as_integer(left) ||
+            (as_integer(edges[i].first) == as_integer(left) && as_integer(edges[i].second) <= as_integer(right))) {
+            to_add[i] = edges[i];
+        }
+        else {
+            to_add[i] = make_pair(left, right);
+        }
+    }
+    std::sort(to_add.begin(), to_add.end(), [](const edge_t& a, const edge_t& b) {
+        return make_pair(as_integer(a.first), as_integer(a.second)) < make_pair(as_integer(b.first), as_integer(b.second));
+    });
+    to_add.erase(std::unique(to_add.begin(), to_add.end()), to_add.end());
+    
+    // look for the edges we already have in parallel
+    vector<uint8_t> is_new(to_add.size());
+#pragma omp parallel for schedule(dynamic, PARALLEL_ITERATION_CHUNK_SIZE)
+    for (size_t i = 0; i < to_add.size(); ++i) {
+        is_new[i] = follow_edges_fast(to_add[i].first, false, [&](const handle_t& next) {
+            return next != to_add[i].second;
+        });
+    }
+    
+    // lay out all the new edge records, linked onto the heads of their lists,
+    // and then pack them into the edge vector at once
+    vector<uint64_t> records;
+    uint64_t next_record = edge_lists_iv.size() / EDGE_RECORD_SIZE + 1;
+    for (size_t i = 0; i < to_add.size(); ++i) {
+        if (!is_new[i]) {
+            continue;
+        }
+        const handle_t& left = to_add[i].first;
+        const handle_t& right = to_add[i].second;
+        if (get_is_reverse(left) != get_is_reverse(right)) {
+            // this edge reverses strand
+            single_stranded_state = 2;
+        }
+        size_t g_iv_left = graph_iv_index(left) + (get_is_reverse(left) ?
+                                                   GRAPH_START_EDGES_OFFSET :
+                                                   GRAPH_END_EDGES_OFFSET);
+        size_t g_iv_right = graph_iv_index(right) + (get_is_reverse(right) ?
+                                                     GRAPH_END_EDGES_OFFSET :
+                                                     GRAPH_START_EDGES_OFFSET);
+        records.push_back(encode_traversal(right));
+        records.push_back(graph_iv.get(g_iv_left));
+        graph_iv.set(g_iv_left, next_record++);
+        
+        // don't double add a reversing self edge
+        if (g_iv_left == g_iv_right) {
+            ++reversing_self_edge_records;
+            continue;
+        }
+        records.push_back(encode_traversal(flip(left)));
+        records.push_back(graph_iv.get(g_iv_right));
+        graph_iv.set(g_iv_right, next_record++);
+    }
+    size_t records_start = edge_lists_iv.size();
+    edge_lists_iv.resize(records_start + records.size());
+    edge_lists_iv.set_range(records_start, records.size(), records.data());
+}
+
+template<typename Backend>
+void BasePackedGraph<Backend>::chop(size_t max_length) {
+    
+    if (max_length == 0) {
+        throw std::runtime_error("error:[BasePackedGraph] cannot chop nodes to a maximum length of 0");
+    }
+    
+    // find how many pieces each node will become, and where their records
+    // will start, with the nodes in ID order and each node's pieces together
+    vector<size_t> order = graph_indexes_in_id_order();
+    vector<uint64_t> first_records(order.size() + 1, 0);
+#pragma omp parallel for schedule(dynamic, PARALLEL_ITERATION_CHUNK_SIZE)
+    for (size_t i = 0; i < order.size(); ++i) {
+        size_t length = seq_length_iv.get(graph_index_to_seq_len_index(order[i]));
+        first_records[i + 1] = std::max<size_t>((length + max_length - 1) / max_length, 1);
+    }
+    for (size_t i = 0; i < order.size(); ++i) {
+        first_records[i + 1] += first_records[i];
+    }
+    size_t num_records = first_records.back();
+    if (num_records == order.size()) {
+        // nothing is too long
+        return;
+    }
+    
+    // remember the ID of each node and where each existing record comes in ID order
+    vector<nid_t> ids(order.size());
+    vector<size_t> order_index(graph_iv.size() / GRAPH_RECORD_SIZE);
+    size_t num_seen = 0;
+    for (size_t i = nid_to_graph_iv.next_nonzero(0); i < nid_to_graph_iv.size(); i = nid_to_graph_iv.next_nonzero(i + 1)) {
+        ids[num_seen] = min_id + i;
+        order_index[order[num_seen] / GRAPH_RECORD_SIZE] = num_seen;
+        ++num_seen;
+    }
+    
+    // the first piece of a node keeps its ID, and the others get new IDs
+    // after the current max, in the order of the nodes they come from
+    nid_t old_max_id = max_id;
+    auto piece_handle = [&](size_t i, size_t piece, bool is_reverse) {
+        return get_handle(piece == 0 ? ids[i] : old_max_id + nid_t(first_records[i] - i + piece), is_reverse);
+    };
+    // we need to find the pieces of the nodes from the old IDs after the new
+    // pieces have been given theirs
+    decltype(nid_to_graph_iv) old_nid_to_graph_iv = nid_to_graph_iv;
+    auto get_order_index = [&](const handle_t& trav) {
+        return order_index[old_nid_to_graph_iv.get(get_id(trav) - min_id) - 1];
+    };
+    // translate a traversal of an existing node, going onto the node, into a
+    // traversal of the piece it goes onto
+    auto translate = [&](const handle_t& trav) {
+        if (!get_is_reverse(trav)) {
+            return trav;
+        }
+        size_t i = get_order_index(trav);
+        return piece_handle(i, first_records[i + 1] - first_records[i] - 1, true);
+    };
+    
+    // find where each node's edge lists will go, with an edge each way between
+    // consecutive pieces
+    vector<uint64_t> edge_offsets(order.size() + 1, 0);
+#pragma omp parallel for schedule(dynamic, PARALLEL_ITERATION_CHUNK_SIZE)
+    for (size_t i = 0; i < order.size(); ++i) {
+        size_t num_edge_records = 2 * (first_records[i + 1] - first_records[i] - 1);
+        for (size_t edge_list_offset : {GRAPH_START_EDGES_OFFSET, GRAPH_END_EDGES_OFFSET}) {
+            for (size_t edge_list_idx = graph_iv.get(order[i] + edge_list_offset); edge_list_idx;
+                 edge_list_idx = get_next_edge_index(edge_list_idx)) {
+                ++num_edge_records;
+            }
+        }
+        edge_offsets[i + 1] = num_edge_records * EDGE_RECORD_SIZE;
+    }
+    for (size_t i = 0; i < order.size(); ++i) {
+        edge_offsets[i + 1] += edge_offsets[i];
+    }
+    
+    // build the edge lists in parallel, moving the edges on the end of each
+    // node onto its last piece
+    decltype(edge_lists_iv) new_edge_lists_iv;
+    new_edge_lists_iv.reserve(edge_offsets.back());
+    new_edge_lists_iv.resize(edge_offsets.back());
+    vector<uint64_t> new_heads(num_records * 2, 0);
+    parallel_fill(new_edge_lists_iv, order.size(), [&](size_t i) { return edge_offsets[i]; },
+                  [&](size_t i, uint64_t* out) {
+        // the 1-based index of the next edge record we will make
+        uint64_t next_record = edge_offsets[i] / EDGE_RECORD_SIZE + 1;
+        size_t num_pieces = first_records[i + 1] - first_records[i];
+        for (size_t piece = 0; piece < num_pieces; ++piece) {
+            for (size_t j : {0, 1}) {
+                uint64_t& head = new_heads[2 * (first_records[i] + piece) + j];
+                if (j == 0 ? piece != 0 : piece + 1 != num_pieces) {
+                    // an edge to the neighboring piece
+                    head = next_record++;
+                    out[EDGE_TRAV_OFFSET] = encode_traversal(j == 0 ? piece_handle(i, piece - 1, true)
+                                                                    : piece_handle(i, piece + 1, false));
+                    out[EDGE_NEXT_OFFSET] = 0;
+                    out += EDGE_RECORD_SIZE;
+                    continue;
+                }
+                size_t edge_list_idx = graph_iv.get(order[i] + (j ? GRAPH_END_EDGES_OFFSET : GRAPH_START_EDGES_OFFSET));
+                if (edge_list_idx) {
+                    head = next_record;
+                }
+                while (edge_list_idx) {
+                    uint64_t next_edge_list_idx = get_next_edge_index(edge_list_idx);
+                    out[EDGE_TRAV_OFFSET] = encode_traversal(translate(decode_traversal(get_edge_target(edge_list_idx))));
+                    out[EDGE_NEXT_OFFSET] = next_edge_list_idx ? next_record + 1 : 0;
+                    out += EDGE_RECORD_SIZE;
+                    ++next_record;
+                    edge_list_idx = next_edge_list_idx;
+                }
+            }
+        }
+    });
+    
+    // build the node records in parallel, with each piece's sequence being a
+    // part of the original's
+    decltype(graph_iv) new_graph_iv;
+    decltype(seq_start_iv) new_seq_start_iv;
+    PackedVector<Backend> new_seq_length_iv;
+    decltype(path_membership_node_iv) new_path_membership_node_iv;
+    new_graph_iv.reserve(num_records * GRAPH_RECORD_SIZE);
+    new_seq_start_iv.reserve(num_records * SEQ_START_RECORD_SIZE);
+    new_seq_length_iv.reserve(num_records * SEQ_LENGTH_RECORD_SIZE);
+    new_graph_iv.resize(num_records * GRAPH_RECORD_SIZE);
+    new_seq_start_iv.resize(num_records * SEQ_START_RECORD_SIZE);
+    new_seq_length_iv.resize(num_records * SEQ_LENGTH_RECORD_SIZE);
+    // the memberships are all remade along with the paths
+    new_path_membership_node_iv.resize(num_records * NODE_MEMBER_RECORD_SIZE);
+    parallel_fill(new_graph_iv, order.size(), [&](size_t i) { return first_records[i] * GRAPH_RECORD_SIZE; },
+                  [&](size_t i, uint64_t* out) {
+        for (size_t r = first_records[i]; r < first_records[i + 1]; ++r) {
+            out[GRAPH_START_EDGES_OFFSET] = new_heads[2 * r];
+            out[GRAPH_END_EDGES_OFFSET] = new_heads[2 * r + 1];
+            out += GRAPH_RECORD_SIZE;
+        }
+    });
+    parallel_fill(new_seq_start_iv, order.size(), [&](size_t i) { return first_records[i] * SEQ_START_RECORD_SIZE; },
+                  [&](size_t i, uint64_t* out) {
+        size_t seq_start = seq_start_iv.get(graph_index_to_seq_start_index(order[i]));
+        for (size_t piece = 0; piece < first_records[i + 1] - first_records[i]; ++piece) {
+            out[piece * SEQ_START_RECORD_SIZE] = seq_start + piece * max_length;
+        }
+    });
+    parallel_fill(new_seq_length_iv, order.size(), [&](size_t i) { return first_records[i] * SEQ_LENGTH_RECORD_SIZE; },
+                  [&](size_t i, uint64_t* out) {
+        size_t length = seq_length_iv.get(graph_index_to_seq_len_index(order[i]));
+        for (size_t piece = 0; piece < first_records[i + 1] - first_records[i]; ++piece) {
+            out[piece * SEQ_LENGTH_RECORD_SIZE] = std::min(max_length, length - piece * max_length);
+        }
+    });
+    
+    // switch over to the new records
+    graph_iv = std::move(new_graph_iv);
+    seq_start_iv = std::move(new_seq_start_iv);
+    seq_length_iv = std::move(new_seq_length_iv);
+    path_membership_node_iv = std::move(new_path_membership_node_iv);
+    edge_lists_iv = std::move(new_edge_lists_iv);
+    max_id = old_max_id + nid_t(num_records - order.size());
+    if (max_id - min_id + 1 > nid_t(nid_to_graph_iv.size())) {
+        nid_to_graph_iv.extend_back(max_id - min_id + 1 - nid_to_graph_iv.size());
+    }
+    for (size_t i = 0; i < order.size(); ++i) {
+        for (size_t piece = 0; piece < first_records[i + 1] - first_records[i]; ++piece) {
+            nid_to_graph_iv.set(get_id(piece_handle(i, piece, false)) - min_id, first_records[i] + piece + 1);
+        }
+    }
+    deleted_node_records = 0;
+    deleted_edge_records = 0;
+    reversing_self_edge_records -= deleted_reversing_self_edge_records;
+    deleted_reversing_self_edge_records = 0;
+    path_membership_id_iv = decltype(path_membership_id_iv)();
+    path_membership_offset_iv = decltype(path_membership_offset_iv)();
+    path_membership_next_iv = decltype(path_membership_next_iv)();
+    deleted_membership_records = 0;
+    
+    // remake the paths in batches, working out the new steps of each batch of
+    // paths in parallel
+    vector<path_handle_t> batch_paths;
+    vector<vector<handle_t>> batch_steps;
+    vector<int64_t> recompress;
+    size_t next_path = 0;
+    while (next_path < paths.size()) {
+        size_t batch_end = next_path;
+        size_t batch_size = 0;
+        batch_paths.clear();
+        while (batch_end < paths.size() && (batch_end == next_path || batch_size < CONVERSION_BATCH_STEPS)) {
+            if (!path_is_deleted_iv.get(batch_end)) {
+                batch_paths.push_back(as_path_handle(batch_end));
+                batch_size += get_step_count(batch_paths.back());
             }
-               
+            ++batch_end;
+        }
+        batch_steps.clear();
+        batch_steps.resize(batch_paths.size());
+#pragma omp parallel for schedule(dynamic, 1)
+        for (size_t i = 0; i < batch_paths.size(); ++i) {
+            int64_t path_idx = as_integer(batch_paths[i]);
+            vector<handle_t>& steps = batch_steps[i];
+            for_each_step_index(path_idx, [&](const uint64_t& step_index) {
+                handle_t trav = decode_traversal(get_step_trav(paths[path_idx], step_index));
+                size_t node = get_order_index(trav);
+                size_t num_pieces = first_records[node + 1] - first_records[node];
+                for (size_t piece = 0; piece < num_pieces; ++piece) {
+                    steps.push_back(piece_handle(node, get_is_reverse(trav) ? num_pieces - piece - 1 : piece,
+                                                 get_is_reverse(trav)));
+                }
+                return true;
+            });
             
-            // add connections between the divided segments
-            for (size_t i = 1; i < divided_trav_offsets.size(); i++) {
-                set_step_next(packed_path, divided_trav_offsets[i - 1], divided_trav_offsets[i]);
-                set_step_prev(packed_path, divided_trav_offsets[i], divided_trav_offsets[i - 1]);
+            // and clear out the old steps
+            if (paths[path_idx].compressed_steps) {
+#pragma omp critical
+                recompress.push_back(path_idx);
             }
+            paths[path_idx] = PackedPath();
         }
-        
-        // move to the next membership record
-        path_membership = get_next_membership(path_membership);
-    }
-    
-    if (get_is_reverse(handle)) {
-        // reverse the vector to the orientation of the input handle
-        reverse(return_val.begin(), return_val.end());
-        for (handle_t& ret_handle : return_val) {
-            ret_handle = flip(ret_handle);
+        for (const path_handle_t& path : batch_paths) {
+            path_head_iv.set(as_integer(path), 0);
+            path_tail_iv.set(as_integer(path), 0);
+            path_deleted_steps_iv.set(as_integer(path), 0);
         }
+        append_steps(batch_paths, batch_steps);
+        next_path = batch_end;
     }
     
-    return return_val;
+    // paths that were compressed are straight now, so they can be compressed again
+#pragma omp parallel for schedule(dynamic, 1)
+    for (size_t i = 0; i < recompress.size(); ++i) {
+        compress_path(recompress[i]);
+    }
 }
 
 template<typename Backend>
 void BasePackedGraph<Backend>::destroy_handle(const handle_t& handle) {
+    // this might take out the last reversing edge
+    if (single_stranded_state == 2) {
+        single_stranded_state = 0;
+    }
 
     // Clear out any paths on this handle.
     // We need to first compose a list of distinct visiting paths.
@@ -1708,10 +4419,8 @@ void BasePackedGraph<Backend>::destroy_handle(const handle_t& handle) {
         visiting_paths.insert(get_path_handle_of_step(step));
         return true;
     });
-    for (auto& p : visiting_paths) {
-        // Then we destroy all of them.
-        destroy_path(p);
-    }
+    // Then we destroy all of them.
+    destroy_paths(vector<path_handle_t>(visiting_paths.begin(), visiting_paths.end()));
     
     deleted_bases += get_length(handle);
     
@@ -1796,6 +4505,10 @@ void BasePackedGraph<Backend>::remove_edge_reference(const handle_t& on, const h
 
 template<typename Backend>
 void BasePackedGraph<Backend>::destroy_edge(const handle_t& left, const handle_t& right) {
+    if (get_is_reverse(left) != get_is_reverse(right)) {
+        // this might have been the last reversing edge
+        single_stranded_state = 0;
+    }
     remove_edge_reference(left, right);
     if (left != flip(right)) {
         // this edge is a reversing self edge, so it only has one reference
@@ -1807,129 +4520,155 @@ void BasePackedGraph<Backend>::destroy_edge(const handle_t& left, const handle_t
 template<typename Backend>
 void BasePackedGraph<Backend>::defragment_path(const int64_t& path_idx, bool force) {
     
-    // we don't want to defrag deleted paths since they have already been cleared
-    if (path_is_deleted_iv.get(path_idx)) {
+    // we don't want to defrag deleted paths since they have already been cleared,
+    // and compressed paths are already straight
+    if (path_is_deleted_iv.get(path_idx) || paths[path_idx].compressed_steps) {
         return;
     }
     
+    // have we either deleted a lot of steps or forced a defrag?
+    if ((automatic_defragmentation && path_fragmented(path_idx)) || force) {
+        PagedVector<NARROW_PAGE_WIDTH> offset_translator;
+        size_t new_tail = straighten_path(path_idx, offset_translator);
+        finish_defragment_path(path_idx, new_tail, offset_translator);
+    }
+}
+
+template<typename Backend>
+size_t BasePackedGraph<Backend>::straighten_path(const int64_t& path_idx,
+                                                 PagedVector<NARROW_PAGE_WIDTH>& offset_translator) {
+    
     PackedPath& path = paths[path_idx];
     
-    // have we either deleted a lot of steps or forced a defrag?
-    if (path_deleted_steps_iv.get(path_idx) > defrag_factor * (path.steps_iv.size() / PATH_RECORD_SIZE) || force) {
+    if (path_head_iv.get(path_idx) == 0) {
+        // the path is empty, so let's make sure it's not holding onto any capacity it doesn't need
+        path.links_iv = decltype(path.links_iv)();
+        path.steps_iv = decltype(path.steps_iv)();
+        return 0;
+    }
+    
+    // the path is non-empty, so we need to straighten it out and reallocate it
+    decltype(path.steps_iv) new_steps_iv;
+    decltype(path.links_iv) new_links_iv;
+    
+    // we will need to record the translation between path steps so we can update memberships later
+    offset_translator.resize(path.steps_iv.size() / STEP_RECORD_SIZE + 1);
+    
+    new_links_iv.reserve(path.links_iv.size() - path_deleted_steps_iv.get(path_idx) * PATH_RECORD_SIZE);
+    new_steps_iv.reserve(path.steps_iv.size() - path_deleted_steps_iv.get(path_idx) * STEP_RECORD_SIZE);
+    
+    // read the old traversals through an iterator, which decodes each page
+    // once while the old steps are in order
+    auto old_step = path.steps_iv.begin();
+    size_t old_step_position = 0;
+    size_t prev = 0;
+    for_each_step_index(path_idx, [&](const size_t& copying_from) {
+        uint64_t trav;
+        if (path.compressed_steps) {
+            trav = get_step_trav(path, copying_from);
+        } else {
+            size_t position = (copying_from - 1) * STEP_RECORD_SIZE;
+            old_step += std::ptrdiff_t(position) - std::ptrdiff_t(old_step_position);
+            old_step_position = position;
+            trav = *old_step;
+        }
         
-        if (path_head_iv.get(path_idx) != 0) {
-            
-            // the path is non-empty, so we need to straighten it out and reallocate it
-            decltype(path.steps_iv) new_steps_iv;
-            decltype(path.links_iv) new_links_iv;
-            
-            // we will need to record the translation between path steps so we can update memberships later
-            PagedVector<NARROW_PAGE_WIDTH> offset_translator;
-            offset_translator.resize(path.steps_iv.size() / STEP_RECORD_SIZE + 1);
+        // make a new record
+        new_steps_iv.append(trav);
+        new_links_iv.append(prev);
+        new_links_iv.append(0);
+        
+        size_t here = new_steps_iv.size() / STEP_RECORD_SIZE;
+        
+        // record the correspondance between the old
+        offset_translator.set(copying_from, here);
+        
+        // update the point on the previous node
+        if (prev != 0) {
+            new_links_iv.set(new_links_iv.size() - 2 * PATH_RECORD_SIZE + PATH_NEXT_OFFSET, here);
+        }
+        
+        prev = here;
+        return true;
+    });
+    
+    // add the looping connection if this is a circular path
+    if (path_is_circular_iv.get(path_idx)) {
+        new_links_iv.set(new_links_iv.size() - PATH_RECORD_SIZE + PATH_NEXT_OFFSET, 1);
+        new_links_iv.set(PATH_PREV_OFFSET, new_links_iv.size() / PATH_RECORD_SIZE);
+    }
+    
+    path.links_iv = move(new_links_iv);
+    path.steps_iv = move(new_steps_iv);
+    
+    return prev;
+}
+
+template<typename Backend>
+void BasePackedGraph<Backend>::finish_defragment_path(const int64_t& path_idx, const size_t& new_tail,
+                                                      const PagedVector<NARROW_PAGE_WIDTH>& offset_translator) {
+    
+    if (new_tail != 0) {
+        
+        PackedPath& path = paths[path_idx];
+        
+        // update the head and tail of the newly allocated path
+        path_head_iv.set(path_idx, 1);
+        path_tail_iv.set(path_idx, new_tail);
+        
+        // retrieve the ID of this path so we can match it to membership records
+        int64_t path_id_here = path_id.at(extract_encoded_path_name(path_idx));
+        
+        // now we need to iterate over each node on the path exactly one time to update its membership
+        // records (even if the node occurs multiple times on this path), so we will use a bit deque
+        // indexed by node_id - min_id to flag nodes as either translated or untranslated
+        SparsePackedDeque<> nid_translated;
+        nid_translated.append_back(0);
+        nid_t min_translated_id = get_id(decode_traversal(get_step_trav(path, path_head_iv.get(path_idx))));
+        
+        bool first_iter = true;
+        for (size_t here = path_head_iv.get(path_idx);
+             here != 0 && (here != path_head_iv.get(path_idx) || first_iter);
+             here = get_step_next(path, here)) {
             
-            new_links_iv.reserve(path.links_iv.size() - path_deleted_steps_iv.get(path_idx) * PATH_RECORD_SIZE);
-            new_steps_iv.reserve(path.steps_iv.size() - path_deleted_steps_iv.get(path_idx) * STEP_RECORD_SIZE);
+            handle_t handle = decode_traversal(get_step_trav(path, here));
+            nid_t step_node_id = get_id(handle);
             
-            bool first_iter = true;
-            size_t copying_from = path_head_iv.get(path_idx);
-            size_t prev = 0;
-            while (copying_from != 0 && (first_iter || copying_from != path_head_iv.get(path_idx))) {
-                // make a new record
-                new_steps_iv.append(get_step_trav(path, copying_from));
-                new_links_iv.append(prev);
-                new_links_iv.append(0);
-                
-                size_t here = new_steps_iv.size() / STEP_RECORD_SIZE;
-                
-                // record the correspondance between the old
-                offset_translator.set(copying_from, here);
-                
-                // update the point on the previous node
-                if (prev != 0) {
-                    new_links_iv.set(new_links_iv.size() - 2 * PATH_RECORD_SIZE + PATH_NEXT_OFFSET, here);
-                }
-                
-                prev = here;
-                copying_from = get_step_next(path, copying_from);
-                first_iter = false;
+            // expand the bounds of the deque as necessary to be able to index by ID
+            if (step_node_id < min_translated_id) {
+                nid_translated.extend_front(min_translated_id - step_node_id);
+                min_translated_id = step_node_id;
             }
-            
-            // add the looping connection if this is a circular path
-            if (path_is_circular_iv.get(path_idx)) {
-                new_links_iv.set(new_links_iv.size() - PATH_RECORD_SIZE + PATH_NEXT_OFFSET, 1);
-                new_links_iv.set(PATH_PREV_OFFSET, new_links_iv.size() / PATH_RECORD_SIZE);
+            else if (step_node_id >= min_translated_id + nid_translated.size()) {
+                nid_translated.extend_back(step_node_id - min_translated_id + 1 - nid_translated.size());
             }
             
-            path.links_iv = move(new_links_iv);
-            path.steps_iv = move(new_steps_iv);
-            
-            // update the head and tail of the newly allocated path
-            path_head_iv.set(path_idx, 1);
-            path_tail_iv.set(path_idx, prev);
-            
-            // retrieve the ID of this path so we can match it to membership records
-            int64_t path_id_here = path_id.at(extract_encoded_path_name(path_idx));
-            
-            // now we need to iterate over each node on the path exactly one time to update its membership
-            // records (even if the node occurs multiple times on this path), so we will use a bit deque
-            // indexed by node_id - min_id to flag nodes as either translated or untranslated
-            PackedDeque<> nid_translated;
-            nid_translated.append_back(0);
-            nid_t min_translated_id = get_id(decode_traversal(get_step_trav(path, path_head_iv.get(path_idx))));
-            
-            first_iter = true;
-            for (size_t here = path_head_iv.get(path_idx);
-                 here != 0 && (here != path_head_iv.get(path_idx) || first_iter);
-                 here = get_step_next(path, here)) {
-                
-                handle_t handle = decode_traversal(get_step_trav(path, here));
-                nid_t step_node_id = get_id(handle);
-                
-                // expand the bounds of the deque as necessary to be able to index by ID
-                if (step_node_id < min_translated_id) {
-                    for (nid_t i = step_node_id; i < min_translated_id; ++i) {
-                        nid_translated.append_front(0);
-                    }
-                    min_translated_id = step_node_id;
-                }
-                else if (step_node_id >= min_translated_id + nid_translated.size()) {
-                    for (nid_t i = min_translated_id + nid_translated.size(); i <= step_node_id; ++i) {
-                        nid_translated.append_back(0);
-                    }
-                }
+            // have we already translated the membership records for the path on this node?
+            // (we need to check this to avoid falsely translating pointers that we have actually
+            // already translated)
+            if (nid_translated.get(step_node_id - min_translated_id) != 1) {
                 
-                // have we already translated the membership records for the path on this node?
-                // (we need to check this to avoid falsely translating pointers that we have actually
-                // already translated)
-                if (nid_translated.get(step_node_id - min_translated_id) != 1) {
+                size_t member_idx = path_membership_node_iv.get(graph_index_to_node_member_index(graph_iv_index(handle)));
+                while (member_idx) {
                     
-                    size_t member_idx = path_membership_node_iv.get(graph_index_to_node_member_index(graph_iv_index(handle)));
-                    while (member_idx) {
-                        
-                        // update the offsets for membership records on this path
-                        if (get_membership_path(member_idx) == path_id_here) {
-                            set_membership_step(member_idx, offset_translator.get(get_membership_step(member_idx)));
-                        }
-                        
-                        // move to the next membership record
-                        member_idx = get_next_membership(member_idx);
+                    // update the offsets for membership records on this path
+                    if (get_membership_path(member_idx) == path_id_here) {
+                        set_membership_step(member_idx, offset_translator.get(get_membership_step(member_idx)));
                     }
                     
-                    // mark this node as updated so we don't re-update the offsets
-                    nid_translated.set(step_node_id - min_translated_id, 1);
+                    // move to the next membership record
+                    member_idx = get_next_membership(member_idx);
                 }
                 
-                first_iter = false;
+                // mark this node as updated so we don't re-update the offsets
+                nid_translated.set(step_node_id - min_translated_id, 1);
             }
+            
+            first_iter = false;
         }
-        else {
-            // the path is empty, so let's make sure it's not holding onto any capacity it doesn't need
-            path.links_iv = decltype(path.links_iv)();
-            path.steps_iv = decltype(path.steps_iv)();
-        }
-        
-        path_deleted_steps_iv.set(path_idx,  0);
     }
+    
+    path_deleted_steps_iv.set(path_idx,  0);
 }
 
 template<typename Backend>
@@ -1971,6 +4710,7 @@ void BasePackedGraph<Backend>::eject_deleted_paths() {
         for (size_t i = 0; i < paths.size(); ++i) {
             path_id[extract_encoded_path_name(i)] = i;
         }
+        path_metadata_indexed = false;
         
         // update the path IDs in the membership records
         for (size_t i = 0; i < path_membership_id_iv.size(); i += MEMBERSHIP_ID_RECORD_SIZE) {
@@ -2001,6 +4741,7 @@ void BasePackedGraph<Backend>::eject_deleted_paths() {
         
         // TODO: should I reassign the char to int mapping in case entire chars where ejected?
     }
+    deleted_path_name_length = 0;
     
     // consolidate the vectors that share indexes with the paths vector (we do this to get them
     // to a tight allocation even if no paths have been deleted)
@@ -2046,247 +4787,656 @@ void BasePackedGraph<Backend>::eject_deleted_paths() {
     }
     path_tail_iv = move(new_path_tail_iv);
     
-    PackedVector<> new_path_deleted_steps_iv;
-    new_path_deleted_steps_iv.reserve(paths.size());
-    for (size_t i = 0; i < paths.size(); ++i) {
-        new_path_deleted_steps_iv.append(path_deleted_steps_iv.get(i));
+    PackedVector<> new_path_deleted_steps_iv;
+    new_path_deleted_steps_iv.reserve(paths.size());
+    for (size_t i = 0; i < paths.size(); ++i) {
+        new_path_deleted_steps_iv.append(path_deleted_steps_iv.get(i));
+    }
+    path_deleted_steps_iv = move(new_path_deleted_steps_iv);
+    
+    // the paths may have been renumbered
+    update_path_metadata_index();
+    
+    // TODO: unless paths have been deleted, path_names_iv doesn't get a tight allocation...
+}
+
+template<typename Backend>
+void BasePackedGraph<Backend>::compact_ids(const vector<handle_t>& order) {
+    
+    if (order.size() != get_node_count()) {
+        throw std::runtime_error("error:[BasePackedGraph] attempted to compact node IDs according to an incomplete ordering of the nodes");
+    }
+    
+    // use the layout to make a translator between current IDs and the IDs we will reassign
+    SparsePackedDeque<> nid_trans;
+    nid_trans.extend_back(max_id - min_id + 1);
+    for (size_t i = 0; i < order.size(); ++i) {
+        nid_trans.set(get_id(order[i]) - min_id, i + 1);
+    }
+    
+    // for safety, let's copy this in case it's modified during reassignment
+    nid_t pre_assignment_min_id = min_id;
+    
+    // reassign the node IDs according to the order
+    translate_node_ids([&](const nid_t& node_id) {
+        return nid_trans.get(node_id - pre_assignment_min_id);
+    }, true);
+}
+
+template<typename Backend>
+void BasePackedGraph<Backend>::tighten() {
+    
+    // remove deleted paths and force them to eject deleted material, straightening
+    // batches of paths in parallel and then updating their memberships in order
+    size_t path_batch_size = 4 * get_thread_count();
+    for (size_t batch_begin = 0; batch_begin < paths.size(); batch_begin += path_batch_size) {
+        size_t batch_end = std::min(batch_begin + path_batch_size, paths.size());
+        vector<PagedVector<NARROW_PAGE_WIDTH>> offset_translators(batch_end - batch_begin);
+        vector<size_t> new_tails(batch_end - batch_begin, 0);
+#pragma omp parallel for schedule(dynamic, 1)
+        for (size_t i = batch_begin; i < batch_end; ++i) {
+            if (!path_is_deleted_iv.get(i) && !paths[i].compressed_steps) {
+                new_tails[i - batch_begin] = straighten_path(i, offset_translators[i - batch_begin]);
+            }
+        }
+        for (size_t i = batch_begin; i < batch_end; ++i) {
+            if (!path_is_deleted_iv.get(i) && !paths[i].compressed_steps) {
+                finish_defragment_path(i, new_tails[i - batch_begin], offset_translators[i - batch_begin]);
+            }
+        }
+    }
+    
+    // push any paths we deleted out of the path vector
+    eject_deleted_paths();
+    
+    // force the graph structures to reallocate in ID order and eject deleted material
+    defragment(true);
+    
+    // rebuild nid_to_graph_iv with exactly the blocks it needs
+    nid_to_graph_iv.shrink_to_fit();
+    
+    // count up the total length of all non-deleted sequence
+    size_t total_seq_len = seq_iv.size() - deleted_bases;
+    
+    // find where each sequence will start in the new seq_iv
+    static_assert(SEQ_START_RECORD_SIZE == SEQ_LENGTH_RECORD_SIZE,
+                  "These loops will need to be rewritten if we change the record sizes");
+    size_t num_seqs = seq_start_iv.size() / SEQ_START_RECORD_SIZE;
+    vector<uint64_t> new_seq_starts(num_seqs + 1, 0);
+    for (size_t i = 0; i < num_seqs; ++i) {
+        new_seq_starts[i + 1] = new_seq_starts[i] + seq_length_iv.get(i * SEQ_LENGTH_RECORD_SIZE);
+    }
+    
+    // make a new seq_iv of exactly the right size, and copy the sequences over in parallel
+    PackedVector<> new_seq_iv;
+    new_seq_iv.reserve(total_seq_len);
+    new_seq_iv.resize(new_seq_starts.back());
+    parallel_fill(new_seq_iv, num_seqs, [&](size_t i) { return new_seq_starts[i]; },
+                  [&](size_t i, uint64_t* out) {
+        seq_iv.get_range(seq_start_iv.get(i * SEQ_START_RECORD_SIZE),
+                         new_seq_starts[i + 1] - new_seq_starts[i], out);
+    });
+    
+    decltype(seq_exception_start_iv) new_seq_exception_start_iv;
+    decltype(seq_exception_length_iv) new_seq_exception_length_iv;
+    decltype(seq_exception_char_iv) new_seq_exception_char_iv;
+    for (size_t i = 0; i < seq_start_iv.size(); i += SEQ_START_RECORD_SIZE) {
+        // get the interval from the current seq_iv
+        size_t begin = seq_start_iv.get(i);
+        size_t end = begin + seq_length_iv.get(i);
+        size_t new_begin = new_seq_starts[i / SEQ_START_RECORD_SIZE];
+        // switch the pointer to the new seq iv
+        seq_start_iv.set(i, new_begin);
+        // transfer the exceptions over, clipped to this sequence
+        for (size_t j = first_exception_after(begin);
+             j < seq_exception_start_iv.size() && seq_exception_start_iv.get(j) < end; ++j) {
+            size_t run_start = std::max<size_t>(seq_exception_start_iv.get(j), begin);
+            size_t run_end = std::min<size_t>(seq_exception_start_iv.get(j) + seq_exception_length_iv.get(j), end);
+            new_seq_exception_start_iv.append(new_begin + run_start - begin);
+            new_seq_exception_length_iv.append(run_end - run_start);
+            new_seq_exception_char_iv.append(seq_exception_char_iv.get(j));
+        }
+    }
+    // replace the old seq iv
+    seq_iv = std::move(new_seq_iv);
+    seq_exception_start_iv = std::move(new_seq_exception_start_iv);
+    seq_exception_length_iv = std::move(new_seq_exception_length_iv);
+    seq_exception_char_iv = std::move(new_seq_exception_char_iv);
+    deleted_bases = 0;
+}
+
+template<typename Backend>
+void BasePackedGraph<Backend>::defragment(bool force) {
+    
+    if (!automatic_defragmentation && !force) {
+        return;
+    }
+    
+    BDSG_TIME_EVENT(GRAPH_DEFRAGMENT);
+    
+    if (node_records_fragmented() || force) {
+        defragment_node_records();
+    }
+    
+    // TODO: also defragment seq_iv?
+    // for now only doing that inside tighten()
+    
+    if (edge_records_fragmented() || force) {
+        defragment_edge_records();
+    }
+    
+    if (membership_records_fragmented() || force) {
+        defragment_membership_records();
+    }
+    
+    if (path_names_fragmented() || (force && deleted_path_name_length != 0)) {
+        defragment_path_names();
+    }
+}
+
+template<typename Backend>
+bool BasePackedGraph<Backend>::node_records_fragmented() const {
+    return deleted_node_records > defrag_factor * (graph_iv.size() / GRAPH_RECORD_SIZE);
+}
+
+template<typename Backend>
+bool BasePackedGraph<Backend>::edge_records_fragmented() const {
+    return deleted_edge_records > defrag_factor * (edge_lists_iv.size() / EDGE_RECORD_SIZE);
+}
+
+template<typename Backend>
+bool BasePackedGraph<Backend>::membership_records_fragmented() const {
+    return deleted_membership_records > defrag_factor * (path_membership_next_iv.size() / MEMBERSHIP_NEXT_RECORD_SIZE);
+}
+
+template<typename Backend>
+bool BasePackedGraph<Backend>::path_names_fragmented() const {
+    return deleted_path_name_length > defrag_factor * path_names_iv.size();
+}
+
+template<typename Backend>
+bool BasePackedGraph<Backend>::path_fragmented(const int64_t& path_idx) const {
+    return !path_is_deleted_iv.get(path_idx) &&
+        path_deleted_steps_iv.get(path_idx) > defrag_factor * (paths[path_idx].steps_iv.size() / PATH_RECORD_SIZE);
+}
+
+template<typename Backend>
+void BasePackedGraph<Backend>::defragment_path_names() {
+    
+    size_t name_length_kept = 0;
+    for (size_t i = 0; i < paths.size(); ++i) {
+        if (!path_is_deleted_iv.get(i)) {
+            name_length_kept += path_name_length_iv.get(i);
+        }
+    }
+    
+    // transfer over the remaining path names and update the pointers into them
+    decltype(path_names_iv) new_path_names_iv;
+    new_path_names_iv.resize(name_length_kept);
+    size_t name_filled_so_far = 0;
+    for (size_t i = 0; i < paths.size(); ++i) {
+        if (path_is_deleted_iv.get(i)) {
+            // the name is gone, so it shouldn't be counted again when this
+            // path is ejected
+            path_name_start_iv.set(i, 0);
+            path_name_length_iv.set(i, 0);
+            continue;
+        }
+        size_t name_start = path_name_start_iv.get(i);
+        size_t name_length = path_name_length_iv.get(i);
+        for (size_t j = 0; j < name_length; ++j) {
+            new_path_names_iv.set(name_filled_so_far + j, path_names_iv.get(name_start + j));
+        }
+        path_name_start_iv.set(i, name_filled_so_far);
+        name_filled_so_far += name_length;
+    }
+    
+    path_names_iv = move(new_path_names_iv);
+    deleted_path_name_length = 0;
+}
+
+template<typename Backend>
+void BasePackedGraph<Backend>::defragment_node_records() {
+    // what's the real number of undeleted nodes in the graph?
+    uint64_t num_nodes = graph_iv.size() / GRAPH_RECORD_SIZE - deleted_node_records;
+    
+    // adjust the start
+    size_t leading_zeros = nid_to_graph_iv.next_nonzero(0);
+    nid_to_graph_iv.drop_front(leading_zeros);
+    min_id += leading_zeros;
+    // adjust the end
+    if (!nid_to_graph_iv.empty()) {
+        nid_to_graph_iv.drop_back(nid_to_graph_iv.size() - 1 - nid_to_graph_iv.prev_nonzero(nid_to_graph_iv.size() - 1));
+    }
+    if (nid_to_graph_iv.empty()) {
+        min_id = numeric_limits<nid_t>::max();
+        max_id = 0;
+    }
+    else {
+        max_id = min_id + nid_to_graph_iv.size() - 1;
+    }
+    
+    // initialize new vectors to construct defragged copies in
+    decltype(graph_iv) new_graph_iv;
+    PackedVector<> new_seq_length_iv;
+    decltype(seq_start_iv) new_seq_start_iv;
+    decltype(path_membership_node_iv) new_path_membership_node_iv;
+    
+    // expand them to the size we need to avoid reallocation and get optimal compression
+    new_graph_iv.reserve(num_nodes * GRAPH_RECORD_SIZE);
+    new_seq_length_iv.reserve(num_nodes * SEQ_LENGTH_RECORD_SIZE);
+    new_seq_start_iv.reserve(num_nodes * SEQ_START_RECORD_SIZE);
+    new_path_membership_node_iv.reserve(num_nodes * NODE_MEMBER_RECORD_SIZE);
+    
+    // copy the records of the nodes that still exist in parallel
+    vector<size_t> order = graph_indexes_in_id_order();
+    new_graph_iv.resize(order.size() * GRAPH_RECORD_SIZE);
+    new_seq_length_iv.resize(order.size() * SEQ_LENGTH_RECORD_SIZE);
+    new_seq_start_iv.resize(order.size() * SEQ_START_RECORD_SIZE);
+    new_path_membership_node_iv.resize(order.size() * NODE_MEMBER_RECORD_SIZE);
+    parallel_fill(new_graph_iv, order.size(), [](size_t i) { return i * GRAPH_RECORD_SIZE; },
+                  [&](size_t i, uint64_t* out) {
+        out[0] = graph_iv.get(order[i] + GRAPH_START_EDGES_OFFSET);
+        out[1] = graph_iv.get(order[i] + GRAPH_END_EDGES_OFFSET);
+    });
+    parallel_fill(new_seq_length_iv, order.size(), [](size_t i) { return i * SEQ_LENGTH_RECORD_SIZE; },
+                  [&](size_t i, uint64_t* out) {
+        out[0] = seq_length_iv.get(graph_index_to_seq_len_index(order[i]));
+    });
+    parallel_fill(new_seq_start_iv, order.size(), [](size_t i) { return i * SEQ_START_RECORD_SIZE; },
+                  [&](size_t i, uint64_t* out) {
+        out[0] = seq_start_iv.get(graph_index_to_seq_start_index(order[i]));
+    });
+    parallel_fill(new_path_membership_node_iv, order.size(), [](size_t i) { return i * NODE_MEMBER_RECORD_SIZE; },
+                  [&](size_t i, uint64_t* out) {
+        out[0] = path_membership_node_iv.get(graph_index_to_node_member_index(order[i]));
+    });
+    
+    // update the pointers into graph_iv
+    size_t num_copied = 0;
+    for (size_t i = nid_to_graph_iv.next_nonzero(0); i < nid_to_graph_iv.size(); i = nid_to_graph_iv.next_nonzero(i + 1)) {
+        nid_to_graph_iv.set(i, ++num_copied);
+    }
+    
+    // replace graph with the defragged copy
+    graph_iv = std::move(new_graph_iv);
+    seq_length_iv = std::move(new_seq_length_iv);
+    seq_start_iv = std::move(new_seq_start_iv);
+    path_membership_node_iv = std::move(new_path_membership_node_iv);
+    
+    deleted_node_records = 0;
+}
+
+template<typename Backend>
+void BasePackedGraph<Backend>::defragment_edge_records() {
+    
+    uint64_t num_edge_records = edge_lists_iv.size() / EDGE_RECORD_SIZE - deleted_edge_records;
+    
+    decltype(edge_lists_iv) new_edge_lists_iv;
+    new_edge_lists_iv.reserve(num_edge_records * EDGE_RECORD_SIZE);
+    
+    // find where each node's edge lists will go
+    vector<size_t> order = graph_indexes_in_id_order();
+    vector<uint64_t> new_offsets(order.size() + 1, 0);
+#pragma omp parallel for schedule(dynamic, PARALLEL_ITERATION_CHUNK_SIZE)
+    for (size_t i = 0; i < order.size(); ++i) {
+        size_t num_records = 0;
+        for (size_t edge_list_offset : {GRAPH_START_EDGES_OFFSET, GRAPH_END_EDGES_OFFSET}) {
+            for (size_t edge_list_idx = graph_iv.get(order[i] + edge_list_offset); edge_list_idx;
+                 edge_list_idx = get_next_edge_index(edge_list_idx)) {
+                ++num_records;
+            }
+        }
+        new_offsets[i + 1] = num_records * EDGE_RECORD_SIZE;
+    }
+    for (size_t i = 0; i < order.size(); ++i) {
+        new_offsets[i + 1] += new_offsets[i];
+    }
+    
+    // copy the edge lists in parallel, with each list contiguous and in order
+    vector<uint64_t> new_heads(order.size() * 2, 0);
+    new_edge_lists_iv.resize(new_offsets.back());
+    parallel_fill(new_edge_lists_iv, order.size(), [&](size_t i) { return new_offsets[i]; },
+                  [&](size_t i, uint64_t* out) {
+        // the 1-based index of the next edge record we will make
+        uint64_t next_record = new_offsets[i] / EDGE_RECORD_SIZE + 1;
+        for (size_t j : {0, 1}) {
+            size_t edge_list_idx = graph_iv.get(order[i] + (j ? GRAPH_END_EDGES_OFFSET : GRAPH_START_EDGES_OFFSET));
+            if (edge_list_idx) {
+                new_heads[2 * i + j] = next_record;
+            }
+            while (edge_list_idx) {
+                // add a new edge record that points to the following one
+                uint64_t next_edge_list_idx = get_next_edge_index(edge_list_idx);
+                out[EDGE_TRAV_OFFSET] = get_edge_target(edge_list_idx);
+                out[EDGE_NEXT_OFFSET] = next_edge_list_idx ? next_record + 1 : 0;
+                out += EDGE_RECORD_SIZE;
+                ++next_record;
+                edge_list_idx = next_edge_list_idx;
+            }
+        }
+    });
+    
+    // point the graph vector at the new edge lists
+    for (size_t i = 0; i < order.size(); ++i) {
+        for (size_t j : {0, 1}) {
+            if (new_heads[2 * i + j]) {
+                graph_iv.set(order[i] + (j ? GRAPH_END_EDGES_OFFSET : GRAPH_START_EDGES_OFFSET), new_heads[2 * i + j]);
+            }
+        }
     }
-    path_deleted_steps_iv = move(new_path_deleted_steps_iv);
     
-    // TODO: unless paths have been deleted, path_names_iv doesn't get a tight allocation...
+    edge_lists_iv = std::move(new_edge_lists_iv);
+    
+    deleted_edge_records = 0;
+    reversing_self_edge_records -= deleted_reversing_self_edge_records;
+    deleted_reversing_self_edge_records = 0;
 }
 
 template<typename Backend>
-void BasePackedGraph<Backend>::compact_ids(const vector<handle_t>& order) {
+void BasePackedGraph<Backend>::sort_path_memberships() {
+    defragment_membership_records(true);
+}
+
+template<typename Backend>
+void BasePackedGraph<Backend>::defragment_membership_records(bool sort_by_path) {
     
-    if (order.size() != get_node_count()) {
-        throw std::runtime_error("error:[BasePackedGraph] attempted to compact node IDs according to an incomplete ordering of the nodes");
-    }
+    uint64_t num_membership_records = path_membership_next_iv.size() / MEMBERSHIP_NEXT_RECORD_SIZE - deleted_membership_records;
     
-    // use the layout to make a translator between current IDs and the IDs we will reassign
-    PagedVector<NARROW_PAGE_WIDTH> nid_trans;
-    nid_trans.resize(max_id - min_id + 1);
+    decltype(path_membership_id_iv) new_path_membership_id_iv;
+    decltype(path_membership_offset_iv) new_path_membership_offset_iv;
+    decltype(path_membership_next_iv) new_path_membership_next_iv;
+    
+    new_path_membership_id_iv.reserve(num_membership_records * MEMBERSHIP_ID_RECORD_SIZE);
+    new_path_membership_offset_iv.reserve(num_membership_records * MEMBERSHIP_OFFSET_RECORD_SIZE);
+    new_path_membership_next_iv.reserve(num_membership_records * MEMBERSHIP_NEXT_RECORD_SIZE);
+    
+    // find where each node's membership list will go
+    vector<size_t> order = graph_indexes_in_id_order();
+    vector<uint64_t> new_records(order.size() + 1, 0);
+#pragma omp parallel for schedule(dynamic, PARALLEL_ITERATION_CHUNK_SIZE)
     for (size_t i = 0; i < order.size(); ++i) {
-        nid_trans.set(get_id(order[i]) - min_id, i + 1);
+        size_t num_records = 0;
+        for (uint64_t member_idx = path_membership_node_iv.get(graph_index_to_node_member_index(order[i]));
+             member_idx; member_idx = get_next_membership(member_idx)) {
+            ++num_records;
+        }
+        new_records[i + 1] = num_records;
+    }
+    for (size_t i = 0; i < order.size(); ++i) {
+        new_records[i + 1] += new_records[i];
     }
     
-    // for safety, let's copy this in case it's modified during reassignment
-    nid_t pre_assignment_min_id = min_id;
+    // visit the membership records of a node in the order they will be laid out
+    auto for_each_membership = [&](size_t i, const std::function<void(uint64_t)>& iteratee) {
+        uint64_t first_member_idx = path_membership_node_iv.get(graph_index_to_node_member_index(order[i]));
+        if (!sort_by_path) {
+            for (uint64_t member_idx = first_member_idx; member_idx; member_idx = get_next_membership(member_idx)) {
+                iteratee(member_idx);
+            }
+            return;
+        }
+        vector<pair<pair<uint64_t, uint64_t>, uint64_t>> members;
+        for (uint64_t member_idx = first_member_idx; member_idx; member_idx = get_next_membership(member_idx)) {
+            members.emplace_back(make_pair(get_membership_path(member_idx), get_membership_step(member_idx)), member_idx);
+        }
+        std::sort(members.begin(), members.end());
+        for (const auto& member : members) {
+            iteratee(member.second);
+        }
+    };
     
-    // reassign the node IDs according to the order
-    reassign_node_ids([&](const nid_t& node_id) {
-        return nid_trans.get(node_id - pre_assignment_min_id);
+    // copy the membership lists in parallel, with each list contiguous and in order
+    new_path_membership_id_iv.resize(new_records.back() * MEMBERSHIP_ID_RECORD_SIZE);
+    new_path_membership_offset_iv.resize(new_records.back() * MEMBERSHIP_OFFSET_RECORD_SIZE);
+    new_path_membership_next_iv.resize(new_records.back() * MEMBERSHIP_NEXT_RECORD_SIZE);
+    parallel_fill(new_path_membership_id_iv, order.size(),
+                  [&](size_t i) { return new_records[i] * MEMBERSHIP_ID_RECORD_SIZE; },
+                  [&](size_t i, uint64_t* out) {
+        for_each_membership(i, [&](uint64_t member_idx) {
+            *out = get_membership_path(member_idx);
+            out += MEMBERSHIP_ID_RECORD_SIZE;
+        });
+    });
+    parallel_fill(new_path_membership_offset_iv, order.size(),
+                  [&](size_t i) { return new_records[i] * MEMBERSHIP_OFFSET_RECORD_SIZE; },
+                  [&](size_t i, uint64_t* out) {
+        for_each_membership(i, [&](uint64_t member_idx) {
+            *out = get_membership_step(member_idx);
+            out += MEMBERSHIP_OFFSET_RECORD_SIZE;
+        });
     });
+    parallel_fill(new_path_membership_next_iv, order.size(),
+                  [&](size_t i) { return new_records[i] * MEMBERSHIP_NEXT_RECORD_SIZE; },
+                  [&](size_t i, uint64_t* out) {
+        // the 1-based index of the following membership record, with the
+        // list ending at the next node's records
+        for (uint64_t next_record = new_records[i] + 2; next_record <= new_records[i + 1] + 1; ++next_record) {
+            *out = next_record <= new_records[i + 1] ? next_record : 0;
+            out += MEMBERSHIP_NEXT_RECORD_SIZE;
+        }
+    });
+    
+    // point the membership vector at the new lists
+    for (size_t i = 0; i < order.size(); ++i) {
+        if (new_records[i + 1] != new_records[i]) {
+            path_membership_node_iv.set(graph_index_to_node_member_index(order[i]), new_records[i] + 1);
+        }
+    }
+    
+    path_membership_id_iv = std::move(new_path_membership_id_iv);
+    path_membership_offset_iv = std::move(new_path_membership_offset_iv);
+    path_membership_next_iv = std::move(new_path_membership_next_iv);
+    
+    deleted_membership_records = 0;
 }
 
 template<typename Backend>
-void BasePackedGraph<Backend>::tighten() {
-    
-    // remove deleted paths and force them to eject deleted material
-    for (size_t i = 0; i < paths.size(); i++) {
-        // force the path to defragment
-        defragment_path(i, true);
+void BasePackedGraph<Backend>::set_automatic_defragmentation(bool automatic) {
+    automatic_defragmentation = automatic;
+}
+
+template<typename Backend>
+void BasePackedGraph<Backend>::set_path_compression(bool compress) {
+    path_compression = compress;
+}
+
+template<typename Backend>
+void BasePackedGraph<Backend>::set_serialization_compression(bool compress, size_t block_size) {
+    if (compress && !block_compression_available()) {
+        throw std::runtime_error("error:[BasePackedGraph] cannot use block-compressed serialization, because libbdsg was built without zlib");
     }
+    if (block_size == 0) {
+        throw std::runtime_error("error:[BasePackedGraph] block-compressed serialization needs a nonzero block size");
+    }
+    serialization_compression = compress;
+    serialization_block_size = block_size;
+}
+
+template<typename Backend>
+bool BasePackedGraph<Backend>::compress_path(const int64_t& path_idx) {
     
-    // push any paths we deleted out of the path vector
-    eject_deleted_paths();
-    
-    // force the graph structures to reallocate in ID order and eject deleted material
-    defragment(true);
+    PackedPath& path = paths[path_idx];
+    size_t num_steps = path.steps_iv.size() / STEP_RECORD_SIZE;
+    if (path.compressed_steps || num_steps == 0 || path_is_deleted_iv.get(path_idx)
+        || path_deleted_steps_iv.get(path_idx) != 0 || path_head_iv.get(path_idx) != 1
+        || path_tail_iv.get(path_idx) != num_steps) {
+        return false;
+    }
+    bool circular = path_is_circular_iv.get(path_idx);
+    for (size_t i = 1; i <= num_steps; ++i) {
+        uint64_t expected_prev = i > 1 ? i - 1 : (circular ? num_steps : 0);
+        uint64_t expected_next = i < num_steps ? i + 1 : (circular ? 1 : 0);
+        if (get_step_prev(path, i) != expected_prev || get_step_next(path, i) != expected_next) {
+            // the links would not be implicit
+            return false;
+        }
+    }
     
-    // make a new nid_to_graph_iv of exactly the right size
-    decltype(nid_to_graph_iv) new_nid_to_graph_iv;
-    new_nid_to_graph_iv.reserve(nid_to_graph_iv.size());
-    // transfer of the data
-    for (size_t i = 0; i < nid_to_graph_iv.size(); i++) {
-        new_nid_to_graph_iv.append_back(nid_to_graph_iv.get(i));
+    PackedPath compressed;
+    size_t num_blocks = (num_steps + COMPRESSED_BLOCK_SIZE - 1) / COMPRESSED_BLOCK_SIZE;
+    compressed.block_bases_iv.resize(num_blocks);
+    compressed.block_widths_iv.resize(num_blocks);
+    compressed.block_starts_iv.resize(num_blocks);
+    
+    // lay out the blocks, which each use a fixed number of bits per step
+    size_t total_bits = 0;
+    for (size_t block = 0; block < num_blocks; ++block) {
+        size_t begin = block * COMPRESSED_BLOCK_SIZE + 1;
+        size_t end = std::min(begin + COMPRESSED_BLOCK_SIZE, num_steps + 1);
+        uint64_t base = std::numeric_limits<uint64_t>::max();
+        uint64_t max_trav = 0;
+        for (size_t i = begin; i < end; ++i) {
+            uint64_t trav = get_step_trav(path, i);
+            base = std::min(base, trav);
+            max_trav = std::max(max_trav, trav);
+        }
+        uint64_t width = max_trav == base ? 0 : 64 - __builtin_clzll(max_trav - base);
+        compressed.block_bases_iv.set(block, base);
+        compressed.block_widths_iv.set(block, width);
+        compressed.block_starts_iv.set(block, total_bits);
+        total_bits += width * (end - begin);
     }
-    // replace the old one
-    nid_to_graph_iv = std::move(new_nid_to_graph_iv);
     
-    // count up the total length of all non-deleted sequence
-    size_t total_seq_len = seq_iv.size() - deleted_bases;
+    vector<uint32_t> words((total_bits + 31) / 32, 0);
+    for (size_t block = 0; block < num_blocks; ++block) {
+        uint64_t width = compressed.block_widths_iv.get(block);
+        if (width == 0) {
+            continue;
+        }
+        uint64_t base = compressed.block_bases_iv.get(block);
+        size_t bit = compressed.block_starts_iv.get(block);
+        size_t begin = block * COMPRESSED_BLOCK_SIZE + 1;
+        size_t end = std::min(begin + COMPRESSED_BLOCK_SIZE, num_steps + 1);
+        for (size_t i = begin; i < end; ++i, bit += width) {
+            uint64_t offset = get_step_trav(path, i) - base;
+            for (uint64_t filled = 0; filled < width;) {
+                uint64_t shift = (bit + filled) % 32;
+                uint64_t taking = std::min<uint64_t>(32 - shift, width - filled);
+                words[(bit + filled) / 32] |= ((offset >> filled) & ((uint64_t(1) << taking) - 1)) << shift;
+                filled += taking;
+            }
+        }
+    }
+    compressed.packed_steps_iv.reserve(words.size());
+    for (const uint32_t& word : words) {
+        compressed.packed_steps_iv.append(word);
+    }
     
-    // make a new seq_iv of exactly the right size
-    PackedVector<> new_seq_iv;
-    new_seq_iv.reserve(total_seq_len);
-    static_assert(SEQ_START_RECORD_SIZE == SEQ_LENGTH_RECORD_SIZE,
-                  "This loop will need to be rewritten if we change the record sizes");
-    for (size_t i = 0; i < seq_start_iv.size(); i += SEQ_START_RECORD_SIZE) {
-        // get the interval from the current seq_iv
-        size_t begin = seq_start_iv.get(i);
-        size_t end = begin + seq_length_iv.get(i);
-        // switch the pointer to the new seq iv
-        seq_start_iv.set(i, new_seq_iv.size());
-        // transfer the actual sequence over
-        for (size_t j = begin; j < end; j++) {
-            new_seq_iv.append(seq_iv.get(j));
+    compressed.compressed_steps = num_steps;
+    compressed.compressed_circular = circular;
+    path = std::move(compressed);
+    return true;
+}
+
+template<typename Backend>
+void BasePackedGraph<Backend>::decompress_path(PackedPath& path) {
+    if (!path.compressed_steps) {
+        return;
+    }
+    PackedPath decompressed;
+    decompressed.steps_iv.reserve(path.compressed_steps * STEP_RECORD_SIZE);
+    decompressed.links_iv.reserve(path.compressed_steps * PATH_RECORD_SIZE);
+    for (size_t i = 1; i <= path.compressed_steps; ++i) {
+        decompressed.steps_iv.append(get_step_trav(path, i));
+        decompressed.links_iv.append(get_step_prev(path, i));
+        decompressed.links_iv.append(get_step_next(path, i));
+    }
+    path = std::move(decompressed);
+}
+
+template<typename Backend>
+bool BasePackedGraph<Backend>::needs_defragmentation() const {
+    if (node_records_fragmented() || edge_records_fragmented() || membership_records_fragmented() ||
+        path_names_fragmented()) {
+        return true;
+    }
+    for (size_t i = 0; i < paths.size(); ++i) {
+        if (path_fragmented(i)) {
+            return true;
         }
     }
-    // replace the old seq iv
-    seq_iv = std::move(new_seq_iv);
-    deleted_bases = 0;
+    return false;
 }
 
 template<typename Backend>
-void BasePackedGraph<Backend>::defragment(bool force) {
-    
-    uint64_t num_nodes = graph_iv.size() / GRAPH_RECORD_SIZE - deleted_node_records;
-    if (deleted_node_records > defrag_factor * (graph_iv.size() / GRAPH_RECORD_SIZE) || force) {
-        // what's the real number of undeleted nodes in the graph?
-        uint64_t num_nodes = graph_iv.size() / GRAPH_RECORD_SIZE - deleted_node_records;
-        
-        // adjust the start
-        while (!nid_to_graph_iv.empty() && nid_to_graph_iv.get(0) == 0) {
-            nid_to_graph_iv.pop_front();
-            min_id++;
+bool BasePackedGraph<Backend>::is_single_stranded() const {
+    uint8_t state = single_stranded_state.load();
+    if (state == 0) {
+        // check all the nodes in parallel, stopping once any reversing edge is found
+        std::atomic<bool> single_stranded(true);
+        for_each_handle([&](const handle_t& handle) {
+            for (bool go_left : {false, true}) {
+                follow_edges(handle, go_left, [&](const handle_t& next) {
+                    if (get_is_reverse(next) != get_is_reverse(handle)) {
+                        single_stranded.store(false);
+                    }
+                    return single_stranded.load();
+                });
+            }
+            return single_stranded.load();
+        }, true);
+        state = single_stranded.load() ? 1 : 2;
+        // a graph mapped read-only from a file can't remember the answer
+        auto chain = yomo::Manager::get_chain(this);
+        if (chain == yomo::Manager::NO_CHAIN || yomo::Manager::is_chain_writable(chain)) {
+            single_stranded_state.store(state);
         }
-        // adjust the end
-        while (!nid_to_graph_iv.empty() && nid_to_graph_iv.get(nid_to_graph_iv.size() - 1) == 0) {
-            nid_to_graph_iv.pop_back();
+    }
+    return state == 1;
+}
+
+template<typename Backend>
+bool BasePackedGraph<Backend>::defragment_step(size_t max_records) {
+    
+    size_t records_moved = 0;
+    // take a unit of work if it fits in the budget, or if it's the first one
+    auto take = [&](size_t num_records) {
+        if (records_moved != 0 && records_moved + num_records > max_records) {
+            return false;
         }
-        if (nid_to_graph_iv.empty()) {
-            min_id = numeric_limits<nid_t>::max();
-            max_id = 0;
+        records_moved += num_records;
+        return true;
+    };
+    
+    if (node_records_fragmented()) {
+        if (!take(get_node_count())) {
+            return true;
         }
-        else {
-            max_id = min_id + nid_to_graph_iv.size() - 1;
+        defragment_node_records();
+    }
+    if (edge_records_fragmented()) {
+        if (!take(edge_lists_iv.size() / EDGE_RECORD_SIZE - deleted_edge_records)) {
+            return true;
         }
-        
-        // initialize new vectors to construct defragged copies in
-        decltype(graph_iv) new_graph_iv;
-        PackedVector<> new_seq_length_iv;
-        decltype(seq_start_iv) new_seq_start_iv;
-        decltype(path_membership_node_iv) new_path_membership_node_iv;
-        
-        // expand them to the size we need to avoid reallocation and get optimal compression
-        new_graph_iv.reserve(num_nodes * GRAPH_RECORD_SIZE);
-        new_seq_length_iv.reserve(num_nodes * SEQ_LENGTH_RECORD_SIZE);
-        new_seq_start_iv.reserve(num_nodes * SEQ_START_RECORD_SIZE);
-        new_path_membership_node_iv.reserve(num_nodes * NODE_MEMBER_RECORD_SIZE);
-        
-        for (size_t i = 0; i < nid_to_graph_iv.size(); i++) {
-            size_t raw_g_iv_idx = nid_to_graph_iv.get(i);
-            if (raw_g_iv_idx) {
-                size_t g_iv_idx = (raw_g_iv_idx - 1) * GRAPH_RECORD_SIZE;
-                // this node still exists, create a new copy
-                new_graph_iv.append(graph_iv.get(g_iv_idx + GRAPH_START_EDGES_OFFSET));
-                new_graph_iv.append(graph_iv.get(g_iv_idx + GRAPH_END_EDGES_OFFSET));
-                new_seq_length_iv.append(seq_length_iv.get(graph_index_to_seq_len_index(g_iv_idx)));
-                new_seq_start_iv.append(seq_start_iv.get(graph_index_to_seq_start_index(g_iv_idx)));
-                new_path_membership_node_iv.append(path_membership_node_iv.get(graph_index_to_node_member_index(g_iv_idx)));
-                // update the pointer into graph_iv
-                nid_to_graph_iv.set(i, new_graph_iv.size() / GRAPH_RECORD_SIZE);
-            }
+        defragment_edge_records();
+    }
+    if (membership_records_fragmented()) {
+        if (!take(path_membership_next_iv.size() / MEMBERSHIP_NEXT_RECORD_SIZE - deleted_membership_records)) {
+            return true;
         }
-        
-        // replace graph with the defragged copy
-        graph_iv = std::move(new_graph_iv);
-        seq_length_iv = std::move(new_seq_length_iv);
-        seq_start_iv = std::move(new_seq_start_iv);
-        path_membership_node_iv = std::move(new_path_membership_node_iv);
-        
-        deleted_node_records = 0;
+        defragment_membership_records();
     }
-    
-    // TODO: also defragment seq_iv?
-    // for now only doing that inside tighten()
-    
-    if (deleted_edge_records > defrag_factor * (edge_lists_iv.size() / EDGE_RECORD_SIZE) || force) {
-        
-        uint64_t num_edge_records = edge_lists_iv.size() / EDGE_RECORD_SIZE - deleted_edge_records;
-        
-        decltype(edge_lists_iv) new_edge_lists_iv;
-        new_edge_lists_iv.reserve(num_edge_records * EDGE_RECORD_SIZE);
-        
-        for (size_t i = 0; i < nid_to_graph_iv.size(); i++) {
-            size_t raw_g_iv_idx = nid_to_graph_iv.get(i);
-            if (raw_g_iv_idx) {
-                // this node still exists
-                size_t g_iv_idx = (raw_g_iv_idx - 1) * GRAPH_RECORD_SIZE;
-                for (size_t edge_list_offset : {GRAPH_START_EDGES_OFFSET, GRAPH_END_EDGES_OFFSET}) {
-                    size_t edge_list_idx = graph_iv.get(g_iv_idx + edge_list_offset);
-                    if (edge_list_idx) {
-                        // add a new edge record
-                        new_edge_lists_iv.append(get_edge_target(edge_list_idx));
-                        new_edge_lists_iv.append(0);
-                        // point the graph vector at this new edge list
-                        graph_iv.set(g_iv_idx + edge_list_offset, new_edge_lists_iv.size() / EDGE_RECORD_SIZE);
-                        
-                        edge_list_idx = get_next_edge_index(edge_list_idx);
-                        while (edge_list_idx) {
-                            // add a new edge record
-                            new_edge_lists_iv.append(get_edge_target(edge_list_idx));
-                            new_edge_lists_iv.append(0);
-                            // point the previous link at this one
-                            new_edge_lists_iv.set(new_edge_lists_iv.size() - 2 * EDGE_RECORD_SIZE + EDGE_NEXT_OFFSET,
-                                                  new_edge_lists_iv.size() / EDGE_RECORD_SIZE);
-                            
-                            edge_list_idx = get_next_edge_index(edge_list_idx);
-                        }
-                    }
-                }
-            }
+    if (path_names_fragmented()) {
+        if (!take(path_names_iv.size() - deleted_path_name_length)) {
+            return true;
         }
-        
-        edge_lists_iv = std::move(new_edge_lists_iv);
-        
-        deleted_edge_records = 0;
-        reversing_self_edge_records -= deleted_reversing_self_edge_records;
-        deleted_reversing_self_edge_records = 0;
+        defragment_path_names();
     }
     
-    if (deleted_membership_records > defrag_factor * (path_membership_next_iv.size() / MEMBERSHIP_NEXT_RECORD_SIZE) || force) {
-        
-        uint64_t num_membership_records = path_membership_next_iv.size() / MEMBERSHIP_NEXT_RECORD_SIZE - deleted_membership_records;
-        
-        decltype(path_membership_id_iv) new_path_membership_id_iv;
-        decltype(path_membership_offset_iv) new_path_membership_offset_iv;
-        decltype(path_membership_next_iv) new_path_membership_next_iv;
-        
-        new_path_membership_id_iv.reserve(num_membership_records * MEMBERSHIP_ID_RECORD_SIZE);
-        new_path_membership_offset_iv.reserve(num_membership_records * MEMBERSHIP_OFFSET_RECORD_SIZE);
-        new_path_membership_next_iv.reserve(num_membership_records * MEMBERSHIP_NEXT_RECORD_SIZE);
-        
-        for (size_t i = 0; i < nid_to_graph_iv.size(); i++) {
-            size_t raw_g_iv_idx = nid_to_graph_iv.get(i);
-            if (raw_g_iv_idx) {
-                // this node still exists
-                size_t g_iv_idx = (raw_g_iv_idx - 1) * GRAPH_RECORD_SIZE;
-                
-                uint64_t member_idx = path_membership_node_iv.get(graph_index_to_node_member_index(g_iv_idx));
-                if (member_idx) {
-                    // make a new membership record
-                    new_path_membership_id_iv.append(get_membership_path(member_idx));
-                    new_path_membership_offset_iv.append(get_membership_step(member_idx));
-                    new_path_membership_next_iv.append(0);
-                    
-                    // point the membership vector here
-                    path_membership_node_iv.set(graph_index_to_node_member_index(g_iv_idx),
-                                                new_path_membership_next_iv.size() / MEMBERSHIP_NEXT_RECORD_SIZE);
-                    
-                    member_idx = get_next_membership(member_idx);
-                    while (member_idx) {
-                        // make a new membership record
-                        new_path_membership_id_iv.append(get_membership_path(member_idx));
-                        new_path_membership_offset_iv.append(get_membership_step(member_idx));
-                        new_path_membership_next_iv.append(0);
-                        // point the previous link at this one
-                        new_path_membership_next_iv.set(new_path_membership_next_iv.size() - 2 * MEMBERSHIP_NEXT_RECORD_SIZE,
-                                                        new_path_membership_next_iv.size() / MEMBERSHIP_NEXT_RECORD_SIZE);
-                        
-                        member_idx = get_next_membership(member_idx);
-                    }
-                }
+    // go around the paths, starting where we stopped last time
+    for (size_t i = 0; i < paths.size(); ++i) {
+        size_t path_idx = (next_path_to_defragment + i) % paths.size();
+        if (path_fragmented(path_idx)) {
+            if (!take(paths[path_idx].steps_iv.size() / STEP_RECORD_SIZE - path_deleted_steps_iv.get(path_idx))) {
+                next_path_to_defragment = path_idx;
+                return true;
             }
+            defragment_path(path_idx, true);
         }
-        
-        path_membership_id_iv = std::move(new_path_membership_id_iv);
-        path_membership_offset_iv = std::move(new_path_membership_offset_iv);
-        path_membership_next_iv = std::move(new_path_membership_next_iv);
-        
-        deleted_membership_records = 0;
     }
+    
+    return false;
 }
 
 template<typename Backend>
@@ -2303,30 +5453,36 @@ void BasePackedGraph<Backend>::optimize(bool allow_id_reassignment) {
         StrandSplitOverlay digraph(&proxy);
         
         // get a low FAS layout using Eades-Lin-Smyth algorithm
-        vector<handle_t> layout = algorithms::eades_algorithm(&digraph);
         // note: the single stranded graph will have a fully separated forward and reverse strands, so
         // we have the guarantee that every handle in this layout is forward in the strand split graph
         
-        // in place, take only the handles that are forward in the source graph and convert them back
-        // to the source handles
-        size_t skipped = 0;
-        for (size_t i = 0; i < layout.size(); ++i) {
-            handle_t underlying = digraph.get_underlying_handle(layout[i]);
-            if (get_is_reverse(underlying)) {
-                ++skipped;
+        // as the layout streams out, take only the handles that are forward in the source graph and
+        // convert them back to the source handles
+        vector<handle_t> layout;
+        layout.reserve(get_node_count());
+        algorithms::parallel_eades_algorithm(&digraph, [&](const handle_t& handle) {
+            handle_t underlying = digraph.get_underlying_handle(handle);
+            if (!get_is_reverse(underlying)) {
+                layout.push_back(underlying);
             }
-            else {
-                layout[i - skipped] = underlying;
-            }
-        }
-        // remove everything we skipped
-        layout.resize(layout.size() - skipped);
+        });
         
         compact_ids(layout);
     }
     
     // tighten up vector allocations and straighten out the linked lists they contain
     tighten();
+    
+    if (path_compression) {
+        // the paths are all straight now, so they can all be compressed
+#pragma omp parallel for schedule(dynamic, 1)
+        for (size_t i = 0; i < paths.size(); ++i) {
+            compress_path(i);
+        }
+    }
+    
+    // assume the paths have settled down too
+    index_path_names();
 }
 
 template<typename Backend>
@@ -2341,12 +5497,16 @@ bool BasePackedGraph<Backend>::apply_ordering(const vector<handle_t>& order, boo
 
 template<typename Backend>
 void BasePackedGraph<Backend>::clear(void) {
+    single_stranded_state = 0;
     graph_iv.clear();
     seq_start_iv.clear();
     seq_length_iv.clear();
     edge_lists_iv.clear();
     nid_to_graph_iv.clear();
     seq_iv.clear();
+    seq_exception_start_iv.clear();
+    seq_exception_length_iv.clear();
+    seq_exception_char_iv.clear();
     path_membership_node_iv.clear();
     path_membership_id_iv.clear();
     path_membership_offset_iv.clear();
@@ -2354,6 +5514,12 @@ void BasePackedGraph<Backend>::clear(void) {
     paths.clear();
     paths.shrink_to_fit();
     path_id.clear();
+    path_names_indexed = false;
+    path_name_order_iv.clear();
+    path_metadata_indexed = false;
+    paths_by_sense.clear();
+    paths_by_sample.clear();
+    paths_by_locus.clear();
     min_id = std::numeric_limits<nid_t>::max();
     max_id = 0;
     deleted_edge_records = 0;
@@ -2362,10 +5528,15 @@ void BasePackedGraph<Backend>::clear(void) {
     deleted_bases = 0;
     reversing_self_edge_records = 0;
     deleted_reversing_self_edge_records = 0;
+    deleted_path_name_length = 0;
 }
 
 template<typename Backend>
 bool BasePackedGraph<Backend>::has_path(const std::string& path_name) const {
+    if (path_names_indexed) {
+        auto range = find_indexed_path_names(path_name, false);
+        return range.first != range.second;
+    }
     auto encoded = encode_path_name(path_name);
     if (encoded.empty()) {
         return false;
@@ -2377,9 +5548,133 @@ bool BasePackedGraph<Backend>::has_path(const std::string& path_name) const {
 
 template<typename Backend>
 path_handle_t BasePackedGraph<Backend>::get_path_handle(const std::string& path_name) const {
+    if (path_names_indexed) {
+        auto range = find_indexed_path_names(path_name, false);
+        if (range.first != range.second) {
+            return as_path_handle(path_name_order_iv.get(range.first));
+        }
+        // let the hash table complain about the missing path
+    }
     return as_path_handle(path_id.at(encode_path_name(path_name)));
 }
 
+template<typename Backend>
+void BasePackedGraph<Backend>::index_path_names() {
+    
+    path_name_char_codes.fill(0);
+    for (size_t i = 0; i < inverse_char_assignment.size(); ++i) {
+        path_name_char_codes[(unsigned char) inverse_char_assignment[i]] = i + 1;
+    }
+    
+    vector<int64_t> order;
+    order.reserve(path_id.size());
+    for (int64_t i = 0; i < paths.size(); ++i) {
+        if (!path_is_deleted_iv.get(i)) {
+            order.push_back(i);
+        }
+    }
+    // compare the encoded names directly, which keeps names that share a
+    // prefix together just as well as comparing the characters would
+    std::sort(order.begin(), order.end(), [&](const int64_t& a, const int64_t& b) {
+        size_t a_start = path_name_start_iv.get(a);
+        size_t b_start = path_name_start_iv.get(b);
+        size_t a_length = path_name_length_iv.get(a);
+        size_t b_length = path_name_length_iv.get(b);
+        for (size_t i = 0; i < a_length && i < b_length; ++i) {
+            uint64_t a_char = path_names_iv.get(a_start + i);
+            uint64_t b_char = path_names_iv.get(b_start + i);
+            if (a_char != b_char) {
+                return a_char < b_char;
+            }
+        }
+        return a_length < b_length;
+    });
+    
+    path_name_order_iv.clear();
+    path_name_order_iv.reserve(order.size());
+    for (const int64_t& path_idx : order) {
+        path_name_order_iv.append(path_idx);
+    }
+    path_names_indexed = true;
+}
+
+template<typename Backend>
+int BasePackedGraph<Backend>::compare_path_name(const int64_t& path_idx, const string& name, bool prefix_only) const {
+    size_t name_start = path_name_start_iv.get(path_idx);
+    size_t name_length = path_name_length_iv.get(path_idx);
+    for (size_t i = 0; i < name_length && i < name.size(); ++i) {
+        uint64_t here = path_names_iv.get(name_start + i) + 1;
+        uint64_t there = path_name_char_codes[(unsigned char) name[i]];
+        if (there == 0) {
+            // no path has this character, so sort it after all of them
+            there = numeric_limits<uint64_t>::max();
+        }
+        if (here != there) {
+            return here < there ? -1 : 1;
+        }
+    }
+    if (name_length == name.size() || (prefix_only && name_length > name.size())) {
+        return 0;
+    }
+    return name_length < name.size() ? -1 : 1;
+}
+
+template<typename Backend>
+pair<size_t, size_t> BasePackedGraph<Backend>::find_indexed_path_names(const string& name, bool prefix_only) const {
+    // find the first path not before the name
+    size_t low = 0;
+    size_t high = path_name_order_iv.size();
+    while (low < high) {
+        size_t middle = (low + high) / 2;
+        if (compare_path_name(path_name_order_iv.get(middle), name, prefix_only) < 0) {
+            low = middle + 1;
+        }
+        else {
+            high = middle;
+        }
+    }
+    size_t begin = low;
+    // and then the first path after it
+    high = path_name_order_iv.size();
+    while (low < high) {
+        size_t middle = (low + high) / 2;
+        if (compare_path_name(path_name_order_iv.get(middle), name, prefix_only) <= 0) {
+            low = middle + 1;
+        }
+        else {
+            high = middle;
+        }
+    }
+    return make_pair(begin, low);
+}
+
+template<typename Backend>
+bool BasePackedGraph<Backend>::for_each_path_with_prefix(const std::string& prefix,
+                                                         const std::function<bool(const path_handle_t&)>& iteratee) const {
+    if (path_names_indexed) {
+        auto range = find_indexed_path_names(prefix, true);
+        for (size_t i = range.first; i < range.second; ++i) {
+            if (!iteratee(as_path_handle(path_name_order_iv.get(i)))) {
+                return false;
+            }
+        }
+        return true;
+    }
+    return for_each_path_handle([&](const path_handle_t& path_handle) {
+        int64_t path_idx = as_integer(path_handle);
+        size_t name_start = path_name_start_iv.get(path_idx);
+        if (path_name_length_iv.get(path_idx) < prefix.size()) {
+            return true;
+        }
+        for (size_t i = 0; i < prefix.size(); ++i) {
+            if (get_char(path_names_iv.get(name_start + i)) != prefix[i]) {
+                return true;
+            }
+        }
+        return iteratee(path_handle);
+    });
+}
+
 template<typename Backend>
 string BasePackedGraph<Backend>::get_path_name(const path_handle_t& path_handle) const {
     return decode_path_name(as_integer(path_handle));
@@ -2393,6 +5688,9 @@ bool BasePackedGraph<Backend>::get_is_circular(const path_handle_t& path_handle)
 template<typename Backend>
 size_t BasePackedGraph<Backend>::get_step_count(const path_handle_t& path_handle) const {
     const PackedPath& path = paths.at(as_integer(path_handle));
+    if (path.compressed_steps) {
+        return path.compressed_steps;
+    }
     return path.steps_iv.size() / STEP_RECORD_SIZE - path_deleted_steps_iv.get(as_integer(path_handle));
 }
 
@@ -2422,6 +5720,21 @@ bool BasePackedGraph<Backend>::for_each_path_handle(const std::function<bool(con
     return true;
 }
 
+template<typename Backend>
+bool BasePackedGraph<Backend>::for_each_path_handle(const std::function<bool(const path_handle_t&)>& iteratee,
+                                                    bool parallel) const {
+    if (!parallel) {
+        return for_each_path_handle(iteratee);
+    }
+    std::vector<std::pair<size_t, path_handle_t>> weighted_paths;
+    weighted_paths.reserve(path_id.size());
+    for (const auto& path_id_record : path_id) {
+        path_handle_t path_handle = as_path_handle(path_id_record.second);
+        weighted_paths.emplace_back(get_step_count(path_handle), path_handle);
+    }
+    return parallel_for_each_weighted(weighted_paths, PARALLEL_ITERATION_CHUNK_SIZE, iteratee);
+}
+
 template<typename Backend>
 handle_t BasePackedGraph<Backend>::get_handle_of_step(const step_handle_t& step_handle) const {
     const PackedPath& path = paths.at(as_integers(step_handle)[0]);
@@ -2497,6 +5810,13 @@ path_handle_t BasePackedGraph<Backend>::get_path_handle_of_step(const step_handl
 template<typename Backend>
 bool BasePackedGraph<Backend>::for_each_step_on_handle(const handle_t& handle,
                                                const function<bool(const step_handle_t&)>& iteratee) const {
+    return for_each_step_on_handle_fast(handle, iteratee);
+}
+
+template<typename Backend>
+template<typename Iteratee>
+bool BasePackedGraph<Backend>::for_each_step_on_handle_fast(const handle_t& handle,
+                                                            const Iteratee& iteratee) const {
     
     size_t path_membership = path_membership_node_iv.get(graph_index_to_node_member_index(graph_iv_index(handle)));
     while (path_membership) {
@@ -2513,15 +5833,97 @@ bool BasePackedGraph<Backend>::for_each_step_on_handle(const handle_t& handle,
         step_handle_t step_handle;
         as_integers(step_handle)[0] = path_id;
         as_integers(step_handle)[1] = occ_idx;
-        if (!iteratee(step_handle)) {
+        if (!call_iteratee(iteratee, step_handle)) {
             return false;
         }
         
         // move to the next membership record
         path_membership = get_next_membership(path_membership);
     }
-    
-    return true;
+    
+    return true;
+}
+
+template<typename Backend>
+template<typename Iteratee>
+bool BasePackedGraph<Backend>::for_each_step_in_path_fast(const path_handle_t& path_handle,
+                                                          const Iteratee& iteratee) const {
+    return for_each_step_index(as_integer(path_handle), [&](const size_t& here) {
+        step_handle_t step_handle;
+        as_integers(step_handle)[0] = as_integer(path_handle);
+        as_integers(step_handle)[1] = here;
+        return call_iteratee(iteratee, step_handle);
+    });
+}
+
+template<typename Backend>
+bool BasePackedGraph<Backend>::for_each_step_in_path(const path_handle_t& path_handle,
+                                                     const std::function<bool(const step_handle_t&)>& iteratee,
+                                                     bool parallel) const {
+    if (!parallel) {
+        return for_each_step_in_path_fast(path_handle, iteratee);
+    }
+    
+    int64_t path_idx = as_integer(path_handle);
+    const PackedPath& packed_path = paths.at(path_idx);
+    atomic<bool> keep_going(true);
+    auto visit = [&](size_t here) {
+        step_handle_t step_handle;
+        as_integers(step_handle)[0] = path_idx;
+        as_integers(step_handle)[1] = here;
+        if (!iteratee(step_handle)) {
+            keep_going = false;
+        }
+    };
+    
+    if (path_head_iv.get(path_idx) == 0) {
+        // the path is empty
+        return true;
+    }
+    else if (packed_path.compressed_steps || path_deleted_steps_iv.get(path_idx) == 0) {
+        // every record is a live step
+        size_t num_steps = packed_path.compressed_steps ? packed_path.compressed_steps
+                                                        : packed_path.steps_iv.size() / STEP_RECORD_SIZE;
+        size_t num_chunks = (num_steps + PARALLEL_ITERATION_CHUNK_SIZE - 1) / PARALLEL_ITERATION_CHUNK_SIZE;
+#pragma omp parallel for schedule(dynamic, 1)
+        for (size_t chunk = 0; chunk < num_chunks; ++chunk) {
+            size_t end = min(num_steps, (chunk + 1) * PARALLEL_ITERATION_CHUNK_SIZE);
+            for (size_t i = chunk * PARALLEL_ITERATION_CHUNK_SIZE; i < end && keep_going; ++i) {
+                visit(i + 1);
+            }
+        }
+    }
+    else {
+        // deleted records are still in the vectors, so only the links can
+        // tell us which steps are live
+#pragma omp parallel
+        {
+#pragma omp single
+            {
+                size_t head = path_head_iv.get(path_idx);
+                size_t here = head;
+                while (here != 0 && keep_going) {
+                    std::vector<size_t> chunk;
+                    chunk.reserve(PARALLEL_ITERATION_CHUNK_SIZE);
+                    do {
+                        chunk.push_back(here);
+                        here = get_step_next(packed_path, here);
+                    } while (here != 0 && here != head && chunk.size() < PARALLEL_ITERATION_CHUNK_SIZE);
+                    if (here == head) {
+                        // we came back around a circular path
+                        here = 0;
+                    }
+#pragma omp task firstprivate(chunk)
+                    {
+                        for (size_t i = 0; i < chunk.size() && keep_going; ++i) {
+                            visit(chunk[i]);
+                        }
+                    }
+                }
+            }
+        }
+    }
+    return keep_going;
 }
 
 template<typename Backend>
@@ -2641,10 +6043,11 @@ void BasePackedGraph<Backend>::destroy_path(const path_handle_t& path) {
     }
     
     path_id.erase(extract_encoded_path_name(as_integer(path)));
+    path_names_indexed = false;
+    deleted_path_name_length += path_name_length_iv.get(as_integer(path));
     
     path_is_deleted_iv.set(as_integer(path), true);
-    packed_path.steps_iv.clear();
-    packed_path.links_iv.clear();
+    packed_path = PackedPath();
     path_head_iv.set(as_integer(path), 0);
     path_tail_iv.set(as_integer(path), 0);
     path_deleted_steps_iv.set(as_integer(path), 0);
@@ -2652,6 +6055,99 @@ void BasePackedGraph<Backend>::destroy_path(const path_handle_t& path) {
     defragment();
 }
 
+template<typename Backend>
+void BasePackedGraph<Backend>::destroy_paths(const vector<path_handle_t>& to_destroy) {
+    
+    // mark the paths, skipping repeats
+    vector<bool> destroying(paths.size(), false);
+    vector<int64_t> path_idxs;
+    for (const path_handle_t& path : to_destroy) {
+        if (!destroying.at(as_integer(path))) {
+            destroying[as_integer(path)] = true;
+            path_idxs.push_back(as_integer(path));
+        }
+    }
+    if (path_idxs.empty()) {
+        return;
+    }
+    
+    // find the nodes that the paths visit
+    vector<vector<uint64_t>> visited(path_idxs.size());
+#pragma omp parallel for schedule(dynamic, 1)
+    for (size_t i = 0; i < path_idxs.size(); ++i) {
+        const PackedPath& packed_path = paths[path_idxs[i]];
+        for_each_step_index(path_idxs[i], [&](const uint64_t& step_index) {
+            handle_t trav = decode_traversal(get_step_trav(packed_path, step_index));
+            visited[i].push_back(graph_index_to_node_member_index(graph_iv_index(trav)));
+            return true;
+        });
+        std::sort(visited[i].begin(), visited[i].end());
+        visited[i].erase(std::unique(visited[i].begin(), visited[i].end()), visited[i].end());
+    }
+    vector<uint64_t> node_member_idxs;
+    for (vector<uint64_t>& node_visits : visited) {
+        node_member_idxs.insert(node_member_idxs.end(), node_visits.begin(), node_visits.end());
+        vector<uint64_t>().swap(node_visits);
+    }
+    std::sort(node_member_idxs.begin(), node_member_idxs.end());
+    node_member_idxs.erase(std::unique(node_member_idxs.begin(), node_member_idxs.end()), node_member_idxs.end());
+    
+    // filter the membership lists of a batch of nodes in parallel, and then
+    // make the links that skip over the removed records
+    vector<uint64_t> new_heads;
+    vector<vector<pair<uint64_t, uint64_t>>> new_links;
+    for (size_t batch_begin = 0; batch_begin < node_member_idxs.size(); batch_begin += CONVERSION_BATCH_NODES) {
+        size_t batch_end = std::min(node_member_idxs.size(), batch_begin + CONVERSION_BATCH_NODES);
+        new_heads.assign(batch_end - batch_begin, 0);
+        new_links.clear();
+        new_links.resize(batch_end - batch_begin);
+        uint64_t num_removed = 0;
+#pragma omp parallel for schedule(dynamic, PARALLEL_ITERATION_CHUNK_SIZE) reduction(+:num_removed)
+        for (size_t i = batch_begin; i < batch_end; ++i) {
+            uint64_t prev = 0;
+            for (uint64_t here = path_membership_node_iv.get(node_member_idxs[i]); here != 0;
+                 here = get_next_membership(here)) {
+                if (destroying[get_membership_path(here)]) {
+                    ++num_removed;
+                    continue;
+                }
+                if (prev == 0) {
+                    new_heads[i - batch_begin] = here;
+                }
+                else if (get_next_membership(prev) != here) {
+                    new_links[i - batch_begin].emplace_back(prev, here);
+                }
+                prev = here;
+            }
+            if (prev != 0 && get_next_membership(prev) != 0) {
+                new_links[i - batch_begin].emplace_back(prev, 0);
+            }
+        }
+        for (size_t i = batch_begin; i < batch_end; ++i) {
+            if (path_membership_node_iv.get(node_member_idxs[i]) != new_heads[i - batch_begin]) {
+                path_membership_node_iv.set(node_member_idxs[i], new_heads[i - batch_begin]);
+            }
+            for (const pair<uint64_t, uint64_t>& link : new_links[i - batch_begin]) {
+                set_next_membership(link.first, link.second);
+            }
+        }
+        deleted_membership_records += num_removed;
+    }
+    
+    for (int64_t path_idx : path_idxs) {
+        path_id.erase(extract_encoded_path_name(path_idx));
+        deleted_path_name_length += path_name_length_iv.get(path_idx);
+        path_is_deleted_iv.set(path_idx, true);
+        paths[path_idx] = PackedPath();
+        path_head_iv.set(path_idx, 0);
+        path_tail_iv.set(path_idx, 0);
+        path_deleted_steps_iv.set(path_idx, 0);
+    }
+    path_names_indexed = false;
+    
+    defragment();
+}
+
 template<typename Backend>
 path_handle_t BasePackedGraph<Backend>::create_path_handle(const string& name, bool is_circular) {
     if (name.empty()) {
@@ -2664,6 +6160,7 @@ path_handle_t BasePackedGraph<Backend>::create_path_handle(const string& name, b
     }
     
     path_id[encoded] = paths.size();
+    path_names_indexed = false;
     path_handle_t path_handle = as_path_handle(paths.size());
     
     // we manually handle the geometric expansion of the array so we can give it a smaller
@@ -2688,6 +6185,9 @@ path_handle_t BasePackedGraph<Backend>::create_path_handle(const string& name, b
     
     append_path_name(name);
     
+    // catch the metadata index up if it has fallen too far behind
+    update_path_metadata_index();
+    
     return path_handle;
 }
 
@@ -2695,6 +6195,7 @@ template<typename Backend>
 step_handle_t BasePackedGraph<Backend>::append_step(const path_handle_t& path, const handle_t& to_append) {
     
     PackedPath& packed_path = paths.at(as_integer(path));
+    decompress_path(packed_path);
     
     // create a new path record
     packed_path.steps_iv.append(as_integer(to_append));
@@ -2741,6 +6242,7 @@ template<typename Backend>
 step_handle_t BasePackedGraph<Backend>::prepend_step(const path_handle_t& path, const handle_t& to_prepend) {
     
     PackedPath& packed_path = paths.at(as_integer(path));
+    decompress_path(packed_path);
     
     // create a new path record
     packed_path.steps_iv.append(as_integer(to_prepend));
@@ -2783,6 +6285,137 @@ step_handle_t BasePackedGraph<Backend>::prepend_step(const path_handle_t& path,
     return step;
 }
 
+template<typename Backend>
+step_handle_t BasePackedGraph<Backend>::append_steps(const path_handle_t& path, const vector<handle_t>& to_append) {
+    
+    if (to_append.empty()) {
+        return path_end(path);
+    }
+    
+    uint64_t head, tail;
+    vector<uint64_t> node_member_indexes;
+    append_step_records(path, to_append, head, tail, node_member_indexes);
+    path_head_iv.set(as_integer(path), head);
+    path_tail_iv.set(as_integer(path), tail);
+    
+    append_membership_records(path, tail - to_append.size() + 1, node_member_indexes);
+    
+    // make and return an step handle
+    step_handle_t step;
+    as_integers(step)[0] = as_integer(path);
+    as_integers(step)[1] = tail;
+    return step;
+}
+
+template<typename Backend>
+void BasePackedGraph<Backend>::append_steps(const vector<path_handle_t>& path_handles,
+                                            const vector<vector<handle_t>>& to_append) {
+    
+    if (path_handles.size() != to_append.size()) {
+        throw std::runtime_error("error:[BasePackedGraph] must provide one run of steps to append for each path");
+    }
+    unordered_set<int64_t> distinct_paths;
+    for (const path_handle_t& path : path_handles) {
+        if (!distinct_paths.insert(as_integer(path)).second) {
+            throw std::runtime_error("error:[BasePackedGraph] cannot append steps to the same path from two threads");
+        }
+    }
+    
+    // each thread builds the records of its own paths and buffers up the
+    // node memberships that need to go into the shared lists
+    vector<uint64_t> heads(path_handles.size()), tails(path_handles.size());
+    vector<vector<uint64_t>> node_member_indexes(path_handles.size());
+#pragma omp parallel for schedule(dynamic, 1)
+    for (size_t i = 0; i < path_handles.size(); ++i) {
+        if (!to_append[i].empty()) {
+            append_step_records(path_handles[i], to_append[i], heads[i], tails[i], node_member_indexes[i]);
+        }
+    }
+    
+    // merge the buffers into the shared structures
+    for (size_t i = 0; i < path_handles.size(); ++i) {
+        if (!to_append[i].empty()) {
+            path_head_iv.set(as_integer(path_handles[i]), heads[i]);
+            path_tail_iv.set(as_integer(path_handles[i]), tails[i]);
+            append_membership_records(path_handles[i], tails[i] - to_append[i].size() + 1, node_member_indexes[i]);
+        }
+    }
+}
+
+template<typename Backend>
+void BasePackedGraph<Backend>::append_step_records(const path_handle_t& path, const vector<handle_t>& to_append,
+                                                   uint64_t& head, uint64_t& tail, vector<uint64_t>& node_member_indexes) {
+    
+    PackedPath& packed_path = paths.at(as_integer(path));
+    decompress_path(packed_path);
+    
+    head = path_head_iv.get(as_integer(path));
+    uint64_t prev_tail = path_tail_iv.get(as_integer(path));
+    
+    // the offset associated with the first new record
+    uint64_t first_step_offset = packed_path.steps_iv.size() / STEP_RECORD_SIZE + 1;
+    
+    // lay out all of the new records, linked to each other
+    vector<uint64_t> steps(to_append.size() * STEP_RECORD_SIZE);
+    vector<uint64_t> links(to_append.size() * PATH_RECORD_SIZE);
+    node_member_indexes.resize(to_append.size());
+    for (size_t i = 0; i < to_append.size(); ++i) {
+        steps[i * STEP_RECORD_SIZE] = as_integer(to_append[i]);
+        links[i * PATH_RECORD_SIZE + PATH_PREV_OFFSET] = i == 0 ? prev_tail : first_step_offset + i - 1;
+        links[i * PATH_RECORD_SIZE + PATH_NEXT_OFFSET] = i + 1 == to_append.size() ? 0 : first_step_offset + i + 1;
+        node_member_indexes[i] = graph_index_to_node_member_index(graph_iv_index(to_append[i]));
+    }
+    
+    size_t steps_start = packed_path.steps_iv.size();
+    packed_path.steps_iv.resize(steps_start + steps.size());
+    packed_path.steps_iv.set_range(steps_start, steps.size(), steps.data());
+    size_t links_start = packed_path.links_iv.size();
+    packed_path.links_iv.resize(links_start + links.size());
+    packed_path.links_iv.set_range(links_start, links.size(), links.data());
+    
+    // update the pointer from the current tail
+    if (prev_tail != 0) {
+        set_step_next(packed_path, prev_tail, first_step_offset);
+    }
+    
+    // update the head and tail of the list
+    tail = first_step_offset + to_append.size() - 1;
+    if (head == 0) {
+        head = first_step_offset;
+    }
+    
+    // update the looping connection if this is a circular path
+    if (path_is_circular_iv.get(as_integer(path))) {
+        set_step_prev(packed_path, head, tail);
+        set_step_next(packed_path, tail, head);
+    }
+}
+
+template<typename Backend>
+void BasePackedGraph<Backend>::append_membership_records(const path_handle_t& path, const uint64_t& first_step_offset,
+                                                         const vector<uint64_t>& node_member_indexes) {
+    
+    size_t num_records = node_member_indexes.size();
+    size_t records_start = path_membership_next_iv.size();
+    
+    // make each new membership record the head of its node's linked list, in order
+    vector<uint64_t> ids(num_records, as_integer(path));
+    vector<uint64_t> offsets(num_records);
+    vector<uint64_t> nexts(num_records);
+    for (size_t i = 0; i < num_records; ++i) {
+        offsets[i] = first_step_offset + i;
+        nexts[i] = path_membership_node_iv.get(node_member_indexes[i]);
+        path_membership_node_iv.set(node_member_indexes[i], records_start / MEMBERSHIP_NEXT_RECORD_SIZE + i + 1);
+    }
+    
+    path_membership_id_iv.resize(records_start + num_records);
+    path_membership_id_iv.set_range(records_start, num_records, ids.data());
+    path_membership_offset_iv.resize(records_start + num_records);
+    path_membership_offset_iv.set_range(records_start, num_records, offsets.data());
+    path_membership_next_iv.resize(records_start + num_records);
+    path_membership_next_iv.set_range(records_start, num_records, nexts.data());
+}
+
 template<typename Backend>
 pair<step_handle_t, step_handle_t> BasePackedGraph<Backend>::rewrite_segment(const step_handle_t& segment_begin,
                                                                 const step_handle_t& segment_end,
@@ -2794,6 +6427,7 @@ pair<step_handle_t, step_handle_t> BasePackedGraph<Backend>::rewrite_segment(con
     
     size_t path_idx = as_integers(segment_begin)[0];
     PackedPath& packed_path =  paths[path_idx];
+    decompress_path(packed_path);
     
     // TODO: somewhat repetitive with a routine in destroy_path
     
@@ -2930,6 +6564,7 @@ pair<step_handle_t, step_handle_t> BasePackedGraph<Backend>::rewrite_segment(con
 template<typename Backend>
 void BasePackedGraph<Backend>::set_circularity(const path_handle_t& path, bool circular) {
     PackedPath& packed_path = paths[as_integer(path)];
+    decompress_path(packed_path);
     // set the looping connection as appropriate
     if (circular && path_head_iv.get(as_integer(path)) != 0) {
         set_step_prev(packed_path, path_head_iv.get(as_integer(path)), path_tail_iv.get(as_integer(path)));
@@ -2957,24 +6592,56 @@ void BasePackedGraph<Backend>::increment_node_ids(nid_t increment) {
 
 template<typename Backend>
 void BasePackedGraph<Backend>::reassign_node_ids(const std::function<nid_t(const nid_t&)>& get_new_id) {
+    // we don't know whether the function is safe to call from multiple threads
+    translate_node_ids(get_new_id, false);
+}
+
+template<typename Backend>
+void BasePackedGraph<Backend>::translate_node_ids(const std::function<nid_t(const nid_t&)>& get_new_id, bool parallel) {
     
-    // update the node IDs of edges
-    for (size_t i = EDGE_TRAV_OFFSET; i < edge_lists_iv.size(); i += EDGE_RECORD_SIZE) {
-        handle_t trav = decode_traversal(edge_lists_iv.get(i));
-        // only translate edges to nodes that have not been deleted
+    // translate a traversal if it is to a node that has not been deleted
+    auto translate = [&](uint64_t& encoded) {
+        handle_t trav = decode_traversal(encoded);
         auto trav_id = get_id(trav);
         if (trav_id >= min_id) {
             auto idx = trav_id - min_id;
             if (idx < nid_to_graph_iv.size()) {
                 if (nid_to_graph_iv.get(idx)) {
-                    trav = get_handle(get_new_id(trav_id), get_is_reverse(trav));
-                    edge_lists_iv.set(i, encode_traversal(trav));
+                    encoded = encode_traversal(get_handle(get_new_id(trav_id), get_is_reverse(trav)));
                 }
             }
         }
+    };
+    
+    // update the node IDs of edges
+    if (parallel) {
+        // translate whole pages at a time
+        size_t num_chunks = (edge_lists_iv.size() + WIDE_PAGE_WIDTH - 1) / WIDE_PAGE_WIDTH;
+        parallel_fill(edge_lists_iv, num_chunks,
+                      [&](size_t i) { return std::min(i * WIDE_PAGE_WIDTH, edge_lists_iv.size()); },
+                      [&](size_t i, uint64_t* out) {
+            size_t begin = i * WIDE_PAGE_WIDTH;
+            size_t end = std::min(begin + WIDE_PAGE_WIDTH, edge_lists_iv.size());
+            edge_lists_iv.get_range(begin, end - begin, out);
+            static_assert(WIDE_PAGE_WIDTH % 2 == 0, "Chunks must consist of whole edge records");
+            for (size_t j = EDGE_TRAV_OFFSET; j < end - begin; j += EDGE_RECORD_SIZE) {
+                translate(out[j]);
+            }
+        });
+    }
+    else {
+        for (size_t i = EDGE_TRAV_OFFSET; i < edge_lists_iv.size(); i += EDGE_RECORD_SIZE) {
+            uint64_t encoded = edge_lists_iv.get(i);
+            uint64_t translated = encoded;
+            translate(translated);
+            if (translated != encoded) {
+                edge_lists_iv.set(i, translated);
+            }
+        }
     }
     
-    // update the node IDs of steps on paths
+    // update the node IDs of steps on paths, which each have their own vectors
+#pragma omp parallel for schedule(dynamic, 1) if (parallel)
     for (size_t i = 0; i < paths.size(); ++i){
         
         if (path_is_deleted_iv.get(i)) {
@@ -2982,20 +6649,14 @@ void BasePackedGraph<Backend>::reassign_node_ids(const std::function<nid_t(const
         }
         
         PackedPath& packed_path = paths[i];
+        decompress_path(packed_path);
         
         for (size_t j = 0; j < packed_path.steps_iv.size(); j += STEP_RECORD_SIZE) {
-            handle_t trav = decode_traversal(packed_path.steps_iv.get(j));
-            
-            // only translate step records of nodes that have not been deleted
-            auto trav_id = get_id(trav);
-            if (trav_id >= min_id) {
-                auto idx = trav_id - min_id;
-                if (idx < nid_to_graph_iv.size()) {
-                    if (nid_to_graph_iv.get(idx)) {
-                        trav = get_handle(get_new_id(get_id(trav)), get_is_reverse(trav));
-                        packed_path.steps_iv.set(j, encode_traversal(trav));
-                    }
-                }
+            uint64_t encoded = packed_path.steps_iv.get(j);
+            uint64_t translated = encoded;
+            translate(translated);
+            if (translated != encoded) {
+                packed_path.steps_iv.set(j, translated);
             }
         }
     }
@@ -3006,32 +6667,28 @@ void BasePackedGraph<Backend>::reassign_node_ids(const std::function<nid_t(const
     decltype(nid_to_graph_iv) new_nid_to_graph_iv;
     new_nid_to_graph_iv.reserve(get_node_count());
 
-    for (size_t i = 0; i < nid_to_graph_iv.size(); ++i) {
-        if (nid_to_graph_iv.get(i) != 0) {
-            // there is a node with this ID
-
-            nid_t new_id = get_new_id(min_id + i);
+    for (size_t i = nid_to_graph_iv.next_nonzero(0); i < nid_to_graph_iv.size(); i = nid_to_graph_iv.next_nonzero(i + 1)) {
+        // there is a node with this ID
 
-            // expand the new ID vector as necessary
-            if (new_nid_to_graph_iv.empty()) {
-                new_nid_to_graph_iv.append_back(0);
-            }
-            else {
-                for (int64_t j = new_id; j < new_min_id; ++j) {
-                    new_nid_to_graph_iv.append_front(0);
-                }
-                for (int64_t j = new_nid_to_graph_iv.size(); j <= new_id - new_min_id; ++j) {
-                    new_nid_to_graph_iv.append_back(0);
-                }
-            }
-            
-            // update the min and max ID
-            new_max_id = std::max(new_id, new_max_id);
-            new_min_id = std::min(new_id, new_min_id);
+        nid_t new_id = get_new_id(min_id + i);
 
-            // copy the value of the old ID vector over
-            new_nid_to_graph_iv.set(new_id - new_min_id, nid_to_graph_iv.get(i));
+        // expand the new ID vector as necessary
+        if (new_nid_to_graph_iv.empty()) {
+            new_nid_to_graph_iv.append_back(0);
+        }
+        else if (new_id < new_min_id) {
+            new_nid_to_graph_iv.extend_front(new_min_id - new_id);
+        }
+        else if (new_id - new_min_id >= new_nid_to_graph_iv.size()) {
+            new_nid_to_graph_iv.extend_back(new_id - new_min_id + 1 - new_nid_to_graph_iv.size());
         }
+        
+        // update the min and max ID
+        new_max_id = std::max(new_id, new_max_id);
+        new_min_id = std::min(new_id, new_min_id);
+
+        // copy the value of the old ID vector over
+        new_nid_to_graph_iv.set(new_id - new_min_id, nid_to_graph_iv.get(i));
     }
 
     // replace the old ID variables
@@ -3040,18 +6697,87 @@ void BasePackedGraph<Backend>::reassign_node_ids(const std::function<nid_t(const
     nid_to_graph_iv = move(new_nid_to_graph_iv);
 }
 
+template<typename Backend>
+vector<size_t> BasePackedGraph<Backend>::graph_indexes_in_id_order() const {
+    
+    // count up the nodes in each chunk of the ID space
+    size_t num_chunks = (nid_to_graph_iv.size() + PARALLEL_ITERATION_CHUNK_SIZE - 1) / PARALLEL_ITERATION_CHUNK_SIZE;
+    vector<size_t> chunk_starts(num_chunks + 1, 0);
+#pragma omp parallel for schedule(dynamic, 1)
+    for (size_t i = 0; i < num_chunks; ++i) {
+        size_t end = std::min((i + 1) * PARALLEL_ITERATION_CHUNK_SIZE, nid_to_graph_iv.size());
+        for (size_t j = nid_to_graph_iv.next_nonzero(i * PARALLEL_ITERATION_CHUNK_SIZE, end); j < end;
+             j = nid_to_graph_iv.next_nonzero(j + 1, end)) {
+            ++chunk_starts[i + 1];
+        }
+    }
+    for (size_t i = 0; i < num_chunks; ++i) {
+        chunk_starts[i + 1] += chunk_starts[i];
+    }
+    
+    // fill in each chunk's part of the order
+    vector<size_t> order(chunk_starts.back());
+#pragma omp parallel for schedule(dynamic, 1)
+    for (size_t i = 0; i < num_chunks; ++i) {
+        size_t end = std::min((i + 1) * PARALLEL_ITERATION_CHUNK_SIZE, nid_to_graph_iv.size());
+        size_t k = chunk_starts[i];
+        for (size_t j = nid_to_graph_iv.next_nonzero(i * PARALLEL_ITERATION_CHUNK_SIZE, end); j < end;
+             j = nid_to_graph_iv.next_nonzero(j + 1, end)) {
+            order[k++] = (nid_to_graph_iv.get(j) - 1) * GRAPH_RECORD_SIZE;
+        }
+    }
+    return order;
+}
+
+template<typename Backend>
+template<typename Vec, typename GetOffset, typename WriteItem>
+void BasePackedGraph<Backend>::parallel_fill(Vec& vec, size_t num_items, const GetOffset& get_offset,
+                                             const WriteItem& write_item) {
+    vector<uint64_t> buffer;
+    size_t batch_begin = 0;
+    while (batch_begin < num_items) {
+        // take items until the batch is full, but always at least one
+        size_t batch_offset = get_offset(batch_begin);
+        size_t batch_end = batch_begin + 1;
+        while (batch_end < num_items && get_offset(batch_end + 1) - batch_offset <= PARALLEL_FILL_BATCH_SIZE) {
+            ++batch_end;
+        }
+        size_t batch_size = get_offset(batch_end) - batch_offset;
+        
+        // compute the entries in parallel
+        buffer.resize(batch_size);
+#pragma omp parallel for schedule(dynamic, 256)
+        for (size_t i = batch_begin; i < batch_end; ++i) {
+            write_item(i, buffer.data() + (get_offset(i) - batch_offset));
+        }
+        
+        // and pack them in order
+        vec.set_range(batch_offset, batch_size, buffer.data());
+        batch_begin = batch_end;
+    }
+}
+
 template<typename Backend>
 PathSense BasePackedGraph<Backend>::get_sense(const path_handle_t& handle) const {
+    if (path_metadata_indexed && as_integer(handle) < path_metadata_indexed_count) {
+        return (PathSense) paths_by_sense.path_groups_iv.get(as_integer(handle));
+    }
     return PathMetadata::parse_sense(get_path_name(handle));
 }
 
 template<typename Backend>
 std::string BasePackedGraph<Backend>::get_sample_name(const path_handle_t& handle) const {
+    if (path_metadata_indexed && as_integer(handle) < path_metadata_indexed_count) {
+        return paths_by_sample.get_name(paths_by_sample.path_groups_iv.get(as_integer(handle)));
+    }
     return PathMetadata::parse_sample_name(get_path_name(handle));
 }
 
 template<typename Backend>
 std::string BasePackedGraph<Backend>::get_locus_name(const path_handle_t& handle) const {
+    if (path_metadata_indexed && as_integer(handle) < path_metadata_indexed_count) {
+        return paths_by_locus.get_name(paths_by_locus.path_groups_iv.get(as_integer(handle)));
+    }
     return PathMetadata::parse_locus_name(get_path_name(handle));
 }
 
@@ -3075,28 +6801,123 @@ bool BasePackedGraph<Backend>::for_each_path_matching(const std::unordered_set<P
                                                       const std::unordered_set<std::string>* samples,
                                                       const std::unordered_set<std::string>* loci,
                                                       const std::function<bool(const path_handle_t&)>& iteratee) const {
-    return for_each_path_handle([&](const path_handle_t& handle) {
+    
+    auto matches = [&](const path_handle_t& handle) {
         if (senses && !senses->count(get_sense(handle))) {
             // Sense doesn't match
-            return true;
+            return false;
         }
         if (samples && !samples->count(get_sample_name(handle))) {
             // Sample name doesn't match
-            return true;
+            return false;
         }
         if (loci && !loci->count(get_locus_name(handle))) {
             // Locus name doesn't match
-            return true;
+            return false;
         }
-        // Emit any matching handles
-        return iteratee(handle);
-    });
+        return true;
+    };
+    
+    if (!senses && !samples && !loci) {
+        // everything matches, so there's no need for the index
+        return for_each_path_handle(iteratee);
+    }
+    
+    // the paths outside the index are checked by name
+    size_t indexed_count = path_metadata_indexed ? path_metadata_indexed_count : 0;
+    if (indexed_count == 0) {
+        return for_each_path_handle([&](const path_handle_t& handle) {
+            return !matches(handle) || iteratee(handle);
+        });
+    }
+    
+    // find the groups that each part of the query selects
+    std::vector<size_t> sense_groups, sample_groups, locus_groups;
+    if (senses) {
+        for (const PathSense& sense : *senses) {
+            if ((size_t) sense + 1 < paths_by_sense.path_starts_iv.size()) {
+                sense_groups.push_back((size_t) sense);
+            }
+        }
+    }
+    auto find_groups = [](const PathMetadataGroups& groups, const std::unordered_set<std::string>& names,
+                          std::vector<size_t>& found) {
+        for (const std::string& name : names) {
+            size_t group = groups.find(name);
+            if (group + 1 < groups.path_starts_iv.size()) {
+                found.push_back(group);
+            }
+        }
+    };
+    if (samples) {
+        find_groups(paths_by_sample, *samples, sample_groups);
+    }
+    if (loci) {
+        find_groups(paths_by_locus, *loci, locus_groups);
+    }
+    std::sort(sense_groups.begin(), sense_groups.end());
+    std::sort(sample_groups.begin(), sample_groups.end());
+    std::sort(locus_groups.begin(), locus_groups.end());
+    
+    // walk the paths of whichever part of the query selects the fewest, and
+    // check the rest of the query against the indexed groups of each path
+    auto count_paths = [](const PathMetadataGroups& groups, const std::vector<size_t>& selected) {
+        size_t count = 0;
+        for (const size_t& group : selected) {
+            count += groups.path_starts_iv.get(group + 1) - groups.path_starts_iv.get(group);
+        }
+        return count;
+    };
+    const PathMetadataGroups* walk_groups = nullptr;
+    const std::vector<size_t>* walk_selected = nullptr;
+    size_t walk_count = std::numeric_limits<size_t>::max();
+    for (auto query : {std::make_tuple(senses != nullptr, &paths_by_sense, &sense_groups),
+                       std::make_tuple(samples != nullptr, &paths_by_sample, &sample_groups),
+                       std::make_tuple(loci != nullptr, &paths_by_locus, &locus_groups)}) {
+        if (std::get<0>(query)) {
+            size_t count = count_paths(*std::get<1>(query), *std::get<2>(query));
+            if (count < walk_count) {
+                walk_groups = std::get<1>(query);
+                walk_selected = std::get<2>(query);
+                walk_count = count;
+            }
+        }
+    }
+    auto selects = [](bool queried, const PathMetadataGroups& groups, const std::vector<size_t>& selected, int64_t path_idx) {
+        return !queried || std::binary_search(selected.begin(), selected.end(), groups.path_groups_iv.get(path_idx));
+    };
+    for (const size_t& group : *walk_selected) {
+        for (size_t i = walk_groups->path_starts_iv.get(group), end = walk_groups->path_starts_iv.get(group + 1); i < end; ++i) {
+            int64_t path_idx = walk_groups->paths_iv.get(i);
+            if (path_is_deleted_iv.get(path_idx)) {
+                continue;
+            }
+            if (selects(senses, paths_by_sense, sense_groups, path_idx) &&
+                selects(samples, paths_by_sample, sample_groups, path_idx) &&
+                selects(loci, paths_by_locus, locus_groups, path_idx)) {
+                if (!iteratee(as_path_handle(path_idx))) {
+                    return false;
+                }
+            }
+        }
+    }
+    
+    // the paths created since the index was built have to be checked by name
+    for (int64_t path_idx = indexed_count; path_idx < paths.size(); ++path_idx) {
+        if (!path_is_deleted_iv.get(path_idx) && matches(as_path_handle(path_idx))) {
+            if (!iteratee(as_path_handle(path_idx))) {
+                return false;
+            }
+        }
+    }
+    return true;
 }
 
 template<typename Backend>
 bool BasePackedGraph<Backend>::for_each_step_of_sense(const handle_t& visited,
                                                       const PathSense& sense,
                                                       const std::function<bool(const step_handle_t&)>& iteratee) const {
+    // with the index, finding the sense of the indexed paths is just a lookup
     return for_each_step_on_handle(visited, [&](const step_handle_t& handle) {
         if (get_sense(get_path_handle_of_step(handle)) != sense) {
             // Skip this non-matching path's step
@@ -3107,6 +6928,191 @@ bool BasePackedGraph<Backend>::for_each_step_of_sense(const handle_t& visited,
     });
 }
 
+template<typename Backend>
+void BasePackedGraph<Backend>::index_path_metadata() {
+    build_path_metadata_index();
+}
+
+template<typename Backend>
+void BasePackedGraph<Backend>::update_path_metadata_index() {
+    size_t unindexed = paths.size() - (path_metadata_indexed ? path_metadata_indexed_count : 0);
+    if (unindexed > MAX_UNINDEXED_PATHS && unindexed > path_metadata_indexed_count / 4) {
+        build_path_metadata_index();
+    }
+}
+
+template<typename Backend>
+void BasePackedGraph<Backend>::build_path_metadata_index() {
+    
+    // parse each path's name just once
+    vector<size_t> path_senses(paths.size(), 0);
+    vector<string> path_samples(paths.size()), path_loci(paths.size());
+    size_t num_senses = 0;
+#pragma omp parallel for schedule(dynamic, 1024) reduction(max:num_senses)
+    for (size_t i = 0; i < paths.size(); ++i) {
+        if (!path_is_deleted_iv.get(i)) {
+            string name = get_path_name(as_path_handle(i));
+            path_senses[i] = (size_t) PathMetadata::parse_sense(name);
+            path_samples[i] = PathMetadata::parse_sample_name(name);
+            path_loci[i] = PathMetadata::parse_locus_name(name);
+            num_senses = std::max(num_senses, path_senses[i] + 1);
+        }
+    }
+    
+    paths_by_sense.assign(path_senses, num_senses, path_is_deleted_iv);
+    paths_by_sample.assign(path_samples, path_is_deleted_iv);
+    paths_by_locus.assign(path_loci, path_is_deleted_iv);
+    
+    path_metadata_indexed_count = paths.size();
+    path_metadata_indexed = true;
+}
+
+template<typename Backend>
+void BasePackedGraph<Backend>::PathMetadataGroups::assign(const vector<size_t>& path_groups, size_t num_groups,
+                                                          const PackedVector<Backend>& path_is_deleted_iv) {
+    
+    // count up the paths in each group
+    vector<size_t> group_starts(num_groups + 1, 0);
+    for (size_t i = 0; i < path_groups.size(); ++i) {
+        if (!path_is_deleted_iv.get(i)) {
+            ++group_starts[path_groups[i] + 1];
+        }
+    }
+    for (size_t i = 1; i < group_starts.size(); ++i) {
+        group_starts[i] += group_starts[i - 1];
+    }
+    
+    path_starts_iv.clear();
+    path_starts_iv.reserve(group_starts.size());
+    for (const size_t& group_start : group_starts) {
+        path_starts_iv.append(group_start);
+    }
+    
+    // place the paths, which come out in order within each group
+    paths_iv.clear();
+    paths_iv.resize(group_starts.back());
+    path_groups_iv.clear();
+    path_groups_iv.resize(path_groups.size());
+    for (size_t i = 0; i < path_groups.size(); ++i) {
+        if (!path_is_deleted_iv.get(i)) {
+            paths_iv.set(group_starts[path_groups[i]]++, i);
+            path_groups_iv.set(i, path_groups[i]);
+        }
+    }
+}
+
+template<typename Backend>
+void BasePackedGraph<Backend>::PathMetadataGroups::assign(const vector<string>& path_group_names,
+                                                          const PackedVector<Backend>& path_is_deleted_iv) {
+    
+    vector<string> names;
+    for (size_t i = 0; i < path_group_names.size(); ++i) {
+        if (!path_is_deleted_iv.get(i)) {
+            names.push_back(path_group_names[i]);
+        }
+    }
+    std::sort(names.begin(), names.end());
+    names.erase(std::unique(names.begin(), names.end()), names.end());
+    
+    names_iv.clear();
+    name_starts_iv.clear();
+    name_starts_iv.reserve(names.size() + 1);
+    for (const string& name : names) {
+        name_starts_iv.append(names_iv.size());
+        for (const char& c : name) {
+            names_iv.append((unsigned char) c);
+        }
+    }
+    name_starts_iv.append(names_iv.size());
+    
+    vector<size_t> path_groups(path_group_names.size(), 0);
+    for (size_t i = 0; i < path_group_names.size(); ++i) {
+        if (!path_is_deleted_iv.get(i)) {
+            path_groups[i] = std::lower_bound(names.begin(), names.end(), path_group_names[i]) - names.begin();
+        }
+    }
+    assign(path_groups, names.size(), path_is_deleted_iv);
+}
+
+template<typename Backend>
+size_t BasePackedGraph<Backend>::PathMetadataGroups::find(const string& name) const {
+    if (name_starts_iv.empty()) {
+        return 0;
+    }
+    size_t num_groups = name_starts_iv.size() - 1;
+    // compare the named group to the name, like std::string::compare
+    auto compare = [&](size_t group) {
+        size_t start = name_starts_iv.get(group);
+        size_t length = name_starts_iv.get(group + 1) - start;
+        for (size_t i = 0; i < length && i < name.size(); ++i) {
+            uint64_t here = names_iv.get(start + i);
+            uint64_t there = (unsigned char) name[i];
+            if (here != there) {
+                return here < there ? -1 : 1;
+            }
+        }
+        return length == name.size() ? 0 : (length < name.size() ? -1 : 1);
+    };
+    size_t low = 0;
+    size_t high = num_groups;
+    while (low < high) {
+        size_t middle = (low + high) / 2;
+        int comparison = compare(middle);
+        if (comparison == 0) {
+            return middle;
+        }
+        else if (comparison < 0) {
+            low = middle + 1;
+        }
+        else {
+            high = middle;
+        }
+    }
+    return num_groups;
+}
+
+template<typename Backend>
+string BasePackedGraph<Backend>::PathMetadataGroups::get_name(size_t group) const {
+    string name;
+    for (size_t i = name_starts_iv.get(group), end = name_starts_iv.get(group + 1); i < end; ++i) {
+        name.push_back((char) names_iv.get(i));
+    }
+    return name;
+}
+
+template<typename Backend>
+void BasePackedGraph<Backend>::PathMetadataGroups::clear() {
+    names_iv.clear();
+    name_starts_iv.clear();
+    path_starts_iv.clear();
+    paths_iv.clear();
+    path_groups_iv.clear();
+}
+
+template<typename Backend>
+void BasePackedGraph<Backend>::PathMetadataGroups::serialize(ostream& out) const {
+    names_iv.serialize(out);
+    name_starts_iv.serialize(out);
+    path_starts_iv.serialize(out);
+    paths_iv.serialize(out);
+    path_groups_iv.serialize(out);
+}
+
+template<typename Backend>
+void BasePackedGraph<Backend>::PathMetadataGroups::deserialize(istream& in) {
+    names_iv.deserialize(in);
+    name_starts_iv.deserialize(in);
+    path_starts_iv.deserialize(in);
+    paths_iv.deserialize(in);
+    path_groups_iv.deserialize(in);
+}
+
+template<typename Backend>
+size_t BasePackedGraph<Backend>::PathMetadataGroups::memory_usage() const {
+    return names_iv.memory_usage() + name_starts_iv.memory_usage() + path_starts_iv.memory_usage()
+        + paths_iv.memory_usage() + path_groups_iv.memory_usage();
+}
+
 template<typename Backend>
 path_handle_t BasePackedGraph<Backend>::create_path(const PathSense& sense,
                                                     const std::string& sample,
@@ -3163,6 +7169,11 @@ void BasePackedGraph<Backend>::print_graph(ostream& out) const {
         out << " " << seq_iv.get(i);
     }
     out << endl;
+    out << "seq_exception_*_iv" << endl;
+    for (size_t i = 0; i < seq_exception_start_iv.size(); ++i) {
+        out << " " << seq_exception_start_iv.get(i) << "+" << seq_exception_length_iv.get(i) << ":" << (char) seq_exception_char_iv.get(i);
+    }
+    out << endl;
     out << "path_membership_node_iv" << endl;
     for (size_t i = 0; i < path_membership_node_iv.size(); ++i) {
         if (i != 0 && i % NODE_MEMBER_RECORD_SIZE == 0) {
@@ -3297,6 +7308,10 @@ void BasePackedGraph<Backend>::report_memory(ostream& out, bool individual_paths
     out << "seq_iv: " << format_memory(item_mem) << endl;
     grand_total += item_mem;
     
+    item_mem = seq_exception_start_iv.memory_usage() + seq_exception_length_iv.memory_usage() + seq_exception_char_iv.memory_usage();
+    out << "seq_exception_*_iv: " << format_memory(item_mem) << endl;
+    grand_total += item_mem;
+    
     item_mem = path_membership_node_iv.memory_usage();
     out << "path_membership_node_iv: " << format_memory(item_mem) << endl;
     grand_total += item_mem;
@@ -3438,6 +7453,84 @@ void BasePackedGraph<Backend>::report_memory(ostream& out, bool individual_paths
     out << "GRAND TOTAL: " << format_memory(grand_total) << endl;
 }
 
+template<typename Backend>
+MemoryBreakdown BasePackedGraph<Backend>::memory_breakdown() const {
+    
+    MemoryBreakdown breakdown("BasePackedGraph");
+    breakdown.add("min/max_id", sizeof(max_id) + sizeof(min_id));
+    breakdown.add("graph_iv", graph_iv.memory_usage());
+    breakdown.add("seq_start_iv", seq_start_iv.memory_usage());
+    breakdown.add("seq_length_iv", seq_length_iv.memory_usage());
+    breakdown.add("edge_lists_iv", edge_lists_iv.memory_usage());
+    breakdown.add("nid_to_graph_iv", nid_to_graph_iv.memory_usage());
+    breakdown.add("seq_iv", seq_iv.memory_usage());
+    MemoryBreakdown exceptions("sequence exceptions");
+    exceptions.add("seq_exception_start_iv", seq_exception_start_iv.memory_usage());
+    exceptions.add("seq_exception_length_iv", seq_exception_length_iv.memory_usage());
+    exceptions.add("seq_exception_char_iv", seq_exception_char_iv.memory_usage());
+    breakdown.add(exceptions);
+    
+    MemoryBreakdown membership("path membership");
+    membership.add("path_membership_node_iv", path_membership_node_iv.memory_usage());
+    membership.add("path_membership_id_iv", path_membership_id_iv.memory_usage());
+    membership.add("path_membership_offset_iv", path_membership_offset_iv.memory_usage());
+    membership.add("path_membership_next_iv", path_membership_next_iv.memory_usage());
+    breakdown.add(membership);
+    
+    size_t char_assignment_mem = sizeof(inverse_char_assignment) + inverse_char_assignment.capacity() * sizeof(char);
+    char_assignment_mem += char_assignment.bucket_count() * (sizeof(typename decltype(char_assignment)::value_type)
+                                                             + sizeof(typename decltype(char_assignment)::key_type));
+    char_assignment_mem += sizeof(char_assignment);
+    breakdown.add("char assignment indexes", char_assignment_mem);
+    
+    MemoryBreakdown path_metadata("path metadata");
+    path_metadata.add("path_names_iv", path_names_iv.memory_usage());
+    path_metadata.add("path_name_start_iv", path_name_start_iv.memory_usage());
+    path_metadata.add("path_name_length_iv", path_name_length_iv.memory_usage());
+    path_metadata.add("path_is_deleted_iv", path_is_deleted_iv.memory_usage());
+    path_metadata.add("path_is_circular_iv", path_is_circular_iv.memory_usage());
+    path_metadata.add("path_head_iv", path_head_iv.memory_usage());
+    path_metadata.add("path_tail_iv", path_tail_iv.memory_usage());
+    path_metadata.add("path_deleted_steps_iv", path_deleted_steps_iv.memory_usage());
+    breakdown.add(path_metadata);
+    
+    // deleted paths stay in the paths vector until they are ejected, so this
+    // counts them too
+    size_t links_mem = 0, steps_mem = 0, compressed_mem = 0;
+    for (const auto& packed_path : paths) {
+        links_mem += packed_path.links_iv.memory_usage();
+        steps_mem += packed_path.steps_iv.memory_usage();
+        compressed_mem += packed_path.block_bases_iv.memory_usage() + packed_path.block_widths_iv.memory_usage()
+            + packed_path.block_starts_iv.memory_usage() + packed_path.packed_steps_iv.memory_usage();
+    }
+    MemoryBreakdown paths_breakdown("paths");
+    paths_breakdown.add("links", links_mem);
+    paths_breakdown.add("steps", steps_mem);
+    paths_breakdown.add("compressed steps", compressed_mem);
+    paths_breakdown.add("vector overhead", sizeof(paths) + (paths.capacity() - paths.size()) * sizeof(typename decltype(paths)::value_type));
+    breakdown.add(paths_breakdown);
+    
+    size_t path_name_mem = 0;
+    for (const auto& path_id_record : path_id) {
+        path_name_mem += path_id_record.first.memory_usage();
+    }
+    MemoryBreakdown path_id_breakdown("path_id");
+    path_id_breakdown.add("names", path_name_mem);
+    path_id_breakdown.add("ids", path_id.size() * sizeof(typename decltype(path_id)::mapped_type));
+    path_id_breakdown.add("hash table overhead", sizeof(path_id) + (path_id.bucket_count() - path_id.size())
+                          * (sizeof(typename decltype(path_id)::key_type) + sizeof(typename decltype(path_id)::value_type)));
+    breakdown.add(path_id_breakdown);
+    
+    MemoryBreakdown path_indexes("path indexes");
+    path_indexes.add("path_name_order_iv", path_name_order_iv.memory_usage());
+    path_indexes.add("paths_by_sense", paths_by_sense.memory_usage());
+    path_indexes.add("paths_by_sample", paths_by_sample.memory_usage());
+    path_indexes.add("paths_by_locus", paths_by_locus.memory_usage());
+    breakdown.add(path_indexes);
+    
+    return breakdown;
+}
+
 } // end dankness
 
 #endif
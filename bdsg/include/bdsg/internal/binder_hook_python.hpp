@@ -0,0 +1,250 @@
+#ifndef BSDG_BINDER_HOOK_PYTHON_HPP
+#define BSDG_BINDER_HOOK_PYTHON_HPP
+
+// Hand-written extra Python methods, attached to Binder's generated bindings
+// with +add_on_binder in config.cfg. Only the binding compilation units
+// include this, since it needs pybind11 and NumPy.
+//
+// The generated bindings hold the GIL for every call and build Python objects
+// one element at a time. The methods here instead fill whole NumPy arrays with
+// the GIL released. Our packed structures store bit-packed values, so there is
+// no native-width memory to expose directly; each array is allocated once by
+// NumPy and the values are decoded straight into it, without any intermediate
+// list or copy.
+
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <stdexcept>
+
+#include <pybind11/pybind11.h>
+#include <pybind11/numpy.h>
+#include <pybind11/functional.h>
+
+#include <handlegraph/handle_graph.hpp>
+#include <handlegraph/path_handle_graph.hpp>
+#include <handlegraph/path_position_handle_graph.hpp>
+
+#include "bdsg/snarl_distance_index.hpp"
+
+namespace bdsg {
+namespace python {
+
+using namespace handlegraph;
+
+/**
+ * NumPy array argument type that gets converted, if necessary, to a contiguous
+ * array of the given type.
+ */
+template<typename T>
+using input_array_t = pybind11::array_t<T, pybind11::array::c_style | pybind11::array::forcecast>;
+
+/**
+ * Make a NumPy array of the given length, and fill it in from C++ with the GIL
+ * released. The filler gets a pointer to the array's memory, and must return
+ * the number of items it wrote, which must be the full length.
+ */
+template<typename T>
+pybind11::array_t<T> fill_array(size_t length, const std::function<size_t(T*)>& filler) {
+    pybind11::array_t<T> result(length);
+    T* data = result.mutable_data();
+    size_t filled;
+    {
+        pybind11::gil_scoped_release release;
+        filled = filler(data);
+    }
+    if (filled != length) {
+        throw std::runtime_error("error:[bdsg::python] graph changed size while filling array");
+    }
+    return result;
+}
+
+/**
+ * Fill in one array item for each handle, in for_each_handle() order, checking
+ * that we don't run past the end.
+ */
+template<typename T>
+pybind11::array_t<T> fill_handle_array(const HandleGraph& graph, const std::function<T(const handle_t&)>& get_value) {
+    size_t length = graph.get_node_count();
+    return fill_array<T>(length, [&](T* data) {
+        size_t i = 0;
+        graph.for_each_handle([&](const handle_t& handle) {
+            if (i < length) {
+                data[i] = get_value(handle);
+            }
+            i++;
+        });
+        return i;
+    });
+}
+
+/**
+ * Fill in one array item for each step in a path, in path order.
+ */
+template<typename T>
+pybind11::array_t<T> fill_step_array(const PathHandleGraph& graph, const path_handle_t& path,
+                                     const std::function<T(const step_handle_t&)>& get_value) {
+    size_t length = graph.get_step_count(path);
+    return fill_array<T>(length, [&](T* data) {
+        size_t i = 0;
+        graph.for_each_step_in_path(path, [&](const step_handle_t& step) {
+            if (i < length) {
+                data[i] = get_value(step);
+            }
+            i++;
+        });
+        return i;
+    });
+}
+
+/**
+ * Add bulk NumPy accessors, and a for_each_handle() that releases the GIL, to
+ * the bindings for a HandleGraph.
+ */
+template<typename Class, typename... Options>
+void add_graph_accessors(pybind11::class_<Class, Options...>& cl) {
+    cl.def("node_ids", [](const Class& graph) {
+        return fill_handle_array<int64_t>(graph, [&](const handle_t& handle) {
+            return (int64_t) graph.get_id(handle);
+        });
+    }, "Get a NumPy array of all node IDs, in for_each_handle() order.\n"
+       "The other per-node arrays use the same order.");
+    cl.def("sequence_lengths", [](const Class& graph) {
+        return fill_handle_array<uint64_t>(graph, [&](const handle_t& handle) {
+            return (uint64_t) graph.get_length(handle);
+        });
+    }, "Get a NumPy array of the sequence length of each node, in node_ids() order.");
+    cl.def("degrees", [](const Class& graph, bool go_left) {
+        return fill_handle_array<uint64_t>(graph, [&](const handle_t& handle) {
+            return (uint64_t) graph.get_degree(handle, go_left);
+        });
+    }, "Get a NumPy array of the number of edges on the right (or left) of each\n"
+       "node, in node_ids() order.",
+       pybind11::arg("go_left") = false);
+    cl.def("for_each_handle_nogil", [](const Class& graph, const std::function<bool(const handle_t&)>& iteratee, bool parallel) {
+        // A Python exception can't be let out of an OpenMP thread, so the
+        // first one stops the loop and is thrown again once it is over.
+        std::exception_ptr error;
+        bool completed;
+        {
+            pybind11::gil_scoped_release release;
+            completed = graph.for_each_handle([&](const handle_t& handle) {
+                // Only hold the GIL while we are in Python. It also guards the error.
+                pybind11::gil_scoped_acquire acquire;
+                if (error) {
+                    return false;
+                }
+                try {
+                    return iteratee(handle);
+                } catch (...) {
+                    error = std::current_exception();
+                    return false;
+                }
+            }, parallel);
+        }
+        if (error) {
+            std::rethrow_exception(error);
+        }
+        return completed;
+    }, "Loop over all the handles, like for_each_handle(), but only hold the GIL\n"
+       "while running the iteratee, so other Python threads can run during the\n"
+       "graph traversal. Return False from the iteratee to stop early. If the\n"
+       "iteratee raises an exception, the loop stops and the exception is raised.",
+       pybind11::arg("iteratee"), pybind11::arg("parallel") = false);
+}
+
+/**
+ * Add NumPy accessors for path steps to the bindings for a PathHandleGraph,
+ * along with all the HandleGraph accessors.
+ */
+template<typename Class, typename... Options>
+void add_path_graph_accessors(pybind11::class_<Class, Options...>& cl) {
+    add_graph_accessors(cl);
+    cl.def("path_step_ids", [](const Class& graph, const path_handle_t& path) {
+        return fill_step_array<int64_t>(graph, path, [&](const step_handle_t& step) {
+            return (int64_t) graph.get_id(graph.get_handle_of_step(step));
+        });
+    }, "Get a NumPy array of the node ID visited by each step of a path, in order.",
+       pybind11::arg("path"));
+    cl.def("path_step_orientations", [](const Class& graph, const path_handle_t& path) {
+        return fill_step_array<bool>(graph, path, [&](const step_handle_t& step) {
+            return graph.get_is_reverse(graph.get_handle_of_step(step));
+        });
+    }, "Get a NumPy array of whether each step of a path visits its node in\n"
+       "reverse, in path_step_ids() order.",
+       pybind11::arg("path"));
+}
+
+/**
+ * Add NumPy accessors for step positions to the bindings for a
+ * PathPositionHandleGraph, along with all the PathHandleGraph accessors.
+ */
+template<typename Class, typename... Options>
+void add_path_position_graph_accessors(pybind11::class_<Class, Options...>& cl) {
+    add_path_graph_accessors(cl);
+    cl.def("path_step_positions", [](const Class& graph, const path_handle_t& path) {
+        return fill_step_array<uint64_t>(graph, path, [&](const step_handle_t& step) {
+            return (uint64_t) graph.get_position_of_step(step);
+        });
+    }, "Get a NumPy array of the offset along the path at which each step of a\n"
+       "path starts, in path_step_ids() order.",
+       pybind11::arg("path"));
+}
+
+/**
+ * Add versions of the distance queries that release the GIL to the bindings
+ * for SnarlDistanceIndex.
+ */
+template<typename Class, typename... Options>
+void add_distance_index_accessors(pybind11::class_<Class, Options...>& cl) {
+    cl.def("minimum_distance_nogil", [](const Class& index, nid_t id1, bool rev1, size_t offset1,
+                                        nid_t id2, bool rev2, size_t offset2, bool unoriented_distance,
+                                        const HandleGraph* graph) {
+        return index.minimum_distance(id1, rev1, offset1, id2, rev2, offset2, unoriented_distance, graph);
+    }, "Find the minimum distance between two positions, like minimum_distance(),\n"
+       "without holding the GIL.",
+       pybind11::arg("id1"), pybind11::arg("rev1"), pybind11::arg("offset1"),
+       pybind11::arg("id2"), pybind11::arg("rev2"), pybind11::arg("offset2"),
+       pybind11::arg("unoriented_distance") = false, pybind11::arg("graph") = pybind11::none(),
+       pybind11::call_guard<pybind11::gil_scoped_release>());
+    cl.def("maximum_distance_nogil", [](const Class& index, nid_t id1, bool rev1, size_t offset1,
+                                        nid_t id2, bool rev2, size_t offset2, bool unoriented_distance,
+                                        const HandleGraph* graph) {
+        return index.maximum_distance(id1, rev1, offset1, id2, rev2, offset2, unoriented_distance, graph);
+    }, "Find an approximation of the maximum distance between two positions, like\n"
+       "maximum_distance(), without holding the GIL.",
+       pybind11::arg("id1"), pybind11::arg("rev1"), pybind11::arg("offset1"),
+       pybind11::arg("id2"), pybind11::arg("rev2"), pybind11::arg("offset2"),
+       pybind11::arg("unoriented_distance") = false, pybind11::arg("graph") = pybind11::none(),
+       pybind11::call_guard<pybind11::gil_scoped_release>());
+    cl.def("minimum_distance_pairs", [](const Class& index,
+                                        const input_array_t<nid_t>& ids1, const input_array_t<bool>& revs1,
+                                        const input_array_t<size_t>& offsets1,
+                                        const input_array_t<nid_t>& ids2, const input_array_t<bool>& revs2,
+                                        const input_array_t<size_t>& offsets2,
+                                        bool unoriented_distance, const HandleGraph* graph, bool parallel) {
+        size_t count = ids1.size();
+        if (revs1.size() != count || offsets1.size() != count || ids2.size() != count ||
+            revs2.size() != count || offsets2.size() != count) {
+            throw std::runtime_error("error:[bdsg::python] position arrays must all be the same length");
+        }
+        return fill_array<size_t>(count, [&](size_t* distances) {
+            index.minimum_distance_pairs(count, ids1.data(), revs1.data(), offsets1.data(),
+                                         ids2.data(), revs2.data(), offsets2.data(), distances,
+                                         unoriented_distance, graph, parallel);
+            return count;
+        });
+    }, "Find the minimum distance between each of a batch of pairs of positions,\n"
+       "given as NumPy arrays of the ID, orientation and offset of each side.\n"
+       "Returns a NumPy array of distances. The queries run without holding the\n"
+       "GIL, across OpenMP threads if parallel is set.",
+       pybind11::arg("ids1"), pybind11::arg("revs1"), pybind11::arg("offsets1"),
+       pybind11::arg("ids2"), pybind11::arg("revs2"), pybind11::arg("offsets2"),
+       pybind11::arg("unoriented_distance") = false, pybind11::arg("graph") = pybind11::none(),
+       pybind11::arg("parallel") = true);
+}
+
+}
+}
+
+#endif
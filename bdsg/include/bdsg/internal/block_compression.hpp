@@ -0,0 +1,32 @@
+#ifndef BDSG_BLOCK_COMPRESSION_HPP_INCLUDED
+#define BDSG_BLOCK_COMPRESSION_HPP_INCLUDED
+
+/**
+ * \file block_compression.hpp
+ * Compression of independent blocks of bytes, for the block-compressed
+ * serialization formats. Each block can be decompressed on its own, so blocks
+ * can be decompressed in parallel and in any order.
+ *
+ * Compression is only available in code compiled with BDSG_ZLIB defined (the
+ * ZLIB_COMPRESSION build option). Otherwise block_compression_available()
+ * returns false, and the other functions throw.
+ */
+
+#include <cstddef>
+#include <string>
+
+namespace bdsg {
+
+/// Return true if libbdsg was built with support for block compression.
+bool block_compression_available();
+
+/// Compress a block of bytes, replacing the contents of compressed.
+void compress_block(const char* data, size_t length, std::string& compressed);
+
+/// Decompress a block made by compress_block() into dest, which must have
+/// room for exactly the length of the original block.
+void decompress_block(const char* compressed, size_t compressed_length, char* dest, size_t length);
+
+}
+
+#endif
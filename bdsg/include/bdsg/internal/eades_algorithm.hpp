@@ -15,6 +15,7 @@
 #include <list>
 #include <unordered_map>
 #include <deque>
+#include <functional>
 
 namespace bdsg {
 namespace algorithms {
@@ -28,6 +29,18 @@ using namespace handlegraph;
 /// algorithms::single_stranded_orientation.
 vector<handle_t> eades_algorithm(const HandleGraph* graph);
 
+/// Computes the same kind of layout as eades_algorithm(), but keeps its working
+/// state in flat arrays indexed by node rank (see DenseNodeRanks), lays out weakly connected
+/// components concurrently, and peels the sources and sinks of large components
+/// in parallel. The layout is passed to the iteratee one handle at a time, in
+/// order, instead of being returned. The layout may differ from the one
+/// eades_algorithm() gives, and may depend on the number of threads. Only valid
+/// for graphs that have a single stranded orientation.
+void parallel_eades_algorithm(const HandleGraph* graph, const function<void(const handle_t&)>& iteratee);
+
+/// Computes the layout of parallel_eades_algorithm() and returns it.
+vector<handle_t> parallel_eades_algorithm(const HandleGraph* graph);
+
 }
 }
 
@@ -7,6 +7,7 @@
 
 #include "bdsg/internal/wang_hash.hpp"
 #include "bdsg/internal/packed_structs.hpp"
+#include "bdsg/internal/swiss_table.hpp"
 
 // Uncomment these to use dense hash tables in memory:
 //#define USE_DENSE_HASH
@@ -152,31 +153,63 @@ public:
 #endif
 };
 
+// Flat hash tables, for when lookup speed matters more than memory.
+
+template<typename K, typename V>
+using swiss_hash_map = SwissMap<K, V, wang_hash<K>>;
+
+template<typename K>
+using swiss_hash_set = SwissSet<K, wang_hash<K>>;
+
 /**
- * Template to choose the appropriate hash map for a backend. Exposes the
- * resulting template at ::type.
+ * Hash table policy for the *For templates below: use the memory-efficient
+ * hash tables selected at compile time (sparse, unless USE_DENSE_HASH is set).
+ * This is the default.
  */
-template<typename Backend>
+struct CompactHashTables {
+};
+
+/**
+ * Hash table policy for the *For templates below: use the flat SwissMap and
+ * SwissSet tables, which are several times faster to query than the sparse
+ * ones but use more memory. They can't use a custom allocator, so the
+ * backends that need one fall back on the compact tables.
+ */
+struct SwissHashTables {
+};
+
+/**
+ * Template to choose the appropriate hash map for a backend and policy.
+ * Exposes the resulting template at ::type.
+ */
+template<typename Backend, typename Policy = CompactHashTables>
 struct HashMapFor {
 };
 
 // Use the hash map selected above for STLBackend
 template<>
-struct HashMapFor<STLBackend> {
+struct HashMapFor<STLBackend, CompactHashTables> {
     template<typename K, typename V>
     using type = hash_map<K, V>;
 };
 
-// Always use a sparse hash map with SPP's default allocator for CompatBackend
+// Or the flat one, if asked
 template<>
-struct HashMapFor<CompatBackend> {
+struct HashMapFor<STLBackend, SwissHashTables> {
+    template<typename K, typename V>
+    using type = swiss_hash_map<K, V>;
+};
+
+// Always use a sparse hash map with SPP's default allocator for CompatBackend
+template<typename Policy>
+struct HashMapFor<CompatBackend, Policy> {
     template<typename K, typename V>
     using type = spp::sparse_hash_map<K, V, spp::spp_hash<K>, std::equal_to<K>, SPP_DEFAULT_ALLOCATOR<std::pair<const K, V>>>;
 };
 
 // When memory mapping, use the SPP hash tables with the YOMO allocator, so they live in the memory map.
-template<>
-struct HashMapFor<MappedBackend> {
+template<typename Policy>
+struct HashMapFor<MappedBackend, Policy> {
     template<typename K, typename V>
     using type = spp::sparse_hash_map<K, V, spp::spp_hash<K>, std::equal_to<K>, bdsg::yomo::Allocator<std::pair<const K, V>>>;
 };
@@ -197,23 +230,30 @@ public:
 };
 
 /**
- * Template to choose the appropriate string-keyed hash map for a backend.
- * Exposes the resulting template at ::type.
+ * Template to choose the appropriate string-keyed hash map for a backend and
+ * policy. Exposes the resulting template at ::type.
  */
-template<typename Backend>
+template<typename Backend, typename Policy = CompactHashTables>
 struct StringHashMapFor {
     // Usually use the normal hash map.
     template<typename K, typename V>
-    using type = typename HashMapFor<Backend>::template type<K, V>;
+    using type = typename HashMapFor<Backend, Policy>::template type<K, V>;
 };
 
 // Use the string hash map selected above for STLBackend
 template<>
-struct StringHashMapFor<STLBackend> {
+struct StringHashMapFor<STLBackend, CompactHashTables> {
     template<typename K, typename V>
     using type = string_hash_map<K, V>;
 };
 
+// Strings have a good std::hash already
+template<>
+struct StringHashMapFor<STLBackend, SwissHashTables> {
+    template<typename K, typename V>
+    using type = SwissMap<K, V, std::hash<K>>;
+};
+
 template<typename K, typename V>
 #ifdef USE_DENSE_HASH
 class pair_hash_map : public google::dense_hash_map<K, V, wang_hash<K>>
@@ -230,19 +270,19 @@ public:
 };
 
 /**
- * Template to choose the appropriate pair-keyed hash map for a backend.
- * Exposes the resulting template at ::type.
+ * Template to choose the appropriate pair-keyed hash map for a backend and
+ * policy. Exposes the resulting template at ::type.
  */
-template<typename Backend>
+template<typename Backend, typename Policy = CompactHashTables>
 struct PairHashMapFor {
     // Usually use the normal hash map.
     template<typename K, typename V>
-    using type = typename HashMapFor<Backend>::template type<K, V>;
+    using type = typename HashMapFor<Backend, Policy>::template type<K, V>;
 };
 
 // Use the pair hash map selected above for STLBackend
 template<>
-struct PairHashMapFor<STLBackend> {
+struct PairHashMapFor<STLBackend, CompactHashTables> {
     template<typename K, typename V>
     using type = pair_hash_map<K, V>;
 };
@@ -283,30 +323,37 @@ public:
 };
 
 /**
- * Template to choose the appropriate hash set for a backend.
+ * Template to choose the appropriate hash set for a backend and policy.
  * Exposes the resulting template at ::type.
  */
-template<typename Backend>
+template<typename Backend, typename Policy = CompactHashTables>
 struct HashSetFor {
 };
 
 // Use the hash set selected above for STLBackend
 template<>
-struct HashSetFor<STLBackend> {
+struct HashSetFor<STLBackend, CompactHashTables> {
     template<typename K>
     using type = hash_set<K>;
 };
 
-// Always use a sparse hash set with SPP's default allocator for CompatBackend
+// Or the flat one, if asked
 template<>
-struct HashSetFor<CompatBackend> {
+struct HashSetFor<STLBackend, SwissHashTables> {
+    template<typename K>
+    using type = swiss_hash_set<K>;
+};
+
+// Always use a sparse hash set with SPP's default allocator for CompatBackend
+template<typename Policy>
+struct HashSetFor<CompatBackend, Policy> {
     template<typename K>
     using type = spp::sparse_hash_set<K, spp::spp_hash<K>, std::equal_to<K>, SPP_DEFAULT_ALLOCATOR<const K>>;
 };
 
 // When memory mapping, use the SPP hash set with the YOMO allocator, so they live in the memory map.
-template<>
-struct HashSetFor<MappedBackend> {
+template<typename Policy>
+struct HashSetFor<MappedBackend, Policy> {
     template<typename K>
     using type = spp::sparse_hash_set<K, spp::spp_hash<K>, std::equal_to<K>, bdsg::yomo::Allocator<const K>>;
 };
@@ -327,23 +374,30 @@ public:
 };
 
 /**
- * Template to choose the appropriate string-keyed hash set for a backend.
- * Exposes the resulting template at ::type.
+ * Template to choose the appropriate string-keyed hash set for a backend and
+ * policy. Exposes the resulting template at ::type.
  */
-template<typename Backend>
+template<typename Backend, typename Policy = CompactHashTables>
 struct StringHashSetFor {
     // Usually use the normal hash set.
     template<typename K>
-    using type = typename HashSetFor<Backend>::template type<K>;
+    using type = typename HashSetFor<Backend, Policy>::template type<K>;
 };
 
 // Use the hash set selected above for STLBackend
 template<>
-struct StringHashSetFor<STLBackend> {
+struct StringHashSetFor<STLBackend, CompactHashTables> {
     template<typename K>
     using type = string_hash_set<K>;
 };
 
+// Strings have a good std::hash already
+template<>
+struct StringHashSetFor<STLBackend, SwissHashTables> {
+    template<typename K>
+    using type = SwissSet<K, std::hash<K>>;
+};
+
 template<typename K>
 #ifdef USE_DENSE_HASH
 class pair_hash_set : public google::dense_hash_set<K, wang_hash<K>>
@@ -360,19 +414,19 @@ public:
 };
 
 /**
- * Template to choose the appropriate pair-keyed hash set for a backend.
- * Exposes the resulting template at ::type.
+ * Template to choose the appropriate pair-keyed hash set for a backend and
+ * policy. Exposes the resulting template at ::type.
  */
-template<typename Backend>
+template<typename Backend, typename Policy = CompactHashTables>
 struct PairHashSetFor {
     // Usually use the normal hash set.
     template<typename K>
-    using type = typename HashSetFor<Backend>::template type<K>;
+    using type = typename HashSetFor<Backend, Policy>::template type<K>;
 };
 
 // Use the hash set selected above for STLBackend
 template<>
-struct PairHashSetFor<STLBackend> {
+struct PairHashSetFor<STLBackend, CompactHashTables> {
     template<typename K>
     using type = pair_hash_set<K>;
 };
@@ -8,7 +8,9 @@
  */
 
 #include <handlegraph/handle_graph.hpp>
+#include <handlegraph/ranked_handle_graph.hpp>
 
+#include <algorithm>
 #include <unordered_set>
 #include <unordered_map>
 #include <vector>
@@ -30,6 +32,53 @@ using namespace handlegraph;
     /// in orientation, the graph would contain no reversing edges. Returns an empty vector
     /// if there is no such combination of node orientations (also if graph has no nodes).
     vector<handle_t> single_stranded_orientation(const HandleGraph* graph);
+    
+    /// Like is_single_stranded(), but checks the nodes in parallel, and stops
+    /// every thread as soon as any of them finds a reversing edge.
+    bool parallel_is_single_stranded(const HandleGraph* graph);
+    
+    /// Like single_stranded_orientation(), but finds the orientations in
+    /// parallel, using a concurrent union-find over the edges that tracks
+    /// whether each node is flipped relative to the representative of its
+    /// set. The handles come out in the order of their DenseNodeRanks rather
+    /// than in a traversal order.
+    vector<handle_t> parallel_single_stranded_orientation(const HandleGraph* graph);
+    
+    /// Assigns each node of a graph a dense rank, for indexing flat arrays of
+    /// per-node state. Uses the graph's own ranks if it is a RankedHandleGraph.
+    /// Otherwise the ranks come from the node IDs, directly if they are dense
+    /// enough and by searching a sorted list of them if not.
+    class DenseNodeRanks {
+    public:
+        DenseNodeRanks(const HandleGraph* graph);
+        
+        /// Get the number of ranks, which is at least the number of nodes. Some
+        /// ranks may not be used.
+        inline size_t size() const {
+            return rank_space;
+        }
+        
+        /// Get the rank of a node, which is less than size().
+        inline size_t rank(const handle_t& handle) const {
+            nid_t node_id = graph->get_id(handle);
+            if (ranked) {
+                return ranked->id_to_rank(node_id) - 1;
+            }
+            else if (sorted_ids.empty()) {
+                return node_id - min_id;
+            }
+            else {
+                return std::lower_bound(sorted_ids.begin(), sorted_ids.end(), node_id) - sorted_ids.begin();
+            }
+        }
+        
+    private:
+        const HandleGraph* graph;
+        const RankedHandleGraph* ranked;
+        nid_t min_id = 0;
+        size_t rank_space = 0;
+        vector<nid_t> sorted_ids;
+    };
 
 }
 }
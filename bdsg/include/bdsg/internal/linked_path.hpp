@@ -0,0 +1,146 @@
+//
+//  linked_path.hpp
+//
+//  Contains a doubly linked list representation of an embedded path, shared
+//  by the hash table based graph implementations
+//
+
+#ifndef BDSG_LINKED_PATH_HPP_INCLUDED
+#define BDSG_LINKED_PATH_HPP_INCLUDED
+
+#include <handlegraph/types.hpp>
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include <iostream>
+
+#include "bdsg/internal/endianness.hpp"
+
+namespace bdsg {
+    
+using namespace std;
+using namespace handlegraph;
+
+/*
+ * A linked list record representing a single node in an embedded path
+ */
+struct LinkedPathStep {
+    LinkedPathStep() {}
+    LinkedPathStep(const handle_t& handle,
+                   const int64_t& path_id) : handle(handle), path_id(path_id) {}
+    
+    handle_t handle;
+    int64_t path_id;
+    struct LinkedPathStep* prev = nullptr;
+    struct LinkedPathStep* next = nullptr;
+};
+
+/*
+ * Allocates the mappings of a single path from a list of blocks that grow
+ * geometrically, so that steps added in order are adjacent in memory and
+ * all of a path's steps are freed at once. Mappings never move once they
+ * are allocated, and removed mappings are reused.
+ */
+class LinkedPathArena {
+public:
+    
+    LinkedPathArena() = default;
+    LinkedPathArena(LinkedPathArena&& other);
+    LinkedPathArena& operator=(LinkedPathArena&& other);
+    
+    /// Get a mapping with the given contents and no links
+    LinkedPathStep* allocate(const handle_t& handle, const int64_t& path_id);
+    
+    /// Return a mapping for reuse
+    void deallocate(LinkedPathStep* mapping);
+    
+    /// Make sure the next count allocations come from a single block
+    void reserve(size_t count);
+    
+    /// Free all of the mappings
+    void clear();
+    
+    /// The number of mappings that fit in the allocated blocks
+    size_t capacity() const;
+    
+private:
+    
+    /// The smallest and largest block we allocate to grow the arena. Paths
+    /// of only a step or two are common, so without a reserve() the first
+    /// block holds one mapping.
+    static const size_t MIN_BLOCK_SIZE = 1;
+    static const size_t MAX_BLOCK_SIZE = 1 << 16;
+    
+    /// The blocks and the number of mappings they hold
+    vector<pair<unique_ptr<LinkedPathStep[]>, size_t>> blocks;
+    /// The number of mappings in the last block that have been handed out
+    size_t used = 0;
+    /// Mappings that have been returned, linked through their next pointers
+    LinkedPathStep* free_list = nullptr;
+};
+
+/*
+ * A simple linked list implementation of an embedded path
+ */
+class LinkedPath {
+public:
+    
+    LinkedPath();
+    LinkedPath(const string& name, const int64_t& path_id, bool is_circular = false);
+    
+    /// Move constructor
+    LinkedPath(LinkedPath&& other);
+    
+    /// Move assignment
+    LinkedPath& operator=(LinkedPath&& other);
+    
+    /// Copy constructor
+    LinkedPath(const LinkedPath& other);
+    
+    /// Copy assignment
+    LinkedPath& operator=(const LinkedPath& other);
+    
+    /// Remove all of the steps from the path
+    void clear();
+    
+    /// Add a node to the end of the path
+    LinkedPathStep* push_back(const handle_t& handle);
+    
+    /// Add a node to the front of the path
+    LinkedPathStep* push_front(const handle_t& handle);
+    
+    /// Remove the mapping from the path and free its memory
+    void remove(LinkedPathStep* mapping);
+    
+    /// Insert a new node into the middle of the path. If the the provided node
+    /// is null, inserts at the end.
+    LinkedPathStep* insert_before(const handle_t& handle, LinkedPathStep* mapping);
+    
+    /// Call the given function on each step of the path, in parallel. One
+    /// thread follows the path and hands out chunks of steps of the given size
+    /// to OMP tasks, so the order is not defined. If the function returns
+    /// false, iteration stops on a best-effort basis, and false is returned.
+    bool for_each_step_parallel(const function<bool(const LinkedPathStep*)>& iteratee, size_t chunk_size) const;
+    
+    /// Write the path to an out stream, applying the given offset to all
+    /// node IDs referenced by the path.
+    void serialize(ostream& out) const;
+    
+    /// Read the path (in the format written by serialize()) from an in stream.
+    void deserialize(istream& in);
+    
+    LinkedPathStep* head = nullptr;
+    LinkedPathStep* tail = nullptr;
+    /// Owns the memory of the mappings
+    LinkedPathArena arena;
+    size_t count = 0;
+    int64_t path_id = 0;
+    string name;
+    bool is_circular = false;
+};
+
+}
+
+#endif
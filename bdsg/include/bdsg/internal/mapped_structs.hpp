@@ -11,13 +11,17 @@
 #include <cstdint>
 #include <cassert>
 #include <climits>
+#include <cstring>
 #include <iostream>
 #include <functional>
 #include <limits>
 
+#include <algorithm>
 #include <map>
+#include <memory>
 #include <unordered_map>
 #include <vector>
+#include <atomic>
 #include <shared_mutex>
 
 // TODO: We only target little-endian systems, like x86_64 and ARM64 Linux and
@@ -169,6 +173,15 @@ protected:
  * When a file is initially mapped, it is mapped as a single segment.
  * Additional segments may be mapped later to fulfill allocations from
  * yomo::Allocator<T> instances stored in the chain.
+ *
+ * Resolving addresses and positions in chains, which every access through a
+ * Pointer does, takes no locks. Readers work from an immutable snapshot of
+ * the links in all chains, which is republished whenever links are added or
+ * removed, and which is only freed once no reader that could have seen it is
+ * still running. So any number of threads can read through Pointers while a
+ * single writer thread allocates from and grows the chains. Readers must
+ * still not look at objects that the writer is in the middle of changing,
+ * and a chain must not be destroyed while anyone is using it.
  */
 class Manager {
 
@@ -182,6 +195,19 @@ public:
      * correctness, and false to disable them.
      */
     static bool check_chains;
+    
+    /**
+     * Kinds of memory that chains not backed by files can be made of.
+     */
+    enum page_kind_t {
+        /// Use memory from malloc().
+        PAGES_NORMAL = 0,
+        /// Map 2 MB huge pages. If none are available, fall back on normal
+        /// pages opted in to transparent hugepages.
+        PAGES_HUGE_2MB,
+        /// Map 1 GB huge pages, falling back like PAGES_HUGE_2MB.
+        PAGES_HUGE_1GB
+    };
 
     /**
      * Create a chain not backed by any file. The given prefix data will be
@@ -189,6 +215,15 @@ public:
      */
     static chainid_t create_chain(const std::string& prefix = "");
     
+    /**
+     * Create a chain not backed by any file, made of the given kind of memory,
+     * with room for at least the given number of bytes in its first link.
+     * When using huge pages, the chain's links are all sized in whole pages.
+     * The given prefix data will be placed before the chain allocator data
+     * structures.
+     */
+    static chainid_t create_chain(const std::string& prefix, size_t reserve_bytes, page_kind_t pages = PAGES_NORMAL);
+    
     /**
      * Create a chain by mapping all of the given open file. The file must
      * begin with the given prefix, if specified, or an error will occur.
@@ -220,14 +255,43 @@ public:
      */
     static chainid_t create_chain(const std::function<std::string(void)>& iterator, const std::string& prefix = "");
     
+    /**
+     * Create a chain by calling the given function to read data directly into
+     * the chain's memory, until it returns 0. The function is given a
+     * destination and a maximum number of bytes, and returns the number of
+     * bytes it wrote there.
+     *
+     * The result must begin with the given prefix, if specified, or an error
+     * will occur.
+     *
+     * All content will be stored in one contiguous link.
+     */
+    static chainid_t create_chain_by_reading(const std::function<size_t(void*, size_t)>& reader, const std::string& prefix = "");
+    
+    /**
+     * Create a chain not backed by any file, holding a copy of the data in the
+     * given open file from its current position to its end. The data must
+     * begin with the given prefix, if specified, or an error will occur.
+     *
+     * Regular files are read with several pread() calls in flight at once,
+     * which is faster than mapping or streaming them on network filesystems.
+     * Other files, like pipes, are read straight through. Either way, the
+     * data is read directly into the chain's memory, and the file position is
+     * left at the end.
+     *
+     * The Manager will not take ownership of the file descriptor.
+     */
+    static chainid_t read_chain(int fd, const std::string& prefix = "");
+    
     /**
      * Return a chain which has the same stored data as the given chain, but
      * for which modification of the chain will not modify any backing file on
      * disk. The chain returned may be the same chain as the given chain.
+     * The new chain is made of the given kind of memory.
      *
      * Not thread safe with concurrent modificatons to the source chain.
      */
-    static chainid_t get_dissociated_chain(chainid_t chain);
+    static chainid_t get_dissociated_chain(chainid_t chain, page_kind_t pages = PAGES_NORMAL);
     
     /**
      * Return a chain which has the same stored data as the given chain, but
@@ -240,7 +304,61 @@ public:
      * Not thread safe with concurrent modificatons to the source chain.
      */
     static chainid_t get_associated_chain(chainid_t chain, int fd);
+
+    /**
+     * Return a new chain which has the same stored data as the given chain,
+     * and which can be modified without modifying the given chain or any
+     * backing file. The given chain is left as it is.
+     *
+     * If the given chain is backed by a file, the new chain maps the file
+     * copy-on-write, so it shares the pages of the file until it writes to
+     * them, and taking the snapshot copies nothing. While the snapshot exists,
+     * the given chain should not be modified, since that may show through in
+     * pages the snapshot has not written to. If the given chain is not backed
+     * by a file, its data is copied.
+     *
+     * Not thread safe with concurrent modificatons to the source chain.
+     */
+    static chainid_t get_snapshot_chain(chainid_t chain);
+
+    /**
+     * Replace the given chain with the given replacement chain, which holds a
+     * freshly-built copy of its data, and return the chain to use from now on.
+     * The given chain is destroyed. If the given chain was backed by a
+     * writable file, the file is rewritten to hold just the replacement's
+     * data, and the returned chain is backed by the file; otherwise the
+     * replacement chain itself is returned.
+     *
+     * Rewriting the file is not crash safe: if the process dies partway
+     * through, the file will be incomplete.
+     *
+     * Not thread safe with concurrent access to either chain.
+     */
+    static chainid_t replace_chain(chainid_t chain, chainid_t replacement);
+    
+    /**
+     * Return a new chain not backed by any file, which has a copy of the data
+     * in the given chain, stored in memory on the given NUMA node where the
+     * platform supports it. The copy is meant for threads on that node to read
+     * from; the given chain should not be modified while it exists, since
+     * changes will not show up in it.
+     *
+     * Not thread safe with concurrent modificatons to the source chain.
+     */
+    static chainid_t get_numa_replica_chain(chainid_t chain, size_t numa_node);
     
+    /**
+     * Get the number of NUMA nodes on the system, which is 1 where NUMA is not
+     * supported.
+     */
+    static size_t get_numa_node_count();
+    
+    /**
+     * Get the NUMA node the calling thread is running on. This is looked up
+     * the first time each thread asks, and remembered after that.
+     */
+    static size_t get_local_numa_node();
+
     /**
      * Destroy the given chain and unmap all of its memory, and close any
      * associated file.
@@ -299,6 +417,15 @@ public:
      */
     static std::pair<void*, bool> follow_offset_in_same_chain(const void* here, int64_t offset);
     
+    /**
+     * Return true if the two addresses are both in one of the links that this
+     * thread has recently looked up, so that an offset between them can be
+     * applied directly in memory. Takes no locks and searches no indexes, so
+     * in the common case of a chain with one link, following a Pointer costs
+     * little more than adding the offset.
+     */
+    static inline bool in_cached_link(const void* here, const void* there);
+    
     /**
      * Allocate the given number of bytes from the given chain.
      * For NO_CHAIN just allocates with malloc().
@@ -321,6 +448,76 @@ public:
      */
     static void preload_chain(chainid_t chain, bool blocking = false);
     
+    /**
+     * Tell the memory management subsystem that the given range of memory
+     * should be loaded, if possible. The range is widened out to whole pages.
+     *
+     * If blocking is set to true, actually read from each page in the range,
+     * or make a syscall with similar effect, before returning.
+     */
+    static void preload_range(const void* start, size_t length, bool blocking = false);
+    
+    /**
+     * Hints about how a chain's memory is going to be accessed, for passing
+     * along to the memory management subsystem.
+     */
+    enum access_hint_t {
+        /// Go back to the default readahead and caching behavior.
+        ACCESS_NORMAL = 0,
+        /// Memory will be read front to back, so read ahead aggressively and
+        /// drop pages soon after they are used.
+        ACCESS_SEQUENTIAL,
+        /// Memory will be accessed in no particular order, so don't bother
+        /// reading ahead.
+        ACCESS_RANDOM,
+        /// Memory will be needed soon, so start loading it in the background.
+        ACCESS_WILLNEED,
+        /// Memory won't be needed soon, so it can be dropped from the page
+        /// cache. Only applied to file-backed chains, since for heap-backed
+        /// chains it would discard the data.
+        ACCESS_DONTNEED,
+        /// Opt the memory in to transparent hugepages, where available.
+        ACCESS_HUGEPAGE,
+        /// Opt the memory back out of transparent hugepages.
+        ACCESS_NOHUGEPAGE
+    };
+    
+    /**
+     * Tell the memory management subsystem how the given chain is going to be
+     * accessed. Hints the platform does not support are ignored.
+     */
+    static void advise_chain(chainid_t chain, access_hint_t hint);
+    
+    /**
+     * Start writing any changes to the given chain back to the file backing
+     * it, in the background, and return the generation number of the
+     * checkpoint being written. Generation numbers count up from 1 for each
+     * chain, and checkpoints reach the file in order.
+     *
+     * Changes made to the chain before the call are in the checkpoint.
+     * Changes made while it is being written may or may not be, so if the
+     * file needs to be consistent, the chain should not be modified until
+     * wait_for_flush() returns.
+     *
+     * Returns 0 and does nothing if the chain is not backed by a writable
+     * file.
+     */
+    static size_t flush_chain_async(chainid_t chain);
+    
+    /**
+     * Wait for the most recent checkpoint started on the given chain to reach
+     * its file, and return its generation number, or 0 if no checkpoint has
+     * been started. Throws if the checkpoint could not be written.
+     */
+    static size_t wait_for_flush(chainid_t chain);
+    
+    /**
+     * Write any changes to the given chain back to the file backing it, and
+     * wait for them to get there. Returns the generation number of the
+     * checkpoint, or 0 if the chain is not backed by a writable file.
+     */
+    static size_t flush_chain(chainid_t chain);
+    
     /**
      * Free the given allocated block in the chain to which it belongs.
      * For NO_CHAIN just frees with free().
@@ -490,6 +687,32 @@ protected:
      * How much should we expand each new link by?
      */
     static constexpr size_t SCALE_FACTOR = 2;
+    
+    /**
+     * How many bytes should each pread() call in read_chain() ask for?
+     */
+    static constexpr size_t READ_CHUNK_SIZE = 8 * 1024 * 1024;
+    
+    /**
+     * How many pread() calls should read_chain() keep in flight at once?
+     */
+    static constexpr size_t MAX_READ_THREADS = 8;
+    
+    /**
+     * Create a chain with one link of the given buffer, allocated with
+     * malloc(), which must hold the given prefix and then the allocator data
+     * structures. The Manager takes ownership of the buffer, and frees it if
+     * an error occurs.
+     */
+    static chainid_t adopt_buffer(void* buffer, size_t length, const std::string& prefix);
+    
+    /**
+     * Create a chain with one link of the memory mapped by the given record,
+     * which must have its length set, and which must hold the chain's data,
+     * with allocator data structures after the given number of prefix bytes.
+     * Fills in the rest of the record and takes it over.
+     */
+    static chainid_t adopt_mapping(LinkRecord& record, size_t prefix_size);
    
     /**
      * Create a chain with one link and no allocator setup.
@@ -503,8 +726,11 @@ protected:
      *
      * If the FD is not writable, this will be detected, and memory will be
      * mapped read-only.
+     *
+     * If there is no FD or link_data, the chain's links are made of the given
+     * kind of memory.
      */
-    static std::pair<chainid_t, bool> open_chain(int fd = 0, size_t start_size = BASE_SIZE, void* link_data = nullptr);
+    static std::pair<chainid_t, bool> open_chain(int fd = 0, size_t start_size = BASE_SIZE, void* link_data = nullptr, page_kind_t pages = PAGES_NORMAL);
     
     /**
      * Extend the given chain to the given new total size.
@@ -530,17 +756,72 @@ protected:
     static LinkRecord& add_link(LinkRecord& head, size_t new_bytes, void* link_data = nullptr);
     
     /**
-     * Find the link overlapping the given address, or
-     * address_space_index.end() if no link overlaps the given address. Must be
-     * called while you hold a read lock on the chain data structures.
+     * Immutable snapshot of where the links of all chains are, which readers
+     * can search without holding the mutex.
      */
-    static std::map<intptr_t, LinkRecord>::iterator find_link(std::shared_lock<std::shared_timed_mutex>& lock, const void* address);
+    struct LinkTable;
     
     /**
-     * Create a new chain, using the given file if set, and copy data from the
-     * given existing chain.
+     * Keeps the current LinkTable from being freed while it exists. Should
+     * not be held across calls that may need to write-lock the mutex.
      */
-    static chainid_t copy_chain(chainid_t chain, int fd = 0);
+    struct LinkTableGuard;
+    
+    /**
+     * The most recently published LinkTable, or null if no chains have been
+     * made yet.
+     */
+    static std::atomic<const LinkTable*> link_table;
+    
+    /**
+     * Counts up every time a LinkTable is replaced. Starts at 1 so that 0 can
+     * mean a reader is idle.
+     */
+    static std::atomic<uint64_t> link_table_epoch;
+    
+    /**
+     * A link range that a thread has looked up, which is good as long as the
+     * LinkTable epoch has not changed.
+     */
+    struct CachedLink {
+        uint64_t epoch = 0;
+        intptr_t start = 0;
+        intptr_t end = 0;
+    };
+    
+    /// How many recently used links each thread remembers
+    static constexpr size_t LINK_CACHE_SIZE = 4;
+    
+    /// The links this thread has recently looked up
+    static thread_local CachedLink link_cache[LINK_CACHE_SIZE];
+    
+    /// Where the next link this thread looks up goes in its cache
+    static thread_local size_t next_cached_link;
+    
+    /**
+     * Remember the given link range as having been found in the LinkTable of
+     * the given epoch.
+     */
+    static void remember_link(uint64_t epoch, intptr_t start, size_t length);
+    
+    /**
+     * Publish a new LinkTable reflecting the current indexes, and free old
+     * ones that no reader can still be using. The caller must hold a write
+     * lock on the manager data structures.
+     */
+    static void publish_link_table();
+    
+    /**
+     * Create a new chain, using the given file if set, or else the given kind
+     * of memory, and copy data from the given existing chain.
+     */
+    static chainid_t copy_chain(chainid_t chain, int fd = 0, page_kind_t pages = PAGES_NORMAL);
+    
+    /**
+     * Get the size of the pages of the given kind, or 0 for PAGES_NORMAL,
+     * which doesn't allocate in pages.
+     */
+    static size_t get_page_size(page_kind_t pages);
    
     /**
      * Set up the allocator data structures in the first link, assuming they
@@ -575,6 +856,21 @@ protected:
      * should close the chain and trim down the backing file!
      */
     static size_t reclaim_tail(chainid_t chain);
+
+    /**
+     * Index over the free blocks of a chain by size class and by position,
+     * so allocation doesn't need to walk the free list. Lives in normal
+     * memory, next to the chain's first LinkRecord, and is rebuilt from the
+     * free list in the chain when the chain is next used.
+     */
+    struct FreeBlockIndex;
+
+    /**
+     * Get the free block index for the given chain, building it from the
+     * chain's free list if it doesn't exist yet. The caller must hold the
+     * chain's allocator mutex.
+     */
+    static FreeBlockIndex& get_free_block_index(chainid_t chain, AllocatorHeader* header);
 };
 
 /**
@@ -696,7 +992,7 @@ protected:
      * prefix. Forward other arguments to the constructor.
      */
     template <typename... Args>
-    void construct_internal(const std::string& prefix, Args&&... constructor_args);
+    void construct_internal(const std::string& prefix, size_t reserve_bytes, Manager::page_kind_t pages, Args&&... constructor_args);
 
 public:
 
@@ -722,6 +1018,15 @@ public:
     template <typename... Args>
     void construct(const std::string& prefix, Args&&... constructor_args);
     
+    /**
+     * Make a new constructed T in memory, preceeded by the given prefix, in
+     * memory of the given kind, with at least reserve_bytes set aside up
+     * front. Forward other arguments to the constructor. See
+     * Manager::create_chain().
+     */
+    template <typename... Args>
+    void construct_reserved(size_t reserve_bytes, Manager::page_kind_t pages, const std::string& prefix, Args&&... constructor_args);
+    
     /**
      * Point to the already-constructed T saved to the file at fd by a previous
      * save() call. The file must begin with the given prefix, or an error will
@@ -751,13 +1056,42 @@ public:
      */
     void load_after_prefix(std::istream& in, const std::string& prefix);
     
+    /**
+     * Copy into memory, without mapping the file, and point to the
+     * already-constructed T saved in the given open file from its current
+     * position. The data must begin with the given prefix, or an error will
+     * occur. The file is read with several reads in flight where possible.
+     * See Manager::read_chain().
+     */
+    void load_unmapped(int fd, const std::string& prefix);
+    
     /**
      * Break any write-back association with a backing file and move the object
-     * to non-file-backed memory.
+     * to non-file-backed memory, of the given kind.
      *
      * TODO: Allow private COW mappings by adding features to MIO, to avoid a copy.
      */
-    void dissociate();
+    void dissociate(Manager::page_kind_t pages = Manager::PAGES_NORMAL);
+    
+    /**
+     * Drop any existing item and point to a writable snapshot of the item
+     * that the other pointer points to, which must not be null. Changes to
+     * the snapshot do not affect the other item or any file backing it. If
+     * the other item is in a file, the snapshot maps it copy-on-write, and
+     * the other item should not be modified while the snapshot exists. See
+     * Manager::get_snapshot_chain().
+     */
+    void snapshot(const UniqueMappedPointer& other);
+    
+    /**
+     * Rebuild the stored item in a fresh chain by copy-constructing it, which
+     * lays its memory out densely in the order the copy allocates it, leaving
+     * behind the free space of a fragmented chain. The given prefix is used
+     * for the new chain. If the item is in a writable file, the file is
+     * rewritten to hold the compacted item. The pointer must not be null.
+     * See Manager::replace_chain().
+     */
+    void compact(const std::string& prefix);
     
     /**
      * Move the stored item and all associated memory into memory mapped in the
@@ -792,6 +1126,41 @@ public:
      */
     void preload(bool blocking = false) const;
     
+    /**
+     * Tell the memory management subsystem how the memory arena is going to
+     * be accessed.
+     */
+    void advise(Manager::access_hint_t hint) const;
+    
+    /**
+     * Write any changes to the item back to the file it is stored in. If
+     * blocking is set, wait for them to reach the file; otherwise they are
+     * written in the background. Returns the generation number of the
+     * checkpoint, or 0 if the item is not in a writable file. See
+     * Manager::flush_chain_async().
+     */
+    size_t checkpoint(bool blocking = true);
+    
+    /**
+     * Make a copy of the item in memory on each NUMA node, for threads on that
+     * node to read through get_local(). Does nothing if there is only one
+     * NUMA node. The pointer must not be null, and the item must not be
+     * modified while the replicas exist. See Manager::get_numa_replica_chain().
+     */
+    void replicate_numa();
+    
+    /**
+     * Drop any copies of the item made by replicate_numa().
+     */
+    void drop_replicas();
+    
+    /**
+     * Get the copy of the item that is local to the NUMA node the calling
+     * thread is running on, or this pointer if the item has not been
+     * replicated.
+     */
+    const UniqueMappedPointer<T>* get_local() const;
+    
     /**
      * Free any associated memory and become empty.
      */
@@ -803,7 +1172,7 @@ public:
      * Returns the total bytes, the number of free bytes, and the number of
      * free bytes reclaimable when closed as a mapped file. 
      */
-    std::tuple<size_t, size_t, size_t> get_usage();
+    std::tuple<size_t, size_t, size_t> get_usage() const;
     
     /**
      * Make sure that internal heap data structures are consistent with the
@@ -816,6 +1185,8 @@ private:
     Manager::chainid_t chain = Manager::NO_CHAIN;
     /// The address of the pointed-to value, as mapped into memory.
     T* cached_value = nullptr;
+    /// Copies of the value for each NUMA node, if made.
+    std::unique_ptr<std::vector<UniqueMappedPointer<T>>> replicas;
 };
 
 };
@@ -1030,6 +1401,19 @@ public:
      */
     uint64_t unpack(size_t index, size_t width) const;
     
+    /**
+     * Get len bits (up to 64) beginning at the given bit index in the packed
+     * data, with the first bit in the lowest position, like sdsl's get_int().
+     */
+    uint64_t get_int(size_t bit_index, size_t len = 64) const;
+    
+    /**
+     * Tell the memory management subsystem that the entries from first up to
+     * but not including past_last should be loaded, if possible. See
+     * Manager::preload_range().
+     */
+    void preload(size_t first, size_t past_last, bool blocking = false) const;
+    
     /**
      * Proxy that acts as a mutable reference to an entry in the vector.
      */
@@ -1831,6 +2215,24 @@ uint64_t CompatIntVector<Alloc>::unpack(size_t index, size_t width) const {
     return sdsl::bits::read_int(data.get_first() + (start_bit >> 6), start_bit & 0x3F, width);
 }
 
+template<typename Alloc>
+uint64_t CompatIntVector<Alloc>::get_int(size_t bit_index, size_t len) const {
+    return sdsl::bits::read_int(data.get_first() + (bit_index >> 6), bit_index & 0x3F, len);
+}
+
+template<typename Alloc>
+void CompatIntVector<Alloc>::preload(size_t first, size_t past_last, bool blocking) const {
+    past_last = std::min(past_last, length);
+    if (first >= past_last) {
+        return;
+    }
+    // Find the words holding the first and last bits of the range
+    size_t first_word = (first * bit_width) >> 6;
+    size_t past_last_word = ((past_last * bit_width - 1) >> 6) + 1;
+    yomo::Manager::preload_range(data.get_first() + first_word,
+                                 (past_last_word - first_word) * sizeof(uint64_t), blocking);
+}
+
 template<typename Alloc>
 CompatIntVector<Alloc>::Proxy::Proxy(CompatIntVector& parent, size_t index) : parent(parent), index(index) {
     // Nothing to do!
@@ -1913,6 +2315,19 @@ Pointer<T>::Pointer() : offset(std::numeric_limits<int64_t>::max()), local(false
     // Nothing to do!
 }
 
+inline bool Manager::in_cached_link(const void* here, const void* there) {
+    uint64_t epoch = link_table_epoch.load(std::memory_order_acquire);
+    for (size_t i = 0; i < LINK_CACHE_SIZE; i++) {
+        const CachedLink& cached = link_cache[i];
+        if (cached.epoch == epoch &&
+            (intptr_t) here >= cached.start && (intptr_t) here < cached.end &&
+            (intptr_t) there >= cached.start && (intptr_t) there < cached.end) {
+            return true;
+        }
+    }
+    return false;
+}
+
 template<typename T>
 Pointer<T>::Pointer(T* destination) : Pointer() {
     *this = destination;
@@ -1964,10 +2379,16 @@ Pointer<T>& Pointer<T>::operator=(T* addr) {
         // Adopt our special null value
         offset = std::numeric_limits<int64_t>::max();
     } else {
-        // Get the offset, requiring that it is in the same chain as us.
-        auto result = Manager::get_offset_in_same_chain(this, addr);
-        offset = result.first;
-        local.store(result.second);
+        if (Manager::in_cached_link(this, addr)) {
+            // We know we are in the same link, so use the offset in memory.
+            offset = (intptr_t) addr - (intptr_t) this;
+            local.store(true);
+        } else {
+            // Get the offset, requiring that it is in the same chain as us.
+            auto result = Manager::get_offset_in_same_chain(this, addr);
+            offset = result.first;
+            local.store(result.second);
+        }
     }
     return *this;
 }
@@ -1984,6 +2405,10 @@ T* Pointer<T>::get() const {
     } else if (local.load()) {
         // Just apply the offset directly
         return (T*) ((intptr_t) this + offset);
+    } else if (Manager::in_cached_link(this, (const void*) ((intptr_t) this + offset))) {
+        // We can't record that we are local (maybe because the link is
+        // read-only), but we know we are, so apply the offset directly.
+        return (T*) ((intptr_t) this + offset);
     } else {
         auto result = Manager::follow_offset_in_same_chain((const void*) this, offset);
         if (result.second) {
@@ -2095,12 +2520,12 @@ const T* UniqueMappedPointer<T>::get() const {
 
 template<typename T>
 template<typename... Args>
-void UniqueMappedPointer<T>::construct_internal(const std::string& prefix, Args&&... constructor_args) {
+void UniqueMappedPointer<T>::construct_internal(const std::string& prefix, size_t reserve_bytes, Manager::page_kind_t pages, Args&&... constructor_args) {
     // Drop any existing chain.
     reset();
     
     // Make a new chain
-    chain = Manager::create_chain(prefix);
+    chain = Manager::create_chain(prefix, reserve_bytes, pages);
     // Allocate space in the cahin for the item.
     // Can't use the Allocator because we don't have a place in the chain to
     // store one.
@@ -2116,20 +2541,27 @@ void UniqueMappedPointer<T>::construct_internal(const std::string& prefix, Args&
 template<typename T>
 void UniqueMappedPointer<T>::construct() {
     // Use an empty prefix.
-    construct_internal("");
+    construct_internal("", 0, Manager::PAGES_NORMAL);
 }
 
 template<typename T>
 void UniqueMappedPointer<T>::construct(const std::string& prefix) {
     // Use the provided prefix.
-    construct_internal(prefix);
+    construct_internal(prefix, 0, Manager::PAGES_NORMAL);
 }
 
 template<typename T>
 template<typename... Args>
 void UniqueMappedPointer<T>::construct(const std::string& prefix, Args&&... constructor_args) {
     // Pass along args and use the provided prefix.
-    construct_internal(prefix, std::forward<Args>(constructor_args)...);
+    construct_internal(prefix, 0, Manager::PAGES_NORMAL, std::forward<Args>(constructor_args)...);
+}
+
+template<typename T>
+template<typename... Args>
+void UniqueMappedPointer<T>::construct_reserved(size_t reserve_bytes, Manager::page_kind_t pages, const std::string& prefix, Args&&... constructor_args) {
+    // Pass along everything.
+    construct_internal(prefix, reserve_bytes, pages, std::forward<Args>(constructor_args)...);
 }
 
 template<typename T>
@@ -2181,53 +2613,56 @@ void UniqueMappedPointer<T>::load_after_prefix(std::istream& in, const std::stri
         throw std::runtime_error("Stream is in a bad state and cannot be used for input!");
     }
     
-    const size_t MAX_CHUNK_SIZE = 4096;
-    
-    // Fill up this buffer with chunks of a certian size
-    std::string buffer;
-    
-    // Make the chain through the Manager
-    chain = Manager::create_chain([&]() {
-        if (buffer.empty() && !prefix.empty()) {
-            // Inject the prefix on the first call.
-            // (Or on any call after hitting EOF and returning "", so don't keep calling us)
-            buffer = prefix;
-        } else if (in.eof()) {
-            // Show an empty buffer for EOF
-            buffer.clear();
-        } else {
-            // Other calls read data, until the last call shows an empty buffer
-            // for EOF.
-            buffer.resize(MAX_CHUNK_SIZE);
-            // Grab a chunk
-            if (!in) {
-                // Notice if something goes wrong
-                throw std::runtime_error("Error before reading chunk from stream!");
-            }
-            in.read(&buffer.at(0), MAX_CHUNK_SIZE);
-            if (in.eof()) {
-                // Didn't read all the characters, so shrink down (maybe to 0)
-                buffer.resize(in.gcount());
-            } else if (!in) {
-                // Input error not co-occuirring with EOF
-                throw std::runtime_error("Error reading chunk from stream!");
-            }
+    // How much of the prefix have we shown the Manager yet?
+    size_t prefix_cursor = 0;
+    
+    // Make the chain through the Manager, reading straight into its memory
+    chain = Manager::create_chain_by_reading([&](void* destination, size_t max_bytes) -> size_t {
+        if (prefix_cursor < prefix.size()) {
+            // Inject the prefix first.
+            size_t bytes = std::min(max_bytes, prefix.size() - prefix_cursor);
+            memcpy(destination, prefix.c_str() + prefix_cursor, bytes);
+            prefix_cursor += bytes;
+            return bytes;
+        }
+        if (in.eof()) {
+            // Show 0 bytes for EOF
+            return 0;
         }
-        // Copy the buffer over to the caller.
-        // TODO: can we save a copy here?
-        return buffer;
+        if (!in) {
+            // Notice if something goes wrong
+            throw std::runtime_error("Error before reading chunk from stream!");
+        }
+        in.read((char*) destination, max_bytes);
+        if (!in && !in.eof()) {
+            // Input error not co-occuirring with EOF
+            throw std::runtime_error("Error reading chunk from stream!");
+        }
+        // Report what we got, which is 0 only at EOF
+        return in.gcount();
     }, prefix);
     // And find the item
     cached_value = (T*) Manager::find_first_allocation(chain, sizeof(T));
 }
 
 template<typename T>
-void UniqueMappedPointer<T>::dissociate() {
+void UniqueMappedPointer<T>::load_unmapped(int fd, const std::string& prefix) {
+    // Drop any existing chain.
+    reset();
+    
+    // Just pass through to the Manager
+    chain = Manager::read_chain(fd, prefix);
+    // And find the item
+    cached_value = (T*) Manager::find_first_allocation(chain, sizeof(T));
+}
+
+template<typename T>
+void UniqueMappedPointer<T>::dissociate(Manager::page_kind_t pages) {
     if (chain == Manager::NO_CHAIN) {
         throw runtime_error("Cannot dissociate a null object");
     }
     // Copy the chain
-    Manager::chainid_t new_chain = Manager::get_dissociated_chain(chain);
+    Manager::chainid_t new_chain = Manager::get_dissociated_chain(chain, pages);
     // Get rid of the old chain
     Manager::destroy_chain(chain);
     // Adopt the new chain
@@ -2236,6 +2671,37 @@ void UniqueMappedPointer<T>::dissociate() {
     cached_value = (T*) Manager::find_first_allocation(chain, sizeof(T));
 }
 
+template<typename T>
+void UniqueMappedPointer<T>::snapshot(const UniqueMappedPointer<T>& other) {
+    if (other.chain == Manager::NO_CHAIN) {
+        throw runtime_error("Cannot snapshot a null object");
+    }
+    // Map or copy the other chain
+    Manager::chainid_t new_chain = Manager::get_snapshot_chain(other.chain);
+    // Get rid of our old chain, if any
+    reset();
+    // Adopt the new chain
+    chain = new_chain;
+    // And find the item
+    cached_value = (T*) Manager::find_first_allocation(chain, sizeof(T));
+}
+
+template<typename T>
+void UniqueMappedPointer<T>::compact(const std::string& prefix) {
+    if (chain == Manager::NO_CHAIN) {
+        throw runtime_error("Cannot compact a null object");
+    }
+    // Copy the item into a fresh chain
+    UniqueMappedPointer<T> compacted;
+    compacted.construct(prefix, *cached_value);
+    // Swap it in for our old chain, and take it over
+    chain = Manager::replace_chain(chain, compacted.chain);
+    compacted.chain = Manager::NO_CHAIN;
+    compacted.cached_value = nullptr;
+    // And find the item
+    cached_value = (T*) Manager::find_first_allocation(chain, sizeof(T));
+}
+
 template<typename T>
 void UniqueMappedPointer<T>::save(int fd) {
     if (chain == Manager::NO_CHAIN) {
@@ -2302,8 +2768,64 @@ void UniqueMappedPointer<T>::preload(bool blocking) const {
     }
 }
 
+template<typename T>
+void UniqueMappedPointer<T>::advise(Manager::access_hint_t hint) const {
+    if (chain != Manager::NO_CHAIN) {
+        Manager::advise_chain(chain, hint);
+    }
+}
+
+template<typename T>
+size_t UniqueMappedPointer<T>::checkpoint(bool blocking) {
+    if (chain == Manager::NO_CHAIN) {
+        return 0;
+    }
+    return blocking ? Manager::flush_chain(chain) : Manager::flush_chain_async(chain);
+}
+
+template<typename T>
+void UniqueMappedPointer<T>::replicate_numa() {
+    if (chain == Manager::NO_CHAIN) {
+        throw runtime_error("Cannot replicate a null object");
+    }
+    drop_replicas();
+    
+    size_t node_count = Manager::get_numa_node_count();
+    if (node_count < 2) {
+        // Everything is local already.
+        return;
+    }
+    
+    auto new_replicas = std::make_unique<std::vector<UniqueMappedPointer<T>>>(node_count);
+    for (size_t i = 0; i < node_count; i++) {
+        // Copy the chain onto each node
+        UniqueMappedPointer<T>& replica = new_replicas->at(i);
+        replica.chain = Manager::get_numa_replica_chain(chain, i);
+        // And find the item there
+        replica.cached_value = (T*) Manager::find_first_allocation(replica.chain, sizeof(T));
+    }
+    replicas = std::move(new_replicas);
+}
+
+template<typename T>
+void UniqueMappedPointer<T>::drop_replicas() {
+    replicas.reset();
+}
+
+template<typename T>
+const UniqueMappedPointer<T>* UniqueMappedPointer<T>::get_local() const {
+    if (replicas) {
+        size_t node = Manager::get_local_numa_node();
+        if (node < replicas->size()) {
+            return &(*replicas)[node];
+        }
+    }
+    return this;
+}
+
 template<typename T>
 void UniqueMappedPointer<T>::reset() {
+    drop_replicas();
     if (chain != Manager::NO_CHAIN) {
         Manager::destroy_chain(chain);
         chain = Manager::NO_CHAIN;
@@ -2312,7 +2834,7 @@ void UniqueMappedPointer<T>::reset() {
 }
 
 template<typename T>
-std::tuple<size_t, size_t, size_t> UniqueMappedPointer<T>::get_usage() {
+std::tuple<size_t, size_t, size_t> UniqueMappedPointer<T>::get_usage() const {
     return Manager::get_usage(chain);
 }
 
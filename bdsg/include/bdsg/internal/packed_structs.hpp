@@ -14,9 +14,15 @@
 #include <iostream>
 #include <vector>
 #include <random>
+#include <type_traits>
 #include <sdsl/int_vector.hpp>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #include <bdsg/internal/mapped_structs.hpp>
+#include <bdsg/internal/wang_hash.hpp>
 
 namespace bdsg {
     
@@ -27,6 +33,27 @@ using namespace std;
  */
 template<typename IntVector>
 inline void repack(IntVector& target, size_t new_width, size_t new_size); 
+
+/**
+ * Decode count consecutive entries of an int vector, beginning at start, into
+ * out. Specialized for SDSL int vectors to walk the packed words directly.
+ */
+template<typename IntVector>
+inline void unpack_range(const IntVector& source, size_t start, size_t count, uint64_t* out);
+
+/**
+ * Encode count consecutive values from in into an int vector, beginning at
+ * start. The int vector must already be wide enough to hold every value.
+ */
+template<typename IntVector>
+inline void pack_range(IntVector& target, size_t start, size_t count, const uint64_t* in);
+
+/**
+ * Hint that entry i of an int vector will be read soon. Does nothing except
+ * for SDSL int vectors, where the word holding the entry is prefetched.
+ */
+template<typename IntVector>
+inline void prefetch_entry(const IntVector& source, size_t i);
     
 /*
  * A dynamic integer vector that maintains integers in bit-compressed form.
@@ -88,6 +115,17 @@ public:
         
     /// Returns the i-th value
     inline uint64_t get(const size_t& i) const;
+    
+    /// Hint that the i-th value will be read soon
+    inline void prefetch(const size_t& i) const;
+    
+    /// Copy the count values beginning at start into out, which must have
+    /// room for count values. Faster than count separate calls to get().
+    inline void get_range(const size_t& start, const size_t& count, uint64_t* out) const;
+    
+    /// Set the count values beginning at start to the values in in. The bit
+    /// width is adjusted at most once for the whole range.
+    inline void set_range(const size_t& start, const size_t& count, const uint64_t* in);
         
     /// Add a value to the end
     inline void append(const uint64_t& value);
@@ -115,6 +153,22 @@ public:
     /// Clears the backing vector.
     inline void clear();
     
+    /// Returns the number of bits currently used to store each value.
+    inline size_t width() const;
+    
+    /// If necessary, widen the storage now so that values of up to the given
+    /// number of bits can be stored without repacking. Never narrows it.
+    inline void reserve_width(const size_t& bits);
+    
+    /// Replace the contents with the count values in in, packed in a single
+    /// pass at the narrowest width that holds them all.
+    inline void assign(const uint64_t* in, const size_t& count);
+    
+    /// Returns the packed bits of the count values beginning at start, with
+    /// the first value in the lowest bits. The values must fit in a single
+    /// word: count times width() can be at most 64.
+    inline uint64_t get_bits(const size_t& start, const size_t& count) const;
+    
     /// Reports the amount of memory consumed by this object in bytes.
     size_t memory_usage() const;
     
@@ -131,10 +185,91 @@ private:
     size_t filled = 0;
     // geometric expansion factor
     static const double factor;
+    // vectors with at least this many entries get headroom bits when widened
+    static const size_t headroom_min_size;
+    
+    /// Get the width to repack to when values need the given number of bits.
+    /// Long vectors are widened a little past what they need, so that steadily
+    /// growing values don't cost a full repack for every extra bit.
+    inline uint8_t grown_width(uint8_t needed) const;
 };
 
 using MappedPackedVector = PackedVector<MappedBackend>;
 
+/*
+ * Collects values to go in a PackedVector at full width, and packs them all at
+ * once when finalized, instead of repacking the vector each time a longer
+ * value comes in.
+ */
+template<typename Backend = STLBackend>
+class PackedVectorBuilder {
+public:
+    /// Add a value to the end
+    inline void append(const uint64_t& value);
+    
+    /// Expand capacity so that the given number of values can be appended
+    /// without reallocating.
+    inline void reserve(const size_t& future_size);
+    
+    /// Returns the number of values appended so far.
+    inline size_t size() const;
+    
+    /// Replace the contents of the given vector with the appended values, and
+    /// empty the builder.
+    inline void finalize(PackedVector<Backend>& into);
+    
+private:
+    vector<uint64_t> values;
+};
+
+/*
+ * Const iterator over a paged integer vector, forward or in reverse, that
+ * decodes a whole page at a time into a local buffer with get_range(), instead
+ * of finding and decoding the page again for each value. Can jump around like
+ * a random access iterator, but only decodes a new page when it leaves the
+ * current one. Invalidated by any change to the vector.
+ */
+template<typename Vector, size_t page_size, bool reverse>
+class PageDecodingIterator {
+public:
+    using iterator_category = std::bidirectional_iterator_tag;
+    using value_type = uint64_t;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const uint64_t*;
+    using reference = uint64_t;
+    
+    PageDecodingIterator() = default;
+    
+    /// Make an iterator at the given position. Positions run from 0 to the
+    /// vector's size, and in reverse, position i points to value i - 1.
+    PageDecodingIterator(const Vector& vec, size_t position) : vec(&vec), position(position) {
+        // Nothing to do
+    }
+    
+    /// Get the value pointed at
+    inline uint64_t operator*() const;
+    
+    inline PageDecodingIterator& operator++();
+    inline PageDecodingIterator operator++(int);
+    inline PageDecodingIterator& operator--();
+    inline PageDecodingIterator operator--(int);
+    inline PageDecodingIterator& operator+=(difference_type steps);
+    inline PageDecodingIterator& operator-=(difference_type steps);
+    inline PageDecodingIterator operator+(difference_type steps) const;
+    inline PageDecodingIterator operator-(difference_type steps) const;
+    inline difference_type operator-(const PageDecodingIterator& other) const;
+    
+    inline bool operator==(const PageDecodingIterator& other) const;
+    inline bool operator!=(const PageDecodingIterator& other) const;
+    
+private:
+    const Vector* vec = nullptr;
+    size_t position = 0;
+    // the page that is decoded in the buffer
+    mutable size_t buffered_page = std::numeric_limits<size_t>::max();
+    mutable uint64_t buffer[page_size];
+};
+
 /*
  * A dynamic integer vector that provides better compression when values in the
  * integer vector either 1) do not vary much from their neighbors or 2) are 0.
@@ -153,6 +288,9 @@ private:
 
 public:
     
+    using const_iterator = PageDecodingIterator<PagedVector, page_size, false>;
+    using const_reverse_iterator = PageDecodingIterator<PagedVector, page_size, true>;
+    
     /// Construct (starts empty) 
     PagedVector();
     
@@ -168,6 +306,18 @@ public:
     PagedVector(const PagedVector& other) = default;
     /// Copy assignment operator
     PagedVector& operator=(const PagedVector& other) = default;
+
+    // To allow copy across backends, we need to be friends with other
+    // instantiations of us.
+    template<size_t other_page_size, typename OtherBackend> friend class PagedVector;
+    
+    /// Allow copy constructing across backends
+    template<typename OtherBackend>
+    PagedVector(const PagedVector<page_size, OtherBackend>& other);
+    
+    /// Allow copy assignment across backends
+    template<typename OtherBackend>
+    PagedVector& operator=(const PagedVector<page_size, OtherBackend>& other);
     
     // Destructor
     ~PagedVector();
@@ -184,6 +334,30 @@ public:
     /// Returns the i-th value
     inline uint64_t get(const size_t& i) const;
     
+    /// Hint that the i-th value will be read soon
+    inline void prefetch(const size_t& i) const;
+    
+    /// Copy the count values beginning at start into out, which must have
+    /// room for count values. Decodes a page at a time.
+    inline void get_range(const size_t& start, const size_t& count, uint64_t* out) const;
+    
+    /// Set the count values beginning at start to the values in in. Encodes
+    /// a page at a time.
+    inline void set_range(const size_t& start, const size_t& count, const uint64_t* in);
+    
+    /// Call the iteratee with each value from begin up to but not including
+    /// end, in order, decoding a page at a time. The iteratee returns false to
+    /// stop, in which case this returns false.
+    template<typename Iteratee>
+    inline bool for_each_in_range(const size_t& begin, const size_t& end, Iteratee&& iteratee) const;
+    
+    /// Iterate over the values in order, decoding a page at a time
+    inline const_iterator begin() const;
+    inline const_iterator end() const;
+    /// Iterate over the values in reverse order, decoding a page at a time
+    inline const_reverse_iterator rbegin() const;
+    inline const_reverse_iterator rend() const;
+    
     /// Add a value to the end
     inline void append(const uint64_t& value);
     
@@ -244,6 +418,10 @@ private:
     using PackedVec = PackedVector<Backend>;
     using PagedVec = PagedVector<page_size, Backend>;
 public:
+    
+    using const_iterator = PageDecodingIterator<RobustPagedVector, page_size, false>;
+    using const_reverse_iterator = PageDecodingIterator<RobustPagedVector, page_size, true>;
+    
     /// Construct (starts empty)
     RobustPagedVector();
     
@@ -259,6 +437,18 @@ public:
     RobustPagedVector(const RobustPagedVector& other) = default;
     /// Copy assignment operator
     RobustPagedVector& operator=(const RobustPagedVector& other) = default;
+
+    // To allow copy across backends, we need to be friends with other
+    // instantiations of us.
+    template<size_t other_page_size, typename OtherBackend> friend class RobustPagedVector;
+    
+    /// Allow copy constructing across backends
+    template<typename OtherBackend>
+    RobustPagedVector(const RobustPagedVector<page_size, OtherBackend>& other);
+    
+    /// Allow copy assignment across backends
+    template<typename OtherBackend>
+    RobustPagedVector& operator=(const RobustPagedVector<page_size, OtherBackend>& other);
     
     // Destructor
     ~RobustPagedVector();
@@ -275,6 +465,27 @@ public:
     /// Returns the i-th value
     inline uint64_t get(const size_t& i) const;
     
+    /// Copy the count values beginning at start into out, which must have
+    /// room for count values. Decodes a page at a time.
+    inline void get_range(const size_t& start, const size_t& count, uint64_t* out) const;
+    
+    /// Set the count values beginning at start to the values in in. Encodes
+    /// a page at a time.
+    inline void set_range(const size_t& start, const size_t& count, const uint64_t* in);
+    
+    /// Call the iteratee with each value from begin up to but not including
+    /// end, in order, decoding a page at a time. The iteratee returns false to
+    /// stop, in which case this returns false.
+    template<typename Iteratee>
+    inline bool for_each_in_range(const size_t& begin, const size_t& end, Iteratee&& iteratee) const;
+    
+    /// Iterate over the values in order, decoding a page at a time
+    inline const_iterator begin() const;
+    inline const_iterator end() const;
+    /// Iterate over the values in reverse order, decoding a page at a time
+    inline const_reverse_iterator rbegin() const;
+    inline const_reverse_iterator rend() const;
+    
     /// Add a value to the end
     inline void append(const uint64_t& value);
     
@@ -342,6 +553,18 @@ public:
     PackedDeque(const PackedDeque& other) = default;
     /// Copy assignment operator
     PackedDeque& operator=(const PackedDeque& other) = default;
+
+    // To allow copy across backends, we need to be friends with other
+    // instantiations of us.
+    template<typename OtherBackend> friend class PackedDeque;
+    
+    /// Allow copy constructing across backends
+    template<typename OtherBackend>
+    PackedDeque(const PackedDeque<OtherBackend>& other);
+    
+    /// Allow copy assignment across backends
+    template<typename OtherBackend>
+    PackedDeque& operator=(const PackedDeque<OtherBackend>& other);
     
     /// Destructor
     ~PackedDeque(void);
@@ -400,7 +623,168 @@ private:
 };
 
 using MappedPackedDeque = PackedDeque<MappedBackend>;
+
+/*
+ * A deque of bit-compressed integers that is mostly 0, and that may have long
+ * runs of 0's. Values are stored in fixed-size blocks, found through a
+ * two-level directory of superblocks and blocks. Blocks that are all 0 are not
+ * stored, and neither are superblocks with no stored blocks, so a long run of
+ * 0's costs one directory entry per superblock. Access is O(1), through the
+ * directory. Runs of 0's can be added or removed at either end, and skipped
+ * over a superblock or block at a time.
+ */
+template<typename Backend = STLBackend>
+class SparsePackedDeque {
+private:
+    using PackedVec = PackedVector<Backend>;
+public:
+    /// Construct empty
+    SparsePackedDeque(void);
+    /// Construct from contents in a stream
+    SparsePackedDeque(istream& in);
+
+    /// Move constructor
+    SparsePackedDeque(SparsePackedDeque&& other) = default;
+    /// Move assignment operator
+    SparsePackedDeque& operator=(SparsePackedDeque&& other) = default;
+
+    /// Copy constructor
+    SparsePackedDeque(const SparsePackedDeque& other) = default;
+    /// Copy assignment operator
+    SparsePackedDeque& operator=(const SparsePackedDeque& other) = default;
+
+    // To allow copy across backends, we need to be friends with other
+    // instantiations of us.
+    template<typename OtherBackend> friend class SparsePackedDeque;
     
+    /// Allow copy constructing across backends
+    template<typename OtherBackend>
+    SparsePackedDeque(const SparsePackedDeque<OtherBackend>& other);
+    
+    /// Allow copy assignment across backends
+    template<typename OtherBackend>
+    SparsePackedDeque& operator=(const SparsePackedDeque<OtherBackend>& other);
+
+    /// Destructor
+    ~SparsePackedDeque(void);
+
+    /// Clear current contents and load from contents in a stream
+    void deserialize(istream& in);
+
+    /// Output contents to a stream
+    void serialize(ostream& out) const ;
+
+    /// Set the i-th value
+    inline void set(const size_t& i, const uint64_t& value);
+
+    /// Returns the i-th value
+    inline uint64_t get(const size_t& i) const;
+
+    /// Hint that the i-th value will be read soon. The directory is read to
+    /// find the value's block, and only the block is prefetched.
+    inline void prefetch(const size_t& i) const;
+
+    /// Returns the index of the first nonzero value at or after i, or size() if
+    /// there is none.
+    inline size_t next_nonzero(const size_t& i) const;
+
+    /// Returns the index of the first nonzero value at or after i and before
+    /// end, or end if there is none.
+    inline size_t next_nonzero(const size_t& i, const size_t& end) const;
+
+    /// Returns the index of the last nonzero value at or before i, or size() if
+    /// there is none.
+    inline size_t prev_nonzero(const size_t& i) const;
+
+    /// Add a value to the front
+    inline void append_front(const uint64_t& value);
+
+    /// Add a value to the back
+    inline void append_back(const uint64_t& value);
+
+    /// Add the given number of 0's to the front
+    inline void extend_front(const size_t& count);
+
+    /// Add the given number of 0's to the back
+    inline void extend_back(const size_t& count);
+
+    /// Remove the front value
+    inline void pop_front();
+
+    /// Remove the back value
+    inline void pop_back();
+
+    /// Remove the given number of values from the front
+    inline void drop_front(const size_t& count);
+
+    /// Remove the given number of values from the back
+    inline void drop_back(const size_t& count);
+
+    /// If necessary, expand the directory so that the given number of entries
+    /// can be included in the deque without reallocating it. Blocks are still
+    /// only allocated when a nonzero value is set in them.
+    inline void reserve(const size_t& future_size);
+
+    /// Rebuild the storage so that it only holds the blocks that have nonzero
+    /// values, in order, at the narrowest width that fits them.
+    inline void shrink_to_fit();
+
+    /// Returns the number of values
+    inline size_t size() const;
+
+    /// Returns true if there are no entries and false otherwise
+    inline bool empty() const;
+
+    /// Empty the contents
+    inline void clear();
+
+    /// Reports the amount of memory consumed by this object in bytes.
+    size_t memory_usage() const;
+
+private:
+
+    /// Get the 1-based slot in blocks of the block holding the given position,
+    /// or 0 if it isn't stored
+    inline uint64_t get_block_slot(const size_t& position) const;
+
+    /// Store a new all-0 block holding the given position, and return its
+    /// 1-based slot
+    inline uint64_t allocate_block(const size_t& position);
+
+    /// Stop storing the block holding the given position, which must be all 0
+    inline void release_block(const size_t& position);
+
+    /// The number of values in a block
+    static constexpr size_t block_size = 256;
+    /// The number of blocks in a superblock
+    static constexpr size_t superblock_blocks = 256;
+    /// The number of values in a superblock
+    static constexpr size_t superblock_size = block_size * superblock_blocks;
+
+    /// The 1-based slot in subdirectories of each superblock, or 0 if it has
+    /// no stored blocks
+    PackedDeque<Backend> directory;
+    /// The 1-based slot in blocks of each block of the stored superblocks, or
+    /// 0 if the block is all 0's, superblock_blocks per slot
+    PackedVec subdirectories;
+    /// The number of stored blocks in each subdirectory slot
+    PackedVec subdirectory_counts;
+    /// The 1-based subdirectory slots that have been freed and can be reused
+    PackedVec free_subdirectories;
+    /// The values of the stored blocks, block_size per slot
+    PackedVec blocks;
+    /// The number of nonzero values in each block slot
+    PackedVec block_counts;
+    /// The 1-based block slots that have been freed and can be reused
+    PackedVec free_blocks;
+
+    /// The offset of the first value in the first superblock
+    size_t begin_offset = 0;
+    size_t filled = 0;
+};
+
+using MappedSparsePackedDeque = SparsePackedDeque<MappedBackend>;
+
 /*
  * A hash set that maintains integers in bit-compressed form, with the bit
  * width automatically adjusted to the entries. It is designed to have the
@@ -535,87 +919,369 @@ private:
 };
 
 using MappedPackedSet = PackedSet<MappedBackend>;
-    
-/// Inline and template functions
 
-/////////////////////
-/// General
-/////////////////////
+/*
+ * A hash set of integers with the same interface as PackedSet, laid out like
+ * a Swiss table: slots come in groups of 16, and each slot has a control byte
+ * that marks it as empty, deleted, or full with 7 bits of the value's hash.
+ * Probes compare a whole group's control bytes at once (with SSE2 where it is
+ * available), and only decode the bit-packed values whose hash bits match, so
+ * lookups usually touch one or two groups and decode at most one value. The
+ * values are stored bit-compressed as differences from an anchor, as in
+ * PackedSet, at the cost of one extra byte per slot for the control bytes.
+ */
+template<typename Backend = STLBackend>
+class GroupedPackedSet {
+private:
+    using PackedVec = PackedVector<Backend>;
+    using ControlVec = typename VectorFor<Backend>::template type<uint8_t>;
+public:
 
-template<typename IntVector>
-inline void repack(IntVector& target, size_t new_width, size_t new_size) {
-    target.repack(new_width, new_size);
-}
+    /// Constructor
+    GroupedPackedSet();
+    /// Desctructor
+    ~GroupedPackedSet() = default;
 
-template<>
-inline void repack<sdsl::int_vector<>>(sdsl::int_vector<>& target, size_t new_width, size_t new_size) {
-    // We know we don't need to use a special allocator here.
-    sdsl::int_vector<> tmp;
-    tmp.width(new_width);
-    tmp.resize(new_size);
-    for (size_t i = 0; i < new_size && i < target.size(); i++) {
-        tmp[i] = target[i];
-    }
-    target = std::move(tmp);
-}
+    /// Move constructor
+    GroupedPackedSet(GroupedPackedSet&& other) = default;
+    /// Move assignment operator
+    GroupedPackedSet& operator=(GroupedPackedSet&& other) = default;
 
-    
-/////////////////////
-/// PackedVector
-/////////////////////
+    /// Copy constructor
+    GroupedPackedSet(const GroupedPackedSet& other) = default;
+    /// Copy assignment operator
+    GroupedPackedSet& operator=(const GroupedPackedSet& other) = default;
 
-template<typename Backend>
-const double PackedVector<Backend>::factor = 1.25;
+    /// Forward declaration
+    class iterator;
 
-template<typename Backend>
-inline void PackedVector<Backend>::set(const size_t& i, const uint64_t& value) {
-    assert(i < filled);
-        
-    uint8_t width = vec.width();
-    uint64_t mask = std::numeric_limits<uint64_t>::max() << width;
-    while (mask & value) {
-        width++;
-        mask = std::numeric_limits<uint64_t>::max() << width;
-    }
-        
-    if (width > vec.width()) {
-        repack(vec, width, vec.size());
-    }
-        
-    vec[i] = value;
-}
-    
-template<typename Backend>
-inline uint64_t PackedVector<Backend>::get(const size_t& i) const {
-    assert(i < filled);
-    return vec[i];
-}
+    /// Insert a value into the set. Has no effect if the value is already in the set.
+    inline void insert(const uint64_t& value);
 
-template<typename Backend>
-inline void PackedVector<Backend>::append(const uint64_t& value) {
-    resize(filled + 1);
-    set(filled - 1, value);
-}
+    /// Returns true if the value is in the set, else false.
+    inline bool find(const uint64_t& value) const;
 
-template<typename Backend>
-inline void PackedVector<Backend>::pop() {
-    resize(filled - 1);
-}
-    
-template<typename Backend>
-inline void PackedVector<Backend>::resize(const size_t& new_size) {
-    if (new_size < filled) {
-        size_t shrink_capacity = vec.size() / (factor * factor);
-        if (new_size < shrink_capacity) {
-            repack(vec, vec.width(), new_size);
-        }
-    }
-    else if (new_size > vec.size()) {
-        size_t old_capacity = vec.size();
-        size_t new_capacity = std::max<size_t>(size_t(vec.size() * factor) + 1, new_size);
-        reserve(new_capacity);
-        for (size_t i = old_capacity; i < vec.size(); i++) {
-            vec[i] = 0;
+    /// Remove a value into the set. Has no effect if the value is not in the set.
+    inline void remove(const uint64_t& value);
+
+    /// Make room for the given number of values without rehashing.
+    inline void reserve(const size_t& future_size);
+
+    /// Remove all the values
+    inline void clear();
+
+    /// Returns the number of values in the set
+    inline size_t size() const;
+
+    /// Returns the number of values in the set
+    inline bool empty() const;
+
+    /// Reports the amount of memory consumed by this object in bytes.
+    size_t memory_usage() const;
+
+    /// Iterator to the first item in the set
+    iterator begin() const;
+
+    /// Iterator to the past-the-last item in the set
+    iterator end() const;
+
+    /*
+     * An iterator class for the GroupedPackedSet
+     */
+    class iterator{
+    public:
+        iterator(const iterator& other) = default;
+        iterator() = delete;
+        ~iterator() = default;
+        iterator& operator=(const iterator& other) = default;
+        iterator& operator++();
+        uint64_t operator*() const;
+        bool operator==(const iterator& other) const;
+        bool operator!=(const iterator& other) const;
+
+    private:
+
+        iterator(const GroupedPackedSet* iteratee, size_t i);
+
+        const GroupedPackedSet* iteratee;
+
+        // the slot in the hash table
+        size_t i = 0;
+
+        friend class GroupedPackedSet;
+    };
+
+private:
+
+    /// The number of slots in a group
+    static constexpr size_t group_size = 16;
+    /// Control byte for a slot that has never been filled
+    static constexpr uint8_t empty_slot = 0x80;
+    /// Control byte for a slot whose value was removed
+    static constexpr uint8_t deleted_slot = 0xFE;
+
+    /// Hash a value. The low 7 bits go in the control byte, and the rest
+    /// choose the first group to probe.
+    inline static uint64_t hash(const uint64_t& value);
+
+    /// Get a mask of the slots in a group whose control bytes are the given byte
+    inline static uint32_t match_byte(const uint8_t* group, uint8_t byte);
+
+    /// Get a mask of the slots in a group that are empty or deleted
+    inline static uint32_t match_free(const uint8_t* group);
+
+    /// Return the slot holding the value, or the number of slots if it's absent
+    inline size_t locate(const uint64_t& value) const;
+
+    /// Put a value that isn't in the set into the first free slot of its probe
+    /// sequence, without checking the load
+    inline void place(const uint64_t& value);
+
+    /// Move to a table with the given number of groups, which must be a power
+    /// of 2, and re-anchor the values
+    void rehash(size_t new_num_groups);
+
+    /// Get the smallest power of 2 number of groups that can hold the given
+    /// number of values at no more than half the max load
+    inline static size_t groups_for(size_t count);
+
+    /// Convert a value to a difference from an anchor
+    inline static uint64_t to_diff(const uint64_t& value, const uint64_t& _anchor);
+
+    /// Convert a difference from an anchor to a value
+    inline static uint64_t from_diff(const uint64_t& diff, const uint64_t& _anchor);
+
+    /// One control byte per slot
+    ControlVec control;
+
+    /// The encoded value in each full slot
+    PackedVec slots;
+
+    /// The value that differences are taken from
+    uint64_t anchor = 0;
+
+    /// The number of groups minus 1
+    size_t group_mask = 0;
+
+    /// Number of items in the set
+    size_t num_items = 0;
+
+    /// Number of deleted slots, which still count against the load
+    size_t num_deleted = 0;
+
+    /// Let the iterator access the internals
+    friend class iterator;
+};
+
+using MappedGroupedPackedSet = GroupedPackedSet<MappedBackend>;
+
+/// Inline and template functions
+
+/////////////////////
+/// General
+/////////////////////
+
+template<typename IntVector>
+inline void repack(IntVector& target, size_t new_width, size_t new_size) {
+    target.repack(new_width, new_size);
+}
+
+template<>
+inline void repack<sdsl::int_vector<>>(sdsl::int_vector<>& target, size_t new_width, size_t new_size) {
+    // We know we don't need to use a special allocator here.
+    sdsl::int_vector<> tmp;
+    tmp.width(new_width);
+    tmp.resize(new_size);
+    for (size_t i = 0; i < new_size && i < target.size(); i++) {
+        tmp[i] = target[i];
+    }
+    target = std::move(tmp);
+}
+
+/// Copy an int vector into one of a different type, which it can usually just
+/// be assigned to.
+template<typename IntVector, typename OtherIntVector>
+inline void copy_int_vector(IntVector& target, const OtherIntVector& source) {
+    target = source;
+}
+
+inline void copy_int_vector(sdsl::int_vector<>& target, const sdsl::int_vector<>& source) {
+    target = source;
+}
+
+/// SDSL int vectors can't be assigned from other types, so copy the packed
+/// bits over a word at a time.
+template<typename OtherIntVector>
+inline void copy_int_vector(sdsl::int_vector<>& target, const OtherIntVector& source) {
+    target = sdsl::int_vector<>(source.size(), 0, std::max<size_t>(source.width(), 1));
+    size_t bits = source.size() * source.width();
+    for (size_t i = 0; i < bits; i += 64) {
+        size_t len = std::min<size_t>(64, bits - i);
+        target.set_int(i, source.get_int(i, len), len);
+    }
+}
+
+template<typename IntVector>
+inline void unpack_range(const IntVector& source, size_t start, size_t count, uint64_t* out) {
+    for (size_t i = 0; i < count; i++) {
+        out[i] = source[start + i];
+    }
+}
+
+template<>
+inline void unpack_range<sdsl::int_vector<>>(const sdsl::int_vector<>& source, size_t start, size_t count,
+                                             uint64_t* out) {
+    if (count == 0) {
+        return;
+    }
+    // walk the packed words directly instead of recomputing the position of
+    // each entry from scratch
+    uint8_t width = source.width();
+    size_t bit_idx = start * width;
+    const uint64_t* word = source.data() + (bit_idx >> 6);
+    uint8_t offset = bit_idx & 0x3F;
+    for (size_t i = 0; i < count; i++) {
+        out[i] = sdsl::bits::read_int_and_move(word, offset, width);
+    }
+}
+
+template<typename IntVector>
+inline void prefetch_entry(const IntVector& source, size_t i) {
+    // no way to get at the memory in general
+}
+
+template<>
+inline void prefetch_entry<sdsl::int_vector<>>(const sdsl::int_vector<>& source, size_t i) {
+#if defined(__GNUC__) || defined(__clang__)
+    __builtin_prefetch(source.data() + ((i * source.width()) >> 6));
+#endif
+}
+
+template<typename IntVector>
+inline void pack_range(IntVector& target, size_t start, size_t count, const uint64_t* in) {
+    for (size_t i = 0; i < count; i++) {
+        target[start + i] = in[i];
+    }
+}
+
+template<>
+inline void pack_range<sdsl::int_vector<>>(sdsl::int_vector<>& target, size_t start, size_t count,
+                                           const uint64_t* in) {
+    if (count == 0) {
+        return;
+    }
+    uint8_t width = target.width();
+    size_t bit_idx = start * width;
+    uint64_t* word = target.data() + (bit_idx >> 6);
+    uint8_t offset = bit_idx & 0x3F;
+    for (size_t i = 0; i < count; i++) {
+        sdsl::bits::write_int_and_move(word, in[i], offset, width);
+    }
+}
+
+    
+/////////////////////
+/// PackedVector
+/////////////////////
+
+template<typename Backend>
+const double PackedVector<Backend>::factor = 1.25;
+
+template<typename Backend>
+const size_t PackedVector<Backend>::headroom_min_size = 1 << 16;
+
+template<typename Backend>
+inline uint8_t PackedVector<Backend>::grown_width(uint8_t needed) const {
+    if (vec.size() < headroom_min_size) {
+        return needed;
+    }
+    // an eighth more bits, so narrow vectors like sequences don't get any
+    return std::min<uint8_t>(needed + needed / 8, std::numeric_limits<uint64_t>::digits);
+}
+
+template<typename Backend>
+inline void PackedVector<Backend>::set(const size_t& i, const uint64_t& value) {
+    assert(i < filled);
+        
+    uint8_t width = vec.width();
+    uint64_t mask = std::numeric_limits<uint64_t>::max() << width;
+    while (width < std::numeric_limits<uint64_t>::digits && (mask & value)) {
+        width++;
+        mask = std::numeric_limits<uint64_t>::max() << width;
+    }
+        
+    if (width > vec.width()) {
+        repack(vec, grown_width(width), vec.size());
+    }
+        
+    vec[i] = value;
+}
+    
+template<typename Backend>
+inline uint64_t PackedVector<Backend>::get(const size_t& i) const {
+    assert(i < filled);
+    return vec[i];
+}
+
+template<typename Backend>
+inline void PackedVector<Backend>::prefetch(const size_t& i) const {
+    prefetch_entry(vec, i);
+}
+
+template<typename Backend>
+inline void PackedVector<Backend>::get_range(const size_t& start, const size_t& count, uint64_t* out) const {
+    assert(start + count <= filled);
+    unpack_range(vec, start, count, out);
+}
+
+template<typename Backend>
+inline void PackedVector<Backend>::set_range(const size_t& start, const size_t& count, const uint64_t* in) {
+    assert(start + count <= filled);
+    
+    // find the width we need for the whole range up front
+    uint64_t all_bits = 0;
+    for (size_t i = 0; i < count; i++) {
+        all_bits |= in[i];
+    }
+    uint8_t width = vec.width();
+    uint64_t mask = std::numeric_limits<uint64_t>::max() << width;
+    while (width < std::numeric_limits<uint64_t>::digits && (mask & all_bits)) {
+        width++;
+        mask = std::numeric_limits<uint64_t>::max() << width;
+    }
+    
+    if (width > vec.width()) {
+        repack(vec, grown_width(width), vec.size());
+    }
+    
+    pack_range(vec, start, count, in);
+}
+
+template<typename Backend>
+inline void PackedVector<Backend>::append(const uint64_t& value) {
+    resize(filled + 1);
+    set(filled - 1, value);
+}
+
+template<typename Backend>
+inline void PackedVector<Backend>::pop() {
+    resize(filled - 1);
+}
+    
+template<typename Backend>
+inline void PackedVector<Backend>::resize(const size_t& new_size) {
+    if (new_size < filled) {
+        size_t shrink_capacity = vec.size() / (factor * factor);
+        if (new_size < shrink_capacity) {
+            repack(vec, vec.width(), new_size);
+        }
+    }
+    else if (new_size > vec.size()) {
+        size_t old_capacity = vec.size();
+        size_t new_capacity = std::max<size_t>(size_t(vec.size() * factor) + 1, new_size);
+        reserve(new_capacity);
+        for (size_t i = old_capacity; i < vec.size(); i++) {
+            vec[i] = 0;
         }
     }
     filled = new_size;
@@ -643,6 +1309,50 @@ inline bool PackedVector<Backend>::empty() const {
     return filled == 0;
 }
 
+template<typename Backend>
+inline size_t PackedVector<Backend>::width() const {
+    return vec.width();
+}
+
+template<typename Backend>
+inline void PackedVector<Backend>::reserve_width(const size_t& bits) {
+    size_t width = std::min<size_t>(bits, std::numeric_limits<uint64_t>::digits);
+    if (width > vec.width()) {
+        repack(vec, width, vec.size());
+    }
+}
+
+template<typename Backend>
+inline void PackedVector<Backend>::assign(const uint64_t* in, const size_t& count) {
+    uint64_t all_bits = 0;
+    for (size_t i = 0; i < count; i++) {
+        all_bits |= in[i];
+    }
+    uint8_t width = 1;
+    uint64_t mask = std::numeric_limits<uint64_t>::max() << width;
+    while (width < std::numeric_limits<uint64_t>::digits && (mask & all_bits)) {
+        width++;
+        mask = std::numeric_limits<uint64_t>::max() << width;
+    }
+    
+    // start over at the new width, so nothing needs to be repacked
+    vec.resize(0);
+    vec.width(width);
+    vec.resize(count);
+    pack_range(vec, 0, count, in);
+    filled = count;
+}
+
+template<typename Backend>
+inline uint64_t PackedVector<Backend>::get_bits(const size_t& start, const size_t& count) const {
+    assert(start + count <= filled);
+    assert(count * vec.width() <= 64);
+    if (count == 0) {
+        return 0;
+    }
+    return vec.get_int(start * vec.width(), count * vec.width());
+}
+
 template<typename Backend>
 inline void PackedVector<Backend>::clear() {
     vec.resize(0);
@@ -681,16 +1391,16 @@ PackedVector<Backend>::~PackedVector() {
 
 template<typename Backend>
 template<typename OtherBackend>
-PackedVector<Backend>::PackedVector(const PackedVector<OtherBackend>& other) : vec(other.vec), filled(other.filled) {
-    // Nothing to do because members' constructors did all the work.
+PackedVector<Backend>::PackedVector(const PackedVector<OtherBackend>& other) : filled(other.filled) {
+    copy_int_vector(vec, other.vec);
 }
 
 template<typename Backend>
 template<typename OtherBackend>
 auto PackedVector<Backend>::operator=(const PackedVector<OtherBackend>& other) -> PackedVector& {
-    // Assign all the fields with their cross-type assignment operators.
+    // Assign all the fields across types.
     filled = other.filled;
-    vec = other.vec;
+    copy_int_vector(vec, other.vec);
     
     return *this;
 }
@@ -709,8 +1419,39 @@ void PackedVector<Backend>::serialize(ostream& out) const {
 
 template<typename Backend>
 size_t PackedVector<Backend>::memory_usage() const {
-    // sdsl vectors return the number of bits, but we want bytes
-    return sizeof(filled) + sizeof(vec) + vec.capacity() / 8;
+    // sdsl vectors return the number of bits, but we want bytes, and the
+    // compatible int vectors return the number of items
+    size_t capacity_bits = vec.capacity();
+    if (!std::is_same<typename IntVectorFor<Backend>::type, sdsl::int_vector<>>::value) {
+        capacity_bits *= vec.width();
+    }
+    return sizeof(filled) + sizeof(vec) + capacity_bits / 8;
+}
+
+/////////////////////
+/// PackedVectorBuilder
+/////////////////////
+
+template<typename Backend>
+inline void PackedVectorBuilder<Backend>::append(const uint64_t& value) {
+    values.push_back(value);
+}
+
+template<typename Backend>
+inline void PackedVectorBuilder<Backend>::reserve(const size_t& future_size) {
+    values.reserve(future_size);
+}
+
+template<typename Backend>
+inline size_t PackedVectorBuilder<Backend>::size() const {
+    return values.size();
+}
+
+template<typename Backend>
+inline void PackedVectorBuilder<Backend>::finalize(PackedVector<Backend>& into) {
+    into.assign(values.data(), values.size());
+    values.clear();
+    values.shrink_to_fit();
 }
 
 /////////////////////
@@ -727,6 +1468,22 @@ PackedDeque<Backend>::PackedDeque(istream& in) {
     deserialize(in);
 }
 
+template<typename Backend>
+template<typename OtherBackend>
+PackedDeque<Backend>::PackedDeque(const PackedDeque<OtherBackend>& other) :
+    vec(other.vec), begin_idx(other.begin_idx), filled(other.filled) {
+    // Nothing to do because members' constructors did all the work.
+}
+
+template<typename Backend>
+template<typename OtherBackend>
+auto PackedDeque<Backend>::operator=(const PackedDeque<OtherBackend>& other) -> PackedDeque& {
+    vec = other.vec;
+    begin_idx = other.begin_idx;
+    filled = other.filled;
+    return *this;
+}
+
 template<typename Backend>
 PackedDeque<Backend>::~PackedDeque() {
     
@@ -833,46 +1590,489 @@ inline void PackedDeque<Backend>::contract() {
     }
 }
 
-template<typename Backend>
-inline void PackedDeque<Backend>::pop_front() {
-    // update the pointer to the beginning
-    begin_idx++;
-    if (begin_idx == vec.size()) {
-        begin_idx = 0;
-    }
-    // update the pointer to the end
-    filled--;
-    
-    // shrink if necessary
-    contract();
+template<typename Backend>
+inline void PackedDeque<Backend>::pop_front() {
+    // update the pointer to the beginning
+    begin_idx++;
+    if (begin_idx == vec.size()) {
+        begin_idx = 0;
+    }
+    // update the pointer to the end
+    filled--;
+    
+    // shrink if necessary
+    contract();
+}
+
+template<typename Backend>
+inline void PackedDeque<Backend>::pop_back() {
+    // update the pointer to the end
+    filled--;
+    
+    // shrink if necessary
+    contract();
+}
+
+template<typename Backend>
+inline size_t PackedDeque<Backend>::size() const {
+    return filled;
+}
+
+template<typename Backend>
+inline bool PackedDeque<Backend>::empty() const {
+    return filled == 0;
+}
+ 
+template<typename Backend>
+inline void PackedDeque<Backend>::clear() {
+    vec.clear();
+    filled = 0;
+    begin_idx = 0;
+}
+
+/////////////////////
+/// SparsePackedDeque
+/////////////////////
+
+template<typename Backend>
+SparsePackedDeque<Backend>::SparsePackedDeque() {
+
+}
+
+template<typename Backend>
+SparsePackedDeque<Backend>::SparsePackedDeque(istream& in) {
+    deserialize(in);
+}
+
+template<typename Backend>
+template<typename OtherBackend>
+SparsePackedDeque<Backend>::SparsePackedDeque(const SparsePackedDeque<OtherBackend>& other) {
+    *this = other;
+}
+
+template<typename Backend>
+template<typename OtherBackend>
+auto SparsePackedDeque<Backend>::operator=(const SparsePackedDeque<OtherBackend>& other) -> SparsePackedDeque& {
+    directory = other.directory;
+    subdirectories = other.subdirectories;
+    subdirectory_counts = other.subdirectory_counts;
+    free_subdirectories = other.free_subdirectories;
+    blocks = other.blocks;
+    block_counts = other.block_counts;
+    free_blocks = other.free_blocks;
+    begin_offset = other.begin_offset;
+    filled = other.filled;
+    return *this;
+}
+
+template<typename Backend>
+SparsePackedDeque<Backend>::~SparsePackedDeque() {
+
+}
+
+template<typename Backend>
+void SparsePackedDeque<Backend>::deserialize(istream& in) {
+    sdsl::read_member(begin_offset, in);
+    sdsl::read_member(filled, in);
+    directory.deserialize(in);
+    subdirectories.deserialize(in);
+    subdirectory_counts.deserialize(in);
+    free_subdirectories.deserialize(in);
+    blocks.deserialize(in);
+    block_counts.deserialize(in);
+    free_blocks.deserialize(in);
+}
+
+template<typename Backend>
+void SparsePackedDeque<Backend>::serialize(ostream& out) const  {
+    sdsl::write_member(begin_offset, out);
+    sdsl::write_member(filled, out);
+    directory.serialize(out);
+    subdirectories.serialize(out);
+    subdirectory_counts.serialize(out);
+    free_subdirectories.serialize(out);
+    blocks.serialize(out);
+    block_counts.serialize(out);
+    free_blocks.serialize(out);
+}
+
+template<typename Backend>
+size_t SparsePackedDeque<Backend>::memory_usage() const {
+    return sizeof(begin_offset) + sizeof(filled) + directory.memory_usage()
+        + subdirectories.memory_usage() + subdirectory_counts.memory_usage() + free_subdirectories.memory_usage()
+        + blocks.memory_usage() + block_counts.memory_usage() + free_blocks.memory_usage();
+}
+
+template<typename Backend>
+inline uint64_t SparsePackedDeque<Backend>::get_block_slot(const size_t& position) const {
+    uint64_t subdirectory = directory.get(position / superblock_size);
+    if (subdirectory == 0) {
+        return 0;
+    }
+    return subdirectories.get((subdirectory - 1) * superblock_blocks + (position / block_size) % superblock_blocks);
+}
+
+template<typename Backend>
+inline uint64_t SparsePackedDeque<Backend>::allocate_block(const size_t& position) {
+    // freed slots are always left all 0
+    size_t superblock = position / superblock_size;
+    uint64_t subdirectory = directory.get(superblock);
+    if (subdirectory == 0) {
+        if (!free_subdirectories.empty()) {
+            subdirectory = free_subdirectories.get(free_subdirectories.size() - 1);
+            free_subdirectories.pop();
+        }
+        else {
+            subdirectory_counts.append(0);
+            subdirectory = subdirectory_counts.size();
+            subdirectories.resize(subdirectories.size() + superblock_blocks);
+        }
+        directory.set(superblock, subdirectory);
+    }
+    subdirectory_counts.set(subdirectory - 1, subdirectory_counts.get(subdirectory - 1) + 1);
+    
+    uint64_t slot;
+    if (!free_blocks.empty()) {
+        slot = free_blocks.get(free_blocks.size() - 1);
+        free_blocks.pop();
+    }
+    else {
+        block_counts.append(0);
+        slot = block_counts.size();
+        blocks.resize(blocks.size() + block_size);
+    }
+    subdirectories.set((subdirectory - 1) * superblock_blocks + (position / block_size) % superblock_blocks, slot);
+    return slot;
+}
+
+template<typename Backend>
+inline void SparsePackedDeque<Backend>::release_block(const size_t& position) {
+    size_t superblock = position / superblock_size;
+    uint64_t subdirectory = directory.get(superblock);
+    size_t entry = (subdirectory - 1) * superblock_blocks + (position / block_size) % superblock_blocks;
+    free_blocks.append(subdirectories.get(entry));
+    subdirectories.set(entry, 0);
+    
+    uint64_t count = subdirectory_counts.get(subdirectory - 1) - 1;
+    subdirectory_counts.set(subdirectory - 1, count);
+    if (count == 0) {
+        directory.set(superblock, 0);
+        free_subdirectories.append(subdirectory);
+    }
+}
+
+template<typename Backend>
+inline void SparsePackedDeque<Backend>::set(const size_t& i, const uint64_t& value) {
+    assert(i < filled);
+    size_t position = begin_offset + i;
+    uint64_t slot = get_block_slot(position);
+    if (slot == 0) {
+        if (value == 0) {
+            return;
+        }
+        slot = allocate_block(position);
+    }
+    size_t idx = (slot - 1) * block_size + position % block_size;
+    uint64_t prev_value = blocks.get(idx);
+    blocks.set(idx, value);
+    if (prev_value == 0 && value != 0) {
+        block_counts.set(slot - 1, block_counts.get(slot - 1) + 1);
+    }
+    else if (prev_value != 0 && value == 0) {
+        uint64_t count = block_counts.get(slot - 1) - 1;
+        block_counts.set(slot - 1, count);
+        if (count == 0) {
+            // the block is all 0's again, so we don't need to store it
+            release_block(position);
+        }
+    }
+}
+
+template<typename Backend>
+inline uint64_t SparsePackedDeque<Backend>::get(const size_t& i) const {
+    assert(i < filled);
+    size_t position = begin_offset + i;
+    uint64_t slot = get_block_slot(position);
+    return slot ? blocks.get((slot - 1) * block_size + position % block_size) : 0;
+}
+
+template<typename Backend>
+inline void SparsePackedDeque<Backend>::prefetch(const size_t& i) const {
+    size_t position = begin_offset + i;
+    uint64_t slot = get_block_slot(position);
+    if (slot) {
+        blocks.prefetch((slot - 1) * block_size + position % block_size);
+    }
+}
+
+template<typename Backend>
+inline size_t SparsePackedDeque<Backend>::next_nonzero(const size_t& i) const {
+    return next_nonzero(i, filled);
+}
+
+template<typename Backend>
+inline size_t SparsePackedDeque<Backend>::next_nonzero(const size_t& i, const size_t& end_idx) const {
+    size_t position = begin_offset + i;
+    size_t end = begin_offset + std::min(end_idx, filled);
+    while (position < end) {
+        if (directory.get(position / superblock_size) == 0) {
+            // skip the whole superblock
+            position = (position / superblock_size + 1) * superblock_size;
+            continue;
+        }
+        size_t block_end = (position / block_size + 1) * block_size;
+        uint64_t slot = get_block_slot(position);
+        if (slot) {
+            if (block_end > end) {
+                block_end = end;
+            }
+            size_t slot_begin = (slot - 1) * block_size - (position / block_size) * block_size;
+            for (; position < block_end; ++position) {
+                if (blocks.get(slot_begin + position)) {
+                    return position - begin_offset;
+                }
+            }
+        }
+        position = block_end;
+    }
+    return end_idx;
+}
+
+template<typename Backend>
+inline size_t SparsePackedDeque<Backend>::prev_nonzero(const size_t& i) const {
+    if (i >= filled) {
+        return filled;
+    }
+    // one past the position we're looking at
+    size_t position = begin_offset + i + 1;
+    while (position > begin_offset) {
+        if (directory.get((position - 1) / superblock_size) == 0) {
+            // skip the whole superblock
+            position = ((position - 1) / superblock_size) * superblock_size;
+            continue;
+        }
+        size_t block = (position - 1) / block_size;
+        size_t block_begin = block * block_size;
+        if (block_begin < begin_offset) {
+            block_begin = begin_offset;
+        }
+        uint64_t slot = get_block_slot(position - 1);
+        if (slot) {
+            size_t slot_begin = (slot - 1) * block_size - block * block_size;
+            for (; position > block_begin; --position) {
+                if (blocks.get(slot_begin + position - 1)) {
+                    return position - 1 - begin_offset;
+                }
+            }
+        }
+        position = block_begin;
+    }
+    return filled;
+}
+
+template<typename Backend>
+inline void SparsePackedDeque<Backend>::reserve(const size_t& future_size) {
+    directory.reserve(future_size / superblock_size + 2);
+}
+
+template<typename Backend>
+inline void SparsePackedDeque<Backend>::append_front(const uint64_t& value) {
+    extend_front(1);
+    set(0, value);
+}
+
+template<typename Backend>
+inline void SparsePackedDeque<Backend>::append_back(const uint64_t& value) {
+    extend_back(1);
+    set(filled - 1, value);
+}
+
+template<typename Backend>
+inline void SparsePackedDeque<Backend>::extend_front(const size_t& count) {
+    if (count > begin_offset) {
+        // add directory entries for the new superblocks, which are all 0's
+        size_t new_superblocks = (count - begin_offset + superblock_size - 1) / superblock_size;
+        for (size_t i = 0; i < new_superblocks; ++i) {
+            directory.append_front(0);
+        }
+        begin_offset += new_superblocks * superblock_size;
+    }
+    begin_offset -= count;
+    filled += count;
+}
+
+template<typename Backend>
+inline void SparsePackedDeque<Backend>::extend_back(const size_t& count) {
+    filled += count;
+    size_t num_superblocks = (begin_offset + filled + superblock_size - 1) / superblock_size;
+    while (directory.size() < num_superblocks) {
+        directory.append_back(0);
+    }
+}
+
+template<typename Backend>
+inline void SparsePackedDeque<Backend>::pop_front() {
+    drop_front(1);
+}
+
+template<typename Backend>
+inline void SparsePackedDeque<Backend>::pop_back() {
+    drop_back(1);
+}
+
+template<typename Backend>
+inline void SparsePackedDeque<Backend>::drop_front(const size_t& count) {
+    assert(count <= filled);
+    // zero out the values so that their blocks get freed
+    for (size_t i = next_nonzero(0); i < count; i = next_nonzero(i + 1)) {
+        set(i, 0);
+    }
+    begin_offset += count;
+    filled -= count;
+    if (filled == 0) {
+        clear();
+        return;
+    }
+    while (begin_offset >= superblock_size) {
+        directory.pop_front();
+        begin_offset -= superblock_size;
+    }
+}
+
+template<typename Backend>
+inline void SparsePackedDeque<Backend>::drop_back(const size_t& count) {
+    assert(count <= filled);
+    // zero out the values so that their blocks get freed
+    for (size_t i = next_nonzero(filled - count); i < filled; i = next_nonzero(i + 1)) {
+        set(i, 0);
+    }
+    filled -= count;
+    if (filled == 0) {
+        clear();
+        return;
+    }
+    size_t num_superblocks = (begin_offset + filled + superblock_size - 1) / superblock_size;
+    while (directory.size() > num_superblocks) {
+        directory.pop_back();
+    }
+}
+
+template<typename Backend>
+inline void SparsePackedDeque<Backend>::shrink_to_fit() {
+    SparsePackedDeque<Backend> rebuilt;
+    rebuilt.reserve(filled);
+    rebuilt.subdirectories.reserve((subdirectory_counts.size() - free_subdirectories.size()) * superblock_blocks);
+    rebuilt.blocks.reserve((block_counts.size() - free_blocks.size()) * block_size);
+    rebuilt.extend_back(filled);
+    for (size_t i = next_nonzero(0); i < filled; i = next_nonzero(i + 1)) {
+        rebuilt.set(i, get(i));
+    }
+    *this = std::move(rebuilt);
+}
+
+template<typename Backend>
+inline size_t SparsePackedDeque<Backend>::size() const {
+    return filled;
+}
+
+template<typename Backend>
+inline bool SparsePackedDeque<Backend>::empty() const {
+    return filled == 0;
+}
+
+template<typename Backend>
+inline void SparsePackedDeque<Backend>::clear() {
+    directory.clear();
+    subdirectories.clear();
+    subdirectory_counts.clear();
+    free_subdirectories.clear();
+    blocks.clear();
+    block_counts.clear();
+    free_blocks.clear();
+    filled = 0;
+    begin_offset = 0;
+}
+
+/////////////////////
+/// PageDecodingIterator
+/////////////////////
+
+template<typename Vector, size_t page_size, bool reverse>
+inline uint64_t PageDecodingIterator<Vector, page_size, reverse>::operator*() const {
+    size_t i = reverse ? position - 1 : position;
+    size_t page = i / page_size;
+    if (page != buffered_page) {
+        size_t page_begin = page * page_size;
+        vec->get_range(page_begin, std::min(page_size, vec->size() - page_begin), buffer);
+        buffered_page = page;
+    }
+    return buffer[i % page_size];
+}
+
+template<typename Vector, size_t page_size, bool reverse>
+inline auto PageDecodingIterator<Vector, page_size, reverse>::operator++() -> PageDecodingIterator& {
+    return *this += 1;
+}
+
+template<typename Vector, size_t page_size, bool reverse>
+inline auto PageDecodingIterator<Vector, page_size, reverse>::operator++(int) -> PageDecodingIterator {
+    PageDecodingIterator copy = *this;
+    *this += 1;
+    return copy;
+}
+
+template<typename Vector, size_t page_size, bool reverse>
+inline auto PageDecodingIterator<Vector, page_size, reverse>::operator--() -> PageDecodingIterator& {
+    return *this -= 1;
+}
+
+template<typename Vector, size_t page_size, bool reverse>
+inline auto PageDecodingIterator<Vector, page_size, reverse>::operator--(int) -> PageDecodingIterator {
+    PageDecodingIterator copy = *this;
+    *this -= 1;
+    return copy;
+}
+
+template<typename Vector, size_t page_size, bool reverse>
+inline auto PageDecodingIterator<Vector, page_size, reverse>::operator+=(difference_type steps) -> PageDecodingIterator& {
+    position += reverse ? -steps : steps;
+    return *this;
+}
+
+template<typename Vector, size_t page_size, bool reverse>
+inline auto PageDecodingIterator<Vector, page_size, reverse>::operator-=(difference_type steps) -> PageDecodingIterator& {
+    return *this += -steps;
 }
 
-template<typename Backend>
-inline void PackedDeque<Backend>::pop_back() {
-    // update the pointer to the end
-    filled--;
-    
-    // shrink if necessary
-    contract();
+template<typename Vector, size_t page_size, bool reverse>
+inline auto PageDecodingIterator<Vector, page_size, reverse>::operator+(difference_type steps) const -> PageDecodingIterator {
+    PageDecodingIterator moved = *this;
+    moved += steps;
+    return moved;
 }
 
-template<typename Backend>
-inline size_t PackedDeque<Backend>::size() const {
-    return filled;
+template<typename Vector, size_t page_size, bool reverse>
+inline auto PageDecodingIterator<Vector, page_size, reverse>::operator-(difference_type steps) const -> PageDecodingIterator {
+    PageDecodingIterator moved = *this;
+    moved -= steps;
+    return moved;
 }
 
-template<typename Backend>
-inline bool PackedDeque<Backend>::empty() const {
-    return filled == 0;
+template<typename Vector, size_t page_size, bool reverse>
+inline auto PageDecodingIterator<Vector, page_size, reverse>::operator-(const PageDecodingIterator& other) const -> difference_type {
+    return reverse ? difference_type(other.position - position) : difference_type(position - other.position);
 }
- 
-template<typename Backend>
-inline void PackedDeque<Backend>::clear() {
-    vec.clear();
-    filled = 0;
-    begin_idx = 0;
+
+template<typename Vector, size_t page_size, bool reverse>
+inline bool PageDecodingIterator<Vector, page_size, reverse>::operator==(const PageDecodingIterator& other) const {
+    return vec == other.vec && position == other.position;
 }
-    
+
+template<typename Vector, size_t page_size, bool reverse>
+inline bool PageDecodingIterator<Vector, page_size, reverse>::operator!=(const PageDecodingIterator& other) const {
+    return !(*this == other);
+}
+
 /////////////////////
 /// PagedVector
 /////////////////////
@@ -882,6 +2082,27 @@ PagedVector<page_size, Backend>::PagedVector() {
     
 }
 
+template<size_t page_size, typename Backend>
+template<typename OtherBackend>
+PagedVector<page_size, Backend>::PagedVector(const PagedVector<page_size, OtherBackend>& other) {
+    *this = other;
+}
+
+template<size_t page_size, typename Backend>
+template<typename OtherBackend>
+auto PagedVector<page_size, Backend>::operator=(const PagedVector<page_size, OtherBackend>& other) -> PagedVector& {
+    filled = other.filled;
+    anchors = other.anchors;
+    // the page holders are different types, so copy the pages one at a time
+    // into pages made in place
+    pages.clear();
+    pages.resize(other.pages.size());
+    for (size_t i = 0; i < other.pages.size(); ++i) {
+        pages[i] = other.pages[i];
+    }
+    return *this;
+}
+
 template<size_t page_size, typename Backend>
 PagedVector<page_size, Backend>::PagedVector(istream& in) {
     deserialize(in);
@@ -950,6 +2171,105 @@ inline uint64_t PagedVector<page_size, Backend>::get(const size_t& i) const {
                      anchors.get(i / page_size));
 }
 
+template<size_t page_size, typename Backend>
+inline void PagedVector<page_size, Backend>::prefetch(const size_t& i) const {
+    pages[i / page_size].prefetch(i % page_size);
+    anchors.prefetch(i / page_size);
+}
+
+template<size_t page_size, typename Backend>
+inline void PagedVector<page_size, Backend>::get_range(const size_t& start, const size_t& count,
+                                                       uint64_t* out) const {
+    assert(start + count <= filled);
+    size_t i = start, end = start + count;
+    while (i < end) {
+        // decode the part of the range that falls on this page
+        size_t page_idx = i / page_size;
+        size_t page_begin = i % page_size;
+        size_t page_count = std::min(end - i, page_size - page_begin);
+        pages[page_idx].get_range(page_begin, page_count, out);
+        
+        uint64_t anchor = anchors.get(page_idx);
+        for (size_t j = 0; j < page_count; j++) {
+            out[j] = from_diff(out[j], anchor);
+        }
+        
+        out += page_count;
+        i += page_count;
+    }
+}
+
+template<size_t page_size, typename Backend>
+template<typename Iteratee>
+inline bool PagedVector<page_size, Backend>::for_each_in_range(const size_t& begin, const size_t& end,
+                                                               Iteratee&& iteratee) const {
+    assert(end <= size());
+    uint64_t buffer[page_size];
+    size_t i = begin;
+    while (i < end) {
+        // decode up to the end of this page
+        size_t count = std::min(end - i, page_size - i % page_size);
+        get_range(i, count, buffer);
+        for (size_t j = 0; j < count; j++) {
+            if (!iteratee(buffer[j])) {
+                return false;
+            }
+        }
+        i += count;
+    }
+    return true;
+}
+
+template<size_t page_size, typename Backend>
+inline auto PagedVector<page_size, Backend>::begin() const -> const_iterator {
+    return const_iterator(*this, 0);
+}
+
+template<size_t page_size, typename Backend>
+inline auto PagedVector<page_size, Backend>::end() const -> const_iterator {
+    return const_iterator(*this, size());
+}
+
+template<size_t page_size, typename Backend>
+inline auto PagedVector<page_size, Backend>::rbegin() const -> const_reverse_iterator {
+    return const_reverse_iterator(*this, size());
+}
+
+template<size_t page_size, typename Backend>
+inline auto PagedVector<page_size, Backend>::rend() const -> const_reverse_iterator {
+    return const_reverse_iterator(*this, 0);
+}
+
+template<size_t page_size, typename Backend>
+inline void PagedVector<page_size, Backend>::set_range(const size_t& start, const size_t& count,
+                                                       const uint64_t* in) {
+    assert(start + count <= filled);
+    uint64_t diffs[page_size];
+    size_t i = start, end = start + count;
+    while (i < end) {
+        // encode the part of the range that falls on this page
+        size_t page_idx = i / page_size;
+        size_t page_begin = i % page_size;
+        size_t page_count = std::min(end - i, page_size - page_begin);
+        
+        uint64_t anchor = anchors.get(page_idx);
+        for (size_t j = 0; j < page_count; j++) {
+            if (anchor == 0) {
+                // choose the anchor the same way that set() would
+                anchor = in[j];
+            }
+            diffs[j] = to_diff(in[j], anchor);
+        }
+        if (anchor != anchors.get(page_idx)) {
+            anchors.set(page_idx, anchor);
+        }
+        pages[page_idx].set_range(page_begin, page_count, diffs);
+        
+        in += page_count;
+        i += page_count;
+    }
+}
+
 template<size_t page_size, typename Backend>
 inline void PagedVector<page_size, Backend>::append(const uint64_t& value) {
     if (filled == pages.size() * page_size) {
@@ -1085,6 +2405,21 @@ RobustPagedVector<page_size, Backend>::RobustPagedVector() {
     // Nothing to do
 }
 
+template<size_t page_size, typename Backend>
+template<typename OtherBackend>
+RobustPagedVector<page_size, Backend>::RobustPagedVector(const RobustPagedVector<page_size, OtherBackend>& other) :
+    first_page(other.first_page), latter_pages(other.latter_pages) {
+    // Nothing to do because members' constructors did all the work.
+}
+
+template<size_t page_size, typename Backend>
+template<typename OtherBackend>
+auto RobustPagedVector<page_size, Backend>::operator=(const RobustPagedVector<page_size, OtherBackend>& other) -> RobustPagedVector& {
+    first_page = other.first_page;
+    latter_pages = other.latter_pages;
+    return *this;
+}
+
 template<size_t page_size, typename Backend>
 RobustPagedVector<page_size, Backend>::RobustPagedVector(istream& in) {
     deserialize(in);
@@ -1132,6 +2467,75 @@ inline uint64_t RobustPagedVector<page_size, Backend>::get(const size_t& i) cons
     }
 }
 
+template<size_t page_size, typename Backend>
+inline void RobustPagedVector<page_size, Backend>::get_range(const size_t& start, const size_t& count,
+                                                             uint64_t* out) const {
+    size_t first_count = 0;
+    if (start < latter_pages.page_width()) {
+        first_count = std::min(count, latter_pages.page_width() - start);
+        first_page.get_range(start, first_count, out);
+    }
+    if (first_count < count) {
+        latter_pages.get_range(start + first_count - latter_pages.page_width(), count - first_count,
+                               out + first_count);
+    }
+}
+
+template<size_t page_size, typename Backend>
+template<typename Iteratee>
+inline bool RobustPagedVector<page_size, Backend>::for_each_in_range(const size_t& begin, const size_t& end,
+                                                                     Iteratee&& iteratee) const {
+    assert(end <= size());
+    uint64_t buffer[page_size];
+    size_t i = begin;
+    while (i < end) {
+        // decode up to the end of this page
+        size_t count = std::min(end - i, page_size - i % page_size);
+        get_range(i, count, buffer);
+        for (size_t j = 0; j < count; j++) {
+            if (!iteratee(buffer[j])) {
+                return false;
+            }
+        }
+        i += count;
+    }
+    return true;
+}
+
+template<size_t page_size, typename Backend>
+inline auto RobustPagedVector<page_size, Backend>::begin() const -> const_iterator {
+    return const_iterator(*this, 0);
+}
+
+template<size_t page_size, typename Backend>
+inline auto RobustPagedVector<page_size, Backend>::end() const -> const_iterator {
+    return const_iterator(*this, size());
+}
+
+template<size_t page_size, typename Backend>
+inline auto RobustPagedVector<page_size, Backend>::rbegin() const -> const_reverse_iterator {
+    return const_reverse_iterator(*this, size());
+}
+
+template<size_t page_size, typename Backend>
+inline auto RobustPagedVector<page_size, Backend>::rend() const -> const_reverse_iterator {
+    return const_reverse_iterator(*this, 0);
+}
+
+template<size_t page_size, typename Backend>
+inline void RobustPagedVector<page_size, Backend>::set_range(const size_t& start, const size_t& count,
+                                                             const uint64_t* in) {
+    size_t first_count = 0;
+    if (start < latter_pages.page_width()) {
+        first_count = std::min(count, latter_pages.page_width() - start);
+        first_page.set_range(start, first_count, in);
+    }
+    if (first_count < count) {
+        latter_pages.set_range(start + first_count - latter_pages.page_width(), count - first_count,
+                               in + first_count);
+    }
+}
+
 template<size_t page_size, typename Backend>
 inline void RobustPagedVector<page_size, Backend>::append(const uint64_t& value) {
     if (first_page.size() < latter_pages.page_width()) {
@@ -1543,6 +2947,294 @@ template<typename Backend>
 inline bool PackedSet<Backend>::empty() const {
     return num_items == 0;
 }
+
+/////////////////////
+/// GroupedPackedSet
+/////////////////////
+
+template<typename Backend>
+constexpr size_t GroupedPackedSet<Backend>::group_size;
+template<typename Backend>
+constexpr uint8_t GroupedPackedSet<Backend>::empty_slot;
+template<typename Backend>
+constexpr uint8_t GroupedPackedSet<Backend>::deleted_slot;
+
+template<typename Backend>
+GroupedPackedSet<Backend>::GroupedPackedSet() {
+    control.resize(group_size);
+    for (size_t i = 0; i < group_size; ++i) {
+        control[i] = empty_slot;
+    }
+    slots.resize(group_size);
+}
+
+template<typename Backend>
+typename GroupedPackedSet<Backend>::iterator GroupedPackedSet<Backend>::begin() const {
+    iterator it(this, 0);
+    if (slots.size() != 0 && (control[0] & empty_slot)) {
+        ++it;
+    }
+    return it;
+}
+
+template<typename Backend>
+typename GroupedPackedSet<Backend>::iterator GroupedPackedSet<Backend>::end() const {
+    return iterator(this, slots.size());
+}
+
+template<typename Backend>
+GroupedPackedSet<Backend>::iterator::iterator(const GroupedPackedSet* iteratee, size_t i) : iteratee(iteratee), i(i) {
+    // nothing to do
+}
+
+template<typename Backend>
+typename GroupedPackedSet<Backend>::iterator& GroupedPackedSet<Backend>::iterator::operator++() {
+    // advance to the next full slot
+    do {
+        ++i;
+    } while (i < iteratee->slots.size() && (iteratee->control[i] & empty_slot));
+    return *this;
+}
+
+template<typename Backend>
+uint64_t GroupedPackedSet<Backend>::iterator::operator*() const {
+    return from_diff(iteratee->slots.get(i), iteratee->anchor);
+}
+
+template<typename Backend>
+bool GroupedPackedSet<Backend>::iterator::operator==(const GroupedPackedSet<Backend>::iterator& other) const {
+    return iteratee == other.iteratee && i == other.i;
+}
+
+template<typename Backend>
+bool GroupedPackedSet<Backend>::iterator::operator!=(const GroupedPackedSet<Backend>::iterator& other) const {
+    return !(*this == other);
+}
+
+template<typename Backend>
+inline uint64_t GroupedPackedSet<Backend>::hash(const uint64_t& value) {
+    return wang_hash_64(value);
+}
+
+template<typename Backend>
+inline uint32_t GroupedPackedSet<Backend>::match_byte(const uint8_t* group, uint8_t byte) {
+#ifdef __SSE2__
+    __m128i bytes = _mm_loadu_si128((const __m128i*) group);
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8((char) byte)));
+#else
+    uint32_t mask = 0;
+    for (size_t i = 0; i < group_size; ++i) {
+        mask |= uint32_t(group[i] == byte) << i;
+    }
+    return mask;
+#endif
+}
+
+template<typename Backend>
+inline uint32_t GroupedPackedSet<Backend>::match_free(const uint8_t* group) {
+    // empty and deleted slots are the ones with the high bit set
+#ifdef __SSE2__
+    return _mm_movemask_epi8(_mm_loadu_si128((const __m128i*) group));
+#else
+    uint32_t mask = 0;
+    for (size_t i = 0; i < group_size; ++i) {
+        mask |= uint32_t(group[i] >> 7) << i;
+    }
+    return mask;
+#endif
+}
+
+template<typename Backend>
+inline uint64_t GroupedPackedSet<Backend>::to_diff(const uint64_t& value, const uint64_t& _anchor) {
+    // zig-zag encode the signed difference, so that values near the anchor
+    // on either side get small codes:
+    // difference  0 -1  1 -2  2 ...
+    // integer     0  1  2  3  4 ...
+    uint64_t diff = value - _anchor;
+    return (diff << 1) ^ (uint64_t) ((int64_t) diff >> 63);
+}
+
+template<typename Backend>
+inline uint64_t GroupedPackedSet<Backend>::from_diff(const uint64_t& diff, const uint64_t& _anchor) {
+    // inverse of to_diff
+    return _anchor + ((diff >> 1) ^ (~(diff & 1) + 1));
+}
+
+template<typename Backend>
+inline size_t GroupedPackedSet<Backend>::groups_for(size_t count) {
+    // the max load is 7/8
+    size_t num_groups = 1;
+    while (num_groups * group_size * 7 < count * 16) {
+        num_groups *= 2;
+    }
+    return num_groups;
+}
+
+template<typename Backend>
+inline size_t GroupedPackedSet<Backend>::locate(const uint64_t& value) const {
+    uint64_t hsh = hash(value);
+    uint8_t tag = hsh & 0x7F;
+    uint64_t diff = to_diff(value, anchor);
+    // triangular probing over groups reaches all of them, since there are a
+    // power of 2 of them
+    size_t group = (hsh >> 7) & group_mask;
+    for (size_t step = 1; true; ++step) {
+        const uint8_t* group_control = &control[group * group_size];
+        for (uint32_t mask = match_byte(group_control, tag); mask; mask &= mask - 1) {
+            size_t i = group * group_size + __builtin_ctz(mask);
+            if (slots.get(i) == diff) {
+                return i;
+            }
+        }
+        if (match_byte(group_control, empty_slot)) {
+            // the value would have been placed here
+            return slots.size();
+        }
+        group = (group + step) & group_mask;
+    }
+}
+
+template<typename Backend>
+inline void GroupedPackedSet<Backend>::place(const uint64_t& value) {
+    uint64_t hsh = hash(value);
+    size_t group = (hsh >> 7) & group_mask;
+    for (size_t step = 1; true; ++step) {
+        uint32_t mask = match_free(&control[group * group_size]);
+        if (mask) {
+            size_t i = group * group_size + __builtin_ctz(mask);
+            if (control[i] == deleted_slot) {
+                --num_deleted;
+            }
+            control[i] = hsh & 0x7F;
+            slots.set(i, to_diff(value, anchor));
+            return;
+        }
+        group = (group + step) & group_mask;
+    }
+}
+
+template<typename Backend>
+void GroupedPackedSet<Backend>::rehash(size_t new_num_groups) {
+    
+    // anchor the values at the middle of their range
+    uint64_t new_anchor = anchor;
+    if (num_items != 0) {
+        uint64_t min_val = numeric_limits<uint64_t>::max();
+        uint64_t max_val = numeric_limits<uint64_t>::min();
+        for (size_t i = 0; i < slots.size(); ++i) {
+            if (!(control[i] & empty_slot)) {
+                uint64_t val = from_diff(slots.get(i), anchor);
+                min_val = min(min_val, val);
+                max_val = max(max_val, val);
+            }
+        }
+        new_anchor = min_val + (max_val - min_val) / 2;
+    }
+    
+    ControlVec old_control = std::move(control);
+    PackedVec old_slots = std::move(slots);
+    uint64_t old_anchor = anchor;
+    
+    control = ControlVec();
+    control.resize(new_num_groups * group_size);
+    for (size_t i = 0; i < control.size(); ++i) {
+        control[i] = empty_slot;
+    }
+    slots = PackedVec();
+    slots.resize(new_num_groups * group_size);
+    group_mask = new_num_groups - 1;
+    num_deleted = 0;
+    anchor = new_anchor;
+    
+    // move the entries over to the new table
+    for (size_t i = 0; i < old_slots.size(); ++i) {
+        if (!(old_control[i] & empty_slot)) {
+            place(from_diff(old_slots.get(i), old_anchor));
+        }
+    }
+}
+
+template<typename Backend>
+inline void GroupedPackedSet<Backend>::insert(const uint64_t& value) {
+    
+    // greedily choose the first value as the anchor
+    if (num_items == 0) {
+        anchor = value;
+    }
+    
+    if (locate(value) != slots.size()) {
+        // already inserted
+        return;
+    }
+    if ((num_items + num_deleted + 1) * 8 > slots.size() * 7) {
+        // rehash so we don't exceed the max load, which also clears out the
+        // deleted slots
+        rehash(groups_for(num_items + 1));
+    }
+    place(value);
+    ++num_items;
+}
+
+template<typename Backend>
+inline bool GroupedPackedSet<Backend>::find(const uint64_t& value) const {
+    return locate(value) != slots.size();
+}
+
+template<typename Backend>
+inline void GroupedPackedSet<Backend>::remove(const uint64_t& value) {
+    size_t i = locate(value);
+    if (i == slots.size()) {
+        // not in the set
+        return;
+    }
+    
+    if (match_byte(&control[(i / group_size) * group_size], empty_slot)) {
+        // no probe has ever continued past this group, since it was never
+        // full, so the slot can go back to being empty
+        control[i] = empty_slot;
+    }
+    else {
+        // leave a marker so that probes continue past this slot
+        control[i] = deleted_slot;
+        ++num_deleted;
+    }
+    slots.set(i, 0);
+    --num_items;
+    
+    if (group_mask != 0 && num_items * 16 < slots.size()) {
+        // shrink so we don't waste too much space
+        rehash(groups_for(num_items));
+    }
+}
+
+template<typename Backend>
+inline void GroupedPackedSet<Backend>::reserve(const size_t& future_size) {
+    size_t num_groups = groups_for(future_size);
+    if (num_groups > group_mask + 1) {
+        rehash(num_groups);
+    }
+}
+
+template<typename Backend>
+inline void GroupedPackedSet<Backend>::clear() {
+    *this = GroupedPackedSet<Backend>();
+}
+
+template<typename Backend>
+inline size_t GroupedPackedSet<Backend>::size() const {
+    return num_items;
+}
+
+template<typename Backend>
+inline bool GroupedPackedSet<Backend>::empty() const {
+    return num_items == 0;
+}
+
+template<typename Backend>
+size_t GroupedPackedSet<Backend>::memory_usage() const {
+    return sizeof(anchor) + sizeof(group_mask) + sizeof(num_items) + sizeof(num_deleted)
+        + control.size() * sizeof(uint8_t) + slots.memory_usage();
+}
     
 }
 
@@ -0,0 +1,156 @@
+#ifndef BDSG_PERF_COUNTERS_HPP_INCLUDED
+#define BDSG_PERF_COUNTERS_HPP_INCLUDED
+
+/**
+ * \file perf_counters.hpp
+ * Optional per-thread counters and timers for hot paths in the distance
+ * index, the packed graphs, and the yomo memory manager.
+ *
+ * Counting only happens in code compiled with BDSG_PERF_COUNTERS defined
+ * (the PERF_COUNTERS build option). Otherwise the BDSG_COUNT_EVENT() and
+ * BDSG_TIME_EVENT() macros expand to nothing, and snapshots are all zeros.
+ * Since BasePackedGraph is a template, its counters depend on how the code
+ * instantiating it was compiled.
+ */
+
+#include <cstdint>
+#include <chrono>
+#include <ostream>
+#include <string>
+
+namespace bdsg {
+namespace perf {
+
+/**
+ * The events we can count. Timed events also accumulate the nanoseconds
+ * spent in them, including time spent in any events nested inside them.
+ */
+enum event_t {
+    /// Calls to SnarlDistanceIndex::minimum_distance() (timed)
+    DISTANCE_MINIMUM_DISTANCE = 0,
+    /// Page faults taken during SnarlDistanceIndex::minimum_distance()
+    DISTANCE_PAGE_FAULTS,
+    /// Calls to SnarlDistanceIndex::lowest_common_ancestor() (timed)
+    DISTANCE_LOWEST_COMMON_ANCESTOR,
+    /// Calls to SnarlDistanceIndex::distance_in_parent() (timed)
+    DISTANCE_IN_PARENT,
+    /// Calls to SnarlDistanceIndex::distance_to_parent_bound() (timed)
+    DISTANCE_TO_PARENT_BOUND,
+    /// Calls to follow_edges() on a packed graph (timed)
+    GRAPH_FOLLOW_EDGES,
+    /// Calls to get_sequence() on a packed graph (timed)
+    GRAPH_GET_SEQUENCE,
+    /// Defragmentations of a packed graph (timed)
+    GRAPH_DEFRAGMENT,
+    /// Allocations from yomo chains (timed)
+    MANAGER_ALLOCATE,
+    /// Deallocations in yomo chains
+    MANAGER_DEALLOCATE,
+    /// New links added to yomo chains
+    MANAGER_CHAIN_GROWTH,
+    /// Times a thread had to wait for a yomo chain's allocator lock (timed)
+    MANAGER_LOCK_WAIT,
+    /// Not an event; the number of events
+    EVENT_COUNT
+};
+
+/**
+ * Get the name of an event, for reporting.
+ */
+const char* event_name(event_t event);
+
+/**
+ * Totals for each event, across all threads.
+ */
+struct Snapshot {
+    /// How many times each event happened
+    uint64_t counts[EVENT_COUNT] = {};
+    /// How many nanoseconds were spent in each timed event
+    uint64_t nanoseconds[EVENT_COUNT] = {};
+
+    /**
+     * Write out the totals as a JSON object, keyed by event name, of objects
+     * with "count" and "nanoseconds" fields.
+     */
+    void dump_json(std::ostream& out) const;
+
+    /**
+     * Get the totals as a JSON string.
+     */
+    std::string to_json() const;
+};
+
+/**
+ * Return true if the library was compiled with counters enabled.
+ */
+bool enabled();
+
+/**
+ * Add up the counters from all threads, including those that have exited,
+ * since the last reset(). Counters being updated concurrently may be a little
+ * behind.
+ */
+Snapshot snapshot();
+
+/**
+ * Set all counters to zero. Events happening concurrently may or may not be
+ * counted afterward.
+ */
+void reset();
+
+/**
+ * Record that an event happened, and took the given number of nanoseconds.
+ * Only the calling thread's counters are touched.
+ */
+void record(event_t event, uint64_t nanoseconds = 0);
+
+/**
+ * Times the scope it lives in, and records it as an event when destroyed.
+ */
+class ScopedTimer {
+public:
+    inline ScopedTimer(event_t event) : event(event), start(std::chrono::steady_clock::now()) {
+        // Nothing to do
+    }
+
+    inline ~ScopedTimer() {
+        record(event, std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+    }
+
+private:
+    event_t event;
+    std::chrono::steady_clock::time_point start;
+};
+
+/**
+ * Counts page faults taken by the calling thread in the scope it lives in, and
+ * records them as DISTANCE_PAGE_FAULTS when destroyed.
+ */
+class ScopedFaultCounter {
+public:
+    ScopedFaultCounter();
+    ~ScopedFaultCounter();
+
+private:
+    uint64_t start;
+};
+
+}
+}
+
+#ifdef BDSG_PERF_COUNTERS
+#define BDSG_PERF_CONCAT_INNER(a, b) a##b
+#define BDSG_PERF_CONCAT(a, b) BDSG_PERF_CONCAT_INNER(a, b)
+/// Count the given event (a bdsg::perf::event_t name) once.
+#define BDSG_COUNT_EVENT(event) ::bdsg::perf::record(::bdsg::perf::event)
+/// Count the given event and time it until the end of the enclosing scope.
+#define BDSG_TIME_EVENT(event) ::bdsg::perf::ScopedTimer BDSG_PERF_CONCAT(bdsg_perf_timer_, __LINE__)(::bdsg::perf::event)
+/// Count page faults until the end of the enclosing scope.
+#define BDSG_COUNT_FAULTS() ::bdsg::perf::ScopedFaultCounter BDSG_PERF_CONCAT(bdsg_perf_faults_, __LINE__)
+#else
+#define BDSG_COUNT_EVENT(event)
+#define BDSG_TIME_EVENT(event)
+#define BDSG_COUNT_FAULTS()
+#endif
+
+#endif
@@ -0,0 +1,145 @@
+//
+//  step_position_tree.hpp
+//
+//  Contains a blocked, counted tree over the steps of a path that keeps their
+//  positions implicitly, so that edits do not have to shift every downstream
+//  position.
+//
+
+#ifndef BDSG_STEP_POSITION_TREE_HPP_INCLUDED
+#define BDSG_STEP_POSITION_TREE_HPP_INCLUDED
+
+#include <handlegraph/types.hpp>
+
+#include <vector>
+
+#include <sparsepp/spp.h>
+
+namespace bdsg {
+
+using namespace std;
+using namespace handlegraph;
+
+/*
+ * The steps of one path, in order, along with their lengths in bases. Steps
+ * are kept in leaf blocks under internal nodes that record the number of steps
+ * and bases below each of their children, so a step's position is never
+ * stored and inserting or erasing a step only updates the nodes above it.
+ *
+ * Blocks are split when they fill, and removed when they empty, but are not
+ * merged, so the tree stays at most as deep as it would have grown from
+ * the inserts alone.
+ */
+class StepPositionTree {
+public:
+
+    StepPositionTree();
+    StepPositionTree(const StepPositionTree& other);
+    StepPositionTree(StepPositionTree&& other);
+    ~StepPositionTree();
+    StepPositionTree& operator=(const StepPositionTree& other);
+    StepPositionTree& operator=(StepPositionTree&& other);
+
+    /// Returns the number of steps in the tree
+    size_t size() const;
+
+    /// Returns the total length of the steps in bases
+    size_t bases() const;
+
+    /// Returns true if the step is in the tree
+    bool contains(const step_handle_t& step) const;
+
+    /// Returns the rank of a step that is in the tree
+    size_t rank_of(const step_handle_t& step) const;
+
+    /// Returns the number of bases before a step that is in the tree
+    size_t position_of(const step_handle_t& step) const;
+
+    /// Returns the step at a rank less than size()
+    step_handle_t step_at_rank(size_t rank) const;
+
+    /// Returns the rank of the step that covers the base at the given
+    /// position, or size() if the position is past the end.
+    size_t rank_at_position(size_t position) const;
+
+    /// Insert a step, which must not already be in the tree, so that it has
+    /// the given rank, which must be at most size().
+    void insert(size_t rank, const step_handle_t& step, size_t length);
+
+    /// Add a step, which must not already be in the tree, at the end.
+    void push_back(const step_handle_t& step, size_t length);
+
+    /// Remove a step that is in the tree
+    void erase(const step_handle_t& step);
+
+    /// Remove all steps
+    void clear();
+
+    /// Returns the number of bytes used by the tree
+    size_t memory_usage() const;
+
+private:
+
+    /// The most entries in a block before it is split
+    static const size_t MAX_BLOCK_SIZE = 64;
+
+    struct Internal;
+
+    /// A node in the tree, with the totals for its subtree
+    struct Node {
+        Internal* parent = nullptr;
+        size_t count = 0;
+        size_t bases = 0;
+        bool is_leaf;
+        Node(bool is_leaf) : is_leaf(is_leaf) {}
+    };
+
+    /// A block of steps, with the totals for the block.
+    struct Leaf : public Node {
+        Leaf() : Node(true) {}
+        vector<step_handle_t> steps;
+        vector<size_t> lengths;
+    };
+
+    /// A block of children, with the totals for all of them
+    struct Internal : public Node {
+        Internal() : Node(false) {}
+        vector<Node*> children;
+    };
+
+    /// Free a node and everything under it
+    static void destroy(Node* node);
+
+    /// Add all the steps under a node of another tree to the end of this one
+    void append_all(const Node* node);
+
+    /// Find the leaf and index within it of the entry at the given rank,
+    /// which may be one past the last entry.
+    pair<Leaf*, size_t> locate_rank(size_t rank) const;
+
+    /// Find the index of a step in its leaf
+    static size_t index_in_leaf(const Leaf* leaf, const step_handle_t& step);
+
+    /// Find the index of a node among its parent's children
+    static size_t index_in_parent(const Node* node);
+
+    /// Add to the totals of a node and all of its ancestors
+    static void adjust_totals(Node* node, int64_t count_delta, int64_t bases_delta);
+
+    /// Split a node that has gotten too big, possibly making a new root.
+    void split(Node* node);
+
+    /// Unlink and free a node that has become empty, along with any
+    /// ancestors that become empty.
+    void remove_empty(Node* node);
+
+    /// The root of the tree, which is a leaf until the first split
+    Node* root = nullptr;
+
+    /// Where to find each step
+    spp::sparse_hash_map<step_handle_t, Leaf*> leaf_of;
+};
+
+}
+
+#endif
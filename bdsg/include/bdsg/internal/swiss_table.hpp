@@ -0,0 +1,827 @@
+#ifndef BDSG_SWISS_TABLE_HPP_INCLUDED
+#define BDSG_SWISS_TABLE_HPP_INCLUDED
+
+/**
+ * \file swiss_table.hpp
+ * Flat open-addressing hash tables, laid out like Abseil's "Swiss tables".
+ *
+ * Slots come in groups of 16, with a byte of control information per slot
+ * stored separately from the slots themselves. A full slot's control byte
+ * holds 7 bits of its key's hash, so a lookup can check a whole group of
+ * control bytes against its key with a couple of SIMD instructions and only
+ * needs to compare keys on a match. Entries live directly in the slot array,
+ * so they move when the table is rehashed, and pointers and iterators to them
+ * are invalidated by insertions (but not by erasures).
+ *
+ * These tables trade memory for speed, compared to the sparse tables in
+ * hash_map.hpp: they aim to keep the load between 7/16 and 7/8 and can't
+ * be memory-mapped.
+ */
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <tuple>
+#include <utility>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace bdsg {
+
+/**
+ * A flat hash table of Value entries, identified by the keys that KeyOf
+ * extracts from them. Use SwissMap or SwissSet instead of this directly.
+ *
+ * The interface follows std::unordered_map, for the subset we use.
+ */
+template<typename Key, typename Value, typename KeyOf, typename Hash, typename KeyEqual>
+class SwissTable {
+public:
+
+    using key_type = Key;
+    using value_type = Value;
+    using size_type = size_t;
+    using hasher = Hash;
+    using key_equal = KeyEqual;
+
+    template<bool Const>
+    class iterator_base;
+    using iterator = iterator_base<false>;
+    using const_iterator = iterator_base<true>;
+
+    SwissTable() = default;
+    SwissTable(const SwissTable& other);
+    SwissTable(SwissTable&& other) noexcept;
+    SwissTable& operator=(const SwissTable& other);
+    SwissTable& operator=(SwissTable&& other) noexcept;
+    ~SwissTable();
+
+    /// Iterate over the entries in an arbitrary order
+    iterator begin();
+    iterator end();
+    const_iterator begin() const;
+    const_iterator end() const;
+    const_iterator cbegin() const;
+    const_iterator cend() const;
+
+    /// Return true if there are no entries
+    bool empty() const;
+
+    /// Return the number of entries
+    size_t size() const;
+
+    /// Return the number of slots
+    size_t bucket_count() const;
+
+    /// Return the fraction of slots that are full
+    float load_factor() const;
+
+    /// Return the load past which we grow
+    float max_load_factor() const;
+
+    /// Return the load below which we shrink. We only ever shrink on an
+    /// explicit rehash(), so this is 0.
+    float min_load_factor() const;
+
+    /// Remove all entries, keeping the slots
+    void clear();
+
+    /// Make room for the given number of entries without rehashing
+    void reserve(size_t count);
+
+    /// Rehash into at least the given number of slots, or fewer if the
+    /// entries can't fill them. May be used to shrink the table.
+    void rehash(size_t count);
+
+    /// Exchange contents with another table
+    void swap(SwissTable& other);
+
+    /// Find the entry with the given key, or end() if there is none
+    iterator find(const Key& key);
+    const_iterator find(const Key& key) const;
+
+    /// Return 1 if there is an entry with the given key, and 0 otherwise
+    size_t count(const Key& key) const;
+
+    /// Add an entry, if there isn't one with its key already. Returns the
+    /// entry with its key and whether it was added.
+    std::pair<iterator, bool> insert(const Value& value);
+    std::pair<iterator, bool> insert(Value&& value);
+
+    /// Add an entry constructed from the given arguments, if there isn't one
+    /// with its key already.
+    template<typename... Args>
+    std::pair<iterator, bool> emplace(Args&&... args);
+
+    /// Remove the entry with the given key, if any. Returns the number of
+    /// entries removed.
+    size_t erase(const Key& key);
+
+    /// Remove the entry at the given position, which must exist. Returns the
+    /// position of the next entry; erasing never rehashes, so it is safe to
+    /// erase entries while iterating.
+    iterator erase(iterator pos);
+    iterator erase(const_iterator pos);
+
+    template<bool Const>
+    class iterator_base {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = Value;
+        using difference_type = std::ptrdiff_t;
+        using pointer = typename std::conditional<Const, const Value*, Value*>::type;
+        using reference = typename std::conditional<Const, const Value&, Value&>::type;
+
+        iterator_base() = default;
+        iterator_base(const iterator_base<false>& other);
+        iterator_base& operator=(const iterator_base& other) = default;
+
+        reference operator*() const;
+        pointer operator->() const;
+        iterator_base& operator++();
+        iterator_base operator++(int);
+        template<bool OtherConst>
+        bool operator==(const iterator_base<OtherConst>& other) const;
+        template<bool OtherConst>
+        bool operator!=(const iterator_base<OtherConst>& other) const;
+
+    private:
+        iterator_base(const SwissTable* table, size_t index);
+
+        /// Move to the first full slot at or after index
+        void skip_free();
+
+        const SwissTable* table = nullptr;
+        size_t index = 0;
+
+        friend class SwissTable;
+        friend class iterator_base<!Const>;
+    };
+
+protected:
+
+    /// Find the entry with the given key, and if there isn't one, add one
+    /// constructed from the given arguments. Returns the slot used and
+    /// whether the entry was added.
+    template<typename... Args>
+    std::pair<size_t, bool> find_or_emplace(const Key& key, Args&&... args);
+
+    static const size_t group_size = 16;
+    static const uint8_t empty_slot = 0x80;
+    static const uint8_t deleted_slot = 0xFE;
+
+    /// Get the slot holding the given key, or bucket_count() if none does
+    size_t find_slot(const Key& key) const;
+
+    /// Find the first free slot along the key's probe sequence, given its
+    /// hash, and claim it for the key. Rehashes if needed.
+    size_t claim_slot(size_t hash);
+
+    /// Move all the entries into a table with the given number of groups
+    void resize(size_t new_num_groups);
+
+    /// Destroy all the entries and free the table
+    void destroy();
+
+    /// Get the smallest power-of-two number of groups that can hold count
+    /// entries without exceeding the max load
+    static size_t groups_for(size_t count);
+
+    /// Get the control byte to use for a slot with the given hash
+    static uint8_t tag_of(size_t hash);
+
+    /// Get a bit mask of the slots in the group with the given control byte
+    static uint32_t match_byte(const uint8_t* group, uint8_t byte);
+
+    /// Get a bit mask of the empty or deleted slots in the group
+    static uint32_t match_free(const uint8_t* group);
+
+    /// Get a bit mask of the empty slots in the group
+    static uint32_t match_empty(const uint8_t* group);
+
+    /// The control bytes, one per slot
+    uint8_t* control = nullptr;
+    /// The slots, which are only constructed when full
+    Value* slots = nullptr;
+    /// The number of groups of slots, a power of two or 0
+    size_t num_groups = 0;
+    /// The number of full slots
+    size_t num_items = 0;
+    /// The number of deleted slots, which lookups have to probe past
+    size_t num_deleted = 0;
+
+    hasher hash_function;
+    key_equal key_eq;
+};
+
+/// KeyOf for map entries
+struct SwissMapKeyOf {
+    template<typename Pair>
+    const typename Pair::first_type& operator()(const Pair& entry) const {
+        return entry.first;
+    }
+};
+
+/// KeyOf for set entries
+struct SwissSetKeyOf {
+    template<typename K>
+    const K& operator()(const K& entry) const {
+        return entry;
+    }
+};
+
+/**
+ * A flat hash map, with an interface like std::unordered_map. The hash
+ * function must scatter its output over all bits, so things like the identity
+ * hash for integers will not work well.
+ */
+template<typename K, typename V, typename Hash, typename KeyEqual = std::equal_to<K>>
+class SwissMap : public SwissTable<K, std::pair<const K, V>, SwissMapKeyOf, Hash, KeyEqual> {
+public:
+    using mapped_type = V;
+
+    /// Get the value for the given key, adding a default one if there isn't
+    /// one already
+    V& operator[](const K& key);
+
+    /// Get the value for the given key, or throw std::out_of_range if there
+    /// isn't one
+    V& at(const K& key);
+    const V& at(const K& key) const;
+};
+
+/**
+ * A flat hash set, with an interface like std::unordered_set. The hash
+ * function must scatter its output over all bits, so things like the identity
+ * hash for integers will not work well.
+ */
+template<typename K, typename Hash, typename KeyEqual = std::equal_to<K>>
+class SwissSet : public SwissTable<K, K, SwissSetKeyOf, Hash, KeyEqual> {
+};
+
+
+
+/////////////////////
+/// SwissTable
+/////////////////////
+
+template<typename Key, typename Value, typename KeyOf, typename Hash, typename KeyEqual>
+const size_t SwissTable<Key, Value, KeyOf, Hash, KeyEqual>::group_size;
+template<typename Key, typename Value, typename KeyOf, typename Hash, typename KeyEqual>
+const uint8_t SwissTable<Key, Value, KeyOf, Hash, KeyEqual>::empty_slot;
+template<typename Key, typename Value, typename KeyOf, typename Hash, typename KeyEqual>
+const uint8_t SwissTable<Key, Value, KeyOf, Hash, KeyEqual>::deleted_slot;
+
+template<typename Key, typename Value, typename KeyOf, typename Hash, typename KeyEqual>
+SwissTable<Key, Value, KeyOf, Hash, KeyEqual>::SwissTable(const SwissTable& other) :
+    hash_function(other.hash_function), key_eq(other.key_eq) {
+    *this = other;
+}
+
+template<typename Key, typename Value, typename KeyOf, typename Hash, typename KeyEqual>
+SwissTable<Key, Value, KeyOf, Hash, KeyEqual>::SwissTable(SwissTable&& other) noexcept :
+    hash_function(std::move(other.hash_function)), key_eq(std::move(other.key_eq)) {
+    swap(other);
+}
+
+template<typename Key, typename Value, typename KeyOf, typename Hash, typename KeyEqual>
+SwissTable<Key, Value, KeyOf, Hash, KeyEqual>&
+SwissTable<Key, Value, KeyOf, Hash, KeyEqual>::operator=(const SwissTable& other) {
+    if (this != &other) {
+        destroy();
+        hash_function = other.hash_function;
+        key_eq = other.key_eq;
+        if (other.num_groups) {
+            size_t capacity = other.num_groups * group_size;
+            control = new uint8_t[capacity];
+            slots = std::allocator<Value>().allocate(capacity);
+            num_groups = other.num_groups;
+            // the deleted slots come along, so the probe sequences stay intact
+            memcpy(control, other.control, capacity);
+            for (size_t i = 0; i < capacity; ++i) {
+                if (!(control[i] & empty_slot)) {
+                    new (slots + i) Value(other.slots[i]);
+                }
+            }
+            num_items = other.num_items;
+            num_deleted = other.num_deleted;
+        }
+    }
+    return *this;
+}
+
+template<typename Key, typename Value, typename KeyOf, typename Hash, typename KeyEqual>
+SwissTable<Key, Value, KeyOf, Hash, KeyEqual>&
+SwissTable<Key, Value, KeyOf, Hash, KeyEqual>::operator=(SwissTable&& other) noexcept {
+    if (this != &other) {
+        destroy();
+        swap(other);
+    }
+    return *this;
+}
+
+template<typename Key, typename Value, typename KeyOf, typename Hash, typename KeyEqual>
+SwissTable<Key, Value, KeyOf, Hash, KeyEqual>::~SwissTable() {
+    destroy();
+}
+
+template<typename Key, typename Value, typename KeyOf, typename Hash, typename KeyEqual>
+inline typename SwissTable<Key, Value, KeyOf, Hash, KeyEqual>::iterator
+SwissTable<Key, Value, KeyOf, Hash, KeyEqual>::begin() {
+    iterator it(this, 0);
+    it.skip_free();
+    return it;
+}
+
+template<typename Key, typename Value, typename KeyOf, typename Hash, typename KeyEqual>
+inline typename SwissTable<Key, Value, KeyOf, Hash, KeyEqual>::iterator
+SwissTable<Key, Value, KeyOf, Hash, KeyEqual>::end() {
+    return iterator(this, bucket_count());
+}
+
+template<typename Key, typename Value, typename KeyOf, typename Hash, typename KeyEqual>
+inline typename SwissTable<Key, Value, KeyOf, Hash, KeyEqual>::const_iterator
+SwissTable<Key, Value, KeyOf, Hash, KeyEqual>::begin() const {
+    const_iterator it(this, 0);
+    it.skip_free();
+    return it;
+}
+
+template<typename Key, typename Value, typename KeyOf, typename Hash, typename KeyEqual>
+inline typename SwissTable<Key, Value, KeyOf, Hash, KeyEqual>::const_iterator
+SwissTable<Key, Value, KeyOf, Hash, KeyEqual>::end() const {
+    return const_iterator(this, bucket_count());
+}
+
+template<typename Key, typename Value, typename KeyOf, typename Hash, typename KeyEqual>
+inline typename SwissTable<Key, Value, KeyOf, Hash, KeyEqual>::const_iterator
+SwissTable<Key, Value, KeyOf, Hash, KeyEqual>::cbegin() const {
+    return begin();
+}
+
+template<typename Key, typename Value, typename KeyOf, typename Hash, typename KeyEqual>
+inline typename SwissTable<Key, Value, KeyOf, Hash, KeyEqual>::const_iterator
+SwissTable<Key, Value, KeyOf, Hash, KeyEqual>::cend() const {
+    return end();
+}
+
+template<typename Key, typename Value, typename KeyOf, typename Hash, typename KeyEqual>
+inline bool SwissTable<Key, Value, KeyOf, Hash, KeyEqual>::empty() const {
+    return num_items == 0;
+}
+
+template<typename Key, typename Value, typename KeyOf, typename Hash, typename KeyEqual>
+inline size_t SwissTable<Key, Value, KeyOf, Hash, KeyEqual>::size() const {
+    return num_items;
+}
+
+template<typename Key, typename Value, typename KeyOf, typename Hash, typename KeyEqual>
+inline size_t SwissTable<Key, Value, KeyOf, Hash, KeyEqual>::bucket_count() const {
+    return num_groups * group_size;
+}
+
+template<typename Key, typename Value, typename KeyOf, typename Hash, typename KeyEqual>
+inline float SwissTable<Key, Value, KeyOf, Hash, KeyEqual>::load_factor() const {
+    return num_groups ? float(num_items) / bucket_count() : 0.0;
+}
+
+template<typename Key, typename Value, typename KeyOf, typename Hash, typename KeyEqual>
+inline float SwissTable<Key, Value, KeyOf, Hash, KeyEqual>::max_load_factor() const {
+    return 0.875;
+}
+
+template<typename Key, typename Value, typename KeyOf, typename Hash, typename KeyEqual>
+inline float SwissTable<Key, Value, KeyOf, Hash, KeyEqual>::min_load_factor() const {
+    return 0.0;
+}
+
+template<typename Key, typename Value, typename KeyOf, typename Hash, typename KeyEqual>
+void SwissTable<Key, Value, KeyOf, Hash, KeyEqual>::clear() {
+    size_t capacity = bucket_count();
+    for (size_t i = 0; i < capacity; ++i) {
+        if (!(control[i] & empty_slot)) {
+            slots[i].~Value();
+        }
+    }
+    if (capacity) {
+        memset(control, empty_slot, capacity);
+    }
+    num_items = 0;
+    num_deleted = 0;
+}
+
+template<typename Key, typename Value, typename KeyOf, typename Hash, typename KeyEqual>
+void SwissTable<Key, Value, KeyOf, Hash, KeyEqual>::reserve(size_t count) {
+    size_t needed = groups_for(count);
+    if (needed > num_groups) {
+        resize(needed);
+    }
+}
+
+template<typename Key, typename Value, typename KeyOf, typename Hash, typename KeyEqual>
+void SwissTable<Key, Value, KeyOf, Hash, KeyEqual>::rehash(size_t count) {
+    size_t needed = 1;
+    while (needed * group_size < count) {
+        needed *= 2;
+    }
+    needed = std::max(needed, groups_for(num_items));
+    if (num_items == 0 && count == 0) {
+        needed = 0;
+    }
+    if (needed != num_groups || num_deleted) {
+        resize(needed);
+    }
+}
+
+template<typename Key, typename Value, typename KeyOf, typename Hash, typename KeyEqual>
+void SwissTable<Key, Value, KeyOf, Hash, KeyEqual>::swap(SwissTable& other) {
+    std::swap(control, other.control);
+    std::swap(slots, other.slots);
+    std::swap(num_groups, other.num_groups);
+    std::swap(num_items, other.num_items);
+    std::swap(num_deleted, other.num_deleted);
+    std::swap(hash_function, other.hash_function);
+    std::swap(key_eq, other.key_eq);
+}
+
+template<typename Key, typename Value, typename KeyOf, typename Hash, typename KeyEqual>
+inline typename SwissTable<Key, Value, KeyOf, Hash, KeyEqual>::iterator
+SwissTable<Key, Value, KeyOf, Hash, KeyEqual>::find(const Key& key) {
+    return iterator(this, find_slot(key));
+}
+
+template<typename Key, typename Value, typename KeyOf, typename Hash, typename KeyEqual>
+inline typename SwissTable<Key, Value, KeyOf, Hash, KeyEqual>::const_iterator
+SwissTable<Key, Value, KeyOf, Hash, KeyEqual>::find(const Key& key) const {
+    return const_iterator(this, find_slot(key));
+}
+
+template<typename Key, typename Value, typename KeyOf, typename Hash, typename KeyEqual>
+inline size_t SwissTable<Key, Value, KeyOf, Hash, KeyEqual>::count(const Key& key) const {
+    return find_slot(key) != bucket_count();
+}
+
+template<typename Key, typename Value, typename KeyOf, typename Hash, typename KeyEqual>
+inline std::pair<typename SwissTable<Key, Value, KeyOf, Hash, KeyEqual>::iterator, bool>
+SwissTable<Key, Value, KeyOf, Hash, KeyEqual>::insert(const Value& value) {
+    auto found = find_or_emplace(KeyOf()(value), value);
+    return std::make_pair(iterator(this, found.first), found.second);
+}
+
+template<typename Key, typename Value, typename KeyOf, typename Hash, typename KeyEqual>
+inline std::pair<typename SwissTable<Key, Value, KeyOf, Hash, KeyEqual>::iterator, bool>
+SwissTable<Key, Value, KeyOf, Hash, KeyEqual>::insert(Value&& value) {
+    auto found = find_or_emplace(KeyOf()(value), std::move(value));
+    return std::make_pair(iterator(this, found.first), found.second);
+}
+
+template<typename Key, typename Value, typename KeyOf, typename Hash, typename KeyEqual>
+template<typename... Args>
+inline std::pair<typename SwissTable<Key, Value, KeyOf, Hash, KeyEqual>::iterator, bool>
+SwissTable<Key, Value, KeyOf, Hash, KeyEqual>::emplace(Args&&... args) {
+    // we need the key to look for, so we have to make the entry first
+    Value value(std::forward<Args>(args)...);
+    return insert(std::move(value));
+}
+
+template<typename Key, typename Value, typename KeyOf, typename Hash, typename KeyEqual>
+inline size_t SwissTable<Key, Value, KeyOf, Hash, KeyEqual>::erase(const Key& key) {
+    size_t slot = find_slot(key);
+    if (slot == bucket_count()) {
+        return 0;
+    }
+    erase(iterator(this, slot));
+    return 1;
+}
+
+template<typename Key, typename Value, typename KeyOf, typename Hash, typename KeyEqual>
+typename SwissTable<Key, Value, KeyOf, Hash, KeyEqual>::iterator
+SwissTable<Key, Value, KeyOf, Hash, KeyEqual>::erase(iterator pos) {
+    size_t slot = pos.index;
+    slots[slot].~Value();
+    --num_items;
+    // if the group has never been full, no probe sequence passes through it,
+    // so the slot can just be empty again
+    if (match_empty(control + (slot / group_size) * group_size)) {
+        control[slot] = empty_slot;
+    }
+    else {
+        control[slot] = deleted_slot;
+        ++num_deleted;
+    }
+    pos.skip_free();
+    return pos;
+}
+
+template<typename Key, typename Value, typename KeyOf, typename Hash, typename KeyEqual>
+inline typename SwissTable<Key, Value, KeyOf, Hash, KeyEqual>::iterator
+SwissTable<Key, Value, KeyOf, Hash, KeyEqual>::erase(const_iterator pos) {
+    return erase(iterator(this, pos.index));
+}
+
+template<typename Key, typename Value, typename KeyOf, typename Hash, typename KeyEqual>
+template<typename... Args>
+std::pair<size_t, bool> SwissTable<Key, Value, KeyOf, Hash, KeyEqual>::find_or_emplace(const Key& key,
+                                                                                       Args&&... args) {
+    size_t slot = find_slot(key);
+    if (slot != bucket_count()) {
+        return std::make_pair(slot, false);
+    }
+    // the key may point into the arguments, so construct the entry before
+    // anything can move
+    Value value(std::forward<Args>(args)...);
+    slot = claim_slot(hash_function(KeyOf()(value)));
+    try {
+        new (slots + slot) Value(std::move(value));
+    }
+    catch (...) {
+        // give the slot back
+        control[slot] = empty_slot;
+        --num_items;
+        throw;
+    }
+    return std::make_pair(slot, true);
+}
+
+template<typename Key, typename Value, typename KeyOf, typename Hash, typename KeyEqual>
+inline size_t SwissTable<Key, Value, KeyOf, Hash, KeyEqual>::find_slot(const Key& key) const {
+    if (num_items == 0) {
+        return bucket_count();
+    }
+    size_t hash = hash_function(key);
+    uint8_t tag = tag_of(hash);
+    size_t mask = num_groups - 1;
+    size_t group = (hash >> 7) & mask;
+    // triangular probing visits every group when there are a power of two
+    for (size_t step = 1; ; ++step) {
+        const uint8_t* group_control = control + group * group_size;
+        uint32_t matches = match_byte(group_control, tag);
+        while (matches) {
+            size_t i = group * group_size + __builtin_ctz(matches);
+            if (key_eq(KeyOf()(slots[i]), key)) {
+                return i;
+            }
+            matches &= matches - 1;
+        }
+        if (match_empty(group_control)) {
+            // the key would have been put here
+            return bucket_count();
+        }
+        group = (group + step) & mask;
+    }
+}
+
+template<typename Key, typename Value, typename KeyOf, typename Hash, typename KeyEqual>
+size_t SwissTable<Key, Value, KeyOf, Hash, KeyEqual>::claim_slot(size_t hash) {
+    if ((num_items + num_deleted + 1) * 8 > bucket_count() * 7) {
+        // grow to about half the max load, which also clears out deleted
+        // slots (and may not grow at all, if there are many)
+        resize(groups_for(2 * (num_items + 1)));
+    }
+    size_t mask = num_groups - 1;
+    size_t group = (hash >> 7) & mask;
+    for (size_t step = 1; ; ++step) {
+        uint32_t free = match_free(control + group * group_size);
+        if (free) {
+            size_t i = group * group_size + __builtin_ctz(free);
+            if (control[i] == deleted_slot) {
+                --num_deleted;
+            }
+            control[i] = tag_of(hash);
+            ++num_items;
+            return i;
+        }
+        group = (group + step) & mask;
+    }
+}
+
+template<typename Key, typename Value, typename KeyOf, typename Hash, typename KeyEqual>
+void SwissTable<Key, Value, KeyOf, Hash, KeyEqual>::resize(size_t new_num_groups) {
+    uint8_t* old_control = control;
+    Value* old_slots = slots;
+    size_t old_capacity = bucket_count();
+
+    size_t capacity = new_num_groups * group_size;
+    control = capacity ? new uint8_t[capacity] : nullptr;
+    slots = capacity ? std::allocator<Value>().allocate(capacity) : nullptr;
+    num_groups = new_num_groups;
+    if (capacity) {
+        memset(control, empty_slot, capacity);
+    }
+
+    size_t mask = num_groups - 1;
+    for (size_t i = 0; i < old_capacity; ++i) {
+        if (!(old_control[i] & empty_slot)) {
+            // there are no deleted slots or duplicates yet, so we can go
+            // straight to the first free slot
+            size_t hash = hash_function(KeyOf()(old_slots[i]));
+            size_t group = (hash >> 7) & mask;
+            for (size_t step = 1; ; ++step) {
+                uint32_t free = match_free(control + group * group_size);
+                if (free) {
+                    size_t j = group * group_size + __builtin_ctz(free);
+                    control[j] = tag_of(hash);
+                    new (slots + j) Value(std::move(old_slots[i]));
+                    old_slots[i].~Value();
+                    break;
+                }
+                group = (group + step) & mask;
+            }
+        }
+    }
+    num_deleted = 0;
+
+    if (old_capacity) {
+        delete[] old_control;
+        std::allocator<Value>().deallocate(old_slots, old_capacity);
+    }
+}
+
+template<typename Key, typename Value, typename KeyOf, typename Hash, typename KeyEqual>
+void SwissTable<Key, Value, KeyOf, Hash, KeyEqual>::destroy() {
+    if (num_groups) {
+        clear();
+        delete[] control;
+        std::allocator<Value>().deallocate(slots, bucket_count());
+    }
+    control = nullptr;
+    slots = nullptr;
+    num_groups = 0;
+}
+
+template<typename Key, typename Value, typename KeyOf, typename Hash, typename KeyEqual>
+inline size_t SwissTable<Key, Value, KeyOf, Hash, KeyEqual>::groups_for(size_t count) {
+    if (count == 0) {
+        return 0;
+    }
+    // the max load is 7/8
+    size_t groups = 1;
+    while (groups * group_size * 7 < count * 8) {
+        groups *= 2;
+    }
+    return groups;
+}
+
+template<typename Key, typename Value, typename KeyOf, typename Hash, typename KeyEqual>
+inline uint8_t SwissTable<Key, Value, KeyOf, Hash, KeyEqual>::tag_of(size_t hash) {
+    // the low 7 bits, which choosing the group doesn't use
+    return hash & 0x7F;
+}
+
+template<typename Key, typename Value, typename KeyOf, typename Hash, typename KeyEqual>
+inline uint32_t SwissTable<Key, Value, KeyOf, Hash, KeyEqual>::match_byte(const uint8_t* group, uint8_t byte) {
+#ifdef __SSE2__
+    __m128i bytes = _mm_loadu_si128((const __m128i*) group);
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8((char) byte)));
+#else
+    uint32_t mask = 0;
+    for (size_t i = 0; i < group_size; ++i) {
+        mask |= uint32_t(group[i] == byte) << i;
+    }
+    return mask;
+#endif
+}
+
+template<typename Key, typename Value, typename KeyOf, typename Hash, typename KeyEqual>
+inline uint32_t SwissTable<Key, Value, KeyOf, Hash, KeyEqual>::match_free(const uint8_t* group) {
+    // empty and deleted slots are the ones with the high bit set
+#ifdef __SSE2__
+    return _mm_movemask_epi8(_mm_loadu_si128((const __m128i*) group));
+#else
+    uint32_t mask = 0;
+    for (size_t i = 0; i < group_size; ++i) {
+        mask |= uint32_t(group[i] >> 7) << i;
+    }
+    return mask;
+#endif
+}
+
+template<typename Key, typename Value, typename KeyOf, typename Hash, typename KeyEqual>
+inline uint32_t SwissTable<Key, Value, KeyOf, Hash, KeyEqual>::match_empty(const uint8_t* group) {
+    return match_byte(group, empty_slot);
+}
+
+/////////////////////
+/// SwissTable::iterator_base
+/////////////////////
+
+template<typename Key, typename Value, typename KeyOf, typename Hash, typename KeyEqual>
+template<bool Const>
+inline SwissTable<Key, Value, KeyOf, Hash, KeyEqual>::iterator_base<Const>::iterator_base(const SwissTable* table,
+                                                                                          size_t index) :
+    table(table), index(index) {
+    // Nothing to do
+}
+
+template<typename Key, typename Value, typename KeyOf, typename Hash, typename KeyEqual>
+template<bool Const>
+inline SwissTable<Key, Value, KeyOf, Hash, KeyEqual>::iterator_base<Const>::iterator_base(const iterator_base<false>& other) :
+    table(other.table), index(other.index) {
+    // Nothing to do
+}
+
+template<typename Key, typename Value, typename KeyOf, typename Hash, typename KeyEqual>
+template<bool Const>
+inline typename SwissTable<Key, Value, KeyOf, Hash, KeyEqual>::template iterator_base<Const>::reference
+SwissTable<Key, Value, KeyOf, Hash, KeyEqual>::iterator_base<Const>::operator*() const {
+    return table->slots[index];
+}
+
+template<typename Key, typename Value, typename KeyOf, typename Hash, typename KeyEqual>
+template<bool Const>
+inline typename SwissTable<Key, Value, KeyOf, Hash, KeyEqual>::template iterator_base<Const>::pointer
+SwissTable<Key, Value, KeyOf, Hash, KeyEqual>::iterator_base<Const>::operator->() const {
+    return table->slots + index;
+}
+
+template<typename Key, typename Value, typename KeyOf, typename Hash, typename KeyEqual>
+template<bool Const>
+inline typename SwissTable<Key, Value, KeyOf, Hash, KeyEqual>::template iterator_base<Const>&
+SwissTable<Key, Value, KeyOf, Hash, KeyEqual>::iterator_base<Const>::operator++() {
+    ++index;
+    skip_free();
+    return *this;
+}
+
+template<typename Key, typename Value, typename KeyOf, typename Hash, typename KeyEqual>
+template<bool Const>
+inline typename SwissTable<Key, Value, KeyOf, Hash, KeyEqual>::template iterator_base<Const>
+SwissTable<Key, Value, KeyOf, Hash, KeyEqual>::iterator_base<Const>::operator++(int) {
+    iterator_base copy = *this;
+    ++(*this);
+    return copy;
+}
+
+template<typename Key, typename Value, typename KeyOf, typename Hash, typename KeyEqual>
+template<bool Const>
+template<bool OtherConst>
+inline bool SwissTable<Key, Value, KeyOf, Hash, KeyEqual>::iterator_base<Const>::operator==(const iterator_base<OtherConst>& other) const {
+    return table == other.table && index == other.index;
+}
+
+template<typename Key, typename Value, typename KeyOf, typename Hash, typename KeyEqual>
+template<bool Const>
+template<bool OtherConst>
+inline bool SwissTable<Key, Value, KeyOf, Hash, KeyEqual>::iterator_base<Const>::operator!=(const iterator_base<OtherConst>& other) const {
+    return !(*this == other);
+}
+
+template<typename Key, typename Value, typename KeyOf, typename Hash, typename KeyEqual>
+template<bool Const>
+inline void SwissTable<Key, Value, KeyOf, Hash, KeyEqual>::iterator_base<Const>::skip_free() {
+    size_t capacity = table->bucket_count();
+    while (index < capacity) {
+        if (index % group_size == 0) {
+            // skip whole groups of free slots at a time
+            uint32_t full = ~match_free(table->control + index) & 0xFFFF;
+            if (!full) {
+                index += group_size;
+                continue;
+            }
+            index += __builtin_ctz(full);
+            return;
+        }
+        if (!(table->control[index] & empty_slot)) {
+            return;
+        }
+        ++index;
+    }
+}
+
+/////////////////////
+/// SwissMap
+/////////////////////
+
+template<typename K, typename V, typename Hash, typename KeyEqual>
+inline V& SwissMap<K, V, Hash, KeyEqual>::operator[](const K& key) {
+    auto found = this->find_or_emplace(key, std::piecewise_construct, std::forward_as_tuple(key), std::tuple<>());
+    return this->slots[found.first].second;
+}
+
+template<typename K, typename V, typename Hash, typename KeyEqual>
+inline V& SwissMap<K, V, Hash, KeyEqual>::at(const K& key) {
+    size_t slot = this->find_slot(key);
+    if (slot == this->bucket_count()) {
+        throw std::out_of_range("error:[SwissMap] key not found");
+    }
+    return this->slots[slot].second;
+}
+
+template<typename K, typename V, typename Hash, typename KeyEqual>
+inline const V& SwissMap<K, V, Hash, KeyEqual>::at(const K& key) const {
+    size_t slot = this->find_slot(key);
+    if (slot == this->bucket_count()) {
+        throw std::out_of_range("error:[SwissMap] key not found");
+    }
+    return this->slots[slot].second;
+}
+
+}
+
+#endif
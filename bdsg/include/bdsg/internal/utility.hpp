@@ -1,10 +1,16 @@
 #ifndef BDSG_UTILITY_HPP_INCLUDED
 #define BDSG_UTILITY_HPP_INCLUDED
 
+#include <algorithm>
+#include <atomic>
 #include <string>
 #include <sstream>
 #include <iomanip>
 #include <functional>
+#include <streambuf>
+#include <type_traits>
+#include <vector>
+#include <ostream>
 
 namespace bdsg {
 
@@ -60,6 +66,148 @@ string format_memory(size_t s);
 /// TODO: Assumes that this is the same for every parallel section.
 int get_thread_count(void);
 
+/// Return the number of the calling thread in the current OMP team, or 0
+/// outside of a parallel section.
+int get_thread_num(void);
+
+/// Sort a random access range with OMP threads, by sorting a chunk per thread
+/// and then merging the chunks pairwise. Not stable.
+template<typename Iterator>
+void parallel_sort(Iterator begin, Iterator end);
+
+/// Run an iteratee on each of a set of weighted items, in OMP tasks. Items
+/// are handed out heaviest first, and light ones are grouped into tasks of
+/// about task_weight in total, so that the longest jobs start early and the
+/// short ones fill in around them. The items are (weight, item) pairs, and get
+/// reordered. The iteratee may return bool or void; if it returns false,
+/// iteration stops on a best-effort basis, and false is returned.
+template<typename Item, typename Iteratee>
+bool parallel_for_each_weighted(std::vector<std::pair<size_t, Item>>& items, size_t task_weight,
+                                const Iteratee& iteratee);
+
+/// A read-only stream buffer over a block of memory that we do not own, so
+/// that it can be read with an istream without copying it into a string.
+class MemoryStreambuf : public std::streambuf {
+public:
+    inline MemoryStreambuf(const char* data, size_t length) {
+        char* begin = const_cast<char*>(data);
+        setg(begin, begin, begin + length);
+    }
+};
+
+/// A tree describing how many bytes each component of a data structure takes
+/// up, for capacity planning. The bytes of a component include those of its
+/// subcomponents.
+struct MemoryBreakdown {
+    MemoryBreakdown() = default;
+    MemoryBreakdown(const string& name, size_t bytes = 0);
+    
+    /// Add a subcomponent, counting its bytes toward this component. Returns
+    /// this component, so calls can be chained.
+    MemoryBreakdown& add(const MemoryBreakdown& component);
+    
+    /// Add a subcomponent with no subcomponents of its own, counting its bytes
+    /// toward this component. Returns this component, so calls can be chained.
+    MemoryBreakdown& add(const string& name, size_t bytes);
+    
+    /// Get the subcomponent with the given name, or null if there isn't one.
+    const MemoryBreakdown* find(const string& name) const;
+    
+    /// Write the tree in a human-readable indented form.
+    void print(ostream& out, size_t indent = 0) const;
+    
+    /// The name of the component
+    string name;
+    /// The total bytes in the component
+    size_t bytes = 0;
+    /// The subcomponents, in the order they were added
+    vector<MemoryBreakdown> components;
+};
+
+template<typename Iterator>
+void parallel_sort(Iterator begin, Iterator end) {
+    // Don't bother splitting up ranges that are too small for it to pay off
+    static const size_t MIN_CHUNK_SIZE = 4096;
+    size_t length = end - begin;
+    size_t chunk_count = std::min<size_t>(get_thread_count(), length / MIN_CHUNK_SIZE);
+    if (chunk_count <= 1) {
+        std::sort(begin, end);
+        return;
+    }
+    
+    std::vector<size_t> bounds(chunk_count + 1);
+    for (size_t i = 0; i <= chunk_count; i++) {
+        bounds[i] = (length * i) / chunk_count;
+    }
+    
+    #pragma omp parallel for
+    for (size_t i = 0; i < chunk_count; i++) {
+        std::sort(begin + bounds[i], begin + bounds[i + 1]);
+    }
+    
+    // Merge sorted runs of chunks into runs twice as long
+    for (size_t width = 1; width < chunk_count; width *= 2) {
+        #pragma omp parallel for
+        for (size_t i = 0; i < chunk_count; i += 2 * width) {
+            if (i + width < chunk_count) {
+                std::inplace_merge(begin + bounds[i], begin + bounds[i + width],
+                                   begin + bounds[std::min(i + 2 * width, chunk_count)]);
+            }
+        }
+    }
+}
+
+/// Call an iteratee that may return either bool or void, and report whether
+/// iteration should continue. Used by the templated iteration fast paths, so
+/// that the call can be inlined instead of going through a std::function.
+template<typename Iteratee, typename... Iterated>
+inline typename std::enable_if<std::is_void<decltype(std::declval<const Iteratee&>()(std::declval<const Iterated&>()...))>::value, bool>::type
+call_iteratee(const Iteratee& iteratee, const Iterated&... items) {
+    iteratee(items...);
+    return true;
+}
+
+template<typename Iteratee, typename... Iterated>
+inline typename std::enable_if<!std::is_void<decltype(std::declval<const Iteratee&>()(std::declval<const Iterated&>()...))>::value, bool>::type
+call_iteratee(const Iteratee& iteratee, const Iterated&... items) {
+    return iteratee(items...);
+}
+
+template<typename Item, typename Iteratee>
+bool parallel_for_each_weighted(std::vector<std::pair<size_t, Item>>& items, size_t task_weight,
+                                const Iteratee& iteratee) {
+    std::sort(items.begin(), items.end(), [](const std::pair<size_t, Item>& a, const std::pair<size_t, Item>& b) {
+        return a.first > b.first;
+    });
+    std::atomic<bool> keep_going(true);
+    #pragma omp parallel
+    {
+        #pragma omp single
+        {
+            size_t begin = 0;
+            while (begin < items.size() && keep_going) {
+                // take items until the task has enough work, counting each
+                // item as at least some work
+                size_t end = begin;
+                size_t weight = 0;
+                do {
+                    weight += items[end].first + 1;
+                    ++end;
+                } while (end < items.size() && weight < task_weight);
+                #pragma omp task firstprivate(begin, end)
+                {
+                    for (size_t i = begin; i < end && keep_going; ++i) {
+                        if (!call_iteratee(iteratee, items[i].second)) {
+                            keep_going = false;
+                        }
+                    }
+                }
+                begin = end;
+            }
+        }
+    }
+    return keep_going;
+}
 }
 
 #endif
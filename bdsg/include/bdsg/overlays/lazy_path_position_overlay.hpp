@@ -0,0 +1,136 @@
+//
+//  lazy_path_position_overlay.hpp
+//
+//  Contains a variant of the PackedPositionOverlay that only indexes the paths
+//  that are actually queried, when they are first queried.
+//
+
+#ifndef BDSG_LAZY_PATH_POSITION_OVERLAY_HPP_INCLUDED
+#define BDSG_LAZY_PATH_POSITION_OVERLAY_HPP_INCLUDED
+
+#include <list>
+#include <memory>
+#include <mutex>
+
+#include <bdsg/overlays/packed_path_position_overlay.hpp>
+
+namespace bdsg {
+
+using namespace std;
+using namespace handlegraph;
+
+/*
+ * An overlay that adds the PathPositionHandleGraph interface to a static
+ * PathHandleGraph, like the PackedPositionOverlay, but builds the index for
+ * each path the first time a position query needs it, instead of indexing
+ * every path up front. This suits graphs with many paths of which only a few
+ * are ever queried.
+ *
+ * Each path gets its own index. Queries are thread safe, and different paths
+ * can be indexed by different threads at once. If a memory budget is given,
+ * the least recently used indexes are dropped when the indexes together use
+ * more than the budget, and are rebuilt if they are needed again. The most
+ * recently built index is always kept, even if it alone is over the budget.
+ *
+ * The indexes are not serializable.
+ */
+class LazyPositionOverlay : public PackedPositionOverlay {
+
+public:
+
+    /// Make a LazyPositionOverlay on the given graph, which keeps at most
+    /// about memory_budget bytes of path indexes, or all of them if
+    /// memory_budget is 0.
+    LazyPositionOverlay(const PathHandleGraph* graph, size_t memory_budget = 0);
+    LazyPositionOverlay() = default;
+    LazyPositionOverlay(const LazyPositionOverlay& other) = delete;
+    LazyPositionOverlay(LazyPositionOverlay&& other) = delete;
+    ~LazyPositionOverlay() = default;
+    LazyPositionOverlay& operator=(const LazyPositionOverlay& other) = delete;
+    LazyPositionOverlay& operator=(LazyPositionOverlay&& other) = delete;
+
+    ////////////////////////////////////////////////////////////////////////////
+    // Path position interface
+    ////////////////////////////////////////////////////////////////////////////
+
+    /// Returns the length of a path measured in bases of sequence.
+    virtual size_t get_path_length(const path_handle_t& path_handle) const;
+
+    /// Returns the position along the path of the beginning of this step measured in
+    /// bases of sequence. In a circular path, positions start at the step returned by
+    /// path_begin().
+    virtual size_t get_position_of_step(const step_handle_t& step) const;
+
+    /// Returns the step at this position, measured in bases of sequence starting at
+    /// the step returned by path_begin(). If the position is past the end of the
+    /// path, returns path_end().
+    virtual step_handle_t get_step_at_position(const path_handle_t& path,
+                                               const size_t& position) const;
+
+    /// Fill out with the step at each of the given positions on the path, as
+    /// get_step_at_position() would return. The positions should be sorted,
+    /// so that the lookups can carry on from one another instead of each
+    /// searching the whole path.
+    virtual void get_steps_at_positions(const path_handle_t& path,
+                                        const vector<size_t>& sorted_positions,
+                                        vector<step_handle_t>& out) const;
+
+    /// Fill out with the position of each of the given steps on the path, as
+    /// get_position_of_step() would return.
+    virtual void get_positions_of_steps(const path_handle_t& path,
+                                        const vector<step_handle_t>& steps,
+                                        vector<size_t>& out) const;
+
+    /// Returns the number of paths that currently have indexes.
+    size_t get_indexed_path_count() const;
+
+    /// Measure how many bytes each component of the overlay's indexes takes.
+    virtual MemoryBreakdown memory_breakdown() const;
+
+protected:
+
+    /// Serialization is not supported, so this throws.
+    virtual void serialize_members(ostream& out) const;
+
+    /// Serialization is not supported, so this throws.
+    virtual void deserialize_members(istream& in);
+
+    /// Get the index for the given path, building it if necessary. The index
+    /// stays valid while the pointer is held, even if it is evicted.
+    shared_ptr<const PathIndex> get_index(const path_handle_t& path) const;
+
+    /// Index all the steps of the given path into an empty PathIndex.
+    void build_index(const path_handle_t& path, PathIndex& index) const;
+
+    /// Get the range covering the single path in an index.
+    static PathRange whole_range(const PathIndex& index);
+
+    /// Measure the bytes used by an index.
+    static size_t index_memory_usage(const PathIndex& index);
+
+    /// An index that has been built, and where it is in the LRU order.
+    struct CachedIndex {
+        shared_ptr<const PathIndex> index;
+        size_t bytes;
+        list<int64_t>::iterator lru_position;
+    };
+
+    /// The most bytes of indexes to keep, or 0 for no limit.
+    size_t memory_budget = 0;
+
+    /// Protects the cache, the LRU order, and the byte count.
+    mutable mutex cache_mutex;
+
+    /// The built indexes by path handle
+    mutable hash_map<int64_t, CachedIndex> cache;
+
+    /// The paths with indexes, most recently used first
+    mutable list<int64_t> lru;
+
+    /// The total bytes used by the cached indexes
+    mutable size_t cached_bytes = 0;
+};
+
+}
+
+#endif
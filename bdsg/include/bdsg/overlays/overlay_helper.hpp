@@ -23,6 +23,7 @@ using namespace handlegraph;
 // The templates used to generate the overlay helpers
 template<typename T, typename U, typename V> class OverlayHelper;
 template<typename T1, typename U1, typename V1, typename T2, typename U2, typename V2> class PairOverlayHelper;
+template<typename T1, typename T2, typename U2, typename V2, typename F, typename V> class FusedPairOverlayHelper;
 
 /// Helper to ensure that a PathHandleGraph has the PathPositionHandleGraph interface
 typedef OverlayHelper<PathPositionHandleGraph, PackedPositionOverlay, PathHandleGraph> PathPositionOverlayHelper;
@@ -48,8 +49,9 @@ typedef OverlayHelper<VectorizableHandleGraph, VectorizableOverlay, HandleGraph>
 typedef OverlayHelper<VectorizableHandleGraph, PathVectorizableOverlay, PathHandleGraph> PathVectorizableOverlayHelper;
 
 /// Helper to ensure that a PathHandleGraph has the VectorizableHandleGraph and PathPositionHandleGraph interfaces.
-typedef PairOverlayHelper<PathPositionHandleGraph, PackedPositionOverlay, PathHandleGraph,
-VectorizableHandleGraph, PathPositionVectorizableOverlay, PathPositionHandleGraph> PathPositionVectorizableOverlayHelper;
+/// If the graph has neither, a single PackedPositionVectorizableOverlay provides both.
+typedef FusedPairOverlayHelper<PathPositionHandleGraph, VectorizableHandleGraph, PathPositionVectorizableOverlay,
+PathPositionHandleGraph, PackedPositionVectorizableOverlay, PathHandleGraph> PathPositionVectorizableOverlayHelper;
 
 /// Helper to ensure that a PathHandleGraph has the VectorizableHandleGraph and PathPositionHandleGraph interfaces,
 /// But ising the GBZ-optimized ReferencePath Overlay instead of the vanilla PathPosition Overlay
@@ -122,6 +124,64 @@ protected:
     OverlayHelper<T2, U2, V2> overlay2;
 };
 
+/// Implementation of overlay helper functionality for when two interfaces are
+/// needed, and one overlay can provide both at once.
+/// T1 = first desired class
+/// T2 = second desired class, which is returned
+/// U2 = overlay class adding T2 to a V2
+/// V2 = input class for U2, which must be a T1
+/// F = overlay class adding T1 and T2 to a V
+/// V = input class
+template<typename T1, typename T2, typename U2, typename V2, typename F, typename V>
+class FusedPairOverlayHelper {
+public:
+    // Handle non-const base graph
+    T2* apply(V* input_graph) {
+        T2* mutable_overlaid = dynamic_cast<T2*>(input_graph);
+        if (mutable_overlaid == nullptr || dynamic_cast<T1*>(input_graph) == nullptr) {
+            V2* partly_overlaid = dynamic_cast<V2*>(input_graph);
+            if (partly_overlaid != nullptr) {
+                // only the second interface is missing
+                overlay = make_unique<U2>(partly_overlaid);
+                mutable_overlaid = overlay.get();
+            }
+            else {
+                fused_overlay = make_unique<F>(input_graph);
+                mutable_overlaid = fused_overlay.get();
+            }
+        }
+        overlaid = mutable_overlaid;
+        return mutable_overlaid;
+    }
+    
+    // Handle const base graph
+    const T2* apply(const V* input_graph) {
+        overlaid = dynamic_cast<const T2*>(input_graph);
+        if (overlaid == nullptr || dynamic_cast<const T1*>(input_graph) == nullptr) {
+            const V2* partly_overlaid = dynamic_cast<const V2*>(input_graph);
+            if (partly_overlaid != nullptr) {
+                // only the second interface is missing
+                overlay = make_unique<U2>(partly_overlaid);
+                overlaid = overlay.get();
+            }
+            else {
+                fused_overlay = make_unique<F>(input_graph);
+                overlaid = fused_overlay.get();
+            }
+        }
+        return overlaid;
+    }
+    
+    // In general we can only get the const overlay later.
+    const T2* get() const {
+        return overlaid;
+    }
+protected:
+    unique_ptr<U2> overlay;
+    unique_ptr<F> fused_overlay;
+    const T2* overlaid = nullptr;
+};
+
 }
 
 #endif
@@ -12,11 +12,15 @@
 #include <handlegraph/mutable_path_deletable_handle_graph.hpp>
 #include <handlegraph/path_position_handle_graph.hpp>
 #include <handlegraph/expanding_overlay_graph.hpp>
+#include <handlegraph/serializable_handle_graph.hpp>
 #include <handlegraph/util.hpp>
 #include <BooPHF.h>
 
+#include <unordered_set>
+
 #include "bdsg/internal/hash_map.hpp"
 #include "bdsg/internal/packed_structs.hpp"
+#include "bdsg/internal/utility.hpp"
 
 namespace bdsg {
     
@@ -26,15 +30,28 @@ using namespace handlegraph;
 /*
  * An overlay that adds the PathPositionHandleGraph interface to a static PathHandleGraph
  * by augmenting it with compressed index data structures
+ *
+ * The indexes can be serialized and loaded back on top of the same backing
+ * graph, to save rebuilding them. This only works for graph implementations
+ * whose path and step handles survive their own serialization, like
+ * PackedGraph; it does not work with HashGraph.
  */
-class PackedPositionOverlay : public PathPositionHandleGraph, public ExpandingOverlayGraph {
+class PackedPositionOverlay : public PathPositionHandleGraph, public ExpandingOverlayGraph, public SerializableHandleGraph {
         
 public:
     
     /// Make a new PackedPositionOverlay, on the given graph. Glom short paths
     /// together to make internal indexes each over at least the given number
     /// of steps.
-    PackedPositionOverlay(const PathHandleGraph* graph, size_t steps_per_index = 1000000);
+    ///
+    /// At most concurrent_indexes of the internal indexes are built at once
+    /// (0 for one per thread), and the threads are shared out among them for
+    /// building their hash functions, so peak construction memory scales with
+    /// concurrent_indexes * steps_per_index. If low_memory is set, the hash
+    /// function builds re-stream the steps from the graph on every pass
+    /// instead of caching some of them.
+    PackedPositionOverlay(const PathHandleGraph* graph, size_t steps_per_index = 1000000,
+                          size_t concurrent_indexes = 0, bool low_memory = false);
     PackedPositionOverlay() = default;
     PackedPositionOverlay(const PackedPositionOverlay& other) = default;
     PackedPositionOverlay(PackedPositionOverlay&& other) = default;
@@ -42,6 +59,10 @@ public:
     PackedPositionOverlay& operator=(const PackedPositionOverlay& other) = default;
     PackedPositionOverlay& operator=(PackedPositionOverlay&& other) = default;
 
+    /// Set the graph to overlay, prior to loading indexes built on it with
+    /// deserialize().
+    void set_graph(const PathHandleGraph* graph);
+    
     ////////////////////////////////////////////////////////////////////////////
     // HandleGraph interface
     ////////////////////////////////////////////////////////////////////////////
@@ -213,6 +234,20 @@ public:
     step_handle_t get_step_at_position(const path_handle_t& path,
                                        const size_t& position) const;
     
+    /// Fill out with the step at each of the given positions on the path, as
+    /// get_step_at_position() would return. The positions should be sorted,
+    /// so that the lookups can carry on from one another instead of each
+    /// searching the whole path.
+    virtual void get_steps_at_positions(const path_handle_t& path,
+                                        const vector<size_t>& sorted_positions,
+                                        vector<step_handle_t>& out) const;
+    
+    /// Fill out with the position of each of the given steps on the path, as
+    /// get_position_of_step() would return.
+    virtual void get_positions_of_steps(const path_handle_t& path,
+                                        const vector<step_handle_t>& steps,
+                                        vector<size_t>& out) const;
+    
     ////////////////////////////////////////////////////////////////////////////
     // Expanding overlay interface
     ////////////////////////////////////////////////////////////////////////////
@@ -223,16 +258,46 @@ public:
      */
     handle_t get_underlying_handle(const handle_t& handle) const;
     
+    /**
+     * Measure how many bytes each component of the overlay's index takes, as
+     * a tree of component names and sizes. Does not count the backing graph.
+     */
+    virtual MemoryBreakdown memory_breakdown() const;
+    
+    ////////////////////////////////////////////////////////////////////////////
+    // Serializable interface
+    ////////////////////////////////////////////////////////////////////////////
+    
+    /// Returns a number that is specific to the serialized implementation for type
+    /// checking. Does not depend on the contents of any particular instantiation
+    /// (i.e. behaves as if static, but cannot be static because it is virtual).
+    virtual uint32_t get_magic_number() const;
+    
 protected:
     
+    /// Write the indexes to a stream. The backing graph is not included.
+    virtual void serialize_members(ostream& out) const;
+    
+    /// Read the indexes from a stream, replacing any current ones. The
+    /// backing graph must already be set, and must be the graph the indexes
+    /// were built on.
+    virtual void deserialize_members(istream& in);
+    
+    /// Make sure the loaded path ranges agree with the backing graph's paths,
+    /// or throw.
+    void check_path_ranges() const;
     
     // local BBHash style hash function for step handles
     struct StepHash {
         uint64_t operator()(const step_handle_t& step, uint64_t seed = 0xAAAAAAAA55555555ULL) const;
     };
     
-    /// Construct the index over path positions
-    void index_path_positions();
+    /// Construct the index over path positions. If any of senses, samples,
+    /// or loci are set, only index the paths that for_each_path_matching()
+    /// finds with them.
+    void index_path_positions(const std::unordered_set<PathSense>* senses = nullptr,
+                              const std::unordered_set<std::string>* samples = nullptr,
+                              const std::unordered_set<std::string>* loci = nullptr);
     
     /// Get the length in steps of the given path. Also do any scanning necessary for the path to generate per-path user data.
     virtual size_t scan_path(const path_handle_t& path_handle, void*& user_data);
@@ -243,12 +308,26 @@ protected:
     /// Into index i, index the given range of paths, with the given total size in steps. Consumes and destroys any per-path user data.
     virtual void index_paths(size_t index_num, const std::vector<path_handle_t>::const_iterator& begin_path, const std::vector<path_handle_t>::const_iterator& end_path, size_t cumul_path_size, void** user_data_base);
     
+    /// Get the fraction of the keys that hash function builds should cache
+    /// in memory between passes.
+    float hash_keys_cached() const;
+    
     /// The graph we're overlaying
     const PathHandleGraph* graph = nullptr;
     
     /// The number of steps we target when coalescing small paths into larger indexes.
     size_t steps_per_index;
     
+    /// The most indexes to build at once, or 0 for one per thread.
+    size_t concurrent_indexes = 0;
+    
+    /// Whether hash function builds should stream all their keys from the graph.
+    bool low_memory = false;
+    
+    /// The number of threads each index's hash functions are built with.
+    /// Only meaningful during construction.
+    size_t threads_per_index = 1;
+    
     /// To facillitate parallel construction, we keep the index info for each
     /// path (or collection of tiny paths) in a separate object.
     struct PathIndex {
@@ -268,6 +347,12 @@ protected:
         
         /// The position of the step that hashes to a given index
         PackedVector<> step_positions;
+        
+        /// Write the index to a stream
+        void serialize(ostream& out) const;
+        
+        /// Read the index from a stream
+        void deserialize(istream& in);
     };
     
     /// This holds the indexes, each of which belongs to a path or collection
@@ -280,6 +365,24 @@ protected:
         size_t start;
         size_t end;
     };
+
+    // Queries against one PathIndex and the range of a path in it
+    
+    /// Get the length in bases of the path in the range.
+    size_t path_length_in(const PathIndex& index, const PathRange& range) const;
+    
+    /// Get the position of a step, which must not be past the end, on a path
+    /// in the index.
+    size_t position_in(const PathIndex& index, const step_handle_t& step) const;
+    
+    /// Get the step at a position, which must be before the end of the path
+    /// in the range.
+    step_handle_t step_at_position_in(const PathIndex& index, const PathRange& range, size_t position) const;
+    
+    /// Get the steps at a batch of positions on the path in the range, with
+    /// the given past-the-end step for the positions after its end.
+    void steps_at_positions_in(const PathIndex& index, const PathRange& range, const step_handle_t& end,
+                               const vector<size_t>& sorted_positions, vector<step_handle_t>& out) const;
     
     /// Map from path_handle to the index and range of positions that contain
     /// its records in the steps and positions vectors. Note that access to
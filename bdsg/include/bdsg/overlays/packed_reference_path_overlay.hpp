@@ -29,7 +29,19 @@ public:
 
     /// Make a PackedReferencePathOverlay. Do the indexing and compute the
     /// additional indexes that the base class doesn't have.
-    PackedReferencePathOverlay(const PathHandleGraph* graph, size_t steps_per_index = 1000000);
+    PackedReferencePathOverlay(const PathHandleGraph* graph, size_t steps_per_index = 1000000,
+                               size_t concurrent_indexes = 0, bool low_memory = false);
+
+    /// Make a PackedReferencePathOverlay over only the paths that
+    /// for_each_path_matching() finds with the given senses, samples, and
+    /// loci, any of which may be null to not filter on it. Only steps on
+    /// those paths are found by for_each_step_on_handle(), and only those
+    /// paths can have position queries made on them.
+    PackedReferencePathOverlay(const PathHandleGraph* graph, const std::unordered_set<PathSense>* senses,
+                               const std::unordered_set<std::string>* samples = nullptr,
+                               const std::unordered_set<std::string>* loci = nullptr,
+                               size_t steps_per_index = 1000000, size_t concurrent_indexes = 0,
+                               bool low_memory = false);
     
     // We assume that tracing out a path is fast in the backing graph, but
     // finding visits on nodes is slow. We override the reverse lookups to go
@@ -37,9 +49,25 @@ public:
 
     /// overload this to use the cache 
     virtual path_handle_t get_path_handle_of_step(const step_handle_t& step_handle) const;
+    
+    /// Measure how many bytes each component of the overlay's indexes takes,
+    /// including the visit indexes.
+    virtual MemoryBreakdown memory_breakdown() const;
+    
+    /// Returns a number that is specific to the serialized implementation for type
+    /// checking.
+    virtual uint32_t get_magic_number() const;
 
 protected:
     
+    /// Write the indexes, including the visit indexes, to a stream. The
+    /// backing graph is not included.
+    virtual void serialize_members(ostream& out) const;
+    
+    /// Read the indexes from a stream, replacing any current ones. The
+    /// backing graph must already be set.
+    virtual void deserialize_members(istream& in);
+    
     // PathHandleGraph interface
     
     /// Calls the given function for each step of the given handle on a path.
@@ -61,6 +89,10 @@ protected:
 
     // Construction utilities
     
+    /// The node ID and rank of each step on a path, or on a collection of
+    /// paths, sorted by node ID and then rank.
+    typedef std::vector<std::pair<nid_t, size_t>> VisitRanks;
+    
     // local BBHash style hash function for handles 
     struct HandleHash {
         uint64_t operator()(const handle_t& handle, uint64_t seed = 0xAAAAAAAA55555555ULL) const;
@@ -95,7 +127,12 @@ protected:
         /// Since we're binning the hashes, we need this to verify collisions in bbhash.
         PackedVector<> step_to_step1;
         PackedVector<> step_to_step2;
-
+        
+        /// Write the index to a stream
+        void serialize(ostream& out) const;
+        
+        /// Read the index from a stream
+        void deserialize(istream& in);
     };
 
     /// This holds the indexes, each of which belongs to a path or collection
@@ -111,11 +148,15 @@ protected:
 
 /*
  * A wrapper for constructing the perfect minimal hash function that sequentially
- * returns all unique keys in a key-value multi-container.
+ * returns all unique keys in a key-value multi-container, or in a container of
+ * key-value pairs sorted by key.
  */
 template<typename Container>
 struct UniqueKeyRange {
 public:
+    /// The type of the keys, so the container need not be a map
+    typedef typename std::remove_const<typename Container::value_type::first_type>::type key_type;
+    
     /// Set up for iteration over all paths in the given graph
     UniqueKeyRange(const Container& container) : container(container) {
         // Nothing to do!
@@ -130,14 +171,14 @@ public:
         ~iterator() = default;
         iterator& operator=(const iterator& other) = default;
         iterator& operator++() {
-            typename Container::key_type same_key = **this;
+            key_type same_key = **this;
             do {
                 // Scan past the current key
                 ++wrapped;
             } while (wrapped != end && **this == same_key);
             return *this;
         }
-        typename Container::key_type operator*() const {
+        key_type operator*() const {
             return wrapped->first;
         }
         bool operator==(const iterator& other) const {
@@ -16,6 +16,8 @@
 #include <handlegraph/path_position_handle_graph.hpp>
 #include <handlegraph/expanding_overlay_graph.hpp>
 
+#include "bdsg/internal/step_position_tree.hpp"
+
 namespace bdsg {
     
 using namespace std;
@@ -246,6 +248,7 @@ protected:
  * by augmenting it with relatively simple data structures.
  */
 class MutablePositionOverlay : public PositionOverlay, public MutablePathDeletableHandleGraph {
+protected:
 
     // Because virtual base classes and multiple inheritance are involved, we
     // can't really safely go back from the PathHandleGraph* our base class
@@ -395,7 +398,7 @@ public:
      */
     void set_circularity(const path_handle_t& path, bool circular);
     
-private:
+protected:
     
     /// Clear indexes and rebuild them
     void reindex_path_position();
@@ -410,6 +413,108 @@ private:
     MutablePathDeletableHandleGraph* get_graph();
     
 };
+
+/*
+ * A MutablePositionOverlay that keeps each path's steps in a
+ * StepPositionTree instead of the ordered and hash maps of positions. Step
+ * positions are implicit in the tree, so edits to a path only touch the steps
+ * they change, instead of re-recording the positions of all the steps after
+ * them, and the index takes much less memory per step.
+ */
+class CompactMutablePositionOverlay : public MutablePositionOverlay {
+        
+public:
+    
+    CompactMutablePositionOverlay(MutablePathDeletableHandleGraph* graph);
+    CompactMutablePositionOverlay();
+    ~CompactMutablePositionOverlay();
+    
+    ////////////////////////////////////////////////////////////////////////////
+    // Path position interface
+    ////////////////////////////////////////////////////////////////////////////
+    
+    /// Returns the length of a path measured in bases of sequence.
+    size_t get_path_length(const path_handle_t& path_handle) const;
+    
+    /// Returns the position along the path of the beginning of this step measured in
+    /// bases of sequence. In a circular path, positions start at the step returned by
+    /// path_begin().
+    size_t get_position_of_step(const step_handle_t& step) const;
+    
+    /// Returns the step at this position, measured in bases of sequence starting at
+    /// the step returned by path_begin(). If the position is past the end of the
+    /// path, returns path_end().
+    step_handle_t get_step_at_position(const path_handle_t& path,
+                                       const size_t& position) const;
+    
+    ////////////////////////////////////////////////////////////////////////////
+    // MutableHandleGraph interface
+    ////////////////////////////////////////////////////////////////////////////
+    
+    /// Remove all nodes and edges.
+    void clear(void);
+    
+    /// Alter the node that the given handle corresponds to so the orientation
+    /// indicated by the handle becomes the node's local forward orientation.
+    /// Updates stored paths.
+    handle_t apply_orientation(const handle_t& handle);
+    
+    /// Split a handle's underlying node at the given offsets in the handle's
+    /// orientation. Returns all of the handles to the parts.
+    /// Updates stored paths.
+    vector<handle_t> divide_handle(const handle_t& handle, const std::vector<size_t>& offsets);
+    
+    /// Adjust the representation of the graph in memory to improve performance.
+    void optimize(bool allow_id_reassignment = true);
+    
+    /// Reorder the graph's internal structure to match that given.
+    bool apply_ordering(const vector<handle_t>& order, bool compact_ids = false);
+    
+    /// Add the given value to all node IDs.
+    void increment_node_ids(nid_t increment);
+    
+    /// Renumber all node IDs using the given function, which, given an old ID, returns the new ID.
+    void reassign_node_ids(const std::function<nid_t(const nid_t&)>& get_new_id);
+    
+    ////////////////////////////////////////////////////////////////////////////
+    // MutablePathHandleGraph interface
+    ////////////////////////////////////////////////////////////////////////////
+    
+    /// Destroy the given path. Invalidates handles to the path and its node steps.
+    void destroy_path(const path_handle_t& path);
+    
+    /// Create a path with the given name.
+    path_handle_t create_path_handle(const string& name, bool is_circular = false);
+    
+    /// Append a visit to a node to the given path.
+    step_handle_t append_step(const path_handle_t& path, const handle_t& to_append);
+    
+    /// Prepend a visit to a node to the given path.
+    step_handle_t prepend_step(const path_handle_t& path, const handle_t& to_prepend);
+    
+    /// Delete a segment of a path and rewrite it as some other sequence of
+    /// steps. Only the steps in the old and new segments are re-indexed.
+    pair<step_handle_t, step_handle_t> rewrite_segment(const step_handle_t& segment_begin,
+                                                       const step_handle_t& segment_end,
+                                                       const vector<handle_t>& new_segment);
+    
+    /// Returns the number of bytes used by the position indexes. Does not
+    /// count the backing graph.
+    size_t index_memory_usage() const;
+    
+protected:
+    
+    /// Clear the trees and rebuild them
+    void reindex_trees();
+    
+    /// Indexes all of the steps contiguous with this one that are missing
+    /// from the trees (e.g. after an edit operation). Does nothing if the step
+    /// is already indexed.
+    void reindex_contiguous_steps(const step_handle_t& step);
+    
+    /// The steps of each path, in order
+    unordered_map<path_handle_t, StepPositionTree> path_trees;
+};
     
 }
 
@@ -35,8 +35,13 @@ public:
      * Make a new PathSubgraphOverlay. The backing graph must not be modified
      * while the overlay exists.
      *
+     * If index_steps is set, the steps of the contained paths are grouped by
+     * node up front, so that for_each_step_on_handle() visits only the steps
+     * in the subgraph, without asking the backing graph for all the steps on
+     * the node and filtering out the steps on other paths.
      */
-    PathSubgraphOverlay(const PathHandleGraph* backing, const unordered_set<nid_t>* node_subset);
+    PathSubgraphOverlay(const PathHandleGraph* backing, const unordered_set<nid_t>* node_subset,
+                        bool index_steps = false);
 
     virtual ~PathSubgraphOverlay();
 
@@ -126,6 +131,19 @@ protected:
 
     /// the subset of paths from the backing graph that are entirely contained within our subgraph
     unordered_set<path_handle_t> path_subset;
+    
+    /// whether we have indexed the steps of our paths by node
+    bool steps_indexed;
+    
+    /// the IDs of the nodes with steps on our paths, in sorted order, if indexed
+    vector<nid_t> indexed_ids;
+    
+    /// where the steps on each indexed node start in indexed_steps, and a
+    /// final entry for the end of the last node's steps
+    vector<size_t> step_bounds;
+    
+    /// the steps of our paths, grouped by node and in path order within each node
+    vector<step_handle_t> indexed_steps;
 };
 
 }
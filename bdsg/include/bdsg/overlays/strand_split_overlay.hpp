@@ -8,6 +8,7 @@
  */
 
 #include <handlegraph/expanding_overlay_graph.hpp>
+#include <handlegraph/util.hpp>
 #include "bdsg/internal/utility.hpp"
 
 namespace bdsg {
@@ -99,6 +100,223 @@ using namespace handlegraph;
         /// The underlying graph we're making splitting
         const HandleGraph* graph = nullptr;
     };
+
+    /**
+     * A StrandSplitOverlay over a known, concrete graph type, for use in inner
+     * loops. Handles are converted to and from the underlying graph's with bit
+     * arithmetic, and the underlying graph's methods are called without
+     * virtual dispatch, so for a header-only graph like PackedGraph they can
+     * all be inlined. The Graph must provide follow_edges_fast() and
+     * for_each_handle_fast(), as PackedGraph and HashGraph do.
+     *
+     * Handles and IDs are interchangeable with a StrandSplitOverlay of the
+     * same graph.
+     */
+    template<typename Graph>
+    class TypedStrandSplitOverlay final : public ExpandingOverlayGraph {
+        
+    public:
+        
+        /// Initialize as the strand split version of another graph
+        TypedStrandSplitOverlay(const Graph* graph);
+        
+        /// Default constructor -- not actually functional
+        TypedStrandSplitOverlay() = default;
+        
+        /// Default destructor
+        ~TypedStrandSplitOverlay() = default;
+        
+        //////////////////////////
+        /// HandleGraph interface
+        //////////////////////////
+        
+        // Method to check if a node exists by ID
+        inline bool has_node(nid_t node_id) const;
+        
+        /// Look up the handle for the node with the given ID in the given orientation
+        inline handle_t get_handle(const nid_t& node_id, bool is_reverse = false) const;
+        
+        /// Get the ID from a handle
+        inline nid_t get_id(const handle_t& handle) const;
+        
+        /// Get the orientation of a handle
+        inline bool get_is_reverse(const handle_t& handle) const;
+        
+        /// Invert the orientation of a handle (potentially without getting its ID)
+        inline handle_t flip(const handle_t& handle) const;
+        
+        /// Get the length of a node
+        inline size_t get_length(const handle_t& handle) const;
+        
+        /// Get the sequence of a node, presented in the handle's local forward
+        /// orientation.
+        inline string get_sequence(const handle_t& handle) const;
+        
+        /// Loop over all the handles to next/previous (right/left) nodes. Passes
+        /// them to a callback which returns false to stop iterating and true to
+        /// continue. Returns true if we finished and false if we stopped early.
+        inline bool follow_edges_impl(const handle_t& handle, bool go_left,
+                                      const function<bool(const handle_t&)>& iteratee) const;
+        
+        /// Loop over all the nodes in the graph in their local forward
+        /// orientations, in their internal stored order. Stop if the iteratee
+        /// returns false. Can be told to run in parallel, in which case stopping
+        /// after a false return value is on a best-effort basis and iteration
+        /// order is not defined.
+        inline bool for_each_handle_impl(const function<bool(const handle_t&)>& iteratee,
+                                         bool parallel = false) const;
+        
+        /// Templated version of follow_edges(), which passes the iteratee
+        /// through to the underlying graph's follow_edges_fast() so that no
+        /// std::function is involved. The iteratee may return bool or void.
+        template<typename Iteratee>
+        bool follow_edges_fast(const handle_t& handle, bool go_left, const Iteratee& iteratee) const;
+        
+        /// Templated, serial version of for_each_handle(), for inlining the
+        /// iteratee. The iteratee may return bool or void.
+        template<typename Iteratee>
+        bool for_each_handle_fast(const Iteratee& iteratee) const;
+        
+        /// Return the number of nodes in the graph
+        inline size_t get_node_count() const;
+        
+        /// Return the smallest ID in the graph, or some smaller number if the
+        /// smallest ID is unavailable. Return value is unspecified if the graph is empty.
+        inline nid_t min_node_id() const;
+        
+        /// Return the largest ID in the graph, or some larger number if the
+        /// largest ID is unavailable. Return value is unspecified if the graph is empty.
+        inline nid_t max_node_id() const;
+        
+        ///////////////////////////////////
+        /// ExpandingOverlayGraph interface
+        ///////////////////////////////////
+        
+        /**
+         * Returns the handle in the underlying graph that corresponds to a handle in the
+         * overlay
+         */
+        inline handle_t get_underlying_handle(const handle_t& handle) const;
+        
+    private:
+        
+        /// Get the overlay handle for a handle we reached in the underlying
+        /// graph while traversing from an overlay handle with the given
+        /// orientation.
+        inline handle_t from_underlying(const handle_t& underlying, bool is_reverse) const;
+        
+        /// The underlying graph we're making splitting
+        const Graph* graph = nullptr;
+    };
+    
+    // Calls to the underlying graph are qualified with its type, so that
+    // they are bound statically.
+    
+    template<typename Graph>
+    TypedStrandSplitOverlay<Graph>::TypedStrandSplitOverlay(const Graph* graph) : graph(graph) {
+        // nothing to do
+    }
+    
+    template<typename Graph>
+    inline bool TypedStrandSplitOverlay<Graph>::has_node(nid_t node_id) const {
+        return graph->Graph::has_node(node_id >> 1);
+    }
+    
+    template<typename Graph>
+    inline handle_t TypedStrandSplitOverlay<Graph>::get_handle(const nid_t& node_id, bool is_reverse) const {
+        return handlegraph::number_bool_packing::pack(node_id, is_reverse);
+    }
+    
+    template<typename Graph>
+    inline nid_t TypedStrandSplitOverlay<Graph>::get_id(const handle_t& handle) const {
+        return handlegraph::number_bool_packing::unpack_number(handle);
+    }
+    
+    template<typename Graph>
+    inline bool TypedStrandSplitOverlay<Graph>::get_is_reverse(const handle_t& handle) const {
+        return handlegraph::number_bool_packing::unpack_bit(handle);
+    }
+    
+    template<typename Graph>
+    inline handle_t TypedStrandSplitOverlay<Graph>::flip(const handle_t& handle) const {
+        return handlegraph::number_bool_packing::toggle_bit(handle);
+    }
+    
+    template<typename Graph>
+    inline size_t TypedStrandSplitOverlay<Graph>::get_length(const handle_t& handle) const {
+        return graph->Graph::get_length(graph->Graph::get_handle(get_id(handle) >> 1));
+    }
+    
+    template<typename Graph>
+    inline string TypedStrandSplitOverlay<Graph>::get_sequence(const handle_t& handle) const {
+        return graph->Graph::get_sequence(get_underlying_handle(handle));
+    }
+    
+    template<typename Graph>
+    inline bool TypedStrandSplitOverlay<Graph>::follow_edges_impl(const handle_t& handle, bool go_left,
+                                                                  const function<bool(const handle_t&)>& iteratee) const {
+        return follow_edges_fast(handle, go_left, iteratee);
+    }
+    
+    template<typename Graph>
+    inline bool TypedStrandSplitOverlay<Graph>::for_each_handle_impl(const function<bool(const handle_t&)>& iteratee,
+                                                                     bool parallel) const {
+        if (!parallel) {
+            return for_each_handle_fast(iteratee);
+        }
+        return graph->Graph::for_each_handle([&](const handle_t& underlying_handle) {
+            nid_t node_id = graph->Graph::get_id(underlying_handle);
+            // forward version of the node, then reverse version of the node
+            return iteratee(get_handle(node_id << 1)) && iteratee(get_handle((node_id << 1) | 1));
+        }, true);
+    }
+    
+    template<typename Graph>
+    template<typename Iteratee>
+    bool TypedStrandSplitOverlay<Graph>::follow_edges_fast(const handle_t& handle, bool go_left, const Iteratee& iteratee) const {
+        bool is_reverse = get_is_reverse(handle);
+        return graph->follow_edges_fast(get_underlying_handle(handle), go_left, [&](const handle_t& next) {
+            return call_iteratee(iteratee, from_underlying(next, is_reverse));
+        });
+    }
+    
+    template<typename Graph>
+    template<typename Iteratee>
+    bool TypedStrandSplitOverlay<Graph>::for_each_handle_fast(const Iteratee& iteratee) const {
+        return graph->for_each_handle_fast([&](const handle_t& underlying_handle) {
+            nid_t node_id = graph->Graph::get_id(underlying_handle);
+            // forward version of the node, then reverse version of the node
+            return call_iteratee(iteratee, get_handle(node_id << 1))
+                && call_iteratee(iteratee, get_handle((node_id << 1) | 1));
+        });
+    }
+    
+    template<typename Graph>
+    inline size_t TypedStrandSplitOverlay<Graph>::get_node_count() const {
+        return graph->Graph::get_node_count() << 1;
+    }
+    
+    template<typename Graph>
+    inline nid_t TypedStrandSplitOverlay<Graph>::min_node_id() const {
+        return graph->Graph::min_node_id() << 1;
+    }
+    
+    template<typename Graph>
+    inline nid_t TypedStrandSplitOverlay<Graph>::max_node_id() const {
+        return (graph->Graph::max_node_id() << 1) | 1;
+    }
+    
+    template<typename Graph>
+    inline handle_t TypedStrandSplitOverlay<Graph>::get_underlying_handle(const handle_t& handle) const {
+        nid_t node_id = get_id(handle);
+        return graph->Graph::get_handle(node_id >> 1, ((node_id & 1) == 1) != get_is_reverse(handle));
+    }
+    
+    template<typename Graph>
+    inline handle_t TypedStrandSplitOverlay<Graph>::from_underlying(const handle_t& underlying, bool is_reverse) const {
+        return get_handle((graph->Graph::get_id(underlying) << 1) + (graph->Graph::get_is_reverse(underlying) != is_reverse),
+                          is_reverse);
+    }
 }
 
 #endif
@@ -0,0 +1,502 @@
+//
+//  subgraph_extractor.hpp
+//
+//  Defines a batched extractor for the neighborhoods around many positions in
+//  a graph, and the overlays it produces, which all share one backing array.
+//
+
+#ifndef BDSG_SUBGRAPH_EXTRACTOR_HPP_INCLUDED
+#define BDSG_SUBGRAPH_EXTRACTOR_HPP_INCLUDED
+
+#include <handlegraph/handle_graph.hpp>
+#include <handlegraph/expanding_overlay_graph.hpp>
+#include <handlegraph/util.hpp>
+
+#include <algorithm>
+#include <exception>
+#include <functional>
+#include <limits>
+#include <tuple>
+#include <vector>
+
+#include "bdsg/internal/hash_map.hpp"
+#include "bdsg/internal/utility.hpp"
+#include "bdsg/snarl_distance_index.hpp"
+
+namespace bdsg {
+
+using namespace std;
+using namespace handlegraph;
+
+class SubgraphBatch;
+
+/*
+ * One subgraph out of a SubgraphBatch, presented as a HandleGraph. Like the
+ * ContiguousSubgraphOverlay, the subgraph has some of the backing graph's
+ * nodes and all the edges between them, and its nodes are kept sorted in the
+ * order of the backing graph's handles. But the overlay doesn't own them: it
+ * points into the batch's storage, so it is cheap to make and copy, and is
+ * only valid as long as the batch it came from.
+ */
+class BatchSubgraphOverlay : public ExpandingOverlayGraph {
+
+public:
+
+    /// Make an overlay for the subgraph with the given index in the batch
+    BatchSubgraphOverlay(const SubgraphBatch& batch, size_t index);
+
+    /// Default constructor (not functionally useful)
+    BatchSubgraphOverlay() = default;
+
+    ~BatchSubgraphOverlay() = default;
+
+    ////////////////////////////////////////////////////////////////////////////
+    // HandleGraph interface
+    ////////////////////////////////////////////////////////////////////////////
+
+    /// Method to check if a node exists by ID
+    bool has_node(nid_t node_id) const;
+
+    /// Look up the handle for the node with the given ID in the given orientation
+    handle_t get_handle(const nid_t& node_id, bool is_reverse = false) const;
+
+    /// Get the ID from a handle
+    nid_t get_id(const handle_t& handle) const;
+
+    /// Get the orientation of a handle
+    bool get_is_reverse(const handle_t& handle) const;
+
+    /// Invert the orientation of a handle (potentially without getting its ID)
+    handle_t flip(const handle_t& handle) const;
+
+    /// Get the length of a node
+    size_t get_length(const handle_t& handle) const;
+
+    /// Get the sequence of a node, presented in the handle's local forward orientation.
+    string get_sequence(const handle_t& handle) const;
+
+private:
+
+    /// Loop over all the handles to next/previous (right/left) nodes. Passes
+    /// them to a callback which returns false to stop iterating and true to
+    /// continue. Returns true if we finished and false if we stopped early.
+    bool follow_edges_impl(const handle_t& handle, bool go_left, const std::function<bool(const handle_t&)>& iteratee) const;
+
+    /// Loop over all the nodes in the graph in their local forward
+    /// orientations, in their internal stored order. Stop if the iteratee
+    /// returns false. Can be told to run in parallel, in which case stopping
+    /// after a false return value is on a best-effort basis and iteration
+    /// order is not defined.
+    bool for_each_handle_impl(const std::function<bool(const handle_t&)>& iteratee, bool parallel = false) const;
+
+public:
+
+    /// Returns one base of a handle's sequence, in the orientation of the
+    /// handle.
+    char get_base(const handle_t& handle, size_t index) const;
+
+    /// Returns a substring of a handle's sequence, in the orientation of the
+    /// handle. If the indicated substring would extend beyond the end of the
+    /// handle's sequence, the return value is truncated to the sequence's end.
+    std::string get_subsequence(const handle_t& handle, size_t index, size_t size) const;
+
+    /// Return the number of nodes in the graph
+    size_t get_node_count(void) const;
+
+    /// Return the smallest ID in the graph, or some smaller number if the
+    /// smallest ID is unavailable. Return value is unspecified if the graph is empty.
+    nid_t min_node_id(void) const;
+
+    /// Return the largest ID in the graph, or some larger number if the
+    /// largest ID is unavailable. Return value is unspecified if the graph is empty.
+    nid_t max_node_id(void) const;
+
+    ////////////////////////////////////////////////////////////////////////////
+    // Expanding overlay interface
+    ////////////////////////////////////////////////////////////////////////////
+
+    /**
+     * Returns the handle in the underlying graph that corresponds to a handle in the
+     * overlay
+     */
+    handle_t get_underlying_handle(const handle_t& handle) const;
+
+protected:
+
+    /// Return true if the node of the given backing graph handle is in the
+    /// subgraph
+    bool contains(const handle_t& handle) const;
+
+    /// The graph we're overlaying
+    const HandleGraph* graph = nullptr;
+
+    /// The range of the batch's sorted forward handles that are in this
+    /// subgraph
+    const uint64_t* handles_begin = nullptr;
+    const uint64_t* handles_end = nullptr;
+
+    /// Max node ID
+    nid_t max_id = numeric_limits<nid_t>::min();
+
+    /// Min node ID
+    nid_t min_id = numeric_limits<nid_t>::max();
+};
+
+/*
+ * A collection of subgraphs of one graph, such as the neighborhoods that a
+ * NeighborhoodExtractor finds around a batch of positions. The nodes of all
+ * the subgraphs are stored together in one array, with each subgraph's nodes
+ * in a sorted run.
+ */
+class SubgraphBatch {
+
+public:
+
+    SubgraphBatch() = default;
+    ~SubgraphBatch() = default;
+
+    /// Return the number of subgraphs
+    size_t size() const;
+
+    /// Return true if there are no subgraphs
+    bool empty() const;
+
+    /// Get the subgraph with the given index, as an overlay on the backing
+    /// graph. The overlay points into the batch, so it must not outlive it.
+    BatchSubgraphOverlay get_subgraph(size_t index) const;
+
+    /// Get the number of nodes in the subgraph with the given index
+    size_t get_node_count(size_t index) const;
+
+    /// Loop over the forward handles of the nodes in the subgraph with the
+    /// given index, in the backing graph's handle order.
+    void for_each_handle(size_t index, const std::function<void(const handle_t&)>& iteratee) const;
+
+    /// Get the graph that the subgraphs are subgraphs of
+    const HandleGraph* get_graph() const;
+
+protected:
+
+    friend class BatchSubgraphOverlay;
+    template<typename Graph> friend class NeighborhoodExtractor;
+
+    /// The graph the subgraphs are in
+    const HandleGraph* graph = nullptr;
+
+    /// The forward handles of each subgraph's nodes, as integers, sorted
+    /// within each subgraph
+    std::vector<uint64_t> handles;
+
+    /// Where each subgraph's nodes start in handles, and then the end of the
+    /// last one
+    std::vector<size_t> bounds;
+
+    /// The smallest and largest node ID in each subgraph
+    std::vector<pair<nid_t, nid_t>> id_ranges;
+};
+
+/*
+ * Finds the neighborhoods around many positions at once, for turning into
+ * subgraphs. Each neighborhood is the set of nodes that have a base within a
+ * given number of bases of the position, in either direction, optionally
+ * limited to a given number of edges away from it.
+ *
+ * The positions are expanded in parallel. Each thread reuses its own search
+ * buffers from position to position, and writes its subgraphs into its own
+ * output array, so the only allocations are those buffers' growth and the
+ * batch's storage at the end. If the Graph provides follow_edges_fast(), as
+ * PackedGraph and HashGraph do, the traversal goes through it and no
+ * std::function is involved.
+ *
+ * Without a distance index, the neighborhood is found by a Dijkstra search
+ * out from the position, and the edge limit applies along the shortest walk
+ * to each node. With a SnarlDistanceIndex of the graph, the search goes
+ * breadth first instead, and asks the index for the exact distance to all the
+ * nodes discovered in each round at once, pruning those that are too far.
+ * There the edge limit applies along the walk with the fewest edges through
+ * nodes that are close enough.
+ */
+template<typename Graph = HandleGraph>
+class NeighborhoodExtractor {
+
+public:
+
+    /// Make an extractor for the given graph, and optionally its distance
+    /// index, both of which must outlive it.
+    NeighborhoodExtractor(const Graph* graph, const SnarlDistanceIndex* distance_index = nullptr);
+
+    /// Get the neighborhoods around each of the given positions, as (node ID,
+    /// is reverse, offset) tuples. A node is in a neighborhood if some base of
+    /// it is within max_distance bases of the position, and it can be reached
+    /// by crossing at most max_edges edges. The subgraphs are in the same
+    /// order as the positions. If parallel is set, the positions are split
+    /// across OpenMP threads. Throws if an offset is past the end of its node.
+    SubgraphBatch extract(const vector<tuple<nid_t, bool, size_t>>& positions, size_t max_distance,
+                          size_t max_edges = numeric_limits<size_t>::max(), bool parallel = true) const;
+
+protected:
+
+    /// The search buffers for one thread, reused for each position it
+    /// expands
+    struct Scratch {
+        /// The best distance found so far to the start of each oriented
+        /// handle, which also marks the handles already seen
+        swiss_hash_map<uint64_t, size_t> distances;
+        /// Dijkstra queue of (distance, edges crossed, handle)
+        vector<tuple<size_t, size_t, uint64_t>> queue;
+        /// Handles in the current and next breadth-first rounds
+        vector<handle_t> frontier;
+        vector<handle_t> next_frontier;
+        /// Index queries for the next round
+        vector<tuple<nid_t, bool, size_t>> targets;
+        /// All the threads' subgraphs, as runs of sorted forward handles
+        vector<uint64_t> output;
+    };
+
+    /// Add the neighborhood of a position to the scratch's output, as a
+    /// sorted run of forward handles, and return its smallest and largest node
+    /// IDs.
+    pair<nid_t, nid_t> expand(const tuple<nid_t, bool, size_t>& position, size_t max_distance,
+                              size_t max_edges, Scratch& scratch) const;
+
+    /// Do the expansion with a Dijkstra search in the graph
+    void expand_dijkstra(const handle_t& seed, size_t to_right, size_t to_left, size_t max_distance,
+                         size_t max_edges, Scratch& scratch) const;
+
+    /// Do the expansion breadth first, filtered by the distance index
+    void expand_indexed(const handle_t& seed, size_t offset, size_t max_distance,
+                        size_t max_edges, Scratch& scratch) const;
+
+    /// Loop over the handles on one side of a handle, through
+    /// follow_edges_fast() if the Graph has it
+    template<typename Iteratee, typename G = Graph>
+    auto follow_edges(const handle_t& handle, const Iteratee& iteratee, int) const
+        -> decltype(declval<const G&>().follow_edges_fast(handle, false, iteratee));
+    template<typename Iteratee>
+    bool follow_edges(const handle_t& handle, const Iteratee& iteratee, long) const;
+
+    const Graph* graph;
+    const SnarlDistanceIndex* distance_index;
+};
+
+///////////////////////////////////
+/// Template implementations
+///////////////////////////////////
+
+template<typename Graph>
+NeighborhoodExtractor<Graph>::NeighborhoodExtractor(const Graph* graph, const SnarlDistanceIndex* distance_index) :
+    graph(graph), distance_index(distance_index) {
+    // Nothing to do
+}
+
+template<typename Graph>
+SubgraphBatch NeighborhoodExtractor<Graph>::extract(const vector<tuple<nid_t, bool, size_t>>& positions,
+                                                    size_t max_distance, size_t max_edges, bool parallel) const {
+
+    SubgraphBatch batch;
+    batch.graph = graph;
+    batch.id_ranges.resize(positions.size());
+
+    size_t thread_count = parallel ? get_thread_count() : 1;
+    vector<Scratch> scratches(thread_count);
+    // Where each subgraph ended up in the threads' outputs
+    vector<pair<size_t, size_t>> sources(positions.size());
+    vector<size_t> sizes(positions.size());
+
+    // Exceptions can't leave an OpenMP parallel region, so hold on to the
+    // first one and throw it after
+    std::exception_ptr error;
+    #pragma omp parallel for schedule(dynamic, 16) if (parallel)
+    for (size_t i = 0; i < positions.size(); i++) {
+        size_t thread = parallel ? get_thread_num() : 0;
+        Scratch& scratch = scratches[thread];
+        size_t start = scratch.output.size();
+        try {
+            batch.id_ranges[i] = expand(positions[i], max_distance, max_edges, scratch);
+        } catch (...) {
+            #pragma omp critical (neighborhood_extractor_error)
+            {
+                if (!error) {
+                    error = std::current_exception();
+                }
+            }
+            scratch.output.resize(start);
+        }
+        sources[i] = make_pair(thread, start);
+        sizes[i] = scratch.output.size() - start;
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+
+    // Lay the subgraphs out in order
+    batch.bounds.resize(positions.size() + 1);
+    batch.bounds[0] = 0;
+    for (size_t i = 0; i < positions.size(); i++) {
+        batch.bounds[i + 1] = batch.bounds[i] + sizes[i];
+    }
+    batch.handles.resize(batch.bounds.back());
+
+    #pragma omp parallel for schedule(dynamic, 64) if (parallel)
+    for (size_t i = 0; i < positions.size(); i++) {
+        auto from = scratches[sources[i].first].output.begin() + sources[i].second;
+        std::copy(from, from + sizes[i], batch.handles.begin() + batch.bounds[i]);
+    }
+
+    return batch;
+}
+
+template<typename Graph>
+pair<nid_t, nid_t> NeighborhoodExtractor<Graph>::expand(const tuple<nid_t, bool, size_t>& position, size_t max_distance,
+                                                        size_t max_edges, Scratch& scratch) const {
+
+    handle_t seed = graph->get_handle(get<0>(position), get<1>(position));
+    size_t length = graph->get_length(seed);
+    size_t offset = get<2>(position);
+    if (offset >= length) {
+        throw runtime_error("error:[NeighborhoodExtractor] position offset " + to_string(offset) +
+                            " is past the end of node " + to_string(get<0>(position)));
+    }
+
+    size_t start = scratch.output.size();
+    scratch.distances.clear();
+    // The seed itself is at distance 0, in both orientations
+    scratch.distances[as_integer(seed)] = 0;
+    scratch.distances[as_integer(graph->flip(seed))] = 0;
+    scratch.output.push_back(as_integer(graph->forward(seed)));
+
+    if (distance_index) {
+        expand_indexed(seed, offset, max_distance, max_edges, scratch);
+    }
+    else {
+        // Distances are counted between bases, so the first base past the
+        // end of the seed is length - offset away, and the last base before
+        // its start is offset + 1 away.
+        expand_dijkstra(seed, length - offset, offset + 1, max_distance, max_edges, scratch);
+    }
+
+    // Make the run a sorted set of forward handles
+    auto begin = scratch.output.begin() + start;
+    std::sort(begin, scratch.output.end());
+    scratch.output.erase(std::unique(begin, scratch.output.end()), scratch.output.end());
+
+    pair<nid_t, nid_t> id_range(numeric_limits<nid_t>::max(), numeric_limits<nid_t>::min());
+    for (auto it = scratch.output.begin() + start; it != scratch.output.end(); ++it) {
+        nid_t node_id = graph->get_id(as_handle(*it));
+        id_range.first = std::min(id_range.first, node_id);
+        id_range.second = std::max(id_range.second, node_id);
+    }
+    return id_range;
+}
+
+template<typename Graph>
+void NeighborhoodExtractor<Graph>::expand_dijkstra(const handle_t& seed, size_t to_right, size_t to_left,
+                                                   size_t max_distance, size_t max_edges,
+                                                   Scratch& scratch) const {
+
+    auto& queue = scratch.queue;
+    auto& distances = scratch.distances;
+    queue.clear();
+
+    // Queue up the handles after here, which start the given distance away
+    auto relax = [&](const handle_t& here, size_t distance, size_t edges) {
+        if (edges >= max_edges || distance > max_distance) {
+            return;
+        }
+        follow_edges(here, [&](const handle_t& next) {
+            auto found = distances.find(as_integer(next));
+            if (found == distances.end()) {
+                distances.emplace(as_integer(next), distance);
+            }
+            else if (found->second > distance) {
+                found->second = distance;
+            }
+            else {
+                return;
+            }
+            queue.emplace_back(distance, edges + 1, as_integer(next));
+            std::push_heap(queue.begin(), queue.end(), std::greater<tuple<size_t, size_t, uint64_t>>());
+        }, 0);
+    };
+
+    relax(seed, to_right, 0);
+    relax(graph->flip(seed), to_left, 0);
+
+    while (!queue.empty()) {
+        std::pop_heap(queue.begin(), queue.end(), std::greater<tuple<size_t, size_t, uint64_t>>());
+        size_t distance, edges;
+        uint64_t here;
+        std::tie(distance, edges, here) = queue.back();
+        queue.pop_back();
+        if (distances.at(here) < distance) {
+            // We already got here a shorter way
+            continue;
+        }
+        handle_t handle = as_handle(here);
+        scratch.output.push_back(as_integer(graph->forward(handle)));
+        relax(handle, distance + graph->get_length(handle), edges);
+    }
+}
+
+template<typename Graph>
+void NeighborhoodExtractor<Graph>::expand_indexed(const handle_t& seed, size_t offset, size_t max_distance,
+                                                  size_t max_edges, Scratch& scratch) const {
+
+    auto& frontier = scratch.frontier;
+    auto& next_frontier = scratch.next_frontier;
+    auto& targets = scratch.targets;
+    frontier.clear();
+    frontier.push_back(seed);
+    frontier.push_back(graph->flip(seed));
+
+    nid_t seed_id = graph->get_id(seed);
+    bool seed_reverse = graph->get_is_reverse(seed);
+    size_t reverse_offset = graph->get_length(seed) - offset - 1;
+
+    for (size_t edges = 0; edges < max_edges && !frontier.empty(); edges++) {
+        // Find everything new one edge further out
+        next_frontier.clear();
+        targets.clear();
+        for (const handle_t& here : frontier) {
+            follow_edges(here, [&](const handle_t& next) {
+                if (scratch.distances.emplace(as_integer(next), 0).second) {
+                    next_frontier.push_back(next);
+                    targets.emplace_back(graph->get_id(next), graph->get_is_reverse(next), 0);
+                }
+            }, 0);
+        }
+        if (targets.empty()) {
+            break;
+        }
+
+        // Keep the ones that the index says are close enough, reading either
+        // way out of the seed. Some may only be reachable through nodes that
+        // are too far, but then they are too far themselves.
+        vector<size_t> right = distance_index->minimum_distances(seed_id, seed_reverse, offset, targets, max_distance);
+        vector<size_t> left = distance_index->minimum_distances(seed_id, !seed_reverse, reverse_offset, targets, max_distance);
+        frontier.clear();
+        for (size_t i = 0; i < next_frontier.size(); i++) {
+            if (std::min(right[i], left[i]) <= max_distance) {
+                frontier.push_back(next_frontier[i]);
+                scratch.output.push_back(as_integer(graph->forward(next_frontier[i])));
+            }
+        }
+    }
+}
+
+template<typename Graph>
+template<typename Iteratee, typename G>
+auto NeighborhoodExtractor<Graph>::follow_edges(const handle_t& handle, const Iteratee& iteratee, int) const
+    -> decltype(declval<const G&>().follow_edges_fast(handle, false, iteratee)) {
+    return graph->follow_edges_fast(handle, false, iteratee);
+}
+
+template<typename Graph>
+template<typename Iteratee>
+bool NeighborhoodExtractor<Graph>::follow_edges(const handle_t& handle, const Iteratee& iteratee, long) const {
+    return graph->follow_edges(handle, false, iteratee);
+}
+
+}
+
+#endif
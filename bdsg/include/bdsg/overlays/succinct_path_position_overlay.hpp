@@ -0,0 +1,133 @@
+//
+//  succinct_path_position_overlay.hpp
+//
+//  Contains a variant of the PackedPositionOverlay that stores step positions
+//  in an Elias-Fano encoded bit vector instead of a packed vector of offsets.
+//
+
+#ifndef BDSG_SUCCINCT_PATH_POSITION_OVERLAY_HPP_INCLUDED
+#define BDSG_SUCCINCT_PATH_POSITION_OVERLAY_HPP_INCLUDED
+
+#include <sdsl/sd_vector.hpp>
+
+#include <bdsg/overlays/packed_path_position_overlay.hpp>
+
+namespace bdsg {
+
+using namespace std;
+using namespace handlegraph;
+
+/*
+ * An overlay that adds the PathPositionHandleGraph interface to a static
+ * PathHandleGraph, like the PackedPositionOverlay, but keeps the positions of
+ * the steps in an sdsl::sd_vector.
+ *
+ * Within each index, step k of the concatenated paths, starting at base
+ * offset p_k, is recorded as a 1 at bit p_k + k. That makes the bit vector a
+ * unary coding of the step lengths: each step is a 1 followed by one 0 per
+ * base. The position of a step is then a select over the 1s, and the step at
+ * a position is a select over the 0s, so neither query has to search, and
+ * steps on nodes with empty sequences are still represented.
+ */
+class SuccinctPositionOverlay : public PackedPositionOverlay {
+
+public:
+
+    using PackedPositionOverlay::PackedPositionOverlay;
+
+    /// Make a SuccinctPositionOverlay on the given graph. Glom short paths
+    /// together to make internal indexes each over at least the given number
+    /// of steps.
+    SuccinctPositionOverlay(const PathHandleGraph* graph, size_t steps_per_index = 1000000,
+                            size_t concurrent_indexes = 0, bool low_memory = false);
+
+    ////////////////////////////////////////////////////////////////////////////
+    // Path position interface
+    ////////////////////////////////////////////////////////////////////////////
+
+    /// Returns the length of a path measured in bases of sequence.
+    virtual size_t get_path_length(const path_handle_t& path_handle) const;
+
+    /// Returns the position along the path of the beginning of this step measured in
+    /// bases of sequence. In a circular path, positions start at the step returned by
+    /// path_begin().
+    virtual size_t get_position_of_step(const step_handle_t& step) const;
+
+    /// Returns the step at this position, measured in bases of sequence starting at
+    /// the step returned by path_begin(). If the position is past the end of the
+    /// path, returns path_end().
+    virtual step_handle_t get_step_at_position(const path_handle_t& path,
+                                               const size_t& position) const;
+
+    /// Fill out with the step at each of the given positions on the path, as
+    /// get_step_at_position() would return. Each lookup is already constant
+    /// time, so the positions need not be sorted.
+    virtual void get_steps_at_positions(const path_handle_t& path,
+                                        const vector<size_t>& sorted_positions,
+                                        vector<step_handle_t>& out) const;
+
+    /// Fill out with the position of each of the given steps on the path, as
+    /// get_position_of_step() would return.
+    virtual void get_positions_of_steps(const path_handle_t& path,
+                                        const vector<step_handle_t>& steps,
+                                        vector<size_t>& out) const;
+
+    /// Measure how many bytes each component of the overlay's indexes takes.
+    virtual MemoryBreakdown memory_breakdown() const;
+
+    /// Returns a number that is specific to the serialized implementation for type
+    /// checking.
+    virtual uint32_t get_magic_number() const;
+
+protected:
+
+    /// Write the indexes to a stream. The backing graph is not included.
+    virtual void serialize_members(ostream& out) const;
+
+    /// Read the indexes from a stream, replacing any current ones. The
+    /// backing graph must already be set.
+    virtual void deserialize_members(istream& in);
+
+    // Construction hooks
+
+    /// Set the number of distinct indexes we will use.
+    virtual void set_index_count(size_t count);
+
+    /// Into index i, index the given range of paths, with the given total size in steps. Consumes and destroys any per-path user data.
+    virtual void index_paths(size_t index_num, const std::vector<path_handle_t>::const_iterator& begin_path, const std::vector<path_handle_t>::const_iterator& end_path, size_t cumul_path_size, void** user_data_base);
+
+    /// Get the offset of the bit for the given step rank in the given index.
+    size_t step_bit(size_t index_num, size_t rank) const;
+
+    /// Get the number of bases before the given step rank in the given index,
+    /// counting all paths that come before it in the index.
+    size_t bases_before(size_t index_num, size_t rank) const;
+
+    // Stored index data
+
+    /// The position data for each index in the base class's "indexes". The
+    /// base class's steps and step hash are kept, but not its positions.
+    struct PathPositionIndex {
+        /// Unary coding of the step lengths, with a 1 for each step followed
+        /// by a 0 for each of its bases.
+        sdsl::sd_vector<> step_starts;
+
+        /// The rank among the index's steps of the step that hashes to a
+        /// given index in the base class's step hash.
+        PackedVector<> step_ranks;
+
+        /// Write the index to a stream
+        void serialize(ostream& out) const;
+
+        /// Read the index from a stream
+        void deserialize(istream& in);
+    };
+
+    /// This holds the position indexes. Order is the same as "indexes" in the
+    /// base class.
+    vector<PathPositionIndex> position_indexes;
+};
+
+}
+
+#endif
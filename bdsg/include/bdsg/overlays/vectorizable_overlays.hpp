@@ -15,6 +15,7 @@
 #include "sdsl/bit_vectors.hpp"
 
 #include "bdsg/internal/hash_map.hpp"
+#include "bdsg/overlays/packed_path_position_overlay.hpp"
 
 #include <handlegraph/handle_graph.hpp>
 #include <handlegraph/path_position_handle_graph.hpp>
@@ -323,6 +324,63 @@ protected:
     const PathPositionHandleGraph* underlying_path_position_graph = nullptr;
 };
 
+/*
+ * An overlay that adds both the PathPositionHandleGraph and the
+ * VectorizableHandleGraph interfaces to a PathHandleGraph. This does the job
+ * of a PathPositionVectorizableOverlay on top of a PackedPositionOverlay, but
+ * all queries go straight to the backing graph or to this overlay's own
+ * indexes, instead of passing through both overlays.
+ */
+class PackedPositionVectorizableOverlay : public PathVectorizableOverlay, virtual public PathPositionHandleGraph {
+
+public:
+    
+    /// Make a new overlay on the given graph. The path position indexes are
+    /// built as by a PackedPositionOverlay with the given settings.
+    PackedPositionVectorizableOverlay(const PathHandleGraph* path_graph, size_t steps_per_index = 1000000,
+                                      size_t concurrent_indexes = 0, bool low_memory = false);
+    PackedPositionVectorizableOverlay();
+    virtual ~PackedPositionVectorizableOverlay();
+
+public:
+
+    ////////////////////////////////////////////////////////////////////////////
+    // Path Position handle Interface that needs to be implemented
+    ////////////////////////////////////////////////////////////////////////////
+
+    /// Returns the length of a path measured in bases of sequence.
+    virtual size_t get_path_length(const path_handle_t& path_handle) const;
+    
+    /// Returns the position along the path of the beginning of this step measured in
+    /// bases of sequence. In a circular path, positions start at the step returned by
+    /// path_begin().
+    virtual size_t get_position_of_step(const step_handle_t& step) const;
+    
+    /// Returns the step at this position, measured in bases of sequence starting at
+    /// the step returned by path_begin(). If the position is past the end of the
+    /// path, returns path_end().
+    virtual step_handle_t get_step_at_position(const path_handle_t& path,
+                                               const size_t& position) const;
+    
+    /// Fill out with the step at each of the given sorted positions on the
+    /// path, as get_step_at_position() would return.
+    void get_steps_at_positions(const path_handle_t& path,
+                                const vector<size_t>& sorted_positions,
+                                vector<step_handle_t>& out) const;
+    
+    /// Fill out with the position of each of the given steps on the path, as
+    /// get_position_of_step() would return.
+    void get_positions_of_steps(const path_handle_t& path,
+                                const vector<step_handle_t>& steps,
+                                vector<size_t>& out) const;
+    
+protected:
+    
+    /// The path position indexes, over the same backing graph. Its step
+    /// handles are the backing graph's, so they can be passed straight in.
+    PackedPositionOverlay position_overlay;
+};
+
 
 }
 
@@ -21,11 +21,37 @@ namespace bdsg {
 using namespace std;
 using namespace handlegraph;
 
+class HashGraph;
+class MappedPackedGraph;
+
 /*
  * In-memory implementation of MutablePathDeletableHandleGraph
  */
 class PackedGraph : public GraphProxy<BasePackedGraph<>> {
+public:
+    /**
+     * Measure how many bytes each internal component of the graph takes.
+     */
+    MemoryBreakdown memory_breakdown() const;
+    
+    /**
+     * Make a copy of a HashGraph. The graph's vectors are sized up front, and
+     * its edge lists and paths are filled in in bulk, rather than one
+     * create_handle(), create_edge() or append_step() at a time. The nodes
+     * are stored in ID order.
+     */
+    static PackedGraph from(const HashGraph& other);
+    
+    /**
+     * Make a copy of a MappedPackedGraph in normal memory. Each of its
+     * structures is copied whole, in parallel.
+     */
+    static PackedGraph from(const MappedPackedGraph& other);
+    
 protected:
+    
+    friend class MappedPackedGraph;
+
     /**
      * Get the object that actually provides the graph methods.
      */
@@ -45,6 +71,11 @@ protected:
 
 /*
  * Memory-mapped implementation of MutablePathDeletableHandleGraph
+ *
+ * Following pointers in the mapped memory takes no locks, even while another
+ * thread grows the mapping (see yomo::Manager). So one writer thread can add
+ * to the graph while reader threads query it, as long as the readers stay out
+ * of the parts of the graph that the writer is changing.
  */
 class MappedPackedGraph : public GraphProxy<BasePackedGraph<MappedBackend>>, public TriviallySerializable {
 public:
@@ -71,6 +102,72 @@ public:
      */
     void dissociate();
     
+    /**
+     * Cut the memory mapping connection to any backing file, and move the
+     * graph into memory of the given kind. Huge pages can cut down on TLB
+     * misses for big graphs.
+     */
+    void dissociate(yomo::Manager::page_kind_t pages);
+    
+    /**
+     * Make a copy of a PackedGraph in memory-mapped memory. Each of its
+     * structures is copied whole, in parallel.
+     */
+    static MappedPackedGraph from(const PackedGraph& other);
+    
+    /**
+     * Make a copy of a HashGraph, filling in the graph's vectors in bulk, as
+     * PackedGraph::from() does.
+     */
+    static MappedPackedGraph from(const HashGraph& other);
+    
+    /**
+     * Replace the contents of this graph with a writable snapshot of the
+     * other graph. Changes to the snapshot do not affect the other graph or
+     * any file backing it. If the other graph is memory-mapped from a file,
+     * the snapshot maps the file copy-on-write, so taking it copies nothing
+     * and it only ever copies the pages it changes. The other graph should
+     * not be modified while the snapshot exists.
+     */
+    void snapshot(const MappedPackedGraph& other);
+    
+    /**
+     * Rebuild the graph's memory densely, dropping free space left behind by
+     * edits. If the graph is memory-mapped from a writable file, the file is
+     * rewritten to hold the compacted graph, and is not valid if the process
+     * dies while that happens.
+     */
+    void compact();
+    
+    /**
+     * Tell the memory management subsystem that the whole graph should be
+     * loaded. If blocking is set, wait for it to be paged in.
+     */
+    void preload(bool blocking = false) const;
+    
+    /**
+     * Tell the memory management subsystem how the graph is going to be
+     * accessed.
+     */
+    void advise(yomo::Manager::access_hint_t hint) const;
+    
+    /**
+     * Write any changes to the graph back to the file it is memory-mapped
+     * from. If blocking is set, wait until they are on disk; otherwise they
+     * are written in the background, and the graph should not be modified
+     * until they are if the file needs to be consistent. Returns the
+     * generation number of the checkpoint, which counts up from 1, or 0 if
+     * the graph is not in a writable file.
+     */
+    size_t checkpoint(bool blocking = true);
+    
+    /**
+     * Measure how many bytes each internal component of the graph takes. The
+     * components are followed by the free space in the memory mapping, so
+     * that they add up to the total size of the mapped chain.
+     */
+    MemoryBreakdown memory_breakdown() const;
+    
     /**
      * Serialize us as a series of in-memory blocks shown to the given finction.
      * Backs const serialization to FDs, and serialization to streams.
@@ -106,6 +203,8 @@ public:
    
 protected:
 
+    friend class PackedGraph;
+
     /**
      * Return the magic number to use at the start of files.
      *
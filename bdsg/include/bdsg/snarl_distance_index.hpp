@@ -9,6 +9,9 @@
 #include <handlegraph/util.hpp>
 #include <handlegraph/trivially_serializable.hpp>
 #include <bdsg/internal/mapped_structs.hpp>
+#include <bdsg/internal/packed_structs.hpp>
+#include <bdsg/internal/utility.hpp>
+#include <bdsg/internal/perf_counters.hpp>
 #include <string>
 #include <numeric>
 #include <atomic>
@@ -123,6 +126,43 @@ using namespace sdsl;
 using namespace std;
 using namespace handlegraph;
 
+/**
+ * A compact record of where a node sits in the snarl tree of a
+ * SnarlDistanceIndex, made by SnarlDistanceIndex::get_ancestry_code().
+ *
+ * For each ancestor of the node, the code stores the distances from the
+ * ancestor's ends to the ends of its parent, the distances looping from the
+ * ancestor back to itself in the parent, and, if the parent is a chain, the
+ * ancestor's rank, prefix sum and loop distances in the chain. The values are
+ * packed as varints.
+ *
+ * Two codes from the same index are enough to find the minimum distance
+ * between positions on their nodes, unless the lowest common ancestor of the
+ * nodes is a snarl or a looping chain, which needs the distances stored in
+ * the index.
+ */
+class AncestryCode {
+public:
+    AncestryCode() = default;
+    ///Make a code from the bytes given by get_bytes()
+    AncestryCode(const std::vector<uint8_t>& bytes);
+
+    ///Get the ID of the node that this is the code for
+    handlegraph::nid_t get_node_id() const;
+    ///Get the packed bytes of the code
+    const std::vector<uint8_t>& get_bytes() const;
+
+    ///Write the code to a stream
+    void serialize(std::ostream& out) const;
+    ///Read a code written by serialize() from a stream
+    void deserialize(std::istream& in);
+
+private:
+    std::vector<uint8_t> bytes;
+
+    friend class SnarlDistanceIndex;
+};
+
 /**
   * The distance index, which also acts as a snarl decomposition.
   *
@@ -162,6 +202,11 @@ public:
     void serialize(const std::function<void(const void*, size_t)>& iteratee) const;
     void serialize(int fd);
     void deserialize(int fd);
+    /// Load the index from the given file into memory, instead of
+    /// memory-mapping it. Reads from the file in parallel, which is faster
+    /// than paging in a mapping on network filesystems. The file is expected
+    /// to start with the prefix.
+    void deserialize_unmapped(int fd);
 
     void serialize_members(std::ostream& out) const;
     void deserialize_members(std::istream& in);
@@ -176,6 +221,83 @@ public:
     /// use it.
     void preload(bool blocking = false) const;
 
+    /// Tell the OS how the index is going to be accessed, for example
+    /// ACCESS_RANDOM when doing many scattered distance queries, or
+    /// ACCESS_HUGEPAGE to reduce TLB pressure on large indexes.
+    void advise(bdsg::yomo::Manager::access_hint_t hint) const;
+
+    /// Write any changes to the index back to the file it is memory-mapped
+    /// from. If blocking is true, waits for them to reach the disk. Returns
+    /// the generation number of the checkpoint, or 0 if the index is not in a
+    /// writable file.
+    size_t checkpoint(bool blocking = true);
+
+    /// Copy the index into memory on each NUMA node, so that queries read
+    /// from the copy on their own thread's node instead of paying for remote
+    /// memory access. Does nothing on machines with one NUMA node. The index
+    /// must not be modified while replicated; loading another index drops the
+    /// copies.
+    void replicate_numa();
+
+    /// Get the range of record offsets, from the first up to but not
+    /// including the past-the-end offset, holding the snarl tree of the given
+    /// connected component (numbered as in get_connected_component_number()).
+    /// The records are laid out one connected component after another, each
+    /// followed by the child lists of its own snarls, so the root's
+    /// per-component pointers serve as the offset table. In indexes built
+    /// before this layout, all the child lists of one build come after its
+    /// last component and are counted as part of that one.
+    std::pair<size_t, size_t> get_component_record_range(size_t component_number) const;
+
+    /// Load just the records for the given connected component, for example
+    /// before a batch of queries at one locus, so a memory-mapped index does
+    /// not have to fault them in one page at a time. If blocking is true,
+    /// waits for the records to be paged in.
+    void prefetch_component(size_t component_number, bool blocking = false) const;
+
+    /// Measure how many bytes the index takes, as a tree of component names
+    /// and sizes. The records are followed by the rest of the memory mapping,
+    /// so that the components add up to the total size of the mapped chain.
+    MemoryBreakdown memory_breakdown() const;
+
+    /// Cache the distance_in_parent() results that minimum_distance() looks up
+    /// while walking up the snarl tree, keeping up to entries_per_thread of
+    /// them in a thread-local table for each thread, for each of the last few
+    /// indexes the thread has queried. 0 turns the cache off, which is the
+    /// default. Calling this also drops everything already cached, so it
+    /// should be called again if the index is modified.
+    void set_distance_cache_size(size_t entries_per_thread);
+    size_t get_distance_cache_size() const;
+
+    /// Get the number of distance cache hits and misses, summed over all
+    /// threads. Each thread reports its counts in batches, so this can lag
+    /// behind by a few dozen lookups per thread. Each thread keeps tables for
+    /// a few indexes at once, and a table's unreported counts are dropped when
+    /// the thread needs it for another index.
+    pair<size_t, size_t> get_distance_cache_stats() const;
+    void reset_distance_cache_stats();
+
+    /// Keep root distance labels: for each node, the distances from its ends
+    /// to the ends of its ancestor at the top of the snarl tree. With them,
+    /// minimum_distance() answers queries between nodes in different
+    /// connected components, or in different children of a root snarl,
+    /// without walking up the snarl tree. The labels are only kept in memory.
+    /// Turning them on builds them for the current contents, and after that
+    /// they are rebuilt by get_snarl_tree_records() and whenever an index is
+    /// loaded. The graph is used for any snarls too big to store distances
+    /// for. They are off by default.
+    void set_root_distance_labels(bool use_labels, const HandleGraph* graph=nullptr);
+    bool has_root_distance_labels() const;
+
+    /// Keep tables of the maximum distances between the sides of the children
+    /// of each snarl that is a DAG and stores distances, so that
+    /// maximum_distance() can use the longest path through those snarls instead
+    /// of the minimum distance. Like the root distance labels, the tables are
+    /// only kept in memory and are rebuilt when the index is built or loaded.
+    /// They are off by default.
+    void set_snarl_maximum_distances(bool use_maximum_distances);
+    bool has_snarl_maximum_distances() const;
+
 
 ////////////////////////////////////  How we define different properties of a net handle
 
@@ -216,11 +338,55 @@ public:
                             const bool rev2, const size_t offset2, bool unoriented_distance = false, const HandleGraph* graph=nullptr, 
                             pair<vector<tuple<net_handle_t, int32_t, int32_t>>, vector<tuple<net_handle_t, int32_t, int32_t>>>* distance_traceback=nullptr) const ;
 
+    ///Get the minimum distances from one position to each of a set of other positions, given as
+    ///(node id, is reverse, offset) tuples. This gives the same answers as calling minimum_distance()
+    ///for each target, but only walks up the snarl tree from the source once.
+    ///Distances greater than distance_limit are not worked out, and are returned as
+    ///std::numeric_limits<size_t>::max() along with targets that can't be reached at all.
+    vector<size_t> minimum_distances(const handlegraph::nid_t id1, const bool rev1, const size_t offset1,
+                                     const vector<tuple<handlegraph::nid_t, bool, size_t>>& targets,
+                                     size_t distance_limit = std::numeric_limits<size_t>::max(),
+                                     bool unoriented_distance = false, const HandleGraph* graph=nullptr) const;
+
+    ///Get the minimum distances between each of a batch of pairs of positions, as if by calling
+    ///minimum_distance() on each pair. The count pairs are given as parallel arrays, and the distance
+    ///for the i-th pair is written to distances[i]. If parallel is set, the pairs are split across
+    ///OpenMP threads.
+    void minimum_distance_pairs(size_t count, const handlegraph::nid_t* ids1, const bool* revs1, const size_t* offsets1,
+                                const handlegraph::nid_t* ids2, const bool* revs2, const size_t* offsets2,
+                                size_t* distances, bool unoriented_distance = false, const HandleGraph* graph=nullptr,
+                                bool parallel = true) const;
+
     ///Find an approximation of the maximum distance between two positions. 
     ///This isn't a true maximum- the only guarantee is that it's greater than or equal to the minimum distance.
     size_t maximum_distance(const handlegraph::nid_t id1, const bool rev1, const size_t offset1, const handlegraph::nid_t id2, 
                             const bool rev2, const size_t offset2, bool unoriented_distance = false, const HandleGraph* graph=nullptr) const ;
 
+    ///Get the maximum distances from one position to each of a set of other positions, given as
+    ///(node id, is reverse, offset) tuples. This gives the same answers as calling maximum_distance()
+    ///for each target, but only walks up the snarl tree from the source once.
+    vector<size_t> maximum_distances(const handlegraph::nid_t id1, const bool rev1, const size_t offset1,
+                                     const vector<tuple<handlegraph::nid_t, bool, size_t>>& targets,
+                                     bool unoriented_distance = false, const HandleGraph* graph=nullptr) const;
+
+    ///Get the ancestry code of a node, which records enough about the node's
+    ///ancestors in the snarl tree to find many distances without the index.
+    AncestryCode get_ancestry_code(const handlegraph::nid_t id, const HandleGraph* graph=nullptr) const;
+
+    ///Get the minimum distance between two positions, like minimum_distance(), on the
+    ///nodes of two ancestry codes from this index. The codes are used on their own when
+    ///they can be, and the rest of the query is looked up in the index otherwise.
+    size_t minimum_distance(const AncestryCode& code1, const bool rev1, const size_t offset1,
+                            const AncestryCode& code2, const bool rev2, const size_t offset2,
+                            bool unoriented_distance = false, const HandleGraph* graph=nullptr) const;
+
+    ///Try to get the minimum distance between two positions from their ancestry codes
+    ///alone. Returns false, leaving distance alone, if the distance can't be found without
+    ///the index because the nodes meet in a snarl or a looping chain.
+    static bool minimum_distance_from_codes(const AncestryCode& code1, const bool rev1, const size_t offset1,
+                                            const AncestryCode& code2, const bool rev2, const size_t offset2,
+                                            bool unoriented_distance, size_t& distance);
+
     //Find the distance between the two child node sides in the parent, facing each other, not 
     //including the lengths of the nodes.
     //This only takes into account the endpoint of the net_handle_t traversal, it does not care if the traversal
@@ -503,6 +669,178 @@ public:
     ///For 0 or 1, returns the sentinel facing in. Otherwise return the child as a chain going START_END
     net_handle_t get_snarl_child_from_rank(const net_handle_t& snarl, const size_t& rank) const;
 
+    ///Where we are in going through the children of one parent, for visiting children without
+    ///going through a std::function for each one. Get one from start_children() and then pass it
+    ///to next_child() until it returns false.
+    struct ChildIterator {
+        enum kind_t {DONE=0, ONE_CHILD, ROOT_CHILDREN, SNARL_CHILDREN, SIMPLE_SNARL_CHILDREN, CHAIN_CHILDREN};
+        kind_t kind = DONE;
+        ///The next child for ONE_CHILD and CHAIN_CHILDREN
+        net_handle_t next;
+        ///The first child of a chain, to stop at when a chain loops.
+        net_handle_t first;
+        ///Record of the parent, and of the root snarl when going through children of the root
+        size_t record_offset = 0;
+        ///How far through the children (or root components) we are, and how many there are
+        size_t index = 0;
+        size_t count = 0;
+        ///Where the list of children is, for snarls, and how far through a root snarl's children we are
+        size_t child_list_offset = 0;
+        size_t root_snarl_index = 0;
+        size_t root_snarl_count = 0;
+    };
+
+    ///Start going through the children of parent, in the same order as for_each_child().
+    ChildIterator start_children(const net_handle_t& parent) const;
+
+    ///Get the next child from the iterator into child. Returns false when there are no more.
+    bool next_child(ChildIterator& iterator, net_handle_t& child) const;
+
+    ///Version of for_each_child() that calls the iteratee directly so it can be inlined.
+    ///Iteratee takes a const net_handle_t& and returns false to stop, in which case this returns false.
+    template<typename Iteratee>
+    bool for_each_child_inline(const net_handle_t& parent, Iteratee&& iteratee) const {
+        ChildIterator iterator = start_children(parent);
+        net_handle_t child;
+        while (next_child(iterator, child)) {
+            if (!iteratee(child)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    ///Pre-order walk of the snarl tree below (and including) some net handle, by default the root.
+    ///Every snarl, chain and node is visited once, with parents before their children and siblings
+    ///in the order for_each_child() gives them.
+    ///
+    ///    SnarlDistanceIndex::SnarlTreeCursor cursor(index);
+    ///    while (cursor.next()) {
+    ///        do_something(cursor.get(), cursor.get_depth());
+    ///    }
+    class SnarlTreeCursor {
+    public:
+        SnarlTreeCursor(const SnarlDistanceIndex& index);
+        SnarlTreeCursor(const SnarlDistanceIndex& index, const net_handle_t& start);
+
+        ///Move to the next net handle, or return false if the walk is over.
+        bool next();
+        ///Get the current net handle.
+        const net_handle_t& get() const {return current;}
+        ///Get how far below the start the current net handle is.
+        size_t get_depth() const {return started ? stack.size() : 0;}
+        ///Don't visit the children of the current net handle.
+        void skip_children() {skip = true;}
+    private:
+        const SnarlDistanceIndex* index;
+        net_handle_t current;
+        bool started = false;
+        bool finished = false;
+        bool skip = false;
+        ///Iterators through the children of each ancestor of current, below the start
+        vector<ChildIterator> stack;
+    };
+
+    ///Walk along one shortest path from the start of one oriented node to the start of another,
+    ///in the same direction minimum_distance() measures, one handle at a time. Both ends are
+    ///visited. Nothing is visited if there is no path, or if the shortest one is longer than
+    ///distance_limit.
+    ///
+    ///    SnarlDistanceIndex::ShortestPathCursor cursor(index, graph, id1, rev1, id2, rev2, limit);
+    ///    while (cursor.next()) {
+    ///        do_something(cursor.get(), cursor.get_distance());
+    ///    }
+    ///
+    ///The walk only goes where the path goes, and doesn't reconstruct the path through the
+    ///snarl tree. Where the graph doesn't branch, the next handle is free. Where it does, one
+    ///batched distance query from the end finds a branch that stays on a shortest path.
+    class ShortestPathCursor {
+    public:
+        ShortestPathCursor(const SnarlDistanceIndex& index, const HandleGraph* graph,
+                           const handlegraph::nid_t id1, const bool rev1,
+                           const handlegraph::nid_t id2, const bool rev2,
+                           size_t distance_limit = std::numeric_limits<size_t>::max());
+
+        ///Move to the next handle on the path, or return false if the walk is over.
+        bool next();
+        ///Get the current handle.
+        const handlegraph::handle_t& get() const {return current;}
+        ///Get the distance from the start of the first handle to the start of the current one.
+        size_t get_distance() const {return distance;}
+        ///Get the distance from the start of the first handle to the start of the last one, or
+        ///std::numeric_limits<size_t>::max() if no path is walked.
+        size_t get_path_length() const {return path_length;}
+    private:
+        const SnarlDistanceIndex* index;
+        const HandleGraph* graph;
+        handlegraph::handle_t current;
+        size_t distance = 0;
+        size_t path_length;
+        bool started = false;
+        bool finished = false;
+        ///The end of the path, as a position reading backward from the start of the last handle
+        tuple<handlegraph::nid_t, bool, size_t> reverse_end;
+        ///Reused space for the branches at the current handle
+        vector<handlegraph::handle_t> branches;
+        vector<tuple<handlegraph::nid_t, bool, size_t>> branch_positions;
+    };
+
+    ///Function to walk through the shortest path between the two nodes+orientations. Orientation is the same as for minimum_distance - 
+    ///traverses from the first node going forward to the second node going forward.
+    ///Calls iteratee on each node of the shortest path between the nodes and the distance to the start of that node,
+    ///the same as a ShortestPathCursor visits them, and stops early if iteratee returns false.
+    void for_each_handle_in_shortest_path(const handlegraph::nid_t id1, const bool rev1, const handlegraph::nid_t id2, const bool rev2, 
+                                          const HandleGraph* graph, const std::function<bool(const handlegraph::handle_t, size_t)>& iteratee) const;
+
+    ///A sampled index over the nodes of one chain, for chains long enough that walking along
+    ///them is slow. Every sample_interval-th node is remembered along with its rank, chain
+    ///component and prefix sum, and the smallest loop values in each run of sample_interval
+    ///nodes go in sparse tables. Finding where a node is in the chain, which node covers an
+    ///offset, or the smallest loop between two nodes then takes O(log n) time plus a walk of at
+    ///most sample_interval nodes from a sample, instead of a walk between the two nodes.
+    ///
+    ///Nodes are numbered 0 to get_node_count()-1 along the chain, and the snarls between them
+    ///are skipped. The skip index has to be rebuilt if the distance index changes.
+    class ChainSkipIndex {
+    public:
+        ChainSkipIndex(const SnarlDistanceIndex& index, const net_handle_t& chain, size_t sample_interval = 64);
+
+        ///Get the number of nodes in the chain
+        size_t get_node_count() const {return node_count;}
+        ///Get the number of nodes that come before the given node in the chain
+        size_t get_node_ordinal(const net_handle_t& node) const;
+        ///Get the node in the given chain component that covers the given prefix sum offset:
+        ///the last one whose prefix sum is at most offset. If the component starts after the
+        ///offset, gets the last node before it.
+        net_handle_t get_node_at_offset(size_t offset, size_t component = 0) const;
+        ///Get the smallest forward loop value (or reverse loop value, if forward is false) of
+        ///the nodes from node1 to node2 inclusive, in either order.
+        size_t get_min_loop_value(const net_handle_t& node1, const net_handle_t& node2, bool forward = true) const;
+    private:
+        const SnarlDistanceIndex* index;
+        net_handle_t chain;
+        size_t sample_interval;
+        size_t node_count = 0;
+        ///The node at the start of each run of sample_interval nodes, and its rank in the chain
+        vector<net_handle_t> sample_nodes;
+        vector<size_t> sample_ranks;
+        ///The chain component and prefix sum of each sampled node
+        vector<pair<size_t, size_t>> sample_positions;
+        ///Sparse tables of the smallest loop values, where level i holds the minimum over 2^i
+        ///runs starting from each run
+        vector<vector<size_t>> forward_loop_minima;
+        vector<vector<size_t>> reverse_loop_minima;
+
+        ///Get the next node to the right in the chain
+        net_handle_t next_node(const net_handle_t& node) const;
+        ///Get the rank of a node in the chain, checking that it is in this chain
+        size_t get_node_rank(const net_handle_t& node) const;
+        ///Get the run containing the node with the given rank
+        size_t get_run(size_t rank) const;
+        ///Get the smallest loop value of the nodes from node up to the given rank, inclusive
+        size_t walk_min_loop_value(net_handle_t node, size_t last_rank, bool forward) const;
+    };
+
 protected:
     ///Internal implementation for for_each_child.
     bool for_each_child_impl(const net_handle_t& traversal, const std::function<bool(const net_handle_t&)>& iteratee) const;
@@ -538,12 +876,6 @@ public:
 
 private:
 
-    ///Function to walk through the shortest path between the two nodes+orientations. Orientation is the same as for minimum_distance - 
-    ///traverses from the first node going forward to the second node going forward.
-    ///Calls iteratee on each node of the shortest path between the nodes and the distance to the start of that node
-    void for_each_handle_in_shortest_path(const handlegraph::nid_t id1, const bool rev1, const handlegraph::nid_t id2, const bool rev2, 
-                                          const HandleGraph* graph, const std::function<bool(const handlegraph::handle_t, size_t)>& iteratee) const;
-
     ///Helper function for recursively traversing the shortest path in a snarl.
     ///start and end must be children (or sentinels) of the snarl.
     ///The distance found will traverse start going forward and reach end going forward.
@@ -649,14 +981,14 @@ public:
     
     }
     handlegraph::net_handle_t get_net_handle(size_t pointer, connectivity_t connectivity) const  {
-        net_handle_record_t type = SnarlTreeRecord(pointer, &snarl_tree_records).get_record_handle_type(); 
-        size_t node_record_offset = SnarlTreeRecord(pointer, &snarl_tree_records).get_record_type() == SIMPLE_SNARL || 
-                                    SnarlTreeRecord(pointer, &snarl_tree_records).get_record_type() == SIMPLE_SNARL ? 1 : 0;
+        net_handle_record_t type = SnarlTreeRecord(pointer, snarl_tree_records.get_local()).get_record_handle_type(); 
+        size_t node_record_offset = SnarlTreeRecord(pointer, snarl_tree_records.get_local()).get_record_type() == SIMPLE_SNARL || 
+                                    SnarlTreeRecord(pointer, snarl_tree_records.get_local()).get_record_type() == SIMPLE_SNARL ? 1 : 0;
         return get_net_handle_from_values(pointer, connectivity, type, node_record_offset); 
     
     }
     handlegraph::net_handle_t get_net_handle(size_t pointer) const  {
-        net_handle_record_t type = SnarlTreeRecord(pointer, &snarl_tree_records).get_record_handle_type(); 
+        net_handle_record_t type = SnarlTreeRecord(pointer, snarl_tree_records.get_local()).get_record_handle_type(); 
         return get_net_handle_from_values(pointer, START_END, type); 
     
     }
@@ -837,6 +1169,7 @@ private:
      * - A snarl record for each snarl, which are stuck in chains
      *   [snarl tag, # nodes, pointer to parent, min length, max length, rank in parent, 
      *      pointer to children (in child vector), distance vector]
+     *   The list of children is stored after the rest of the snarl's connected component
      *   The rank of the start node will always be 0 and the end node rank will be 1
      *   start/end are the start and end nodes, include the orientations
      *   For the first and last nodes, we only care about the node sides pointing in
@@ -844,6 +1177,13 @@ private:
      *   2rank+1 for the right side, and 0 for the start, 1 for the end, where we only keep the 
      *   inner node side of the start and end
      *   Node count is the number of nodes, not including boundary nodes
+     *
+     *   The distance vector normally has one distance per entry, at the width of the whole index.
+     *   If the tag has a nonzero distance width (see SNARL_DISTANCE_WIDTH_SHIFT), then it is instead
+     *   packed with as many values of that many bits as fit in one entry, lowest bits first, so
+     *   snarls with short distances don't pay for the longest distance anywhere in the index.
+     *   How many values share an entry is kept in the tag too, so that the record still reads
+     *   back the same if the index is later made wider.
      */
     const static size_t SNARL_RECORD_SIZE = 8;
     const static size_t SNARL_NODE_COUNT_OFFSET = 1;
@@ -890,7 +1230,73 @@ private:
     size_t snarl_size_limit = 5000;
     static const int max_num_size_limit_warnings = 100;
     std::atomic<int> size_limit_warnings{0};
-    static const uint32_t magic_number = 1738636486;
+
+    /// How many distance_in_parent() results each thread may cache for
+    /// minimum_distance(), or 0 for no cache.
+    size_t distance_cache_size = 0;
+    /// Identifies the current contents of this index to the thread-local
+    /// caches, so that entries cached for a different index, or for an older
+    /// version of this one, are never used.
+    uint64_t distance_cache_generation = 0;
+    mutable std::atomic<size_t> distance_cache_hits{0};
+    mutable std::atomic<size_t> distance_cache_misses{0};
+
+    /// Get the next never-before-used distance cache generation.
+    static uint64_t next_distance_cache_generation();
+
+    /// The root distance label of a node: its ancestor that is a child of the
+    /// root (as walked by minimum_distance()), the record offset of that
+    /// ancestor's parent, which identifies its root snarl or connected
+    /// component, and how distances to the ends of the node become distances
+    /// to the ends of the ancestor. As in minimum_distance(), the new distance
+    /// to the start is min(distances[0] + start, distances[1] + end), and the
+    /// new distance to the end is min(distances[2] + start, distances[3] + end).
+    struct RootDistanceLabel {
+        net_handle_t top;
+        size_t root_record_offset;
+        size_t distances[4];
+    };
+    bool use_root_distance_labels = false;
+    /// Root distance labels by node ID, starting from the minimum node ID
+    vector<RootDistanceLabel> root_distance_labels;
+
+    /// Fill in root_distance_labels for every node in the index
+    void build_root_distance_labels(const HandleGraph* graph);
+
+    /// Maximum distance tables for snarls. The sides of a snarl with n children
+    /// are numbered with 0 and 1 for the start and end bounds and 2r-2 and 2r-1
+    /// for the left and right sides of the child with rank r. For each snarl
+    /// with a table, snarl_maximum_distance_offsets maps the snarl's record
+    /// offset to the start of the upper triangle of its side-by-side matrix in
+    /// snarl_maximum_distances. Values are stored +1, with 0 for unreachable.
+    bool use_snarl_maximum_distances = false;
+    std::unordered_map<size_t, size_t> snarl_maximum_distance_offsets;
+    PackedVector<> snarl_maximum_distances;
+
+    /// Fill in the maximum distance tables for every DAG snarl in the index
+    void build_snarl_maximum_distances();
+
+    /// Get the maximum distance between two sides of children of a snarl, with
+    /// the same meaning as distance_in_snarl(). Returns
+    /// std::numeric_limits<size_t>::max() if the snarl has no table.
+    size_t get_snarl_maximum_distance(const net_handle_t& snarl, size_t rank1, bool right_side1,
+                                      size_t rank2, bool right_side2) const;
+
+    /// Get the distances from the ends of a child to the ends of its parent, as
+    /// used by minimum_distance() to walk up the snarl tree, in the same order
+    /// as RootDistanceLabel::distances. The parent can't be the root.
+    void get_bound_distances(const net_handle_t& child, const net_handle_t& parent, size_t* bounds,
+                             const HandleGraph* graph) const;
+
+    /// distance_in_parent() with no distance limit, going through the
+    /// thread-local distance cache if it is on.
+    size_t cached_distance_in_parent(const net_handle_t& parent, const net_handle_t& child1,
+                                     const net_handle_t& child2, const HandleGraph* graph) const;
+    /// This was 1738636486 before snarl distance vectors could be packed (see
+    /// SNARL_DISTANCE_WIDTH_SHIFT). Readers from before then can't decode the
+    /// packed records, so they have to reject these indexes, and indexes from
+    /// before then are rejected here.
+    static const uint32_t magic_number = 1738636487;
     
 public:
     void set_snarl_size_limit (size_t size) {snarl_size_limit=size;}
@@ -908,11 +1314,30 @@ private:
      * Each bit represents one type of connectivity:
      * start-start, start-end, start-tip, end-end, end-tip, tip-tip
      * 
-     * The remainder of the tag will be the record_t of the record
+     * The next RECORD_TYPE_BITS bits of the tag will be the record_t of the record.
+     * For snarls with distances, the SNARL_DISTANCE_WIDTH_BITS bits after that are
+     * the width of the values in the distance vector, or 0 if it isn't packed, and the
+     * SNARL_VALUES_PER_ENTRY_BITS bits after that are how many values are packed into
+     * each entry. This all fits in the narrowest index, which is 26 bits wide.
      */
+    const static size_t RECORD_TYPE_SHIFT = 9;
+    const static size_t RECORD_TYPE_BITS = 5;
+    const static size_t SNARL_DISTANCE_WIDTH_SHIFT = RECORD_TYPE_SHIFT + RECORD_TYPE_BITS;
+    const static size_t SNARL_DISTANCE_WIDTH_BITS = 6;
+    const static size_t SNARL_VALUES_PER_ENTRY_SHIFT = SNARL_DISTANCE_WIDTH_SHIFT + SNARL_DISTANCE_WIDTH_BITS;
+    const static size_t SNARL_VALUES_PER_ENTRY_BITS = 6;
+
     /////////// Methods for interpreting the tags for each snarl tree record
 
-    const static record_t get_record_type(const size_t tag) {return static_cast<record_t>(tag >> 9);}
+    const static record_t get_record_type(const size_t tag) {
+        return static_cast<record_t>((tag >> RECORD_TYPE_SHIFT) & ((1 << RECORD_TYPE_BITS) - 1));
+    }
+    const static size_t get_snarl_distance_width(const size_t tag) {
+        return (tag >> SNARL_DISTANCE_WIDTH_SHIFT) & ((1 << SNARL_DISTANCE_WIDTH_BITS) - 1);
+    }
+    const static size_t get_snarl_values_per_entry(const size_t tag) {
+        return (tag >> SNARL_VALUES_PER_ENTRY_SHIFT) & ((1 << SNARL_VALUES_PER_ENTRY_BITS) - 1);
+    }
 
     const static bool is_start_start_connected(const size_t tag) {return tag & 32;}
     const static bool is_start_end_connected(const size_t tag)   {return tag & 16;}
@@ -1071,6 +1496,8 @@ private:
         //Constructor meant for creating a new record, at the end of snarl_tree_records
         RootRecordWriter (size_t pointer, size_t connected_component_count, size_t node_count, size_t max_tree_depth, 
                     handlegraph::nid_t min_node_id, bdsg::yomo::UniqueMappedPointer<bdsg::MappedIntVector>* records);
+        //Constructor for a root record that has already been allocated
+        RootRecordWriter (bdsg::yomo::UniqueMappedPointer<bdsg::MappedIntVector>* records, size_t pointer);
 
         void set_connected_component_count(size_t connected_component_count);
         void set_node_count(size_t node_count);
@@ -1177,10 +1604,16 @@ private:
         SnarlRecord (net_handle_t net, const bdsg::yomo::UniqueMappedPointer<bdsg::MappedIntVector>* tree_records);
 
         //How big is the entire snarl record?
-        static size_t distance_vector_size(record_t type, size_t node_count);
-        static size_t record_size (record_t type, size_t node_count) ;
+        //values_per_entry is how many distances are packed into each entry of the distance vector
+        static size_t distance_vector_size(record_t type, size_t node_count, size_t values_per_entry = 1);
+        static size_t record_size (record_t type, size_t node_count, size_t values_per_entry = 1) ;
         size_t record_size() ;
 
+        //How many bits each value in the distance vector takes, or 0 if they take a whole entry each
+        size_t get_distance_width() const;
+        //How many distances are packed into each entry of the distance vector
+        size_t get_values_per_entry() const;
+
         //Get the index into the distance vector for the calculating distance between the given node sides
         static size_t get_distance_vector_offset(size_t rank1, bool right_side1, size_t rank2, 
                 bool right_side2, size_t node_count, record_t type); 
@@ -1212,7 +1645,10 @@ private:
 
         SnarlRecordWriter();
 
-        SnarlRecordWriter (size_t node_count, bdsg::yomo::UniqueMappedPointer<bdsg::MappedIntVector>* records, record_t type);
+        //distance_width is how many bits to use for each distance in the distance vector, or 0 to use
+        //a whole entry for each one. It is ignored if it wouldn't save any space.
+        SnarlRecordWriter (size_t node_count, bdsg::yomo::UniqueMappedPointer<bdsg::MappedIntVector>* records, record_t type,
+                           size_t distance_width = 0);
         SnarlRecordWriter(bdsg::yomo::UniqueMappedPointer<bdsg::MappedIntVector>* records, size_t pointer);
 
         void set_distance(size_t rank1, bool right_side1, size_t rank2, bool right_side2, size_t distance);
@@ -1311,6 +1747,14 @@ private:
                                     size_t rank2, bool right_side2, size_t node_length2,
                                     size_t prefix_sum2, size_t forward_loop2, size_t reverse_loop2, size_t component2, size_t end_component2) const;
 
+        ///Get the distance between two node sides along a chain, from the chain values
+        ///of the nodes, without checking components or taking the chain's loop.
+        ///The nodes must be ordered so that rank1 <= rank2.
+        static size_t get_distance_in_order(size_t rank1, bool left_side1, size_t node_length1,
+                                    size_t prefix_sum1, size_t forward_loop1, size_t reverse_loop1,
+                                    size_t rank2, bool left_side2, size_t node_length2,
+                                    size_t prefix_sum2, size_t forward_loop2, size_t reverse_loop2);
+
         ///For a chain that loops (when the start and end node are the same), find the 
         //distance walking around the back of the loop
         size_t get_distance_taking_chain_loop(size_t rank1, bool right_side1, size_t node_length1, 
@@ -1384,7 +1828,7 @@ private:
          */
 
         //Add a snarl to the end of the chain and return a SnarlRecordWriter pointing to it
-        SnarlRecordWriter add_snarl(size_t snarl_size, record_t type, size_t previous_child_offset); 
+        SnarlRecordWriter add_snarl(size_t snarl_size, record_t type, size_t previous_child_offset, size_t distance_width = 0); 
         SimpleSnarlRecordWriter add_simple_snarl(size_t snarl_size, record_t type, size_t previous_child_offset); 
         //Add a node to the end of a chain and return the offset of the record it got added to
         //If new_record is true, make a new trivial snarl record for the node
@@ -1398,16 +1842,16 @@ private:
 private:
     ////////////////////// More methods for dealing with net_handle_ts
     SnarlTreeRecord get_snarl_tree_record(const handlegraph::net_handle_t& net_handle) const {
-        return SnarlTreeRecord(get_record_offset(net_handle), &snarl_tree_records);
+        return SnarlTreeRecord(get_record_offset(net_handle), snarl_tree_records.get_local());
     }
     SnarlTreeRecord get_node_record(const handlegraph::net_handle_t& net_handle) const {
-        return NodeRecord(get_record_offset(net_handle), get_node_record_offset(net_handle), &snarl_tree_records); 
+        return NodeRecord(get_record_offset(net_handle), get_node_record_offset(net_handle), snarl_tree_records.get_local()); 
     }
     SnarlTreeRecord get_snarl_record(const handlegraph::net_handle_t& net_handle) const {
-        return SnarlRecord(get_record_offset(net_handle), &snarl_tree_records); 
+        return SnarlRecord(get_record_offset(net_handle), snarl_tree_records.get_local()); 
     }
     SnarlTreeRecord get_chain_record(const handlegraph::net_handle_t& net_handle) const {
-        return ChainRecord(get_record_offset(net_handle), &snarl_tree_records); 
+        return ChainRecord(get_record_offset(net_handle), snarl_tree_records.get_local()); 
     }
 
 public:
@@ -1615,11 +2059,25 @@ public:
     static size_t bit_width(size_t value) {
         return std::ceil(std::log2(value+1));
     }
+private:
+    //Copy the temporary indexes onto the end of snarl_tree_records, as connected components
+    //first_component onwards. The root record must already have room for them and their nodes
+    void add_snarl_tree_records(const vector<const TemporaryDistanceIndex*>& temporary_indexes, size_t first_component,
+                                const HandleGraph* graph);
 public:
     //Given an arbitrary number of temporary indexes, produce the final one
     //Each temporary index must be a separate connected component
     void get_snarl_tree_records(const vector<const TemporaryDistanceIndex*>& temporary_indexes, const HandleGraph* graph);
 
+    //After the graph has been edited, replace the connected components that changed without
+    //rebuilding the rest of the index. Each temporary index replaces every existing connected
+    //component that shares a node with it. A component that is gone from the graph entirely
+    //can be dropped by listing any of its nodes in removed_nodes. All the other components
+    //keep their records, so their distances don't need to be found again. The records of the
+    //replaced components are left behind as unused space until the index is rebuilt
+    void update_snarl_tree_records(const vector<const TemporaryDistanceIndex*>& temporary_indexes, const HandleGraph* graph,
+                                   const vector<handlegraph::nid_t>& removed_nodes = {});
+
     void time_accesses();
 
 };
@@ -0,0 +1,496 @@
+//
+//  bench_libbdsg.cpp
+//
+// Contains microbenchmarks for the hot operations on the data structures in
+// libbdsg, with JSON output so that results can be compared across versions.
+//
+
+#include <iostream>
+#include <cstdio>
+#include <vector>
+#include <string>
+#include <random>
+#include <chrono>
+#include <limits>
+#include <functional>
+#include <stdexcept>
+#include <memory>
+#include <algorithm>
+
+#include <getopt.h>
+#include <jansson.h>
+
+#include "bdsg/packed_graph.hpp"
+#include "bdsg/hash_graph.hpp"
+#include "bdsg/snarl_distance_index.hpp"
+#include "bdsg/overlays/path_position_overlays.hpp"
+#include "bdsg/overlays/packed_path_position_overlay.hpp"
+#include "bdsg/overlays/packed_reference_path_overlay.hpp"
+#include "bdsg/overlays/vectorizable_overlays.hpp"
+
+
+using namespace bdsg;
+using namespace handlegraph;
+using namespace std;
+
+/// Results get folded into here so the compiler can't throw the benchmarked
+/// work away.
+volatile size_t benchmark_sink = 0;
+
+/// The measurement for one operation on one graph implementation.
+struct BenchmarkResult {
+    /// Name of the graph the operation was run on
+    string graph;
+    /// The graph implementation or overlay
+    string implementation;
+    /// The operation that was timed
+    string operation;
+    /// The number of times the operation was carried out per repetition
+    size_t operations;
+    /// The fastest time in seconds over all the repetitions
+    double seconds;
+};
+
+/// Time a benchmark. The body is called once per repetition and must return
+/// the number of operations it did, and fold its results into the sink. Only
+/// the fastest repetition is kept.
+template<typename Body>
+void run_benchmark(vector<BenchmarkResult>& results, const string& graph, const string& implementation,
+                   const string& operation, size_t repetitions, const Body& body) {
+
+    BenchmarkResult result {graph, implementation, operation, 0, numeric_limits<double>::infinity()};
+    for (size_t i = 0; i < repetitions; i++) {
+        auto start = chrono::steady_clock::now();
+        size_t operations = body();
+        auto stop = chrono::steady_clock::now();
+
+        double seconds = chrono::duration<double>(stop - start).count();
+        if (seconds < result.seconds) {
+            result.seconds = seconds;
+            result.operations = operations;
+        }
+    }
+
+    cerr << graph << "\t" << implementation << "\t" << operation << "\t"
+         << (result.operations ? result.seconds * 1e9 / result.operations : 0.0) << " ns/op" << endl;
+    results.push_back(result);
+}
+
+/// Fill an empty graph with a synthetic variation graph: a backbone of nodes
+/// with a SNP-like bubble or a deletion every few nodes. The backbone is
+/// embedded as a "reference" path and one "alt" path takes the other side of
+/// every site.
+void make_synthetic_graph(MutablePathMutableHandleGraph& graph, size_t node_count, uint64_t seed) {
+
+    default_random_engine gen(seed);
+    uniform_int_distribution<int> base_distr(0, 3);
+    uniform_int_distribution<size_t> length_distr(1, 32);
+    uniform_int_distribution<int> site_distr(0, 9);
+
+    auto random_sequence = [&](size_t length) {
+        string seq(length, 'A');
+        for (char& c : seq) {
+            c = "ACGT"[base_distr(gen)];
+        }
+        return seq;
+    };
+
+    path_handle_t ref = graph.create_path_handle("reference");
+    path_handle_t alt = graph.create_path_handle("alt");
+
+    handle_t prev, prev_prev;
+    bool have_prev = false;
+    bool have_prev_prev = false;
+    size_t created = 0;
+    while (created < node_count) {
+        handle_t next = graph.create_handle(random_sequence(length_distr(gen)));
+        created++;
+
+        int site = site_distr(gen);
+        if (have_prev && site < 2 && created < node_count) {
+            // make a bubble between the previous node and this one
+            handle_t ref_allele = graph.create_handle(random_sequence(1));
+            handle_t alt_allele = graph.create_handle(random_sequence(1));
+            created += 2;
+            graph.create_edge(prev, ref_allele);
+            graph.create_edge(prev, alt_allele);
+            graph.create_edge(ref_allele, next);
+            graph.create_edge(alt_allele, next);
+            graph.append_step(ref, ref_allele);
+            graph.append_step(alt, alt_allele);
+        }
+        else if (have_prev_prev && site < 3) {
+            // make a deletion that skips the previous node
+            graph.create_edge(prev, next);
+            graph.create_edge(prev_prev, next);
+        }
+        else if (have_prev) {
+            graph.create_edge(prev, next);
+        }
+
+        graph.append_step(ref, next);
+        graph.append_step(alt, next);
+
+        prev_prev = prev;
+        have_prev_prev = have_prev;
+        prev = next;
+        have_prev = true;
+    }
+}
+
+/// Copy a graph, with its paths, into an empty graph of another
+/// implementation, preserving node IDs.
+void copy_graph(const PathHandleGraph& from, MutablePathMutableHandleGraph& into) {
+    from.for_each_handle([&](const handle_t& h) {
+        into.create_handle(from.get_sequence(h), from.get_id(h));
+    });
+    from.for_each_edge([&](const edge_t& edge) {
+        into.create_edge(into.get_handle(from.get_id(edge.first), from.get_is_reverse(edge.first)),
+                         into.get_handle(from.get_id(edge.second), from.get_is_reverse(edge.second)));
+    });
+    from.for_each_path_handle([&](const path_handle_t& path) {
+        path_handle_t copy = into.create_path_handle(from.get_path_name(path), from.get_is_circular(path));
+        for (handle_t h : from.scan_path(path)) {
+            into.append_step(copy, into.get_handle(from.get_id(h), from.get_is_reverse(h)));
+        }
+    });
+}
+
+/// Benchmark the HandleGraph operations that don't alter the graph.
+void benchmark_handle_graph(vector<BenchmarkResult>& results, const string& graph_name,
+                            const string& implementation, const HandleGraph& graph,
+                            size_t repetitions, uint64_t seed) {
+
+    // visit the nodes in a random order so we don't just measure streaming
+    vector<pair<nid_t, bool>> traversals;
+    traversals.reserve(graph.get_node_count());
+    graph.for_each_handle([&](const handle_t& h) {
+        traversals.emplace_back(graph.get_id(h), traversals.size() % 2);
+    });
+    shuffle(traversals.begin(), traversals.end(), default_random_engine(seed));
+
+    vector<handle_t> handles;
+    handles.reserve(traversals.size());
+    for (auto& traversal : traversals) {
+        handles.push_back(graph.get_handle(traversal.first, traversal.second));
+    }
+
+    run_benchmark(results, graph_name, implementation, "get_handle", repetitions, [&]() {
+        size_t total = 0;
+        for (auto& traversal : traversals) {
+            total += handlegraph::as_integer(graph.get_handle(traversal.first, traversal.second));
+        }
+        benchmark_sink += total;
+        return traversals.size();
+    });
+
+    run_benchmark(results, graph_name, implementation, "follow_edges", repetitions, [&]() {
+        size_t total = 0;
+        for (const handle_t& h : handles) {
+            for (bool go_left : {false, true}) {
+                graph.follow_edges(h, go_left, [&](const handle_t& next) {
+                    total += handlegraph::as_integer(next);
+                });
+            }
+        }
+        benchmark_sink += total;
+        return 2 * handles.size();
+    });
+
+    run_benchmark(results, graph_name, implementation, "get_sequence", repetitions, [&]() {
+        size_t total = 0;
+        for (const handle_t& h : handles) {
+            total += graph.get_sequence(h).size();
+        }
+        benchmark_sink += total;
+        return handles.size();
+    });
+
+    run_benchmark(results, graph_name, implementation, "get_base", repetitions, [&]() {
+        size_t total = 0;
+        size_t operations = 0;
+        for (const handle_t& h : handles) {
+            size_t length = graph.get_length(h);
+            for (size_t i = 0; i < length; i++) {
+                total += graph.get_base(h, i);
+            }
+            operations += length;
+        }
+        benchmark_sink += total;
+        return operations;
+    });
+}
+
+/// Benchmark building up a path one step at a time. The path visits every node
+/// and is destroyed again after each repetition.
+void benchmark_append_step(vector<BenchmarkResult>& results, const string& graph_name,
+                           const string& implementation, MutablePathHandleGraph& graph,
+                           size_t repetitions) {
+
+    vector<handle_t> handles;
+    handles.reserve(graph.get_node_count());
+    graph.for_each_handle([&](const handle_t& h) {
+        handles.push_back(h);
+    });
+
+    run_benchmark(results, graph_name, implementation, "append_step", repetitions, [&]() {
+        path_handle_t path = graph.create_path_handle("bdsg_bench_append_step");
+        for (const handle_t& h : handles) {
+            graph.append_step(path, h);
+        }
+        graph.destroy_path(path);
+        return handles.size();
+    });
+}
+
+/// Benchmark the position queries of a PathPositionHandleGraph.
+void benchmark_path_positions(vector<BenchmarkResult>& results, const string& graph_name,
+                              const string& implementation, const PathPositionHandleGraph& graph,
+                              size_t repetitions, uint64_t seed) {
+
+    vector<step_handle_t> steps;
+    vector<pair<path_handle_t, size_t>> positions;
+    default_random_engine gen(seed);
+    graph.for_each_path_handle([&](const path_handle_t& path) {
+        for (auto step = graph.path_begin(path); step != graph.path_end(path); step = graph.get_next_step(step)) {
+            steps.push_back(step);
+        }
+        size_t length = graph.get_path_length(path);
+        if (length > 0) {
+            uniform_int_distribution<size_t> distr(0, length - 1);
+            for (size_t i = 0, count = graph.get_step_count(path); i < count; i++) {
+                positions.emplace_back(path, distr(gen));
+            }
+        }
+    });
+    shuffle(steps.begin(), steps.end(), gen);
+
+    run_benchmark(results, graph_name, implementation, "get_position_of_step", repetitions, [&]() {
+        size_t total = 0;
+        for (const step_handle_t& step : steps) {
+            total += graph.get_position_of_step(step);
+        }
+        benchmark_sink += total;
+        return steps.size();
+    });
+
+    run_benchmark(results, graph_name, implementation, "get_step_at_position", repetitions, [&]() {
+        size_t total = 0;
+        for (auto& position : positions) {
+            total += handlegraph::as_integers(graph.get_step_at_position(position.first, position.second))[1];
+        }
+        benchmark_sink += total;
+        return positions.size();
+    });
+}
+
+/// Benchmark minimum distance queries between random node starts.
+void benchmark_minimum_distance(vector<BenchmarkResult>& results, const string& graph_name,
+                                const SnarlDistanceIndex& distance_index, const HandleGraph& graph,
+                                size_t queries, size_t repetitions, uint64_t seed) {
+
+    vector<nid_t> ids;
+    ids.reserve(graph.get_node_count());
+    graph.for_each_handle([&](const handle_t& h) {
+        ids.push_back(graph.get_id(h));
+    });
+    if (ids.empty()) {
+        return;
+    }
+
+    default_random_engine gen(seed);
+    uniform_int_distribution<size_t> distr(0, ids.size() - 1);
+    vector<pair<nid_t, nid_t>> pairs;
+    pairs.reserve(queries);
+    for (size_t i = 0; i < queries; i++) {
+        pairs.emplace_back(ids[distr(gen)], ids[distr(gen)]);
+    }
+
+    run_benchmark(results, graph_name, "SnarlDistanceIndex", "minimum_distance", repetitions, [&]() {
+        size_t total = 0;
+        for (auto& pair : pairs) {
+            total += distance_index.minimum_distance(pair.first, false, 0, pair.second, false, 0, false, &graph);
+        }
+        benchmark_sink += total;
+        return pairs.size();
+    });
+}
+
+/// Run every benchmark on every graph implementation holding a copy of the
+/// given graph, and on the overlays over each.
+void benchmark_graph(vector<BenchmarkResult>& results, const string& graph_name, const PathHandleGraph& source,
+                     const SnarlDistanceIndex* distance_index, size_t queries, size_t repetitions, uint64_t seed) {
+
+    HashGraph hash_graph;
+    PackedGraph packed_graph;
+    MappedPackedGraph mapped_packed_graph;
+    copy_graph(source, hash_graph);
+    copy_graph(source, packed_graph);
+    copy_graph(source, mapped_packed_graph);
+
+    vector<pair<string, MutablePathDeletableHandleGraph*>> implementations {
+        {"HashGraph", &hash_graph},
+        {"PackedGraph", &packed_graph},
+        {"MappedPackedGraph", &mapped_packed_graph}
+    };
+
+    for (auto& implementation : implementations) {
+        benchmark_handle_graph(results, graph_name, implementation.first, *implementation.second, repetitions, seed);
+        benchmark_append_step(results, graph_name, implementation.first, *implementation.second, repetitions);
+
+        {
+            PositionOverlay overlay(implementation.second);
+            benchmark_path_positions(results, graph_name, "PositionOverlay(" + implementation.first + ")",
+                                     overlay, repetitions, seed);
+        }
+        {
+            PackedPositionOverlay overlay(implementation.second);
+            benchmark_path_positions(results, graph_name, "PackedPositionOverlay(" + implementation.first + ")",
+                                     overlay, repetitions, seed);
+        }
+        {
+            PackedReferencePathOverlay overlay(implementation.second);
+            string name = "PackedReferencePathOverlay(" + implementation.first + ")";
+            benchmark_handle_graph(results, graph_name, name, overlay, repetitions, seed);
+            benchmark_path_positions(results, graph_name, name, overlay, repetitions, seed);
+        }
+        {
+            VectorizableOverlay overlay(implementation.second);
+            benchmark_handle_graph(results, graph_name, "VectorizableOverlay(" + implementation.first + ")",
+                                   overlay, repetitions, seed);
+        }
+    }
+
+    if (distance_index) {
+        benchmark_minimum_distance(results, graph_name, *distance_index, packed_graph, queries, repetitions, seed);
+    }
+}
+
+void print_help(char** argv) {
+    cerr << "usage: " << argv[0] << " [options]" << endl
+         << "Benchmark the hot operations of the libbdsg graphs and overlays." << endl
+         << endl
+         << "options:" << endl
+         << "    -g, --graph FILE       benchmark a graph in PackedGraph format (may repeat)" << endl
+         << "    -d, --distance FILE    distance index for the most recent --graph" << endl
+         << "    -n, --nodes N          nodes in the synthetic graph, or 0 to skip it [100000]" << endl
+         << "    -q, --queries N        minimum distance queries per repetition [100000]" << endl
+         << "    -r, --repetitions N    time each benchmark N times and keep the fastest [3]" << endl
+         << "    -s, --seed N           seed for the synthetic graph and queries [0]" << endl
+         << "    -o, --output FILE      write JSON results to FILE instead of standard output" << endl
+         << "    -h, --help             print this help" << endl;
+}
+
+int main(int argc, char** argv) {
+
+    vector<pair<string, string>> graph_files;
+    size_t synthetic_nodes = 100000;
+    size_t queries = 100000;
+    size_t repetitions = 3;
+    uint64_t seed = 0;
+    string output_file;
+
+    static struct option long_options[] = {
+        {"graph", required_argument, 0, 'g'},
+        {"distance", required_argument, 0, 'd'},
+        {"nodes", required_argument, 0, 'n'},
+        {"queries", required_argument, 0, 'q'},
+        {"repetitions", required_argument, 0, 'r'},
+        {"seed", required_argument, 0, 's'},
+        {"output", required_argument, 0, 'o'},
+        {"help", no_argument, 0, 'h'},
+        {0, 0, 0, 0}
+    };
+
+    int c;
+    while ((c = getopt_long(argc, argv, "g:d:n:q:r:s:o:h", long_options, nullptr)) != -1) {
+        switch (c) {
+        case 'g':
+            graph_files.emplace_back(optarg, "");
+            break;
+        case 'd':
+            if (graph_files.empty()) {
+                cerr << "error:[bdsg_bench] --distance must follow the --graph it indexes" << endl;
+                return 1;
+            }
+            graph_files.back().second = optarg;
+            break;
+        case 'n':
+            synthetic_nodes = stoull(optarg);
+            break;
+        case 'q':
+            queries = stoull(optarg);
+            break;
+        case 'r':
+            repetitions = max<size_t>(stoull(optarg), 1);
+            break;
+        case 's':
+            seed = stoull(optarg);
+            break;
+        case 'o':
+            output_file = optarg;
+            break;
+        case 'h':
+            print_help(argv);
+            return 0;
+        default:
+            print_help(argv);
+            return 1;
+        }
+    }
+
+    vector<BenchmarkResult> results;
+
+    if (synthetic_nodes > 0) {
+        PackedGraph synthetic;
+        make_synthetic_graph(synthetic, synthetic_nodes, seed);
+        benchmark_graph(results, "synthetic-" + to_string(synthetic_nodes), synthetic, nullptr,
+                        queries, repetitions, seed);
+    }
+
+    for (auto& graph_file : graph_files) {
+        PackedGraph graph;
+        graph.deserialize(graph_file.first);
+
+        unique_ptr<SnarlDistanceIndex> distance_index;
+        if (!graph_file.second.empty()) {
+            distance_index.reset(new SnarlDistanceIndex());
+            distance_index->deserialize(graph_file.second);
+        }
+
+        benchmark_graph(results, graph_file.first, graph, distance_index.get(), queries, repetitions, seed);
+    }
+
+    // report everything as JSON
+    json_t* out_json = json_object();
+    json_object_set_new(out_json, "repetitions", json_integer(repetitions));
+    json_object_set_new(out_json, "seed", json_integer(seed));
+    json_t* benchmarks_json = json_array();
+    for (auto& result : results) {
+        json_t* result_json = json_object();
+        json_object_set_new(result_json, "graph", json_string(result.graph.c_str()));
+        json_object_set_new(result_json, "implementation", json_string(result.implementation.c_str()));
+        json_object_set_new(result_json, "operation", json_string(result.operation.c_str()));
+        json_object_set_new(result_json, "operations", json_integer(result.operations));
+        json_object_set_new(result_json, "seconds", json_real(result.seconds));
+        json_object_set_new(result_json, "ns_per_operation",
+                            json_real(result.operations ? result.seconds * 1e9 / result.operations : 0.0));
+        json_array_append_new(benchmarks_json, result_json);
+    }
+    json_object_set_new(out_json, "benchmarks", benchmarks_json);
+
+    FILE* out = output_file.empty() ? stdout : fopen(output_file.c_str(), "w");
+    if (!out) {
+        cerr << "error:[bdsg_bench] could not open " << output_file << " for writing" << endl;
+        json_decref(out_json);
+        return 1;
+    }
+    json_dumpf(out_json, out, JSON_INDENT(2));
+    fputc('\n', out);
+    if (out != stdout) {
+        fclose(out);
+    }
+    json_decref(out_json);
+
+    return 0;
+}
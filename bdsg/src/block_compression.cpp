@@ -0,0 +1,53 @@
+#include "bdsg/internal/block_compression.hpp"
+
+#include <stdexcept>
+
+#ifdef BDSG_ZLIB
+#include <zlib.h>
+#endif
+
+namespace bdsg {
+
+#ifdef BDSG_ZLIB
+
+bool block_compression_available() {
+    return true;
+}
+
+void compress_block(const char* data, size_t length, std::string& compressed) {
+    uLongf compressed_length = compressBound(length);
+    compressed.resize(compressed_length);
+    // the default level trades speed and size about as well as any other
+    int status = compress2((Bytef*) &compressed[0], &compressed_length, (const Bytef*) data, length,
+                           Z_DEFAULT_COMPRESSION);
+    if (status != Z_OK) {
+        throw std::runtime_error("error:[compress_block] zlib failed to compress block with status " + std::to_string(status));
+    }
+    compressed.resize(compressed_length);
+}
+
+void decompress_block(const char* compressed, size_t compressed_length, char* dest, size_t length) {
+    uLongf decompressed_length = length;
+    int status = uncompress((Bytef*) dest, &decompressed_length, (const Bytef*) compressed, compressed_length);
+    if (status != Z_OK || decompressed_length != length) {
+        throw std::runtime_error("error:[decompress_block] compressed block is corrupt");
+    }
+}
+
+#else
+
+bool block_compression_available() {
+    return false;
+}
+
+void compress_block(const char* data, size_t length, std::string& compressed) {
+    throw std::runtime_error("error:[compress_block] libbdsg was built without zlib, so it cannot compress blocks");
+}
+
+void decompress_block(const char* compressed, size_t compressed_length, char* dest, size_t length) {
+    throw std::runtime_error("error:[decompress_block] libbdsg was built without zlib, so it cannot decompress blocks");
+}
+
+#endif
+
+}
@@ -7,6 +7,10 @@
 //#define debug_eades
 
 #include "bdsg/internal/eades_algorithm.hpp"
+#include "bdsg/internal/utility.hpp"
+
+#include <algorithm>
+#include <omp.h> // BINDER_IGNORE because Binder can't find this
 
 namespace bdsg {
 namespace algorithms {
@@ -277,5 +281,290 @@ using namespace handlegraph;
         
         return layout;
     }
+    
+    void parallel_eades_algorithm(const HandleGraph* graph, const function<void(const handle_t&)>& iteratee) {
+        
+        // components at least this big are laid out one at a time with all the threads
+        static const size_t PARALLEL_COMPONENT_SIZE = 1 << 16;
+        // source and sink frontiers at least this big are peeled in parallel
+        static const size_t PARALLEL_FRONTIER_SIZE = 1 << 10;
+        
+        // the progress of a node through the algorithm
+        enum : uint8_t {ABSENT = 0, UNSEEN, IN_BUCKET, SOURCE, SINK, PLACED};
+        
+        // decide which strand will be "forward" for each node
+        vector<handle_t> canonical_orientation = parallel_single_stranded_orientation(graph);
+        
+        if (canonical_orientation.size() < graph->get_node_count()) {
+            cerr << "error:[eades_algorithm] Eades' algorithm only valid on graphs with a single stranded orientation" << endl;
+            exit(1);
+        }
+        if (canonical_orientation.empty()) {
+            return;
+        }
+        
+        // choose a dense rank for each node to index the working state by
+        DenseNodeRanks ranks(graph);
+        size_t rank_space = ranks.size();
+        
+        // the working state, all indexed by rank
+        vector<handle_t> oriented(rank_space);
+        vector<uint8_t> state(rank_space, ABSENT);
+        vector<int64_t> in_degree(rank_space, 0);
+        vector<int64_t> out_degree(rank_space, 0);
+        vector<int64_t> bucket_of(rank_space, -1);
+        vector<int64_t> prev_in_bucket(rank_space, -1);
+        vector<int64_t> next_in_bucket(rank_space, -1);
+        
+        for (const handle_t& handle : canonical_orientation) {
+            size_t rank = ranks.rank(handle);
+            oriented[rank] = handle;
+            state[rank] = UNSEEN;
+        }
+        
+        // find the weakly connected components with a breadth first search, using
+        // the array of their nodes as the queue
+        vector<size_t> component_nodes;
+        component_nodes.reserve(canonical_orientation.size());
+        vector<size_t> component_starts;
+        for (size_t rank = 0; rank < rank_space; ++rank) {
+            if (state[rank] != UNSEEN) {
+                continue;
+            }
+            component_starts.push_back(component_nodes.size());
+            state[rank] = IN_BUCKET;
+            component_nodes.push_back(rank);
+            for (size_t i = component_starts.back(); i < component_nodes.size(); ++i) {
+                for (bool go_left : {false, true}) {
+                    graph->follow_edges(oriented[component_nodes[i]], go_left, [&](const handle_t& next) {
+                        size_t next_rank = ranks.rank(next);
+                        if (state[next_rank] == UNSEEN) {
+                            state[next_rank] = IN_BUCKET;
+                            component_nodes.push_back(next_rank);
+                        }
+                    });
+                }
+            }
+        }
+        component_starts.push_back(component_nodes.size());
+        
+        // measure the degrees
+#pragma omp parallel for
+        for (size_t i = 0; i < component_nodes.size(); ++i) {
+            size_t rank = component_nodes[i];
+            in_degree[rank] = graph->get_degree(oriented[rank], true);
+            out_degree[rank] = graph->get_degree(oriented[rank], false);
+        }
+        
+        // the layout as ranks, with each component in the same interval it has in
+        // component_nodes
+        vector<size_t> layout(component_nodes.size());
+        
+        // lay out the component in the given interval of component_nodes
+        auto lay_out_component = [&](size_t begin, size_t end, bool parallel) {
+            
+            // buckets based on delta(u) among non-source, non-sink nodes (see
+            // paper), as intrusive linked lists through the nodes
+            int64_t max_in_degree = 0;
+            int64_t max_out_degree = 0;
+            for (size_t i = begin; i < end; ++i) {
+                max_in_degree = max(max_in_degree, in_degree[component_nodes[i]]);
+                max_out_degree = max(max_out_degree, out_degree[component_nodes[i]]);
+            }
+            vector<int64_t> bucket_head(max_in_degree + max_out_degree + 1, -1);
+            int64_t max_delta_bucket = -1;
+            
+            auto link = [&](size_t rank) {
+                int64_t bucket = out_degree[rank] - in_degree[rank] + max_in_degree;
+                bucket_of[rank] = bucket;
+                prev_in_bucket[rank] = -1;
+                next_in_bucket[rank] = bucket_head[bucket];
+                if (bucket_head[bucket] != -1) {
+                    prev_in_bucket[bucket_head[bucket]] = rank;
+                }
+                bucket_head[bucket] = rank;
+                max_delta_bucket = max(max_delta_bucket, bucket);
+            };
+            auto unlink = [&](size_t rank) {
+                if (prev_in_bucket[rank] != -1) {
+                    next_in_bucket[prev_in_bucket[rank]] = next_in_bucket[rank];
+                }
+                else {
+                    bucket_head[bucket_of[rank]] = next_in_bucket[rank];
+                }
+                if (next_in_bucket[rank] != -1) {
+                    prev_in_bucket[next_in_bucket[rank]] = prev_in_bucket[rank];
+                }
+            };
+            
+            vector<size_t> sources;
+            vector<size_t> sinks;
+            
+            // move a node whose degrees have changed to wherever it belongs now
+            auto update = [&](size_t rank) {
+                if (state[rank] != IN_BUCKET) {
+                    return;
+                }
+                unlink(rank);
+                if (in_degree[rank] == 0) {
+                    state[rank] = SOURCE;
+                    sources.push_back(rank);
+                }
+                else if (out_degree[rank] == 0) {
+                    state[rank] = SINK;
+                    sinks.push_back(rank);
+                }
+                else {
+                    link(rank);
+                }
+            };
+            
+            for (size_t i = begin; i < end; ++i) {
+                size_t rank = component_nodes[i];
+                if (in_degree[rank] == 0) {
+                    state[rank] = SOURCE;
+                    sources.push_back(rank);
+                }
+                else if (out_degree[rank] == 0) {
+                    state[rank] = SINK;
+                    sinks.push_back(rank);
+                }
+                else {
+                    state[rank] = IN_BUCKET;
+                    link(rank);
+                }
+            }
+            
+            // remove a node's edges from the degrees of its neighbors on one side
+            auto remove_edges = [&](size_t rank, bool go_left, const function<void(size_t)>& on_neighbor) {
+                handle_t handle = oriented[rank];
+                graph->follow_edges(handle, go_left, [&](const handle_t& adjacent) {
+                    if (adjacent != handle) {
+                        size_t adjacent_rank = ranks.rank(adjacent);
+                        if (go_left) {
+#pragma omp atomic
+                            out_degree[adjacent_rank]--;
+                        }
+                        else {
+#pragma omp atomic
+                            in_degree[adjacent_rank]--;
+                        }
+                        on_neighbor(adjacent_rank);
+                    }
+                });
+            };
+            
+            // place a whole frontier of sources or sinks at once, finding the
+            // neighbors in parallel and then updating them all
+            vector<vector<size_t>> thread_touched(parallel ? get_thread_count() : 0);
+            auto peel_frontier = [&](vector<size_t>& frontier, size_t layout_begin, bool go_left) {
+                vector<size_t> peeling;
+                peeling.swap(frontier);
+                for (size_t i = 0; i < peeling.size(); ++i) {
+                    state[peeling[i]] = PLACED;
+                    layout[layout_begin + i] = peeling[i];
+                }
+#pragma omp parallel for schedule(static)
+                for (size_t i = 0; i < peeling.size(); ++i) {
+                    vector<size_t>& touched = thread_touched[omp_get_thread_num()];
+                    remove_edges(peeling[i], go_left, [&](size_t adjacent_rank) {
+                        // only nodes in buckets change state, and only in update()
+                        if (state[adjacent_rank] == IN_BUCKET) {
+                            touched.push_back(adjacent_rank);
+                        }
+                    });
+                }
+                for (vector<size_t>& touched : thread_touched) {
+                    for (size_t rank : touched) {
+                        update(rank);
+                    }
+                    touched.clear();
+                }
+            };
+            
+            // the next positions to add to in the layout (we fill from both sides)
+            int64_t next_left_idx = begin;
+            int64_t next_right_idx = int64_t(end) - 1;
+            
+            while (next_left_idx <= next_right_idx) {
+                if (!sources.empty()) {
+                    if (parallel && sources.size() >= PARALLEL_FRONTIER_SIZE) {
+                        // sources have no edges between them, so they can all go at once
+                        size_t count = sources.size();
+                        peel_frontier(sources, next_left_idx, false);
+                        next_left_idx += count;
+                    }
+                    else {
+                        // add a source to the layout and remove it from the graph
+                        size_t source = sources.back();
+                        sources.pop_back();
+                        state[source] = PLACED;
+                        layout[next_left_idx++] = source;
+                        remove_edges(source, false, update);
+                    }
+                }
+                else if (!sinks.empty()) {
+                    if (parallel && sinks.size() >= PARALLEL_FRONTIER_SIZE) {
+                        // sinks have no edges between them either
+                        size_t count = sinks.size();
+                        peel_frontier(sinks, next_right_idx - count + 1, true);
+                        next_right_idx -= int64_t(count);
+                    }
+                    else {
+                        // add a sink to the layout and remove it from the graph
+                        size_t sink = sinks.back();
+                        sinks.pop_back();
+                        state[sink] = PLACED;
+                        layout[next_right_idx--] = sink;
+                        remove_edges(sink, true, update);
+                    }
+                }
+                else {
+                    // remove a node in the highest delta bucket from the graph
+                    size_t next = bucket_head[max_delta_bucket];
+                    unlink(next);
+                    state[next] = PLACED;
+                    layout[next_left_idx++] = next;
+                    remove_edges(next, false, update);
+                    remove_edges(next, true, update);
+                }
+                
+                // move the max bucket lower if it has been emptied
+                while (max_delta_bucket >= 0 && bucket_head[max_delta_bucket] == -1) {
+                    max_delta_bucket--;
+                }
+            }
+        };
+        
+        size_t component_count = component_starts.size() - 1;
+        bool multithreaded = get_thread_count() > 1;
+        
+        // big components get all the threads to themselves
+        for (size_t i = 0; i < component_count; ++i) {
+            if (multithreaded && component_starts[i + 1] - component_starts[i] >= PARALLEL_COMPONENT_SIZE) {
+                lay_out_component(component_starts[i], component_starts[i + 1], true);
+            }
+        }
+        // and small components get a thread each
+#pragma omp parallel for schedule(dynamic, 1)
+        for (size_t i = 0; i < component_count; ++i) {
+            if (!multithreaded || component_starts[i + 1] - component_starts[i] < PARALLEL_COMPONENT_SIZE) {
+                lay_out_component(component_starts[i], component_starts[i + 1], false);
+            }
+        }
+        
+        for (size_t rank : layout) {
+            iteratee(oriented[rank]);
+        }
+    }
+    
+    vector<handle_t> parallel_eades_algorithm(const HandleGraph* graph) {
+        vector<handle_t> layout;
+        layout.reserve(graph->get_node_count());
+        parallel_eades_algorithm(graph, [&](const handle_t& handle) {
+            layout.push_back(handle);
+        });
+        return layout;
+    }
 }
 }
@@ -0,0 +1,1124 @@
+//
+//  flat_hash_graph.cpp
+//
+
+#include "bdsg/flat_hash_graph.hpp"
+
+#include <handlegraph/util.hpp>
+#include <unordered_set>
+
+namespace bdsg {
+
+    using namespace handlegraph;
+
+    const double FlatHashGraph::MAX_LOAD_FACTOR = 0.75;
+
+    FlatHashGraph::FlatHashGraph() {
+
+    }
+
+    FlatHashGraph::~FlatHashGraph() {
+
+    }
+
+    FlatHashGraph::FlatHashGraph(const FlatHashGraph& other) {
+        *this = other;
+    }
+
+    FlatHashGraph::FlatHashGraph(FlatHashGraph&& other) {
+        *this = move(other);
+    }
+
+    FlatHashGraph& FlatHashGraph::operator=(const FlatHashGraph& other) {
+
+        max_id = other.max_id;
+        min_id = other.min_id;
+        records = other.records;
+        slots = other.slots;
+        num_nodes = other.num_nodes;
+        sequences = other.sequences;
+        edges = other.edges;
+        sequence_garbage = other.sequence_garbage;
+        edge_garbage = other.edge_garbage;
+        path_id = other.path_id;
+        paths = other.paths;
+        next_path_id = other.next_path_id;
+
+        // can't directly copy the occurrences, because the pointers to path
+        // mappings will be different in the copy
+        occurrences.clear();
+        occurrence_garbage = 0;
+        for (node_t& node : records) {
+            node.occurrences = slice_t();
+        }
+        for (const auto& path_record : paths) {
+            const path_t& path = path_record.second;
+            bool first_iter = true;
+            for (path_mapping_t* mapping = path.head;
+                 mapping != nullptr && (first_iter || mapping != path.head); // for circular paths
+                 mapping = mapping->next) {
+                add_occurrence(mapping);
+                first_iter = false;
+            }
+        }
+        return *this;
+    }
+
+    FlatHashGraph& FlatHashGraph::operator=(FlatHashGraph&& other) {
+        max_id = other.max_id;
+        min_id = other.min_id;
+        records = move(other.records);
+        slots = move(other.slots);
+        num_nodes = other.num_nodes;
+        sequences = move(other.sequences);
+        edges = move(other.edges);
+        occurrences = move(other.occurrences);
+        sequence_garbage = other.sequence_garbage;
+        edge_garbage = other.edge_garbage;
+        occurrence_garbage = other.occurrence_garbage;
+        path_id = move(other.path_id);
+        paths = move(other.paths);
+        next_path_id = other.next_path_id;
+        other.clear();
+        return *this;
+    }
+
+    FlatHashGraph::FlatHashGraph(istream& in) {
+        deserialize(in);
+    }
+
+    FlatHashGraph::node_t& FlatHashGraph::insert_node(const nid_t& node_id) {
+
+        if (num_nodes + 1 > slots.size() * MAX_LOAD_FACTOR) {
+            rehash(max<size_t>(16, 2 * slots.size()));
+        }
+
+        size_t mask = slots.size() - 1;
+        size_t i = wang_hash_64(node_id) & mask;
+        while (slots[i].id != 0) {
+            i = (i + 1) & mask;
+        }
+        slots[i].id = node_id;
+        slots[i].record = records.size();
+
+        records.emplace_back();
+        records.back().id = node_id;
+        ++num_nodes;
+        return records.back();
+    }
+
+    void FlatHashGraph::erase_slot(size_t slot) {
+        // shift back any later entries in the probe sequence that could
+        // otherwise no longer be found
+        size_t mask = slots.size() - 1;
+        for (size_t j = (slot + 1) & mask; slots[j].id != 0; j = (j + 1) & mask) {
+            size_t home = wang_hash_64(slots[j].id) & mask;
+            // can the entry at j move to the hole, without moving before its
+            // home slot in the cyclic order?
+            bool movable = slot <= j ? (home <= slot || home > j) : (home <= slot && home > j);
+            if (movable) {
+                slots[slot] = slots[j];
+                slot = j;
+            }
+        }
+        slots[slot] = slot_t();
+    }
+
+    void FlatHashGraph::rehash(size_t num_slots) {
+        slots.clear();
+        slots.resize(num_slots);
+        size_t mask = num_slots - 1;
+        for (size_t r = 0; r < records.size(); ++r) {
+            if (records[r].id == 0) {
+                continue;
+            }
+            size_t i = wang_hash_64(records[r].id) & mask;
+            while (slots[i].id != 0) {
+                i = (i + 1) & mask;
+            }
+            slots[i].id = records[r].id;
+            slots[i].record = r;
+        }
+    }
+
+    void FlatHashGraph::compact(const vector<handle_t>* order) {
+
+        vector<node_t> new_records;
+        new_records.reserve(num_nodes);
+        string new_sequences;
+        new_sequences.reserve(sequences.size() - sequence_garbage);
+        vector<handle_t> new_edges;
+        new_edges.reserve(edges.size() - edge_garbage);
+        vector<path_mapping_t*> new_occurrences;
+        new_occurrences.reserve(occurrences.size() - occurrence_garbage);
+
+        auto copy_slice = [](slice_t& slice, auto& arena, auto& new_arena) {
+            size_t new_offset = new_arena.size();
+            new_arena.insert(new_arena.end(), arena.begin() + slice.offset, arena.begin() + slice.offset + slice.size);
+            slice.offset = new_offset;
+            slice.capacity = slice.size;
+        };
+
+        auto transfer = [&](const node_t& node) {
+            new_records.push_back(node);
+            node_t& new_node = new_records.back();
+            new_sequences.append(sequences, node.seq_offset, node.seq_length);
+            new_node.seq_offset = new_sequences.size() - node.seq_length;
+            copy_slice(new_node.left_edges, edges, new_edges);
+            copy_slice(new_node.right_edges, edges, new_edges);
+            copy_slice(new_node.occurrences, occurrences, new_occurrences);
+        };
+
+        if (order) {
+            for (const handle_t& handle : *order) {
+                transfer(get_node(get_id(handle)));
+            }
+            if (new_records.size() != num_nodes) {
+                throw std::runtime_error("error:[FlatHashGraph] ordering does not contain every node exactly once");
+            }
+        }
+        else {
+            for (const node_t& node : records) {
+                if (node.id != 0) {
+                    transfer(node);
+                }
+            }
+        }
+
+        records = move(new_records);
+        sequences = move(new_sequences);
+        edges = move(new_edges);
+        occurrences = move(new_occurrences);
+        sequence_garbage = 0;
+        edge_garbage = 0;
+        occurrence_garbage = 0;
+
+        // size the hash table to be about half full
+        size_t num_slots = 16;
+        while (num_nodes > num_slots * MAX_LOAD_FACTOR / 2) {
+            num_slots *= 2;
+        }
+        rehash(num_slots);
+    }
+
+    void FlatHashGraph::compact_if_wasteful() {
+        size_t garbage_bytes = (records.size() - num_nodes) * sizeof(node_t) + sequence_garbage
+            + edge_garbage * sizeof(handle_t) + occurrence_garbage * sizeof(path_mapping_t*);
+        size_t used_bytes = num_nodes * sizeof(node_t) + (sequences.size() - sequence_garbage)
+            + (edges.size() - edge_garbage) * sizeof(handle_t)
+            + (occurrences.size() - occurrence_garbage) * sizeof(path_mapping_t*);
+        if (garbage_bytes > used_bytes && garbage_bytes > MIN_GARBAGE_TO_COMPACT * sizeof(node_t)) {
+            compact();
+        }
+    }
+
+    handle_t FlatHashGraph::create_handle(const string& sequence) {
+        return create_handle(sequence, max_id + 1);
+    }
+
+    handle_t FlatHashGraph::create_handle(const string& sequence, const nid_t& id) {
+
+        if (id <= 0) {
+            throw std::runtime_error("error:[FlatHashGraph] tried to create a node with non-positive ID " + std::to_string(id));
+        }
+        if (find_slot(id) != slots.size()) {
+            throw std::runtime_error("error:[FlatHashGraph] tried to create a node with ID " + std::to_string(id) + ", but this ID already belongs to a different node");
+        }
+
+        compact_if_wasteful();
+
+        node_t& node = insert_node(id);
+        node.seq_offset = sequences.size();
+        node.seq_length = sequence.size();
+        sequences.append(sequence);
+
+        max_id = max(max_id, id);
+        min_id = min(min_id, id);
+        return get_handle(id, false);
+    }
+
+    void FlatHashGraph::create_edge(const handle_t& left, const handle_t& right) {
+
+        // look for the edge
+        bool add_edge = follow_edges(left, false, [&](const handle_t& next) {
+            return next != right;
+        });
+
+        // don't duplicate it
+        if (!add_edge) {
+            return;
+        }
+
+        push_back(edge_list(get_node(get_id(left)), get_is_reverse(left)), edges, edge_garbage, right);
+
+        // a reversing self-edge only touches one side of one node, so we only want
+        // to add it to a single edge list rather than two
+        if (left != flip(right)) {
+            push_back(edge_list(get_node(get_id(right)), !get_is_reverse(right)), edges, edge_garbage, flip(left));
+        }
+    }
+
+    bool FlatHashGraph::has_node(nid_t node_id) const {
+        return find_slot(node_id) != slots.size();
+    }
+
+    handle_t FlatHashGraph::get_handle(const nid_t& node_id, bool is_reverse) const {
+        return handlegraph::number_bool_packing::pack(node_id, is_reverse);
+    }
+
+    nid_t FlatHashGraph::get_id(const handle_t& handle) const {
+        return handlegraph::number_bool_packing::unpack_number(handle) ;
+    }
+
+    bool FlatHashGraph::get_is_reverse(const handle_t& handle) const {
+        return handlegraph::number_bool_packing::unpack_bit(handle);
+    }
+
+    handle_t FlatHashGraph::flip(const handle_t& handle) const {
+        return handlegraph::number_bool_packing::toggle_bit(handle);
+    }
+
+    size_t FlatHashGraph::get_length(const handle_t& handle) const {
+        return get_node(get_id(handle)).seq_length;
+    }
+
+    string FlatHashGraph::get_sequence(const handle_t& handle) const {
+        string seq;
+        get_sequence_into(handle, seq);
+        return seq;
+    }
+
+    void FlatHashGraph::get_sequence_into(const handle_t& handle, string& buffer) const {
+        const node_t& node = get_node(get_id(handle));
+        buffer.assign(sequences, node.seq_offset, node.seq_length);
+        if (get_is_reverse(handle)) {
+            reverse_complement_in_place(buffer);
+        }
+    }
+
+    bool FlatHashGraph::follow_edges_impl(const handle_t& handle, bool go_left,
+                                          const std::function<bool(const handle_t&)>& iteratee) const {
+        return follow_edges_fast(handle, go_left, iteratee);
+    }
+
+    size_t FlatHashGraph::get_node_count(void) const {
+        return num_nodes;
+    }
+
+    nid_t FlatHashGraph::min_node_id(void) const {
+        return min_id;
+    }
+
+    nid_t FlatHashGraph::max_node_id(void) const {
+        return max_id;
+    }
+
+    size_t FlatHashGraph::get_degree(const handle_t& handle, bool go_left) const {
+        return edge_list(get_node(get_id(handle)), get_is_reverse(handle) != go_left).size;
+    }
+
+    char FlatHashGraph::get_base(const handle_t& handle, size_t index) const {
+        const node_t& node = get_node(get_id(handle));
+        if (index >= node.seq_length) {
+            throw std::out_of_range("error:[FlatHashGraph] base " + std::to_string(index) + " is past the end of node " + std::to_string(node.id));
+        }
+        return get_is_reverse(handle) ? reverse_complement(sequences[node.seq_offset + node.seq_length - index - 1])
+                                      : sequences[node.seq_offset + index];
+    }
+
+    string FlatHashGraph::get_subsequence(const handle_t& handle, size_t index, size_t size) const {
+        const node_t& node = get_node(get_id(handle));
+        if (index > node.seq_length) {
+            throw std::out_of_range("error:[FlatHashGraph] subsequence starts past the end of node " + std::to_string(node.id));
+        }
+        size = min<size_t>(size, node.seq_length - index);
+        if (get_is_reverse(handle)) {
+            return reverse_complement(sequences.substr(node.seq_offset + node.seq_length - index - size, size));
+        }
+        else {
+            return sequences.substr(node.seq_offset + index, size);
+        }
+    }
+
+    bool FlatHashGraph::for_each_handle_impl(const std::function<bool(const handle_t&)>& iteratee,
+                                             bool parallel) const {
+
+        if (!parallel) {
+            return for_each_handle_fast(iteratee);
+        }
+
+        bool keep_going = true;
+#pragma omp parallel for schedule(dynamic, 1024)
+        for (size_t i = 0; i < records.size(); ++i) {
+            bool still_going;
+#pragma omp atomic read
+            still_going = keep_going;
+            if (still_going && records[i].id != 0 && !iteratee(get_handle(records[i].id))) {
+#pragma omp atomic write
+                keep_going = false;
+            }
+        }
+        return keep_going;
+    }
+
+    handle_t FlatHashGraph::apply_orientation(const handle_t& handle) {
+
+        // don't do anything if it's already forward
+        if (!get_is_reverse(handle)) {
+            return handle;
+        }
+
+        // reverse the sequence
+        node_t& node = get_node(get_id(handle));
+        std::reverse(sequences.begin() + node.seq_offset, sequences.begin() + node.seq_offset + node.seq_length);
+        for (size_t i = node.seq_offset; i < node.seq_offset + node.seq_length; ++i) {
+            sequences[i] = reverse_complement(sequences[i]);
+        }
+
+        // reverse the orientation of the handle in the edge lists
+        for (const slice_t* edge_slice : {&node.left_edges, &node.right_edges}) {
+            for (size_t i = 0; i < edge_slice->size; ++i) {
+                const handle_t& target = edges[edge_slice->offset + i];
+                const slice_t& bwd_edge_slice = edge_list(get_node(get_id(target)), !get_is_reverse(target));
+                for (size_t j = 0; j < bwd_edge_slice.size; ++j) {
+                    handle_t& bwd_handle = edges[bwd_edge_slice.offset + j];
+                    if (get_id(bwd_handle) == get_id(handle)) {
+                        bwd_handle = flip(bwd_handle);
+                        break;
+                    }
+                    // note: if a node has an edge to both sides of another node, we will end up flipping the
+                    // same edge target twice, but this actually ends with the edge list in the desired state,
+                    // so it's okay
+                }
+            }
+        }
+
+        // the edge lists switch sides
+        swap(node.left_edges, node.right_edges);
+
+        // update the occurrences on paths
+        for (size_t i = 0; i < node.occurrences.size; ++i) {
+            path_mapping_t* occurrence = occurrences[node.occurrences.offset + i];
+            occurrence->handle = flip(occurrence->handle);
+        }
+
+        // make it forward and return it
+        return flip(handle);
+    }
+
+    vector<handle_t> FlatHashGraph::divide_handle(const handle_t& handle, const vector<size_t>& offsets) {
+
+        // put the offsets in forward orientation to simplify subsequent steps
+        vector<size_t> forward_offsets = offsets;
+        size_t node_length = get_length(handle);
+        if (get_is_reverse(handle)) {
+            reverse(forward_offsets.begin(), forward_offsets.end());
+            for (size_t& off : forward_offsets) {
+                off = node_length - off;
+            }
+        }
+
+        // we will also build the return value in forward orientation
+        handle_t forward_handle = forward(handle);
+        vector<handle_t> return_val;
+        return_val.push_back(forward_handle);
+
+        // make it easy to handle edge cases by returning here if we're not actually dividing
+        if (offsets.empty()) {
+            return return_val;
+        }
+
+        // divvy up the sequence onto separate nodes, which share the original
+        // node's interval of the sequence arena
+        uint64_t seq_offset = get_node(get_id(handle)).seq_offset;
+        for (size_t i = 0; i < forward_offsets.size(); i++) {
+            size_t length = (i + 1 < forward_offsets.size() ? forward_offsets[i + 1] : node_length) - forward_offsets[i];
+            nid_t id = max_id + 1;
+            node_t& new_node = insert_node(id);
+            new_node.seq_offset = seq_offset + forward_offsets[i];
+            new_node.seq_length = length;
+            max_id = id;
+            return_val.push_back(get_handle(id));
+        }
+        get_node(get_id(handle)).seq_length = forward_offsets.front();
+
+        // move the edges out the end of the node to the final one
+        node_t& final_node = get_node(get_id(return_val.back()));
+        node_t& orig_node = get_node(get_id(handle));
+        final_node.right_edges = orig_node.right_edges;
+        orig_node.right_edges = slice_t();
+
+        // update the backwards references back onto this node
+        for (size_t i = 0; i < final_node.right_edges.size; ++i) {
+            handle_t& next = edges[final_node.right_edges.offset + i];
+            if (next == flip(forward_handle)) {
+                next = flip(return_val.back());
+                continue;
+            }
+            const slice_t& bwd_edge_slice = edge_list(get_node(get_id(next)), !get_is_reverse(next));
+            for (size_t j = 0; j < bwd_edge_slice.size; ++j) {
+                handle_t& bwd_target = edges[bwd_edge_slice.offset + j];
+                if (bwd_target == flip(forward_handle)) {
+                    bwd_target = flip(return_val.back());
+                    break;
+                }
+            }
+        }
+
+        // create edges between the segments of the original node
+        for (size_t i = 1; i < return_val.size(); i++) {
+            push_back(get_node(get_id(return_val[i - 1])).right_edges, edges, edge_garbage, return_val[i]);
+            push_back(get_node(get_id(return_val[i])).left_edges, edges, edge_garbage, flip(return_val[i - 1]));
+        }
+
+        // update the paths and the occurrence records
+        slice_t orig_occurrences = get_node(get_id(handle)).occurrences;
+        for (size_t j = 0; j < orig_occurrences.size; ++j) {
+            path_mapping_t* mapping = occurrences[orig_occurrences.offset + j];
+            path_t& path = paths[mapping->path_id];
+            if (get_is_reverse(mapping->handle)) {
+                for (size_t i = return_val.size() - 1; i > 0; i--) {
+                    add_occurrence(path.insert_before(flip(return_val[i]), mapping));
+                }
+            }
+            else {
+                mapping = mapping->next;
+                for (size_t i = 1; i < return_val.size(); i++) {
+                    add_occurrence(path.insert_before(return_val[i], mapping));
+                }
+            }
+        }
+
+        if (get_is_reverse(handle)) {
+            // reverse the orientation of the return value to match the input
+            reverse(return_val.begin(), return_val.end());
+            for (handle_t& ret_handle : return_val) {
+                ret_handle = flip(ret_handle);
+            }
+        }
+
+        return return_val;
+    }
+
+    void FlatHashGraph::optimize(bool allow_id_reassignment) {
+        // release all of the unused space
+        compact();
+        records.shrink_to_fit();
+        sequences.shrink_to_fit();
+        edges.shrink_to_fit();
+        occurrences.shrink_to_fit();
+        // reassign hash tables to the midpoint of their max and min load factors
+        path_id.rehash(path_id.size() * 0.5 * (path_id.min_load_factor() + path_id.max_load_factor()));
+        paths.rehash(paths.size() * 0.5 * (paths.min_load_factor() + paths.max_load_factor()));
+    }
+
+    bool FlatHashGraph::apply_ordering(const vector<handle_t>& order, bool compact_ids) {
+        // the records are stored in iteration order, so we can put them in
+        // the requested order as we compact them
+        compact(&order);
+        if (compact_ids) {
+            hash_map<nid_t, nid_t> new_ids;
+            new_ids.reserve(num_nodes);
+            for (size_t i = 0; i < records.size(); ++i) {
+                new_ids[records[i].id] = i + 1;
+            }
+            reassign_node_ids([&](const nid_t& node_id) {
+                return new_ids.at(node_id);
+            });
+        }
+        return compact_ids;
+    }
+
+    void FlatHashGraph::destroy_handle(const handle_t& handle) {
+
+        // Clear out any paths on this handle.
+        // We need to first compose a list of distinct visiting paths.
+        std::unordered_set<path_handle_t> visiting_paths;
+        for_each_step_on_handle(handle, [&](const step_handle_t& step) {
+            visiting_paths.insert(get_path_handle_of_step(step));
+        });
+        for (auto& p : visiting_paths) {
+            // Then we destroy all of them.
+            destroy_path(p);
+        }
+
+        // remove backwards references from edges on other nodes
+        size_t slot = find_slot(get_id(handle));
+        node_t& node = records[slots[slot].record];
+        for (const slice_t* edge_slice : {&node.left_edges, &node.right_edges}) {
+            for (size_t i = 0; i < edge_slice->size; ++i) {
+                const handle_t& next = edges[edge_slice->offset + i];
+                if (get_id(next) == get_id(handle)) {
+                    // this is a self-loop, which we're going to release anyway
+                    continue;
+                }
+                slice_t& bwd_edge_slice = edge_list(get_node(get_id(next)), !get_is_reverse(next));
+                for (size_t j = 0; j < bwd_edge_slice.size; ++j) {
+                    if (get_id(edges[bwd_edge_slice.offset + j]) == get_id(handle)) {
+                        remove(bwd_edge_slice, edges, j);
+                        break;
+                    }
+                }
+            }
+        }
+
+        // free the node's space and remove it from the table
+        release(node.left_edges, edge_garbage);
+        release(node.right_edges, edge_garbage);
+        release(node.occurrences, occurrence_garbage);
+        sequence_garbage += node.seq_length;
+        node = node_t();
+        erase_slot(slot);
+        --num_nodes;
+    }
+
+    void FlatHashGraph::destroy_edge(const handle_t& left, const handle_t& right) {
+
+        // remove this edge from left
+        slice_t& left_edge_slice = edge_list(get_node(get_id(left)), get_is_reverse(left));
+        for (size_t i = 0; i < left_edge_slice.size; ++i) {
+            if (edges[left_edge_slice.offset + i] == right) {
+                remove(left_edge_slice, edges, i);
+                break;
+            }
+        }
+
+        // remove this edge from right
+        slice_t& right_edge_slice = edge_list(get_node(get_id(right)), !get_is_reverse(right));
+        for (size_t i = 0; i < right_edge_slice.size; ++i) {
+            if (edges[right_edge_slice.offset + i] == flip(left)) {
+                remove(right_edge_slice, edges, i);
+                break;
+            }
+        }
+    }
+
+    handle_t FlatHashGraph::truncate_handle(const handle_t& handle, bool trunc_left, size_t offset) {
+
+        handle_t fwd_handle = forward(handle);
+        offset = get_is_reverse(handle) ? get_length(handle) - offset : offset;
+        trunc_left = get_is_reverse(handle) != trunc_left;
+
+        node_t& node = get_node(get_id(fwd_handle));
+        slice_t& truncated_edges = edge_list(node, trunc_left);
+        // the edge that the other side of the node records for each edge on
+        // the truncated side
+        handle_t self = trunc_left ? fwd_handle : flip(fwd_handle);
+        // remove references on the other nodes
+        for (size_t i = 0; i < truncated_edges.size; ++i) {
+            handle_t next = edges[truncated_edges.offset + i];
+            if (next == self) {
+                continue;
+            }
+            slice_t& bwd_edge_slice = edge_list(get_node(get_id(next)), !get_is_reverse(next));
+            for (size_t j = 0; j < bwd_edge_slice.size; ++j) {
+                if (edges[bwd_edge_slice.offset + j] == self) {
+                    remove(bwd_edge_slice, edges, j);
+                    break;
+                }
+            }
+        }
+        // remove references on this node
+        release(truncated_edges, edge_garbage);
+        if (trunc_left) {
+            node.seq_offset += offset;
+            sequence_garbage += offset;
+            node.seq_length -= offset;
+        }
+        else {
+            sequence_garbage += node.seq_length - offset;
+            node.seq_length = offset;
+        }
+
+        return handle;
+    }
+
+    void FlatHashGraph::clear(void) {
+        max_id = 0;
+        min_id = numeric_limits<nid_t>::max();
+        next_path_id = 1;
+        records.clear();
+        slots.clear();
+        num_nodes = 0;
+        sequences.clear();
+        edges.clear();
+        occurrences.clear();
+        sequence_garbage = 0;
+        edge_garbage = 0;
+        occurrence_garbage = 0;
+        path_id.clear();
+        paths.clear();
+    }
+
+    size_t FlatHashGraph::get_path_count() const {
+        return paths.size();
+    }
+
+    bool FlatHashGraph::has_path(const std::string& path_name) const {
+        return path_id.count(path_name);
+    }
+
+    path_handle_t FlatHashGraph::get_path_handle(const std::string& path_name) const {
+        return as_path_handle(path_id.at(path_name));
+    }
+
+    string FlatHashGraph::get_path_name(const path_handle_t& path_handle) const {
+        return paths.at(as_integer(path_handle)).name;
+    }
+
+    bool FlatHashGraph::get_is_circular(const path_handle_t& path_handle) const {
+        return paths.at(as_integer(path_handle)).is_circular;
+    }
+
+    size_t FlatHashGraph::get_step_count(const path_handle_t& path_handle) const {
+        return paths.at(as_integer(path_handle)).count;
+    }
+
+    bool FlatHashGraph::for_each_path_handle_impl(const std::function<bool(const path_handle_t&)>& iteratee) const {
+        for (auto it = paths.begin(); it != paths.end(); it++) {
+            if (!iteratee(as_path_handle(it->first))) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool FlatHashGraph::for_each_path_handle(const std::function<bool(const path_handle_t&)>& iteratee,
+                                             bool parallel) const {
+        if (!parallel) {
+            return for_each_path_handle_impl(iteratee);
+        }
+        vector<pair<size_t, path_handle_t>> weighted_paths;
+        weighted_paths.reserve(paths.size());
+        for (auto it = paths.begin(); it != paths.end(); it++) {
+            weighted_paths.emplace_back(it->second.count, as_path_handle(it->first));
+        }
+        return parallel_for_each_weighted(weighted_paths, PARALLEL_ITERATION_CHUNK_SIZE, iteratee);
+    }
+    
+    bool FlatHashGraph::for_each_step_in_path(const path_handle_t& path_handle,
+                                              const std::function<bool(const step_handle_t&)>& iteratee,
+                                              bool parallel) const {
+        if (!parallel) {
+            return PathHandleGraph::for_each_step_in_path(path_handle, iteratee);
+        }
+        return paths.at(as_integer(path_handle)).for_each_step_parallel([&](const path_mapping_t* mapping) {
+            step_handle_t step;
+            as_integers(step)[0] = as_integer(path_handle);
+            as_integers(step)[1] = intptr_t(mapping);
+            return iteratee(step);
+        }, PARALLEL_ITERATION_CHUNK_SIZE);
+    }
+
+    handle_t FlatHashGraph::get_handle_of_step(const step_handle_t& step_handle) const {
+        return ((path_mapping_t*) intptr_t(as_integers(step_handle)[1]))->handle;
+    }
+
+    step_handle_t FlatHashGraph::path_begin(const path_handle_t& path_handle) const {
+        step_handle_t step;
+        as_integers(step)[0] = as_integer(path_handle);
+        as_integers(step)[1] = intptr_t(paths.at(as_integer(path_handle)).head);
+        return step;
+    }
+
+    step_handle_t FlatHashGraph::path_end(const path_handle_t& path_handle) const {
+        step_handle_t step;
+        as_integers(step)[0] = as_integer(path_handle);
+        as_integers(step)[1] = intptr_t(nullptr);
+        return step;
+    }
+
+    step_handle_t FlatHashGraph::path_back(const path_handle_t& path_handle) const {
+        step_handle_t step;
+        as_integers(step)[0] = as_integer(path_handle);
+        as_integers(step)[1] = intptr_t(paths.at(as_integer(path_handle)).tail);
+        return step;
+    }
+
+    step_handle_t FlatHashGraph::path_front_end(const path_handle_t& path_handle) const {
+        // we'll actually use the same sentinel
+        return path_end(path_handle);
+    }
+
+    bool FlatHashGraph::has_next_step(const step_handle_t& step_handle) const {
+        return ((path_mapping_t*) intptr_t(as_integers(step_handle)[1]))->next != nullptr;
+    }
+
+    bool FlatHashGraph::has_previous_step(const step_handle_t& step_handle) const {
+        return ((path_mapping_t*) intptr_t(as_integers(step_handle)[1]))->prev != nullptr;
+    }
+
+    step_handle_t FlatHashGraph::get_next_step(const step_handle_t& step_handle) const {
+        step_handle_t next;
+        as_integers(next)[0] = as_integers(step_handle)[0];
+        as_integers(next)[1] = intptr_t(((path_mapping_t*) intptr_t(as_integers(step_handle)[1]))->next);
+        return next;
+    }
+
+    step_handle_t FlatHashGraph::get_previous_step(const step_handle_t& step_handle) const {
+        step_handle_t prev;
+        as_integers(prev)[0] = as_integers(step_handle)[0];
+        as_integers(prev)[1] = as_integers(step_handle)[1] != intptr_t(nullptr) ? intptr_t(((path_mapping_t*) intptr_t(as_integers(step_handle)[1]))->prev)
+                                                                                : intptr_t(paths.at(as_integers(step_handle)[0]).tail);
+        return prev;
+    }
+
+    path_handle_t FlatHashGraph::get_path_handle_of_step(const step_handle_t& step_handle) const {
+        return as_path_handle(as_integers(step_handle)[0]);
+    }
+
+    bool FlatHashGraph::for_each_step_on_handle_impl(const handle_t& handle,
+                                                     const function<bool(const step_handle_t&)>& iteratee) const {
+        return for_each_step_on_handle_fast(handle, iteratee);
+    }
+
+    void FlatHashGraph::remove_occurrence(path_mapping_t* mapping) {
+        slice_t& occurrence_slice = get_node(get_id(mapping->handle)).occurrences;
+        for (size_t i = 0; i < occurrence_slice.size; i++) {
+            if (occurrences[occurrence_slice.offset + i] == mapping) {
+                remove(occurrence_slice, occurrences, i);
+                break;
+            }
+        }
+    }
+
+    void FlatHashGraph::destroy_path(const path_handle_t& path) {
+
+        // remove the records of nodes occurring on this path
+        for_each_step_in_path(path, [&](const step_handle_t& step) {
+            remove_occurrence((path_mapping_t*) intptr_t(as_integers(step)[1]));
+        });
+
+        // erase the path itself
+        path_id.erase(paths[as_integer(path)].name);
+        paths.erase(as_integer(path));
+    }
+
+    path_handle_t FlatHashGraph::create_path_handle(const string& name, bool is_circular) {
+        path_id[name] = next_path_id;
+        paths[next_path_id] = path_t(name, next_path_id, is_circular);
+        next_path_id++;
+        return as_path_handle(next_path_id - 1);
+    }
+
+    step_handle_t FlatHashGraph::append_step(const path_handle_t& path, const handle_t& to_append) {
+
+        path_t& path_list = paths[as_integer(path)];
+        path_mapping_t* mapping = path_list.push_back(to_append);
+        add_occurrence(mapping);
+
+        step_handle_t step;
+        as_integers(step)[0] = as_integer(path);
+        as_integers(step)[1] = intptr_t(mapping);
+        return step;
+    }
+
+    step_handle_t FlatHashGraph::prepend_step(const path_handle_t& path, const handle_t& to_prepend) {
+
+        path_t& path_list = paths[as_integer(path)];
+        path_mapping_t* mapping = path_list.push_front(to_prepend);
+        add_occurrence(mapping);
+
+        step_handle_t step;
+        as_integers(step)[0] = as_integer(path);
+        as_integers(step)[1] = intptr_t(mapping);
+        return step;
+    }
+
+    pair<step_handle_t, step_handle_t> FlatHashGraph::rewrite_segment(const step_handle_t& segment_begin,
+                                                                      const step_handle_t& segment_end,
+                                                                      const std::vector<handle_t>& new_segment) {
+
+        if (get_path_handle_of_step(segment_begin) != get_path_handle_of_step(segment_end)) {
+            cerr << "error:[FlatHashGraph] attempted to rewrite a path segment delimited by steps on two different paths" << endl;
+            exit(1);
+        }
+
+        path_mapping_t* begin = (path_mapping_t*) intptr_t(as_integers(segment_begin)[1]);
+        path_mapping_t* end = (path_mapping_t*) intptr_t(as_integers(segment_end)[1]);
+
+        path_t& path_list = paths[as_integers(segment_begin)[0]];
+
+        for (path_mapping_t* mapping = begin; mapping != end;) {
+
+            // remove this occurrence of the mapping from the occurrences index
+            remove_occurrence(mapping);
+
+            path_mapping_t* next = mapping->next;
+
+            // remove the step from the path
+            path_list.remove(mapping);
+
+            mapping = next;
+        }
+
+        // init the new range for the return value
+        pair<step_handle_t, step_handle_t> new_range(segment_end, segment_end);
+
+        // add the new segment into the slot
+        bool first_iter = true;
+        for (const handle_t& handle : new_segment) {
+
+            path_mapping_t* mapping = path_list.insert_before(handle, end);
+            add_occurrence(mapping);
+
+            if (first_iter) {
+                as_integers(new_range.first)[1] = intptr_t(mapping);
+                first_iter = false;
+            }
+        }
+
+        return new_range;
+    }
+
+    void FlatHashGraph::set_circularity(const path_handle_t& path, bool circular) {
+        // set the annotation
+        path_t& path_list = paths[as_integer(path)];
+        path_list.is_circular = circular;
+
+        // set the circular connection between the head and tail
+        if (path_list.head) {
+            if (circular) {
+                path_list.head->prev = path_list.tail;
+                path_list.tail->next = path_list.head;
+            }
+            else {
+                path_list.head->prev = nullptr;
+                path_list.tail->next = nullptr;
+            }
+        }
+    }
+
+    void FlatHashGraph::set_id_increment(const nid_t& min_id) {
+        // no-op as this implementation does not require this hint for decent construction performance
+    }
+
+    void FlatHashGraph::increment_node_ids(nid_t increment) {
+        reassign_node_ids([&increment](const nid_t& node_id) { return node_id + increment; });
+    }
+
+    void FlatHashGraph::reassign_node_ids(const std::function<nid_t(const nid_t&)>& get_new_id) {
+
+        nid_t new_max_id = 0;
+        nid_t new_min_id = std::numeric_limits<nid_t>::max();
+
+        for (node_t& node : records) {
+            if (node.id == 0) {
+                continue;
+            }
+            // Transform the IDs in all the handles for edges
+            for (const slice_t* edge_slice : {&node.left_edges, &node.right_edges}) {
+                for (size_t i = edge_slice->offset; i < edge_slice->offset + edge_slice->size; ++i) {
+                    edges[i] = set_id(edges[i], get_new_id(get_id(edges[i])));
+                }
+            }
+
+            // Convert its ID
+            node.id = get_new_id(node.id);
+            new_max_id = std::max(new_max_id, node.id);
+            new_min_id = std::min(new_min_id, node.id);
+        }
+
+        // the slots are keyed by the old IDs
+        rehash(slots.size());
+
+        // Now we just have to change the paths, in place, so we don't break occurrence pointers
+        for (auto& id_and_path : paths) {
+            // For each path
+            bool first_iter = true;
+            for (path_mapping_t* here = id_and_path.second.head;
+                here != nullptr && (first_iter || here != id_and_path.second.head);
+                here = here->next) {
+
+                // For each mapping in the possibly circular linked list, transform the ID in the handle.
+                here->handle = set_id(here->handle, get_new_id(get_id(here->handle)));
+                first_iter = false;
+            }
+        }
+
+        // Now apply the graph metadata (and zero the ID offset).
+        max_id = new_max_id;
+        min_id = new_min_id;
+    }
+
+    void FlatHashGraph::serialize_members(ostream& out) const {
+        // this is the same layout that HashGraph uses
+
+        nid_t max_id_out = endianness<nid_t>::to_big_endian(max_id);
+        out.write((const char*) &max_id_out, sizeof(max_id_out) / sizeof(char));
+
+        nid_t min_id_out = endianness<nid_t>::to_big_endian(min_id);
+        out.write((const char*) &min_id_out, sizeof(min_id_out) / sizeof(char));
+
+        int64_t next_path_id_out = endianness<int64_t>::to_big_endian(next_path_id);
+        out.write((const char*) &next_path_id_out, sizeof(next_path_id_out) / sizeof(char));
+
+        uint64_t graph_size_out = endianness<uint64_t>::to_big_endian(num_nodes);
+        out.write((const char*) &graph_size_out, sizeof(graph_size_out) / sizeof(char));
+
+        for (const node_t& node : records) {
+            if (node.id == 0) {
+                continue;
+            }
+            nid_t node_id_out = endianness<nid_t>::to_big_endian(node.id);
+            out.write((const char*) &node_id_out, sizeof(node_id_out) / sizeof(char));
+
+            uint64_t seq_size_out = endianness<uint64_t>::to_big_endian(node.seq_length);
+            out.write((const char*) &seq_size_out, sizeof(seq_size_out) / sizeof(char));
+            out.write(sequences.data() + node.seq_offset, node.seq_length);
+
+            for (const slice_t* edge_slice : {&node.left_edges, &node.right_edges}) {
+                uint64_t edges_size_out = endianness<uint64_t>::to_big_endian(edge_slice->size);
+                out.write((const char*) &edges_size_out, sizeof(edges_size_out) / sizeof(char));
+                for (size_t i = edge_slice->offset; i < edge_slice->offset + edge_slice->size; i++) {
+                    int64_t next_out = endianness<int64_t>::to_big_endian(as_integer(edges[i]));
+                    out.write((const char*) &next_out, sizeof(next_out) / sizeof(char));
+                }
+            }
+
+            // don't serialize the occurrences, since they are redundant information with the actual
+            // path and the value requires an in memory representation of the paths
+        }
+
+        uint64_t paths_size_out = endianness<uint64_t>::to_big_endian(paths.size());
+        out.write((const char*) &paths_size_out, sizeof(paths_size_out) / sizeof(char));
+        for (const auto& path_record : paths) {
+            path_record.second.serialize(out);
+        }
+    }
+
+    void FlatHashGraph::deserialize_members(istream& in) {
+        clear();
+
+        nid_t max_id_in;
+        in.read((char*) &max_id_in, sizeof(max_id_in) / sizeof(char));
+        max_id = endianness<nid_t>::from_big_endian(max_id_in);
+
+        nid_t min_id_in;
+        in.read((char*) &min_id_in, sizeof(min_id_in) / sizeof(char));
+        min_id = endianness<nid_t>::from_big_endian(min_id_in);
+
+        int64_t next_path_id_in;
+        in.read((char*) &next_path_id_in, sizeof(next_path_id_in) / sizeof(char));
+        next_path_id = endianness<int64_t>::from_big_endian(next_path_id_in);
+
+        uint64_t num_nodes_in;
+        in.read((char*) &num_nodes_in, sizeof(num_nodes_in) / sizeof(char));
+        uint64_t num_nodes_to_read = endianness<uint64_t>::from_big_endian(num_nodes_in);
+
+        records.reserve(num_nodes_to_read);
+        for (size_t i = 0; i < num_nodes_to_read; i++) {
+            nid_t node_id_in;
+            in.read((char*) &node_id_in, sizeof(node_id_in) / sizeof(char));
+            nid_t node_id = endianness<nid_t>::from_big_endian(node_id_in);
+
+            records.emplace_back();
+            node_t& node = records.back();
+            node.id = node_id;
+
+            uint64_t seq_size_in;
+            in.read((char*) &seq_size_in, sizeof(seq_size_in) / sizeof(char));
+            node.seq_length = endianness<uint64_t>::from_big_endian(seq_size_in);
+            node.seq_offset = sequences.size();
+            sequences.resize(node.seq_offset + node.seq_length);
+            in.read(&sequences[node.seq_offset], node.seq_length);
+
+            for (slice_t* edge_slice : {&node.left_edges, &node.right_edges}) {
+                uint64_t num_edges_in;
+                in.read((char*) &num_edges_in, sizeof(num_edges_in) / sizeof(char));
+                edge_slice->size = endianness<uint64_t>::from_big_endian(num_edges_in);
+                edge_slice->capacity = edge_slice->size;
+                edge_slice->offset = edges.size();
+                for (size_t j = 0; j < edge_slice->size; j++) {
+                    int64_t next_in;
+                    in.read((char*) &next_in, sizeof(next_in) / sizeof(char));
+                    edges.push_back(as_handle(endianness<int64_t>::from_big_endian(next_in)));
+                }
+            }
+        }
+        num_nodes = records.size();
+
+        // index the records, about half full
+        size_t num_slots = 16;
+        while (num_nodes > num_slots * MAX_LOAD_FACTOR / 2) {
+            num_slots *= 2;
+        }
+        rehash(num_slots);
+
+        uint64_t num_paths_in;
+        in.read((char*) &num_paths_in, sizeof(num_paths_in) / sizeof(char));
+        uint64_t num_paths = endianness<uint64_t>::from_big_endian(num_paths_in);
+
+        paths.reserve(num_paths);
+        path_id.reserve(num_paths);
+        for (size_t i = 0; i < num_paths; i++) {
+            path_t path;
+            path.deserialize(in);
+            path_id[path.name] = path.path_id;
+            paths[path.path_id] = move(path);
+        }
+
+        // we need to rebuild the occurrences of node mapping, which is not
+        // part of the serialized format
+        for (pair<const int64_t, path_t>& path_record : paths) {
+            path_t& path = path_record.second;
+            bool first_iter = true;
+            for (path_mapping_t* mapping = path.head;
+                 mapping != nullptr && (first_iter || mapping != path.head); // for circular paths
+                 mapping = mapping->next) {
+
+                add_occurrence(mapping);
+                first_iter = false;
+            }
+        }
+    }
+
+    uint32_t FlatHashGraph::get_magic_number() const {
+        return 3281736194ul;
+    }
+
+    MemoryBreakdown FlatHashGraph::memory_breakdown() const {
+
+        MemoryBreakdown nodes("graph");
+        nodes.add("node records", records.capacity() * sizeof(node_t));
+        nodes.add("node table", slots.capacity() * sizeof(slot_t));
+        nodes.add("sequences", sequences.capacity());
+        nodes.add("edges", edges.capacity() * sizeof(handle_t));
+        nodes.add("occurrences", occurrences.capacity() * sizeof(path_mapping_t*));
+
+        size_t step_capacity = 0, path_name_mem = 0;
+        for (const auto& path_record : paths) {
+            step_capacity += path_record.second.arena.capacity();
+            path_name_mem += path_record.second.name.capacity();
+        }
+
+        MemoryBreakdown path_breakdown("paths");
+        path_breakdown.add("path records", paths.size() * sizeof(typename decltype(paths)::value_type));
+        path_breakdown.add("names", path_name_mem);
+        path_breakdown.add("steps", step_capacity * sizeof(path_mapping_t));
+        path_breakdown.add("hash table overhead", sizeof(paths) + (paths.bucket_count() - paths.size())
+                           * sizeof(typename decltype(paths)::value_type));
+
+        size_t path_id_name_mem = 0;
+        for (const auto& path_id_record : path_id) {
+            path_id_name_mem += path_id_record.first.capacity();
+        }
+        MemoryBreakdown path_id_breakdown("path_id");
+        path_id_breakdown.add("entries", path_id.size() * sizeof(typename decltype(path_id)::value_type));
+        path_id_breakdown.add("names", path_id_name_mem);
+        path_id_breakdown.add("hash table overhead", sizeof(path_id) + (path_id.bucket_count() - path_id.size())
+                              * sizeof(typename decltype(path_id)::value_type));
+
+        MemoryBreakdown breakdown("FlatHashGraph");
+        breakdown.add("min/max_id", sizeof(min_id) + sizeof(max_id));
+        breakdown.add(nodes);
+        breakdown.add(path_breakdown);
+        breakdown.add(path_id_breakdown);
+        breakdown.add("next_path_id", sizeof(next_path_id));
+        return breakdown;
+    }
+
+    handle_t FlatHashGraph::set_id(const handle_t& handle, nid_t new_id) {
+        return handlegraph::number_bool_packing::pack(new_id, handlegraph::number_bool_packing::unpack_bit(handle));
+    }
+}
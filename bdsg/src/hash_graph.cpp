@@ -3,6 +3,7 @@
 //
 
 #include "bdsg/hash_graph.hpp"
+#include "bdsg/packed_graph.hpp"
 
 #include <handlegraph/util.hpp>
 #include <unordered_set>
@@ -18,6 +19,50 @@ namespace bdsg {
     HashGraph::~HashGraph() {
         
     }
+    
+    HashGraph HashGraph::from(const PackedGraph& other) {
+        HashGraph converted;
+        converted.assign_graph(other);
+        return converted;
+    }
+    
+    HashGraph HashGraph::from(const MappedPackedGraph& other) {
+        HashGraph converted;
+        converted.assign_graph(other);
+        return converted;
+    }
+    
+    template<typename Graph>
+    void HashGraph::assign_graph(const Graph& other) {
+        clear();
+        
+        // we know how many nodes there are, so we never need to rehash
+        graph.reserve(other.get_node_count());
+        other.for_each_handle_fast([&](const handle_t& handle) {
+            nid_t id = other.get_id(handle);
+            node_t& node = graph[id];
+            node.sequence = other.get_sequence(handle);
+            // our edge lists are in the same form as the lists of what is
+            // reached going right from each strand
+            other.follow_edges_fast(handle, false, [&](const handle_t& next) {
+                node.right_edges.push_back(get_handle(other.get_id(next), other.get_is_reverse(next)));
+            });
+            other.follow_edges_fast(other.flip(handle), false, [&](const handle_t& next) {
+                node.left_edges.push_back(get_handle(other.get_id(next), other.get_is_reverse(next)));
+            });
+            max_id = max(max_id, id);
+            min_id = min(min_id, id);
+        });
+        
+        // copy all the paths, including haplotypes
+        other.for_each_path_matching(nullptr, nullptr, nullptr, [&](const path_handle_t& other_path) {
+            path_handle_t path = create_path_handle(other.get_path_name(other_path), other.get_is_circular(other_path));
+            other.for_each_step_in_path(other_path, [&](const step_handle_t& step) {
+                handle_t handle = other.get_handle_of_step(step);
+                append_step(path, get_handle(other.get_id(handle), other.get_is_reverse(handle)));
+            });
+        });
+    }
 
     HashGraph::HashGraph(const HashGraph& other) {
         *this = other;
@@ -29,6 +74,7 @@ namespace bdsg {
 
     HashGraph& HashGraph::operator=(const HashGraph& other) {
         
+        set_concurrent_mutation(other.get_concurrent_mutation());
         max_id = other.max_id;
         min_id = other.min_id;
         path_id = other.path_id;
@@ -67,6 +113,7 @@ namespace bdsg {
         path_id = move(other.path_id);
         paths = move(other.paths);
         next_path_id = other.next_path_id;
+        mutation_locks = move(other.mutation_locks);
         return *this;
     }
     
@@ -75,11 +122,64 @@ namespace bdsg {
     }
     
     
+    void HashGraph::set_concurrent_mutation(bool concurrent) {
+        if (concurrent && !mutation_locks) {
+            mutation_locks.reset(new MutationLocks());
+        }
+        else if (!concurrent) {
+            mutation_locks.reset();
+        }
+    }
+    
+    bool HashGraph::get_concurrent_mutation() const {
+        return mutation_locks.get() != nullptr;
+    }
+    
+    HashGraph::HeldLocks HashGraph::lock_nodes(const nid_t& id1, const nid_t& id2) {
+        HeldLocks held;
+        if (mutation_locks) {
+            held.node_table = std::shared_lock<std::shared_timed_mutex>(mutation_locks->node_table);
+            // always take the lower stripe first, so that two edits can't wait on each other
+            size_t stripe1 = size_t(id1) % NUM_LOCK_STRIPES;
+            size_t stripe2 = size_t(id2) % NUM_LOCK_STRIPES;
+            held.first_node = std::unique_lock<std::mutex>(mutation_locks->node_stripes[min(stripe1, stripe2)]);
+            if (stripe1 != stripe2) {
+                held.second_node = std::unique_lock<std::mutex>(mutation_locks->node_stripes[max(stripe1, stripe2)]);
+            }
+        }
+        return held;
+    }
+    
+    HashGraph::HeldLocks HashGraph::lock_step(const path_handle_t& path, const nid_t& id) {
+        HeldLocks held;
+        if (mutation_locks) {
+            // paths are always locked before nodes
+            held.node_table = std::shared_lock<std::shared_timed_mutex>(mutation_locks->node_table);
+            held.path_table = std::shared_lock<std::shared_timed_mutex>(mutation_locks->path_table);
+            held.path = std::unique_lock<std::mutex>(mutation_locks->path_stripes[size_t(as_integer(path)) % NUM_LOCK_STRIPES]);
+            held.first_node = std::unique_lock<std::mutex>(mutation_locks->node_stripes[size_t(id) % NUM_LOCK_STRIPES]);
+        }
+        return held;
+    }
+    
     handle_t HashGraph::create_handle(const string& sequence) {
-        return create_handle(sequence, max_id + 1);
+        if (mutation_locks) {
+            // the next ID has to be chosen under the lock too
+            std::lock_guard<std::shared_timed_mutex> table_lock(mutation_locks->node_table);
+            return insert_node(sequence, max_id + 1);
+        }
+        return insert_node(sequence, max_id + 1);
     }
     
     handle_t HashGraph::create_handle(const string& sequence, const nid_t& id) {
+        if (mutation_locks) {
+            std::lock_guard<std::shared_timed_mutex> table_lock(mutation_locks->node_table);
+            return insert_node(sequence, id);
+        }
+        return insert_node(sequence, id);
+    }
+    
+    handle_t HashGraph::insert_node(const string& sequence, const nid_t& id) {
        
         // TODO: We can't actually ban empty nodes yet. vg::algorithms::extract_extending_graph needs them.
         // Maybe define a tag interface for graphs that can have them?
@@ -90,6 +190,8 @@ namespace bdsg {
     }
     
     void HashGraph::create_edge(const handle_t& left, const handle_t& right) {
+        
+        HeldLocks held = lock_nodes(get_id(left), get_id(right));
        
         // look for the edge
         bool add_edge = follow_edges(left, false, [&](const handle_t& next) {
@@ -149,17 +251,16 @@ namespace bdsg {
                                       : graph.at(get_id(handle)).sequence;
     }
     
+    void HashGraph::get_sequence_into(const handle_t& handle, string& buffer) const {
+        buffer = graph.at(get_id(handle)).sequence;
+        if (get_is_reverse(handle)) {
+            reverse_complement_in_place(buffer);
+        }
+    }
+    
     bool HashGraph::follow_edges_impl(const handle_t& handle, bool go_left,
                                       const std::function<bool(const handle_t&)>& iteratee) const {
-        
-        auto& edge_list = get_is_reverse(handle) != go_left ? graph.at(get_id(handle)).left_edges
-                                                            : graph.at(get_id(handle)).right_edges;
-        
-        bool keep_going = true;
-        for (auto it = edge_list.begin(); it != edge_list.end() && keep_going; it++) {
-            keep_going = iteratee(go_left ? flip(*it) : *it);
-        }
-        return keep_going;
+        return follow_edges_fast(handle, go_left, iteratee);
     }
     
     size_t HashGraph::get_node_count(void) const {
@@ -213,9 +314,7 @@ namespace bdsg {
             
         }
         else {
-            for (auto it = graph.begin(); it != graph.end() && keep_going; it++) {
-                keep_going = iteratee(get_handle(it->first));
-            }
+            keep_going = for_each_handle_fast(iteratee);
         }
         
         return keep_going;
@@ -522,6 +621,33 @@ namespace bdsg {
         return true;
     }
     
+    bool HashGraph::for_each_path_handle(const std::function<bool(const path_handle_t&)>& iteratee,
+                                         bool parallel) const {
+        if (!parallel) {
+            return for_each_path_handle_impl(iteratee);
+        }
+        vector<pair<size_t, path_handle_t>> weighted_paths;
+        weighted_paths.reserve(paths.size());
+        for (auto it = paths.begin(); it != paths.end(); it++) {
+            weighted_paths.emplace_back(it->second.count, as_path_handle(it->first));
+        }
+        return parallel_for_each_weighted(weighted_paths, PARALLEL_ITERATION_CHUNK_SIZE, iteratee);
+    }
+    
+    bool HashGraph::for_each_step_in_path(const path_handle_t& path_handle,
+                                          const std::function<bool(const step_handle_t&)>& iteratee,
+                                          bool parallel) const {
+        if (!parallel) {
+            return PathHandleGraph::for_each_step_in_path(path_handle, iteratee);
+        }
+        return paths.at(as_integer(path_handle)).for_each_step_parallel([&](const path_mapping_t* mapping) {
+            step_handle_t step;
+            as_integers(step)[0] = as_integer(path_handle);
+            as_integers(step)[1] = intptr_t(mapping);
+            return iteratee(step);
+        }, PARALLEL_ITERATION_CHUNK_SIZE);
+    }
+    
     handle_t HashGraph::get_handle_of_step(const step_handle_t& step_handle) const {
         return ((path_mapping_t*) intptr_t(as_integers(step_handle)[1]))->handle;
     }
@@ -581,16 +707,7 @@ namespace bdsg {
     
     bool HashGraph::for_each_step_on_handle_impl(const handle_t& handle,
                                                  const function<bool(const step_handle_t&)>& iteratee) const {
-        for (path_mapping_t* mapping : graph.at(get_id(handle)).occurrences) {
-            step_handle_t step;
-            as_integers(step)[0] = mapping->path_id;
-            as_integers(step)[1] = intptr_t(mapping);
-            
-            if (!iteratee(step)) {
-                return false;
-            }
-        }
-        return true;
+        return for_each_step_on_handle_fast(handle, iteratee);
     }
     
     void HashGraph::destroy_path(const path_handle_t& path) {
@@ -614,6 +731,10 @@ namespace bdsg {
     }
     
     path_handle_t HashGraph::create_path_handle(const string& name, bool is_circular) {
+        std::unique_lock<std::shared_timed_mutex> table_lock;
+        if (mutation_locks) {
+            table_lock = std::unique_lock<std::shared_timed_mutex>(mutation_locks->path_table);
+        }
         path_id[name] = next_path_id;
         paths[next_path_id] = path_t(name, next_path_id, is_circular);
         next_path_id++;
@@ -622,6 +743,7 @@ namespace bdsg {
     
     step_handle_t HashGraph::append_step(const path_handle_t& path, const handle_t& to_append) {
         
+        HeldLocks held = lock_step(path, get_id(to_append));
         path_t& path_list = paths[as_integer(path)];
         path_mapping_t* mapping = path_list.push_back(to_append);
         graph[get_id(to_append)].occurrences.push_back(mapping);
@@ -634,6 +756,7 @@ namespace bdsg {
     
     step_handle_t HashGraph::prepend_step(const path_handle_t& path, const handle_t& to_prepend) {
         
+        HeldLocks held = lock_step(path, get_id(to_prepend));
         path_t& path_list = paths[as_integer(path)];
         path_mapping_t* mapping = path_list.push_front(to_prepend);
         graph[get_id(to_prepend)].occurrences.push_back(mapping);
@@ -725,7 +848,7 @@ namespace bdsg {
     
     void HashGraph::reassign_node_ids(const std::function<nid_t(const nid_t&)>& get_new_id) {
         // We're going to have to move all the nodes to this new map.
-        hash_map<nid_t, node_t> new_graph;
+        decltype(graph) new_graph;
         
         nid_t new_max_id = 0;
         nid_t new_min_id = std::numeric_limits<nid_t>::max();
@@ -782,258 +905,6 @@ namespace bdsg {
         min_id = new_min_id;
     }
     
-    HashGraph::path_t::path_t() {
-        
-    }
-    
-    HashGraph::path_t::path_t(const string& name, const int64_t& path_id, bool is_circular) : name(name), path_id(path_id), is_circular(is_circular) {
-        
-    }
-    
-    HashGraph::path_t::path_t(path_t&& other) : head(other.head), tail(other.tail), path_id(other.path_id), count(other.count), name(move(other.name)), is_circular(other.is_circular) {
-        // we grabbed the data in the initializer, now make sure the other one is in a valid state
-        other.head = nullptr;
-        other.tail = nullptr;
-        other.path_id = 0;
-        other.count = 0;
-    }
-    
-    HashGraph::path_t& HashGraph::path_t::operator=(path_t&& other) {
-        if (this != &other) {
-            // free existing list
-            this->~path_t();
-            
-            // steal other list
-            head = other.head;
-            tail = other.tail;
-            other.head = nullptr;
-            other.tail = nullptr;
-            
-            name = move(other.name);
-            
-            is_circular = other.is_circular;
-            
-            path_id = other.path_id;
-            other.path_id = 0;
-            
-            count = other.count;
-            other.count = 0;
-        }
-        return *this;
-    }
-    
-    HashGraph::path_t::path_t(const path_t& other) : path_id(other.path_id), count(other.count), name(other.name), is_circular(other.is_circular) {
-        
-        path_mapping_t* prev = nullptr;
-        bool first_iter = true;
-        for (path_mapping_t* mapping = other.head;
-             mapping != nullptr && (first_iter || mapping != other.head); // in case we loop around a circular path
-             mapping = mapping->next) {
-            
-            path_mapping_t* copied = new path_mapping_t(mapping->handle, mapping->path_id);
-            
-            if (!head) {
-                head = copied;
-            }
-            if (prev) {
-                prev->next = copied;
-                copied->prev = prev;
-            }
-            prev = copied;
-            first_iter = false;
-        }
-        tail = prev;
-        
-        // we only loop over each mapping one time, so we may need to add in the last connection
-        // in a circular path
-        if (is_circular) {
-            tail->next = head;
-            head->prev = tail;
-        }
-    }
-    
-    HashGraph::path_t& HashGraph::path_t::operator=(const path_t& other) {
-        if (this != &other) {
-            // free existing list
-            this->~path_t();
-            
-            // copy the other list
-            path_mapping_t* prev = nullptr;
-            bool first_iter = true;
-            for (path_mapping_t* mapping = other.head;
-                 mapping != nullptr && (first_iter || mapping != other.head); // in case we loop around a circular path
-                 mapping = mapping->next) {
-                
-                path_mapping_t* copied = new path_mapping_t(mapping->handle, mapping->path_id);
-                
-                if (!head) {
-                    head = copied;
-                }
-                if (prev) {
-                    prev->next = copied;
-                    copied->prev = prev;
-                }
-                prev = copied;
-                first_iter = false;
-            }
-            tail = prev;
-            
-            // copy the rest of the info
-            path_id = other.path_id;
-            name = other.name;
-            count = other.count;
-            is_circular = other.is_circular;
-            
-            // we only loop over each mapping one time, so we may need to add in the last connection
-            // in a circular path
-            if (is_circular) {
-                tail->next = head;
-                head->prev = tail;
-            }
-        }
-        return *this;
-    }
-    
-    HashGraph::path_t::~path_t() {
-        bool first_iter = true;
-        for (path_mapping_t* mapping = head;
-             mapping != nullptr && (first_iter || mapping != head);) { // for circular paths
-            
-            path_mapping_t* next = mapping->next;
-            delete mapping;
-            mapping = next;
-            
-            first_iter = false;
-        }
-    }
-    
-    HashGraph::path_mapping_t* HashGraph::path_t::push_back(const handle_t& handle) {
-        return insert_before(handle, nullptr);
-    }
-    
-    HashGraph::path_mapping_t* HashGraph::path_t::push_front(const handle_t& handle) {
-        return insert_before(handle, head);
-    }
-    
-    void HashGraph::path_t::remove(path_mapping_t* mapping) {
-        if (mapping == head) {
-            head = mapping->next != mapping ? mapping->next : nullptr;
-        }
-        if (mapping == tail) {
-            tail = mapping->prev != mapping ? mapping->prev : nullptr;
-        }
-        if (mapping->next) {
-            mapping->next->prev = mapping->prev;
-        }
-        if (mapping->prev) {
-            mapping->prev->next = mapping->next;
-        }
-        count--;
-        delete mapping;
-    }
-    
-    HashGraph::path_mapping_t* HashGraph::path_t::insert_before(const handle_t& handle, path_mapping_t* mapping) {
-        
-        path_mapping_t* inserting = new path_mapping_t(handle, path_id);
-        
-        if (mapping) {
-            inserting->prev = mapping->prev;
-            if (mapping->prev) {
-                mapping->prev->next = inserting;
-            }
-            mapping->prev = inserting;
-            inserting->next = mapping;
-            
-            if (mapping == head) {
-                head = inserting;
-            }
-        }
-        else if (tail) {
-            
-            // handle the potential circular connection
-            inserting->next = tail->next;
-            if (inserting->next) {
-                inserting->next->prev = inserting;
-            }
-            
-            inserting->prev = tail;
-            tail->next = inserting;
-            
-            tail = inserting;
-        }
-        else {
-            // the list is empty so far, so initialize it
-            head = tail = inserting;
-            
-            // make an initial circular connection
-            if (is_circular) {
-                inserting->next = inserting->prev = inserting;
-            }
-        }
-        
-        count++;
-        return inserting;
-    }
-    
-    void HashGraph::path_t::serialize(ostream& out) const {
-        
-        out.write((const char*) &is_circular, sizeof(is_circular) / sizeof(char));
-        
-        int64_t path_id_out = endianness<int64_t>::to_big_endian(path_id);
-        out.write((const char*) &path_id_out, sizeof(path_id_out) / sizeof(char));
-        
-        uint64_t name_size_out = endianness<uint64_t>::to_big_endian(name.size());
-        out.write((const char*) &name_size_out, sizeof(name_size_out) / sizeof(char));
-
-        out.write(name.c_str(), name.size());
-        
-        uint64_t count_out = endianness<uint64_t>::to_big_endian(count);
-        out.write((const char*) &count_out, sizeof(count_out) / sizeof(char));
-        
-        path_mapping_t* mapping = head;
-        bool first_iter = true;
-        while (mapping && (first_iter || mapping != head)) { // extra condition for circular paths
-            int64_t step = endianness<int64_t>::to_big_endian(as_integer(mapping->handle));
-
-            out.write((const char*) &step, sizeof(step) / sizeof(char));
-            mapping = mapping->next;
-            
-            first_iter = false;
-        }
-    }
-    
-    void HashGraph::path_t::deserialize(istream& in) {
-        // free the current path if it exists
-        this->~path_t();
-        in.read((char*) &is_circular, sizeof(is_circular) / sizeof(char));
-        
-        int64_t path_id_in;
-        in.read((char*) &path_id_in, sizeof(path_id_in) / sizeof(char));
-        path_id = endianness<int64_t>::from_big_endian(path_id_in);
-        
-        uint64_t name_size_in;
-        in.read((char*) &name_size_in, sizeof(name_size_in) / sizeof(char));
-        uint64_t name_size = endianness<uint64_t>::from_big_endian(name_size_in);
-        
-        name.resize(name_size);
-        for (size_t i = 0; i < name.size(); i++) {
-            in.read((char*) &name[i], sizeof(char));
-        }
-        
-        uint64_t num_mappings_in;
-        in.read((char*) &num_mappings_in, sizeof(num_mappings_in) / sizeof(char));
-        uint64_t num_mappings = endianness<uint64_t>::from_big_endian(num_mappings_in);
-        
-        // note: count will be incremented in the push_back method
-        count = 0;
-        for (size_t i = 0; i < num_mappings; i++) {
-            int64_t step_in;
-            in.read((char*) &step_in, sizeof(step_in) / sizeof(char));
-            int64_t step = endianness<int64_t>::from_big_endian(step_in);
-            push_back(as_handle(step));
-        }
-    }
-    
     void HashGraph::node_t::serialize(ostream& out) const {
         
         uint64_t seq_size_out = endianness<uint64_t>::to_big_endian( sequence.size());
@@ -1176,6 +1047,57 @@ namespace bdsg {
         return 676155192ul;
     }
     
+    MemoryBreakdown HashGraph::memory_breakdown() const {
+        
+        size_t sequence_mem = 0, edge_mem = 0, occurrence_mem = 0;
+        for (const auto& node_record : graph) {
+            const node_t& node = node_record.second;
+            sequence_mem += node.sequence.capacity();
+            edge_mem += (node.left_edges.capacity() + node.right_edges.capacity()) * sizeof(handle_t);
+            occurrence_mem += node.occurrences.capacity() * sizeof(path_mapping_t*);
+        }
+        
+        MemoryBreakdown nodes("graph");
+        nodes.add("node records", graph.size() * sizeof(typename decltype(graph)::value_type));
+        nodes.add("sequences", sequence_mem);
+        nodes.add("edges", edge_mem);
+        nodes.add("occurrences", occurrence_mem);
+        nodes.add("hash table overhead", sizeof(graph) + (graph.bucket_count() - graph.size())
+                  * sizeof(typename decltype(graph)::value_type));
+        
+        size_t step_capacity = 0, path_name_mem = 0;
+        for (const auto& path_record : paths) {
+            step_capacity += path_record.second.arena.capacity();
+            path_name_mem += path_record.second.name.capacity();
+        }
+        
+        MemoryBreakdown path_breakdown("paths");
+        path_breakdown.add("path records", paths.size() * sizeof(typename decltype(paths)::value_type));
+        path_breakdown.add("names", path_name_mem);
+        path_breakdown.add("steps", step_capacity * sizeof(path_mapping_t));
+        path_breakdown.add("hash table overhead", sizeof(paths) + (paths.bucket_count() - paths.size())
+                           * sizeof(typename decltype(paths)::value_type));
+        
+        size_t path_id_name_mem = 0;
+        for (const auto& path_id_record : path_id) {
+            path_id_name_mem += path_id_record.first.capacity();
+        }
+        
+        MemoryBreakdown path_id_breakdown("path_id");
+        path_id_breakdown.add("entries", path_id.size() * sizeof(typename decltype(path_id)::value_type));
+        path_id_breakdown.add("names", path_id_name_mem);
+        path_id_breakdown.add("hash table overhead", sizeof(path_id) + (path_id.bucket_count() - path_id.size())
+                              * sizeof(typename decltype(path_id)::value_type));
+        
+        MemoryBreakdown breakdown("HashGraph");
+        breakdown.add("min/max_id", sizeof(min_id) + sizeof(max_id));
+        breakdown.add(nodes);
+        breakdown.add(path_breakdown);
+        breakdown.add(path_id_breakdown);
+        breakdown.add("next_path_id", sizeof(next_path_id));
+        return breakdown;
+    }
+    
     handle_t HashGraph::set_id(const handle_t& handle, nid_t new_id) {
         bool is_reverse = handlegraph::number_bool_packing::unpack_bit(handle);
         return handlegraph::number_bool_packing::pack(new_id, is_reverse);
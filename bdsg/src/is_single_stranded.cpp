@@ -1,5 +1,8 @@
 #include "bdsg/internal/is_single_stranded.hpp"
 
+#include <atomic>
+#include <omp.h> // BINDER_IGNORE because Binder can't find this
+
 namespace bdsg {
 namespace algorithms {
 
@@ -94,5 +97,150 @@ using namespace handlegraph;
         
         return orientation;
     }
+    
+    bool parallel_is_single_stranded(const HandleGraph* graph) {
+        
+        std::atomic<bool> single_stranded(true);
+        
+        graph->for_each_handle([&](const handle_t& handle) {
+            for (bool go_left : {false, true}) {
+                graph->follow_edges(handle, go_left, [&](const handle_t& next) {
+                    if (graph->get_is_reverse(handle) != graph->get_is_reverse(next)) {
+                        single_stranded.store(false);
+                    }
+                    return single_stranded.load();
+                });
+            }
+            // stop if any thread has found a reversing edge
+            return single_stranded.load();
+        }, true);
+        
+        return single_stranded.load();
+    }
+    
+    vector<handle_t> parallel_single_stranded_orientation(const HandleGraph* graph) {
+        
+        DenseNodeRanks ranks(graph);
+        
+        // union-find links, each holding the parent's rank and, in the low bit,
+        // whether the node is flipped relative to its parent. Roots point to
+        // themselves and are never flipped.
+        vector<std::atomic<uint64_t>> links(ranks.size());
+#pragma omp parallel for
+        for (size_t i = 0; i < links.size(); ++i) {
+            links[i].store(uint64_t(i) << 1);
+        }
+        
+        // find the root of a node's set, and whether the node is flipped
+        // relative to it
+        auto find = [&](size_t node, bool& flipped) {
+            flipped = false;
+            while (true) {
+                uint64_t link = links[node].load();
+                size_t parent = link >> 1;
+                if (parent == node) {
+                    return node;
+                }
+                uint64_t parent_link = links[parent].load();
+                size_t grandparent = parent_link >> 1;
+                // how a node is flipped relative to any ancestor never changes, so
+                // skipping over the parent is safe even if it has moved on since
+                bool flipped_from_grandparent = (link ^ parent_link) & 1;
+                if (grandparent != parent) {
+                    links[node].compare_exchange_weak(link, (uint64_t(grandparent) << 1) | flipped_from_grandparent);
+                }
+                flipped ^= flipped_from_grandparent;
+                node = grandparent;
+            }
+        };
+        
+        // record that two nodes must be flipped the same amount, or differently
+        // if flip is set, and return false if that contradicts what is known
+        auto unite = [&](size_t a, size_t b, bool flip) {
+            while (true) {
+                bool a_flipped, b_flipped;
+                size_t a_root = find(a, a_flipped);
+                size_t b_root = find(b, b_flipped);
+                if (a_root == b_root) {
+                    return (a_flipped != b_flipped) == flip;
+                }
+                // hang the higher root under the lower one
+                if (a_root < b_root) {
+                    std::swap(a_root, b_root);
+                    std::swap(a_flipped, b_flipped);
+                }
+                uint64_t expected = uint64_t(a_root) << 1;
+                uint64_t linked = (uint64_t(b_root) << 1) | ((a_flipped != b_flipped) != flip);
+                if (links[a_root].compare_exchange_strong(expected, linked)) {
+                    return true;
+                }
+                // another thread moved the root, so try again
+            }
+        };
+        
+        std::atomic<bool> failed(false);
+        graph->for_each_handle([&](const handle_t& handle) {
+            size_t rank = ranks.rank(handle);
+            for (bool go_left : {false, true}) {
+                graph->follow_edges(handle, go_left, [&](const handle_t& next) {
+                    if (!unite(rank, ranks.rank(next), graph->get_is_reverse(handle) != graph->get_is_reverse(next))) {
+                        failed.store(true);
+                    }
+                    return !failed.load();
+                });
+            }
+            return !failed.load();
+        }, true);
+        
+        vector<handle_t> orientation;
+        if (failed.load()) {
+            // return an empty vector as a sentinel
+            return orientation;
+        }
+        
+        // orient each node to match its set's representative
+        vector<handle_t> by_rank(ranks.size());
+        vector<uint8_t> present(ranks.size(), 0);
+        graph->for_each_handle([&](const handle_t& handle) {
+            size_t rank = ranks.rank(handle);
+            bool flipped;
+            find(rank, flipped);
+            by_rank[rank] = flipped ? graph->flip(handle) : handle;
+            present[rank] = 1;
+        }, true);
+        
+        orientation.reserve(graph->get_node_count());
+        for (size_t i = 0; i < by_rank.size(); ++i) {
+            if (present[i]) {
+                orientation.push_back(by_rank[i]);
+            }
+        }
+        return orientation;
+    }
+    
+    DenseNodeRanks::DenseNodeRanks(const HandleGraph* graph) : graph(graph),
+        ranked(dynamic_cast<const RankedHandleGraph*>(graph)) {
+        
+        size_t node_count = graph->get_node_count();
+        if (ranked || node_count == 0) {
+            rank_space = node_count;
+            return;
+        }
+        
+        min_id = graph->min_node_id();
+        if (graph->max_node_id() - min_id < 2 * nid_t(node_count)) {
+            // the IDs are dense enough to use as ranks directly
+            rank_space = graph->max_node_id() - min_id + 1;
+        }
+        else {
+            // rank the IDs by searching a sorted list of them
+            sorted_ids.reserve(node_count);
+            graph->for_each_handle([&](const handle_t& handle) {
+                sorted_ids.push_back(graph->get_id(handle));
+            });
+            std::sort(sorted_ids.begin(), sorted_ids.end());
+            rank_space = node_count;
+        }
+    }
 }
 }
@@ -0,0 +1,190 @@
+#include "bdsg/overlays/lazy_path_position_overlay.hpp"
+
+#include "bdsg/internal/utility.hpp"
+
+namespace bdsg {
+
+LazyPositionOverlay::LazyPositionOverlay(const PathHandleGraph* graph, size_t memory_budget) : PackedPositionOverlay() {
+    // Nothing is indexed until it is asked for
+    this->graph = graph;
+    this->steps_per_index = 0;
+    this->memory_budget = memory_budget;
+}
+
+size_t LazyPositionOverlay::get_path_length(const path_handle_t& path_handle) const {
+    auto index = get_index(path_handle);
+    return path_length_in(*index, whole_range(*index));
+}
+
+size_t LazyPositionOverlay::get_position_of_step(const step_handle_t& step) const {
+    auto path = get_path_handle_of_step(step);
+    auto index = get_index(path);
+    if (step == path_end(path)) {
+        return path_length_in(*index, whole_range(*index));
+    }
+    else {
+        return position_in(*index, step);
+    }
+}
+
+step_handle_t LazyPositionOverlay::get_step_at_position(const path_handle_t& path,
+                                                        const size_t& position) const {
+    auto index = get_index(path);
+    PathRange range = whole_range(*index);
+
+    // check if position it outside the range (handles edge case of an empty path too)
+    if (position >= path_length_in(*index, range)) {
+        return path_end(path);
+    }
+
+    return step_at_position_in(*index, range, position);
+}
+
+void LazyPositionOverlay::get_steps_at_positions(const path_handle_t& path,
+                                                 const vector<size_t>& sorted_positions,
+                                                 vector<step_handle_t>& out) const {
+    auto index = get_index(path);
+    steps_at_positions_in(*index, whole_range(*index), path_end(path), sorted_positions, out);
+}
+
+void LazyPositionOverlay::get_positions_of_steps(const path_handle_t& path,
+                                                 const vector<step_handle_t>& steps,
+                                                 vector<size_t>& out) const {
+
+    out.resize(steps.size());
+
+    auto index = get_index(path);
+    step_handle_t end = path_end(path);
+    for (size_t i = 0; i < steps.size(); i++) {
+        if (steps[i] == end) {
+            out[i] = path_length_in(*index, whole_range(*index));
+        }
+        else {
+            out[i] = position_in(*index, steps[i]);
+        }
+    }
+}
+
+size_t LazyPositionOverlay::get_indexed_path_count() const {
+    lock_guard<mutex> lock(cache_mutex);
+    return cache.size();
+}
+
+MemoryBreakdown LazyPositionOverlay::memory_breakdown() const {
+    lock_guard<mutex> lock(cache_mutex);
+
+    MemoryBreakdown breakdown("LazyPositionOverlay");
+    breakdown.add("indexes", cached_bytes);
+    breakdown.add("cache", sizeof(cache) + cache.bucket_count() * sizeof(typename decltype(cache)::value_type)
+                  + sizeof(lru) + lru.size() * (sizeof(int64_t) + 2 * sizeof(void*)));
+    return breakdown;
+}
+
+void LazyPositionOverlay::serialize_members(ostream& out) const {
+    throw std::runtime_error("error:[LazyPositionOverlay] lazily built indexes cannot be serialized");
+}
+
+void LazyPositionOverlay::deserialize_members(istream& in) {
+    throw std::runtime_error("error:[LazyPositionOverlay] lazily built indexes cannot be serialized");
+}
+
+shared_ptr<const PackedPositionOverlay::PathIndex> LazyPositionOverlay::get_index(const path_handle_t& path) const {
+    int64_t key = as_integer(path);
+    {
+        lock_guard<mutex> lock(cache_mutex);
+        auto found = cache.find(key);
+        if (found != cache.end()) {
+            // mark it as the most recently used
+            lru.splice(lru.begin(), lru, found->second.lru_position);
+            return found->second.index;
+        }
+    }
+
+    // Build the index without holding the lock, so other paths can be queried
+    // and indexed meanwhile. Two threads might both build the same path, in
+    // which case the first one to finish wins.
+    auto built = make_shared<PathIndex>();
+    build_index(path, *built);
+    size_t bytes = index_memory_usage(*built);
+
+    lock_guard<mutex> lock(cache_mutex);
+    auto found = cache.find(key);
+    if (found != cache.end()) {
+        lru.splice(lru.begin(), lru, found->second.lru_position);
+        return found->second.index;
+    }
+    lru.push_front(key);
+    CachedIndex& entry = cache[key];
+    entry.index = built;
+    entry.bytes = bytes;
+    entry.lru_position = lru.begin();
+    cached_bytes += bytes;
+
+    if (memory_budget != 0) {
+        // evict the coldest indexes until we fit, but never the new one
+        while (cached_bytes > memory_budget && lru.size() > 1) {
+            auto evicted = cache.find(lru.back());
+            cached_bytes -= evicted->second.bytes;
+            cache.erase(evicted);
+            lru.pop_back();
+        }
+    }
+
+    return built;
+}
+
+void LazyPositionOverlay::build_index(const path_handle_t& path, PathIndex& index) const {
+    size_t step_count = get_step_count(path);
+
+    // resize the vectors to the number of step handles
+    index.steps_0.resize(step_count);
+    index.steps_1.resize(step_count);
+    index.positions.resize(step_count);
+    index.step_positions.resize(step_count);
+
+    if (step_count == 0) {
+        // nothing to hash
+        return;
+    }
+
+    // Make a perfect minimal hash over the step handles on the path
+    index.step_hash.emplace_back(step_count, BBHashHelper(graph, &path, &path + 1), 1, 2.0, false, false, hash_keys_cached());
+
+    // Walk a cursor through the steps, and a base position cursor along
+    // the path
+    size_t rank = 0;
+    size_t position = 0;
+    for_each_step_in_path(path, [&](const step_handle_t& step) {
+
+        // fill in the position to step index
+        index.steps_0.set(rank, as_integers(step)[0]);
+        index.steps_1.set(rank, as_integers(step)[1]);
+        index.positions.set(rank, position);
+
+        // fill in the step to position index
+        index.step_positions.set(index.step_hash.back().lookup(step), position);
+
+        position += get_length(get_handle_of_step(step));
+        ++rank;
+    });
+}
+
+PackedPositionOverlay::PathRange LazyPositionOverlay::whole_range(const PathIndex& index) {
+    PathRange range;
+    range.index_number = 0;
+    range.start = 0;
+    range.end = index.steps_0.size();
+    return range;
+}
+
+size_t LazyPositionOverlay::index_memory_usage(const PathIndex& index) {
+    size_t total = sizeof(PathIndex) + index.steps_0.memory_usage() + index.steps_1.memory_usage()
+        + index.positions.memory_usage() + index.step_positions.memory_usage();
+    for (const auto& step_hash : index.step_hash) {
+        // BBHash won't measure itself in a const context
+        total += const_cast<boomphf::mphf<step_handle_t, StepHash>&>(step_hash).totalBitSize() / 8;
+    }
+    return total;
+}
+
+}
@@ -0,0 +1,331 @@
+//
+//  linked_path.cpp
+//
+
+#include "bdsg/internal/linked_path.hpp"
+
+#include <handlegraph/util.hpp>
+
+#include <atomic>
+
+namespace bdsg {
+    
+    using namespace handlegraph;
+    
+    LinkedPath::LinkedPath() {
+        
+    }
+    
+    LinkedPath::LinkedPath(const string& name, const int64_t& path_id, bool is_circular) : path_id(path_id), name(name), is_circular(is_circular) {
+        
+    }
+    
+    LinkedPath::LinkedPath(LinkedPath&& other) : head(other.head), tail(other.tail), arena(move(other.arena)), count(other.count), path_id(other.path_id), name(move(other.name)), is_circular(other.is_circular) {
+        // we grabbed the data in the initializer, now make sure the other one is in a valid state
+        other.head = nullptr;
+        other.tail = nullptr;
+        other.path_id = 0;
+        other.count = 0;
+    }
+    
+    LinkedPath& LinkedPath::operator=(LinkedPath&& other) {
+        if (this != &other) {
+            // steal other list, which frees the existing one
+            head = other.head;
+            tail = other.tail;
+            arena = move(other.arena);
+            other.head = nullptr;
+            other.tail = nullptr;
+            
+            name = move(other.name);
+            
+            is_circular = other.is_circular;
+            
+            path_id = other.path_id;
+            other.path_id = 0;
+            
+            count = other.count;
+            other.count = 0;
+        }
+        return *this;
+    }
+    
+    LinkedPath::LinkedPath(const LinkedPath& other) : path_id(other.path_id), name(other.name), is_circular(other.is_circular) {
+        *this = other;
+    }
+    
+    LinkedPath& LinkedPath::operator=(const LinkedPath& other) {
+        if (this != &other) {
+            // free existing list
+            clear();
+            
+            // copy the other list into a single block
+            arena.reserve(other.count);
+            LinkedPathStep* prev = nullptr;
+            bool first_iter = true;
+            for (LinkedPathStep* mapping = other.head;
+                 mapping != nullptr && (first_iter || mapping != other.head); // in case we loop around a circular path
+                 mapping = mapping->next) {
+                
+                LinkedPathStep* copied = arena.allocate(mapping->handle, mapping->path_id);
+                
+                if (!head) {
+                    head = copied;
+                }
+                if (prev) {
+                    prev->next = copied;
+                    copied->prev = prev;
+                }
+                prev = copied;
+                first_iter = false;
+            }
+            tail = prev;
+            
+            // copy the rest of the info
+            path_id = other.path_id;
+            name = other.name;
+            count = other.count;
+            is_circular = other.is_circular;
+            
+            // we only loop over each mapping one time, so we may need to add in the last connection
+            // in a circular path
+            if (is_circular && tail) {
+                tail->next = head;
+                head->prev = tail;
+            }
+        }
+        return *this;
+    }
+    
+    void LinkedPath::clear() {
+        // the mappings are all freed along with the arena
+        arena.clear();
+        head = nullptr;
+        tail = nullptr;
+        count = 0;
+    }
+    
+    LinkedPathStep* LinkedPath::push_back(const handle_t& handle) {
+        return insert_before(handle, nullptr);
+    }
+    
+    LinkedPathStep* LinkedPath::push_front(const handle_t& handle) {
+        return insert_before(handle, head);
+    }
+    
+    void LinkedPath::remove(LinkedPathStep* mapping) {
+        if (mapping == head) {
+            head = mapping->next != mapping ? mapping->next : nullptr;
+        }
+        if (mapping == tail) {
+            tail = mapping->prev != mapping ? mapping->prev : nullptr;
+        }
+        if (mapping->next) {
+            mapping->next->prev = mapping->prev;
+        }
+        if (mapping->prev) {
+            mapping->prev->next = mapping->next;
+        }
+        count--;
+        arena.deallocate(mapping);
+    }
+    
+    bool LinkedPath::for_each_step_parallel(const function<bool(const LinkedPathStep*)>& iteratee,
+                                            size_t chunk_size) const {
+        std::atomic<bool> keep_going(true);
+#pragma omp parallel
+        {
+#pragma omp single
+            {
+                const LinkedPathStep* here = head;
+                while (here && keep_going) {
+                    vector<const LinkedPathStep*> chunk;
+                    chunk.reserve(chunk_size);
+                    do {
+                        chunk.push_back(here);
+                        here = here->next;
+                    } while (here && here != head && chunk.size() < chunk_size);
+                    if (here == head) {
+                        // we came back around a circular path
+                        here = nullptr;
+                    }
+#pragma omp task firstprivate(chunk)
+                    {
+                        for (size_t i = 0; i < chunk.size() && keep_going; i++) {
+                            if (!iteratee(chunk[i])) {
+                                keep_going = false;
+                            }
+                        }
+                    }
+                }
+            }
+        }
+        return keep_going;
+    }
+    
+    LinkedPathStep* LinkedPath::insert_before(const handle_t& handle, LinkedPathStep* mapping) {
+        
+        LinkedPathStep* inserting = arena.allocate(handle, path_id);
+        
+        if (mapping) {
+            inserting->prev = mapping->prev;
+            if (mapping->prev) {
+                mapping->prev->next = inserting;
+            }
+            mapping->prev = inserting;
+            inserting->next = mapping;
+            
+            if (mapping == head) {
+                head = inserting;
+            }
+        }
+        else if (tail) {
+            
+            // handle the potential circular connection
+            inserting->next = tail->next;
+            if (inserting->next) {
+                inserting->next->prev = inserting;
+            }
+            
+            inserting->prev = tail;
+            tail->next = inserting;
+            
+            tail = inserting;
+        }
+        else {
+            // the list is empty so far, so initialize it
+            head = tail = inserting;
+            
+            // make an initial circular connection
+            if (is_circular) {
+                inserting->next = inserting->prev = inserting;
+            }
+        }
+        
+        count++;
+        return inserting;
+    }
+    
+    void LinkedPath::serialize(ostream& out) const {
+        
+        out.write((const char*) &is_circular, sizeof(is_circular) / sizeof(char));
+        
+        int64_t path_id_out = endianness<int64_t>::to_big_endian(path_id);
+        out.write((const char*) &path_id_out, sizeof(path_id_out) / sizeof(char));
+        
+        uint64_t name_size_out = endianness<uint64_t>::to_big_endian(name.size());
+        out.write((const char*) &name_size_out, sizeof(name_size_out) / sizeof(char));
+
+        out.write(name.c_str(), name.size());
+        
+        uint64_t count_out = endianness<uint64_t>::to_big_endian(count);
+        out.write((const char*) &count_out, sizeof(count_out) / sizeof(char));
+        
+        LinkedPathStep* mapping = head;
+        bool first_iter = true;
+        while (mapping && (first_iter || mapping != head)) { // extra condition for circular paths
+            int64_t step = endianness<int64_t>::to_big_endian(as_integer(mapping->handle));
+
+            out.write((const char*) &step, sizeof(step) / sizeof(char));
+            mapping = mapping->next;
+            
+            first_iter = false;
+        }
+    }
+    
+    void LinkedPath::deserialize(istream& in) {
+        // free the current path if it exists
+        clear();
+        in.read((char*) &is_circular, sizeof(is_circular) / sizeof(char));
+        
+        int64_t path_id_in;
+        in.read((char*) &path_id_in, sizeof(path_id_in) / sizeof(char));
+        path_id = endianness<int64_t>::from_big_endian(path_id_in);
+        
+        uint64_t name_size_in;
+        in.read((char*) &name_size_in, sizeof(name_size_in) / sizeof(char));
+        uint64_t name_size = endianness<uint64_t>::from_big_endian(name_size_in);
+        
+        name.resize(name_size);
+        for (size_t i = 0; i < name.size(); i++) {
+            in.read((char*) &name[i], sizeof(char));
+        }
+        
+        uint64_t num_mappings_in;
+        in.read((char*) &num_mappings_in, sizeof(num_mappings_in) / sizeof(char));
+        uint64_t num_mappings = endianness<uint64_t>::from_big_endian(num_mappings_in);
+        
+        // note: count will be incremented in the push_back method
+        count = 0;
+        arena.reserve(num_mappings);
+        for (size_t i = 0; i < num_mappings; i++) {
+            int64_t step_in;
+            in.read((char*) &step_in, sizeof(step_in) / sizeof(char));
+            int64_t step = endianness<int64_t>::from_big_endian(step_in);
+            push_back(as_handle(step));
+        }
+    }
+    
+    LinkedPathArena::LinkedPathArena(LinkedPathArena&& other) : blocks(move(other.blocks)), used(other.used), free_list(other.free_list) {
+        other.blocks.clear();
+        other.used = 0;
+        other.free_list = nullptr;
+    }
+    
+    LinkedPathArena& LinkedPathArena::operator=(LinkedPathArena&& other) {
+        if (this != &other) {
+            blocks = move(other.blocks);
+            used = other.used;
+            free_list = other.free_list;
+            other.blocks.clear();
+            other.used = 0;
+            other.free_list = nullptr;
+        }
+        return *this;
+    }
+    
+    LinkedPathStep* LinkedPathArena::allocate(const handle_t& handle, const int64_t& path_id) {
+        LinkedPathStep* mapping;
+        if (free_list) {
+            mapping = free_list;
+            free_list = free_list->next;
+        }
+        else {
+            if (blocks.empty() || used == blocks.back().second) {
+                // grow geometrically
+                reserve(blocks.empty() ? MIN_BLOCK_SIZE : min<size_t>(2 * blocks.back().second, MAX_BLOCK_SIZE));
+            }
+            mapping = &blocks.back().first[used++];
+        }
+        *mapping = LinkedPathStep(handle, path_id);
+        return mapping;
+    }
+    
+    void LinkedPathArena::deallocate(LinkedPathStep* mapping) {
+        mapping->next = free_list;
+        free_list = mapping;
+    }
+    
+    void LinkedPathArena::reserve(size_t count) {
+        if (count == 0 || (!blocks.empty() && blocks.back().second - used >= count)) {
+            return;
+        }
+        // the end of the current block will be left unused
+        blocks.emplace_back(unique_ptr<LinkedPathStep[]>(new LinkedPathStep[count]), count);
+        used = 0;
+    }
+    
+    void LinkedPathArena::clear() {
+        blocks.clear();
+        used = 0;
+        free_list = nullptr;
+    }
+    
+    size_t LinkedPathArena::capacity() const {
+        size_t total = 0;
+        for (const auto& block : blocks) {
+            total += block.second;
+        }
+        return total;
+    }
+}
@@ -3,12 +3,23 @@
 //
 
 #include "bdsg/internal/mapped_structs.hpp"
+#include "bdsg/internal/perf_counters.hpp"
 
 #include <mutex>
+#include <future>
+#include <thread>
+#include <algorithm>
+#include <array>
+#include <unordered_set>
 #include <sstream>
 #include <iomanip>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#endif
 #include <unistd.h>
 #include <stdio.h>
 #include <string.h>
@@ -30,6 +41,102 @@ bool Manager::check_chains = false;
 // This constant needs a compilation unit.
 const Manager::chainid_t Manager::NO_CHAIN;
 
+/**
+ * The free blocks of a chain, binned by size in the manner of TLSF: sizes
+ * below SUBCLASSES bytes get a class each, and each larger power of 2 is split
+ * into SUBCLASSES classes. A bitmap over the nonempty classes finds the
+ * smallest class whose blocks are all big enough in a few word operations.
+ *
+ * The free list in the chain is kept in position order, which deallocation
+ * needs to coalesce and reclaim_tail() needs to find trailing space, so the
+ * blocks are also indexed by position to find where a freed block goes.
+ */
+struct Manager::FreeBlockIndex {
+    static constexpr size_t SUBCLASS_BITS = 3;
+    static constexpr size_t SUBCLASSES = 1 << SUBCLASS_BITS;
+    static constexpr size_t NUM_CLASSES = (64 - SUBCLASS_BITS + 1) * SUBCLASSES;
+    static constexpr size_t BITMAP_WORDS = (NUM_CLASSES + 63) / 64;
+    
+    /// Free blocks by position in the chain
+    std::map<size_t, AllocatorBlock*> by_position;
+    /// Position in the chain of each free block
+    std::unordered_map<AllocatorBlock*, size_t> positions;
+    /// Free blocks in each size class
+    std::vector<std::unordered_set<AllocatorBlock*>> classes;
+    /// Which size classes have any free blocks
+    std::array<uint64_t, BITMAP_WORDS> nonempty;
+    
+    FreeBlockIndex() : classes(NUM_CLASSES) {
+        nonempty.fill(0);
+    }
+    
+    /// Get the size class of a block with the given number of bytes.
+    static size_t size_class(size_t size) {
+        if (size < SUBCLASSES) {
+            return size;
+        }
+        size_t high_bit = 63 - __builtin_clzll(size);
+        size_t subclass = (size >> (high_bit - SUBCLASS_BITS)) & (SUBCLASSES - 1);
+        return (high_bit - SUBCLASS_BITS + 1) * SUBCLASSES + subclass;
+    }
+    
+    /// Add a free block at the given chain position. Its size must not
+    /// change until it is removed.
+    void insert(AllocatorBlock* block, size_t position) {
+        by_position.emplace(position, block);
+        positions.emplace(block, position);
+        size_t size_class_num = size_class(block->size);
+        classes[size_class_num].insert(block);
+        nonempty[size_class_num / 64] |= (uint64_t) 1 << (size_class_num % 64);
+    }
+    
+    /// Remove a free block.
+    void erase(AllocatorBlock* block) {
+        auto found = positions.find(block);
+        by_position.erase(found->second);
+        positions.erase(found);
+        size_t size_class_num = size_class(block->size);
+        classes[size_class_num].erase(block);
+        if (classes[size_class_num].empty()) {
+            nonempty[size_class_num / 64] &= ~((uint64_t) 1 << (size_class_num % 64));
+        }
+    }
+    
+    /// Get the first nonempty size class at or after the given one, or
+    /// NUM_CLASSES if there is none.
+    size_t next_nonempty(size_t size_class_num) const {
+        for (size_t word = size_class_num / 64; word < BITMAP_WORDS; ++word) {
+            uint64_t bits = nonempty[word];
+            if (word == size_class_num / 64) {
+                // mask out the classes before the one we start at
+                bits &= ~(uint64_t) 0 << (size_class_num % 64);
+            }
+            if (bits) {
+                return word * 64 + __builtin_ctzll(bits);
+            }
+        }
+        return NUM_CLASSES;
+    }
+    
+    /// Find a free block with room for the given number of bytes, or null if
+    /// there is none.
+    AllocatorBlock* find(size_t bytes) const {
+        size_t size_class_num = size_class(bytes);
+        // any block in a bigger class will do
+        size_t bigger = size_class_num + 1 < NUM_CLASSES ? next_nonempty(size_class_num + 1) : NUM_CLASSES;
+        if (bigger < NUM_CLASSES) {
+            return *classes[bigger].begin();
+        }
+        // otherwise we need to check the blocks in the same class
+        for (AllocatorBlock* block : classes[size_class_num]) {
+            if (block->size >= bytes) {
+                return block;
+            }
+        }
+        return nullptr;
+    }
+};
+
 // we hide our LinkRecord in here because we can't forward-declare the MIO
 // stuff it stores.
 
@@ -52,6 +159,9 @@ protected:
     std::unique_ptr<mio::mmap_sink> rw_mapping;
     /// If none, we may have an MIO-managed read-only memory mapping.
     std::unique_ptr<mio::mmap_source> ro_mapping;
+    /// If none, we may have a private copy-on-write mapping of a file, which
+    /// MIO can't make, as an address and length.
+    std::pair<void*, size_t> private_mapping {nullptr, 0};
     
 public:
     // We have some accessors to abstract over the different kinds of mappings.
@@ -76,12 +186,65 @@ public:
         }
     }
     
+    /// Set up private_mapping to map the start of the given file copy-on-write,
+    /// so that writes go to private memory and not the file. Throws on failure.
+    inline void map_file_private(int fd, size_t length) {
+        void* address = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        if (address == MAP_FAILED) {
+            throw std::runtime_error("Could not make private mapping of file: " + std::string(strerror(errno)));
+        }
+        private_mapping = std::make_pair(address, length);
+    }
+    
+    /// Set up private_mapping to map anonymous memory of at least the given
+    /// length, made of pages of the given size. If that is bigger than the
+    /// normal page size, tries huge pages of that size, and falls back on
+    /// normal pages opted in to transparent hugepages if there are none.
+    /// Throws on failure.
+    inline void map_anonymous(size_t length, size_t page_size) {
+        // Mappings have to be whole pages.
+        length = ((length + page_size - 1) / page_size) * page_size;
+        bool huge = page_size > (size_t) getpagesize();
+        void* address = MAP_FAILED;
+#if !defined(__APPLE__) && defined(MAP_HUGETLB)
+        int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB;
+#ifdef MAP_HUGE_SHIFT
+        // Say which huge page size we want.
+        int page_bits = 0;
+        while (((size_t) 1 << page_bits) < page_size) {
+            page_bits++;
+        }
+        flags |= page_bits << MAP_HUGE_SHIFT;
+#endif
+        if (huge) {
+            address = mmap(nullptr, length, PROT_READ | PROT_WRITE, flags, -1, 0);
+        }
+#endif
+        if (address == MAP_FAILED) {
+            // There may be no huge pages reserved, so use normal pages.
+            address = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (address == MAP_FAILED) {
+                throw std::runtime_error("Could not map " + std::to_string(length) + " bytes of memory: " + std::string(strerror(errno)));
+            }
+#if !defined(__APPLE__) && defined(MADV_HUGEPAGE)
+            if (huge) {
+                // And let transparent hugepages back them if they can. If the
+                // kernel doesn't do that, that's fine.
+                madvise(address, length, MADV_HUGEPAGE);
+            }
+#endif
+        }
+        private_mapping = std::make_pair(address, length);
+    }
+    
     /// Return the address at which the link is mapped.
     inline intptr_t get_mapped_address() const {
         if (rw_mapping) {
             return (intptr_t)&((*rw_mapping)[0]);
         } else if (ro_mapping) {
             return (intptr_t)&((*ro_mapping)[0]);
+        } else if (private_mapping.first) {
+            return (intptr_t)private_mapping.first;
         } else {
             throw std::runtime_error("Attempted to get address of unmapped link");
         }
@@ -93,6 +256,8 @@ public:
             return rw_mapping->size();
         } else if (ro_mapping) {
             return ro_mapping->size();
+        } else if (private_mapping.first) {
+            return private_mapping.second;
         } else {
             throw std::runtime_error("Attempted to get mapped length of unmapped link");
         }
@@ -100,7 +265,7 @@ public:
     
     /// Return true if a mapping exists.
     inline bool is_mapped() const {
-        return rw_mapping || ro_mapping;
+        return rw_mapping || ro_mapping || private_mapping.first;
     }
     
     /// Return true if the link can be written (rw mapping or no mapping, which
@@ -114,6 +279,14 @@ public:
         return std::make_pair(std::move(rw_mapping), std::move(ro_mapping));
     }
     
+    /// Release any private mapping, as an address and length to unmap, which
+    /// are null and 0 if there was none.
+    inline std::pair<void*, size_t> release_private() {
+        auto released = private_mapping;
+        private_mapping = std::make_pair(nullptr, 0);
+        return released;
+    }
+    
     // Then we have per-chain state only used in the first link.
     
     /// If this is the first link in the chain, stores the file descriptor
@@ -125,30 +298,266 @@ public:
     /// If this is the first link in the chain, how many bytes in the chain are
     /// prefix, before the allocator?
     size_t prefix_size;
+    /// If this is the first link in the chain, whether the allocator has been
+    /// found or set up at prefix_size yet. A chain whose prefix did not match
+    /// has no allocator to look at.
+    bool allocator_connected = false;
     /// If this is the first link in the chain, how many bytes in the chain exist overall?
     size_t total_size;
+    /// If this is the first link in a chain not backed by a file, the size of
+    /// the pages to map its new links in, or 0 to use malloc().
+    size_t page_size = 0;
+    /// If this is the first link in a snapshot chain, the device and inode of
+    /// the file it maps copy-on-write, which must not be truncated while the
+    /// snapshot exists.
+    std::pair<dev_t, ino_t> snapshot_file {0, 0};
     /// If this is the first link in the chain, use this mutex to synchromize
     /// access to the allocator data structures across threads.
     /// MUST NEVER be acquired if the thread is holding a lock on the chain
     /// info data structures; always acquire this mutex *BEFORE* LOCKING CHAIN
     /// INFO, if you are going to hold both simultaneously.
     std::unique_ptr<std::mutex> allocator_mutex;
+    /// If this is the first link in the chain, the index over the chain's free
+    /// blocks, if it has been built. Protected by allocator_mutex.
+    std::unique_ptr<FreeBlockIndex> free_index;
+    /// If this is the first link in the chain, the generation number of the
+    /// last checkpoint started, or 0 if there has been none.
+    size_t flush_generation = 0;
+    /// If this is the first link in the chain, the background task writing
+    /// out the last checkpoint started, if any.
+    std::shared_future<void> pending_flush;
+};
+
+/**
+ * This is a snapshot of the link layout, which is never modified after it is
+ * published, so readers can search it without locking.
+ */
+struct Manager::LinkTable {
+    struct Link {
+        /// Mapping start address of the link
+        intptr_t address;
+        /// Number of bytes in the link
+        size_t length;
+        /// Offset of the start of the link in the chain
+        size_t offset;
+        /// The chain the link belongs to
+        chainid_t chain;
+        /// Whether the link can be written to
+        bool writable;
+    };
+    
+    /// All the links, sorted by address
+    std::vector<Link> links;
+    /// For each chain, the indexes in links of its links, in chain order
+    std::unordered_map<chainid_t, std::vector<size_t>> chain_links;
+    
+    /// Find the link that contains the given address, or null if the address
+    /// is outside all chains.
+    inline const Link* find(const void* address) const {
+        auto found = std::upper_bound(links.begin(), links.end(), (intptr_t) address, [](intptr_t sought, const Link& link) {
+            return sought < link.address;
+        });
+        if (found == links.begin()) {
+            return nullptr;
+        }
+        --found;
+        if (found->address + found->length > (intptr_t) address) {
+            return &(*found);
+        }
+        return nullptr;
+    }
+    
+    /// Find the link in the given chain that covers the given position, or
+    /// throw if there is none.
+    inline const Link& find(chainid_t chain, size_t position) const {
+        const std::vector<size_t>& chain_map = chain_links.at(chain);
+        auto found = std::upper_bound(chain_map.begin(), chain_map.end(), position, [&](size_t sought, size_t link_index) {
+            return sought < links[link_index].offset;
+        });
+        if (found == chain_map.begin()) {
+            // There won't be a link covering the position
+            throw std::runtime_error("Attempted to find address for position that has no link.");
+        }
+        --found;
+        return links[*found];
+    }
+};
+
+namespace {
+
+/// How many threads can read the LinkTable without locking at once. Any
+/// more fall back on the shared lock.
+constexpr size_t MAX_EPOCH_READERS = 256;
+
+/// The epoch each reader slot was in when it started reading, or 0 if it is
+/// not reading.
+std::atomic<uint64_t> reader_epochs[MAX_EPOCH_READERS];
+
+/// Whether each reader slot belongs to a thread.
+std::atomic<bool> reader_slot_claimed[MAX_EPOCH_READERS];
+
+/// Each thread claims a reader slot the first time it reads a LinkTable, and
+/// gives it back when it exits.
+struct ReaderSlot {
+    ReaderSlot() {
+        for (size_t i = 0; i < MAX_EPOCH_READERS; i++) {
+            bool expected = false;
+            if (reader_slot_claimed[i].compare_exchange_strong(expected, true)) {
+                index = i;
+                break;
+            }
+        }
+    }
+    ~ReaderSlot() {
+        if (index < MAX_EPOCH_READERS) {
+            reader_epochs[index].store(0);
+            reader_slot_claimed[index].store(false);
+        }
+    }
+    
+    /// The slot we own, or MAX_EPOCH_READERS if we could not get one
+    size_t index = MAX_EPOCH_READERS;
+    /// How many guards this thread is holding
+    size_t depth = 0;
+};
+
+thread_local ReaderSlot reader_slot;
+
+/// LinkTables that have been replaced, with the epoch they were replaced in.
+/// Only accessed while holding the write lock.
+std::vector<std::pair<uint64_t, const void*>> retired_link_tables;
+
+}
+
+struct Manager::LinkTableGuard {
+    LinkTableGuard() {
+        epoch = link_table_epoch.load();
+        if (reader_slot.index < MAX_EPOCH_READERS) {
+            if (reader_slot.depth++ == 0) {
+                // Say we are reading, before we look at the table, so that a
+                // writer replacing it after we look will see us.
+                reader_epochs[reader_slot.index].store(epoch);
+            }
+        } else {
+            // No slot; writers can't free anything while we hold this.
+            fallback_lock = std::shared_lock<std::shared_timed_mutex>(Manager::mutex);
+        }
+        table = link_table.load();
+    }
+    
+    ~LinkTableGuard() {
+        if (reader_slot.index < MAX_EPOCH_READERS && --reader_slot.depth == 0) {
+            reader_epochs[reader_slot.index].store(0);
+        }
+    }
+    
+    /// The epoch we started reading in. The table is from this epoch or a
+    /// later one.
+    uint64_t epoch;
+    
+    /// The table we are protecting, or null if no chains have been made.
+    const LinkTable* table;
+    
+    /// Lock we use if we have no reader slot
+    std::shared_lock<std::shared_timed_mutex> fallback_lock;
 };
 
 // Give the static members a compilation unit
 std::unordered_map<Manager::chainid_t, std::map<size_t, intptr_t>> Manager::chain_space_index;
 std::map<intptr_t, Manager::LinkRecord> Manager::address_space_index;
 std::shared_timed_mutex Manager::mutex;
+std::atomic<const Manager::LinkTable*> Manager::link_table(nullptr);
+std::atomic<uint64_t> Manager::link_table_epoch(1);
+
+/**
+ * How many snapshot chains map each file copy-on-write, by device and inode.
+ * Truncating the file would take pages out from under them, so chains backed
+ * by these files leave them at full size when destroyed. Protected by
+ * Manager::mutex.
+ */
+static std::map<std::pair<dev_t, ino_t>, size_t> snapshot_file_counts;
+thread_local Manager::CachedLink Manager::link_cache[Manager::LINK_CACHE_SIZE];
+thread_local size_t Manager::next_cached_link = 0;
+constexpr size_t Manager::LINK_CACHE_SIZE;
+constexpr size_t Manager::READ_CHUNK_SIZE;
+constexpr size_t Manager::MAX_READ_THREADS;
+
+void Manager::remember_link(uint64_t epoch, intptr_t start, size_t length) {
+    CachedLink& cached = link_cache[next_cached_link];
+    cached.epoch = epoch;
+    cached.start = start;
+    cached.end = start + length;
+    next_cached_link = (next_cached_link + 1) % LINK_CACHE_SIZE;
+}
+
+void Manager::publish_link_table() {
+    // Assume we're already locked.
+    
+    LinkTable* new_table = new LinkTable();
+    new_table->links.reserve(address_space_index.size());
+    for (auto& record : address_space_index) {
+        new_table->links.push_back({record.first, record.second.length, record.second.offset,
+                                    (chainid_t) record.second.first, record.second.is_writable()});
+    }
+    for (auto& chain_map : chain_space_index) {
+        std::vector<size_t>& link_indexes = new_table->chain_links[chain_map.first];
+        for (auto& offset_and_address : chain_map.second) {
+            auto found = std::lower_bound(new_table->links.begin(), new_table->links.end(), offset_and_address.second,
+                                          [](const LinkTable::Link& link, intptr_t sought) {
+                return link.address < sought;
+            });
+            link_indexes.push_back(found - new_table->links.begin());
+        }
+    }
+    
+    const LinkTable* old_table = link_table.exchange(new_table);
+    if (old_table) {
+        // Readers from this epoch or earlier may still be using the old table
+        retired_link_tables.emplace_back(link_table_epoch.fetch_add(1), old_table);
+    }
+    
+    // Find the oldest epoch still being read in
+    uint64_t oldest_reader = std::numeric_limits<uint64_t>::max();
+    for (size_t i = 0; i < MAX_EPOCH_READERS; i++) {
+        uint64_t reader = reader_epochs[i].load();
+        if (reader != 0) {
+            oldest_reader = std::min(oldest_reader, reader);
+        }
+    }
+    
+    // Free everything retired before then
+    auto kept = retired_link_tables.begin();
+    for (auto it = retired_link_tables.begin(); it != retired_link_tables.end(); ++it) {
+        if (it->first < oldest_reader) {
+            delete (const LinkTable*) it->second;
+        } else {
+            *kept = *it;
+            ++kept;
+        }
+    }
+    retired_link_tables.erase(kept, retired_link_tables.end());
+}
 
 Manager::chainid_t Manager::create_chain(const std::string& prefix) {
+    return create_chain(prefix, 0, PAGES_NORMAL);
+}
+
+Manager::chainid_t Manager::create_chain(const std::string& prefix, size_t reserve_bytes, page_kind_t pages) {
     if (prefix.size() > MAX_PREFIX_SIZE) {
         // Prefix is too long and allocator might not fit.
         throw std::runtime_error("Prefix of " + std::to_string(prefix.size()) +
             " is longer than limit of " + std::to_string(MAX_PREFIX_SIZE));
     }
     
+    // Work out how big the first link should be, using all of its pages.
+    size_t link_size = std::max(BASE_SIZE, reserve_bytes);
+    size_t page_size = get_page_size(pages);
+    if (page_size) {
+        link_size = ((link_size + page_size - 1) / page_size) * page_size;
+    }
+    
     // Make a no-file chain which can't possibly have data.
-    chainid_t chain = open_chain(0, BASE_SIZE).first;
+    chainid_t chain = open_chain(0, link_size, nullptr, pages).first;
     
     // Copy the prefix into place
     char* start = (char*)get_address_in_chain(chain, 0, prefix.size());
@@ -156,11 +565,24 @@ Manager::chainid_t Manager::create_chain(const std::string& prefix) {
     
     
     // Set up the allocator data structures.
-    set_up_allocator_at(chain, prefix.size(), BASE_SIZE - prefix.size());
+    set_up_allocator_at(chain, prefix.size(), link_size - prefix.size());
     
     return chain;
 }
 
+size_t Manager::get_page_size(page_kind_t pages) {
+    switch (pages) {
+    case PAGES_NORMAL:
+        return 0;
+    case PAGES_HUGE_2MB:
+        return (size_t) 1 << 21;
+    case PAGES_HUGE_1GB:
+        return (size_t) 1 << 30;
+    default:
+        throw std::runtime_error("Unknown page kind: " + std::to_string((int) pages));
+    }
+}
+
 Manager::chainid_t Manager::create_chain(int fd, const std::string& prefix) {
     if (prefix.size() > MAX_PREFIX_SIZE) {
         // Prefix is too long and allocator might not fit.
@@ -213,6 +635,27 @@ Manager::chainid_t Manager::create_chain(int fd, const std::string& prefix) {
 }
 
 Manager::chainid_t Manager::create_chain(const std::function<std::string(void)>& iterator, const std::string& prefix) {
+    // Hand out each block from the iterator as the reader asks for it.
+    std::string block;
+    size_t block_used = 0;
+    return create_chain_by_reading([&](void* destination, size_t max_bytes) -> size_t {
+        if (block_used == block.size()) {
+            // Go and get some data
+            block = iterator();
+            block_used = 0;
+            
+#ifdef debug_manager
+            std::cerr << "Received block of size " << block.size() << endl;
+#endif
+        }
+        size_t bytes = std::min(max_bytes, block.size() - block_used);
+        memcpy(destination, block.c_str() + block_used, bytes);
+        block_used += bytes;
+        return bytes;
+    }, prefix);
+}
+
+Manager::chainid_t Manager::create_chain_by_reading(const std::function<size_t(void*, size_t)>& reader, const std::string& prefix) {
     if (prefix.size() > MAX_PREFIX_SIZE) {
         // Prefix is too long and allocator might not fit.
         throw std::runtime_error("Prefix of " + std::to_string(prefix.size()) +
@@ -246,80 +689,164 @@ Manager::chainid_t Manager::create_chain(const std::function<std::string(void)>&
     bool prefix_checked = false;
     
     // Start a cursor at the start of the buffer, pointing to where the next
-    // block will go.
+    // read will go.
     size_t cursor = 0;
     
-    // Go and get some data
-    std::string block = iterator();
-    
-#ifdef debug_manager
-    std::cerr << "Received block of size " << block.size() << endl;
-#endif
-    
-    while (!block.empty()) {
-        if (cursor + block.size() > buffer_size) {
-            // Embiggen the buffer
-            buffer_size *= 2;
-            void* new_buffer = realloc(buffer, buffer_size);
-            if (!new_buffer) {
-                // Make sure to free the old buffer (and not have clobbered it)
-                free(buffer);
-                throw std::runtime_error("Could not expand buffer to " +
-                    std::to_string(buffer_size) + " bytes");
+    try {
+        while (true) {
+            if (cursor == buffer_size) {
+                // Embiggen the buffer
+                buffer_size *= 2;
+                void* new_buffer = realloc(buffer, buffer_size);
+                if (!new_buffer) {
+                    throw std::runtime_error("Could not expand buffer to " +
+                        std::to_string(buffer_size) + " bytes");
+                }
+                buffer = new_buffer;
             }
-            buffer = new_buffer;
-        }
-        
-        // Put the new data in the buffer
-        memcpy((char*)buffer + cursor, block.c_str(), block.size());
-        // And move the cursor
-        cursor += block.size();
-        
-        if (!prefix_checked && cursor >= prefix.size()) {
-            // We've read in enough to check the prefix.
             
-            // Go find where the prefix should be
-            char* start = (char*)buffer;
-            if (!std::equal(prefix.begin(), prefix.end(), start)) {
-                // It's not the right prefix so clean up and bail out.
-                free(buffer);
-                throw std::runtime_error("Expected prefix not found in input. Check file type.");
+            // Read straight into the buffer
+            size_t bytes = reader((char*)buffer + cursor, buffer_size - cursor);
+            if (bytes == 0) {
+                // That's the end of the data
+                break;
             }
+            // And move the cursor
+            cursor += bytes;
             
-            // If we get here we got the right prefix.
-            prefix_checked = true;
+            if (!prefix_checked && cursor >= prefix.size()) {
+                // We've read in enough to check the prefix, so don't bother
+                // reading the rest of a file of the wrong type.
+                if (!std::equal(prefix.begin(), prefix.end(), (char*)buffer)) {
+                    throw std::runtime_error("Expected prefix not found in input. Check file type.");
+                }
+                prefix_checked = true;
+            }
         }
-        
-        // We copied the whole block so go get another block.
-        block = iterator();
-        
-#ifdef debug_manager
-        std::cerr << "Received block of size " << block.size() << endl;
-#endif
-        
+    } catch (...) {
+        // Make sure to free the buffer (and not have clobbered it)
+        free(buffer);
+        throw;
     }
     
-    if (cursor < prefix.size()) {
-        // We should have copied the whole prefix
+    return adopt_buffer(buffer, cursor, prefix);
+}
+
+Manager::chainid_t Manager::read_chain(int fd, const std::string& prefix) {
+    if (prefix.size() > MAX_PREFIX_SIZE) {
+        // Prefix is too long and allocator might not fit.
+        throw std::runtime_error("Prefix of " + std::to_string(prefix.size()) +
+            " is longer than limit of " + std::to_string(MAX_PREFIX_SIZE));
+    }
+    
+    struct stat fileinfo;
+    if (fstat(fd, &fileinfo)) {
+        throw std::runtime_error("Could not stat file: " + std::string(strerror(errno)));
+    }
+    off_t start = S_ISREG(fileinfo.st_mode) ? lseek(fd, 0, SEEK_CUR) : -1;
+    
+    if (start == -1) {
+        // We can't know the length or read out of order, so read through as a
+        // stream.
+        return create_chain_by_reading([&](void* destination, size_t max_bytes) -> size_t {
+            while (true) {
+                ssize_t bytes = ::read(fd, destination, max_bytes);
+                if (bytes >= 0) {
+                    return bytes;
+                }
+                if (errno != EINTR) {
+                    throw std::runtime_error("Could not read file: " + std::string(strerror(errno)));
+                }
+            }
+        }, prefix);
+    }
+    
+    // Otherwise we know how much data there is, and can read it all straight
+    // into place with several reads in flight.
+    size_t total_size = fileinfo.st_size > start ? fileinfo.st_size - start : 0;
+    void* buffer = malloc(std::max(total_size, (size_t) 1));
+    if (!buffer) {
+        throw std::runtime_error("Could not allocate buffer of " +
+            std::to_string(total_size) + " bytes");
+    }
+    
+    size_t chunk_count = (total_size + READ_CHUNK_SIZE - 1) / READ_CHUNK_SIZE;
+    size_t thread_count = std::min<size_t>(std::min<size_t>(chunk_count, MAX_READ_THREADS),
+                                           std::max(std::thread::hardware_concurrency(), 1u));
+    
+    // Threads take chunks in order until they run out, and the first error
+    // stops everyone.
+    std::atomic<size_t> next_chunk(0);
+    std::atomic<int> read_error(0);
+    auto read_chunks = [&]() {
+        size_t chunk;
+        while (!read_error.load() && (chunk = next_chunk.fetch_add(1)) < chunk_count) {
+            size_t cursor = chunk * READ_CHUNK_SIZE;
+            size_t chunk_end = std::min(cursor + READ_CHUNK_SIZE, total_size);
+            while (cursor < chunk_end) {
+                ssize_t bytes = pread(fd, (char*)buffer + cursor, chunk_end - cursor, start + cursor);
+                if (bytes > 0) {
+                    cursor += bytes;
+                } else if (bytes == 0) {
+                    // The file got shorter under us.
+                    read_error.store(EIO);
+                    return;
+                } else if (errno != EINTR) {
+                    read_error.store(errno);
+                    return;
+                }
+            }
+        }
+    };
+    
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < thread_count; i++) {
+        threads.emplace_back(read_chunks);
+    }
+    read_chunks();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    
+    if (read_error.load()) {
+        free(buffer);
+        throw std::runtime_error("Could not read file: " + std::string(strerror(read_error.load())));
+    }
+    
+    // Leave the file position after what we read, as a stream read would.
+    lseek(fd, start + total_size, SEEK_SET);
+    
+    return adopt_buffer(buffer, total_size, prefix);
+}
+
+Manager::chainid_t Manager::adopt_buffer(void* buffer, size_t length, const std::string& prefix) {
+    if (length < prefix.size()) {
+        // We should have read the whole prefix
         free(buffer);
         throw std::runtime_error("Input ended before expected prefix could be read");
     }
     
+    if (!std::equal(prefix.begin(), prefix.end(), (char*)buffer)) {
+        // It's not the right prefix so clean up and bail out.
+        free(buffer);
+        throw std::runtime_error("Expected prefix not found in input. Check file type.");
+    }
+    
     // Shrink the buffer to jsut what we filled
-    void* new_buffer = realloc(buffer, cursor);
+    void* new_buffer = realloc(buffer, length);
     if (!new_buffer) {
         free(buffer);
         throw std::runtime_error("Could not shrink buffer to " +
-            std::to_string(cursor) + " bytes");
+            std::to_string(length) + " bytes");
     }
     buffer = new_buffer;
     
 #ifdef debug_manager
-    std::cerr << "Create chain with preallocated link of size " << cursor << endl;
+    std::cerr << "Create chain with preallocated link of size " << length << endl;
 #endif
     
     // Just hand the whole block over
-    chainid_t chain = open_chain(0, cursor, buffer).first;
+    chainid_t chain = open_chain(0, length, buffer).first;
     
     // Assume the allocator data structures are ready.
     connect_allocator_at(chain, prefix.size());
@@ -327,9 +854,9 @@ Manager::chainid_t Manager::create_chain(const std::function<std::string(void)>&
     return chain;
 }
 
-Manager::chainid_t Manager::get_dissociated_chain(chainid_t chain) {
+Manager::chainid_t Manager::get_dissociated_chain(chainid_t chain, page_kind_t pages) {
     // Copy to a chain associated with no FD
-    return copy_chain(chain, 0);
+    return copy_chain(chain, 0, pages);
 }
 
 Manager::chainid_t Manager::get_associated_chain(chainid_t chain, int fd) {
@@ -337,8 +864,221 @@ Manager::chainid_t Manager::get_associated_chain(chainid_t chain, int fd) {
     return copy_chain(chain, fd);
 }
 
+Manager::chainid_t Manager::get_snapshot_chain(chainid_t chain) {
+
+    assert(chain != NO_CHAIN);
+
+    int fd;
+    size_t prefix_size;
+    size_t total_size;
+    {
+        // Get read access to manager data structures
+        std::shared_lock<std::shared_timed_mutex> lock(Manager::mutex);
+        auto& record = Manager::address_space_index.at(chain);
+        fd = record.fd;
+        prefix_size = record.prefix_size;
+        total_size = record.total_size;
+    }
+    
+    if (!fd) {
+        // Memory not backed by a file has nothing we can map again, so copy it.
+        return copy_chain(chain, 0);
+    }
+    
+    struct stat fileinfo;
+    if (fstat(fd, &fileinfo)) {
+        throw std::runtime_error("Could not stat file: " + std::string(strerror(errno)));
+    }
+    
+    // The links of a file-backed chain map consecutive ranges of the file, so
+    // we can map the whole chain privately as one link. We leave it
+    // unassociated with the file, so that it grows into normal memory.
+    LinkRecord record;
+    record.map_file_private(fd, total_size);
+    record.length = total_size;
+    record.snapshot_file = std::make_pair(fileinfo.st_dev, fileinfo.st_ino);
+    
+    {
+        // Get write access to manager data structures
+        std::unique_lock<std::shared_timed_mutex> lock(Manager::mutex);
+        ++snapshot_file_counts[record.snapshot_file];
+    }
+    
+    return adopt_mapping(record, prefix_size);
+}
+
+Manager::chainid_t Manager::get_numa_replica_chain(chainid_t chain, size_t numa_node) {
+
+    assert(chain != NO_CHAIN);
+
+    size_t prefix_size;
+    size_t total_size;
+    {
+        // Get read access to manager data structures
+        std::shared_lock<std::shared_timed_mutex> lock(Manager::mutex);
+        auto& record = Manager::address_space_index.at(chain);
+        prefix_size = record.prefix_size;
+        total_size = record.total_size;
+    }
+    
+    // Map fresh memory for the replica.
+    LinkRecord record;
+    record.map_anonymous(total_size, getpagesize());
+    record.length = total_size;
+    
+#if defined(__linux__) && defined(SYS_mbind)
+    if (numa_node < sizeof(unsigned long) * CHAR_BIT) {
+        // Place its pages on the node before anything touches them. If the
+        // node has no memory free, they can go elsewhere.
+        unsigned long node_mask = 1UL << numa_node;
+        syscall(SYS_mbind, (void*) record.get_mapped_address(), record.get_mapped_length(),
+                MPOL_PREFERRED, &node_mask, sizeof(node_mask) * CHAR_BIT, 0);
+    }
+#endif
+    
+    // Copy the data over, link by link. We are the first to touch the pages,
+    // so they end up where we bound them.
+    char* destination = (char*) record.get_mapped_address();
+    scan_chain(chain, [&](const void* link_start, size_t link_length) {
+        memcpy(destination, link_start, link_length);
+        destination += link_length;
+    });
+    
+    return adopt_mapping(record, prefix_size);
+}
+
+Manager::chainid_t Manager::adopt_mapping(LinkRecord& record, size_t prefix_size) {
+    intptr_t mapping_address = record.get_mapped_address();
+    record.offset = 0;
+    record.next = 0;
+    record.first = mapping_address;
+    record.last = mapping_address;
+    record.fd = 0;
+    record.total_size = record.length;
+    record.allocator_mutex = std::make_unique<std::mutex>();
+    
+    chainid_t new_chain = (chainid_t) mapping_address;
+    {
+        // Get write access to manager data structures
+        std::unique_lock<std::shared_timed_mutex> lock(Manager::mutex);
+        
+        Manager::address_space_index[mapping_address] = std::move(record);
+        chain_space_index[new_chain][0] = mapping_address;
+        
+        publish_link_table();
+    }
+    
+    // The allocator data structures came along with the data.
+    connect_allocator_at(new_chain, prefix_size);
+    
+    return new_chain;
+}
+
+size_t Manager::get_numa_node_count() {
+    // The set of nodes doesn't change while we run, so only look once.
+    static const size_t node_count = []() {
+        size_t count = 1;
+#ifdef __linux__
+        // Nodes are numbered from 0; look for the first gap.
+        struct stat node_info;
+        while (stat(("/sys/devices/system/node/node" + std::to_string(count)).c_str(), &node_info) == 0) {
+            count++;
+        }
+#endif
+        return count;
+    }();
+    return node_count;
+}
+
+size_t Manager::get_local_numa_node() {
+    // Threads rarely move between nodes, so remember where each one was.
+    thread_local size_t local_node = std::numeric_limits<size_t>::max();
+    if (local_node == std::numeric_limits<size_t>::max()) {
+        local_node = 0;
+#if defined(__linux__) && defined(SYS_getcpu)
+        unsigned int cpu;
+        unsigned int node;
+        if (syscall(SYS_getcpu, &cpu, &node, nullptr) == 0) {
+            local_node = node;
+        }
+#endif
+    }
+    return local_node;
+}
+
+Manager::chainid_t Manager::replace_chain(chainid_t chain, chainid_t replacement) {
+
+    assert(chain != NO_CHAIN);
+    assert(replacement != NO_CHAIN);
+    
+    int fd;
+    {
+        // Get read access to manager data structures
+        std::shared_lock<std::shared_timed_mutex> lock(Manager::mutex);
+        fd = Manager::address_space_index.at(chain).fd;
+    }
+    
+    if (!fd || !is_chain_writable(chain)) {
+        // There is no file to write back to.
+        destroy_chain(chain);
+        return replacement;
+    }
+    
+    struct stat fileinfo;
+    if (fstat(fd, &fileinfo)) {
+        throw std::runtime_error("Could not stat file: " + std::string(strerror(errno)));
+    }
+    {
+        // Get read access to manager data structures
+        std::shared_lock<std::shared_timed_mutex> lock(Manager::mutex);
+        if (snapshot_file_counts.count(std::make_pair(fileinfo.st_dev, fileinfo.st_ino))) {
+            // Rewriting the file would pull it out from under the snapshots.
+            throw std::runtime_error("Cannot rewrite a file that snapshots are mapping");
+        }
+    }
+    
+    // Keep the file open past the old chain, which closes its FD.
+    int our_fd = dup(fd);
+    if (our_fd == -1) {
+        throw std::runtime_error("Could not duplicate file descriptor: " + std::string(strerror(errno)));
+    }
+    
+    chainid_t new_chain;
+    try {
+        destroy_chain(chain);
+        // Truncate the file and copy the replacement into it.
+        new_chain = copy_chain(replacement, our_fd);
+        destroy_chain(replacement);
+    } catch (...) {
+        close(our_fd);
+        throw;
+    }
+    
+    // The new chain has its own FD for the file.
+    if (close(our_fd)) {
+        throw std::runtime_error("Could not close file: " + std::string(strerror(errno)));
+    }
+    return new_chain;
+}
+
 void Manager::destroy_chain(chainid_t chain) {
 
+    {
+        // Let any checkpoint finish with the chain's memory and file.
+        std::shared_future<void> flush;
+        {
+            // Get read access to manager data structures
+            std::shared_lock<std::shared_timed_mutex> lock(Manager::mutex);
+            auto head_entry = Manager::address_space_index.find((intptr_t) chain);
+            if (head_entry != Manager::address_space_index.end()) {
+                flush = head_entry->second.pending_flush;
+            }
+        }
+        if (flush.valid()) {
+            flush.wait();
+        }
+    }
+
     // Reclaim any bytes from the end of the file that we can.
     size_t bytes_to_drop = reclaim_tail(chain);
     // We'll need to get the total chain size out of the first link.
@@ -349,6 +1089,8 @@ void Manager::destroy_chain(chainid_t chain) {
     
     // Remember any MIO mappings to unmap
     std::vector<std::pair<std::unique_ptr<mio::mmap_sink>, std::unique_ptr<mio::mmap_source>>> mio_clean;
+    // And any private mappings
+    std::vector<std::pair<void*, size_t>> private_clean;
     // Remember any normal memory to clean up
     std::vector<void*> normal_clean;
 
@@ -366,6 +1108,20 @@ void Manager::destroy_chain(chainid_t chain) {
         fd = head_entry->second.fd;
         total_size = head_entry->second.total_size;
         
+        struct stat fileinfo;
+        if (fd && bytes_to_drop > 0 && fstat(fd, &fileinfo) == 0 &&
+            snapshot_file_counts.count(std::make_pair(fileinfo.st_dev, fileinfo.st_ino))) {
+            // Snapshots still map the end of the file.
+            bytes_to_drop = 0;
+        }
+        if (head_entry->second.snapshot_file.second != 0) {
+            // This is a snapshot, and it no longer needs its file kept whole.
+            auto count = snapshot_file_counts.find(head_entry->second.snapshot_file);
+            if (--count->second == 0) {
+                snapshot_file_counts.erase(count);
+            }
+        }
+        
         auto link_entry = head_entry;
         
         while(link_entry != Manager::address_space_index.end()) {
@@ -374,6 +1130,7 @@ void Manager::destroy_chain(chainid_t chain) {
                 // Clear up any MIO mapping
                 // Note that we're allowed to modify the actual record with "read" access, just not the maps.
                 mio_clean.emplace_back(std::move(link_entry->second.release()));
+                private_clean.push_back(link_entry->second.release_private());
             } else {
                 // This is just a normal char array allocation.
                 normal_clean.emplace_back((void*)link_entry->first);
@@ -396,6 +1153,8 @@ void Manager::destroy_chain(chainid_t chain) {
         
         // Also clean up the chain position index
         Manager::chain_space_index.erase(chain);
+        
+        publish_link_table();
     }
     
     // Now that we aren't holding locks, free the memory
@@ -405,6 +1164,12 @@ void Manager::destroy_chain(chainid_t chain) {
         mappings.second.reset();
     }
     
+    for (auto& mapping : private_clean) {
+        if (mapping.first) {
+            munmap(mapping.first, mapping.second);
+        }
+    }
+    
     for (auto& mapping : normal_clean) {
         free(mapping);
     }
@@ -434,74 +1199,25 @@ void* Manager::get_address_in_chain(chainid_t chain, size_t position, size_t len
         return (void*) position; 
     }
     
-    // Get read access to manager data structures
-    std::shared_lock<std::shared_timed_mutex> lock(Manager::mutex);
-    
-    // Find the index over this chain's space
-    auto& chain_map = Manager::chain_space_index.at(chain);
-    
-    // Find the first chain link starting after our position 
-    auto found = chain_map.upper_bound(position);
-    
-    if (found == chain_map.begin() || chain_map.empty()) {
-        // There won't be a link covering the position
-        throw std::runtime_error("Attempted to find address for position that has no link.");
+    // Get lock-free read access to the link layout
+    LinkTableGuard guard;
+    if (!guard.table) {
+        throw std::out_of_range("Attempted to find address in nonexistent chain.");
     }
     
-    // Look left and find the link we are looking for
-    --found;
+    // Find the link covering the position
+    const LinkTable::Link& link = guard.table->find(chain, position);
     
-    if (length) {
-        // We need to do extra error checking, for which we need the LinkRecord.
-        // TODO: should we waste some memory and save a lookup here?
-        LinkRecord& link = Manager::address_space_index.at(found->second);
-        
-        if (link.offset + link.length < position + length) {
-            // Whatever it is we're interested in would cross link boundaries.
-            throw std::runtime_error("Attempted to find address for position range that does not fit completely within any link");
-        }
+    if (length && link.offset + link.length < position + length) {
+        // Whatever it is we're interested in would cross link boundaries.
+        throw std::runtime_error("Attempted to find address for position range that does not fit completely within any link");
     }
     
     // Convert to address by offsetting from address of containing block.
-    return (void*)(found->second + (position - found->first));
+    return (void*)(link.address + (position - link.offset));
    
 }
 
-std::map<intptr_t, Manager::LinkRecord>::iterator Manager::find_link(std::shared_lock<std::shared_timed_mutex>& lock, const void* address) {
-
-    // Determine what we're looking for
-    intptr_t sought = (intptr_t) address;
-    
-    // Find the earliest link starting after the address
-    auto found = Manager::address_space_index.upper_bound((intptr_t)address);
-        
-    if (found == Manager::address_space_index.begin() || Manager::address_space_index.empty()) {
-        // There won't be a link covering the address.
-        // Say this is an address not in any chain.
-        
-#ifdef debug_pointers
-        std::cerr << "Address " << sought << " has no links starting after it, or no link before such a link, so is not in any chain" << std::endl;
-#endif
-        
-        return Manager::address_space_index.end();
-    }
-        
-#ifdef debug_pointers
-    std::cerr << "Address " << sought << " has a link starting after it at " << found->first << std::endl;
-#endif
-        
-    // Go left to the link that must include the address if any does.
-    --found;
-    
-    if (found->first + found->second.length > sought) {
-        // The address is inside the link
-        return found;
-    } else {
-        // The link ends before the address
-        return Manager::address_space_index.end();
-    }
-}
-
 std::pair<Manager::chainid_t, size_t> Manager::get_chain_and_position(const void* address, size_t length) {
     // Determine what we're looking for
     intptr_t sought = (intptr_t) address;
@@ -512,22 +1228,22 @@ std::pair<Manager::chainid_t, size_t> Manager::get_chain_and_position(const void
     size_t link_length;
     chainid_t chain;
     {
-        // Get read access to manager data structures
-        std::shared_lock<std::shared_timed_mutex> lock(Manager::mutex);
+        // Get lock-free read access to the link layout
+        LinkTableGuard guard;
         
-        // Find the earliest link starting after the address
-        auto found = find_link(lock, address);
+        // Find the link covering the address
+        const LinkTable::Link* found = guard.table ? guard.table->find(address) : nullptr;
         
-        if (found == Manager::address_space_index.end()) {
+        if (!found) {
             // There won't be a link covering the address.
             return std::make_pair(NO_CHAIN, (size_t) address); 
         }
         
         // Copy out link info
-        link_base = found->first;
-        link_offset = found->second.offset;
-        link_length = found->second.length;
-        chain = (chainid_t) found->second.first;
+        link_base = found->address;
+        link_offset = found->offset;
+        link_length = found->length;
+        chain = found->chain;
     }
     
 #ifdef debug_pointers
@@ -563,30 +1279,28 @@ void* Manager::get_address_in_same_chain(const void* here, size_t position) {
 }
     
 size_t Manager::get_position_in_same_chain(const void* here, const void* address) {
-    {
-        // Get read access to manager data structures
-        std::shared_lock<std::shared_timed_mutex> lock(Manager::mutex);
-        
-        auto here_link = find_link(lock, here);
-        auto there_link = find_link(lock, address);
-        
-        if (here_link == Manager::address_space_index.end()) {
-            if (there_link == Manager::address_space_index.end()) {
-                // We're not actually in a chain. Use a raw position
-                return (size_t) address;
-            } else {
-                throw std::runtime_error("Attempted to refer into or out of a chain!");
-            }
+    // Get lock-free read access to the link layout
+    LinkTableGuard guard;
+    
+    const LinkTable::Link* here_link = guard.table ? guard.table->find(here) : nullptr;
+    const LinkTable::Link* there_link = guard.table ? guard.table->find(address) : nullptr;
+    
+    if (!here_link) {
+        if (!there_link) {
+            // We're not actually in a chain. Use a raw position
+            return (size_t) address;
         } else {
-            if (here_link->second.first != there_link->second.first) {
-                // These are links of different chains
-                throw std::runtime_error("Attempted to refer across chains!");
-            } else {
-                // These are the same chain.
-                // Get how far the address is into its link, plus the start
-                // offset of the link in the chain.
-                return ((intptr_t) address - (intptr_t) there_link->first) + there_link->second.offset; 
-            }
+            throw std::runtime_error("Attempted to refer into or out of a chain!");
+        }
+    } else {
+        if (!there_link || here_link->chain != there_link->chain) {
+            // These are links of different chains
+            throw std::runtime_error("Attempted to refer across chains!");
+        } else {
+            // These are the same chain.
+            // Get how far the address is into its link, plus the start
+            // offset of the link in the chain.
+            return ((intptr_t) address - there_link->address) + there_link->offset; 
         }
     }
 }
@@ -596,23 +1310,26 @@ std::pair<int64_t, bool> Manager::get_offset_in_same_chain(const void* here, con
     // Compute tha address offset
     int64_t in_memory_offset = (intptr_t) address - (intptr_t) here;
 
-    // Get read access to manager data structures
-    std::shared_lock<std::shared_timed_mutex> lock(Manager::mutex);
+    // Get lock-free read access to the link layout
+    LinkTableGuard guard;
     
     // Find where the pointers fall in the chain.
-    auto here_link = find_link(lock, here);
-    auto there_link = find_link(lock, address);
+    const LinkTable::Link* here_link = guard.table ? guard.table->find(here) : nullptr;
+    const LinkTable::Link* there_link = guard.table ? guard.table->find(address) : nullptr;
     
     if (here_link == there_link) {
         // Same link (possibly no link).
+        if (here_link) {
+            // Next time we can skip straight to here
+            remember_link(guard.epoch, here_link->address, here_link->length);
+        }
         // Just do a straight offset.
         return std::make_pair(in_memory_offset, true);
-    } else if (here_link == Manager::address_space_index.end() ||
-        there_link == Manager::address_space_index.end()) {
+    } else if (!here_link || !there_link) {
         
         // One of them is not in a chain 
         throw std::runtime_error("Attempted to refer into or out of a chain!");
-    } else if (here_link->second.first != there_link->second.first) {
+    } else if (here_link->chain != there_link->chain) {
         // These are links of different chains
         throw std::runtime_error("Attempted to refer across chains!");
     } else {
@@ -622,8 +1339,8 @@ std::pair<int64_t, bool> Manager::get_offset_in_same_chain(const void* here, con
         // memory, this is 0. If the link we are going to is further along in
         // memory than we expect, this is positive.
         // So we take the distance in memory and subtract the distance in the chain.
-        int64_t correction = (there_link->first - here_link->first) -
-            ((int64_t) there_link->second.offset - (int64_t) here_link->second.offset);
+        int64_t correction = (there_link->address - here_link->address) -
+            ((int64_t) there_link->offset - (int64_t) here_link->offset);
         // Then we take the distance in memory, and subtract the correction
         // (which is positive if the distance in memory is too big) to get the
         // distance in the chain.
@@ -637,44 +1354,38 @@ std::pair<void*, bool> Manager::follow_offset_in_same_chain(const void* here, in
     // Determine where we would be if we just applied the offset directly to the address
     void* applied_local = (void*)((intptr_t) here + offset);
     
-    // Get read access to manager data structures
-    std::shared_lock<std::shared_timed_mutex> lock(Manager::mutex);
+    // Get lock-free read access to the link layout
+    LinkTableGuard guard;
     
     // Find the link we are starting in.
-    auto link = find_link(lock, here);
+    const LinkTable::Link* link = guard.table ? guard.table->find(here) : nullptr;
     
-    if (link == Manager::address_space_index.end() ||
-        (link->first <= (intptr_t) here + offset &&
-        link->second.length > (intptr_t) here - link->first + offset)) {
+    if (!link ||
+        (link->address <= (intptr_t) here + offset &&
+        (intptr_t) link->length > (intptr_t) here - link->address + offset)) {
         // We are actually in the same link (possibly no link)
+        if (link) {
+            // Next time we can skip straight to here
+            remember_link(guard.epoch, link->address, link->length);
+        }
         // Just need to move in memory.
         // If the link is nonexistent or writable, set the writable-direct-offset flag.
-        return std::make_pair(applied_local, link == Manager::address_space_index.end() || link->second.is_writable());
+        return std::make_pair(applied_local, !link || link->writable);
     } else {
         // Need to move in this chain to a different link
-        chainid_t chain = (chainid_t) link->second.first;
         
-        // These are all the links along the chain
-        auto& chain_map = Manager::chain_space_index.at(chain);
-    
         // This is where we're going along the chain
-        size_t position = link->second.offset + ((intptr_t) here - link->first) + offset;
+        size_t position = link->offset + ((intptr_t) here - link->address) + offset;
         
-        // Find the first chain link starting after our position 
-        auto found = chain_map.upper_bound(position);
-        if (found == chain_map.begin() || chain_map.empty()) {
-            // There won't be a link covering the position
-            throw std::runtime_error("Attempted to find address for position that has no link.");
-        }
-        // Look left and find the link we are looking for that covers the position
-        --found;
+        // Find the chain link that covers the position
+        const LinkTable::Link& found = guard.table->find(link->chain, position);
         
         // Work out where we are going: that offset in the found link along the chain.
-        void* applied_chain = (void*)(found->second + (position - found->first));
+        void* applied_chain = (void*)(found.address + (position - found.offset));
         
         // Return the result, and check if it's actually the same as the local
         // offset and where *we* are is writable, so we can just do that in the future.
-        return std::make_pair(applied_chain, applied_chain == applied_local && link->second.is_writable());
+        return std::make_pair(applied_chain, applied_chain == applied_local && link->writable);
     }
 }
 
@@ -799,6 +1510,8 @@ void* Manager::allocate_from(chainid_t chain, size_t bytes) {
         return allocated;
     }
     
+    BDSG_TIME_EVENT(MANAGER_ALLOCATE);
+    
     // How much space do we need with block overhead, if we need a new block?
     size_t block_bytes = bytes + sizeof(AllocatorBlock);
     
@@ -806,27 +1519,13 @@ void* Manager::allocate_from(chainid_t chain, size_t bytes) {
     
     with_allocator_header(chain, [&](AllocatorHeader* header) {
         // With exclusive use of the free list
+        FreeBlockIndex& index = get_free_block_index(chain, header);
     
         // This will hold a ref to the free block we found or made that is big enough to hold this item.
-        // Starts null if there is no first_free.
-        found = header->first_free;
+        found = index.find(bytes);
 #ifdef debug_manager
-        std::cerr << "Start at " << (intptr_t) found << std::endl;
+        std::cerr << "Found free block at " << (intptr_t) found << std::endl;
 #endif
-        while (found && found->size < bytes) {
-            // Won't fit here. Try the next place.
-#ifdef debug_manager
-            std::cerr << "Skip block of " << found->size << " bytes at " << (intptr_t) found << std::endl;
-#endif
-            AllocatorBlock* old = found;
-            assert(found != found->next);
-            found = found->next;
-            if (found && found->prev != old) {
-                throw std::runtime_error("Free block " + std::to_string((intptr_t) found) +
-                    " must point back to " + std::to_string((intptr_t) old) + " but instead points to " +
-                    std::to_string((intptr_t) found->prev));
-            }
-        }
        
         if (!found) {
             // We have no free memory big enough.
@@ -848,6 +1547,10 @@ void* Manager::allocate_from(chainid_t chain, size_t bytes) {
                 // We need our factor as much memory as last time, or enough for
                 // the thing we want to allocate
                 new_link_size = std::max(last.length * SCALE_FACTOR, new_link_size);
+                if (first.page_size) {
+                    // Use all of the pages we will get.
+                    new_link_size = ((new_link_size + first.page_size - 1) / first.page_size) * first.page_size;
+                }
                 
 #ifdef debug_manager
                 std::cerr << "Create new link of size " << new_link_size << " bytes" << std::endl;
@@ -882,9 +1585,12 @@ void* Manager::allocate_from(chainid_t chain, size_t bytes) {
             if (!header->first_free) {
                 header->first_free = found;
             }
+            index.insert(found, new_link->offset);
         }
         
         // Now we can allocate (part of) this block.
+        size_t position = index.positions.at(found);
+        index.erase(found);
         
         if (found->size > block_bytes) {
             // We could break the user data off of this block and have some space left over.
@@ -905,6 +1611,7 @@ void* Manager::allocate_from(chainid_t chain, size_t bytes) {
                 // And fix up the end of the linked list
                 header->last_free = second;
             }
+            index.insert(second, position + block_bytes);
         }
         
         // Now we have a free block of the right size. Make it not free.
@@ -961,6 +1668,23 @@ void* Manager::allocate_from_same_chain(void* here, size_t bytes) {
 }
 
 void Manager::preload_chain(chainid_t chain, bool blocking) {
+    scan_chain(chain, [&](const void* link_start, size_t link_length) {
+        // For each link in the chain
+
+#ifdef debug
+        std::cerr << "Preloading link: " << link_start << "-" << (void*)((intptr_t)link_start + link_length) << std::endl;
+#endif
+
+        preload_range(link_start, link_length, blocking);
+    });
+}
+
+void Manager::preload_range(const void* start, size_t length, bool blocking) {
+    if (length == 0) {
+        // Nothing to load
+        return;
+    }
+
     // madvise calls need to be page-aligned, so get the page size
     intptr_t page_size = (intptr_t) getpagesize();
     
@@ -979,105 +1703,248 @@ void Manager::preload_chain(chainid_t chain, bool blocking) {
 #endif
 #endif
 
-    scan_chain(chain, [&](const void* link_start, size_t link_length) {
-        // For each link in the chain
-
+    // Start address for load has to be page-aligned, but length just has to be nonnegative.
+    void* advice_start = (void*) start;
+    size_t advice_length = length;
+    
+    // How much of the first page isn't included?
+    intptr_t before_start_bytes = (intptr_t)advice_start % page_size;
+    
+    // Budge the start left.
+    advice_start = (void*)((intptr_t)advice_start - before_start_bytes);
+    advice_length += before_start_bytes;
+    if (advice_length % page_size != 0) {
+        // And finish out the page
+        advice_length += (page_size - advice_length % page_size);
+    }
+    
 #ifdef debug
-        std::cerr << "Preloading link: " << link_start << "-" << (void*)((intptr_t)link_start + link_length) << std::endl;
+    std::cerr << "Preloading addresses " << advice_start << "-" << (void*)((intptr_t)advice_start + advice_length) << std::endl;
 #endif
+    
+    if (blocking) {
         
-        // Start address for load has to be page-aligned, but length just has to be nonnegative.
-        void* advice_start = (void*) link_start;
-        size_t advice_length = link_length;
-        
-        // How much of the first page isn't included?
-        intptr_t before_start_bytes = (intptr_t)advice_start % page_size;
-        
-        // Budge the start left.
-        advice_start = (void*)((intptr_t)advice_start - before_start_bytes);
-        advice_length += before_start_bytes;
-        if (advice_length % page_size != 0) {
-            // And finish out the page
-            advice_length += (page_size - advice_length % page_size);
-        }
+        if (populate_read_advice) {
+            // Make the call
+            int result = madvise(advice_start, advice_length, populate_read_advice);
         
-#ifdef debug
-        std::cerr << "Preloading addresses " << advice_start << "-" << (void*)((intptr_t)advice_start + advice_length) << std::endl;
-#endif
+            if (result == 0) {
+                // It worked!
+                return;
+            }
         
-        if (blocking) {
-            
-            if (populate_read_advice) {
-                // Make the call
-                int result = madvise(advice_start, advice_length, populate_read_advice);
-            
-                if (result == 0) {
-                    // It worked!
-                    return;
-                }
+            // Otherwise the call failed
+            auto madvise_error = errno;
             
-                // Otherwise the call failed
-                auto madvise_error = errno;
-                
-                switch (madvise_error) {
-                case EINVAL:
-                    // It is possible the advice we used doesn't exist on the
-                    // runtime kernel, which may not be the build kernel or
-                    // batch the build glibc.
-                    // Also possible something weird about the memory range,
-                    // like it being secret to the process, is preventing us
-                    // from using madvise() here even if every byte in the
-                    // range is readable.
-                    // TODO: Figure out why this seems to mostly fail. Until
-                    // then, don't usually warn.
+            switch (madvise_error) {
+            case EINVAL:
+                // It is possible the advice we used doesn't exist on the
+                // runtime kernel, which may not be the build kernel or
+                // batch the build glibc.
+                // Also possible something weird about the memory range,
+                // like it being secret to the process, is preventing us
+                // from using madvise() here even if every byte in the
+                // range is readable.
+                // TODO: Figure out why this seems to mostly fail. Until
+                // then, don't usually warn.
 #ifdef debug
-                    std::cerr << "warning[yomo::Manager::preload_chain] Cannot MADV_POPULATE_READ memory range " << advice_start << "-" << (void*)((intptr_t)advice_start + advice_length) << "; falling back to reading each page: " << strerror(madvise_error) << std::endl;
+                std::cerr << "warning[yomo::Manager::preload_range] Cannot MADV_POPULATE_READ memory range " << advice_start << "-" << (void*)((intptr_t)advice_start + advice_length) << "; falling back to reading each page: " << strerror(madvise_error) << std::endl;
 #endif
-                    break;
-                default:
-                    // Something else weird happened. This is a problem.
-                    throw  std::runtime_error(std::string("Could not prefault memory: ") + std::string(strerror(madvise_error)));
-                    break;
-                }
+                break;
+            default:
+                // Something else weird happened. This is a problem.
+                throw  std::runtime_error(std::string("Could not prefault memory: ") + std::string(strerror(madvise_error)));
+                break;
             }
-            
-            for (size_t page = 0; page < (advice_length / page_size); page++) {
-                volatile const unsigned char* page_start = (volatile const unsigned char*) ((intptr_t)advice_start + page * page_size);
-                // Read first byte of the page
-                (void) *page_start;
+        }
+        
+        for (size_t page = 0; page < (advice_length / page_size); page++) {
+            volatile const unsigned char* page_start = (volatile const unsigned char*) ((intptr_t)advice_start + page * page_size);
+            // Read first byte of the page
+            (void) *page_start;
 #ifdef debug
-                // Dump the page structure
-                std::cerr << "Page at " << (void*)page_start << std::endl;
-                for (size_t i = 0; i < page_size; i++) {
-                    if (*(page_start + i) == 0) {
-                        std::cerr << " ";
-                    } else {
-                        std::cerr << ".";
-                    }
-                    if ((i + 1) % 128 == 0) {
-                        std::cerr << std::endl;
-                    }
+            // Dump the page structure
+            std::cerr << "Page at " << (void*)page_start << std::endl;
+            for (size_t i = 0; i < page_size; i++) {
+                if (*(page_start + i) == 0) {
+                    std::cerr << " ";
+                } else {
+                    std::cerr << ".";
+                }
+                if ((i + 1) % 128 == 0) {
+                    std::cerr << std::endl;
                 }
-                // See if this page in particular doesn't want to madvise in.
-                std::cerr << "Re-advise page: " <<  madvise((void*)page_start, page_size, populate_read_advice) << std::endl;
-#endif
             }
-        } else {
-            // Just tell the memory management subsystem we will want this
-            int result = madvise(advice_start, advice_length, MADV_WILLNEED);
-            
-            if (result == 0) {
-                // It worked!
+            // See if this page in particular doesn't want to madvise in.
+            std::cerr << "Re-advise page: " <<  madvise((void*)page_start, page_size, populate_read_advice) << std::endl;
+#endif
+        }
+    } else {
+        // Just tell the memory management subsystem we will want this
+        int result = madvise(advice_start, advice_length, MADV_WILLNEED);
+        
+        if (result == 0) {
+            // It worked!
+            return;
+        }
+        
+        // Otherwise the call failed
+        auto madvise_error = errno;
+        throw std::runtime_error(std::string("Could not mark memory needed: ") + std::string(strerror(madvise_error)));
+    }
+}
+
+void Manager::advise_chain(chainid_t chain, access_hint_t hint) {
+    
+    // Work out the madvise() advice to give, or bail out if there's nothing
+    // we can do for this hint here.
+    int advice;
+    switch (hint) {
+    case ACCESS_NORMAL:
+        advice = MADV_NORMAL;
+        break;
+    case ACCESS_SEQUENTIAL:
+        advice = MADV_SEQUENTIAL;
+        break;
+    case ACCESS_RANDOM:
+        advice = MADV_RANDOM;
+        break;
+    case ACCESS_WILLNEED:
+        advice = MADV_WILLNEED;
+        break;
+    case ACCESS_DONTNEED:
+        {
+            // MADV_DONTNEED zero-fills private anonymous and heap memory the
+            // next time it is touched, so it is only safe when there is a
+            // file to page the data back in from.
+            std::shared_lock<std::shared_timed_mutex> lock(Manager::mutex);
+            if (!address_space_index.at((intptr_t) chain).fd) {
                 return;
             }
-            
-            // Otherwise the call failed
-            auto madvise_error = errno;
-            throw std::runtime_error(std::string("Could not mark memory needed: ") + std::string(strerror(madvise_error)));
         }
+        advice = MADV_DONTNEED;
+        break;
+    case ACCESS_HUGEPAGE:
+#if !defined(__APPLE__) && defined(MADV_HUGEPAGE)
+        advice = MADV_HUGEPAGE;
+        break;
+#else
+        return;
+#endif
+    case ACCESS_NOHUGEPAGE:
+#if !defined(__APPLE__) && defined(MADV_NOHUGEPAGE)
+        advice = MADV_NOHUGEPAGE;
+        break;
+#else
+        return;
+#endif
+    default:
+        throw std::runtime_error("Unknown access hint: " + std::to_string((int) hint));
+    }
+    
+    // madvise calls need to be page-aligned, so get the page size
+    intptr_t page_size = (intptr_t) getpagesize();
+    
+    scan_chain(chain, [&](const void* link_start, size_t link_length) {
+        // Widen each link out to whole pages. Links come from separate
+        // mappings or allocations, so pages we share with a neighbor just get
+        // the same advice.
+        intptr_t before_start_bytes = (intptr_t)link_start % page_size;
+        void* advice_start = (void*)((intptr_t)link_start - before_start_bytes);
+        size_t advice_length = link_length + before_start_bytes;
+        if (advice_length % page_size != 0) {
+            advice_length += (page_size - advice_length % page_size);
+        }
+        
+        if (madvise(advice_start, advice_length, advice) == 0) {
+            return;
+        }
+        
+        auto madvise_error = errno;
+        if (madvise_error == EINVAL && (hint == ACCESS_HUGEPAGE || hint == ACCESS_NOHUGEPAGE)) {
+            // The running kernel may not have transparent hugepage support,
+            // or may not allow it for this kind of mapping. That's fine.
+            return;
+        }
+        throw std::runtime_error(std::string("Could not advise memory access pattern: ") + std::string(strerror(madvise_error)));
     });
 }
 
+size_t Manager::flush_chain_async(chainid_t chain) {
+    
+    // Get write access to manager data structures, so we can start the next
+    // generation.
+    std::unique_lock<std::shared_timed_mutex> lock(Manager::mutex);
+    
+    LinkRecord& head = address_space_index.at((intptr_t) chain);
+    if (!head.fd || !head.is_writable()) {
+        // There is no file to write to.
+        return 0;
+    }
+    
+    // msync calls need to be page-aligned, so get the page size
+    intptr_t page_size = (intptr_t) getpagesize();
+    
+    // Collect the mapped ranges now. Links are only unmapped when the chain
+    // is destroyed, which waits for us.
+    std::vector<std::pair<void*, size_t>> ranges;
+    for (intptr_t link_addr = (intptr_t) chain; link_addr; ) {
+        LinkRecord& link = address_space_index.at(link_addr);
+        if (link.is_mapped()) {
+            intptr_t start = link.get_mapped_address();
+            intptr_t before_start_bytes = start % page_size;
+            ranges.emplace_back((void*)(start - before_start_bytes), link.get_mapped_length() + before_start_bytes);
+        }
+        link_addr = link.next;
+    }
+    
+    int fd = head.fd;
+    std::shared_future<void> previous = head.pending_flush;
+    head.pending_flush = std::async(std::launch::async, [ranges, fd, previous]() {
+        if (previous.valid()) {
+            // Keep checkpoints in order. If the last one failed, this one
+            // writes everything it would have.
+            previous.wait();
+        }
+        for (auto& range : ranges) {
+            if (msync(range.first, range.second, MS_SYNC)) {
+                throw std::runtime_error("Could not write memory back to file: " + std::string(strerror(errno)));
+            }
+        }
+        // Make sure the file's size gets there too.
+        if (fsync(fd)) {
+            throw std::runtime_error("Could not sync file: " + std::string(strerror(errno)));
+        }
+    }).share();
+    
+    return ++head.flush_generation;
+}
+
+size_t Manager::wait_for_flush(chainid_t chain) {
+    std::shared_future<void> flush;
+    size_t generation;
+    {
+        // Get read access to manager data structures
+        std::shared_lock<std::shared_timed_mutex> lock(Manager::mutex);
+        LinkRecord& head = address_space_index.at((intptr_t) chain);
+        flush = head.pending_flush;
+        generation = head.flush_generation;
+    }
+    
+    if (flush.valid()) {
+        // Wait without holding any locks, and pass along any error.
+        flush.get();
+    }
+    return generation;
+}
+
+size_t Manager::flush_chain(chainid_t chain) {
+    if (!flush_chain_async(chain)) {
+        return 0;
+    }
+    return wait_for_flush(chain);
+}
+
 void Manager::deallocate(void* address) {
 #ifdef debug_manager
     std::cerr << "Deallocate at " << address << std::endl;
@@ -1099,6 +1966,7 @@ void Manager::deallocate(void* address) {
     }
     
     // Otherwise this really is in a chain.
+    BDSG_COUNT_EVENT(MANAGER_DEALLOCATE);
     
     // Find the block
     AllocatorBlock* found = AllocatorBlock::get_from_data(address);
@@ -1120,19 +1988,13 @@ void Manager::deallocate(void* address) {
             // This is free already!
             throw std::runtime_error("Detected double-free!");
         }
+        
+        FreeBlockIndex& index = get_free_block_index(chain, header);
        
         // Find the block in the free list after it, if any
-        AllocatorBlock* right = header->first_free;
-        
-        while(right && Manager::get_chain_and_position(right).second < Manager::get_chain_and_position(found).second) {
-            // We have a free block, but it occurs before the block being freed in the chain.
-            // TODO: can we save chain lookups here somehow?
-            // Go to the next free block, or off the end if that was the last one.
-#ifdef debug_manager
-            std::cerr << "\tComes after block " << (intptr_t)right << " in chain space" << std::endl;
-#endif
-            right = right->next;
-        }
+        size_t position = Manager::get_chain_and_position(found).second;
+        auto after = index.by_position.upper_bound(position);
+        AllocatorBlock* right = (after == index.by_position.end()) ? nullptr : after->second;
         AllocatorBlock* left;
         if (!right) {
             // The new block should be the last block in the list.
@@ -1160,8 +2022,25 @@ void Manager::deallocate(void* address) {
             header->first_free = found;
         }
         
+        // Take the free neighbors that will be merged with it out of the index,
+        // since their sizes are about to change.
+        auto abuts = [](AllocatorBlock* a, AllocatorBlock* b) {
+            return (char*) a->get_user_data() + a->size == (char*) b;
+        };
+        AllocatorBlock* run_start = found;
+        while (run_start->prev && abuts(run_start->prev, run_start)) {
+            run_start = run_start->prev;
+        }
+        size_t run_position = run_start == found ? position : index.positions.at(run_start);
+        for (AllocatorBlock* block = run_start; block; block = (block->next && abuts(block, block->next)) ? block->next.get() : nullptr) {
+            if (block != found) {
+                index.erase(block);
+            }
+        }
+        
         // Defragment.
         auto bounds = found->coalesce();
+        index.insert(bounds.first, run_position);
         // We can't need to update the first free when defragmenting, but we may
         // need to update the last free.
         if (header->last_free == bounds.second) {
@@ -1327,7 +2206,16 @@ void Manager::with_allocator_header(chainid_t chain,
     
     {
         // Get exclusive access to the allocator
-        std::unique_lock<std::mutex> lock(*(first->allocator_mutex));
+        std::unique_lock<std::mutex> lock(*(first->allocator_mutex), std::defer_lock);
+#ifdef BDSG_PERF_COUNTERS
+        if (!lock.try_lock()) {
+            // Someone else has it, so time how long we wait.
+            BDSG_TIME_EVENT(MANAGER_LOCK_WAIT);
+            lock.lock();
+        }
+#else
+        lock.lock();
+#endif
         
         // Run the callback with lock protection
         callback(header);
@@ -1346,6 +2234,17 @@ size_t Manager::reclaim_tail(chainid_t chain) {
         return 0;
     }
     
+    {
+        // Get read access to manager data structures
+        std::shared_lock<std::shared_timed_mutex> lock(Manager::mutex);
+        if (!Manager::address_space_index.at((intptr_t) chain).allocator_connected) {
+            // This is something like a file of the wrong type that we are
+            // giving up on, so there are no free blocks to look for and we
+            // must not change it.
+            return 0;
+        }
+    }
+    
     // Get the past-end position in the chain, and use that as our cursor to walk backward.
     size_t first_unused_byte = get_chain_size(chain);
     
@@ -1353,6 +2252,7 @@ size_t Manager::reclaim_tail(chainid_t chain) {
     size_t reclaimed_bytes = 0;
     
     with_allocator_header(chain, [&](AllocatorHeader* header) {
+        FreeBlockIndex& index = get_free_block_index(chain, header);
         while (header->last_free) {
             // For each free block, end to start
             AllocatorBlock* last_free = header->last_free;
@@ -1375,6 +2275,7 @@ size_t Manager::reclaim_tail(chainid_t chain) {
                 
                 // Remove the block from the free list. We have to update the
                 // header pointers ourselves.
+                index.erase(last_free);
                 auto connected = last_free->detach();
                 header->last_free = connected.first;
                 if (header->first_free == last_free) {
@@ -1406,6 +2307,28 @@ size_t Manager::reclaim_tail(chainid_t chain) {
     return reclaimed_bytes;
 }
 
+Manager::FreeBlockIndex& Manager::get_free_block_index(chainid_t chain, AllocatorHeader* header) {
+    
+    assert(chain != NO_CHAIN);
+    
+    LinkRecord* first;
+    {
+        // Get read access to manager data structures
+        std::shared_lock<std::shared_timed_mutex> lock(Manager::mutex);
+        first = &address_space_index.at((intptr_t) chain);
+    }
+    
+    if (!first->free_index) {
+        // Index the free list that is already in the chain
+        first->free_index = std::make_unique<FreeBlockIndex>();
+        for (AllocatorBlock* block = header->first_free; block; block = block->next) {
+            first->free_index->insert(block, get_chain_and_position(block).second);
+        }
+    }
+    
+    return *first->free_index;
+}
+
 void Manager::check_heap_integrity(chainid_t chain) {
      if (chain == NO_CHAIN) {
         // Nothing to scan.
@@ -1445,6 +2368,24 @@ void Manager::check_heap_integrity(chainid_t chain) {
                 " but the chain only has " + std::to_string(first_unused_byte) +
                 " bytes in it. Is the backing file truncated?");
         }
+        
+        // The free block index must agree with the free list.
+        FreeBlockIndex& index = get_free_block_index(chain, header);
+        size_t free_blocks = 0;
+        for (AllocatorBlock* block = header->first_free; block; block = block->next) {
+            auto found = index.positions.find(block);
+            if (found == index.positions.end() || found->second != get_chain_and_position(block).second ||
+                !index.classes[FreeBlockIndex::size_class(block->size)].count(block)) {
+                throw std::runtime_error("The free block at offset " + std::to_string(get_chain_and_position(block).second) +
+                    " in chain " + std::to_string(chain) + " is not indexed correctly");
+            }
+            ++free_blocks;
+        }
+        if (free_blocks != index.positions.size() || free_blocks != index.by_position.size()) {
+            throw std::runtime_error("The free block index for chain " + std::to_string(chain) +
+                " has " + std::to_string(index.positions.size()) + " blocks but the free list has " +
+                std::to_string(free_blocks));
+        }
     });
 }
 
@@ -1464,7 +2405,7 @@ size_t Manager::count_links() {
     return address_space_index.size();
 }
 
-std::pair<Manager::chainid_t, bool> Manager::open_chain(int fd, size_t start_size, void* link_data) {
+std::pair<Manager::chainid_t, bool> Manager::open_chain(int fd, size_t start_size, void* link_data, page_kind_t pages) {
 
     // Set up our return value
     std::pair<chainid_t, bool> to_return;
@@ -1529,7 +2470,12 @@ std::pair<Manager::chainid_t, bool> Manager::open_chain(int fd, size_t start_siz
         
         // TODO: when MIO gets anonymous mapping support, use that.
         
-        if (!link_data) {
+        record.page_size = link_data ? 0 : get_page_size(pages);
+        if (record.page_size) {
+            // Map pages of our own
+            record.map_anonymous(start_size, record.page_size);
+            link_data = (void*) record.get_mapped_address();
+        } else if (!link_data) {
             // Allocate our own link
             link_data = malloc(start_size);
         }
@@ -1565,6 +2511,8 @@ std::pair<Manager::chainid_t, bool> Manager::open_chain(int fd, size_t start_siz
         
         // Save the chain space record that says the chain starts at this link
         chain_space_index[chain_id][0] = mapping_address;
+        
+        publish_link_table();
     }
     
     return to_return;
@@ -1631,6 +2579,7 @@ std::pair<void*, size_t> Manager::get_address_and_length_in_chain(chainid_t chai
 
 Manager::LinkRecord& Manager::add_link(LinkRecord& head, size_t new_bytes, void* link_data) {
     // Assume we're already locked.
+    BDSG_COUNT_EVENT(MANAGER_CHAIN_GROWTH);
     
     // What used to be the last link?
     LinkRecord& old_tail = Manager::address_space_index.at(head.last);
@@ -1662,7 +2611,11 @@ Manager::LinkRecord& Manager::add_link(LinkRecord& head, size_t new_bytes, void*
         // Find its address
         mapping_address = new_tail.get_mapped_address();
     } else {
-        if (!link_data) {
+        if (!link_data && head.page_size) {
+            // Map pages of our own
+            new_tail.map_anonymous(new_bytes, head.page_size);
+            link_data = (void*) new_tail.get_mapped_address();
+        } else if (!link_data) {
             // Allocate our own link
             link_data = malloc(new_bytes);
         }
@@ -1690,10 +2643,12 @@ Manager::LinkRecord& Manager::add_link(LinkRecord& head, size_t new_bytes, void*
     head.last = mapping_address;
     head.total_size += new_bytes;
     
+    publish_link_table();
+    
     return where;
 }
 
-Manager::chainid_t Manager::copy_chain(chainid_t chain, int fd) {
+Manager::chainid_t Manager::copy_chain(chainid_t chain, int fd, page_kind_t pages) {
 
     assert(chain != NO_CHAIN);
 
@@ -1726,7 +2681,7 @@ Manager::chainid_t Manager::copy_chain(chainid_t chain, int fd) {
     }
     
     // Make the new chain with the appropriate size hint.
-    std::pair<chainid_t, bool> chain_info = open_chain(fd, total_size);
+    std::pair<chainid_t, bool> chain_info = open_chain(fd, total_size, nullptr, pages);
     auto& new_chain = chain_info.first;
     auto& had_data = chain_info.second;
     
@@ -1851,6 +2806,7 @@ void Manager::connect_allocator_at(chainid_t chain, size_t offset) {
         LinkRecord& head = Manager::address_space_index.at((intptr_t) chain);
         // Save the allocator position
         head.prefix_size = offset;
+        head.allocator_connected = true;
     }
     
     if (check_chains) {
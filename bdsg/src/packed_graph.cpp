@@ -3,6 +3,7 @@
 //
 
 #include "bdsg/packed_graph.hpp"
+#include "bdsg/hash_graph.hpp"
 
 #include <handlegraph/util.hpp>
 #include <atomic>
@@ -19,6 +20,24 @@ namespace bdsg {
         return &implementation;
     }
     
+    MemoryBreakdown PackedGraph::memory_breakdown() const {
+        MemoryBreakdown breakdown = implementation.memory_breakdown();
+        breakdown.name = "PackedGraph";
+        return breakdown;
+    }
+    
+    PackedGraph PackedGraph::from(const HashGraph& other) {
+        PackedGraph converted;
+        converted.implementation.assign_graph(other);
+        return converted;
+    }
+    
+    PackedGraph PackedGraph::from(const MappedPackedGraph& other) {
+        PackedGraph converted;
+        converted.implementation.assign(*other.get());
+        return converted;
+    }
+    
     BasePackedGraph<MappedBackend>* MappedPackedGraph::get() {
         return implementation.get();
     }
@@ -56,10 +75,67 @@ namespace bdsg {
         return *this;
     }
     
+    MappedPackedGraph MappedPackedGraph::from(const PackedGraph& other) {
+        MappedPackedGraph converted;
+        converted.get()->assign(other.implementation);
+        return converted;
+    }
+    
+    MappedPackedGraph MappedPackedGraph::from(const HashGraph& other) {
+        MappedPackedGraph converted;
+        converted.get()->assign_graph(other);
+        return converted;
+    }
+    
     void MappedPackedGraph::dissociate() {
         implementation.dissociate();
     }
     
+    void MappedPackedGraph::dissociate(yomo::Manager::page_kind_t pages) {
+        implementation.dissociate(pages);
+    }
+    
+    void MappedPackedGraph::snapshot(const MappedPackedGraph& other) {
+        if (&other != this) {
+            implementation.snapshot(other.implementation);
+        }
+    }
+    
+    void MappedPackedGraph::compact() {
+        implementation.compact(get_prefix());
+    }
+    
+    void MappedPackedGraph::preload(bool blocking) const {
+        implementation.preload(blocking);
+    }
+    
+    void MappedPackedGraph::advise(yomo::Manager::access_hint_t hint) const {
+        implementation.advise(hint);
+    }
+    
+    size_t MappedPackedGraph::checkpoint(bool blocking) {
+        return implementation.checkpoint(blocking);
+    }
+    
+    MemoryBreakdown MappedPackedGraph::memory_breakdown() const {
+        MemoryBreakdown breakdown = implementation->memory_breakdown();
+        breakdown.name = "MappedPackedGraph";
+        
+        size_t total, free, reclaimable;
+        std::tie(total, free, reclaimable) = implementation.get_usage();
+        
+        // everything in the chain that isn't a component or free is allocator
+        // bookkeeping and the graph object itself
+        size_t used = total - free;
+        breakdown.add("chain overhead", used > breakdown.bytes ? used - breakdown.bytes : 0);
+        MemoryBreakdown free_breakdown("chain free space");
+        free_breakdown.add("interior", free - reclaimable);
+        free_breakdown.add("reclaimable when closed", reclaimable);
+        breakdown.add(free_breakdown);
+        
+        return breakdown;
+    }
+    
     void MappedPackedGraph::serialize(const std::function<void(const void*, size_t)>& iteratee) const {
         // Pass the same iteratee back to the implementation pointer.
         implementation.save(iteratee);
@@ -84,8 +160,12 @@ namespace bdsg {
     }
     
     uint32_t MappedPackedGraph::get_magic_number() const {
-        // Chosen by fair dice roll, guaranteed to be magic.
-        return 672226447;
+        // Chosen by fair dice roll, guaranteed to be magic. Was 672226447
+        // before the mapped layout gained 2-bit packed sequences, incremental
+        // defragmentation state, the single-stranded flag, the path name and
+        // metadata indexes, and the sparse ID to record map, so files from
+        // before then are refused instead of being misread.
+        return 672226448;
     }
     
     std::string MappedPackedGraph::get_prefix() const {
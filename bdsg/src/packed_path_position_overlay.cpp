@@ -7,10 +7,16 @@
 
 namespace bdsg {
 
-PackedPositionOverlay::PackedPositionOverlay(const PathHandleGraph* graph, size_t steps_per_index) : graph(graph), steps_per_index(steps_per_index) {
+PackedPositionOverlay::PackedPositionOverlay(const PathHandleGraph* graph, size_t steps_per_index,
+                                             size_t concurrent_indexes, bool low_memory) :
+    graph(graph), steps_per_index(steps_per_index), concurrent_indexes(concurrent_indexes), low_memory(low_memory) {
     index_path_positions();
 }
 
+void PackedPositionOverlay::set_graph(const PathHandleGraph* graph) {
+    this->graph = graph;
+}
+
 bool PackedPositionOverlay::has_node(nid_t node_id) const {
     return graph->has_node(node_id);
 }
@@ -150,13 +156,7 @@ bool PackedPositionOverlay::for_each_step_on_handle_impl(const handle_t& handle,
 
 size_t PackedPositionOverlay::get_path_length(const path_handle_t& path_handle) const {
     const auto& range = path_range.at(as_integer(path_handle));
-    if (range.start == range.end) {
-        return 0;
-    }
-    step_handle_t step;
-    as_integers(step)[0] = indexes[range.index_number].steps_0.get(range.end - 1);
-    as_integers(step)[1] = indexes[range.index_number].steps_1.get(range.end - 1);
-    return indexes[range.index_number].positions.get(range.end - 1) + get_length(get_handle_of_step(step));
+    return path_length_in(indexes[range.index_number], range);
 }
 
 size_t PackedPositionOverlay::get_position_of_step(const step_handle_t& step) const {
@@ -166,12 +166,7 @@ size_t PackedPositionOverlay::get_position_of_step(const step_handle_t& step) co
     }
     else {
         auto& range = path_range.at(as_integer(path));
-        const boomphf::mphf<step_handle_t, StepHash>& const_step_hash = indexes[range.index_number].step_hash.back();
-        // We can't use the lookup function on a const mphf, because it isn't
-        // marked const. But it is thread safe and really ought to be const. So
-        // we cast away the const here.
-        boomphf::mphf<step_handle_t, StepHash>& step_hash = const_cast<boomphf::mphf<step_handle_t, StepHash>&>(const_step_hash);
-        return indexes[range.index_number].step_positions.get(step_hash.lookup(step));
+        return position_in(indexes[range.index_number], step);
     }
 }
 
@@ -179,18 +174,69 @@ step_handle_t PackedPositionOverlay::get_step_at_position(const path_handle_t& p
                                                           const size_t& position) const {
     
     const auto& range = path_range.at(as_integer(path));
+    const PathIndex& index = indexes[range.index_number];
     
     // check if position it outside the range (handles edge case of an empty path too)
-    if (position >= get_path_length(path)) {
+    if (position >= path_length_in(index, range)) {
         return path_end(path);
     }
     
+    return step_at_position_in(index, range, position);
+}
+
+void PackedPositionOverlay::get_steps_at_positions(const path_handle_t& path,
+                                                   const vector<size_t>& sorted_positions,
+                                                   vector<step_handle_t>& out) const {
+    const auto& range = path_range.at(as_integer(path));
+    steps_at_positions_in(indexes[range.index_number], range, path_end(path), sorted_positions, out);
+}
+
+void PackedPositionOverlay::get_positions_of_steps(const path_handle_t& path,
+                                                   const vector<step_handle_t>& steps,
+                                                   vector<size_t>& out) const {
+    
+    out.resize(steps.size());
+    
+    // look everything up for the path just once
+    const auto& range = path_range.at(as_integer(path));
+    const PathIndex& index = indexes[range.index_number];
+    step_handle_t end = path_end(path);
+    for (size_t i = 0; i < steps.size(); i++) {
+        if (steps[i] == end) {
+            out[i] = path_length_in(index, range);
+        }
+        else {
+            out[i] = position_in(index, steps[i]);
+        }
+    }
+}
+
+size_t PackedPositionOverlay::path_length_in(const PathIndex& index, const PathRange& range) const {
+    if (range.start == range.end) {
+        return 0;
+    }
+    step_handle_t step;
+    as_integers(step)[0] = index.steps_0.get(range.end - 1);
+    as_integers(step)[1] = index.steps_1.get(range.end - 1);
+    return index.positions.get(range.end - 1) + get_length(get_handle_of_step(step));
+}
+
+size_t PackedPositionOverlay::position_in(const PathIndex& index, const step_handle_t& step) const {
+    // We can't use the lookup function on a const mphf, because it isn't
+    // marked const. But it is thread safe and really ought to be const. So
+    // we cast away the const here.
+    auto& step_hash = const_cast<boomphf::mphf<step_handle_t, StepHash>&>(index.step_hash.back());
+    return index.step_positions.get(step_hash.lookup(step));
+}
+
+step_handle_t PackedPositionOverlay::step_at_position_in(const PathIndex& index, const PathRange& range,
+                                                         size_t position) const {
     // bisect search within the range to find the index with the steps
     size_t low = range.start;
     size_t hi = range.end;
     while (hi > low + 1) {
         size_t mid = (hi + low) / 2;
-        if (position < indexes[range.index_number].positions.get(mid)) {
+        if (position < index.positions.get(mid)) {
             hi = mid;
         }
         else {
@@ -200,25 +246,228 @@ step_handle_t PackedPositionOverlay::get_step_at_position(const path_handle_t& p
     
     // unpack the integers at the same index into a step
     step_handle_t step;
-    as_integers(step)[0] = indexes[range.index_number].steps_0.get(low);
-    as_integers(step)[1] = indexes[range.index_number].steps_1.get(low);
+    as_integers(step)[0] = index.steps_0.get(low);
+    as_integers(step)[1] = index.steps_1.get(low);
     return step;
 }
 
+void PackedPositionOverlay::steps_at_positions_in(const PathIndex& index, const PathRange& range,
+                                                  const step_handle_t& end,
+                                                  const vector<size_t>& sorted_positions,
+                                                  vector<step_handle_t>& out) const {
+    
+    out.resize(sorted_positions.size());
+    
+    size_t path_length = path_length_in(index, range);
+    
+    // the index of a step that starts at or before the previous position
+    size_t cursor = range.start;
+    for (size_t i = 0; i < sorted_positions.size(); i++) {
+        const size_t& position = sorted_positions[i];
+        if (position >= path_length) {
+            // handles edge case of an empty path too
+            out[i] = end;
+            continue;
+        }
+        if (index.positions.get(cursor) > position) {
+            // the positions are out of order, so start over
+            cursor = range.start;
+        }
+        
+        // gallop forward from the cursor to bracket the position, so that
+        // nearby positions only cost a few steps and far ones a search
+        size_t low = cursor;
+        size_t hi = cursor + 1;
+        size_t stride = 1;
+        while (hi < range.end && index.positions.get(hi) <= position) {
+            low = hi;
+            stride *= 2;
+            hi = low + stride;
+        }
+        hi = std::min(hi, range.end);
+        
+        // bisect search within the bracket to find the index with the step
+        while (hi > low + 1) {
+            size_t mid = (hi + low) / 2;
+            if (position < index.positions.get(mid)) {
+                hi = mid;
+            }
+            else {
+                low = mid;
+            }
+        }
+        cursor = low;
+        
+        // unpack the integers at the same index into a step
+        as_integers(out[i])[0] = index.steps_0.get(low);
+        as_integers(out[i])[1] = index.steps_1.get(low);
+    }
+}
+
 handle_t PackedPositionOverlay::get_underlying_handle(const handle_t& handle) const {
     return handle;
 }
 
-void PackedPositionOverlay::index_path_positions() {
+MemoryBreakdown PackedPositionOverlay::memory_breakdown() const {
+    
+    size_t steps_mem = 0, positions_mem = 0, step_hash_mem = 0, step_positions_mem = 0;
+    for (const PathIndex& index : indexes) {
+        steps_mem += index.steps_0.memory_usage() + index.steps_1.memory_usage();
+        positions_mem += index.positions.memory_usage();
+        for (const auto& step_hash : index.step_hash) {
+            // BBHash won't measure itself in a const context
+            step_hash_mem += const_cast<boomphf::mphf<step_handle_t, StepHash>&>(step_hash).totalBitSize() / 8;
+        }
+        step_positions_mem += index.step_positions.memory_usage();
+    }
+    
+    MemoryBreakdown index_breakdown("indexes");
+    index_breakdown.add("steps", steps_mem);
+    index_breakdown.add("positions", positions_mem);
+    index_breakdown.add("step_hash", step_hash_mem);
+    index_breakdown.add("step_positions", step_positions_mem);
+    index_breakdown.add("vector overhead", sizeof(indexes) + indexes.capacity() * sizeof(PathIndex));
+    
+    MemoryBreakdown breakdown("PackedPositionOverlay");
+    breakdown.add(index_breakdown);
+    breakdown.add("path_range", sizeof(path_range) + path_range.bucket_count() * sizeof(typename decltype(path_range)::value_type));
+    return breakdown;
+}
+
+uint32_t PackedPositionOverlay::get_magic_number() const {
+    return 3771487542ul;
+}
+
+void PackedPositionOverlay::serialize_members(ostream& out) const {
+    sdsl::write_member(steps_per_index, out);
+    
+    size_t index_count = indexes.size();
+    sdsl::write_member(index_count, out);
+    for (const PathIndex& index : indexes) {
+        index.serialize(out);
+    }
+    
+    size_t range_count = path_range.size();
+    sdsl::write_member(range_count, out);
+    for (const auto& record : path_range) {
+        sdsl::write_member(record.first, out);
+        sdsl::write_member(record.second.index_number, out);
+        sdsl::write_member(record.second.start, out);
+        sdsl::write_member(record.second.end, out);
+    }
+}
+
+void PackedPositionOverlay::deserialize_members(istream& in) {
+    if (graph == nullptr) {
+        throw std::runtime_error("error:[PackedPositionOverlay] backing graph must be set before loading indexes");
+    }
+    
+    sdsl::read_member(steps_per_index, in);
+    
+    size_t index_count;
+    sdsl::read_member(index_count, in);
+    indexes.clear();
+    this->set_index_count(index_count);
+    for (PathIndex& index : indexes) {
+        index.deserialize(in);
+    }
+    
+    size_t range_count;
+    sdsl::read_member(range_count, in);
+    path_range.clear();
+    path_range.reserve(range_count);
+    for (size_t i = 0; i < range_count; i++) {
+        int64_t path;
+        PathRange range;
+        sdsl::read_member(path, in);
+        sdsl::read_member(range.index_number, in);
+        sdsl::read_member(range.start, in);
+        sdsl::read_member(range.end, in);
+        path_range.emplace(path, range);
+    }
+    
+    if (!in) {
+        throw std::runtime_error("error:[PackedPositionOverlay] could not read indexes from stream");
+    }
+    
+    check_path_ranges();
+}
+
+void PackedPositionOverlay::check_path_ranges() const {
+    // We can't afford to check every step, but a graph with different paths
+    // or handles will almost surely disagree at the ends of the paths.
+    // The indexes may have been built on only some of the paths.
+    if (path_range.size() > graph->get_path_count()) {
+        throw std::runtime_error("error:[PackedPositionOverlay] loaded indexes have more paths than the backing graph");
+    }
+    for (const auto& record : path_range) {
+        path_handle_t path_handle = as_path_handle(record.first);
+        const PathRange& range = record.second;
+        if (range.index_number >= indexes.size() || range.end < range.start
+            || range.end > indexes[range.index_number].steps_0.size()
+            || range.end - range.start != graph->get_step_count(path_handle)) {
+            throw std::runtime_error("error:[PackedPositionOverlay] loaded indexes do not match the paths of the backing graph");
+        }
+        if (range.start != range.end) {
+            step_handle_t front, back;
+            const PathIndex& index = indexes[range.index_number];
+            as_integers(front)[0] = index.steps_0.get(range.start);
+            as_integers(front)[1] = index.steps_1.get(range.start);
+            as_integers(back)[0] = index.steps_0.get(range.end - 1);
+            as_integers(back)[1] = index.steps_1.get(range.end - 1);
+            if (front != graph->path_begin(path_handle) || back != graph->path_back(path_handle)) {
+                throw std::runtime_error("error:[PackedPositionOverlay] loaded indexes do not match the steps of the backing graph");
+            }
+        }
+    }
+}
+
+void PackedPositionOverlay::PathIndex::serialize(ostream& out) const {
+    steps_0.serialize(out);
+    steps_1.serialize(out);
+    positions.serialize(out);
+    size_t hash_count = step_hash.size();
+    sdsl::write_member(hash_count, out);
+    for (const auto& hash : step_hash) {
+        hash.save(out);
+    }
+    step_positions.serialize(out);
+}
+
+void PackedPositionOverlay::PathIndex::deserialize(istream& in) {
+    steps_0.deserialize(in);
+    steps_1.deserialize(in);
+    positions.deserialize(in);
+    size_t hash_count;
+    sdsl::read_member(hash_count, in);
+    step_hash.clear();
+    step_hash.resize(hash_count);
+    for (auto& hash : step_hash) {
+        hash.load(in);
+    }
+    step_positions.deserialize(in);
+}
+
+void PackedPositionOverlay::index_path_positions(const std::unordered_set<PathSense>* senses,
+                                                 const std::unordered_set<std::string>* samples,
+                                                 const std::unordered_set<std::string>* loci) {
     
     // I'm not sure how to pass handles to OMP tasks by value, when we'd return
     // out of the functions that created the tasks and are holding the tasks'
     // locals. So first we'll collect all the path handles.
     // TODO: deduplicate with BBHashHelper's copy of all the path handles?
     std::vector<path_handle_t> path_handles;
-    for_each_path_handle([&](const path_handle_t& path_handle) {
-        path_handles.push_back(path_handle);
-    });
+    if (senses != nullptr || samples != nullptr || loci != nullptr) {
+        // only index the selected paths
+        graph->for_each_path_matching(senses, samples, loci, [&](const path_handle_t& path_handle) {
+            path_handles.push_back(path_handle);
+        });
+    }
+    else {
+        for_each_path_handle([&](const path_handle_t& path_handle) {
+            path_handles.push_back(path_handle);
+        });
+    }
     
     // Then get the lengths of all the paths
     std::vector<size_t> path_lengths(path_handles.size(), 0);
@@ -280,7 +529,20 @@ void PackedPositionOverlay::index_path_positions() {
         std::cerr << "Using " << indexes.size() << " indexes" << std::endl;
 #endif
     
-    #pragma omp parallel for
+    // Decide how many indexes to build at once, and give each of them an
+    // equal share of the threads for building its hash functions. Otherwise
+    // the hash builds would only get the single thread of a nested team.
+    size_t thread_count = get_thread_count();
+    size_t concurrent = concurrent_indexes == 0 ? thread_count : concurrent_indexes;
+    concurrent = std::max<size_t>(1, std::min(concurrent, path_set_steps.size()));
+    threads_per_index = std::max<size_t>(1, thread_count / concurrent);
+    
+#ifdef debug
+    #pragma omp critical (cerr)
+    std::cerr << "Building " << concurrent << " indexes at a time with " << threads_per_index << " threads each" << std::endl;
+#endif
+    
+    #pragma omp parallel for num_threads(concurrent) schedule(dynamic, 1)
     for (size_t i = 0; i < path_set_steps.size(); i++) {
         // For each set of paths to index together
         std::vector<path_handle_t>::const_iterator begin_path = path_handles.cbegin() + bounds[i];
@@ -296,6 +558,13 @@ void PackedPositionOverlay::index_path_positions() {
     
 }
 
+float PackedPositionOverlay::hash_keys_cached() const {
+    // BBHash's default is to keep 3% of the keys in memory, so it can skip
+    // re-reading the input on its later passes. With none, it only ever
+    // re-streams the steps.
+    return low_memory ? 0.0 : 0.03;
+}
+
 size_t PackedPositionOverlay::scan_path(const path_handle_t& path_handle, void*& user_data) {
     user_data = nullptr;
     return get_step_count(path_handle);
@@ -321,8 +590,7 @@ void PackedPositionOverlay::index_paths(size_t index_num, const std::vector<path
 #endif
     
     // Make a perfect minimal hash over the step handles on the selected paths
-    // Use the number of threads a child OMP team would get.
-    index.step_hash.emplace_back(cumul_path_size, BBHashHelper(graph, begin_path, end_path), get_thread_count(), 2.0, false, false);
+    index.step_hash.emplace_back(cumul_path_size, BBHashHelper(graph, begin_path, end_path), threads_per_index, 2.0, false, false, hash_keys_cached());
     
     // Walk a cursor through steps among the path set
     size_t step_overall = 0;
@@ -3,18 +3,23 @@
 
 #include "bdsg/internal/utility.hpp"
 
+#include <algorithm>
+
 #include <omp.h> // BINDER_IGNORE because Binder can't find this
 
 //#define debug
 
 namespace bdsg {
 
-PackedReferencePathOverlay::PackedReferencePathOverlay(const PathHandleGraph* graph, size_t steps_per_index) : PackedPositionOverlay() {
+PackedReferencePathOverlay::PackedReferencePathOverlay(const PathHandleGraph* graph, size_t steps_per_index,
+                                                       size_t concurrent_indexes, bool low_memory) : PackedPositionOverlay() {
     // We can't just chain to the base class constructor with these arguments
     // because we need virtual methods in this class to be available before the
     // index build starts.
     this->graph = graph;
     this->steps_per_index = steps_per_index;
+    this->concurrent_indexes = concurrent_indexes;
+    this->low_memory = low_memory;
 
     // Now do the index build
     index_path_positions();
@@ -23,6 +28,22 @@ PackedReferencePathOverlay::PackedReferencePathOverlay(const PathHandleGraph* gr
     this->last_step_to_path_idx.resize(get_thread_count(), 0);
 }
 
+PackedReferencePathOverlay::PackedReferencePathOverlay(const PathHandleGraph* graph, const std::unordered_set<PathSense>* senses,
+                                                       const std::unordered_set<std::string>* samples,
+                                                       const std::unordered_set<std::string>* loci,
+                                                       size_t steps_per_index, size_t concurrent_indexes,
+                                                       bool low_memory) : PackedPositionOverlay() {
+    // See the other constructor for why we can't chain
+    this->graph = graph;
+    this->steps_per_index = steps_per_index;
+    this->concurrent_indexes = concurrent_indexes;
+    this->low_memory = low_memory;
+
+    index_path_positions(senses, samples, loci);
+
+    this->last_step_to_path_idx.resize(get_thread_count(), 0);
+}
+
 path_handle_t PackedReferencePathOverlay::get_path_handle_of_step(const step_handle_t& step_handle) const {
     // this index-scanning logic mimics that in for_each_step_on_handle_impl below
     // (tradeoff of parallel construction vs faster lookup)
@@ -51,6 +72,104 @@ path_handle_t PackedReferencePathOverlay::get_path_handle_of_step(const step_han
     return this->graph->get_path_handle_of_step(step_handle);
 }
 
+MemoryBreakdown PackedReferencePathOverlay::memory_breakdown() const {
+    
+    size_t node_hash_mem = 0, visit_ranks_mem = 0, step_hash_mem = 0, step_to_path_mem = 0, step_to_step_mem = 0;
+    for (const PathVisitIndex& visit_index : visit_indexes) {
+        for (const auto& node_hash : visit_index.node_hash) {
+            node_hash_mem += const_cast<boomphf::mphf<nid_t, boomphf::SingleHashFunctor<nid_t>>&>(node_hash).totalBitSize() / 8;
+        }
+        visit_ranks_mem += visit_index.visit_ranks.memory_usage() + visit_index.visit_ranks_start.memory_usage()
+            + visit_index.visit_ranks_length.memory_usage();
+        for (const auto& step_hash : visit_index.step_hash) {
+            step_hash_mem += const_cast<boomphf::mphf<step_handle_t, StepHash>&>(step_hash).totalBitSize() / 8;
+        }
+        step_to_path_mem += visit_index.step_to_path.memory_usage();
+        step_to_step_mem += visit_index.step_to_step1.memory_usage() + visit_index.step_to_step2.memory_usage();
+    }
+    
+    MemoryBreakdown visit_breakdown("visit_indexes");
+    visit_breakdown.add("node_hash", node_hash_mem);
+    visit_breakdown.add("visit_ranks", visit_ranks_mem);
+    visit_breakdown.add("step_hash", step_hash_mem);
+    visit_breakdown.add("step_to_path", step_to_path_mem);
+    visit_breakdown.add("step_to_step", step_to_step_mem);
+    visit_breakdown.add("vector overhead", sizeof(visit_indexes) + visit_indexes.capacity() * sizeof(PathVisitIndex));
+    
+    MemoryBreakdown breakdown = PackedPositionOverlay::memory_breakdown();
+    breakdown.name = "PackedReferencePathOverlay";
+    breakdown.add(visit_breakdown);
+    breakdown.add("last_step_to_path_idx", last_step_to_path_idx.capacity() * sizeof(size_t));
+    return breakdown;
+}
+
+uint32_t PackedReferencePathOverlay::get_magic_number() const {
+    return 1459003702ul;
+}
+
+void PackedReferencePathOverlay::serialize_members(ostream& out) const {
+    PackedPositionOverlay::serialize_members(out);
+    for (const PathVisitIndex& visit_index : visit_indexes) {
+        visit_index.serialize(out);
+    }
+}
+
+void PackedReferencePathOverlay::deserialize_members(istream& in) {
+    // This sizes our indexes along with the base class's
+    PackedPositionOverlay::deserialize_members(in);
+    for (PathVisitIndex& visit_index : visit_indexes) {
+        visit_index.deserialize(in);
+    }
+    if (!in) {
+        throw std::runtime_error("error:[PackedReferencePathOverlay] could not read indexes from stream");
+    }
+    
+    // reset the index cache
+    this->last_step_to_path_idx.clear();
+    this->last_step_to_path_idx.resize(get_thread_count(), 0);
+}
+
+void PackedReferencePathOverlay::PathVisitIndex::serialize(ostream& out) const {
+    size_t hash_count = node_hash.size();
+    sdsl::write_member(hash_count, out);
+    for (const auto& hash : node_hash) {
+        hash.save(out);
+    }
+    visit_ranks.serialize(out);
+    visit_ranks_start.serialize(out);
+    visit_ranks_length.serialize(out);
+    hash_count = step_hash.size();
+    sdsl::write_member(hash_count, out);
+    for (const auto& hash : step_hash) {
+        hash.save(out);
+    }
+    step_to_path.serialize(out);
+    step_to_step1.serialize(out);
+    step_to_step2.serialize(out);
+}
+
+void PackedReferencePathOverlay::PathVisitIndex::deserialize(istream& in) {
+    size_t hash_count;
+    sdsl::read_member(hash_count, in);
+    node_hash.clear();
+    node_hash.resize(hash_count);
+    for (auto& hash : node_hash) {
+        hash.load(in);
+    }
+    visit_ranks.deserialize(in);
+    visit_ranks_start.deserialize(in);
+    visit_ranks_length.deserialize(in);
+    sdsl::read_member(hash_count, in);
+    step_hash.clear();
+    step_hash.resize(hash_count);
+    for (auto& hash : step_hash) {
+        hash.load(in);
+    }
+    step_to_path.deserialize(in);
+    step_to_step1.deserialize(in);
+    step_to_step2.deserialize(in);
+}
+
 bool PackedReferencePathOverlay::for_each_step_on_handle_impl(const handle_t& handle,
                                                               const function<bool(const step_handle_t&)>& iteratee) const {
 
@@ -141,15 +260,18 @@ bool PackedReferencePathOverlay::for_each_step_on_handle_impl(const handle_t& ha
 
 size_t PackedReferencePathOverlay::scan_path(const path_handle_t& path_handle, void*& user_data) {
     // Instead of just getting the path step count, scan the whole path and
-    // make a multimap from visited node ID to ranks it occurs at.
-    std::unordered_multimap<nid_t, size_t>* visit_ranks = new std::unordered_multimap<nid_t, size_t>();
+    // list the node ID visited at each rank.
+    VisitRanks* visit_ranks = new VisitRanks();
     size_t rank = 0;
     for (handle_t h : graph->scan_path(path_handle)) {
         // Keep all the ranks that the handles happen at
-        visit_ranks->emplace(graph->get_id(h), rank);
+        visit_ranks->emplace_back(graph->get_id(h), rank);
         // And count all the steps
         rank++;
     }
+    // Sort the visits by node here, since paths are scanned in parallel but
+    // each collection of paths is indexed by one thread.
+    std::sort(visit_ranks->begin(), visit_ranks->end());
     
     // Keep the visits as the user data for this path
     user_data = (void*) visit_ranks;
@@ -167,13 +289,12 @@ void PackedReferencePathOverlay::set_index_count(size_t count) {
 void PackedReferencePathOverlay::index_paths(size_t index_num, const std::vector<path_handle_t>::const_iterator& begin_path, const std::vector<path_handle_t>::const_iterator& end_path, size_t cumul_path_size, void** user_data_base) {
     
     // Compose all the user datas into one
-    std::unordered_multimap<nid_t, size_t> all_visit_ranks;
+    VisitRanks all_visit_ranks;
+    all_visit_ranks.reserve(cumul_path_size);
     // When composing, we need to offset each path's visits by the previous
     // path's past-end rank, to unify the rank spaces.
     size_t rank_offset = 0;
-    // We also need the number of unique handle keys
-    size_t unique_keys = 0;
-    std::unordered_multimap<nid_t, size_t>** user_data_it = (std::unordered_multimap<nid_t, size_t>**) user_data_base;
+    VisitRanks** user_data_it = (VisitRanks**) user_data_base;
     // We keep track of the steps for the step->path cache below
     size_t step_count = 0;
     for (auto it = begin_path; it != end_path; ++it) {
@@ -183,18 +304,15 @@ void PackedReferencePathOverlay::index_paths(size_t index_num, const std::vector
         std::cerr << "T" << omp_get_thread_num() << ": For path " << get_path_name(*it) << " we see user data " << *user_data_it << " at " << user_data_it << std::endl;
 #endif
         
-        // Copy all the items by hand
-        // TODO: When we get C++17, do something with nodes
         assert(*user_data_it != nullptr); 
+        size_t merge_start = all_visit_ranks.size();
         for (const std::pair<nid_t, size_t>& item : **user_data_it) {
-            auto found = all_visit_ranks.find(item.first);
-            if (found == all_visit_ranks.end()) {
-                // This is a new unique key
-                unique_keys++;
-            }
             // Add the value, shifted past used ranks.
-            all_visit_ranks.emplace_hint(found, item.first, item.second + rank_offset);
+            all_visit_ranks.emplace_back(item.first, item.second + rank_offset);
         }
+        // Each path's visits are already sorted, so we just have to merge
+        // them with the visits before them.
+        std::inplace_merge(all_visit_ranks.begin(), all_visit_ranks.begin() + merge_start, all_visit_ranks.end());
         // Record the ranks used
         rank_offset += (*user_data_it)->size();
         // Consume the user data
@@ -206,6 +324,14 @@ void PackedReferencePathOverlay::index_paths(size_t index_num, const std::vector
         step_count += get_step_count(*it);
     }
     
+    // Count the unique handle keys
+    size_t unique_keys = 0;
+    for (size_t i = 0; i < all_visit_ranks.size(); i++) {
+        if (i == 0 || all_visit_ranks[i].first != all_visit_ranks[i - 1].first) {
+            unique_keys++;
+        }
+    }
+    
     // Grab the additional index we are building into
     auto& visit_index = visit_indexes[index_num];
 
@@ -216,43 +342,32 @@ void PackedReferencePathOverlay::index_paths(size_t index_num, const std::vector
     visit_index.visit_ranks_length.resize(unique_keys);
     
     // Make a perfect minimal hash over the handles on the selected paths
-    // Use the number of threads a child OMP team would get.
-    visit_index.node_hash.emplace_back(cumul_path_size, UniqueKeyRange<std::unordered_multimap<nid_t, size_t>>(all_visit_ranks), get_thread_count(), 2.0, false, false);
+    visit_index.node_hash.emplace_back(unique_keys, UniqueKeyRange<VisitRanks>(all_visit_ranks), threads_per_index, 2.0, false, false, hash_keys_cached());
     
-    // Compress down all_visit_ranks using the MPHF
-    // TODO: Can we do this without making a whole copy in all_visit_ranks? And just make another pass?
+    // Compress down all_visit_ranks using the MPHF. Visits to the same
+    // node are adjacent, so we only have to hash each node once.
     size_t start_visit_number = 0;
-    size_t visit_number = 0;
-    size_t prev_hash = unique_keys;
-    for (auto& kv : all_visit_ranks) {
-        size_t cur_hash = visit_index.node_hash.back().lookup(kv.first);
-        if (cur_hash != prev_hash) {
-            if (prev_hash != unique_keys) {
-                // We have a legit previous visit rank list to finish
-                visit_index.visit_ranks_length.set(prev_hash, visit_number - start_visit_number);
-            }
-            // We have a new visit rank list to start
-            visit_index.visit_ranks_start.set(cur_hash, visit_number);
-            start_visit_number = visit_number;
-            
-            prev_hash = cur_hash;
-        }
+    while (start_visit_number < all_visit_ranks.size()) {
+        nid_t node_id = all_visit_ranks[start_visit_number].first;
+        size_t hash = visit_index.node_hash.back().lookup(node_id);
+        visit_index.visit_ranks_start.set(hash, start_visit_number);
         
-        // Save what rank the visit is to
-        visit_index.visit_ranks.set(visit_number, kv.second);
+        size_t visit_number = start_visit_number;
+        while (visit_number < all_visit_ranks.size() && all_visit_ranks[visit_number].first == node_id) {
+            // Save what rank the visit is to
+            visit_index.visit_ranks.set(visit_number, all_visit_ranks[visit_number].second);
+            visit_number++;
+        }
+        visit_index.visit_ranks_length.set(hash, visit_number - start_visit_number);
         
-        // Move the cursor
-        visit_number++;
-    }
-    if (visit_number != start_visit_number) {
-        // We have an active last range.
-        // Finish the last range.
-        visit_index.visit_ranks_length.set(prev_hash, visit_number - start_visit_number);
+        start_visit_number = visit_number;
     }
+    // Free the visits before building the other hashes
+    VisitRanks().swap(all_visit_ranks);
     
     // Now make the step_handle -> path_handle index
     // (use bigger gamma instead of 2 to speed up our cache a bit at the cost increased size)
-    visit_index.step_hash.emplace_back(step_count, BBHashHelper(graph, begin_path, end_path), get_thread_count(), 10.0, false, false);
+    visit_index.step_hash.emplace_back(step_count, BBHashHelper(graph, begin_path, end_path), threads_per_index, 10.0, false, false, hash_keys_cached());
     visit_index.step_to_path.resize(step_count);
     visit_index.step_to_step1.resize(step_count);
     visit_index.step_to_step2.resize(step_count);    
@@ -1,12 +1,16 @@
 //
 //  packed_subgraph_overlay.cpp
 //
-//  Contains the implementation of PackedSubgraphOverlay
+//  Contains the implementation of PackedSubgraphOverlay and
+//  ContiguousSubgraphOverlay
 //
 
 #include "bdsg/overlays/packed_subgraph_overlay.hpp"
 #include "bdsg/internal/utility.hpp"
 
+#include <algorithm>
+#include <atomic>
+
 namespace bdsg {
 
 PackedSubgraphOverlay::PackedSubgraphOverlay(const HandleGraph* graph) : graph(graph) {
@@ -110,4 +114,113 @@ nid_t PackedSubgraphOverlay::max_node_id(void) const {
 handle_t PackedSubgraphOverlay::get_underlying_handle(const handle_t& handle) const {
     return handle;
 }
+
+ContiguousSubgraphOverlay::ContiguousSubgraphOverlay(const HandleGraph* graph, const std::vector<handle_t>& nodes) : graph(graph) {
+    
+    // Sort the handles into the backing graph's order
+    std::vector<uint64_t> sorted;
+    sorted.reserve(nodes.size());
+    for (const handle_t& handle : nodes) {
+        nid_t node_id = graph->get_id(handle);
+        max_id = max(node_id, max_id);
+        min_id = min(node_id, min_id);
+        sorted.push_back(handlegraph::as_integer(graph->forward(handle)));
+    }
+    std::sort(sorted.begin(), sorted.end());
+    sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+    
+    subgraph_handles.resize(sorted.size());
+    if (!sorted.empty()) {
+        members = sdsl::bit_vector(max_id - min_id + 1, 0);
+    }
+    for (size_t i = 0; i < sorted.size(); i++) {
+        subgraph_handles.set(i, sorted[i]);
+        members[graph->get_id(handlegraph::as_handle(sorted[i])) - min_id] = 1;
+    }
+}
+
+bool ContiguousSubgraphOverlay::has_node(nid_t node_id) const {
+    return node_id >= min_id && node_id <= max_id && members[node_id - min_id];
+}
+
+handle_t ContiguousSubgraphOverlay::get_handle(const nid_t& node_id, bool is_reverse) const {
+    return graph->get_handle(node_id, is_reverse);
+}
+
+nid_t ContiguousSubgraphOverlay::get_id(const handle_t& handle) const {
+    return graph->get_id(handle);
+}
+
+bool ContiguousSubgraphOverlay::get_is_reverse(const handle_t& handle) const {
+    return graph->get_is_reverse(handle);
+}
+
+handle_t ContiguousSubgraphOverlay::flip(const handle_t& handle) const {
+    return graph->flip(handle);
+}
+
+size_t ContiguousSubgraphOverlay::get_length(const handle_t& handle) const {
+    return graph->get_length(handle);
+}
+
+string ContiguousSubgraphOverlay::get_sequence(const handle_t& handle) const {
+    return graph->get_sequence(handle);
+}
+
+bool ContiguousSubgraphOverlay::follow_edges_impl(const handle_t& handle, bool go_left, const std::function<bool(const handle_t&)>& iteratee) const {
+    return graph->follow_edges(handle, go_left, [&](const handle_t& next) {
+        if (has_node(graph->get_id(next))) {
+            return iteratee(next);
+        }
+        else {
+            return true;
+        }
+    });
+}
+
+bool ContiguousSubgraphOverlay::for_each_handle_impl(const std::function<bool(const handle_t&)>& iteratee, bool parallel) const {
+    if (parallel) {
+        std::atomic<bool> keep_going(true);
+        #pragma omp parallel for
+        for (size_t i = 0; i < subgraph_handles.size(); i++) {
+            if (keep_going && !iteratee(handlegraph::as_handle(subgraph_handles.get(i)))) {
+                keep_going = false;
+            }
+        }
+        return keep_going;
+    }
+    else {
+        for (size_t i = 0; i < subgraph_handles.size(); i++) {
+            if (!iteratee(handlegraph::as_handle(subgraph_handles.get(i)))) {
+                return false;
+            }
+        }
+        return true;
+    }
+}
+
+char ContiguousSubgraphOverlay::get_base(const handle_t& handle, size_t index) const {
+    return graph->get_base(handle, index);
+}
+
+std::string ContiguousSubgraphOverlay::get_subsequence(const handle_t& handle, size_t index, size_t size) const {
+    return graph->get_subsequence(handle, index, size);
+}
+
+size_t ContiguousSubgraphOverlay::get_node_count(void) const {
+    return subgraph_handles.size();
+}
+
+nid_t ContiguousSubgraphOverlay::min_node_id(void) const {
+    return min_id;
+}
+
+nid_t ContiguousSubgraphOverlay::max_node_id(void) const {
+    return max_id;
+}
+
+handle_t ContiguousSubgraphOverlay::get_underlying_handle(const handle_t& handle) const {
+    return handle;
+}
+
 }
@@ -404,9 +404,9 @@ namespace bdsg {
         // compute the position of the next step without an offset annotation
         int64_t position;
         if (offset_by_step.count(walker)) {
-            position = (min_path_offset[get_path_handle_of_step(step)]
-                        + offset_by_step[walker]
-                        + get_length(get_handle_of_step(walker)));
+            // (the recorded offsets are already relative to the same zero-point
+            // as min_path_offset)
+            position = offset_by_step[walker] + get_length(get_handle_of_step(walker));
             // point the walker at the next unindexed position
             walker = get_next_step(walker);
         }
@@ -431,4 +431,200 @@ namespace bdsg {
     MutablePathDeletableHandleGraph* MutablePositionOverlay::get_graph() {
         return mutable_graph;
     }
+    
+    CompactMutablePositionOverlay::CompactMutablePositionOverlay(MutablePathDeletableHandleGraph* graph) : MutablePositionOverlay() {
+        // we skip the base class constructors that would build the map indexes
+        this->graph = graph;
+        this->mutable_graph = graph;
+        reindex_trees();
+    }
+    
+    CompactMutablePositionOverlay::CompactMutablePositionOverlay() {
+        
+    }
+    
+    CompactMutablePositionOverlay::~CompactMutablePositionOverlay() {
+        
+    }
+    
+    size_t CompactMutablePositionOverlay::get_path_length(const path_handle_t& path_handle) const {
+        return path_trees.at(path_handle).bases();
+    }
+    
+    size_t CompactMutablePositionOverlay::get_position_of_step(const step_handle_t& step) const {
+        path_handle_t path = get_path_handle_of_step(step);
+        if (step == path_end(path)) {
+            return get_path_length(path);
+        }
+        return path_trees.at(path).position_of(step);
+    }
+    
+    step_handle_t CompactMutablePositionOverlay::get_step_at_position(const path_handle_t& path,
+                                                                      const size_t& position) const {
+        const StepPositionTree& tree = path_trees.at(path);
+        size_t rank = tree.rank_at_position(position);
+        if (rank == tree.size()) {
+            // the position is past the last base in the path
+            return path_end(path);
+        }
+        return tree.step_at_rank(rank);
+    }
+    
+    void CompactMutablePositionOverlay::clear(void) {
+        get_graph()->clear();
+        path_trees.clear();
+    }
+    
+    handle_t CompactMutablePositionOverlay::apply_orientation(const handle_t& handle) {
+        // this will reverse the orientation of the handle on paths, so we need to update
+        // the corresponding steps
+        for_each_step_on_handle(handle, [&](const step_handle_t& step) {
+            path_trees.at(get_path_handle_of_step(step)).erase(step);
+        });
+        
+        handle_t new_handle = get_graph()->apply_orientation(handle);
+        
+        for_each_step_on_handle(new_handle, [&](const step_handle_t& new_step) {
+            reindex_contiguous_steps(new_step);
+        });
+        
+        return new_handle;
+    }
+    
+    vector<handle_t> CompactMutablePositionOverlay::divide_handle(const handle_t& handle, const std::vector<size_t>& offsets) {
+        // the old steps come out of the trees, and everything after them just
+        // moves along implicitly when the parts go in
+        for_each_step_on_handle(handle, [&](const step_handle_t& step) {
+            path_trees.at(get_path_handle_of_step(step)).erase(step);
+        });
+        
+        auto new_handles = get_graph()->divide_handle(handle, offsets);
+        
+        for_each_step_on_handle(new_handles.front(), [&](const step_handle_t& new_step) {
+            reindex_contiguous_steps(new_step);
+        });
+        
+        return new_handles;
+    }
+    
+    void CompactMutablePositionOverlay::optimize(bool allow_id_reassignment) {
+        // optimization may include arbitrary changes that invalidate all handles, need to reindex
+        get_graph()->optimize(allow_id_reassignment);
+        reindex_trees();
+    }
+    
+    bool CompactMutablePositionOverlay::apply_ordering(const vector<handle_t>& order, bool compact_ids) {
+        // this may change the values of the steps
+        bool result = get_graph()->apply_ordering(order, compact_ids);
+        reindex_trees();
+        return result;
+    }
+    
+    void CompactMutablePositionOverlay::increment_node_ids(nid_t increment) {
+        // this can invalidate step handles, so there's no real option except to reindex completely
+        get_graph()->increment_node_ids(increment);
+        reindex_trees();
+    }
+    
+    void CompactMutablePositionOverlay::reassign_node_ids(const std::function<nid_t(const nid_t&)>& get_new_id) {
+        // this can invalidate step handles, so there's no real option except to reindex completely
+        get_graph()->reassign_node_ids(get_new_id);
+        reindex_trees();
+    }
+    
+    void CompactMutablePositionOverlay::destroy_path(const path_handle_t& path) {
+        path_trees.erase(path);
+        get_graph()->destroy_path(path);
+    }
+    
+    path_handle_t CompactMutablePositionOverlay::create_path_handle(const string& name, bool is_circular) {
+        path_handle_t path_handle = get_graph()->create_path_handle(name, is_circular);
+        path_trees[path_handle];
+        return path_handle;
+    }
+    
+    step_handle_t CompactMutablePositionOverlay::append_step(const path_handle_t& path, const handle_t& to_append) {
+        step_handle_t step = get_graph()->append_step(path, to_append);
+        path_trees.at(path).push_back(step, get_length(to_append));
+        return step;
+    }
+    
+    step_handle_t CompactMutablePositionOverlay::prepend_step(const path_handle_t& path, const handle_t& to_prepend) {
+        step_handle_t step = get_graph()->prepend_step(path, to_prepend);
+        path_trees.at(path).insert(0, step, get_length(to_prepend));
+        return step;
+    }
+    
+    pair<step_handle_t, step_handle_t> CompactMutablePositionOverlay::rewrite_segment(const step_handle_t& segment_begin,
+                                                                                      const step_handle_t& segment_end,
+                                                                                      const vector<handle_t>& new_segment) {
+        
+        // only the steps being replaced need to come out
+        StepPositionTree& tree = path_trees.at(get_path_handle_of_step(segment_begin));
+        for (auto step = segment_begin; step != segment_end; step = get_next_step(step)) {
+            tree.erase(step);
+        }
+        
+        auto new_range = get_graph()->rewrite_segment(segment_begin, segment_end, new_segment);
+        
+        if (new_range.first != new_range.second) {
+            // this fills in up to the step after the segment, which is still indexed
+            reindex_contiguous_steps(new_range.first);
+        }
+        
+        return new_range;
+    }
+    
+    size_t CompactMutablePositionOverlay::index_memory_usage() const {
+        size_t total = sizeof(path_trees) + path_trees.bucket_count() * sizeof(void*);
+        for (const auto& path_tree : path_trees) {
+            total += sizeof(path_tree) + path_tree.second.memory_usage();
+        }
+        return total;
+    }
+    
+    void CompactMutablePositionOverlay::reindex_trees() {
+        path_trees.clear();
+        get_graph()->for_each_path_handle([&](const path_handle_t& path) {
+            StepPositionTree& tree = path_trees[path];
+            get_graph()->for_each_step_in_path(path, [&](const step_handle_t& step) {
+                tree.push_back(step, get_graph()->get_length(get_graph()->get_handle_of_step(step)));
+            });
+        });
+    }
+    
+    void CompactMutablePositionOverlay::reindex_contiguous_steps(const step_handle_t& step) {
+        
+        path_handle_t path = get_path_handle_of_step(step);
+        StepPositionTree& tree = path_trees.at(path);
+        
+        // we may have already re-indexed this occurrence starting from a different step
+        if (tree.contains(step)) {
+            return;
+        }
+        
+        // walk backwards until the beginning of the path or a step that is still indexed
+        auto walker = step;
+        while (!tree.contains(walker) && walker != path_begin(path)) {
+            walker = get_previous_step(walker);
+        }
+        
+        // find the rank of the next step without an index entry
+        size_t rank;
+        if (tree.contains(walker)) {
+            rank = tree.rank_of(walker) + 1;
+            walker = get_next_step(walker);
+        }
+        else {
+            // we must have have hit path_begin to have exited the previous while loop
+            rank = 0;
+        }
+        
+        // add all of the new steps (can also soak up adjacent occurrences of
+        // the same node on this path)
+        for (; walker != path_end(path) && !tree.contains(walker); walker = get_next_step(walker)) {
+            tree.insert(rank, walker, get_length(get_handle_of_step(walker)));
+            ++rank;
+        }
+    }
 }
@@ -1,15 +1,18 @@
 #include "bdsg/overlays/path_subgraph_overlay.hpp"
 
 #include <atomic>
+#include <algorithm>
 
 namespace bdsg {
 
 using namespace std;
 using namespace handlegraph;
 
-PathSubgraphOverlay::PathSubgraphOverlay(const PathHandleGraph* backing, const unordered_set<nid_t>* node_subset) :
+PathSubgraphOverlay::PathSubgraphOverlay(const PathHandleGraph* backing, const unordered_set<nid_t>* node_subset,
+                                         bool index_steps) :
     SubgraphOverlay(backing, node_subset),
-    backing_path_graph(backing) {
+    backing_path_graph(backing),
+    steps_indexed(index_steps) {
 
     backing->for_each_path_handle([&](const path_handle_t& path_handle) {
             bool fully_contained = true;
@@ -24,6 +27,30 @@ PathSubgraphOverlay::PathSubgraphOverlay(const PathHandleGraph* backing, const u
                 path_subset.insert(path_handle);
             }
         });
+    
+    if (steps_indexed) {
+        // collect the steps with their node IDs, and group them by node
+        vector<pair<nid_t, step_handle_t>> steps;
+        for (const path_handle_t& path_handle : path_subset) {
+            backing->for_each_step_in_path(path_handle, [&](const step_handle_t& step_handle) {
+                    steps.emplace_back(backing->get_id(backing->get_handle_of_step(step_handle)), step_handle);
+                });
+        }
+        std::stable_sort(steps.begin(), steps.end(), [](const pair<nid_t, step_handle_t>& a,
+                                                        const pair<nid_t, step_handle_t>& b) {
+                return a.first < b.first;
+            });
+        
+        indexed_steps.reserve(steps.size());
+        for (size_t i = 0; i < steps.size(); ++i) {
+            if (i == 0 || steps[i].first != steps[i - 1].first) {
+                indexed_ids.push_back(steps[i].first);
+                step_bounds.push_back(i);
+            }
+            indexed_steps.push_back(steps[i].second);
+        }
+        step_bounds.push_back(steps.size());
+    }
 }
 
 PathSubgraphOverlay::~PathSubgraphOverlay() {
@@ -109,7 +136,28 @@ bool PathSubgraphOverlay::for_each_path_handle_impl(const std::function<bool(con
 
 bool PathSubgraphOverlay::for_each_step_on_handle_impl(const handle_t& handle,
                                                        const std::function<bool(const step_handle_t&)>& iteratee) const {
-    return backing_path_graph->for_each_step_on_handle(handle, iteratee);
+    if (steps_indexed) {
+        nid_t node_id = get_id(handle);
+        auto found = std::lower_bound(indexed_ids.begin(), indexed_ids.end(), node_id);
+        if (found == indexed_ids.end() || *found != node_id) {
+            return true;
+        }
+        size_t i = found - indexed_ids.begin();
+        for (size_t j = step_bounds[i]; j < step_bounds[i + 1]; ++j) {
+            if (!iteratee(indexed_steps[j])) {
+                return false;
+            }
+        }
+        return true;
+    }
+    
+    // only report the steps of the paths we contain
+    return backing_path_graph->for_each_step_on_handle(handle, [&](const step_handle_t& step_handle) {
+            if (path_subset.count(backing_path_graph->get_path_handle_of_step(step_handle))) {
+                return iteratee(step_handle);
+            }
+            return true;
+        });
 }
 
 }
@@ -0,0 +1,183 @@
+#include "bdsg/internal/perf_counters.hpp"
+
+#include <atomic>
+#include <mutex>
+#include <sstream>
+#include <unordered_set>
+#include <sys/resource.h>
+
+namespace bdsg {
+namespace perf {
+
+namespace {
+
+/// One thread's counters. Only the owning thread writes them, so it doesn't
+/// need atomic read-modify-write operations, but other threads read them.
+struct ThreadCounters {
+    std::atomic<uint64_t> counts[EVENT_COUNT];
+    std::atomic<uint64_t> nanoseconds[EVENT_COUNT];
+
+    ThreadCounters();
+    ~ThreadCounters();
+};
+
+/// All the threads' counters, and the totals from threads that have exited.
+struct Registry {
+    std::mutex mutex;
+    std::unordered_set<ThreadCounters*> threads;
+    Snapshot retired;
+};
+
+Registry& get_registry() {
+    // Made on first use, so it outlives all the threads' counters.
+    static Registry registry;
+    return registry;
+}
+
+ThreadCounters::ThreadCounters() {
+    for (size_t i = 0; i < EVENT_COUNT; i++) {
+        counts[i].store(0, std::memory_order_relaxed);
+        nanoseconds[i].store(0, std::memory_order_relaxed);
+    }
+    Registry& registry = get_registry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    registry.threads.insert(this);
+}
+
+ThreadCounters::~ThreadCounters() {
+    Registry& registry = get_registry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    for (size_t i = 0; i < EVENT_COUNT; i++) {
+        // Keep what this thread counted.
+        registry.retired.counts[i] += counts[i].load(std::memory_order_relaxed);
+        registry.retired.nanoseconds[i] += nanoseconds[i].load(std::memory_order_relaxed);
+    }
+    registry.threads.erase(this);
+}
+
+thread_local ThreadCounters thread_counters;
+
+/// Get the number of page faults the calling thread has taken.
+uint64_t get_thread_faults() {
+    struct rusage usage;
+#ifdef RUSAGE_THREAD
+    if (getrusage(RUSAGE_THREAD, &usage)) {
+        return 0;
+    }
+#else
+    if (getrusage(RUSAGE_SELF, &usage)) {
+        return 0;
+    }
+#endif
+    return usage.ru_minflt + usage.ru_majflt;
+}
+
+}
+
+const char* event_name(event_t event) {
+    switch (event) {
+    case DISTANCE_MINIMUM_DISTANCE:
+        return "distance_minimum_distance";
+    case DISTANCE_PAGE_FAULTS:
+        return "distance_page_faults";
+    case DISTANCE_LOWEST_COMMON_ANCESTOR:
+        return "distance_lowest_common_ancestor";
+    case DISTANCE_IN_PARENT:
+        return "distance_in_parent";
+    case DISTANCE_TO_PARENT_BOUND:
+        return "distance_to_parent_bound";
+    case GRAPH_FOLLOW_EDGES:
+        return "graph_follow_edges";
+    case GRAPH_GET_SEQUENCE:
+        return "graph_get_sequence";
+    case GRAPH_DEFRAGMENT:
+        return "graph_defragment";
+    case MANAGER_ALLOCATE:
+        return "manager_allocate";
+    case MANAGER_DEALLOCATE:
+        return "manager_deallocate";
+    case MANAGER_CHAIN_GROWTH:
+        return "manager_chain_growth";
+    case MANAGER_LOCK_WAIT:
+        return "manager_lock_wait";
+    default:
+        return "unknown";
+    }
+}
+
+void Snapshot::dump_json(std::ostream& out) const {
+    out << "{";
+    for (size_t i = 0; i < EVENT_COUNT; i++) {
+        if (i != 0) {
+            out << ", ";
+        }
+        out << "\"" << event_name((event_t) i) << "\": {\"count\": " << counts[i]
+            << ", \"nanoseconds\": " << nanoseconds[i] << "}";
+    }
+    out << "}";
+}
+
+std::string Snapshot::to_json() const {
+    std::stringstream ss;
+    dump_json(ss);
+    return ss.str();
+}
+
+bool enabled() {
+#ifdef BDSG_PERF_COUNTERS
+    return true;
+#else
+    return false;
+#endif
+}
+
+Snapshot snapshot() {
+    Registry& registry = get_registry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    Snapshot totals = registry.retired;
+    for (ThreadCounters* thread : registry.threads) {
+        for (size_t i = 0; i < EVENT_COUNT; i++) {
+            totals.counts[i] += thread->counts[i].load(std::memory_order_relaxed);
+            totals.nanoseconds[i] += thread->nanoseconds[i].load(std::memory_order_relaxed);
+        }
+    }
+    return totals;
+}
+
+void reset() {
+    Registry& registry = get_registry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    registry.retired = Snapshot();
+    for (ThreadCounters* thread : registry.threads) {
+        for (size_t i = 0; i < EVENT_COUNT; i++) {
+            thread->counts[i].store(0, std::memory_order_relaxed);
+            thread->nanoseconds[i].store(0, std::memory_order_relaxed);
+        }
+    }
+}
+
+void record(event_t event, uint64_t nanoseconds) {
+    ThreadCounters& counters = thread_counters;
+    counters.counts[event].store(counters.counts[event].load(std::memory_order_relaxed) + 1,
+                                 std::memory_order_relaxed);
+    if (nanoseconds) {
+        counters.nanoseconds[event].store(counters.nanoseconds[event].load(std::memory_order_relaxed) + nanoseconds,
+                                          std::memory_order_relaxed);
+    }
+}
+
+ScopedFaultCounter::ScopedFaultCounter() : start(get_thread_faults()) {
+    // Nothing to do
+}
+
+ScopedFaultCounter::~ScopedFaultCounter() {
+    uint64_t faults = get_thread_faults() - start;
+    if (faults) {
+        ThreadCounters& counters = thread_counters;
+        counters.counts[DISTANCE_PAGE_FAULTS].store(counters.counts[DISTANCE_PAGE_FAULTS].load(std::memory_order_relaxed) + faults,
+                                                    std::memory_order_relaxed);
+    }
+}
+
+}
+}
@@ -0,0 +1,523 @@
+//
+//  scale_libbdsg.cpp
+//
+// Contains a harness that measures how building the libbdsg indexes, and
+// querying them from many threads at once, scales with the number of threads
+// and the size of the graph, with JSON output so that results can be compared
+// across versions and machines.
+//
+
+#include <iostream>
+#include <cstdio>
+#include <vector>
+#include <string>
+#include <random>
+#include <chrono>
+#include <limits>
+#include <functional>
+#include <memory>
+#include <algorithm>
+#include <tuple>
+
+#include <getopt.h>
+#include <sys/resource.h>
+#include <jansson.h>
+#include <omp.h> // BINDER_IGNORE because Binder can't find this
+
+#include "bdsg/packed_graph.hpp"
+#include "bdsg/snarl_distance_index.hpp"
+#include "bdsg/overlays/packed_path_position_overlay.hpp"
+#include "bdsg/overlays/packed_reference_path_overlay.hpp"
+#include "bdsg/overlays/vectorizable_overlays.hpp"
+
+
+using namespace bdsg;
+using namespace handlegraph;
+using namespace std;
+
+/// Results get folded into here so the compiler can't throw the measured
+/// work away.
+volatile size_t scaling_sink = 0;
+
+/// One measurement of building or querying one structure.
+struct ScalingResult {
+    /// The number of nodes in the graph
+    size_t nodes;
+    /// The number of threads used
+    size_t threads;
+    /// The index or graph measured
+    string structure;
+    /// "build", or the query that was run
+    string operation;
+    /// The number of queries, or 1 for a build
+    size_t operations;
+    /// The time in seconds, the fastest over all repetitions for queries
+    double seconds;
+    /// The peak resident set size of the process so far, in bytes
+    size_t peak_rss;
+    /// The total, free and reclaimable bytes in the structure's yomo chain,
+    /// if it has one
+    bool has_chain_usage = false;
+    tuple<size_t, size_t, size_t> chain_usage {0, 0, 0};
+};
+
+/// Get the peak resident set size of the process so far, in bytes. This never
+/// goes down, so it reflects the largest structure built so far.
+size_t get_peak_rss() {
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage)) {
+        return 0;
+    }
+#ifdef __APPLE__
+    // macOS reports bytes
+    return usage.ru_maxrss;
+#else
+    // Linux reports kilobytes
+    return usage.ru_maxrss * 1024;
+#endif
+}
+
+/// Report a result and add it to the list.
+void add_result(vector<ScalingResult>& results, const ScalingResult& result) {
+    cerr << result.nodes << "\t" << result.threads << "\t" << result.structure << "\t" << result.operation << "\t";
+    if (result.operation == "build") {
+        cerr << result.seconds << " s";
+    }
+    else {
+        cerr << (result.seconds > 0 ? result.operations / result.seconds : 0.0) << " ops/s";
+    }
+    cerr << "\t" << result.peak_rss / (1024 * 1024) << " MiB peak" << endl;
+    results.push_back(result);
+}
+
+/// Time a build, which is only done once.
+template<typename Build>
+ScalingResult time_build(size_t nodes, size_t threads, const string& structure, const Build& build) {
+    auto start = chrono::steady_clock::now();
+    build();
+    auto stop = chrono::steady_clock::now();
+    return ScalingResult {nodes, threads, structure, "build", 1,
+                          chrono::duration<double>(stop - start).count(), get_peak_rss()};
+}
+
+/// Time a query workload, running the query for each number below the count
+/// concurrently on all the threads. The query returns a number to fold into
+/// the sink. Only the fastest repetition is kept.
+template<typename Query>
+void time_queries(vector<ScalingResult>& results, size_t nodes, size_t threads, const string& structure,
+                  const string& operation, size_t count, size_t repetitions, const Query& query) {
+
+    double best = numeric_limits<double>::infinity();
+    for (size_t r = 0; r < repetitions; r++) {
+        size_t total = 0;
+        auto start = chrono::steady_clock::now();
+#pragma omp parallel for schedule(dynamic, 256) reduction(+:total)
+        for (size_t i = 0; i < count; i++) {
+            total += query(i);
+        }
+        auto stop = chrono::steady_clock::now();
+        scaling_sink += total;
+        best = min(best, chrono::duration<double>(stop - start).count());
+    }
+    add_result(results, ScalingResult {nodes, threads, structure, operation, count, best, get_peak_rss()});
+}
+
+/// Fill an empty graph with a synthetic variation graph: a backbone with a
+/// SNP-like bubble every few nodes, walked by a "reference" path and by the
+/// given number of haplotype paths that each pick an allele at random at
+/// every bubble.
+void make_synthetic_graph(PackedGraph& graph, size_t node_count, size_t haplotypes, uint64_t seed) {
+
+    default_random_engine gen(seed);
+    uniform_int_distribution<int> base_distr(0, 3);
+    uniform_int_distribution<size_t> length_distr(1, 32);
+    uniform_int_distribution<int> site_distr(0, 4);
+
+    auto random_sequence = [&](size_t length) {
+        string seq(length, 'A');
+        for (char& c : seq) {
+            c = "ACGT"[base_distr(gen)];
+        }
+        return seq;
+    };
+
+    // each site is a single node, or the two alleles of a bubble
+    vector<vector<handle_t>> sites;
+    size_t created = 0;
+    while (created < node_count) {
+        sites.emplace_back();
+        if (!sites.empty() && site_distr(gen) == 0 && created + 1 < node_count) {
+            sites.back().push_back(graph.create_handle(random_sequence(1)));
+            sites.back().push_back(graph.create_handle(random_sequence(1)));
+            created += 2;
+        }
+        else {
+            sites.back().push_back(graph.create_handle(random_sequence(length_distr(gen))));
+            created++;
+        }
+        if (sites.size() > 1) {
+            for (const handle_t& from : sites[sites.size() - 2]) {
+                for (const handle_t& to : sites.back()) {
+                    graph.create_edge(from, to);
+                }
+            }
+        }
+    }
+
+    path_handle_t ref = graph.create_path_handle("reference");
+    for (auto& site : sites) {
+        graph.append_step(ref, site.front());
+    }
+    for (size_t h = 0; h < haplotypes; h++) {
+        path_handle_t hap = graph.create_path_handle("sample" + to_string(h) + "#1#reference");
+        for (auto& site : sites) {
+            graph.append_step(hap, site[gen() % site.size()]);
+        }
+    }
+}
+
+/// Fill an empty graph with chains of nodes, each its own connected component,
+/// and fill in temporary distance indexes for them. The distance index
+/// construction in libbdsg needs the snarls to come from a snarl finder
+/// elsewhere, so we use a graph whose snarl tree we know.
+void make_chain_graph(PackedGraph& graph, vector<SnarlDistanceIndex::TemporaryDistanceIndex>& temp_indexes,
+                      size_t node_count, size_t chain_length, uint64_t seed) {
+
+    using TemporaryDistanceIndex = SnarlDistanceIndex::TemporaryDistanceIndex;
+    default_random_engine gen(seed);
+    uniform_int_distribution<size_t> length_distr(1, 32);
+
+    temp_indexes.clear();
+    temp_indexes.resize((node_count + chain_length - 1) / chain_length);
+    for (size_t c = 0; c < temp_indexes.size(); c++) {
+        TemporaryDistanceIndex& temp_index = temp_indexes[c];
+        size_t length = min(chain_length, node_count - c * chain_length);
+
+        vector<handle_t> handles;
+        vector<size_t> lengths;
+        for (size_t i = 0; i < length; i++) {
+            lengths.push_back(length_distr(gen));
+            handles.push_back(graph.create_handle(string(lengths.back(), 'A')));
+            if (i > 0) {
+                graph.create_edge(handles[i - 1], handles[i]);
+            }
+        }
+
+        temp_index.min_node_id = graph.get_id(handles.front());
+        temp_index.max_node_id = graph.get_id(handles.back());
+        temp_index.root_structure_count = 1;
+        temp_index.max_tree_depth = 1;
+        temp_index.components.emplace_back(SnarlDistanceIndex::TEMP_CHAIN, 0);
+        temp_index.temp_chain_records.emplace_back();
+        TemporaryDistanceIndex::TemporaryChainRecord& chain = temp_index.temp_chain_records.back();
+        chain.start_node_id = temp_index.min_node_id;
+        chain.start_node_rev = false;
+        chain.end_node_id = temp_index.max_node_id;
+        chain.end_node_rev = false;
+        chain.end_node_length = lengths.back();
+        chain.parent = make_pair(SnarlDistanceIndex::TEMP_ROOT, 0);
+        chain.rank_in_parent = 0;
+        chain.reversed_in_parent = false;
+        chain.is_trivial = false;
+        size_t total_length = 0;
+        for (size_t i = 0; i < handles.size(); i++) {
+            chain.children.emplace_back(SnarlDistanceIndex::TEMP_NODE, graph.get_id(handles[i]));
+            chain.prefix_sum.push_back(total_length);
+            chain.max_prefix_sum.push_back(total_length);
+            chain.forward_loops.push_back(std::numeric_limits<size_t>::max());
+            chain.backward_loops.push_back(std::numeric_limits<size_t>::max());
+            chain.chain_components.push_back(0);
+
+            temp_index.temp_node_records.emplace_back();
+            TemporaryDistanceIndex::TemporaryNodeRecord& node = temp_index.temp_node_records.back();
+            node.node_id = graph.get_id(handles[i]);
+            node.parent = make_pair(SnarlDistanceIndex::TEMP_CHAIN, 0);
+            node.node_length = lengths[i];
+            node.rank_in_parent = i;
+
+            total_length += lengths[i];
+        }
+        chain.min_length = total_length;
+        chain.max_length = total_length;
+        temp_index.max_distance = total_length;
+        temp_index.max_index_size = chain.get_max_record_length();
+    }
+}
+
+/// Build each index over graphs of one size with the given number of threads,
+/// and run the query workloads on them.
+void measure_scaling(vector<ScalingResult>& results, const PackedGraph& graph, const PackedGraph& chain_graph,
+                     const vector<SnarlDistanceIndex::TemporaryDistanceIndex>& temp_indexes, size_t chain_length,
+                     size_t nodes, size_t threads, size_t steps_per_index, size_t queries, size_t repetitions,
+                     uint64_t seed) {
+
+    omp_set_num_threads(threads);
+
+    // make the same random queries for every thread count
+    default_random_engine gen(seed);
+    vector<handle_t> handles;
+    graph.for_each_handle([&](const handle_t& h) {
+        handles.push_back(h);
+    });
+    vector<step_handle_t> steps;
+    vector<pair<path_handle_t, size_t>> positions;
+    graph.for_each_path_handle([&](const path_handle_t& path) {
+        graph.for_each_step_in_path(path, [&](const step_handle_t& step) {
+            steps.push_back(step);
+        });
+    });
+    vector<handle_t> query_handles(queries);
+    vector<step_handle_t> query_steps(queries);
+    for (size_t i = 0; i < queries; i++) {
+        query_handles[i] = handles[gen() % handles.size()];
+        query_steps[i] = steps[gen() % steps.size()];
+    }
+
+    PackedPositionOverlay position_overlay;
+    add_result(results, time_build(nodes, threads, "PackedPositionOverlay", [&]() {
+        position_overlay = PackedPositionOverlay(&graph, steps_per_index);
+    }));
+    for (auto& step : query_steps) {
+        path_handle_t path = graph.get_path_handle_of_step(step);
+        positions.emplace_back(path, gen() % position_overlay.get_path_length(path));
+    }
+    time_queries(results, nodes, threads, "PackedPositionOverlay", "get_position_of_step", queries, repetitions,
+                 [&](size_t i) {
+        return position_overlay.get_position_of_step(query_steps[i]);
+    });
+    time_queries(results, nodes, threads, "PackedPositionOverlay", "get_step_at_position", queries, repetitions,
+                 [&](size_t i) {
+        return as_integers(position_overlay.get_step_at_position(positions[i].first, positions[i].second))[1];
+    });
+
+    {
+        unique_ptr<PackedReferencePathOverlay> reference_overlay;
+        add_result(results, time_build(nodes, threads, "PackedReferencePathOverlay", [&]() {
+            reference_overlay.reset(new PackedReferencePathOverlay(&graph, steps_per_index));
+        }));
+        time_queries(results, nodes, threads, "PackedReferencePathOverlay", "get_step_at_position", queries,
+                     repetitions, [&](size_t i) {
+            return as_integers(reference_overlay->get_step_at_position(positions[i].first, positions[i].second))[1];
+        });
+        time_queries(results, nodes, threads, "PackedReferencePathOverlay", "for_each_step_on_handle", queries,
+                     repetitions, [&](size_t i) {
+            size_t total = 0;
+            reference_overlay->for_each_step_on_handle(query_handles[i], [&](const step_handle_t& step) {
+                total += as_integers(step)[1];
+            });
+            return total;
+        });
+    }
+
+    time_queries(results, nodes, threads, "PackedGraph", "for_each_step_on_handle", queries, repetitions,
+                 [&](size_t i) {
+        size_t total = 0;
+        graph.for_each_step_on_handle(query_handles[i], [&](const step_handle_t& step) {
+            total += as_integers(step)[1];
+        });
+        return total;
+    });
+
+    {
+        unique_ptr<VectorizableOverlay> vectorizable_overlay;
+        add_result(results, time_build(nodes, threads, "VectorizableOverlay", [&]() {
+            vectorizable_overlay.reset(new VectorizableOverlay(&graph));
+        }));
+        time_queries(results, nodes, threads, "VectorizableOverlay", "node_vector_offset", queries, repetitions,
+                     [&](size_t i) {
+            return vectorizable_overlay->node_vector_offset(graph.get_id(query_handles[i]));
+        });
+    }
+
+    {
+        vector<const SnarlDistanceIndex::TemporaryDistanceIndex*> temp_index_pointers;
+        for (auto& temp_index : temp_indexes) {
+            temp_index_pointers.push_back(&temp_index);
+        }
+        SnarlDistanceIndex distance_index;
+        ScalingResult result = time_build(nodes, threads, "SnarlDistanceIndex", [&]() {
+            distance_index.get_snarl_tree_records(temp_index_pointers, &chain_graph);
+        });
+        result.has_chain_usage = true;
+        result.chain_usage = distance_index.get_usage();
+        add_result(results, result);
+
+        // query between nodes on the same chain, so that they are connected
+        vector<pair<nid_t, nid_t>> pairs(queries);
+        nid_t min_id = chain_graph.min_node_id();
+        size_t chain_count = temp_indexes.size();
+        for (auto& pair : pairs) {
+            size_t chain = gen() % chain_count;
+            nid_t first = min_id + chain * chain_length;
+            size_t length = temp_indexes[chain].max_node_id - temp_indexes[chain].min_node_id + 1;
+            pair.first = first + gen() % length;
+            pair.second = first + gen() % length;
+        }
+        time_queries(results, nodes, threads, "SnarlDistanceIndex", "minimum_distance", queries, repetitions,
+                     [&](size_t i) {
+            return distance_index.minimum_distance(pairs[i].first, false, 0, pairs[i].second, false, 0,
+                                                   false, &chain_graph);
+        });
+    }
+}
+
+void print_help(char** argv) {
+    cerr << "usage: " << argv[0] << " [options]" << endl
+         << "Measure how building and querying the libbdsg indexes scales with threads and graph size." << endl
+         << endl
+         << "options:" << endl
+         << "    -n, --nodes N          nodes in the smallest synthetic graph [10000]" << endl
+         << "    -m, --max-nodes N      nodes in the largest synthetic graph [1000000]" << endl
+         << "    -f, --factor N         grow the graph by this factor each time [10]" << endl
+         << "    -t, --threads N        run with 1, 2, 4, ... up to N threads [all available]" << endl
+         << "    -p, --haplotypes N     haplotype paths in the synthetic graphs [8]" << endl
+         << "    -i, --steps-per-index N  steps per path position index [100000]" << endl
+         << "    -c, --chain-length N   nodes per chain in the distance index graphs [1000]" << endl
+         << "    -q, --queries N        queries per workload per repetition [1000000]" << endl
+         << "    -r, --repetitions N    run each workload N times and keep the fastest [3]" << endl
+         << "    -s, --seed N           seed for the synthetic graphs and queries [0]" << endl
+         << "    -o, --output FILE      write JSON results to FILE instead of standard output" << endl
+         << "    -h, --help             print this help" << endl
+         << endl
+         << "The peak resident set size reported is for the whole process so far, so" << endl
+         << "it only goes up." << endl;
+}
+
+int main(int argc, char** argv) {
+
+    size_t min_nodes = 10000;
+    size_t max_nodes = 1000000;
+    size_t factor = 10;
+    size_t max_threads = omp_get_max_threads();
+    size_t haplotypes = 8;
+    size_t steps_per_index = 100000;
+    size_t chain_length = 1000;
+    size_t queries = 1000000;
+    size_t repetitions = 3;
+    uint64_t seed = 0;
+    string output_file;
+
+    static struct option long_options[] = {
+        {"nodes", required_argument, 0, 'n'},
+        {"max-nodes", required_argument, 0, 'm'},
+        {"factor", required_argument, 0, 'f'},
+        {"threads", required_argument, 0, 't'},
+        {"haplotypes", required_argument, 0, 'p'},
+        {"steps-per-index", required_argument, 0, 'i'},
+        {"chain-length", required_argument, 0, 'c'},
+        {"queries", required_argument, 0, 'q'},
+        {"repetitions", required_argument, 0, 'r'},
+        {"seed", required_argument, 0, 's'},
+        {"output", required_argument, 0, 'o'},
+        {"help", no_argument, 0, 'h'},
+        {0, 0, 0, 0}
+    };
+
+    int c;
+    while ((c = getopt_long(argc, argv, "n:m:f:t:p:i:c:q:r:s:o:h", long_options, nullptr)) != -1) {
+        switch (c) {
+        case 'n':
+            min_nodes = max<size_t>(stoull(optarg), 1);
+            break;
+        case 'm':
+            max_nodes = stoull(optarg);
+            break;
+        case 'f':
+            factor = max<size_t>(stoull(optarg), 2);
+            break;
+        case 't':
+            max_threads = max<size_t>(stoull(optarg), 1);
+            break;
+        case 'p':
+            haplotypes = stoull(optarg);
+            break;
+        case 'i':
+            steps_per_index = max<size_t>(stoull(optarg), 1);
+            break;
+        case 'c':
+            chain_length = max<size_t>(stoull(optarg), 1);
+            break;
+        case 'q':
+            queries = max<size_t>(stoull(optarg), 1);
+            break;
+        case 'r':
+            repetitions = max<size_t>(stoull(optarg), 1);
+            break;
+        case 's':
+            seed = stoull(optarg);
+            break;
+        case 'o':
+            output_file = optarg;
+            break;
+        case 'h':
+            print_help(argv);
+            return 0;
+        default:
+            print_help(argv);
+            return 1;
+        }
+    }
+
+    vector<size_t> thread_counts;
+    for (size_t threads = 1; threads < max_threads; threads *= 2) {
+        thread_counts.push_back(threads);
+    }
+    thread_counts.push_back(max_threads);
+
+    vector<ScalingResult> results;
+    for (size_t nodes = min_nodes; nodes <= max(max_nodes, min_nodes); nodes *= factor) {
+        PackedGraph graph;
+        make_synthetic_graph(graph, nodes, haplotypes, seed);
+        PackedGraph chain_graph;
+        vector<SnarlDistanceIndex::TemporaryDistanceIndex> temp_indexes;
+        make_chain_graph(chain_graph, temp_indexes, nodes, chain_length, seed);
+
+        for (size_t threads : thread_counts) {
+            measure_scaling(results, graph, chain_graph, temp_indexes, chain_length, nodes, threads,
+                            steps_per_index, queries, repetitions, seed);
+        }
+    }
+
+    // report everything as JSON
+    json_t* out_json = json_object();
+    json_object_set_new(out_json, "repetitions", json_integer(repetitions));
+    json_object_set_new(out_json, "seed", json_integer(seed));
+    json_object_set_new(out_json, "haplotypes", json_integer(haplotypes));
+    json_t* results_json = json_array();
+    for (auto& result : results) {
+        json_t* result_json = json_object();
+        json_object_set_new(result_json, "nodes", json_integer(result.nodes));
+        json_object_set_new(result_json, "threads", json_integer(result.threads));
+        json_object_set_new(result_json, "structure", json_string(result.structure.c_str()));
+        json_object_set_new(result_json, "operation", json_string(result.operation.c_str()));
+        json_object_set_new(result_json, "operations", json_integer(result.operations));
+        json_object_set_new(result_json, "seconds", json_real(result.seconds));
+        json_object_set_new(result_json, "operations_per_second",
+                            json_real(result.seconds > 0 ? result.operations / result.seconds : 0.0));
+        json_object_set_new(result_json, "peak_rss_bytes", json_integer(result.peak_rss));
+        if (result.has_chain_usage) {
+            json_t* usage_json = json_object();
+            json_object_set_new(usage_json, "total_bytes", json_integer(get<0>(result.chain_usage)));
+            json_object_set_new(usage_json, "free_bytes", json_integer(get<1>(result.chain_usage)));
+            json_object_set_new(usage_json, "reclaimable_bytes", json_integer(get<2>(result.chain_usage)));
+            json_object_set_new(result_json, "chain_usage", usage_json);
+        }
+        json_array_append_new(results_json, result_json);
+    }
+    json_object_set_new(out_json, "results", results_json);
+
+    FILE* out = output_file.empty() ? stdout : fopen(output_file.c_str(), "w");
+    if (!out) {
+        cerr << "error:[bdsg_scale] could not open " << output_file << " for writing" << endl;
+        json_decref(out_json);
+        return 1;
+    }
+    json_dumpf(out_json, out, JSON_INDENT(2));
+    fputc('\n', out);
+    if (out != stdout) {
+        fclose(out);
+    }
+    json_decref(out_json);
+
+    return 0;
+}
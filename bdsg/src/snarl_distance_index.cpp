@@ -4,8 +4,13 @@
 //#define debug_distance_paths
 
 #include "bdsg/snarl_distance_index.hpp"
+#include "bdsg/internal/varint.hpp"
 #include <jansson.h>
 #include <arpa/inet.h>
+#include <algorithm>
+#include <array>
+#include <exception>
+#include <unordered_map>
 
 using namespace std;
 using namespace handlegraph;
@@ -17,6 +22,7 @@ namespace bdsg {
 SnarlDistanceIndex::SnarlDistanceIndex() {
     snarl_tree_records.construct(get_prefix());
     snarl_tree_records->width(64);
+    distance_cache_generation = next_distance_cache_generation();
 }
 SnarlDistanceIndex::~SnarlDistanceIndex() {
 }
@@ -126,8 +132,8 @@ bool SnarlDistanceIndex::is_root(const net_handle_t& net) const {
 bool SnarlDistanceIndex::is_root_snarl(const net_handle_t& net) const {
 #ifdef debug_distances
     if (get_handle_type(net) == ROOT_HANDLE && get_record_offset(net) != 0) {
-        assert(SnarlTreeRecord(net, &snarl_tree_records).get_record_type() == ROOT_SNARL ||
-               SnarlTreeRecord(net, &snarl_tree_records).get_record_type() == DISTANCED_ROOT_SNARL);
+        assert(SnarlTreeRecord(net, snarl_tree_records.get_local()).get_record_type() == ROOT_SNARL ||
+               SnarlTreeRecord(net, snarl_tree_records.get_local()).get_record_type() == DISTANCED_ROOT_SNARL);
     }
 #endif
 
@@ -138,9 +144,9 @@ bool SnarlDistanceIndex::is_root_snarl(const net_handle_t& net) const {
 bool SnarlDistanceIndex::is_snarl(const net_handle_t& net) const {
 #ifdef debug_distances
 if(get_handle_type(net) == SNARL_HANDLE){
-    assert(SnarlTreeRecord(net, &snarl_tree_records).get_record_handle_type() == SNARL_HANDLE ||
-        SnarlTreeRecord(net, &snarl_tree_records).get_record_type() == ROOT_SNARL ||
-        SnarlTreeRecord(net, &snarl_tree_records).get_record_type() == DISTANCED_ROOT_SNARL);
+    assert(SnarlTreeRecord(net, snarl_tree_records.get_local()).get_record_handle_type() == SNARL_HANDLE ||
+        SnarlTreeRecord(net, snarl_tree_records.get_local()).get_record_type() == ROOT_SNARL ||
+        SnarlTreeRecord(net, snarl_tree_records.get_local()).get_record_type() == DISTANCED_ROOT_SNARL);
     assert(get_node_record_offset(net) == 0 || get_node_record_offset(net) == 1);
 }
 #endif
@@ -148,7 +154,7 @@ if(get_handle_type(net) == SNARL_HANDLE){
 }
 
 bool SnarlDistanceIndex::is_dag(const net_handle_t& snarl) const {
-    record_t record_type = SnarlTreeRecord(snarl, &snarl_tree_records).get_record_type();
+    record_t record_type = SnarlTreeRecord(snarl, snarl_tree_records.get_local()).get_record_type();
     if ( record_type == SNARL || record_type == ROOT_SNARL ) {
         //If this is a snarl but didn't store distances
         cerr << "warning: checking if a snarl is a dag in an index without distances. Returning true" << endl;
@@ -196,9 +202,9 @@ bool SnarlDistanceIndex::is_dag(const net_handle_t& snarl) const {
 bool SnarlDistanceIndex::is_simple_snarl(const net_handle_t& net) const {
 #ifdef debug_distances
 if(get_handle_type(net) == SNARL_HANDLE){
-    assert(SnarlTreeRecord(net, &snarl_tree_records).get_record_handle_type() == SNARL_HANDLE ||
-        SnarlTreeRecord(net, &snarl_tree_records).get_record_type() == ROOT_SNARL ||
-        SnarlTreeRecord(net, &snarl_tree_records).get_record_type() == DISTANCED_ROOT_SNARL);
+    assert(SnarlTreeRecord(net, snarl_tree_records.get_local()).get_record_handle_type() == SNARL_HANDLE ||
+        SnarlTreeRecord(net, snarl_tree_records.get_local()).get_record_type() == ROOT_SNARL ||
+        SnarlTreeRecord(net, snarl_tree_records.get_local()).get_record_type() == DISTANCED_ROOT_SNARL);
 }
 #endif
     return get_handle_type(net) == SNARL_HANDLE && get_node_record_offset(net) == 1;
@@ -207,9 +213,9 @@ if(get_handle_type(net) == SNARL_HANDLE){
 bool SnarlDistanceIndex::is_regular_snarl(const net_handle_t& net) const {
 #ifdef debug_distances
 if(get_handle_type(net) == SNARL_HANDLE){
-    assert(SnarlTreeRecord(net, &snarl_tree_records).get_record_handle_type() == SNARL_HANDLE ||
-        SnarlTreeRecord(net, &snarl_tree_records).get_record_type() == ROOT_SNARL ||
-        SnarlTreeRecord(net, &snarl_tree_records).get_record_type() == DISTANCED_ROOT_SNARL);
+    assert(SnarlTreeRecord(net, snarl_tree_records.get_local()).get_record_handle_type() == SNARL_HANDLE ||
+        SnarlTreeRecord(net, snarl_tree_records.get_local()).get_record_type() == ROOT_SNARL ||
+        SnarlTreeRecord(net, snarl_tree_records.get_local()).get_record_type() == DISTANCED_ROOT_SNARL);
 }
 #endif
 
@@ -269,10 +275,10 @@ if(get_handle_type(net) == SNARL_HANDLE){
 bool SnarlDistanceIndex::is_chain(const net_handle_t& net) const {
 #ifdef debug_distances
 if (get_handle_type(net) ==CHAIN_HANDLE) {
-    assert(SnarlTreeRecord(net, &snarl_tree_records).get_record_handle_type() == CHAIN_HANDLE ||
-    SnarlTreeRecord(net, &snarl_tree_records).get_record_handle_type() == NODE_HANDLE ||
-    SnarlTreeRecord(net, &snarl_tree_records).get_record_type() == SIMPLE_SNARL ||
-    SnarlTreeRecord(net, &snarl_tree_records).get_record_type() == DISTANCED_SIMPLE_SNARL);
+    assert(SnarlTreeRecord(net, snarl_tree_records.get_local()).get_record_handle_type() == CHAIN_HANDLE ||
+    SnarlTreeRecord(net, snarl_tree_records.get_local()).get_record_handle_type() == NODE_HANDLE ||
+    SnarlTreeRecord(net, snarl_tree_records.get_local()).get_record_type() == SIMPLE_SNARL ||
+    SnarlTreeRecord(net, snarl_tree_records.get_local()).get_record_type() == DISTANCED_SIMPLE_SNARL);
 }
 #endif
     return get_handle_type(net) == CHAIN_HANDLE;
@@ -280,20 +286,20 @@ if (get_handle_type(net) ==CHAIN_HANDLE) {
 bool SnarlDistanceIndex::is_multicomponent_chain(const net_handle_t& net) const {
 #ifdef debug_distances
 if (get_handle_type(net) ==CHAIN_HANDLE) {
-    assert(SnarlTreeRecord(net, &snarl_tree_records).get_record_handle_type() == CHAIN_HANDLE ||
-    SnarlTreeRecord(net, &snarl_tree_records).get_record_handle_type() == NODE_HANDLE ||
-    SnarlTreeRecord(net, &snarl_tree_records).get_record_type() == SIMPLE_SNARL ||
-    SnarlTreeRecord(net, &snarl_tree_records).get_record_type() == DISTANCED_SIMPLE_SNARL);
+    assert(SnarlTreeRecord(net, snarl_tree_records.get_local()).get_record_handle_type() == CHAIN_HANDLE ||
+    SnarlTreeRecord(net, snarl_tree_records.get_local()).get_record_handle_type() == NODE_HANDLE ||
+    SnarlTreeRecord(net, snarl_tree_records.get_local()).get_record_type() == SIMPLE_SNARL ||
+    SnarlTreeRecord(net, snarl_tree_records.get_local()).get_record_type() == DISTANCED_SIMPLE_SNARL);
 }
 #endif
     return get_handle_type(net) == CHAIN_HANDLE 
-        && SnarlTreeRecord(net, &snarl_tree_records).get_record_type() == MULTICOMPONENT_CHAIN;
+        && SnarlTreeRecord(net, snarl_tree_records.get_local()).get_record_type() == MULTICOMPONENT_CHAIN;
 }
 bool SnarlDistanceIndex::is_looping_chain(const net_handle_t& net) const {
     if (!is_chain(net) || is_trivial_chain(net)) {
         return false;
     }
-    ChainRecord chain_record(net, &snarl_tree_records);
+    ChainRecord chain_record(net, snarl_tree_records.get_local());
     return chain_record.get_start_id() == chain_record.get_end_id();
 }
 bool SnarlDistanceIndex::is_ordered_in_chain(const net_handle_t& child1, const net_handle_t& child2) const {
@@ -304,10 +310,10 @@ bool SnarlDistanceIndex::is_ordered_in_chain(const net_handle_t& child1, const n
     }
     /*This is the proper way to do it since it doesn't depend on how I'm storing the children of the chain,
      * but it takes too long so just double check this if anything changes
-    size_t rank1 = is_node(child1) ? TrivialSnarlRecord(get_record_offset(child1), &snarl_tree_records).get_rank_in_parent(get_node_record_offset(child1))
-                                   : SnarlTreeRecord(child1, &snarl_tree_records).get_rank_in_parent();
-    size_t rank2 = is_node(child2) ? TrivialSnarlRecord(get_record_offset(child2), &snarl_tree_records).get_rank_in_parent(get_node_record_offset(child2))
-                                   : SnarlTreeRecord(child2, &snarl_tree_records).get_rank_in_parent();
+    size_t rank1 = is_node(child1) ? TrivialSnarlRecord(get_record_offset(child1), snarl_tree_records.get_local()).get_rank_in_parent(get_node_record_offset(child1))
+                                   : SnarlTreeRecord(child1, snarl_tree_records.get_local()).get_rank_in_parent();
+    size_t rank2 = is_node(child2) ? TrivialSnarlRecord(get_record_offset(child2), snarl_tree_records.get_local()).get_rank_in_parent(get_node_record_offset(child2))
+                                   : SnarlTreeRecord(child2, snarl_tree_records.get_local()).get_rank_in_parent();
      */
 #endif
     size_t rank1 = get_record_offset(child1) + get_node_record_offset(child1);
@@ -319,9 +325,9 @@ bool SnarlDistanceIndex::is_ordered_in_chain(const net_handle_t& child1, const n
 
 bool SnarlDistanceIndex::is_trivial_chain(const net_handle_t& net) const {
     bool handle_is_chain =get_handle_type(net) == CHAIN_HANDLE; 
-    bool record_is_node = SnarlTreeRecord(net, &snarl_tree_records).get_record_handle_type() == NODE_HANDLE;
-    bool record_is_simple_snarl = SnarlTreeRecord(net, &snarl_tree_records).get_record_type() == SIMPLE_SNARL ||
-                    SnarlTreeRecord(net, &snarl_tree_records).get_record_type() == DISTANCED_SIMPLE_SNARL ;
+    bool record_is_node = SnarlTreeRecord(net, snarl_tree_records.get_local()).get_record_handle_type() == NODE_HANDLE;
+    bool record_is_simple_snarl = SnarlTreeRecord(net, snarl_tree_records.get_local()).get_record_type() == SIMPLE_SNARL ||
+                    SnarlTreeRecord(net, snarl_tree_records.get_local()).get_record_type() == DISTANCED_SIMPLE_SNARL ;
     bool handle_has_node_offset = get_node_record_offset(net) >= 2;
     
     return handle_is_chain && (record_is_node
@@ -331,9 +337,9 @@ bool SnarlDistanceIndex::is_trivial_chain(const net_handle_t& net) const {
 bool SnarlDistanceIndex::is_node(const net_handle_t& net) const {
 #ifdef debug_distances 
 if(get_handle_type(net) == NODE_HANDLE){
-    assert( SnarlTreeRecord(net, &snarl_tree_records).get_record_handle_type() == NODE_HANDLE 
-           || SnarlTreeRecord(net, &snarl_tree_records).get_record_type() == SIMPLE_SNARL
-           || SnarlTreeRecord(net, &snarl_tree_records).get_record_type() == DISTANCED_SIMPLE_SNARL );
+    assert( SnarlTreeRecord(net, snarl_tree_records.get_local()).get_record_handle_type() == NODE_HANDLE 
+           || SnarlTreeRecord(net, snarl_tree_records.get_local()).get_record_type() == SIMPLE_SNARL
+           || SnarlTreeRecord(net, snarl_tree_records.get_local()).get_record_type() == DISTANCED_SIMPLE_SNARL );
 }
 #endif
     return get_handle_type(net) == NODE_HANDLE;
@@ -341,9 +347,9 @@ if(get_handle_type(net) == NODE_HANDLE){
 bool SnarlDistanceIndex::is_sentinel(const net_handle_t& net) const {
 #ifdef debug_distances
 if(get_handle_type(net) == SENTINEL_HANDLE){
-    assert(SnarlTreeRecord(net, &snarl_tree_records).get_record_handle_type() == SNARL_HANDLE
-           || SnarlTreeRecord(net, &snarl_tree_records).get_record_type() == SIMPLE_SNARL
-           || SnarlTreeRecord(net, &snarl_tree_records).get_record_type() == DISTANCED_SIMPLE_SNARL);
+    assert(SnarlTreeRecord(net, snarl_tree_records.get_local()).get_record_handle_type() == SNARL_HANDLE
+           || SnarlTreeRecord(net, snarl_tree_records.get_local()).get_record_type() == SIMPLE_SNARL
+           || SnarlTreeRecord(net, snarl_tree_records.get_local()).get_record_type() == DISTANCED_SIMPLE_SNARL);
 }
 #endif
     return get_handle_type(net) == SENTINEL_HANDLE;
@@ -357,7 +363,7 @@ net_handle_t SnarlDistanceIndex::get_net(const handle_t& handle, const handlegra
 }
 handle_t SnarlDistanceIndex::get_handle(const net_handle_t& net, const handlegraph::HandleGraph* graph) const{
     if (get_handle_type(net) == SENTINEL_HANDLE) {
-        SnarlRecord snarl_record(net, &snarl_tree_records);
+        SnarlRecord snarl_record(net, snarl_tree_records.get_local());
         if (starts_at(net) == START) {
             return graph->get_handle(snarl_record.get_start_id(), 
                        ends_at(net) == START ? !snarl_record.get_start_orientation()   //Going out
@@ -414,8 +420,8 @@ net_handle_t SnarlDistanceIndex::get_parent(const net_handle_t& child) const {
     //Otherwise, we need to move up one level in the snarl tree
 
     //Get the pointer to the parent to find its type
-    size_t parent_pointer = SnarlTreeRecord(child, &snarl_tree_records).get_parent_record_offset();
-    net_handle_record_t parent_type = SnarlTreeRecord(parent_pointer, &snarl_tree_records).get_record_handle_type();
+    size_t parent_pointer = SnarlTreeRecord(child, snarl_tree_records.get_local()).get_parent_record_offset();
+    net_handle_record_t parent_type = SnarlTreeRecord(parent_pointer, snarl_tree_records.get_local()).get_record_handle_type();
 
     
     //The connectivity of the parent defaults to start-end
@@ -444,7 +450,7 @@ net_handle_t SnarlDistanceIndex::get_parent(const net_handle_t& child) const {
 
 net_handle_t SnarlDistanceIndex::get_bound(const net_handle_t& snarl, bool get_end, bool face_in) const {
     if (get_handle_type(snarl) == CHAIN_HANDLE) {
-        ChainRecord chain_record(snarl, &snarl_tree_records);
+        ChainRecord chain_record(snarl, snarl_tree_records.get_local());
         size_t offset;
         size_t node_offset;
         bool is_looping_chain=false;
@@ -465,7 +471,7 @@ net_handle_t SnarlDistanceIndex::get_bound(const net_handle_t& snarl, bool get_e
                 node_offset = 0;
                 
             }
-            rev_in_parent = TrivialSnarlRecord(offset, &snarl_tree_records).get_is_reversed_in_parent(node_offset);
+            rev_in_parent = TrivialSnarlRecord(offset, snarl_tree_records.get_local()).get_is_reversed_in_parent(node_offset);
         }
         if (get_end) {
             rev_in_parent = !rev_in_parent;
@@ -501,7 +507,7 @@ net_handle_t SnarlDistanceIndex::get_node_from_sentinel(const net_handle_t& sent
     net_handle_t parent_chain = get_parent(snarl);
     assert(is_chain(parent_chain));
     //The snarl must be in a chain, so the boundary nodes will be the next things on the chain 
-    ChainRecord chain_record(parent_chain, &snarl_tree_records);
+    ChainRecord chain_record(parent_chain, snarl_tree_records.get_local());
 
     net_handle_t next_handle = chain_record.get_next_child(snarl, starts_at(sentinel) == START);
 
@@ -527,7 +533,7 @@ net_handle_t SnarlDistanceIndex::flip(const net_handle_t& net) const {
 }
 
 net_handle_t SnarlDistanceIndex::canonical(const net_handle_t& net) const {
-    SnarlTreeRecord record(net, &snarl_tree_records);
+    SnarlTreeRecord record(net, snarl_tree_records.get_local());
     record_t type = record.get_record_type();
     if (type == ROOT_SNARL || type == DISTANCED_ROOT_SNARL) {
         return get_root();
@@ -569,7 +575,7 @@ size_t SnarlDistanceIndex::get_rank_in_parent(const net_handle_t& net) const {
     size_t tag = snarl_tree_records->at(get_record_offset(net));
     if (get_record_type(tag) == TRIVIAL_SNARL ||
         get_record_type(tag) == DISTANCED_TRIVIAL_SNARL) {
-        return TrivialSnarlRecord(get_record_offset(net), &snarl_tree_records).get_rank_in_parent(get_node_record_offset(net));
+        return TrivialSnarlRecord(get_record_offset(net), snarl_tree_records.get_local()).get_rank_in_parent(get_node_record_offset(net));
     } else if (get_record_type(tag) == SIMPLE_SNARL ||
         get_record_type(tag) == DISTANCED_SIMPLE_SNARL) {
         if (is_snarl(net)) {
@@ -578,12 +584,12 @@ size_t SnarlDistanceIndex::get_rank_in_parent(const net_handle_t& net) const {
             return get_node_record_offset(net);
         }
     } else {
-        return SnarlTreeRecord(net, &snarl_tree_records).get_rank_in_parent();
+        return SnarlTreeRecord(net, snarl_tree_records.get_local()).get_rank_in_parent();
     }
 }
 
 size_t SnarlDistanceIndex::connected_component_count() const {
-    return RootRecord (get_root(), &snarl_tree_records).get_connected_component_count();
+    return RootRecord (get_root(), snarl_tree_records.get_local()).get_connected_component_count();
 }
 
 net_handle_t SnarlDistanceIndex::get_snarl_child_from_rank(const net_handle_t& snarl, const size_t& rank) const {
@@ -595,7 +601,7 @@ net_handle_t SnarlDistanceIndex::get_snarl_child_from_rank(const net_handle_t& s
     } else if (rank == 1) {
         return get_bound(snarl, true, true);
     } else if (is_simple_snarl(snarl) ){
-        return SimpleSnarlRecord(snarl, &snarl_tree_records).get_child_from_rank(rank);
+        return SimpleSnarlRecord(snarl, snarl_tree_records.get_local()).get_child_from_rank(rank);
     } else {
         //Ranks for children of snarls start from 2 since 0 and 1 are reserved for the bounds
 #ifdef debug_distances
@@ -629,15 +635,15 @@ bool SnarlDistanceIndex::for_each_child_impl(const net_handle_t& traversal, cons
     cerr << "Go through children of " << net_handle_as_string(traversal) << endl;
 #endif
     //What is this according to the snarl tree
-    net_handle_record_t record_type = SnarlTreeRecord(traversal, &snarl_tree_records).get_record_handle_type();
+    net_handle_record_t record_type = SnarlTreeRecord(traversal, snarl_tree_records.get_local()).get_record_handle_type();
     //What is this according to the handle 
     //(could be a trivial chain but actually a node according to the snarl tree)
     net_handle_record_t handle_type = get_handle_type(traversal);
     if (record_type == ROOT_HANDLE) {
-        RootRecord root_record(get_root(), &snarl_tree_records);
+        RootRecord root_record(get_root(), snarl_tree_records.get_local());
         return root_record.for_each_child(iteratee);
-    } else if (SnarlTreeRecord(traversal, &snarl_tree_records).get_record_type() == SIMPLE_SNARL ||
-        SnarlTreeRecord(traversal, &snarl_tree_records).get_record_type() == DISTANCED_SIMPLE_SNARL ) {
+    } else if (SnarlTreeRecord(traversal, snarl_tree_records.get_local()).get_record_type() == SIMPLE_SNARL ||
+        SnarlTreeRecord(traversal, snarl_tree_records.get_local()).get_record_type() == DISTANCED_SIMPLE_SNARL ) {
         //If this is a simple snarl then it is a bit different
         if (handle_type == CHAIN_HANDLE) {
             //If the handle thinks it's a chain, then it is a trivial chain in the snarl so we do
@@ -645,15 +651,15 @@ bool SnarlDistanceIndex::for_each_child_impl(const net_handle_t& traversal, cons
             return iteratee(get_net_handle_from_values(get_record_offset(traversal), get_connectivity(traversal), 
                                            NODE_HANDLE, get_node_record_offset(traversal)));
         } else if (handle_type == SNARL_HANDLE) {
-            return SimpleSnarlRecord(traversal, &snarl_tree_records).for_each_child(iteratee);
+            return SimpleSnarlRecord(traversal, snarl_tree_records.get_local()).for_each_child(iteratee);
         } else { 
             throw runtime_error("error: Looking for children of a node or sentinel in a simple snarl");
         }
     } else if (record_type == SNARL_HANDLE) {
-        SnarlRecord snarl_record(traversal, &snarl_tree_records);
+        SnarlRecord snarl_record(traversal, snarl_tree_records.get_local());
         return snarl_record.for_each_child(iteratee);
     } else if (record_type == CHAIN_HANDLE) {
-        ChainRecord chain_record(traversal, &snarl_tree_records);
+        ChainRecord chain_record(traversal, snarl_tree_records.get_local());
         return chain_record.for_each_child(iteratee);
     } else  if (record_type == NODE_HANDLE && handle_type == CHAIN_HANDLE) {
         //This is actually a node but we're pretending it's a chain
@@ -667,6 +673,376 @@ bool SnarlDistanceIndex::for_each_child_impl(const net_handle_t& traversal, cons
    
 }
 
+SnarlDistanceIndex::ChildIterator SnarlDistanceIndex::start_children(const net_handle_t& parent) const {
+    //This follows for_each_child_impl() and the record types' for_each_child()
+    ChildIterator iterator;
+    SnarlTreeRecord record(parent, snarl_tree_records.get_local());
+    net_handle_record_t record_type = record.get_record_handle_type();
+    net_handle_record_t handle_type = get_handle_type(parent);
+    record_t type = record.get_record_type();
+    if (record_type == ROOT_HANDLE) {
+        iterator.kind = ChildIterator::ROOT_CHILDREN;
+        iterator.record_offset = 0;
+        iterator.count = RootRecord(get_root(), snarl_tree_records.get_local()).get_connected_component_count();
+    } else if (type == SIMPLE_SNARL || type == DISTANCED_SIMPLE_SNARL) {
+        if (handle_type == CHAIN_HANDLE) {
+            //A trivial chain in the simple snarl, so its only child is its node
+            iterator.kind = ChildIterator::ONE_CHILD;
+            iterator.next = get_net_handle_from_values(get_record_offset(parent), get_connectivity(parent), 
+                                                       NODE_HANDLE, get_node_record_offset(parent));
+        } else if (handle_type == SNARL_HANDLE) {
+            iterator.kind = ChildIterator::SIMPLE_SNARL_CHILDREN;
+            iterator.record_offset = get_record_offset(parent);
+            iterator.count = SimpleSnarlRecord(parent, snarl_tree_records.get_local()).get_node_count();
+        } else { 
+            throw runtime_error("error: Looking for children of a node or sentinel in a simple snarl");
+        }
+    } else if (record_type == SNARL_HANDLE) {
+        SnarlRecord snarl_record(parent, snarl_tree_records.get_local());
+        iterator.kind = ChildIterator::SNARL_CHILDREN;
+        iterator.count = snarl_record.get_node_count();
+        iterator.child_list_offset = snarl_record.get_child_record_pointer();
+    } else if (record_type == CHAIN_HANDLE) {
+        size_t first_node_offset = ChainRecord(parent, snarl_tree_records.get_local()).get_first_node_offset();
+        bool rev_in_parent = TrivialSnarlRecord(first_node_offset, snarl_tree_records.get_local()).get_is_reversed_in_parent(0);
+        iterator.kind = ChildIterator::CHAIN_CHILDREN;
+        iterator.record_offset = get_record_offset(parent);
+        iterator.first = get_net_handle_from_values(first_node_offset, rev_in_parent ? END_START : START_END, NODE_HANDLE, 0);
+        iterator.next = iterator.first;
+    } else if (record_type == NODE_HANDLE && handle_type == CHAIN_HANDLE) {
+        //This is actually a node but we're pretending it's a chain
+        iterator.kind = ChildIterator::ONE_CHILD;
+        iterator.next = get_net_handle_from_values(get_record_offset(parent), get_connectivity(parent), NODE_HANDLE);
+    } else {
+        throw runtime_error("error: Looking for children of a node or sentinel");
+    }
+    return iterator;
+}
+
+bool SnarlDistanceIndex::next_child(ChildIterator& iterator, net_handle_t& child) const {
+    switch (iterator.kind) {
+    case ChildIterator::DONE:
+        return false;
+    case ChildIterator::ONE_CHILD:
+        child = iterator.next;
+        iterator.kind = ChildIterator::DONE;
+        return true;
+    case ChildIterator::SNARL_CHILDREN:
+        if (iterator.index == iterator.count) {
+            iterator.kind = ChildIterator::DONE;
+            return false;
+        }
+        child = get_net_handle_from_values(snarl_tree_records->at(iterator.child_list_offset + iterator.index), 
+                                           START_END, CHAIN_HANDLE);
+        iterator.index++;
+        return true;
+    case ChildIterator::SIMPLE_SNARL_CHILDREN:
+        if (iterator.index == iterator.count) {
+            iterator.kind = ChildIterator::DONE;
+            return false;
+        }
+        child = get_net_handle_from_values(iterator.record_offset, START_END, CHAIN_HANDLE, iterator.index+2);
+        iterator.index++;
+        return true;
+    case ChildIterator::CHAIN_CHILDREN:
+        {
+            child = iterator.next;
+            //Work out what comes after this child, if anything
+            net_handle_t next_child = ChainRecord(iterator.record_offset, snarl_tree_records.get_local()).get_next_child(child, false);
+            if (child == next_child || get_start_endpoint(get_connectivity(next_child)) == get_end_endpoint(get_connectivity(next_child))
+                || next_child == iterator.first) {
+                //This is the end of the chain, or it loops back around to the first node
+                iterator.kind = ChildIterator::DONE;
+            } else {
+                iterator.next = next_child;
+            }
+            return true;
+        }
+    case ChildIterator::ROOT_CHILDREN:
+        while (true) {
+            if (iterator.root_snarl_index < iterator.root_snarl_count) {
+                //Go through the children of a root snarl
+                child = get_net_handle_from_values(snarl_tree_records->at(iterator.child_list_offset + iterator.root_snarl_index), 
+                                                   START_END, CHAIN_HANDLE);
+                iterator.root_snarl_index++;
+                return true;
+            }
+            if (iterator.index == iterator.count) {
+                iterator.kind = ChildIterator::DONE;
+                return false;
+            }
+            size_t child_offset = snarl_tree_records->at(ROOT_RECORD_SIZE + iterator.index);
+            iterator.index++;
+            SnarlTreeRecord child_record(child_offset, snarl_tree_records.get_local());
+            record_t record_type = child_record.get_record_type();
+            if (record_type == ROOT_SNARL || record_type == DISTANCED_ROOT_SNARL) {
+                //This is a bunch of root components that are connected, so go through each
+                SnarlRecord snarl_record(child_offset, snarl_tree_records.get_local());
+                iterator.child_list_offset = snarl_record.get_child_record_pointer();
+                iterator.root_snarl_index = 0;
+                iterator.root_snarl_count = snarl_record.get_node_count();
+            } else {
+                //Otherwise, it is a separate connected component
+                net_handle_record_t type = child_record.get_record_handle_type();
+                child = get_net_handle_from_values(child_offset, START_END, type == NODE_HANDLE ? CHAIN_HANDLE : type);
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+SnarlDistanceIndex::SnarlTreeCursor::SnarlTreeCursor(const SnarlDistanceIndex& index) : 
+    SnarlTreeCursor(index, index.get_root()) {
+    // Nothing to do
+}
+
+SnarlDistanceIndex::SnarlTreeCursor::SnarlTreeCursor(const SnarlDistanceIndex& index, const net_handle_t& start) : 
+    index(&index), current(start) {
+    // Nothing to do
+}
+
+bool SnarlDistanceIndex::SnarlTreeCursor::next() {
+    if (finished) {
+        return false;
+    }
+    if (!started) {
+        //Visit the start first
+        started = true;
+        return true;
+    }
+    if (!skip && index->get_handle_type(current) != NODE_HANDLE && index->get_handle_type(current) != SENTINEL_HANDLE) {
+        //Go down into the children of where we are
+        stack.emplace_back(index->start_children(current));
+    }
+    skip = false;
+    while (!stack.empty()) {
+        if (index->next_child(stack.back(), current)) {
+            return true;
+        }
+        //This parent is done, so go back up
+        stack.pop_back();
+    }
+    finished = true;
+    return false;
+}
+
+SnarlDistanceIndex::ShortestPathCursor::ShortestPathCursor(const SnarlDistanceIndex& index, const HandleGraph* graph,
+                                                           const handlegraph::nid_t id1, const bool rev1,
+                                                           const handlegraph::nid_t id2, const bool rev2,
+                                                           size_t distance_limit) : 
+    index(&index), graph(graph), current(graph->get_handle(id1, rev1)) {
+
+    path_length = index.minimum_distance(id1, rev1, 0, id2, rev2, 0, false, graph);
+    if (path_length != std::numeric_limits<size_t>::max() && path_length > distance_limit) {
+        path_length = std::numeric_limits<size_t>::max();
+    }
+    //Reading the strand backward, the start of the last node is its last base
+    reverse_end = std::make_tuple(id2, !rev2, graph->get_length(graph->get_handle(id2)) - 1);
+}
+
+bool SnarlDistanceIndex::ShortestPathCursor::next() {
+    if (finished) {
+        return false;
+    }
+    if (!started) {
+        //Visit the start first, if there is a path at all
+        started = true;
+        finished = path_length == std::numeric_limits<size_t>::max();
+        return !finished;
+    }
+    if (distance == path_length) {
+        //We are at the end
+        finished = true;
+        return false;
+    }
+
+    //Every step along a shortest path uses up exactly the length of the node it leaves
+    size_t length = graph->get_length(current);
+    size_t remaining = path_length - distance - length;
+
+    branches.clear();
+    graph->follow_edges(current, false, [&](const handlegraph::handle_t& next) {
+        branches.push_back(next);
+    });
+    if (branches.size() == 1) {
+        //There's nowhere else to go
+        current = branches.front();
+    } else {
+        //The distance from each branch to the end is the distance back from the end to the
+        //branch on the other strand, so one query from the end covers all the branches
+        branch_positions.clear();
+        for (const handlegraph::handle_t& branch : branches) {
+            branch_positions.emplace_back(graph->get_id(branch), !graph->get_is_reverse(branch),
+                                          graph->get_length(branch) - 1);
+        }
+        vector<size_t> distances = index->minimum_distances(std::get<0>(reverse_end), std::get<1>(reverse_end),
+                                                            std::get<2>(reverse_end), branch_positions,
+                                                            remaining, false, graph);
+        size_t i = 0;
+        while (i < branches.size() && distances[i] != remaining) {
+            i++;
+        }
+        if (i == branches.size()) {
+            throw runtime_error("error: Shortest path leaves node " + std::to_string(graph->get_id(current)) 
+                                + " by no edge that the distance index agrees with");
+        }
+        current = branches[i];
+    }
+    distance += length;
+    return true;
+}
+
+SnarlDistanceIndex::ChainSkipIndex::ChainSkipIndex(const SnarlDistanceIndex& index, const net_handle_t& chain,
+                                                   size_t sample_interval) :
+    index(&index), chain(chain), sample_interval(std::max(sample_interval, (size_t) 1)) {
+
+    if (!index.is_chain(chain) || index.is_trivial_chain(chain)) {
+        throw runtime_error("error: trying to make a chain skip index for something that isn't a chain of nodes and snarls");
+    }
+
+    //The smallest loop values in each run of nodes
+    vector<size_t> forward_run_minima;
+    vector<size_t> reverse_run_minima;
+    ChainRecord(chain, &index.snarl_tree_records).for_each_child([&](const net_handle_t& child) {
+        if (!index.is_node(child)) {
+            //Skip the snarls
+            return true;
+        }
+        TrivialSnarlRecord record(get_record_offset(child), &index.snarl_tree_records);
+        size_t prefix_sum, forward_loop, reverse_loop, component;
+        std::tie(prefix_sum, forward_loop, reverse_loop, component) = record.get_chain_values(get_node_record_offset(child));
+        if (node_count % this->sample_interval == 0) {
+            //Start a new run at this node
+            sample_nodes.emplace_back(child);
+            sample_ranks.emplace_back(record.get_rank_in_parent(get_node_record_offset(child)));
+            sample_positions.emplace_back(component, prefix_sum);
+            forward_run_minima.emplace_back(forward_loop);
+            reverse_run_minima.emplace_back(reverse_loop);
+        } else {
+            forward_run_minima.back() = std::min(forward_run_minima.back(), forward_loop);
+            reverse_run_minima.back() = std::min(reverse_run_minima.back(), reverse_loop);
+        }
+        node_count++;
+        return true;
+    });
+
+    //Each level of the sparse tables covers twice as many runs as the one below it
+    auto make_sparse_table = [&](vector<vector<size_t>>& table, vector<size_t>& run_minima) {
+        table.emplace_back(std::move(run_minima));
+        for (size_t span = 1 ; table.back().size() > span ; span *= 2) {
+            const vector<size_t>& below = table.back();
+            vector<size_t> level(below.size() - span);
+            for (size_t i = 0 ; i < level.size() ; i++) {
+                level[i] = std::min(below[i], below[i + span]);
+            }
+            table.emplace_back(std::move(level));
+        }
+    };
+    make_sparse_table(forward_loop_minima, forward_run_minima);
+    make_sparse_table(reverse_loop_minima, reverse_run_minima);
+}
+
+net_handle_t SnarlDistanceIndex::ChainSkipIndex::next_node(const net_handle_t& node) const {
+    ChainRecord chain_record(chain, &index->snarl_tree_records);
+    net_handle_t next = chain_record.get_next_child(node, false);
+    while (!index->is_node(next)) {
+        next = chain_record.get_next_child(next, false);
+    }
+    return next;
+}
+
+size_t SnarlDistanceIndex::ChainSkipIndex::get_node_rank(const net_handle_t& node) const {
+    if (index->is_node(node)) {
+        TrivialSnarlRecord record(get_record_offset(node), &index->snarl_tree_records);
+        record_t type = record.get_record_type();
+        if ((type == TRIVIAL_SNARL || type == DISTANCED_TRIVIAL_SNARL) &&
+            record.get_parent_record_offset() == get_record_offset(chain)) {
+            return record.get_rank_in_parent(get_node_record_offset(node));
+        }
+    }
+    throw runtime_error("error: trying to find a node in a chain skip index for a different chain");
+}
+
+size_t SnarlDistanceIndex::ChainSkipIndex::get_run(size_t rank) const {
+    //The first node has the smallest rank, so there is always a run to find
+    return std::upper_bound(sample_ranks.begin(), sample_ranks.end(), rank) - sample_ranks.begin() - 1;
+}
+
+size_t SnarlDistanceIndex::ChainSkipIndex::walk_min_loop_value(net_handle_t node, size_t last_rank, bool forward) const {
+    size_t min_loop = std::numeric_limits<size_t>::max();
+    while (true) {
+        TrivialSnarlRecord record(get_record_offset(node), &index->snarl_tree_records);
+        size_t node_rank = get_node_record_offset(node);
+        min_loop = std::min(min_loop, forward ? record.get_forward_loop(node_rank) : record.get_reverse_loop(node_rank));
+        if (record.get_rank_in_parent(node_rank) >= last_rank) {
+            return min_loop;
+        }
+        net_handle_t next = next_node(node);
+        if (get_record_offset(next) + get_node_record_offset(next) > last_rank) {
+            return min_loop;
+        }
+        node = next;
+    }
+}
+
+size_t SnarlDistanceIndex::ChainSkipIndex::get_node_ordinal(const net_handle_t& node) const {
+    size_t rank = get_node_rank(node);
+    size_t run = get_run(rank);
+    size_t ordinal = run * sample_interval;
+    net_handle_t current = sample_nodes[run];
+    while (get_record_offset(current) + get_node_record_offset(current) < rank) {
+        current = next_node(current);
+        ordinal++;
+    }
+    return ordinal;
+}
+
+net_handle_t SnarlDistanceIndex::ChainSkipIndex::get_node_at_offset(size_t offset, size_t component) const {
+    pair<size_t, size_t> position(component, offset);
+    size_t run = std::upper_bound(sample_positions.begin(), sample_positions.end(), position) - sample_positions.begin();
+    if (run == 0) {
+        return sample_nodes.front();
+    }
+    run--;
+    net_handle_t current = sample_nodes[run];
+    for (size_t ordinal = run * sample_interval ; ordinal + 1 < node_count ; ordinal++) {
+        net_handle_t next = next_node(current);
+        TrivialSnarlRecord record(get_record_offset(next), &index->snarl_tree_records);
+        size_t prefix_sum, forward_loop, reverse_loop, next_component;
+        std::tie(prefix_sum, forward_loop, reverse_loop, next_component) = record.get_chain_values(get_node_record_offset(next));
+        if (make_pair(next_component, prefix_sum) > position) {
+            break;
+        }
+        current = next;
+    }
+    return current;
+}
+
+size_t SnarlDistanceIndex::ChainSkipIndex::get_min_loop_value(const net_handle_t& node1, const net_handle_t& node2,
+                                                              bool forward) const {
+    size_t rank1 = get_node_rank(node1);
+    size_t rank2 = get_node_rank(node2);
+    const net_handle_t& first = rank1 <= rank2 ? node1 : node2;
+    if (rank1 > rank2) {
+        std::swap(rank1, rank2);
+    }
+    size_t run1 = get_run(rank1);
+    size_t run2 = get_run(rank2);
+    if (run2 <= run1 + 1) {
+        //There are no whole runs in between, so just walk
+        return walk_min_loop_value(first, rank2, forward);
+    }
+
+    //Walk to the end of the first run, look up the whole runs in between, and walk into the last run
+    size_t min_loop = walk_min_loop_value(first, sample_ranks[run1 + 1] - 1, forward);
+    const vector<vector<size_t>>& table = forward ? forward_loop_minima : reverse_loop_minima;
+    size_t run_count = run2 - run1 - 1;
+    size_t level = std::numeric_limits<unsigned long long>::digits - 1 - __builtin_clzll(run_count);
+    min_loop = std::min(min_loop, std::min(table[level][run1 + 1], table[level][run2 - ((size_t) 1 << level)]));
+    return std::min(min_loop, walk_min_loop_value(sample_nodes[run2], rank2, forward));
+}
+
 bool SnarlDistanceIndex::for_each_traversal_impl(const net_handle_t& item, const std::function<bool(const net_handle_t&)>& iteratee) const {
     if (get_handle_type(item) == SENTINEL_HANDLE) {
         if (!iteratee(get_net_handle_from_values(get_record_offset(item), START_END, get_handle_type(item), get_node_record_offset(item)))) {
@@ -677,7 +1053,7 @@ bool SnarlDistanceIndex::for_each_traversal_impl(const net_handle_t& item, const
         }
         return true;
     }
-    SnarlTreeRecord record(item, &snarl_tree_records);
+    SnarlTreeRecord record(item, snarl_tree_records.get_local());
     for ( size_t type = 1 ; type <= 9 ; type ++ ){
         connectivity_t connectivity = static_cast<connectivity_t>(type);
         if (record.has_connectivity(connectivity)) {
@@ -695,8 +1071,8 @@ bool SnarlDistanceIndex::follow_net_edges_impl(const net_handle_t& here, const h
     cerr << "        that is a child of " << net_handle_as_string(get_parent(here)) << endl;
 #endif
 
-    SnarlTreeRecord this_record(here, &snarl_tree_records);
-    SnarlTreeRecord parent_record (get_parent(here), &snarl_tree_records);
+    SnarlTreeRecord this_record(here, snarl_tree_records.get_local());
+    SnarlTreeRecord parent_record (get_parent(here), snarl_tree_records.get_local());
 
     if (parent_record.get_record_handle_type() == ROOT_HANDLE &&
         parent_record.get_record_type() != ROOT_SNARL &&
@@ -829,11 +1205,11 @@ bool SnarlDistanceIndex::follow_net_edges_impl(const net_handle_t& here, const h
                                                            rev ? END_START : START_END, 
                                                            CHAIN_HANDLE);
 #ifdef debug_snarl_traversal
-                    assert(SnarlTreeRecord(get_parent(node_net_handle), &snarl_tree_records).get_record_handle_type() == CHAIN_HANDLE);
+                    assert(SnarlTreeRecord(get_parent(node_net_handle), snarl_tree_records.get_local()).get_record_handle_type() == CHAIN_HANDLE);
                    // assert(get_node_id_from_offset(next_node_record.record_offset) 
-                   //     == SnarlTreeRecord(next_node_record.get_parent_record_offset(), &snarl_tree_records).get_start_id() || 
+                   //     == SnarlTreeRecord(next_node_record.get_parent_record_offset(), snarl_tree_records.get_local()).get_start_id() || 
                    //     get_node_id_from_offset(next_node_record.record_offset) 
-                   //     == SnarlTreeRecord(next_node_record.get_parent_record_offset(), &snarl_tree_records).get_end_id());
+                   //     == SnarlTreeRecord(next_node_record.get_parent_record_offset(), snarl_tree_records.get_local()).get_end_id());
                 cerr << "    -> child chain " << net_handle_as_string(next_net) << endl;
 #endif
                    return iteratee(next_net);
@@ -852,9 +1228,9 @@ bool SnarlDistanceIndex::follow_net_edges_impl(const net_handle_t& here, const h
             return true;
         }
         //If this is a snarl or node, then it is the component of a (possibly pretend) chain
-        ChainRecord parent_chain(this_record.get_parent_record_offset(), &snarl_tree_records);
+        ChainRecord parent_chain(this_record.get_parent_record_offset(), snarl_tree_records.get_local());
         bool go_left_in_chain = go_left ? starts_at(here) == START : ends_at(here) == START;
-        bool is_rev = is_node(here) ? TrivialSnarlRecord(get_record_offset(here), &snarl_tree_records).get_is_reversed_in_parent(get_node_record_offset(here))
+        bool is_rev = is_node(here) ? TrivialSnarlRecord(get_record_offset(here), snarl_tree_records.get_local()).get_is_reversed_in_parent(get_node_record_offset(here))
                                     : false;
         if (is_rev) {
             go_left_in_chain = !go_left_in_chain;
@@ -893,7 +1269,7 @@ net_handle_t SnarlDistanceIndex::get_parent_traversal(const net_handle_t& traver
             throw runtime_error("error: Looking for parent traversal of two non-siblings");
         }
 #endif
-        SnarlTreeRecord parent_record (start_record.get_parent_record_offset(), &snarl_tree_records);
+        SnarlTreeRecord parent_record (start_record.get_parent_record_offset(), snarl_tree_records.get_local());
 #ifdef debug_snarl_traversal
         assert(parent_record.get_record_handle_type() == CHAIN_HANDLE);
 #endif
@@ -972,6 +1348,23 @@ void SnarlDistanceIndex::deserialize(int fd) {
     //This gets called by TriviallySerializable::deserialize(filename), which
     //doesn't check for the prefix, so this should expect it
     snarl_tree_records.load(fd, get_prefix());
+    distance_cache_generation = next_distance_cache_generation();
+    if (use_root_distance_labels) {
+        build_root_distance_labels(nullptr);
+    }
+    if (use_snarl_maximum_distances) {
+        build_snarl_maximum_distances();
+    }
+}
+void SnarlDistanceIndex::deserialize_unmapped(int fd) {
+    snarl_tree_records.load_unmapped(fd, get_prefix());
+    distance_cache_generation = next_distance_cache_generation();
+    if (use_root_distance_labels) {
+        build_root_distance_labels(nullptr);
+    }
+    if (use_snarl_maximum_distances) {
+        build_snarl_maximum_distances();
+    }
 }
 
 void SnarlDistanceIndex::serialize_members(std::ostream& out) const {
@@ -983,6 +1376,13 @@ void SnarlDistanceIndex::deserialize_members(std::istream& in){
     //This gets called by Serializable::deserialize(istream), which has already
     //read the prefix, so don't expect the prefix
     snarl_tree_records.load_after_prefix(in, get_prefix());
+    distance_cache_generation = next_distance_cache_generation();
+    if (use_root_distance_labels) {
+        build_root_distance_labels(nullptr);
+    }
+    if (use_snarl_maximum_distances) {
+        build_snarl_maximum_distances();
+    }
 }
 
 uint32_t SnarlDistanceIndex::get_magic_number()const {
@@ -1004,8 +1404,414 @@ void SnarlDistanceIndex::preload(bool blocking) const {
     snarl_tree_records.preload(blocking);
 }
 
+void SnarlDistanceIndex::advise(bdsg::yomo::Manager::access_hint_t hint) const {
+    snarl_tree_records.advise(hint);
+}
+
+size_t SnarlDistanceIndex::checkpoint(bool blocking) {
+    return snarl_tree_records.checkpoint(blocking);
+}
+
+void SnarlDistanceIndex::replicate_numa() {
+    snarl_tree_records.replicate_numa();
+}
+
+std::pair<size_t, size_t> SnarlDistanceIndex::get_component_record_range(size_t component_number) const {
+    size_t component_count = snarl_tree_records->size() == 0 ? 0
+                           : RootRecord(0, snarl_tree_records.get_local()).get_connected_component_count();
+    if (component_number >= component_count) {
+        throw runtime_error("error: trying to get the records of connected component " + std::to_string(component_number)
+                            + " of an index with " + std::to_string(component_count) + " connected components");
+    }
+    //The components are written depth first one after another, so this component runs until
+    //the next component to start after it
+    size_t start = snarl_tree_records->at(ROOT_RECORD_SIZE + component_number);
+    size_t end = snarl_tree_records->size();
+    for (size_t i = 0 ; i < component_count ; i++) {
+        size_t other_start = snarl_tree_records->at(ROOT_RECORD_SIZE + i);
+        if (other_start > start && other_start < end) {
+            end = other_start;
+        }
+    }
+    return std::make_pair(start, end);
+}
+
+void SnarlDistanceIndex::prefetch_component(size_t component_number, bool blocking) const {
+    std::pair<size_t, size_t> range = get_component_record_range(component_number);
+    snarl_tree_records->preload(range.first, range.second, blocking);
+}
+
+MemoryBreakdown SnarlDistanceIndex::memory_breakdown() const {
+    MemoryBreakdown breakdown("SnarlDistanceIndex");
+    breakdown.add("snarl_tree_records", sizeof(*snarl_tree_records)
+                  + snarl_tree_records->capacity() * snarl_tree_records->width() / 8);
+    
+    size_t total, free, reclaimable;
+    std::tie(total, free, reclaimable) = snarl_tree_records.get_usage();
+    size_t used = total - free;
+    breakdown.add("chain overhead", used > breakdown.bytes ? used - breakdown.bytes : 0);
+    MemoryBreakdown free_breakdown("chain free space");
+    free_breakdown.add("interior", free - reclaimable);
+    free_breakdown.add("reclaimable when closed", reclaimable);
+    breakdown.add(free_breakdown);
+    
+    return breakdown;
+}
+
+void SnarlDistanceIndex::set_distance_cache_size(size_t entries_per_thread) {
+    distance_cache_size = entries_per_thread;
+    distance_cache_generation = next_distance_cache_generation();
+}
+
+size_t SnarlDistanceIndex::get_distance_cache_size() const {
+    return distance_cache_size;
+}
+
+pair<size_t, size_t> SnarlDistanceIndex::get_distance_cache_stats() const {
+    return make_pair(distance_cache_hits.load(std::memory_order_relaxed), 
+                     distance_cache_misses.load(std::memory_order_relaxed));
+}
+
+void SnarlDistanceIndex::reset_distance_cache_stats() {
+    distance_cache_hits.store(0, std::memory_order_relaxed);
+    distance_cache_misses.store(0, std::memory_order_relaxed);
+}
+
+void SnarlDistanceIndex::set_root_distance_labels(bool use_labels, const HandleGraph* graph) {
+    use_root_distance_labels = use_labels;
+    if (use_labels) {
+        build_root_distance_labels(graph);
+    } else {
+        root_distance_labels.clear();
+        root_distance_labels.shrink_to_fit();
+    }
+}
+
+bool SnarlDistanceIndex::has_root_distance_labels() const {
+    return use_root_distance_labels;
+}
+
+void SnarlDistanceIndex::build_root_distance_labels(const HandleGraph* graph) {
+    root_distance_labels.clear();
+    if (snarl_tree_records->size() == 0) {
+        return;
+    }
+    RootRecord root_record (get_root(), snarl_tree_records.get_local());
+    size_t min_node_id = root_record.get_min_node_id();
+    size_t component_count = root_record.get_connected_component_count();
+    root_distance_labels.resize(root_record.get_node_count());
+
+    //Labels of the chains and snarls we've already been through, so each one is only walked up from once
+    std::unordered_map<net_handle_t, RootDistanceLabel> ancestor_labels;
+    //The ancestors on the way up from the current node, and the distances to the ends of their parents
+    vector<pair<net_handle_t, std::array<size_t, 4>>> walked;
+
+    for (size_t i = 0 ; i < root_distance_labels.size() ; i++) {
+        RootDistanceLabel& label = root_distance_labels[i];
+        if (snarl_tree_records->at(get_node_pointer_offset(min_node_id + i, min_node_id, component_count)) == 0) {
+            //There is no node with this ID
+            label.root_record_offset = std::numeric_limits<size_t>::max();
+            continue;
+        }
+
+        //Walk up the snarl tree the same way as minimum_distance(), until we reach the top or
+        //somewhere we've already been
+        net_handle_t child = get_node_net_handle(min_node_id + i);
+        walked.clear();
+        while (true) {
+            auto found = ancestor_labels.find(child);
+            if (found != ancestor_labels.end()) {
+                label = found->second;
+                break;
+            }
+            net_handle_t parent = start_end_traversal_of(get_parent(child));
+            if (is_root(parent)) {
+                label.top = child;
+                label.root_record_offset = get_record_offset(get_parent(child));
+                label.distances[0] = 0;
+                label.distances[1] = std::numeric_limits<size_t>::max();
+                label.distances[2] = std::numeric_limits<size_t>::max();
+                label.distances[3] = 0;
+                if (!is_node(child)) {
+                    ancestor_labels.emplace(child, label);
+                }
+                break;
+            }
+            walked.emplace_back();
+            walked.back().first = child;
+            get_bound_distances(child, parent, walked.back().second.data(), graph);
+            child = parent;
+        }
+
+        //And come back down, going from the ends of each ancestor to the ends of the top
+        for (auto it = walked.rbegin() ; it != walked.rend() ; ++it) {
+            const std::array<size_t, 4>& bounds = it->second;
+            size_t distances[4];
+            distances[0] = std::min(sum(label.distances[0], bounds[0]), sum(label.distances[1], bounds[2]));
+            distances[1] = std::min(sum(label.distances[0], bounds[1]), sum(label.distances[1], bounds[3]));
+            distances[2] = std::min(sum(label.distances[2], bounds[0]), sum(label.distances[3], bounds[2]));
+            distances[3] = std::min(sum(label.distances[2], bounds[1]), sum(label.distances[3], bounds[3]));
+            std::copy(distances, distances + 4, label.distances);
+            if (!is_node(it->first)) {
+                ancestor_labels.emplace(it->first, label);
+            }
+        }
+    }
+}
+
+void SnarlDistanceIndex::set_snarl_maximum_distances(bool use_maximum_distances) {
+    use_snarl_maximum_distances = use_maximum_distances;
+    if (use_maximum_distances) {
+        build_snarl_maximum_distances();
+    } else {
+        snarl_maximum_distance_offsets.clear();
+        snarl_maximum_distances.clear();
+    }
+}
+
+bool SnarlDistanceIndex::has_snarl_maximum_distances() const {
+    return use_snarl_maximum_distances;
+}
+
+void SnarlDistanceIndex::build_snarl_maximum_distances() {
+    snarl_maximum_distance_offsets.clear();
+    PackedVectorBuilder<> builder;
+
+    //The ith side of a snarl is the start bound, then the end bound, then the left and right sides
+    //of each child in rank order
+    auto side_rank = [](size_t side) {
+        return side < 2 ? side : (side + 2) / 2;
+    };
+    auto side_is_right = [](size_t side) {
+        return side >= 2 && (side & 1);
+    };
+
+    //Work out the maximum distances for one snarl, if it is a DAG
+    auto add_snarl = [&](const net_handle_t& snarl) {
+        if (get_record_type(snarl_tree_records->at(get_record_offset(snarl))) != DISTANCED_SNARL || !is_dag(snarl)) {
+            return;
+        }
+        size_t side_count = SnarlRecord(snarl, snarl_tree_records.get_local()).get_node_count() * 2 + 2;
+        vector<size_t> child_lengths (side_count / 2);
+        for (size_t rank = 2 ; rank < child_lengths.size() + 1 ; rank++) {
+            child_lengths[rank - 1] = maximum_length(get_snarl_child_from_rank(snarl, rank));
+        }
+
+        //Sides that are joined by an edge are the ones with a minimum distance of 0
+        vector<vector<size_t>> adjacent (side_count);
+        for (size_t side1 = 0 ; side1 < side_count ; side1++) {
+            for (size_t side2 = side1 ; side2 < side_count ; side2++) {
+                if (distance_in_snarl(snarl, side_rank(side1), side_is_right(side1),
+                                      side_rank(side2), side_is_right(side2)) == 0) {
+                    if (side1 == side2) {
+                        return;
+                    }
+                    adjacent[side1].emplace_back(side2);
+                    adjacent[side2].emplace_back(side1);
+                }
+            }
+        }
+
+        //Leaving through one side of a child can lead to leaving through the other side of another,
+        //so sort the sides we can leave through topologically
+        vector<size_t> in_degree (side_count, 0);
+        for (size_t side = 0 ; side < side_count ; side++) {
+            for (const size_t& next : adjacent[side]) {
+                if (next >= 2) {
+                    in_degree[next ^ 1]++;
+                }
+            }
+        }
+        vector<size_t> order;
+        for (size_t side = 0 ; side < side_count ; side++) {
+            if (in_degree[side] == 0) {
+                order.emplace_back(side);
+            }
+        }
+        for (size_t i = 0 ; i < order.size() ; i++) {
+            for (const size_t& next : adjacent[order[i]]) {
+                if (next >= 2 && --in_degree[next ^ 1] == 0) {
+                    order.emplace_back(next ^ 1);
+                }
+            }
+        }
+        if (order.size() != side_count) {
+            //There is a cycle after all
+            return;
+        }
+
+        //From each side, find the longest walk to everything after it
+        size_t offset = builder.size();
+        vector<size_t> leaving (side_count);
+        vector<size_t> entering (side_count);
+        for (size_t start = 0 ; start < side_count ; start++) {
+            std::fill(leaving.begin(), leaving.end(), std::numeric_limits<size_t>::max());
+            std::fill(entering.begin(), entering.end(), std::numeric_limits<size_t>::max());
+            leaving[start] = 0;
+            for (const size_t& side : order) {
+                if (leaving[side] == std::numeric_limits<size_t>::max()) {
+                    continue;
+                }
+                for (const size_t& next : adjacent[side]) {
+                    entering[next] = maximum(entering[next], leaving[side]);
+                    if (next >= 2) {
+                        leaving[next ^ 1] = maximum(leaving[next ^ 1], sum(leaving[side], child_lengths[side_rank(next) - 1]));
+                    }
+                }
+            }
+            for (size_t end = start ; end < side_count ; end++) {
+                builder.append(entering[end] == std::numeric_limits<size_t>::max() ? 0 : entering[end] + 1);
+            }
+        }
+        snarl_maximum_distance_offsets.emplace(get_record_offset(snarl), offset);
+    };
+
+    //Go through every snarl in the snarl tree
+    std::function<bool(const net_handle_t&)> add_descendants = [&](const net_handle_t& net) {
+        if (is_snarl(net)) {
+            add_snarl(net);
+        }
+        if (is_root(net)) {
+            //A root snarl, whose children are found from its own record
+            return SnarlRecord(get_record_offset(net), snarl_tree_records.get_local()).for_each_child(add_descendants);
+        } else if (!is_node(net)) {
+            return for_each_child(net, add_descendants);
+        }
+        return true;
+    };
+    if (snarl_tree_records->size() != 0) {
+        for_each_child(get_root(), add_descendants);
+    }
+    builder.finalize(snarl_maximum_distances);
+}
+
+size_t SnarlDistanceIndex::get_snarl_maximum_distance(const net_handle_t& snarl, size_t rank1, bool right_side1,
+                                                      size_t rank2, bool right_side2) const {
+    auto found = snarl_maximum_distance_offsets.find(get_record_offset(snarl));
+    if (found == snarl_maximum_distance_offsets.end()) {
+        return std::numeric_limits<size_t>::max();
+    }
+    size_t side_count = SnarlRecord(snarl, snarl_tree_records.get_local()).get_node_count() * 2 + 2;
+    size_t side1 = rank1 < 2 ? rank1 : rank1 * 2 - 2 + right_side1;
+    size_t side2 = rank2 < 2 ? rank2 : rank2 * 2 - 2 + right_side2;
+    if (side1 > side2) {
+        std::swap(side1, side2);
+    }
+    //The matrix is the upper triangle, one row at a time
+    size_t value = snarl_maximum_distances.get(found->second + side1 * side_count - (side1 * (side1 - 1)) / 2 + side2 - side1);
+    return value == 0 ? std::numeric_limits<size_t>::max() : value - 1;
+}
+
+uint64_t SnarlDistanceIndex::next_distance_cache_generation() {
+    static std::atomic<uint64_t> next_generation{1};
+    return next_generation.fetch_add(1, std::memory_order_relaxed);
+}
+
+namespace {
+
+/// One cached distance_in_parent() result
+struct DistanceCacheEntry {
+    net_handle_t parent;
+    net_handle_t child1;
+    net_handle_t child2;
+    const HandleGraph* graph;
+    size_t distance;
+    /// 0 for an empty slot
+    uint64_t generation;
+};
+
+/// A direct-mapped table of distance_in_parent() results for one thread.
+/// Only ever holds results for one index generation at a time.
+struct DistanceCacheTable {
+    vector<DistanceCacheEntry> entries;
+    uint64_t generation = 0;
+    /// Hits and misses not yet added to the index's counters
+    size_t pending_hits = 0;
+    size_t pending_misses = 0;
+};
+
+/// How many indexes each thread keeps a table for, so that a thread going
+/// back and forth between a few indexes doesn't keep starting over
+const size_t DISTANCE_CACHE_TABLE_COUNT = 4;
+
+/// The tables for one thread, replaced round-robin when a thread moves on to
+/// more indexes than it has tables for
+struct DistanceCache {
+    DistanceCacheTable tables[DISTANCE_CACHE_TABLE_COUNT];
+    size_t next_table = 0;
+};
+
+/// How many lookups a thread makes before reporting hit and miss counts
+const size_t DISTANCE_CACHE_REPORT_INTERVAL = 64;
+
+thread_local DistanceCache distance_cache;
+
+}
+
+size_t SnarlDistanceIndex::cached_distance_in_parent(const net_handle_t& parent, const net_handle_t& child1,
+                                                     const net_handle_t& child2, const HandleGraph* graph) const {
+    if (distance_cache_size == 0) {
+        return distance_in_parent(parent, child1, child2, graph);
+    }
+
+    DistanceCacheTable* table = nullptr;
+    for (DistanceCacheTable& candidate : distance_cache.tables) {
+        if (candidate.generation == distance_cache_generation && candidate.entries.size() == distance_cache_size) {
+            table = &candidate;
+            break;
+        }
+    }
+    if (table == nullptr) {
+        // None of our tables are for this index, or they are for an old
+        // version of it, so take over the one whose turn it is and start it
+        // over. Unreported counts belong to an index that may not exist
+        // anymore, so they have to be dropped.
+        table = &distance_cache.tables[distance_cache.next_table];
+        distance_cache.next_table = (distance_cache.next_table + 1) % DISTANCE_CACHE_TABLE_COUNT;
+        table->pending_hits = 0;
+        table->pending_misses = 0;
+        DistanceCacheEntry empty;
+        empty.generation = 0;
+        table->entries.assign(distance_cache_size, empty);
+        table->generation = distance_cache_generation;
+    }
+    DistanceCacheTable& cache = *table;
+
+    size_t slot = std::hash<net_handle_t>()(parent);
+    slot = slot * 0x9E3779B97F4A7C15ull + std::hash<net_handle_t>()(child1);
+    slot = slot * 0x9E3779B97F4A7C15ull + std::hash<net_handle_t>()(child2);
+    slot = slot * 0x9E3779B97F4A7C15ull + (size_t) graph;
+    slot ^= slot >> 29;
+    DistanceCacheEntry& entry = cache.entries[slot % distance_cache_size];
+
+    size_t distance;
+    if (entry.generation == distance_cache_generation && entry.parent == parent 
+        && entry.child1 == child1 && entry.child2 == child2 && entry.graph == graph) {
+        distance = entry.distance;
+        cache.pending_hits++;
+    } else {
+        distance = distance_in_parent(parent, child1, child2, graph);
+        entry.parent = parent;
+        entry.child1 = child1;
+        entry.child2 = child2;
+        entry.graph = graph;
+        entry.distance = distance;
+        entry.generation = distance_cache_generation;
+        cache.pending_misses++;
+    }
+
+    if (cache.pending_hits + cache.pending_misses >= DISTANCE_CACHE_REPORT_INTERVAL) {
+        distance_cache_hits.fetch_add(cache.pending_hits, std::memory_order_relaxed);
+        distance_cache_misses.fetch_add(cache.pending_misses, std::memory_order_relaxed);
+        cache.pending_hits = 0;
+        cache.pending_misses = 0;
+    }
+    return distance;
+}
+
 size_t SnarlDistanceIndex::distance_in_parent(const net_handle_t& parent, 
         const net_handle_t& child1, const net_handle_t& child2, const HandleGraph* graph, size_t distance_limit) const {
+    BDSG_TIME_EVENT(DISTANCE_IN_PARENT);
 
 #ifdef debug_distances
     cerr << "\t\tFind distance between " << net_handle_as_string(child1) 
@@ -1061,7 +1867,7 @@ size_t SnarlDistanceIndex::distance_in_parent(const net_handle_t& parent,
             cerr << "\tsnarl at offset " << parent_record_offset1 << " with ranks " << get_rank_in_parent(child1) << " " << get_rank_in_parent(child2) << endl;
 #endif                                                                                 
             //They are in the same root snarl, so find the distance between them
-            SnarlRecord snarl_record(parent_record_offset1, &snarl_tree_records);
+            SnarlRecord snarl_record(parent_record_offset1, snarl_tree_records.get_local());
 
             return snarl_record.get_distance(get_rank_in_parent(child1), !child_ends_at_start1, 
                                              get_rank_in_parent(child2), !child_ends_at_start2);
@@ -1073,7 +1879,7 @@ size_t SnarlDistanceIndex::distance_in_parent(const net_handle_t& parent,
             get_record_handle_type(get_record_type(snarl_tree_records->at(get_record_offset(parent)))) == SNARL_HANDLE) {
             return std::numeric_limits<size_t>::max();
         }
-        ChainRecord chain_record(parent, &snarl_tree_records);
+        ChainRecord chain_record(parent, snarl_tree_records.get_local());
 #ifdef debug_distances
         assert(is_node(child1) || is_snarl(child1));
         assert(is_node(child2) || is_snarl(child2));
@@ -1117,8 +1923,8 @@ size_t SnarlDistanceIndex::distance_in_parent(const net_handle_t& parent,
                 go_left_in_chain = go_left;
                 node_length = minimum_length(child);
                 std::tie(prefix_sum, forward_loop, reverse_loop, component) = 
-                    TrivialSnarlRecord(get_record_offset(child), &snarl_tree_records).get_chain_values(get_node_record_offset(child));
-                end_component = TrivialSnarlRecord(get_record_offset(child), &snarl_tree_records).get_chain_component(get_node_record_offset(child), true);
+                    TrivialSnarlRecord(get_record_offset(child), snarl_tree_records.get_local()).get_chain_values(get_node_record_offset(child));
+                end_component = TrivialSnarlRecord(get_record_offset(child), snarl_tree_records.get_local()).get_chain_component(get_node_record_offset(child), true);
 
                 
             } else {
@@ -1136,7 +1942,7 @@ size_t SnarlDistanceIndex::distance_in_parent(const net_handle_t& parent,
                     go_left_in_chain = true;
                     node_length = start_length;
                     std::tie(prefix_sum, forward_loop, reverse_loop, component) = 
-                        TrivialSnarlRecord (get_record_offset(start_bound), &snarl_tree_records).get_chain_values(get_node_record_offset(start_bound));
+                        TrivialSnarlRecord (get_record_offset(start_bound), snarl_tree_records.get_local()).get_chain_values(get_node_record_offset(start_bound));
 
                     node_lengths_to_add += start_length;
                 } else {
@@ -1150,7 +1956,7 @@ size_t SnarlDistanceIndex::distance_in_parent(const net_handle_t& parent,
                     go_left_in_chain = false;
                     node_length = end_length;
                     std::tie(prefix_sum, forward_loop, reverse_loop, component) =
-                            TrivialSnarlRecord (get_record_offset(end_bound), &snarl_tree_records).get_chain_values(get_node_record_offset(end_bound));
+                            TrivialSnarlRecord (get_record_offset(end_bound), snarl_tree_records.get_local()).get_chain_values(get_node_record_offset(end_bound));
 
                     node_lengths_to_add += end_length;
                 }
@@ -1209,7 +2015,7 @@ size_t SnarlDistanceIndex::distance_in_parent(const net_handle_t& parent,
 #endif
 
         if (get_record_type(snarl_tree_records->at(get_record_offset(parent))) == DISTANCED_SIMPLE_SNARL) {
-            return SimpleSnarlRecord(parent, &snarl_tree_records).get_distance(rank1, rev1, rank2, rev2);
+            return SimpleSnarlRecord(parent, snarl_tree_records.get_local()).get_distance(rank1, rev1, rank2, rev2);
         } else if (get_record_type(snarl_tree_records->at(get_record_offset(parent))) == OVERSIZED_SNARL 
             && !(rank1 == 0 || rank1 == 1 || rank2 == 0 || rank2 == 1) ) {
             //If this is an oversized snarl and we're looking for internal distances, then we didn't store the
@@ -1247,13 +2053,13 @@ size_t SnarlDistanceIndex::distance_in_parent(const net_handle_t& parent,
             
         } else if (rank1 == 0 && rank2 == 0 && !snarl_is_root) {
             //Start to start is stored in the snarl
-            return SnarlRecord(parent, &snarl_tree_records).get_distance_start_start();
+            return SnarlRecord(parent, snarl_tree_records.get_local()).get_distance_start_start();
         } else if ((rank1 == 0 && rank2 == 1) || (rank1 == 1 && rank2 == 0) && !snarl_is_root) {
             //start to end / end to start is stored in the snarl
-            return SnarlRecord(parent, &snarl_tree_records).get_min_length();
+            return SnarlRecord(parent, snarl_tree_records.get_local()).get_min_length();
         } else if (rank1 == 1 && rank2 == 1 && !snarl_is_root) {
             //end to end is stored in the snarl
-            return SnarlRecord(parent, &snarl_tree_records).get_distance_end_end();
+            return SnarlRecord(parent, snarl_tree_records.get_local()).get_distance_end_end();
         } else if ((rank1 == 0 || rank1 == 1 || rank2 == 0 || rank2 == 1) && !snarl_is_root) {
             //If one node is a boundary and the other is a child
             size_t boundary_rank = (rank1 == 0 || rank1 == 1) ? rank1 : rank2;
@@ -1263,35 +2069,35 @@ size_t SnarlDistanceIndex::distance_in_parent(const net_handle_t& parent,
                 //Child is just a node pretending to be a chain
                 if (boundary_rank == 0 && !internal_is_reversed) {
                     //Start to left of child
-                    return NodeRecord(internal_child, &snarl_tree_records).get_distance_left_start();
+                    return NodeRecord(internal_child, snarl_tree_records.get_local()).get_distance_left_start();
                 } else if (boundary_rank == 0 && internal_is_reversed) {
                     //Start to right of child
-                    return NodeRecord(internal_child, &snarl_tree_records).get_distance_right_start();
+                    return NodeRecord(internal_child, snarl_tree_records.get_local()).get_distance_right_start();
                 } else if (boundary_rank == 1 && !internal_is_reversed) {
                     //End to left of child
-                    return NodeRecord(internal_child, &snarl_tree_records).get_distance_left_end();
+                    return NodeRecord(internal_child, snarl_tree_records.get_local()).get_distance_left_end();
                 } else {
                     //End to right of child
-                    return NodeRecord(internal_child, &snarl_tree_records).get_distance_right_end();
+                    return NodeRecord(internal_child, snarl_tree_records.get_local()).get_distance_right_end();
                 }
             } else {
                 //Child is an actual chain
                 if (boundary_rank == 0 && !internal_is_reversed) {
                     //Start to left of child
-                    return ChainRecord(internal_child, &snarl_tree_records).get_distance_left_start();
+                    return ChainRecord(internal_child, snarl_tree_records.get_local()).get_distance_left_start();
                 } else if (boundary_rank == 0 && internal_is_reversed) {
                     //Start to right of child
-                    return ChainRecord(internal_child, &snarl_tree_records).get_distance_right_start();
+                    return ChainRecord(internal_child, snarl_tree_records.get_local()).get_distance_right_start();
                 } else if (boundary_rank == 1 && !internal_is_reversed) {
                     //End to left of child
-                    return ChainRecord(internal_child, &snarl_tree_records).get_distance_left_end();
+                    return ChainRecord(internal_child, snarl_tree_records.get_local()).get_distance_left_end();
                 } else {
                     //End to right of child
-                    return ChainRecord(internal_child, &snarl_tree_records).get_distance_right_end();
+                    return ChainRecord(internal_child, snarl_tree_records.get_local()).get_distance_right_end();
                 }
             }
         } else {
-           return SnarlRecord(parent, &snarl_tree_records).get_distance(rank1, rev1, rank2, rev2);
+           return SnarlRecord(parent, snarl_tree_records.get_local()).get_distance(rank1, rev1, rank2, rev2);
         }
     } else {
         throw runtime_error("error: Trying to find distance in the wrong type of handle");
@@ -1305,7 +2111,7 @@ size_t SnarlDistanceIndex::distance_in_snarl(const net_handle_t& parent,
     bool snarl_is_root = is_root_snarl(parent);
     
     if (get_record_type(snarl_tree_records->at(get_record_offset(parent))) == DISTANCED_SIMPLE_SNARL) {
-        return SimpleSnarlRecord(parent, &snarl_tree_records).get_distance(rank1, right_side1, rank2, right_side2);
+        return SimpleSnarlRecord(parent, snarl_tree_records.get_local()).get_distance(rank1, right_side1, rank2, right_side2);
     } else if (get_record_type(snarl_tree_records->at(get_record_offset(parent))) == OVERSIZED_SNARL 
         && !(rank1 == 0 || rank1 == 1 || rank2 == 0 || rank2 == 1) ) {
         //If this is an oversized snarl and we're looking for internal distances, then we didn't store the
@@ -1350,13 +2156,13 @@ size_t SnarlDistanceIndex::distance_in_snarl(const net_handle_t& parent,
         
     } else if (rank1 == 0 && rank2 == 0 && !snarl_is_root) {
         //Start to start is stored in the snarl
-        return SnarlRecord(parent, &snarl_tree_records).get_distance_start_start();
+        return SnarlRecord(parent, snarl_tree_records.get_local()).get_distance_start_start();
     } else if (((rank1 == 0 && rank2 == 1) || (rank1 == 1 && rank2 == 0)) && !snarl_is_root) {
         //start to end / end to start is stored in the snarl
-        return SnarlRecord(parent, &snarl_tree_records).get_min_length();
+        return SnarlRecord(parent, snarl_tree_records.get_local()).get_min_length();
     } else if (rank1 == 1 && rank2 == 1 && !snarl_is_root) {
         //end to end is stored in the snarl
-        return SnarlRecord(parent, &snarl_tree_records).get_distance_end_end();
+        return SnarlRecord(parent, snarl_tree_records.get_local()).get_distance_end_end();
     } else if ((rank1 == 0 || rank1 == 1 || rank2 == 0 || rank2 == 1) && !snarl_is_root) {
         //If one node is a boundary and the other is a child
         size_t boundary_rank = (rank1 == 0 || rank1 == 1) ? rank1 : rank2;
@@ -1367,35 +2173,35 @@ size_t SnarlDistanceIndex::distance_in_snarl(const net_handle_t& parent,
             //Child is just a node pretending to be a chain
             if (boundary_rank == 0 && !internal_is_reversed) {
                 //Start to left of child
-                return NodeRecord(internal_child, &snarl_tree_records).get_distance_left_start();
+                return NodeRecord(internal_child, snarl_tree_records.get_local()).get_distance_left_start();
             } else if (boundary_rank == 0 && internal_is_reversed) {
                 //Start to right of child
-                return NodeRecord(internal_child, &snarl_tree_records).get_distance_right_start();
+                return NodeRecord(internal_child, snarl_tree_records.get_local()).get_distance_right_start();
             } else if (boundary_rank == 1 && !internal_is_reversed) {
                 //End to left of child
-                return NodeRecord(internal_child, &snarl_tree_records).get_distance_left_end();
+                return NodeRecord(internal_child, snarl_tree_records.get_local()).get_distance_left_end();
             } else {
                 //End to right of child
-                return NodeRecord(internal_child, &snarl_tree_records).get_distance_right_end();
+                return NodeRecord(internal_child, snarl_tree_records.get_local()).get_distance_right_end();
             }
         } else {
             //Child is an actual chain
             if (boundary_rank == 0 && !internal_is_reversed) {
                 //Start to left of child
-                return ChainRecord(internal_child, &snarl_tree_records).get_distance_left_start();
+                return ChainRecord(internal_child, snarl_tree_records.get_local()).get_distance_left_start();
             } else if (boundary_rank == 0 && internal_is_reversed) {
                 //Start to right of child
-                return ChainRecord(internal_child, &snarl_tree_records).get_distance_right_start();
+                return ChainRecord(internal_child, snarl_tree_records.get_local()).get_distance_right_start();
             } else if (boundary_rank == 1 && !internal_is_reversed) {
                 //End to left of child
-                return ChainRecord(internal_child, &snarl_tree_records).get_distance_left_end();
+                return ChainRecord(internal_child, snarl_tree_records.get_local()).get_distance_left_end();
             } else {
                 //End to right of child
-                return ChainRecord(internal_child, &snarl_tree_records).get_distance_right_end();
+                return ChainRecord(internal_child, snarl_tree_records.get_local()).get_distance_right_end();
             }
         }
     } else {
-       return SnarlRecord(get_record_offset(parent), &snarl_tree_records).get_distance(rank1, right_side1, rank2, right_side2);
+       return SnarlRecord(get_record_offset(parent), snarl_tree_records.get_local()).get_distance(rank1, right_side1, rank2, right_side2);
     }
 
 }
@@ -1421,7 +2227,7 @@ size_t SnarlDistanceIndex::max_distance_in_parent(const net_handle_t& parent,
             get_record_handle_type(get_record_type(snarl_tree_records->at(get_record_offset(parent)))) == SNARL_HANDLE) {
             return std::numeric_limits<size_t>::max();
         }
-        ChainRecord chain_record(parent, &snarl_tree_records);
+        ChainRecord chain_record(parent, snarl_tree_records.get_local());
 #ifdef debug_distances
         assert(is_node(child1) || is_snarl(child1));
         assert(is_node(child2) || is_snarl(child2));
@@ -1465,9 +2271,9 @@ size_t SnarlDistanceIndex::max_distance_in_parent(const net_handle_t& parent,
                 go_left_in_chain = go_left;
                 node_length = minimum_length(child);
                 std::tie(prefix_sum, forward_loop, reverse_loop, component) = 
-                    TrivialSnarlRecord(get_record_offset(child), &snarl_tree_records).get_chain_values(get_node_record_offset(child));
-                prefix_sum = TrivialSnarlRecord(get_record_offset(child), &snarl_tree_records).get_max_prefix_sum(get_node_record_offset(child));
-                end_component = TrivialSnarlRecord(get_record_offset(child), &snarl_tree_records).get_chain_component(get_node_record_offset(child), true);
+                    TrivialSnarlRecord(get_record_offset(child), snarl_tree_records.get_local()).get_chain_values(get_node_record_offset(child));
+                prefix_sum = TrivialSnarlRecord(get_record_offset(child), snarl_tree_records.get_local()).get_max_prefix_sum(get_node_record_offset(child));
+                end_component = TrivialSnarlRecord(get_record_offset(child), snarl_tree_records.get_local()).get_chain_component(get_node_record_offset(child), true);
 
                 
             } else {
@@ -1485,9 +2291,9 @@ size_t SnarlDistanceIndex::max_distance_in_parent(const net_handle_t& parent,
                     go_left_in_chain = true;
                     node_length = start_length;
                     std::tie(prefix_sum, forward_loop, reverse_loop, component) = 
-                        TrivialSnarlRecord (get_record_offset(start_bound), &snarl_tree_records).get_chain_values(get_node_record_offset(start_bound));
+                        TrivialSnarlRecord (get_record_offset(start_bound), snarl_tree_records.get_local()).get_chain_values(get_node_record_offset(start_bound));
 
-                    prefix_sum = TrivialSnarlRecord (get_record_offset(start_bound), &snarl_tree_records).get_max_prefix_sum(get_node_record_offset(start_bound));
+                    prefix_sum = TrivialSnarlRecord (get_record_offset(start_bound), snarl_tree_records.get_local()).get_max_prefix_sum(get_node_record_offset(start_bound));
                     node_lengths_to_add += start_length;
                 } else {
                     //Do the same thing for the snarl end node if we're going forwards
@@ -1500,9 +2306,9 @@ size_t SnarlDistanceIndex::max_distance_in_parent(const net_handle_t& parent,
                     go_left_in_chain = false;
                     node_length = end_length;
                     std::tie(prefix_sum, forward_loop, reverse_loop, component) =
-                            TrivialSnarlRecord (get_record_offset(end_bound), &snarl_tree_records).get_chain_values(get_node_record_offset(end_bound));
+                            TrivialSnarlRecord (get_record_offset(end_bound), snarl_tree_records.get_local()).get_chain_values(get_node_record_offset(end_bound));
 
-                    prefix_sum = TrivialSnarlRecord (get_record_offset(end_bound), &snarl_tree_records).get_max_prefix_sum(get_node_record_offset(end_bound));
+                    prefix_sum = TrivialSnarlRecord (get_record_offset(end_bound), snarl_tree_records.get_local()).get_max_prefix_sum(get_node_record_offset(end_bound));
 
                     node_lengths_to_add += end_length;
                 }
@@ -1530,14 +2336,28 @@ size_t SnarlDistanceIndex::max_distance_in_parent(const net_handle_t& parent,
                                               component2, component2),
                     node_lengths_to_add);
 
-    } else {
-        //If the parent isn't a chain, then just return the minimum
-        return distance_in_parent(parent, child1, child2, graph, distance_limit);
-    }
+    } else if (is_snarl(parent) && snarl_maximum_distance_offsets.count(get_record_offset(parent))) {
+        //If we know the maximum distances in this snarl, find the children's sides the same
+        //way as distance_in_parent()
+        if ((is_sentinel(child1) && starts_at(child1) == ends_at(child1)) ||
+            (is_sentinel(child2) && starts_at(child2) == ends_at(child2)) ) {
+            //If this is a sentinel pointing out of the snarl
+            return std::numeric_limits<size_t>::max();
+        }
+        size_t rank1 = is_sentinel(child1) ? (starts_at(child1) == START ? 0 : 1) : get_rank_in_parent(child1);
+        size_t rank2 = is_sentinel(child2) ? (starts_at(child2) == START ? 0 : 1) : get_rank_in_parent(child2);
+        bool right_side1 = !is_sentinel(child1) && ends_at(child1) != START;
+        bool right_side2 = !is_sentinel(child2) && ends_at(child2) != START;
+        return get_snarl_maximum_distance(parent, rank1, right_side1, rank2, right_side2);
+    } else {
+        //If the parent isn't a chain, then just return the minimum
+        return distance_in_parent(parent, child1, child2, graph, distance_limit);
+    }
 }
 
 size_t SnarlDistanceIndex::distance_to_parent_bound(const net_handle_t& parent, bool to_start, net_handle_t child,
     tuple<net_handle_record_t, net_handle_record_t, net_handle_record_t, net_handle_record_t> parent_and_child_types) const {
+    BDSG_TIME_EVENT(DISTANCE_TO_PARENT_BOUND);
     /* parent_and_child_types is a tuple of parent handle type, parent record type, child handle type, child record type
       * This is really just used to see if the parent and child are trivial chains, so it might not be exactly what 
       * the actual record is
@@ -1596,7 +2416,7 @@ size_t SnarlDistanceIndex::distance_to_parent_bound(const net_handle_t& parent,
             //to the ends of the snarl
     
             if (child_is_trivial_chain) {
-                NodeRecord child_record (child, &snarl_tree_records);
+                NodeRecord child_record (child, snarl_tree_records.get_local());
                 if (child_ends_at_start && to_start) {
                     return child_record.get_distance_left_start();
                 } else if (!child_ends_at_start && to_start) {
@@ -1607,7 +2427,7 @@ size_t SnarlDistanceIndex::distance_to_parent_bound(const net_handle_t& parent,
                     return child_record.get_distance_right_end();
                 }
             } else {
-                ChainRecord child_record (child, &snarl_tree_records);
+                ChainRecord child_record (child, snarl_tree_records.get_local());
                 if (child_ends_at_start && to_start) {
                     return child_record.get_distance_left_start();
                 } else if (!child_ends_at_start && to_start) {
@@ -1661,7 +2481,7 @@ tuple<nid_t, bool, bool> SnarlDistanceIndex::into_which_snarl(const nid_t& id, c
         //If the node is traversed forwards in the parent and we are going backwards (or the opposite),
         //then we are going backwards in the chain
         bool go_left_in_chain = is_reversed_in_parent(node) != reverse;
-        ChainRecord chain_record (parent, &snarl_tree_records);
+        ChainRecord chain_record (parent, snarl_tree_records.get_local());
         net_handle_t next_child = chain_record.get_next_child(node, go_left_in_chain);
         if (is_snarl(next_child)) {
             //If the node points into a snarl
@@ -1689,6 +2509,7 @@ tuple<nid_t, bool, bool> SnarlDistanceIndex::into_which_snarl(const nid_t& id, c
 
 
 pair<net_handle_t, bool> SnarlDistanceIndex::lowest_common_ancestor(const net_handle_t& net1, const net_handle_t& net2) const {
+    BDSG_TIME_EVENT(DISTANCE_LOWEST_COMMON_ANCESTOR);
     net_handle_t parent1 = net1;
     net_handle_t parent2 = net2;
 
@@ -1706,8 +2527,8 @@ pair<net_handle_t, bool> SnarlDistanceIndex::lowest_common_ancestor(const net_ha
 
     bool is_connected = true;
     if (is_root(parent2) && is_root(parent1)){
-        size_t parent_record_offset1 = SnarlTreeRecord(parent1, &snarl_tree_records).get_parent_record_offset();
-        size_t parent_record_offset2 = SnarlTreeRecord(parent2, &snarl_tree_records).get_parent_record_offset();
+        size_t parent_record_offset1 = SnarlTreeRecord(parent1, snarl_tree_records.get_local()).get_parent_record_offset();
+        size_t parent_record_offset2 = SnarlTreeRecord(parent2, snarl_tree_records.get_local()).get_parent_record_offset();
         if (parent_record_offset1 != parent_record_offset2) {
             is_connected = false;
         }
@@ -1719,7 +2540,9 @@ size_t SnarlDistanceIndex::minimum_distance(const handlegraph::nid_t id1, const
                                             const handlegraph::nid_t id2, const bool rev2, const size_t offset2, 
                                             bool unoriented_distance, const HandleGraph* graph, 
                                             pair<vector<tuple<net_handle_t, int32_t, int32_t>>, vector<tuple<net_handle_t, int32_t, int32_t>>>* distance_traceback) const {
-    RootRecord root_record (get_root(), &snarl_tree_records);
+    BDSG_TIME_EVENT(DISTANCE_MINIMUM_DISTANCE);
+    BDSG_COUNT_FAULTS();
+    RootRecord root_record (get_root(), snarl_tree_records.get_local());
     size_t max_node_id = root_record.get_min_node_id() + root_record.get_node_count();
     if (id1 < root_record.get_min_node_id() || id2 < root_record.get_min_node_id() ||
         id1 > max_node_id || id2 > max_node_id) {
@@ -1794,13 +2617,13 @@ size_t SnarlDistanceIndex::minimum_distance(const handlegraph::nid_t id1, const
 
         //Get the distances from the bounds of the parent to the node we're looking at
         size_t distance_start_start = start_bound == net ? 0 
-                : sum(start_length, distance_in_parent(parent, start_bound, flip(net), graph));
+                : sum(start_length, cached_distance_in_parent(parent, start_bound, flip(net), graph));
         size_t distance_start_end = start_bound == flip(net) ? 0 
-                : sum(start_length, distance_in_parent(parent, start_bound, net, graph));
+                : sum(start_length, cached_distance_in_parent(parent, start_bound, net, graph));
         size_t distance_end_start = end_bound == net ? 0 
-                : sum(end_length, distance_in_parent(parent, end_bound, flip(net), graph));
+                : sum(end_length, cached_distance_in_parent(parent, end_bound, flip(net), graph));
         size_t distance_end_end = end_bound == flip(net) ? 0 
-                : sum(end_length, distance_in_parent(parent, end_bound, net, graph));
+                : sum(end_length, cached_distance_in_parent(parent, end_bound, net, graph));
 
         size_t distance_start = dist_start;
         size_t distance_end = dist_end; 
@@ -1855,21 +2678,7 @@ size_t SnarlDistanceIndex::minimum_distance(const handlegraph::nid_t id1, const
      */
     net_handle_t net1 = get_node_net_handle(id1);
     net_handle_t net2 = get_node_net_handle(id2);
-    pair<net_handle_t, bool> lowest_ancestor = lowest_common_ancestor(net1, net2);
-    if (!lowest_ancestor.second) {
-        //If these are not in the same connected component
-#ifdef debug_distances
-        cerr << "These are in different connected components" << endl;
-#endif
-        return std::numeric_limits<size_t>::max();
-    }
-
-    //The lowest common ancestor of the two positions
-    net_handle_t common_ancestor = start_end_traversal_of(lowest_ancestor.first);
 
-#ifdef debug_distances
-        cerr << "Found the lowest common ancestor " << net_handle_as_string(common_ancestor) << endl;
-#endif
     //These are the distances to the ends of the node, including the position
     size_t distance_to_start1 = rev1 ? node_length(net1) - offset1 : offset1 + 1;
     size_t distance_to_end1 = rev1 ? offset1 + 1 : node_length(net1) - offset1;
@@ -1890,6 +2699,53 @@ size_t SnarlDistanceIndex::minimum_distance(const handlegraph::nid_t id1, const
         }
     }
 
+    if (use_root_distance_labels && distance_traceback == nullptr) {
+        size_t label_index1 = id1 - root_record.get_min_node_id();
+        size_t label_index2 = id2 - root_record.get_min_node_id();
+        if (label_index1 < root_distance_labels.size() && label_index2 < root_distance_labels.size()) {
+            const RootDistanceLabel& label1 = root_distance_labels[label_index1];
+            const RootDistanceLabel& label2 = root_distance_labels[label_index2];
+            if (label1.root_record_offset != std::numeric_limits<size_t>::max() &&
+                label2.root_record_offset != std::numeric_limits<size_t>::max()) {
+                if (label1.root_record_offset != label2.root_record_offset) {
+                    //If these are not in the same connected component
+                    return std::numeric_limits<size_t>::max();
+                } else if (label1.top != label2.top) {
+                    //The nodes only meet at the root, so the labels take them straight there
+                    if (get_record_type(snarl_tree_records->at(label1.root_record_offset)) != DISTANCED_ROOT_SNARL) {
+                        return std::numeric_limits<size_t>::max();
+                    }
+                    size_t top_start1 = std::min(sum(label1.distances[0], distance_to_start1), sum(label1.distances[1], distance_to_end1));
+                    size_t top_end1 = std::min(sum(label1.distances[2], distance_to_start1), sum(label1.distances[3], distance_to_end1));
+                    size_t top_start2 = std::min(sum(label2.distances[0], distance_to_start2), sum(label2.distances[1], distance_to_end2));
+                    size_t top_end2 = std::min(sum(label2.distances[2], distance_to_start2), sum(label2.distances[3], distance_to_end2));
+                    net_handle_t root = get_root();
+                    size_t distance = std::min(
+                        std::min(sum(sum(cached_distance_in_parent(root, flip(label1.top), flip(label2.top), graph), top_start1), top_start2),
+                                 sum(sum(cached_distance_in_parent(root, flip(label1.top), label2.top, graph), top_start1), top_end2)),
+                        std::min(sum(sum(cached_distance_in_parent(root, label1.top, flip(label2.top), graph), top_end1), top_start2),
+                                 sum(sum(cached_distance_in_parent(root, label1.top, label2.top, graph), top_end1), top_end2)));
+                    return distance == std::numeric_limits<size_t>::max() ? std::numeric_limits<size_t>::max() : distance - 1;
+                }
+            }
+        }
+    }
+
+    pair<net_handle_t, bool> lowest_ancestor = lowest_common_ancestor(net1, net2);
+    if (!lowest_ancestor.second) {
+        //If these are not in the same connected component
+#ifdef debug_distances
+        cerr << "These are in different connected components" << endl;
+#endif
+        return std::numeric_limits<size_t>::max();
+    }
+
+    //The lowest common ancestor of the two positions
+    net_handle_t common_ancestor = start_end_traversal_of(lowest_ancestor.first);
+
+#ifdef debug_distances
+        cerr << "Found the lowest common ancestor " << net_handle_as_string(common_ancestor) << endl;
+#endif
 #ifdef debug_distances
         cerr << "Starting with distances " << distance_to_start1 << " " << distance_to_end1 << " and " << distance_to_start2 << " " << distance_to_end2 << endl;
 #endif
@@ -1988,10 +2844,10 @@ size_t SnarlDistanceIndex::minimum_distance(const handlegraph::nid_t id1, const
 #endif
 
         //Find the minimum distance between the two children (net1 and net2)
-        size_t distance_start_start = distance_in_parent(common_ancestor, flip(net1), flip(net2), graph);
-        size_t distance_start_end = distance_in_parent(common_ancestor, flip(net1), net2, graph);
-        size_t distance_end_start = distance_in_parent(common_ancestor, net1, flip(net2), graph);
-        size_t distance_end_end = distance_in_parent(common_ancestor, net1, net2, graph);
+        size_t distance_start_start = cached_distance_in_parent(common_ancestor, flip(net1), flip(net2), graph);
+        size_t distance_start_end = cached_distance_in_parent(common_ancestor, flip(net1), net2, graph);
+        size_t distance_end_start = cached_distance_in_parent(common_ancestor, net1, flip(net2), graph);
+        size_t distance_end_end = cached_distance_in_parent(common_ancestor, net1, net2, graph);
 
         size_t old_minimum = minimum_distance;
 
@@ -2140,10 +2996,867 @@ size_t SnarlDistanceIndex::minimum_distance(const handlegraph::nid_t id1, const
 
 
 }
+vector<size_t> SnarlDistanceIndex::minimum_distances(const handlegraph::nid_t id1, const bool rev1, const size_t offset1,
+                                                     const vector<tuple<handlegraph::nid_t, bool, size_t>>& targets,
+                                                     size_t distance_limit, bool unoriented_distance, const HandleGraph* graph) const {
+    RootRecord root_record (get_root(), snarl_tree_records.get_local());
+    size_t max_node_id = root_record.get_min_node_id() + root_record.get_node_count();
+    if (id1 < root_record.get_min_node_id() || id1 > max_node_id) {
+        throw runtime_error("error: Looking for the minimum distance of a node that does not exist");
+    }
+    for (auto& target : targets) {
+        if (std::get<0>(target) < root_record.get_min_node_id() || std::get<0>(target) > max_node_id) {
+            throw runtime_error("error: Looking for the minimum distance of a node that does not exist");
+        }
+    }
+
+    vector<size_t> distances (targets.size(), std::numeric_limits<size_t>::max());
+    if (targets.empty()) {
+        return distances;
+    }
+
+    /*Walk up from net to parent, updating the distances to the ends of net into distances to the ends
+     * of parent. This is the same as the helper in minimum_distance(), without the traceback.*/
+    auto update_distances = [&](const net_handle_t& net, const net_handle_t& parent, size_t& dist_start, size_t& dist_end) {
+        if (is_trivial_chain(parent)) {
+            return;
+        } else if (is_simple_snarl(parent)) {
+            if (is_reversed_in_parent (net)) {
+                std::swap(dist_start, dist_end);
+            }
+            return;
+        }
+        net_handle_t start_bound = get_bound(parent, false, true);
+        net_handle_t end_bound = get_bound(parent, true, true);
+        size_t start_length = is_chain(parent) ? node_length(start_bound) : 0;
+        size_t end_length = is_chain(parent) ? node_length(end_bound) : 0;
+
+        size_t distance_start_start = start_bound == net ? 0 
+                : sum(start_length, cached_distance_in_parent(parent, start_bound, flip(net), graph));
+        size_t distance_start_end = start_bound == flip(net) ? 0 
+                : sum(start_length, cached_distance_in_parent(parent, start_bound, net, graph));
+        size_t distance_end_start = end_bound == net ? 0 
+                : sum(end_length, cached_distance_in_parent(parent, end_bound, flip(net), graph));
+        size_t distance_end_end = end_bound == flip(net) ? 0 
+                : sum(end_length, cached_distance_in_parent(parent, end_bound, net, graph));
+
+        size_t distance_start = dist_start;
+        size_t distance_end = dist_end; 
+        dist_start = std::min(sum(distance_start_start, distance_start), sum(distance_start_end, distance_end));
+        dist_end = std::min(sum(distance_end_start, distance_start), sum(distance_end_end, distance_end));
+    };
+
+    //Distances are measured including both positions, so this is the limit on them
+    size_t inclusive_limit = sum(distance_limit, 1);
+    //Is a best case of lower_bound too far to be worth looking at?
+    auto past_limit = [&](size_t lower_bound) {
+        return lower_bound == std::numeric_limits<size_t>::max() || 
+               (inclusive_limit != std::numeric_limits<size_t>::max() && lower_bound > inclusive_limit);
+    };
+
+    /*
+     * Walk up from the source once. source_levels[i] is the ith ancestor of the source node (counting
+     * the node itself as 0) along with the distances from the source position to its start and end.
+     * Each target walks up to level i on the source side, so only compute levels when something needs them.
+     */
+    net_handle_t source_node = get_node_net_handle(id1);
+    vector<tuple<net_handle_t, size_t, size_t>> source_levels;
+    {
+        size_t distance_to_start = rev1 ? node_length(source_node) - offset1 : offset1 + 1;
+        size_t distance_to_end = rev1 ? offset1 + 1 : node_length(source_node) - offset1;
+        if (!unoriented_distance) {
+            if (rev1) {
+                distance_to_end = std::numeric_limits<size_t>::max();
+            } else {
+                distance_to_start = std::numeric_limits<size_t>::max();
+            }
+        }
+        source_levels.emplace_back(source_node, distance_to_start, distance_to_end);
+    }
+    auto get_source_level = [&](size_t level) -> const tuple<net_handle_t, size_t, size_t>& {
+        while (source_levels.size() <= level) {
+            net_handle_t net = std::get<0>(source_levels.back());
+            net_handle_t parent = start_end_traversal_of(get_parent(net));
+            size_t dist_start = std::get<1>(source_levels.back());
+            size_t dist_end = std::get<2>(source_levels.back());
+            update_distances(net, parent, dist_start, dist_end);
+            source_levels.emplace_back(parent, dist_start, dist_end);
+        }
+        return source_levels[level];
+    };
+
+    //The ancestors of the source, for finding the lowest common ancestor with each target
+    vector<net_handle_t> source_ancestors;
+    net_handle_t source_top = source_node;
+    while (!is_root(source_top)) {
+        source_ancestors.emplace_back(canonical(source_top));
+        source_top = get_parent(source_top);
+    }
+    size_t source_top_parent_offset = SnarlTreeRecord(source_top, snarl_tree_records.get_local()).get_parent_record_offset();
+
+    for (size_t i = 0 ; i < targets.size() ; i++) {
+        net_handle_t net2 = get_node_net_handle(std::get<0>(targets[i]));
+        bool rev2 = std::get<1>(targets[i]);
+        size_t offset2 = std::get<2>(targets[i]);
+
+        //Find the lowest common ancestor, the same way lowest_common_ancestor() does
+        net_handle_t ancestor = net2;
+        while (std::find(source_ancestors.begin(), source_ancestors.end(), canonical(ancestor)) == source_ancestors.end() 
+               && !is_root(ancestor)) {
+            ancestor = get_parent(ancestor);
+        }
+        if (is_root(ancestor) && is_root(source_top) && 
+            SnarlTreeRecord(ancestor, snarl_tree_records.get_local()).get_parent_record_offset() != source_top_parent_offset) {
+            //Not in the same connected component
+            continue;
+        }
+        net_handle_t common_ancestor = start_end_traversal_of(canonical(ancestor));
+
+        size_t distance_to_start2 = rev2 ? node_length(net2) - offset2 : offset2 + 1;
+        size_t distance_to_end2 = rev2 ? offset2 + 1 : node_length(net2) - offset2;
+        if (!unoriented_distance) {
+            if (rev2) {
+                distance_to_start2 = std::numeric_limits<size_t>::max();
+            } else {
+                distance_to_end2 = std::numeric_limits<size_t>::max();
+            }
+        }
+
+        size_t minimum_distance = std::numeric_limits<size_t>::max();
+        size_t source_level = 0;
+        //The best either side could do from here on
+        auto lower_bound = [&]() {
+            auto& level = get_source_level(source_level);
+            return sum(std::min(std::get<1>(level), std::get<2>(level)), 
+                       std::min(distance_to_start2, distance_to_end2));
+        };
+
+        if (start_end_traversal_of(source_node) == start_end_traversal_of(net2)) {
+            //On the same node, so check the distance between them within the node
+            size_t distance_to_start1 = std::get<1>(source_levels[0]);
+            size_t distance_to_end1 = std::get<2>(source_levels[0]);
+            if (sum(distance_to_end1, distance_to_start2) > node_length(source_node) && 
+                sum(distance_to_end1, distance_to_start2) != std::numeric_limits<size_t>::max()) {
+                minimum_distance = minus(sum(distance_to_end1, distance_to_start2), node_length(source_node));
+            }
+            if (sum(distance_to_start1, distance_to_end2) > node_length(source_node) && 
+                sum(distance_to_start1, distance_to_end2) != std::numeric_limits<size_t>::max()) {
+                minimum_distance = std::min(minus(sum(distance_to_start1, distance_to_end2), node_length(source_node)), minimum_distance);
+            }
+            common_ancestor = start_end_traversal_of(get_parent(source_node));
+        } else {
+            //Get both sides up to children of the common ancestor, giving up if they get too far away
+            bool pruned = false;
+            while (!pruned && start_end_traversal_of(get_parent(std::get<0>(get_source_level(source_level)))) != common_ancestor 
+                   && !is_root(get_parent(std::get<0>(get_source_level(source_level))))) {
+                source_level++;
+                pruned = past_limit(lower_bound());
+            }
+            while (!pruned && start_end_traversal_of(get_parent(net2)) != common_ancestor && !is_root(get_parent(net2))) {
+                net_handle_t parent = start_end_traversal_of(get_parent(net2));
+                update_distances(net2, parent, distance_to_start2, distance_to_end2);
+                net2 = parent;
+                pruned = past_limit(lower_bound());
+            }
+            if (pruned) {
+                continue;
+            }
+        }
+
+        //Walk up to the root, checking for distances between the positions within each ancestor
+        while (!is_root(std::get<0>(get_source_level(source_level)))) {
+            if (past_limit(lower_bound())) {
+                //Nothing further up can get any closer
+                break;
+            }
+            net_handle_t net1 = std::get<0>(get_source_level(source_level));
+            size_t distance_to_start1 = std::get<1>(get_source_level(source_level));
+            size_t distance_to_end1 = std::get<2>(get_source_level(source_level));
+
+            size_t distance_start_start, distance_start_end, distance_end_start, distance_end_end;
+            if (distance_limit == std::numeric_limits<size_t>::max()) {
+                distance_start_start = cached_distance_in_parent(common_ancestor, flip(net1), flip(net2), graph);
+                distance_start_end = cached_distance_in_parent(common_ancestor, flip(net1), net2, graph);
+                distance_end_start = cached_distance_in_parent(common_ancestor, net1, flip(net2), graph);
+                distance_end_end = cached_distance_in_parent(common_ancestor, net1, net2, graph);
+            } else {
+                //Let distance_in_parent give up on any traversal that can't come in under the limit
+                size_t parent_limit = inclusive_limit - lower_bound();
+                distance_start_start = distance_in_parent(common_ancestor, flip(net1), flip(net2), graph, parent_limit);
+                distance_start_end = distance_in_parent(common_ancestor, flip(net1), net2, graph, parent_limit);
+                distance_end_start = distance_in_parent(common_ancestor, net1, flip(net2), graph, parent_limit);
+                distance_end_end = distance_in_parent(common_ancestor, net1, net2, graph, parent_limit);
+            }
+
+            minimum_distance = std::min(minimum_distance, 
+                               std::min(sum(sum(distance_start_start , distance_to_start1), distance_to_start2),
+                               std::min(sum(sum(distance_start_end , distance_to_start1), distance_to_end2),
+                               std::min(sum(sum(distance_end_start , distance_to_end1), distance_to_start2),
+                                        sum(sum(distance_end_end , distance_to_end1), distance_to_end2)))));
+
+            if (is_root(common_ancestor)) {
+                break;
+            }
+            //Move both sides up to the ends of the common ancestor
+            source_level++;
+            update_distances(net2, common_ancestor, distance_to_start2, distance_to_end2);
+            net2 = common_ancestor;
+            common_ancestor = start_end_traversal_of(get_parent(common_ancestor));
+        }
+
+        //minimum distance currently includes both positions
+        if (minimum_distance != std::numeric_limits<size_t>::max() && minimum_distance - 1 <= distance_limit) {
+            distances[i] = minimum_distance - 1;
+        }
+    }
+    return distances;
+}
+
+void SnarlDistanceIndex::minimum_distance_pairs(size_t count, const handlegraph::nid_t* ids1, const bool* revs1,
+                                                const size_t* offsets1, const handlegraph::nid_t* ids2,
+                                                const bool* revs2, const size_t* offsets2, size_t* distances,
+                                                bool unoriented_distance, const HandleGraph* graph, bool parallel) const {
+    if (count == 0) {
+        return;
+    }
+
+    //Check all the IDs up front, so nothing gets thrown from inside the parallel loop for a bad query
+    RootRecord root_record (get_root(), snarl_tree_records.get_local());
+    size_t max_node_id = root_record.get_min_node_id() + root_record.get_node_count();
+    for (size_t i = 0 ; i < count ; i++) {
+        if (ids1[i] < root_record.get_min_node_id() || ids2[i] < root_record.get_min_node_id() ||
+            ids1[i] > max_node_id || ids2[i] > max_node_id) {
+            throw runtime_error("error: Looking for the minimum distance of a node that does not exist");
+        }
+    }
+
+    //Exceptions can't leave an OpenMP parallel region, so hold on to the first one and throw it after
+    std::exception_ptr error;
+#pragma omp parallel for schedule(dynamic, 256) if (parallel)
+    for (size_t i = 0 ; i < count ; i++) {
+        try {
+            distances[i] = minimum_distance(ids1[i], revs1[i], offsets1[i], ids2[i], revs2[i], offsets2[i],
+                                            unoriented_distance, graph);
+        } catch (...) {
+#pragma omp critical (minimum_distance_pairs_error)
+            {
+                if (!error) {
+                    error = std::current_exception();
+                }
+            }
+        }
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+vector<size_t> SnarlDistanceIndex::maximum_distances(const handlegraph::nid_t id1, const bool rev1, const size_t offset1,
+                                                     const vector<tuple<handlegraph::nid_t, bool, size_t>>& targets,
+                                                     bool unoriented_distance, const HandleGraph* graph) const {
+    RootRecord root_record (get_root(), snarl_tree_records.get_local());
+    size_t max_node_id = root_record.get_min_node_id() + root_record.get_node_count();
+    if (id1 < root_record.get_min_node_id() || id1 > max_node_id) {
+        throw runtime_error("error: Looking for the maximum distance of a node that does not exist");
+    }
+    for (auto& target : targets) {
+        if (std::get<0>(target) < root_record.get_min_node_id() || std::get<0>(target) > max_node_id) {
+            throw runtime_error("error: Looking for the maximum distance of a node that does not exist");
+        }
+    }
+
+    vector<size_t> distances (targets.size(), std::numeric_limits<size_t>::max());
+    if (targets.empty()) {
+        return distances;
+    }
+
+    /*Walk up from net to parent, updating the distances to the ends of net into distances to the ends
+     * of parent. This is the same as the helper in maximum_distance().*/
+    auto update_distances = [&](const net_handle_t& net, const net_handle_t& parent, size_t& dist_start, size_t& dist_end) {
+        if (is_trivial_chain(parent)) {
+            return;
+        } else if (is_simple_snarl(parent)) {
+            if (is_reversed_in_parent (net)) {
+                std::swap(dist_start, dist_end);
+            }
+            return;
+        }
+        net_handle_t start_bound = get_bound(parent, false, true);
+        net_handle_t end_bound = get_bound(parent, true, true);
+        size_t start_length = is_chain(parent) ? node_length(start_bound) : 0;
+        size_t end_length = is_chain(parent) ? node_length(end_bound) : 0;
+
+        size_t distance_start_start = start_bound == net ? 0 
+                : sum(start_length, max_distance_in_parent(parent, start_bound, flip(net), graph));
+        size_t distance_start_end = start_bound == flip(net) ? 0 
+                : sum(start_length, max_distance_in_parent(parent, start_bound, net, graph));
+        size_t distance_end_start = end_bound == net ? 0 
+                : sum(end_length, max_distance_in_parent(parent, end_bound, flip(net), graph));
+        size_t distance_end_end = end_bound == flip(net) ? 0 
+                : sum(end_length, max_distance_in_parent(parent, end_bound, net, graph));
+
+        size_t distance_start = dist_start;
+        size_t distance_end = dist_end; 
+        dist_start = maximum(sum(distance_start_start, distance_start), sum(distance_start_end, distance_end));
+        dist_end = maximum(sum(distance_end_start, distance_start), sum(distance_end_end, distance_end));
+    };
+
+    /*
+     * Walk up from the source once, as in minimum_distances(). source_levels[i] is the ith ancestor of
+     * the source node along with the maximum distances from the source position to its start and end.
+     */
+    net_handle_t source_node = get_node_net_handle(id1);
+    vector<tuple<net_handle_t, size_t, size_t>> source_levels;
+    {
+        size_t distance_to_start = rev1 ? node_length(source_node) - offset1 : offset1 + 1;
+        size_t distance_to_end = rev1 ? offset1 + 1 : node_length(source_node) - offset1;
+        if (!unoriented_distance) {
+            if (rev1) {
+                distance_to_end = std::numeric_limits<size_t>::max();
+            } else {
+                distance_to_start = std::numeric_limits<size_t>::max();
+            }
+        }
+        source_levels.emplace_back(source_node, distance_to_start, distance_to_end);
+    }
+    auto get_source_level = [&](size_t level) -> const tuple<net_handle_t, size_t, size_t>& {
+        while (source_levels.size() <= level) {
+            net_handle_t net = std::get<0>(source_levels.back());
+            net_handle_t parent = start_end_traversal_of(get_parent(net));
+            size_t dist_start = std::get<1>(source_levels.back());
+            size_t dist_end = std::get<2>(source_levels.back());
+            update_distances(net, parent, dist_start, dist_end);
+            source_levels.emplace_back(parent, dist_start, dist_end);
+        }
+        return source_levels[level];
+    };
+
+    //The ancestors of the source, for finding the lowest common ancestor with each target
+    vector<net_handle_t> source_ancestors;
+    net_handle_t source_top = source_node;
+    while (!is_root(source_top)) {
+        source_ancestors.emplace_back(canonical(source_top));
+        source_top = get_parent(source_top);
+    }
+    size_t source_top_parent_offset = SnarlTreeRecord(source_top, snarl_tree_records.get_local()).get_parent_record_offset();
+
+    for (size_t i = 0 ; i < targets.size() ; i++) {
+        net_handle_t net2 = get_node_net_handle(std::get<0>(targets[i]));
+        bool rev2 = std::get<1>(targets[i]);
+        size_t offset2 = std::get<2>(targets[i]);
+
+        //Find the lowest common ancestor, the same way lowest_common_ancestor() does
+        net_handle_t ancestor = net2;
+        while (std::find(source_ancestors.begin(), source_ancestors.end(), canonical(ancestor)) == source_ancestors.end() 
+               && !is_root(ancestor)) {
+            ancestor = get_parent(ancestor);
+        }
+        if (is_root(ancestor) && is_root(source_top) && 
+            SnarlTreeRecord(ancestor, snarl_tree_records.get_local()).get_parent_record_offset() != source_top_parent_offset) {
+            //Not in the same connected component
+            continue;
+        }
+        net_handle_t common_ancestor = start_end_traversal_of(canonical(ancestor));
+
+        size_t distance_to_start2 = rev2 ? node_length(net2) - offset2 : offset2 + 1;
+        size_t distance_to_end2 = rev2 ? offset2 + 1 : node_length(net2) - offset2;
+        if (!unoriented_distance) {
+            if (rev2) {
+                distance_to_start2 = std::numeric_limits<size_t>::max();
+            } else {
+                distance_to_end2 = std::numeric_limits<size_t>::max();
+            }
+        }
+
+        size_t maximum_distance = std::numeric_limits<size_t>::max();
+        size_t source_level = 0;
+
+        if (start_end_traversal_of(source_node) == start_end_traversal_of(net2)) {
+            //On the same node, so check the distance between them within the node
+            size_t distance_to_start1 = std::get<1>(source_levels[0]);
+            size_t distance_to_end1 = std::get<2>(source_levels[0]);
+            if (sum(distance_to_end1, distance_to_start2) > node_length(source_node) && 
+                sum(distance_to_end1, distance_to_start2) != std::numeric_limits<size_t>::max()) {
+                maximum_distance = minus(sum(distance_to_end1, distance_to_start2), node_length(source_node));
+            }
+            if (sum(distance_to_start1, distance_to_end2) > node_length(source_node) && 
+                sum(distance_to_start1, distance_to_end2) != std::numeric_limits<size_t>::max()) {
+                maximum_distance = maximum(minus(sum(distance_to_start1, distance_to_end2), node_length(source_node)), maximum_distance);
+            }
+            common_ancestor = start_end_traversal_of(get_parent(source_node));
+        } else {
+            //Get both sides up to children of the common ancestor
+            while (start_end_traversal_of(get_parent(std::get<0>(get_source_level(source_level)))) != common_ancestor 
+                   && !is_root(get_parent(std::get<0>(get_source_level(source_level))))) {
+                source_level++;
+            }
+            while (start_end_traversal_of(get_parent(net2)) != common_ancestor && !is_root(get_parent(net2))) {
+                net_handle_t parent = start_end_traversal_of(get_parent(net2));
+                update_distances(net2, parent, distance_to_start2, distance_to_end2);
+                net2 = parent;
+            }
+        }
+
+        //Walk up to the root, checking for distances between the positions within each ancestor
+        while (!is_root(std::get<0>(get_source_level(source_level)))) {
+            net_handle_t net1 = std::get<0>(get_source_level(source_level));
+            size_t distance_to_start1 = std::get<1>(get_source_level(source_level));
+            size_t distance_to_end1 = std::get<2>(get_source_level(source_level));
+
+            size_t distance_start_start = max_distance_in_parent(common_ancestor, flip(net1), flip(net2), graph);
+            size_t distance_start_end = max_distance_in_parent(common_ancestor, flip(net1), net2, graph);
+            size_t distance_end_start = max_distance_in_parent(common_ancestor, net1, flip(net2), graph);
+            size_t distance_end_end = max_distance_in_parent(common_ancestor, net1, net2, graph);
+
+            maximum_distance = maximum(maximum_distance, 
+                               maximum(sum(sum(distance_start_start , distance_to_start1), distance_to_start2),
+                               maximum(sum(sum(distance_start_end , distance_to_start1), distance_to_end2),
+                               maximum(sum(sum(distance_end_start , distance_to_end1), distance_to_start2),
+                                       sum(sum(distance_end_end , distance_to_end1), distance_to_end2)))));
+
+            if (is_root(common_ancestor)) {
+                break;
+            }
+            //Move both sides up to the ends of the common ancestor
+            source_level++;
+            update_distances(net2, common_ancestor, distance_to_start2, distance_to_end2);
+            net2 = common_ancestor;
+            common_ancestor = start_end_traversal_of(get_parent(common_ancestor));
+        }
+
+        //maximum distance currently includes both positions
+        if (maximum_distance != std::numeric_limits<size_t>::max()) {
+            distances[i] = maximum_distance - 1;
+        }
+    }
+    return distances;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//Ancestry codes
+
+AncestryCode::AncestryCode(const std::vector<uint8_t>& bytes) : bytes(bytes) {
+    if (!bytes.empty() && (bytes.back() & msbvarint::MSB)) {
+        throw runtime_error("error:[AncestryCode] ancestry code ends in the middle of a value");
+    }
+}
+
+handlegraph::nid_t AncestryCode::get_node_id() const {
+    if (bytes.empty()) {
+        throw runtime_error("error:[AncestryCode] getting the node ID of an empty ancestry code");
+    }
+    uint64_t node_id = 0;
+    msbvarint::decode(&node_id, const_cast<uint8_t*>(bytes.data()));
+    return node_id;
+}
+
+const std::vector<uint8_t>& AncestryCode::get_bytes() const {
+    return bytes;
+}
+
+void AncestryCode::serialize(std::ostream& out) const {
+    uint64_t size = bytes.size();
+    out.write((const char*) &size, sizeof(size));
+    out.write((const char*) bytes.data(), bytes.size());
+}
+
+void AncestryCode::deserialize(std::istream& in) {
+    uint64_t size = 0;
+    in.read((char*) &size, sizeof(size));
+    std::vector<uint8_t> new_bytes(size);
+    in.read((char*) new_bytes.data(), size);
+    if (!in) {
+        throw runtime_error("error:[AncestryCode] could not read ancestry code");
+    }
+    *this = AncestryCode(new_bytes);
+}
+
+namespace {
+
+//What a level of an ancestry code says about its parent
+const uint64_t ANCESTRY_PARENT_CHAIN = 1;
+const uint64_t ANCESTRY_PARENT_MULTICOMPONENT = 2;
+const uint64_t ANCESTRY_CHILD_NODE = 4;
+
+//The values needed to find a distance in a chain from one side of a child, as found
+//in distance_in_parent()
+struct AncestryChainValues {
+    size_t rank;
+    bool go_left;
+    size_t node_length;
+    size_t prefix_sum;
+    size_t forward_loop;
+    size_t reverse_loop;
+    size_t component;
+    size_t length_to_add;
+};
+
+//One ancestor of the node, and what it takes to get out of its parent
+struct AncestryLevel {
+    //The ancestor as a start-end traversal
+    uint64_t identity;
+    uint64_t flags;
+    //The distances from the ancestor's start and end to the parent's start (0 and 1) and
+    //end (2 and 3), as used by update_distances() in minimum_distance()
+    size_t bounds[4];
+    //The distances in the parent from the ancestor back to itself: start-start, start-end,
+    //end-start and end-end
+    size_t loops[4];
+    //For a parent chain, the chain values of the child traversed forward and backward
+    AncestryChainValues chain_values[2];
+};
+
+struct DecodedAncestryCode {
+    uint64_t node_id;
+    size_t node_length;
+    //The record offset of the root-level parent of the top ancestor
+    uint64_t root;
+    bool root_is_snarl;
+    //From the node up to the child of the root
+    vector<AncestryLevel> levels;
+};
+
+//Distances can be infinite, so they are stored shifted up by one, with 0 for infinity
+inline uint64_t encode_ancestry_distance(size_t distance) {
+    return distance == std::numeric_limits<size_t>::max() ? 0 : distance + 1;
+}
+inline size_t decode_ancestry_distance(uint64_t value) {
+    return value == 0 ? std::numeric_limits<size_t>::max() : value - 1;
+}
+
+DecodedAncestryCode decode_ancestry_code(const vector<uint8_t>& bytes) {
+    uint8_t* ptr = const_cast<uint8_t*>(bytes.data());
+    uint8_t* end = ptr + bytes.size();
+    //The code's constructor made sure that the last byte ends a value, so only the start needs checking
+    auto next = [&]() {
+        if (ptr >= end) {
+            throw runtime_error("error:[AncestryCode] ancestry code is truncated");
+        }
+        uint64_t value = 0;
+        ptr = msbvarint::decode(&value, ptr);
+        return value;
+    };
+
+    DecodedAncestryCode code;
+    code.node_id = next();
+    code.node_length = next();
+    code.root = next();
+    code.root_is_snarl = next();
+    code.levels.resize(next());
+    for (AncestryLevel& level : code.levels) {
+        level.identity = next();
+        level.flags = next();
+        for (size_t& bound : level.bounds) {
+            bound = decode_ancestry_distance(next());
+        }
+        for (size_t& loop : level.loops) {
+            loop = decode_ancestry_distance(next());
+        }
+        if (level.flags & ANCESTRY_PARENT_CHAIN) {
+            for (AncestryChainValues& values : level.chain_values) {
+                values.rank = next();
+                values.go_left = next();
+                values.node_length = next();
+                values.prefix_sum = next();
+                values.forward_loop = decode_ancestry_distance(next());
+                values.reverse_loop = decode_ancestry_distance(next());
+                values.component = next();
+                values.length_to_add = next();
+            }
+        }
+    }
+    return code;
+}
+
+}
+
+void SnarlDistanceIndex::get_bound_distances(const net_handle_t& child, const net_handle_t& parent, size_t* bounds,
+                                             const HandleGraph* graph) const {
+    //This is what update_distances() in minimum_distance() does
+    if (is_trivial_chain(parent)) {
+        bounds[0] = 0;
+        bounds[1] = std::numeric_limits<size_t>::max();
+        bounds[2] = std::numeric_limits<size_t>::max();
+        bounds[3] = 0;
+    } else if (is_simple_snarl(parent)) {
+        bool reversed = is_reversed_in_parent(child);
+        bounds[0] = reversed ? std::numeric_limits<size_t>::max() : 0;
+        bounds[1] = reversed ? 0 : std::numeric_limits<size_t>::max();
+        bounds[2] = reversed ? 0 : std::numeric_limits<size_t>::max();
+        bounds[3] = reversed ? std::numeric_limits<size_t>::max() : 0;
+    } else {
+        net_handle_t start_bound = get_bound(parent, false, true);
+        net_handle_t end_bound = get_bound(parent, true, true);
+        size_t start_length = is_chain(parent) ? node_length(start_bound) : 0;
+        size_t end_length = is_chain(parent) ? node_length(end_bound) : 0;
+        bounds[0] = start_bound == child ? 0
+                : sum(start_length, cached_distance_in_parent(parent, start_bound, flip(child), graph));
+        bounds[1] = start_bound == flip(child) ? 0
+                : sum(start_length, cached_distance_in_parent(parent, start_bound, child, graph));
+        bounds[2] = end_bound == child ? 0
+                : sum(end_length, cached_distance_in_parent(parent, end_bound, flip(child), graph));
+        bounds[3] = end_bound == flip(child) ? 0
+                : sum(end_length, cached_distance_in_parent(parent, end_bound, child, graph));
+    }
+}
+
+AncestryCode SnarlDistanceIndex::get_ancestry_code(const handlegraph::nid_t id, const HandleGraph* graph) const {
+    RootRecord root_record (get_root(), snarl_tree_records.get_local());
+    size_t max_node_id = root_record.get_min_node_id() + root_record.get_node_count();
+    if (id < root_record.get_min_node_id() || id > max_node_id) {
+        throw runtime_error("error: Looking for the ancestry code of a node that does not exist");
+    }
+
+    vector<uint64_t> values;
+    vector<uint64_t> level_values;
+    size_t level_count = 0;
+
+    net_handle_t child = get_node_net_handle(id);
+    values.push_back(id);
+    values.push_back(node_length(child));
+
+    //Walk up the snarl tree the same way as minimum_distance()
+    while (true) {
+        net_handle_t parent = start_end_traversal_of(get_parent(child));
+        bool parent_is_root = is_root(parent);
+
+        bool parent_is_chain = false;
+        bool parent_is_multicomponent = false;
+        if (!parent_is_root && is_chain(parent) &&
+            get_record_handle_type(get_record_type(snarl_tree_records->at(get_record_offset(parent)))) == CHAIN_HANDLE) {
+            ChainRecord chain_record(parent, snarl_tree_records.get_local());
+            //Looping chains need the chain record to go around the loop, so they aren't in the code
+            parent_is_chain = chain_record.get_start_id() != chain_record.get_end_id();
+            parent_is_multicomponent = chain_record.get_record_type() == MULTICOMPONENT_CHAIN;
+        }
+
+        level_values.push_back(as_integer(start_end_traversal_of(child)));
+        level_values.push_back((parent_is_chain ? ANCESTRY_PARENT_CHAIN : 0)
+                               | (parent_is_multicomponent ? ANCESTRY_PARENT_MULTICOMPONENT : 0)
+                               | (is_node(child) ? ANCESTRY_CHILD_NODE : 0));
+
+        size_t bounds[4] = {std::numeric_limits<size_t>::max(), std::numeric_limits<size_t>::max(),
+                            std::numeric_limits<size_t>::max(), std::numeric_limits<size_t>::max()};
+        if (!parent_is_root) {
+            //The distances never get updated at the root
+            get_bound_distances(child, parent, bounds, graph);
+        }
+        for (size_t bound : bounds) {
+            level_values.push_back(encode_ancestry_distance(bound));
+        }
+
+        level_values.push_back(encode_ancestry_distance(cached_distance_in_parent(parent, flip(child), flip(child), graph)));
+        level_values.push_back(encode_ancestry_distance(cached_distance_in_parent(parent, flip(child), child, graph)));
+        level_values.push_back(encode_ancestry_distance(cached_distance_in_parent(parent, child, flip(child), graph)));
+        level_values.push_back(encode_ancestry_distance(cached_distance_in_parent(parent, child, child, graph)));
+
+        if (parent_is_chain) {
+            //Get the chain values for the child going each way, as in distance_in_parent()
+            for (const net_handle_t& traversal : {child, flip(child)}) {
+                bool child_ends_at_start = ends_at(traversal) == START;
+                size_t rank; bool go_left; size_t length;
+                size_t prefix_sum; size_t forward_loop; size_t reverse_loop; size_t component;
+                size_t length_to_add = 0;
+                if (is_node(child)) {
+                    go_left = is_reversed_in_parent(traversal) != child_ends_at_start;
+                    rank = get_rank_in_parent(traversal);
+                    length = minimum_length(traversal);
+                    std::tie(prefix_sum, forward_loop, reverse_loop, component) =
+                        TrivialSnarlRecord(get_record_offset(traversal), snarl_tree_records.get_local()).get_chain_values(get_node_record_offset(traversal));
+                } else {
+                    //For a snarl, use the boundary node on the side we leave it from
+                    net_handle_t bound = get_node_from_sentinel(get_bound(traversal, !child_ends_at_start, false));
+                    go_left = child_ends_at_start;
+                    rank = get_record_offset(bound) + get_node_record_offset(bound);
+                    length = minimum_length(bound);
+                    std::tie(prefix_sum, forward_loop, reverse_loop, component) =
+                        TrivialSnarlRecord(get_record_offset(bound), snarl_tree_records.get_local()).get_chain_values(get_node_record_offset(bound));
+                    length_to_add = length;
+                }
+                level_values.push_back(rank);
+                level_values.push_back(go_left);
+                level_values.push_back(length);
+                level_values.push_back(prefix_sum);
+                level_values.push_back(encode_ancestry_distance(forward_loop));
+                level_values.push_back(encode_ancestry_distance(reverse_loop));
+                level_values.push_back(component);
+                level_values.push_back(length_to_add);
+            }
+        }
+        level_count++;
+
+        if (parent_is_root) {
+            size_t root_offset = get_record_offset(get_parent(child));
+            values.push_back(root_offset);
+            values.push_back(get_record_type(snarl_tree_records->at(root_offset)) == DISTANCED_ROOT_SNARL);
+            break;
+        }
+        child = parent;
+    }
+    values.push_back(level_count);
+    values.insert(values.end(), level_values.begin(), level_values.end());
+
+    AncestryCode code;
+    code.bytes.resize(msbvarint::length(values));
+    msbvarint::encode(values, code.bytes.data());
+    return code;
+}
+
+bool SnarlDistanceIndex::minimum_distance_from_codes(const AncestryCode& code1, const bool rev1, const size_t offset1,
+                                                     const AncestryCode& code2, const bool rev2, const size_t offset2,
+                                                     bool unoriented_distance, size_t& distance) {
+    DecodedAncestryCode ancestry1 = decode_ancestry_code(code1.bytes);
+    DecodedAncestryCode ancestry2 = decode_ancestry_code(code2.bytes);
+
+    if (ancestry1.root != ancestry2.root) {
+        //Different connected components
+        distance = std::numeric_limits<size_t>::max();
+        return true;
+    }
+
+    //Count the ancestors that the nodes share, from the top
+    size_t depth1 = ancestry1.levels.size();
+    size_t depth2 = ancestry2.levels.size();
+    size_t shared = 0;
+    while (shared < depth1 && shared < depth2 &&
+           ancestry1.levels[depth1 - 1 - shared].identity == ancestry2.levels[depth2 - 1 - shared].identity) {
+        shared++;
+    }
+    bool same_node = shared == depth1 && shared == depth2;
+    if (!same_node && (shared == depth1 || shared == depth2)) {
+        //One node can't be an ancestor of the other, so these can't be from the same index
+        throw runtime_error("error:[AncestryCode] ancestry codes are not from the same distance index");
+    }
+    if (shared == 0) {
+        //The nodes only meet at the root
+        if (ancestry1.root_is_snarl) {
+            return false;
+        }
+        distance = std::numeric_limits<size_t>::max();
+        return true;
+    }
+
+    //These are the distances to the ends of the node, including the position, as in minimum_distance()
+    size_t distance_to_start1 = rev1 ? ancestry1.node_length - offset1 : offset1 + 1;
+    size_t distance_to_end1 = rev1 ? offset1 + 1 : ancestry1.node_length - offset1;
+    size_t distance_to_start2 = rev2 ? ancestry2.node_length - offset2 : offset2 + 1;
+    size_t distance_to_end2 = rev2 ? offset2 + 1 : ancestry2.node_length - offset2;
+    if (!unoriented_distance) {
+        if (rev1) {
+            distance_to_end1 = std::numeric_limits<size_t>::max();
+        } else {
+            distance_to_start1 = std::numeric_limits<size_t>::max();
+        }
+        if (rev2) {
+            distance_to_start2 = std::numeric_limits<size_t>::max();
+        } else {
+            distance_to_end2 = std::numeric_limits<size_t>::max();
+        }
+    }
+
+    auto update_distances = [&](const AncestryLevel& level, size_t& dist_start, size_t& dist_end) {
+        size_t new_start = std::min(sum(level.bounds[0], dist_start), sum(level.bounds[1], dist_end));
+        size_t new_end = std::min(sum(level.bounds[2], dist_start), sum(level.bounds[3], dist_end));
+        dist_start = new_start;
+        dist_end = new_end;
+    };
+    auto combine = [&](size_t start_start, size_t start_end, size_t end_start, size_t end_end) {
+        return std::min(std::min(sum(sum(start_start, distance_to_start1), distance_to_start2),
+                                 sum(sum(start_end, distance_to_start1), distance_to_end2)),
+                        std::min(sum(sum(end_start, distance_to_end1), distance_to_start2),
+                                 sum(sum(end_end, distance_to_end1), distance_to_end2)));
+    };
+
+    size_t minimum_distance = std::numeric_limits<size_t>::max();
+
+    //The levels of the two children of the lowest common ancestor
+    size_t child_level1 = same_node ? 0 : depth1 - 1 - shared;
+    size_t child_level2 = same_node ? 0 : depth2 - 1 - shared;
+
+    if (same_node) {
+        size_t length = ancestry1.node_length;
+        if (sum(distance_to_end1, distance_to_start2) > length &&
+            sum(distance_to_end1, distance_to_start2) != std::numeric_limits<size_t>::max()) {
+            minimum_distance = minus(sum(distance_to_end1, distance_to_start2), length);
+        }
+        if (sum(distance_to_start1, distance_to_end2) > length &&
+            sum(distance_to_start1, distance_to_end2) != std::numeric_limits<size_t>::max()) {
+            minimum_distance = std::min(minus(sum(distance_to_start1, distance_to_end2), length), minimum_distance);
+        }
+        const size_t* loops = ancestry1.levels[0].loops;
+        minimum_distance = std::min(minimum_distance, combine(loops[0], loops[1], loops[2], loops[3]));
+    } else {
+        const AncestryLevel& child1 = ancestry1.levels[child_level1];
+        const AncestryLevel& child2 = ancestry2.levels[child_level2];
+        if (!(child1.flags & ANCESTRY_PARENT_CHAIN)) {
+            //The distance between children of a snarl or a looping chain is only in the index
+            return false;
+        }
+
+        for (size_t i = 0 ; i < child_level1 ; i++) {
+            update_distances(ancestry1.levels[i], distance_to_start1, distance_to_end1);
+        }
+        for (size_t i = 0 ; i < child_level2 ; i++) {
+            update_distances(ancestry2.levels[i], distance_to_start2, distance_to_end2);
+        }
+
+        //The distance in the chain between the two children, as in distance_in_parent()
+        bool is_node1 = child1.flags & ANCESTRY_CHILD_NODE;
+        bool is_node2 = child2.flags & ANCESTRY_CHILD_NODE;
+        bool multicomponent = child1.flags & ANCESTRY_PARENT_MULTICOMPONENT;
+        auto distance_in_chain = [&](const AncestryChainValues& values1, const AncestryChainValues& values2) {
+            if (is_node1 != is_node2 && values1.rank == values2.rank && values1.go_left != values2.go_left) {
+                return (size_t) 0;
+            } else if (!is_node1 && !is_node2 && values1.rank == values2.rank && values1.go_left != values2.go_left) {
+                return values2.node_length;
+            }
+            if (multicomponent && values1.component != values2.component) {
+                return std::numeric_limits<size_t>::max();
+            }
+            const AncestryChainValues& first = values1.rank <= values2.rank ? values1 : values2;
+            const AncestryChainValues& second = values1.rank <= values2.rank ? values2 : values1;
+            return sum(ChainRecord::get_distance_in_order(first.rank, first.go_left, first.node_length,
+                                                          first.prefix_sum, first.forward_loop, first.reverse_loop,
+                                                          second.rank, second.go_left, second.node_length,
+                                                          second.prefix_sum, second.forward_loop, second.reverse_loop),
+                       values1.length_to_add + values2.length_to_add);
+        };
+        minimum_distance = combine(distance_in_chain(child1.chain_values[1], child2.chain_values[1]),
+                                   distance_in_chain(child1.chain_values[1], child2.chain_values[0]),
+                                   distance_in_chain(child1.chain_values[0], child2.chain_values[1]),
+                                   distance_in_chain(child1.chain_values[0], child2.chain_values[0]));
+    }
+
+    //Walk up the shared ancestors, checking for paths that leave each one and come back
+    while (child_level1 + 1 < depth1) {
+        update_distances(ancestry1.levels[child_level1], distance_to_start1, distance_to_end1);
+        update_distances(ancestry2.levels[child_level2], distance_to_start2, distance_to_end2);
+        child_level1++;
+        child_level2++;
+        const size_t* loops = ancestry1.levels[child_level1].loops;
+        minimum_distance = std::min(minimum_distance, combine(loops[0], loops[1], loops[2], loops[3]));
+    }
+
+    //minimum distance currently includes both positions
+    distance = minimum_distance == std::numeric_limits<size_t>::max() ? std::numeric_limits<size_t>::max() : minimum_distance - 1;
+    return true;
+}
+
+size_t SnarlDistanceIndex::minimum_distance(const AncestryCode& code1, const bool rev1, const size_t offset1,
+                                            const AncestryCode& code2, const bool rev2, const size_t offset2,
+                                            bool unoriented_distance, const HandleGraph* graph) const {
+    size_t distance;
+    if (minimum_distance_from_codes(code1, rev1, offset1, code2, rev2, offset2, unoriented_distance, distance)) {
+        return distance;
+    }
+    return minimum_distance(code1.get_node_id(), rev1, offset1, code2.get_node_id(), rev2, offset2,
+                            unoriented_distance, graph);
+}
+
 size_t SnarlDistanceIndex::maximum_distance(const handlegraph::nid_t id1, const bool rev1, const size_t offset1, 
                                             const handlegraph::nid_t id2, const bool rev2, const size_t offset2, 
                                             bool unoriented_distance, const HandleGraph* graph) const {
-    RootRecord root_record (get_root(), &snarl_tree_records);
+    RootRecord root_record (get_root(), snarl_tree_records.get_local());
     size_t max_node_id = root_record.get_min_node_id() + root_record.get_node_count();
     if (id1 < root_record.get_min_node_id() || id2 < root_record.get_min_node_id() ||
         id1 > max_node_id || id2 > max_node_id) {
@@ -2368,253 +4081,33 @@ size_t SnarlDistanceIndex::maximum_distance(const handlegraph::nid_t id1, const
 
             //Update which net handles we're looking at
             net1 = common_ancestor;
-            net2 = common_ancestor;
-            common_ancestor = start_end_traversal_of(get_parent(common_ancestor));
-        } else {
-            //Just update this one to break out of the loop
-            net1 = common_ancestor;
-
-        }
-
-#ifdef debug_distances
-            cerr << "  new common ancestor " << net_handle_as_string(common_ancestor) <<  endl;
-            cerr << "  new distances are " << distance_to_start1 << " "  << distance_to_end1 << 
-                    " " << distance_to_start2 << " " <<  distance_to_end2 << endl;
-#endif
-    }
-
-
-    //maximum distance currently includes both positions
-    return maximum_distance == std::numeric_limits<size_t>::max() ? std::numeric_limits<size_t>::max() : maximum_distance-1;
-
-}
-void SnarlDistanceIndex::for_each_handle_in_shortest_path(const handlegraph::nid_t id1, const bool rev1, const handlegraph::nid_t id2, const bool rev2, 
-                                      const HandleGraph* graph, const std::function<bool(const handlegraph::handle_t, size_t)>& iteratee) const {
-    cerr << "This isn't working, use handlegraph::algorithms::for_each_handle_in_shortest_path instead until I fix it" << endl;
-    return;
-
-    /* First, run minimum distance to get the traceback.
-     * The traceback will be a list of ancestors for each node. They will take the format 
-        <net_handle, distance from last child to to start of net, distance to end of net>
-       The distances will be signed, + meaning that the child (the child of the net handle in the tuple) is traversed forward, - for backwards
-       The last entry in both lists will be for the lowest common ancestor that must be traversed to find the minimum distance (not
-       necessarily the actual lowest common ancestor), and the distances will be from either end of the 
-    */
-    pair<vector<tuple<net_handle_t, int32_t, int32_t>>, vector<tuple<net_handle_t, int32_t, int32_t>>> distance_traceback;
-    size_t distance = minimum_distance(id1, rev1, 0, id2, rev2, 0, false,graph, &distance_traceback);
-#ifdef debug_distance_paths
-    cerr << endl << "Find the minimum distance path between " << id1 << (rev1 ? "rev" : "fd") << " and " << id2 << (rev2 ? "rev" : "fd")
-         << " which has distance between them " << distance << endl;
-#endif
-
-
-    /* We can stop now if the minimum_distance was infinite or if the minimum_distance was within one node
-    */
-
-    if (distance_traceback.first.size() == 0 && distance_traceback.second.size() == 0) {
-        //If there was no path between them
-#ifdef debug_distance_paths
-        assert(distance == std::numeric_limits<size_t>::max());
-#endif
-        return;
-    } else if (distance_traceback.first.size() == 1 && distance_traceback.second.size() == 1) {
-        //If there is only one thing in the traceback, then the two positions must be on the same node
-#ifdef debug_distance_paths
-        assert(is_node(std::get<0>(distance_traceback.first.back())));
-        assert(is_node(std::get<0>(distance_traceback.second.back())));
-        assert(std::get<0>(distance_traceback.first.back()) == std::get<0>(distance_traceback.second.back()));
-        assert(id1 == id2);
-        assert(node_id(std::get<0>(distance_traceback.first.back())) == id1);
-#endif
-        return;
-    }
-#ifdef debug_distance_paths
-        assert(distance_traceback.first.size() > 1);
-        assert(distance_traceback.second.size() > 1);
-#endif
-
-
-    /* Otherwise, walk up the snarl tree from the first node (traversing its traceback vector forwards), and at each
-     * ancestor, call for_each_handle_in_shortest_path_in_snarl/chain to get to the boundary nodes, 
-     * then at the common ancestor, traverse between the second to last ancestor in both lists,
-     * then go through the second node's traceback vector backwards, calling for_each_handle_in_shortest_path_in_snarl/chain
-     * to get from the boundary nodes to each child
-    */
-
-    // Start with the first node
-    net_handle_t& current_node = std::get<0>(distance_traceback.first[0]);
-    net_handle_t& current_parent = std::get<0>(distance_traceback.first[1]);
-
-    size_t distance_traversed = 0;
-
-
-    for (size_t i = 1 ; i < distance_traceback.first.size()-1 ; i++) {
-        //Walking up the snarl tree, walk from the current node to the current parent in the given distance
-        //i always points to the current parent that we're finding distances in
-        if (is_trivial_chain(get_parent(current_node))) {
-            current_node = get_parent(current_node);
-        }
-#ifdef debug_distance_paths
-        cerr << "At traceback for first node: " << net_handle_as_string(std::get<0>(distance_traceback.first[i])) << " " << std::get<1>(distance_traceback.first[i]) << " " << std::get<2>(distance_traceback.first[i]) << endl;
-        cerr << "At current node " << net_handle_as_string(current_node) << endl;
-#endif
-
-        //The (signed) distance from the current node to the end of the current parent
-        int32_t distance_to_traverse = std::get<2>(distance_traceback.first[i]) == std::numeric_limits<int32_t>::max() 
-                            ? std::get<1>(distance_traceback.first[i])
-                            :  std::get<2>(distance_traceback.first[i]);
-#ifdef debug_distance_paths
-        assert(distance_to_traverse != std::numeric_limits<int32_t>::max());                                
-#endif
-
-        //The boundary node/sentinel of the parent pointing out of the parent
-        net_handle_t boundary;
-        if (std::get<1>(distance_traceback.first[i]) == std::numeric_limits<int32_t>::max()) {
-            //If we're traversing to the end of the parent
-            boundary = get_bound(current_parent, true, false);
-        } else {
-            //If we're traversing to the beginning of the parent
-            boundary = get_bound(current_parent, false, false);
-        }
-
-        //Make sure the current node is oriented correctly
-        if ((ends_at(current_node) != START && distance_to_traverse < 0) 
-            || (ends_at(current_node) == START && distance_to_traverse >= 0)) {
-            current_node = flip(current_node);
-        }
-        //We don't care about the orientation for the distance anymore so get the actual value
-        distance_to_traverse = distance_to_traverse == std::numeric_limits<int32_t>::min() ? 0 : std::abs(distance_to_traverse);
-
-
-        if (is_chain(current_parent)) {
-            if (current_node != boundary) {
-                //Go from current node to boundary, not including the length of boundary in the distance_to_traverse
-                for_each_handle_in_shortest_path_in_chain(current_parent, current_node, boundary, distance_to_traverse - node_length(boundary), distance_traversed, graph, iteratee, nullptr);
-
-                //Now iteratee() on boundary
-                iteratee(get_handle(boundary, graph), distance_traversed);
-                distance_traversed += minimum_length(boundary);
-                distance_to_traverse -= minimum_length(boundary);
-            }
-        } else {
-            for_each_handle_in_shortest_path_in_snarl(current_parent, current_node, boundary, distance_to_traverse, distance_traversed, graph, iteratee, nullptr);
-        }
-        current_node = current_parent;
-        current_parent = std::get<0>(distance_traceback.first[i+1]);
-    }
-
-    /* Now walk between the two children of the common ancestor */
-
-#ifdef debug_distance_paths
-    assert(current_parent == std::get<0>(distance_traceback.second.back()));
-#endif
-
-    int32_t distance_between = std::get<1>(distance_traceback.first[distance_traceback.first.size()-1]) == std::numeric_limits<int32_t>::max() 
-                             ? std::get<2>(distance_traceback.first[distance_traceback.first.size()-1])
-                             : std::get<1>(distance_traceback.first[distance_traceback.first.size()-1]);
-
-    //Child of the common ancestor for the second node
-    net_handle_t next_node = std::get<0>(distance_traceback.second[distance_traceback.second.size()-2]);
-    if (is_trivial_chain(get_parent(next_node))) {
-        next_node = get_parent(next_node);
-    }
-    if (is_trivial_chain(get_parent(current_node))) {
-        current_node = get_parent(current_node);
-    }
-#ifdef debug_distance_paths
-    cerr << "Finding distance between two children " << net_handle_as_string(current_node) << " and " << net_handle_as_string (next_node) << endl;
-    cerr << "\tdistance should be " << distance_between << endl;
-#endif
-
-    //Make sure the current node is oriented correctly
-    if ((ends_at(current_node) != START && distance_between < 0) 
-        || (ends_at(current_node) == START && distance_between > 0)) {
-        current_node = flip(current_node);
-    } 
-    distance_between = distance_between == std::numeric_limits<int32_t>::min() ? 0 : std::abs(distance_between);
-
-    //And the next node. Based on the last entry in the first node's traceback. The second or third value will 
-    //be inf depending on whether the second node's ancestor is traversed forward or backwards 
-    if ((ends_at(next_node) != START && std::get<1>(distance_traceback.first.back()) == std::numeric_limits<int32_t>::max()) 
-        || (ends_at(next_node) == START && std::get<2>(distance_traceback.first.back()) == std::numeric_limits<int32_t>::max())) {
-#ifdef debug_distance_paths
-        cerr << "Flip next node which is currently: " << net_handle_as_string(next_node) << " because the last traceback for the first node is " 
-             << net_handle_as_string(std::get<0>(distance_traceback.first.back())) << " " 
-             << std::get<1>(distance_traceback.first.back()) << " " << std::get<2>(distance_traceback.first.back()) << endl; 
-#endif
-
-        next_node = flip(next_node);
-    }
-
-    if (is_chain(current_parent)) {
-        for_each_handle_in_shortest_path_in_chain(current_parent, current_node, next_node, distance_between, distance_traversed, graph, iteratee, nullptr);
-    } else {
-        for_each_handle_in_shortest_path_in_snarl(current_parent, current_node, next_node, distance_between, distance_traversed, graph, iteratee, nullptr);
-    }
-
-    /* Now walk down the snarl tree for the second node, finding the distance_to_traverse from the bound of each parent to its child
-     * Start with the parent one below the common ancestor  
-    */
-    current_parent = next_node;
-    if (distance_traceback.second.size() >= 3) {
-        next_node = std::get<0>(distance_traceback.second[distance_traceback.second.size() - 3]);
-    }
-#ifdef debug_distance_paths
-    cerr << "Now walk down node 2 from parent " << net_handle_as_string(current_parent) << " to node " << net_handle_as_string(next_node) << endl;
-#endif
-    for (int i = distance_traceback.second.size() - 2 ; i > 0 ; i--) {
-        assert(i >= 1 && i < distance_traceback.second.size());
-        //Walk down the snarl tree. i points to the current parent, next_node is one below the parent
-        //
-        current_parent = std::get<0>(distance_traceback.second[i]);
-        next_node = std::get<0>(distance_traceback.second[i-1]);
-        if (is_trivial_chain(get_parent(next_node))) {
-            next_node = get_parent(next_node);
-        }
-
-#ifdef debug_distance_paths
-        cerr << "At traceback for second node: " << net_handle_as_string(std::get<0>(distance_traceback.second[i])) << " " << std::get<1>(distance_traceback.second[i]) << " " << std::get<2>(distance_traceback.second[i]) << endl;
-        cerr << "At next node " << net_handle_as_string(next_node) << " with parent " << net_handle_as_string(current_parent) << endl;
-#endif
-
-        //The (signed) distance_to_traverse from the current node to the end of the current parent
-        int32_t distance_to_traverse = std::get<2>(distance_traceback.second[i]) == std::numeric_limits<int32_t>::max() 
-                            ? std::get<1>(distance_traceback.second[i])
-                            :  std::get<2>(distance_traceback.second[i]);
-
-        //The boundary node/sentinel of the parent pointing into the parent
-        net_handle_t boundary;
-        if (std::get<1>(distance_traceback.second[i]) == std::numeric_limits<int32_t>::max()) {
-            //If we're traversing to the end of the parent
-            boundary = get_bound(current_parent, true, true);
+            net2 = common_ancestor;
+            common_ancestor = start_end_traversal_of(get_parent(common_ancestor));
         } else {
-            //If we're traversing to the beginning of the parent
-            boundary = get_bound(current_parent, false, true);
-        }
-
-        //Make sure the current node is oriented correctly
-        if ((ends_at(next_node) == START && distance_to_traverse < 0) 
-            || (ends_at(next_node) != START && distance_to_traverse >= 0)) {
-            next_node = flip(next_node);
-        } 
+            //Just update this one to break out of the loop
+            net1 = common_ancestor;
 
-        //We don't care about the orientation for the distance anymore so get the actual value
-        distance_to_traverse = distance_to_traverse == std::numeric_limits<int32_t>::min() ? 0 : std::abs(distance_to_traverse);
+        }
 
+#ifdef debug_distances
+            cerr << "  new common ancestor " << net_handle_as_string(common_ancestor) <<  endl;
+            cerr << "  new distances are " << distance_to_start1 << " "  << distance_to_end1 << 
+                    " " << distance_to_start2 << " " <<  distance_to_end2 << endl;
+#endif
+    }
 
-        if (is_chain(current_parent)) {
 
-            if (next_node != boundary) {
-                iteratee(get_handle(boundary, graph), distance_traversed);
-                distance_traversed += minimum_length(boundary);
-                distance_to_traverse -= minimum_length(boundary);
+    //maximum distance currently includes both positions
+    return maximum_distance == std::numeric_limits<size_t>::max() ? std::numeric_limits<size_t>::max() : maximum_distance-1;
 
-                for_each_handle_in_shortest_path_in_chain(current_parent, boundary, next_node, distance_to_traverse, distance_traversed, graph, iteratee, nullptr);
-            }
-        } else {
-            for_each_handle_in_shortest_path_in_snarl(current_parent, boundary, next_node, distance_to_traverse, distance_traversed, graph, iteratee, nullptr);
+}
+void SnarlDistanceIndex::for_each_handle_in_shortest_path(const handlegraph::nid_t id1, const bool rev1, const handlegraph::nid_t id2, const bool rev2, 
+                                      const HandleGraph* graph, const std::function<bool(const handlegraph::handle_t, size_t)>& iteratee) const {
+    ShortestPathCursor cursor(*this, graph, id1, rev1, id2, rev2);
+    while (cursor.next()) {
+        if (!iteratee(cursor.get(), cursor.get_distance())) {
+            return;
         }
-
     }
 }
 void SnarlDistanceIndex::for_each_handle_in_shortest_path_in_snarl(const net_handle_t& snarl_handle, net_handle_t start, net_handle_t end,
@@ -2625,7 +4118,7 @@ void SnarlDistanceIndex::for_each_handle_in_shortest_path_in_snarl(const net_han
     size_t target_distance = distance_to_traverse;
     size_t starting_distance = distance_traversed;
     cerr << "Find shortest path in " << net_handle_as_string(snarl_handle) << " from " << net_handle_as_string(start) << " to " << net_handle_as_string(end) << " with distance " << distance_to_traverse << endl;
-    if (SnarlRecord(snarl_handle, &snarl_tree_records).get_record_type() != OVERSIZED_SNARL) {
+    if (SnarlRecord(snarl_handle, snarl_tree_records.get_local()).get_record_type() != OVERSIZED_SNARL) {
         cerr << "\tactual distance is " << distance_in_parent(snarl_handle, start, flip(end)) << endl;
         assert(distance_in_parent(snarl_handle, start, flip(end)) == distance_to_traverse);
     }
@@ -2637,7 +4130,7 @@ void SnarlDistanceIndex::for_each_handle_in_shortest_path_in_snarl(const net_han
      * there will always be only one that is on the minimum distance path.  
     */
 
-    SnarlRecord snarl_record (snarl_handle, &snarl_tree_records);
+    SnarlRecord snarl_record (snarl_handle, snarl_tree_records.get_local());
     if (snarl_record.get_record_type() == OVERSIZED_SNARL) {
         //IF this is an oversized snarl, then we don't have any distance information so use the handlgraph algorithm
         //for traversing the shortest path
@@ -2693,8 +4186,8 @@ void SnarlDistanceIndex::for_each_handle_in_shortest_path_in_snarl(const net_han
             cerr << "Checking next net " << net_handle_as_string(next_net) << " find distance to " << net_handle_as_string(flip(end)) << endl;
             cerr << "Traversed " << distance_traversed << " so far, looking for " << distance_to_traverse << endl;
             bool snarl_is_root = is_root(snarl_handle) || is_root_snarl(snarl_handle) ||
-                           SnarlTreeRecord(snarl_handle, &snarl_tree_records).get_record_type() == ROOT_SNARL ||
-                            SnarlTreeRecord(snarl_handle, &snarl_tree_records).get_record_type() == DISTANCED_ROOT_SNARL;
+                           SnarlTreeRecord(snarl_handle, snarl_tree_records.get_local()).get_record_type() == ROOT_SNARL ||
+                            SnarlTreeRecord(snarl_handle, snarl_tree_records.get_local()).get_record_type() == DISTANCED_ROOT_SNARL;
             if (!is_root(snarl_handle)) {
                 if( (end != get_bound(snarl_handle, true, false) && next ==  get_bound(snarl_handle, true, false))
                 || (end != get_bound(snarl_handle, false, false) && next ==  get_bound(snarl_handle, false, false))) {
@@ -2866,7 +4359,7 @@ void SnarlDistanceIndex::for_each_handle_in_shortest_path_in_chain(const net_han
      * Since I made this recursive and there can be two to_duplicates, only fill in one of them at a time. Prioritize the to_duplicate
      * just created, and when to_duplicate gets duplicated, add the forward and reverse to to_duplicate_recursed
     */
-    ChainRecord chain_record (chain_handle, &snarl_tree_records);
+    ChainRecord chain_record (chain_handle, snarl_tree_records.get_local());
 
     //Are we going left in the chain?
     bool go_left_start = (ends_at(start) != START) == is_reversed_in_parent(start);
@@ -3140,12 +4633,12 @@ void SnarlDistanceIndex::for_each_handle_in_shortest_path_in_chain(const net_han
 size_t SnarlDistanceIndex::node_length(const net_handle_t& net) const {
     if (is_node(net)) {
         if (get_record_type(snarl_tree_records->at(get_record_offset(net))) == DISTANCED_NODE) {
-            return NodeRecord(net, &snarl_tree_records).get_node_length();
+            return NodeRecord(net, snarl_tree_records.get_local()).get_node_length();
         } else if (get_record_type(snarl_tree_records->at(get_record_offset(net))) == DISTANCED_SIMPLE_SNARL) {
-            return SimpleSnarlRecord(net, &snarl_tree_records).get_node_length();
+            return SimpleSnarlRecord(net, snarl_tree_records.get_local()).get_node_length();
         } else {
             assert(get_record_type(snarl_tree_records->at(get_record_offset(net))) == DISTANCED_TRIVIAL_SNARL);
-            return TrivialSnarlRecord(get_record_offset(net), &snarl_tree_records).get_node_length(get_node_record_offset(net));
+            return TrivialSnarlRecord(get_record_offset(net), snarl_tree_records.get_local()).get_node_length(get_node_record_offset(net));
         }
     } else if (is_sentinel(net)) {
         return node_length(get_node_from_sentinel(net));
@@ -3157,20 +4650,20 @@ size_t SnarlDistanceIndex::node_length(const net_handle_t& net) const {
 
 
 size_t SnarlDistanceIndex::minimum_length(const net_handle_t& net) const {
-    if (SnarlTreeRecord(net, &snarl_tree_records).get_record_type() == TRIVIAL_SNARL || 
-        SnarlTreeRecord(net, &snarl_tree_records).get_record_type() == DISTANCED_TRIVIAL_SNARL) {
-        return TrivialSnarlRecord(get_record_offset(net), &snarl_tree_records).get_node_length(get_node_record_offset(net));
-    } else if (SnarlTreeRecord(net, &snarl_tree_records).get_record_type() == SIMPLE_SNARL || 
-               SnarlTreeRecord(net, &snarl_tree_records).get_record_type() == DISTANCED_SIMPLE_SNARL) {
+    if (SnarlTreeRecord(net, snarl_tree_records.get_local()).get_record_type() == TRIVIAL_SNARL || 
+        SnarlTreeRecord(net, snarl_tree_records.get_local()).get_record_type() == DISTANCED_TRIVIAL_SNARL) {
+        return TrivialSnarlRecord(get_record_offset(net), snarl_tree_records.get_local()).get_node_length(get_node_record_offset(net));
+    } else if (SnarlTreeRecord(net, snarl_tree_records.get_local()).get_record_type() == SIMPLE_SNARL || 
+               SnarlTreeRecord(net, snarl_tree_records.get_local()).get_record_type() == DISTANCED_SIMPLE_SNARL) {
         if (is_snarl(net)) {
-            return SimpleSnarlRecord(net, &snarl_tree_records).get_min_length();
+            return SimpleSnarlRecord(net, snarl_tree_records.get_local()).get_min_length();
         } else {
-            return SimpleSnarlRecord(net, &snarl_tree_records).get_node_length();
+            return SimpleSnarlRecord(net, snarl_tree_records.get_local()).get_node_length();
         }
-    } else if (SnarlTreeRecord(net, &snarl_tree_records).get_record_type() == MULTICOMPONENT_CHAIN) {
+    } else if (SnarlTreeRecord(net, snarl_tree_records.get_local()).get_record_type() == MULTICOMPONENT_CHAIN) {
         return std::numeric_limits<size_t>::max();
     } else {
-        return SnarlTreeRecord(net, &snarl_tree_records).get_min_length();
+        return SnarlTreeRecord(net, snarl_tree_records.get_local()).get_min_length();
     }
 }
 
@@ -3179,40 +4672,40 @@ size_t SnarlDistanceIndex::chain_minimum_length(const net_handle_t& net) const {
     assert(is_chain(net));
 #endif
     if (is_trivial_chain(net)) {
-        return NodeRecord(net, &snarl_tree_records).get_node_length();
+        return NodeRecord(net, snarl_tree_records.get_local()).get_node_length();
     } else {
-        return ChainRecord(net, &snarl_tree_records).get_min_length();
+        return ChainRecord(net, snarl_tree_records.get_local()).get_min_length();
     }
 }
 size_t SnarlDistanceIndex::maximum_length(const net_handle_t& net) const {
-    if ((SnarlTreeRecord(net, &snarl_tree_records).get_record_type() == TRIVIAL_SNARL || 
-        SnarlTreeRecord(net, &snarl_tree_records).get_record_type() == DISTANCED_TRIVIAL_SNARL) &&
+    if ((SnarlTreeRecord(net, snarl_tree_records.get_local()).get_record_type() == TRIVIAL_SNARL || 
+        SnarlTreeRecord(net, snarl_tree_records.get_local()).get_record_type() == DISTANCED_TRIVIAL_SNARL) &&
         get_node_record_offset(net) != 0) {
-        return TrivialSnarlRecord(get_record_offset(net), &snarl_tree_records).get_node_length(get_node_record_offset(net));
-    } else if (SnarlTreeRecord(net, &snarl_tree_records).get_record_type() == SIMPLE_SNARL || 
-               SnarlTreeRecord(net, &snarl_tree_records).get_record_type() == DISTANCED_SIMPLE_SNARL) {
+        return TrivialSnarlRecord(get_record_offset(net), snarl_tree_records.get_local()).get_node_length(get_node_record_offset(net));
+    } else if (SnarlTreeRecord(net, snarl_tree_records.get_local()).get_record_type() == SIMPLE_SNARL || 
+               SnarlTreeRecord(net, snarl_tree_records.get_local()).get_record_type() == DISTANCED_SIMPLE_SNARL) {
         if (is_snarl(net)) {
-            return SimpleSnarlRecord(net, &snarl_tree_records).get_max_length();
+            return SimpleSnarlRecord(net, snarl_tree_records.get_local()).get_max_length();
         } else {
-            return SimpleSnarlRecord(net, &snarl_tree_records).get_node_length();
+            return SimpleSnarlRecord(net, snarl_tree_records.get_local()).get_node_length();
         }
     } else {
-        return SnarlTreeRecord(net, &snarl_tree_records).get_max_length();
+        return SnarlTreeRecord(net, snarl_tree_records.get_local()).get_max_length();
     }
 }
 nid_t SnarlDistanceIndex::node_id(const net_handle_t& net) const {
     if (is_node(net) || is_trivial_chain(net)) {
         if (get_record_type(snarl_tree_records->at(get_record_offset(net))) == NODE 
             || get_record_type(snarl_tree_records->at(get_record_offset(net))) == DISTANCED_NODE) {
-            return NodeRecord(net, &snarl_tree_records).get_node_id();
+            return NodeRecord(net, snarl_tree_records.get_local()).get_node_id();
         }  else if (get_record_type(snarl_tree_records->at(get_record_offset(net))) == SIMPLE_SNARL
                  || get_record_type(snarl_tree_records->at(get_record_offset(net))) == DISTANCED_SIMPLE_SNARL) {
-            return SimpleSnarlRecord(net, &snarl_tree_records).get_node_id();
+            return SimpleSnarlRecord(net, snarl_tree_records.get_local()).get_node_id();
         } else {
-            return TrivialSnarlRecord(get_record_offset(net), &snarl_tree_records).get_node_id(get_node_record_offset(net));
+            return TrivialSnarlRecord(get_record_offset(net), snarl_tree_records.get_local()).get_node_id(get_node_record_offset(net));
         }
     } else if (is_sentinel(net)) {
-        SnarlRecord snarl_record(net, &snarl_tree_records);
+        SnarlRecord snarl_record(net, snarl_tree_records.get_local());
         NodeRecord node_record;
         if (get_start_endpoint(net) == START) {
             return snarl_record.get_start_id();
@@ -3225,23 +4718,23 @@ nid_t SnarlDistanceIndex::node_id(const net_handle_t& net) const {
 
 }
 bool SnarlDistanceIndex::has_node(const nid_t id) const {
-    RootRecord root_record (get_root(), &snarl_tree_records);
+    RootRecord root_record (get_root(), snarl_tree_records.get_local());
     size_t node_pointer_offset = get_node_pointer_offset(id, root_record.get_min_node_id(), root_record.get_connected_component_count());
     return snarl_tree_records->at(node_pointer_offset) != 0;
 }
 
 bool SnarlDistanceIndex::is_reversed_in_parent(const net_handle_t& net) const {
-    SnarlTreeRecord record(net, &snarl_tree_records);
+    SnarlTreeRecord record(net, snarl_tree_records.get_local());
     if (record.get_record_type() == TRIVIAL_SNARL || record.get_record_type() == DISTANCED_TRIVIAL_SNARL) {
-        return TrivialSnarlRecord(get_record_offset(net), &snarl_tree_records).get_is_reversed_in_parent(get_node_record_offset(net));
+        return TrivialSnarlRecord(get_record_offset(net), snarl_tree_records.get_local()).get_is_reversed_in_parent(get_node_record_offset(net));
     } else if ((record.get_record_type() == SIMPLE_SNARL || record.get_record_type() == DISTANCED_SIMPLE_SNARL) && is_chain(net)) {
-        return SimpleSnarlRecord(net, &snarl_tree_records).get_node_is_reversed();
+        return SimpleSnarlRecord(net, snarl_tree_records.get_local()).get_node_is_reversed();
     } else {
         return record.get_is_reversed_in_parent();
     }
 }
 net_handle_t SnarlDistanceIndex::get_node_net_handle(const nid_t id, bool rev) const {
-    RootRecord root_record (get_root(), &snarl_tree_records);
+    RootRecord root_record (get_root(), snarl_tree_records.get_local());
     size_t node_pointer_offset = get_node_pointer_offset(id, root_record.get_min_node_id(), root_record.get_connected_component_count());
     size_t record_offset = snarl_tree_records->at(node_pointer_offset);
     size_t node_record_offset = snarl_tree_records->at(node_pointer_offset+1);
@@ -3249,14 +4742,14 @@ net_handle_t SnarlDistanceIndex::get_node_net_handle(const nid_t id, bool rev) c
 }
 
 size_t SnarlDistanceIndex::get_max_tree_depth() const {
-    return RootRecord(get_root(), &snarl_tree_records).get_max_tree_depth();
+    return RootRecord(get_root(), snarl_tree_records.get_local()).get_max_tree_depth();
 }
 
 size_t SnarlDistanceIndex::get_depth(const net_handle_t& net) const {
     if (is_root(net)) {
         return 0;
-    } else if (SnarlTreeRecord(net, &snarl_tree_records).get_record_type() == SIMPLE_SNARL ||
-               SnarlTreeRecord(net, &snarl_tree_records).get_record_type() == DISTANCED_SIMPLE_SNARL ){
+    } else if (SnarlTreeRecord(net, snarl_tree_records.get_local()).get_record_type() == SIMPLE_SNARL ||
+               SnarlTreeRecord(net, snarl_tree_records.get_local()).get_record_type() == DISTANCED_SIMPLE_SNARL ){
         //If this is a simple snarl, then it can be a node, snarl, or chain
 
         //The depth of the snarl's parent chain
@@ -3273,7 +4766,7 @@ size_t SnarlDistanceIndex::get_depth(const net_handle_t& net) const {
     } else if (is_trivial_chain(net)) {
         return get_depth(get_parent(net)) + 1;
     } else if (is_chain(net)) {
-        return ChainRecord(net, &snarl_tree_records).get_depth();
+        return ChainRecord(net, snarl_tree_records.get_local()).get_depth();
     } else {
         throw runtime_error("error: Unknown handle type");
     }
@@ -3292,17 +4785,17 @@ size_t SnarlDistanceIndex::get_connected_component_number(const net_handle_t& ne
     }
     if (get_record_offset(parent) == 0) {
         //If the parent is actually the root
-        return SnarlTreeRecord(child, &snarl_tree_records).get_rank_in_parent();
+        return SnarlTreeRecord(child, snarl_tree_records.get_local()).get_rank_in_parent();
     } else {
         //Otherwise, it must be a root-level snarl pretending to be a root
-        return SnarlTreeRecord(parent, &snarl_tree_records).get_rank_in_parent();
+        return SnarlTreeRecord(parent, snarl_tree_records.get_local()).get_rank_in_parent();
     }
 }
 
 
 net_handle_t SnarlDistanceIndex::get_handle_from_connected_component(size_t num) const {
     size_t child_offset = snarl_tree_records->at(ROOT_RECORD_SIZE + num);
-    net_handle_record_t type = SnarlTreeRecord(child_offset, &snarl_tree_records).get_record_handle_type();
+    net_handle_record_t type = SnarlTreeRecord(child_offset, snarl_tree_records.get_local()).get_record_handle_type();
     if (type == NODE_HANDLE) {
         //If this child is a node, then pretend it's a chain
         return get_net_handle_from_values(child_offset, START_END, CHAIN_HANDLE);
@@ -3316,7 +4809,7 @@ net_handle_t SnarlDistanceIndex::get_handle_from_connected_component(size_t num)
 
 
 bool SnarlDistanceIndex::has_connectivity(const net_handle_t& net, endpoint_t start, endpoint_t end) const {
-    SnarlTreeRecord record(net, &snarl_tree_records);
+    SnarlTreeRecord record(net, snarl_tree_records.get_local());
     return record.has_connectivity(start, end);
 }
 
@@ -3368,7 +4861,7 @@ size_t SnarlDistanceIndex::get_prefix_sum_value(const net_handle_t& net) const {
         return std::numeric_limits<size_t>::max();
     }
 #endif
-    return TrivialSnarlRecord(get_record_offset(net), &snarl_tree_records).get_prefix_sum(get_node_record_offset(net));
+    return TrivialSnarlRecord(get_record_offset(net), snarl_tree_records.get_local()).get_prefix_sum(get_node_record_offset(net));
 }
 size_t SnarlDistanceIndex::get_max_prefix_sum_value(const net_handle_t& net) const {
 #ifdef debug_distances
@@ -3380,7 +4873,7 @@ size_t SnarlDistanceIndex::get_max_prefix_sum_value(const net_handle_t& net) con
         return std::numeric_limits<size_t>::max();
     }
 #endif
-    return TrivialSnarlRecord(get_record_offset(net), &snarl_tree_records).get_max_prefix_sum(get_node_record_offset(net));
+    return TrivialSnarlRecord(get_record_offset(net), snarl_tree_records.get_local()).get_max_prefix_sum(get_node_record_offset(net));
 }
 
 size_t SnarlDistanceIndex::get_forward_loop_value(const net_handle_t& net) const {
@@ -3393,7 +4886,7 @@ size_t SnarlDistanceIndex::get_forward_loop_value(const net_handle_t& net) const
         return std::numeric_limits<size_t>::max();
     }
 #endif
-    return TrivialSnarlRecord(get_record_offset(net), &snarl_tree_records).get_forward_loop(get_node_record_offset(net));
+    return TrivialSnarlRecord(get_record_offset(net), snarl_tree_records.get_local()).get_forward_loop(get_node_record_offset(net));
 }
 
 size_t SnarlDistanceIndex::get_reverse_loop_value(const net_handle_t& net) const {
@@ -3406,7 +4899,7 @@ size_t SnarlDistanceIndex::get_reverse_loop_value(const net_handle_t& net) const
         return std::numeric_limits<size_t>::max();
     }
 #endif
-    return TrivialSnarlRecord(get_record_offset(net), &snarl_tree_records).get_reverse_loop(get_node_record_offset(net));
+    return TrivialSnarlRecord(get_record_offset(net), snarl_tree_records.get_local()).get_reverse_loop(get_node_record_offset(net));
 }
 
 size_t SnarlDistanceIndex::get_chain_component(const net_handle_t& net, bool get_end) const {
@@ -3419,7 +4912,7 @@ size_t SnarlDistanceIndex::get_chain_component(const net_handle_t& net, bool get
         return std::numeric_limits<size_t>::max();
     }
 #endif
-    return TrivialSnarlRecord(get_record_offset(net), &snarl_tree_records).get_chain_component(get_node_record_offset(net), get_end);
+    return TrivialSnarlRecord(get_record_offset(net), snarl_tree_records.get_local()).get_chain_component(get_node_record_offset(net), get_end);
 }
 
 
@@ -3683,7 +5176,7 @@ SnarlDistanceIndex::SnarlTreeRecordWriter::SnarlTreeRecordWriter (const net_hand
 
 
 SnarlDistanceIndex::record_t SnarlDistanceIndex::SnarlTreeRecordWriter::get_record_type() const {
-    return static_cast<record_t>((*records)->at(record_offset) >> 9);
+    return SnarlDistanceIndex::get_record_type((*records)->at(record_offset));
 }
 void SnarlDistanceIndex::SnarlTreeRecordWriter::set_start_start_connected() {
 #ifdef debug_distance_indexing
@@ -3748,7 +5241,7 @@ void SnarlDistanceIndex::SnarlTreeRecordWriter::set_externally_end_end_connected
 }
 void SnarlDistanceIndex::SnarlTreeRecordWriter::set_record_type(record_t type) {
     assert((*records)->at(record_offset) == 0);
-    (*records)->at(record_offset) = ((static_cast<size_t>(type) << 9) | ((*records)->at(record_offset) & 511));
+    (*records)->at(record_offset) = ((static_cast<size_t>(type) << RECORD_TYPE_SHIFT) | ((*records)->at(record_offset) & 511));
 }
 
 
@@ -4013,6 +5506,17 @@ SnarlDistanceIndex::RootRecordWriter::RootRecordWriter (size_t pointer, size_t c
 #endif
 }
 
+SnarlDistanceIndex::RootRecordWriter::RootRecordWriter (bdsg::yomo::UniqueMappedPointer<bdsg::MappedIntVector>* records, size_t pointer) {
+    //Make a constructor for a root record that has already been allocated.
+    //For adding components to an existing root
+    record_offset = pointer;
+    records = records;
+    SnarlTreeRecordWriter::record_offset = pointer;
+    SnarlTreeRecordWriter::records = records;
+    RootRecord::record_offset = pointer;
+    RootRecord::records = records;
+}
+
 
 void SnarlDistanceIndex::RootRecordWriter::set_connected_component_count(size_t connected_component_count) {
 #ifdef debug_distance_indexing
@@ -4078,7 +5582,7 @@ SnarlDistanceIndex::SnarlRecord::SnarlRecord (net_handle_t net, const bdsg::yomo
 }
 
 
-size_t SnarlDistanceIndex::SnarlRecord::distance_vector_size(record_t type, size_t node_count) {
+size_t SnarlDistanceIndex::SnarlRecord::distance_vector_size(record_t type, size_t node_count, size_t values_per_entry) {
     if (type == SNARL || type == ROOT_SNARL){
         //For a normal snarl, its just the record size and the pointers to children
         return 0;
@@ -4086,7 +5590,7 @@ size_t SnarlDistanceIndex::SnarlRecord::distance_vector_size(record_t type, size
         //For a normal min distance snarl just the distances between internal node sides
         size_t node_side_count = node_count * 2;
         size_t vector_size =  (((node_side_count+1)*node_side_count) / 2);
-        return vector_size;
+        return (vector_size + values_per_entry - 1) / values_per_entry;
     } else if (type ==  OVERSIZED_SNARL){
         //For a large min_distance snarl, all distances get stored in the children
         return 0;
@@ -4095,12 +5599,19 @@ size_t SnarlDistanceIndex::SnarlRecord::distance_vector_size(record_t type, size
     }
 }
 
-size_t SnarlDistanceIndex::SnarlRecord::record_size (record_t type, size_t node_count) {
-    return SNARL_RECORD_SIZE + distance_vector_size(type, node_count);
+size_t SnarlDistanceIndex::SnarlRecord::record_size (record_t type, size_t node_count, size_t values_per_entry) {
+    return SNARL_RECORD_SIZE + distance_vector_size(type, node_count, values_per_entry);
 }
 size_t SnarlDistanceIndex::SnarlRecord::record_size() {
     record_t type = get_record_type();
-   return record_size(type, get_node_count());
+   return record_size(type, get_node_count(), get_values_per_entry());
+}
+size_t SnarlDistanceIndex::SnarlRecord::get_distance_width() const {
+    return get_snarl_distance_width((*records)->at(record_offset));
+}
+size_t SnarlDistanceIndex::SnarlRecord::get_values_per_entry() const {
+    size_t values_per_entry = get_snarl_values_per_entry((*records)->at(record_offset));
+    return values_per_entry == 0 ? 1 : values_per_entry;
 }
 
 size_t SnarlDistanceIndex::SnarlRecord::get_distance_start_start() const {
@@ -4112,7 +5623,8 @@ size_t SnarlDistanceIndex::SnarlRecord::get_distance_end_end() const {
     return stored_value == 0 ? std::numeric_limits<size_t>::max() : stored_value - 1;
 }
 
-SnarlDistanceIndex::SnarlRecordWriter::SnarlRecordWriter (size_t node_count, bdsg::yomo::UniqueMappedPointer<bdsg::MappedIntVector>* records, record_t type){
+SnarlDistanceIndex::SnarlRecordWriter::SnarlRecordWriter (size_t node_count, bdsg::yomo::UniqueMappedPointer<bdsg::MappedIntVector>* records, record_t type,
+                                                           size_t distance_width){
     //Constructor for making a new record, including allocating memory.
     //Assumes that this is the latest record being made, so pointer will be the end of
     //the array and we need to allocate extra memory past it
@@ -4124,7 +5636,17 @@ SnarlDistanceIndex::SnarlRecordWriter::SnarlRecordWriter (size_t node_count, bds
     SnarlRecord::record_offset = (*records)->size();
     SnarlRecord::records = records;
     
-    size_t extra_size = record_size(type, node_count);
+    if (type != DISTANCED_SNARL && type != DISTANCED_ROOT_SNARL) {
+        //There's no distance vector to pack
+        distance_width = 0;
+    } else if (distance_width >= (1 << SNARL_DISTANCE_WIDTH_BITS) || distance_width * 2 > (*records)->width()) {
+        //Packing wouldn't fit more than one value in an entry anyway
+        distance_width = 0;
+    }
+    //The count has to fit in the tag
+    size_t values_per_entry = distance_width == 0 ? 1 : std::min((*records)->width() / distance_width,
+                                                                 (size_t) (1 << SNARL_VALUES_PER_ENTRY_BITS) - 1);
+    size_t extra_size = record_size(type, node_count, values_per_entry);
 #ifdef debug_distance_indexing
     if (type == OVERSIZED_SNARL) {
             cerr << "oversized" << endl;
@@ -4134,6 +5656,10 @@ SnarlDistanceIndex::SnarlRecordWriter::SnarlRecordWriter (size_t node_count, bds
     (*records)->resize((*records)->size() + extra_size);
     set_node_count(node_count);
     set_record_type(type);
+    if (distance_width != 0) {
+        (*records)->at(record_offset) = (*records)->at(record_offset) | (distance_width << SNARL_DISTANCE_WIDTH_SHIFT)
+                                        | (values_per_entry << SNARL_VALUES_PER_ENTRY_SHIFT);
+    }
 
 #ifdef count_allocations
     cerr << "new_snarl\t" << extra_size << "\t" << (*records)->size() << endl;
@@ -4246,7 +5772,22 @@ void SnarlDistanceIndex::SnarlRecordWriter::set_distance(size_t rank1, bool righ
     //Value we actually want to save
     size_t val = distance == std::numeric_limits<size_t>::max() ? 0 : distance+1;
 
-    (*records)->at(distance_vector_offset+record_offset+SNARL_RECORD_SIZE) = val;
+    size_t distance_width = get_distance_width();
+    if (distance_width == 0) {
+        (*records)->at(distance_vector_offset+record_offset+SNARL_RECORD_SIZE) = val;
+    } else {
+        //Pack the value in with its neighbors
+        size_t values_per_entry = get_values_per_entry();
+        size_t mask = (((size_t) 1) << distance_width) - 1;
+        if (val > mask) {
+            throw runtime_error("error: distance " + std::to_string(distance) + " is too large for a snarl with "
+                                + std::to_string(distance_width) + "-bit distances");
+        }
+        size_t entry_offset = record_offset + SNARL_RECORD_SIZE + distance_vector_offset / values_per_entry;
+        size_t shift = (distance_vector_offset % values_per_entry) * distance_width;
+        size_t entry = (*records)->at(entry_offset);
+        (*records)->at(entry_offset) = (entry & ~(mask << shift)) | (val << shift);
+    }
 }
 
 size_t SnarlDistanceIndex::SnarlRecord::get_distance(size_t rank1, bool right_side1, size_t rank2, bool right_side2) const {
@@ -4257,7 +5798,16 @@ size_t SnarlDistanceIndex::SnarlRecord::get_distance(size_t rank1, bool right_si
     //Offset of this particular distance in the distance vector
     size_t distance_vector_offset = get_distance_vector_offset(rank1, right_side1, rank2, right_side2);
 
-    size_t val = (*records)->at(distance_vector_offset+record_offset+SNARL_RECORD_SIZE);
+    size_t val;
+    size_t distance_width = get_distance_width();
+    if (distance_width == 0) {
+        val = (*records)->at(distance_vector_offset+record_offset+SNARL_RECORD_SIZE);
+    } else {
+        //Unpack the value from the entry it shares with its neighbors
+        size_t values_per_entry = get_values_per_entry();
+        size_t entry = (*records)->at(record_offset + SNARL_RECORD_SIZE + distance_vector_offset / values_per_entry);
+        val = (entry >> ((distance_vector_offset % values_per_entry) * distance_width)) & ((((size_t) 1) << distance_width) - 1);
+    }
 
     return  val == 0 ? std::numeric_limits<size_t>::max() : val-1;
 
@@ -4945,6 +6495,26 @@ size_t SnarlDistanceIndex::ChainRecord::get_distance(size_t rank1, bool left_sid
     }
 
 
+    size_t distance = get_distance_in_order(rank1, left_side1, node_length1, prefix_sum1, forward_loop1, reverse_loop1,
+                                            rank2, left_side2, node_length2, prefix_sum2, forward_loop2, reverse_loop2);
+    if (is_looping_chain) {
+        distance = std::min(distance, get_distance_taking_chain_loop(rank1, left_side1, node_length1, 
+                            prefix_sum1, forward_loop1, reverse_loop1, end_component1,
+                            rank2, left_side2, node_length2,
+                            prefix_sum2, forward_loop2, reverse_loop2, end_component2));
+    }
+    return distance;
+}
+
+
+size_t SnarlDistanceIndex::ChainRecord::get_distance_in_order(size_t rank1, bool left_side1, size_t node_length1,
+    size_t prefix_sum1, size_t forward_loop1, size_t reverse_loop1,
+    size_t rank2, bool left_side2, size_t node_length2,
+    size_t prefix_sum2, size_t forward_loop2, size_t reverse_loop2) {
+#ifdef debug_distances
+    assert(rank1 <= rank2);
+#endif
+
     size_t distance;
 
     if (!left_side1 && left_side2) {
@@ -4978,12 +6548,6 @@ size_t SnarlDistanceIndex::ChainRecord::get_distance(size_t rank1, bool left_sid
                         forward_loop2), node_length2);
 
     }
-    if (is_looping_chain) {
-        distance = std::min(distance, get_distance_taking_chain_loop(rank1, left_side1, node_length1, 
-                            prefix_sum1, forward_loop1, reverse_loop1, end_component1,
-                            rank2, left_side2, node_length2,
-                            prefix_sum2, forward_loop2, reverse_loop2, end_component2));
-    }
     return distance;
 }
 
@@ -5330,9 +6894,9 @@ void SnarlDistanceIndex::ChainRecordWriter::set_distance_right_end(size_t distan
 }
 
 //Add a snarl to the end of the chain and return a SnarlRecordWriter pointing to it
-SnarlDistanceIndex::SnarlRecordWriter SnarlDistanceIndex::ChainRecordWriter::add_snarl(size_t snarl_size, record_t type, size_t previous_child_offset) {
+SnarlDistanceIndex::SnarlRecordWriter SnarlDistanceIndex::ChainRecordWriter::add_snarl(size_t snarl_size, record_t type, size_t previous_child_offset,
+                                                                                       size_t distance_width) {
 
-    size_t snarl_record_size = SnarlRecord::record_size(type, snarl_size);
 #ifdef debug_distance_indexing
     cerr << (*records)->size() << " Adding child snarl length to the end of the array " << endl;
     assert(SnarlDistanceIndex::get_record_type((*records)->at(previous_child_offset))== DISTANCED_TRIVIAL_SNARL);
@@ -5345,11 +6909,12 @@ SnarlDistanceIndex::SnarlRecordWriter SnarlDistanceIndex::ChainRecordWriter::add
     (*records)->resize(current_size+1);
     (*records)->at(current_size) = TrivialSnarlRecord(previous_child_offset, records).get_record_size();
     
+    //Leave room for the snarl's size, which depends on how its distances get packed
     size_t start_i = (*records)->size();
     (*records)->resize(start_i+1);
+    SnarlRecordWriter snarl_record(snarl_size, records, type, distance_width);
+    size_t snarl_record_size = snarl_record.record_size();
     (*records)->at(start_i) = snarl_record_size;
-    (*records)->reserve(start_i + snarl_record_size);
-    SnarlRecordWriter snarl_record(snarl_size, records, type);
     snarl_record.set_parent_record_offset(get_offset());
 #ifdef debug_distance_indexing
     cerr << (*records)->size() << " Adding child snarl length to the end of the array " << endl;
@@ -5499,7 +7064,7 @@ size_t SnarlDistanceIndex::ChainRecordWriter::add_node(nid_t node_id, size_t nod
 }
 string SnarlDistanceIndex::net_handle_as_string(const net_handle_t& net) const {
     net_handle_record_t type = get_handle_type(net);
-    SnarlTreeRecord record (net, &snarl_tree_records);
+    SnarlTreeRecord record (net, snarl_tree_records.get_local());
     net_handle_record_t record_type = record.get_record_handle_type();
     string result;
     if (type == ROOT_HANDLE) {
@@ -5526,10 +7091,10 @@ string SnarlDistanceIndex::net_handle_as_string(const net_handle_t& net) const {
             result += "snarl ";         
         }
     } else if (type == CHAIN_HANDLE && record_type == NODE_HANDLE) {
-        return  "node " + std::to_string( NodeRecord(net, &snarl_tree_records).get_node_id())
+        return  "node " + std::to_string( NodeRecord(net, snarl_tree_records.get_local()).get_node_id())
                + (ends_at(net) == START ? "rev" : "fd") + " pretending to be a chain";
     }  else if (type == CHAIN_HANDLE && record_type == SNARL_HANDLE) {
-        return  "node " + std::to_string( SimpleSnarlRecord(net, &snarl_tree_records).get_node_id())
+        return  "node " + std::to_string( SimpleSnarlRecord(net, snarl_tree_records.get_local()).get_node_id())
                + (ends_at(net) == START ? "rev" : "fd") + " pretending to be a chain in a simple snarl";
     }else if (type == CHAIN_HANDLE) {
         result += "chain ";
@@ -5598,7 +7163,7 @@ void SnarlDistanceIndex::print_self() const {
 
 }
 void SnarlDistanceIndex::print_descendants_of(const net_handle_t net) const {
-    SnarlTreeRecord record (net, &snarl_tree_records);
+    SnarlTreeRecord record (net, snarl_tree_records.get_local());
     //What the record thinks it is
     net_handle_record_t record_type = record.get_record_handle_type();
     if (record_type == NODE_HANDLE) {
@@ -5610,23 +7175,23 @@ void SnarlDistanceIndex::print_descendants_of(const net_handle_t net) const {
         string parent;
         if (record_type == ROOT_HANDLE) {
             parent = "none";
-            child_count = RootRecord(get_root(), &snarl_tree_records).get_connected_component_count();
+            child_count = RootRecord(get_root(), snarl_tree_records.get_local()).get_connected_component_count();
         } else {
             parent = net_handle_as_string(get_parent(net));
             if (record_type == CHAIN_HANDLE) {
-                child_count =  ChainRecord(net, &snarl_tree_records).get_node_count();
+                child_count =  ChainRecord(net, snarl_tree_records.get_local()).get_node_count();
             } else if (record.get_record_type() == SNARL ||
                         record.get_record_type() == DISTANCED_SNARL||
                         record.get_record_type() == OVERSIZED_SNARL  
                         ){
  
-                child_count = SnarlRecord(net, &snarl_tree_records).get_node_count();
+                child_count = SnarlRecord(net, snarl_tree_records.get_local()).get_node_count();
             } else if (record.get_record_type() == TRIVIAL_SNARL ||
                         record.get_record_type() == DISTANCED_TRIVIAL_SNARL) {
-                child_count = TrivialSnarlRecord(get_record_offset(net), &snarl_tree_records).get_node_count();
+                child_count = TrivialSnarlRecord(get_record_offset(net), snarl_tree_records.get_local()).get_node_count();
             }else if (record.get_record_type() == SIMPLE_SNARL ||
                         record.get_record_type() == DISTANCED_SIMPLE_SNARL) {
-                child_count = SimpleSnarlRecord(net, &snarl_tree_records).get_node_count();
+                child_count = SimpleSnarlRecord(net, snarl_tree_records.get_local()).get_node_count();
             } else {
                 throw runtime_error("error: printing the wrong kind of record");
             }
@@ -5646,7 +7211,7 @@ void SnarlDistanceIndex::print_snarl_stats() const {
     traverse_decomposition(
         [&](const net_handle_t& snarl_child) {
             //Iteratee for a snarl child
-            SnarlTreeRecord record(snarl_child, &snarl_tree_records);
+            SnarlTreeRecord record(snarl_child, snarl_tree_records.get_local());
 
             //Get the number of children depending on the type of record
             size_t child_count;
@@ -5655,10 +7220,10 @@ void SnarlDistanceIndex::print_snarl_stats() const {
                         record.get_record_type() == OVERSIZED_SNARL  
                         ){
  
-                child_count = SnarlRecord(snarl_child, &snarl_tree_records).get_node_count();
+                child_count = SnarlRecord(snarl_child, snarl_tree_records.get_local()).get_node_count();
             } else if (record.get_record_type() == SIMPLE_SNARL ||
                         record.get_record_type() == DISTANCED_SIMPLE_SNARL) {
-                child_count = SimpleSnarlRecord(snarl_child, &snarl_tree_records).get_node_count();
+                child_count = SimpleSnarlRecord(snarl_child, snarl_tree_records.get_local()).get_node_count();
             } else {
                 throw runtime_error("error: getting the snarl child count of the wrong type of record");
             }
@@ -5687,7 +7252,7 @@ void SnarlDistanceIndex::write_snarls_to_json() const {
             //Make a new json object for this snarl
             json_t* out_json = json_object();
             json_object_set_new(out_json, "type", json_string("snarl")); 
-            SnarlTreeRecord record(snarl_child, &snarl_tree_records);
+            SnarlTreeRecord record(snarl_child, snarl_tree_records.get_local());
 
             //Get the start node pointing in
             net_handle_t start_bound = get_node_from_sentinel(get_bound(snarl_child, false, true));
@@ -5724,11 +7289,11 @@ void SnarlDistanceIndex::write_snarls_to_json() const {
                         record.get_record_type() == DISTANCED_SNARL||
                         record.get_record_type() == OVERSIZED_SNARL  
                         ){
-                size_t child_count = SnarlRecord(snarl_child, &snarl_tree_records).get_node_count();
+                size_t child_count = SnarlRecord(snarl_child, snarl_tree_records.get_local()).get_node_count();
                 json_object_set_new(out_json, "child_count", json_integer(child_count)); 
             } else if (record.get_record_type() == SIMPLE_SNARL ||
                         record.get_record_type() == DISTANCED_SIMPLE_SNARL) {
-                size_t child_count = SimpleSnarlRecord(snarl_child, &snarl_tree_records).get_node_count();
+                size_t child_count = SimpleSnarlRecord(snarl_child, snarl_tree_records.get_local()).get_node_count();
                 json_object_set_new(out_json, "child_count", json_integer(child_count)); 
             } else {
                 throw runtime_error("error: getting the snarl child count of the wrong type of record");
@@ -5758,7 +7323,7 @@ void SnarlDistanceIndex::write_snarls_to_json() const {
             json_object_set_new(out_json, "type", json_string("chain"));
 
             //Make a new json object for this chain
-            ChainRecord record(chain_child, &snarl_tree_records);
+            ChainRecord record(chain_child, snarl_tree_records.get_local());
 
             //Get the start node pointing in
             net_handle_t start_bound = get_bound(chain_child, false, true);
@@ -5853,7 +7418,7 @@ void SnarlDistanceIndex::validate_index() const {
     //Go down tree and validate
     net_handle_t root = get_root();
     validate_descendants_of(root);
-    RootRecord root_record(root, &snarl_tree_records); 
+    RootRecord root_record(root, snarl_tree_records.get_local()); 
 
     //Go up tree and validate
     size_t node_count = 0;
@@ -5870,7 +7435,7 @@ void SnarlDistanceIndex::validate_index() const {
 void SnarlDistanceIndex::validate_descendants_of(net_handle_t net) const {
     cerr << "Looking at descendants of " << net_handle_as_string(net) << endl;
 
-    SnarlTreeRecord record (net, &snarl_tree_records);
+    SnarlTreeRecord record (net, snarl_tree_records.get_local());
     //What the record thinks it is
     net_handle_record_t record_type = record.get_record_handle_type();
     if (record_type == NODE_HANDLE || (is_node(net) && record_type == SNARL_HANDLE)) {
@@ -5887,7 +7452,7 @@ void SnarlDistanceIndex::validate_descendants_of(net_handle_t net) const {
 //Recursively check ancestors of net
 void SnarlDistanceIndex::validate_ancestors_of(net_handle_t net) const {
     cerr << "Looking at ancestors of " << net_handle_as_string(net) << endl;
-    SnarlTreeRecord record (net, &snarl_tree_records);
+    SnarlTreeRecord record (net, snarl_tree_records.get_local());
     //What the record thinks it is
     net_handle_record_t record_type = record.get_record_handle_type();
     if (record_type == ROOT_HANDLE) {
@@ -5907,6 +7472,9 @@ void SnarlDistanceIndex::get_snarl_tree_records(const vector<const TemporaryDist
     cerr << "Convert a temporary distance index into a permanent one" << endl;
 #endif
 
+    //Anything cached about the old contents is no longer right
+    distance_cache_generation = next_distance_cache_generation();
+
     //Convert temporary distance indexes into the final index stored as a single vector
     size_t total_component_count = 0;
     handlegraph::nid_t min_node_id = 0;
@@ -5957,6 +7525,55 @@ void SnarlDistanceIndex::get_snarl_tree_records(const vector<const TemporaryDist
     cerr << "  Root record had length " << snarl_tree_records->size() << endl;
 #endif
 
+    add_snarl_tree_records(temporary_indexes, 0, graph);
+
+#ifdef debug_distance_indexing
+    //Repack the vector to use fewer bits
+    //This doesn't actually get used anymore but keep it around in case I change things and can't
+    //predict the size anymore
+    size_t max_val = 0;
+    for (size_t i = 0 ; i < snarl_tree_records->size() ; i++ ) {
+        max_val = std::max(max_val, (size_t) snarl_tree_records->at(i));
+    }
+    size_t ideal_bit_width = std::max((size_t)log2(max_val)+1, (size_t)26);
+    if (ideal_bit_width < snarl_tree_records->width()) {
+        cerr << "Resetting bit width from " << snarl_tree_records->width() << " to " << ideal_bit_width << endl;
+        //snarl_tree_records->repack(ideal_bit_width, snarl_tree_records->size());
+    }
+#endif
+#ifdef debug_distance_indexing
+    tuple<size_t, size_t, size_t> usage =get_usage();
+    cerr << "total\t" << snarl_tree_records->size() << endl;
+    cerr << "Usage: " << std::get<0>(usage) << " total bytes, " << std::get<1>(usage) << " free bytes " << std::get<2>(usage) << " reclaimable free bytes " << endl;
+    cerr << "bit width " << snarl_tree_records->width() << endl;
+    cerr << "Max value " << max_val << endl;
+    cerr << "Predicted size: " << maximum_index_size << " actual size: " <<  snarl_tree_records->size() << endl;
+    //assert(maximum_index_size == snarl_tree_records->size());
+    cerr << "Predicted size: " << maximum_index_size << " actual size: " <<  snarl_tree_records->size() << endl;
+    //assert(snarl_tree_records->size() <= maximum_index_size); 
+#endif
+#ifdef count_allocations
+    //tuple<size_t, size_t, size_t> usage =get_usage();
+    cerr << "total\t" << snarl_tree_records->size() << endl;
+    cerr << "Usage: " << std::get<0>(usage) << " total bytes, " << std::get<1>(usage) << " free bytes " << std::get<2>(usage) << " reclaimable free bytes " << endl;
+    cerr << "bit width " << snarl_tree_records->width() << endl;
+    cerr << "Max value " << max_val << endl;
+    cerr << "Predicted size: " << maximum_index_size << " actual size: " <<  snarl_tree_records->size() << endl;
+#endif
+
+    if (use_root_distance_labels) {
+        build_root_distance_labels(graph);
+    }
+    if (use_snarl_maximum_distances) {
+        build_snarl_maximum_distances();
+    }
+}
+
+void SnarlDistanceIndex::add_snarl_tree_records(const vector<const TemporaryDistanceIndex*>& temporary_indexes,
+                                                size_t first_component, const HandleGraph* graph) {
+
+    RootRecordWriter root_record(&snarl_tree_records, 0);
+
     /*Now go through each of the chain/snarl indexes and copy them into snarl_tree_records
      * Walk down the snarl tree and fill in children
      */
@@ -5967,6 +7584,70 @@ void SnarlDistanceIndex::get_snarl_tree_records(const vector<const TemporaryDist
         //Any root will point to the same root
         record_to_offset.emplace(make_pair(temp_index_i,make_pair(TEMP_ROOT, 0)), 0);
     }
+    //Filling in snarl distance matrices is most of the work, and it doesn't change the layout of the
+    //index, so remember which snarl records need their distances filled in and do them all in
+    //parallel once everything has been laid out. This is <offset of the snarl record, temporary snarl record>
+    vector<pair<size_t, const TemporaryDistanceIndex::TemporarySnarlRecord*>> snarls_to_fill;
+    //Get the number of bits needed for the distances stored in a snarl's distance vector, given
+    //whether they will actually get stored
+    auto get_distance_width = [&](const TemporaryDistanceIndex::TemporarySnarlRecord& temp_snarl_record, bool store_distances) {
+        size_t max_stored_value = 0;
+        if (store_distances) {
+            for (const auto& it : temp_snarl_record.distances) {
+                //Distances are stored +1 so 0 can be infinite
+                max_stored_value = std::max(max_stored_value, it.second + 1);
+            }
+        }
+        return std::max(bit_width(max_stored_value), (size_t) 1);
+    };
+    //Add the list of children of a snarl that isn't trivial or simple to the end of the index, and
+    //tell the snarl where to find it. This has to wait until all the children have records
+    auto add_child_list = [&](size_t temp_index_i, size_t temp_snarl_i) {
+        const TemporaryDistanceIndex* temp_index = temporary_indexes[temp_index_i];
+        const TemporaryDistanceIndex::TemporarySnarlRecord& temp_snarl_record = temp_index->temp_snarl_records[temp_snarl_i];
+        //And a constructor for the permanent record, which we've already created
+        SnarlRecordWriter snarl_record_constructor (&snarl_tree_records,
+                record_to_offset[make_pair(temp_index_i, make_pair(TEMP_SNARL, temp_snarl_i))]);
+        //Now add the children and tell the record where to find them
+        snarl_record_constructor.set_child_record_pointer(snarl_tree_records->size());
+        for (pair<temp_record_t, size_t> child : temp_snarl_record.children) {
+            snarl_record_constructor.add_child(record_to_offset[make_pair(temp_index_i, child)]);
+
+            //Check if the child is a tip, and if so set start/end_tip connectivity of parent snarl
+            if (child.first == TEMP_NODE) {
+                auto temp_node_record = temp_index->temp_node_records[child.second-temp_index->min_node_id];
+                if (temp_node_record.is_tip) {
+                    if (temp_node_record.distance_left_start != std::numeric_limits<size_t>::max() ||
+                         temp_node_record.distance_right_start != std::numeric_limits<size_t>::max()){
+                        snarl_record_constructor.set_start_tip_connected();
+                    }
+                    if (temp_node_record.distance_left_end != std::numeric_limits<size_t>::max() ||
+                         temp_node_record.distance_right_end != std::numeric_limits<size_t>::max()){
+                        snarl_record_constructor.set_end_tip_connected();
+                    }
+                }
+            } else {
+                auto temp_chain_record = temp_index->temp_chain_records[child.second];
+                if (temp_chain_record.is_tip) {
+                    if (temp_chain_record.distance_left_start != std::numeric_limits<size_t>::max() ||
+                         temp_chain_record.distance_right_start != std::numeric_limits<size_t>::max()){
+                        snarl_record_constructor.set_start_tip_connected();
+                    }
+                    if (temp_chain_record.distance_left_end != std::numeric_limits<size_t>::max() ||
+                         temp_chain_record.distance_right_end != std::numeric_limits<size_t>::max()){
+                        snarl_record_constructor.set_end_tip_connected();
+                    }
+                }
+            }
+#ifdef debug_distance_indexing
+            cerr << "       child " << temp_index->structure_start_end_as_string(child) << endl;
+            cerr << "        " << child.first << " " << child.second << endl;
+            cerr << "        Add child " << net_handle_as_string(get_net_handle_from_values(record_to_offset[make_pair(temp_index_i, child)], START_END))
+                 << "     at offset " << record_to_offset[make_pair(temp_index_i, child)]
+                 << "     to child list at offset " << snarl_tree_records->size() << endl;
+#endif
+        }
+    };
     //Go through each separate temporary index, corresponding to separate connected components
     for (size_t temp_index_i = 0 ; temp_index_i < temporary_indexes.size() ; temp_index_i++) {
         const TemporaryDistanceIndex* temp_index = temporary_indexes[temp_index_i];
@@ -5974,10 +7655,19 @@ void SnarlDistanceIndex::get_snarl_tree_records(const vector<const TemporaryDist
         //Initially, it contains only the root components
         //This reverses the order of the connected components but I don't think that matters
         vector<pair<temp_record_t, size_t>> temp_record_stack = temp_index->components;
+        //Each connected component is finished before the next one comes off the stack, so its
+        //snarls' child lists can go right after it, where get_component_record_range() finds them.
+        //These are the components still waiting on the stack, and the snarls of the current one
+        size_t components_left = temp_record_stack.size();
+        vector<size_t> component_snarls;
 
         while (!temp_record_stack.empty()) {
             pair<temp_record_t, size_t> current_record_index = temp_record_stack.back();
             temp_record_stack.pop_back();
+            if (temp_record_stack.size() < components_left) {
+                //This starts the next connected component
+                components_left = temp_record_stack.size();
+            }
 
 #ifdef debug_distance_indexing
             cerr << "Translating " << temp_index->structure_start_end_as_string(current_record_index) << endl;
@@ -6033,9 +7723,9 @@ void SnarlDistanceIndex::get_snarl_tree_records(const vector<const TemporaryDist
                     } else {
                         //Otherwise, go to the grandparent chain and add 1
                         size_t parent_record_offset = chain_record_constructor.get_parent_record_offset();
-                        size_t grandparent_record_offset = SnarlRecord(parent_record_offset, &snarl_tree_records).get_parent_record_offset();  
+                        size_t grandparent_record_offset = SnarlRecord(parent_record_offset, snarl_tree_records.get_local()).get_parent_record_offset();  
                         chain_record_constructor.set_depth(
-                            ChainRecord(grandparent_record_offset, &snarl_tree_records).get_depth() + 1);
+                            ChainRecord(grandparent_record_offset, snarl_tree_records.get_local()).get_depth() + 1);
                     }
 
 
@@ -6067,7 +7757,7 @@ void SnarlDistanceIndex::get_snarl_tree_records(const vector<const TemporaryDist
 
                                 //Get the temporary node record
                                 const TemporaryDistanceIndex::TemporaryNodeRecord& temp_node_record = 
-                                    temp_index->temp_node_records[child_record_index.second-min_node_id];
+                                    temp_index->temp_node_records[child_record_index.second-temp_index->min_node_id];
 
 
                                 //Make a new node record
@@ -6114,10 +7804,12 @@ void SnarlDistanceIndex::get_snarl_tree_records(const vector<const TemporaryDist
                                 record_t record_type = snarl_size_limit == 0 ? SNARL :
                                     (temp_snarl_record.node_count < snarl_size_limit ? DISTANCED_SNARL : OVERSIZED_SNARL);
                                 SnarlRecordWriter snarl_record_constructor =
-                                    chain_record_constructor.add_snarl(temp_snarl_record.node_count, record_type, last_child_offset.first);
+                                    chain_record_constructor.add_snarl(temp_snarl_record.node_count, record_type, last_child_offset.first,
+                                                                       get_distance_width(temp_snarl_record, snarl_size_limit != 0));
 
                                 //Record how to find the new snarl record
                                 record_to_offset.emplace(make_pair(temp_index_i, child_record_index), snarl_record_constructor.record_offset);
+                                component_snarls.emplace_back(child_record_index.second);
 
                                 //Fill in snarl info
                                 snarl_record_constructor.set_min_length(temp_snarl_record.min_length);
@@ -6125,27 +7817,18 @@ void SnarlDistanceIndex::get_snarl_tree_records(const vector<const TemporaryDist
                                 snarl_record_constructor.set_distance_start_start(temp_snarl_record.distance_start_start);
                                 snarl_record_constructor.set_distance_end_end(temp_snarl_record.distance_end_end);
 
-                                //Add distances and record connectivity
-                                for (const auto& it : temp_snarl_record.distances) {
-                                    pair<size_t, size_t> node_rank1 = it.first.first;
-                                    pair<size_t, size_t> node_rank2 = it.first.second;
-                                    const size_t distance = it.second;
-
-                                    if (snarl_size_limit != 0) {
-                                        //If we are keeping track of distances
-                                        //If the distance exceeded the limit, then it wasn't found in the first place
-                                        snarl_record_constructor.set_distance(node_rank1.first, node_rank1.second,
-                                            node_rank2.first, node_rank2.second, distance);
-
-                                        if (temp_snarl_record.tippy_child_ranks.count(node_rank1.first)
-                                            && temp_snarl_record.tippy_child_ranks.count(node_rank2.first)) {
-                                            snarl_record_constructor.set_tip_tip_connected();
+                                //Record connectivity. The distances themselves get added later.
+                                if (snarl_size_limit != 0) {
+                                    //If we are keeping track of distances
+                                    snarls_to_fill.emplace_back(snarl_record_constructor.record_offset, &temp_snarl_record);
+                                    if (!temp_snarl_record.tippy_child_ranks.empty()) {
+                                        for (const auto& it : temp_snarl_record.distances) {
+                                            if (temp_snarl_record.tippy_child_ranks.count(it.first.first.first)
+                                                && temp_snarl_record.tippy_child_ranks.count(it.first.second.first)) {
+                                                snarl_record_constructor.set_tip_tip_connected();
+                                                break;
+                                            }
                                         }
-#ifdef debug_distance_indexing
-                                        assert(distance <= temp_snarl_record.max_distance);
-                                        assert(snarl_record_constructor.get_distance(node_rank1.first, node_rank1.second,
-                                               node_rank2.first, node_rank2.second) ==  distance);
-#endif
                                     }
                                 }
                                 //Now set the connectivity of this snarl
@@ -6227,7 +7910,7 @@ void SnarlDistanceIndex::get_snarl_tree_records(const vector<const TemporaryDist
                                         assert(temp_index->temp_chain_records[child_index.second].children.size() == 1);
                                         const pair<temp_record_t, size_t>& node_index = temp_index->temp_chain_records[child_index.second].children.front();
                                         const TemporaryDistanceIndex::TemporaryNodeRecord& temp_node_record =
-                                             temp_index->temp_node_records[node_index.second-min_node_id];
+                                             temp_index->temp_node_records[node_index.second-temp_index->min_node_id];
                                         //If there is a way to go from the node forward to the start node,
                                         //then it is reversed
                                         size_t rank =temp_index->temp_chain_records[child_index.second].rank_in_parent;
@@ -6237,7 +7920,7 @@ void SnarlDistanceIndex::get_snarl_tree_records(const vector<const TemporaryDist
                                     } else {
                                         assert(child_index.first == TEMP_NODE);
                                         const TemporaryDistanceIndex::TemporaryNodeRecord& temp_node_record =
-                                             temp_index->temp_node_records[child_index.second-min_node_id];
+                                             temp_index->temp_node_records[child_index.second-temp_index->min_node_id];
                                         size_t rank =temp_node_record.rank_in_parent;
                                         snarl_record_constructor.add_child(i+2, temp_node_record.node_id,  
                                                 temp_node_record.node_length, temp_node_record.reversed_in_parent);
@@ -6266,7 +7949,7 @@ void SnarlDistanceIndex::get_snarl_tree_records(const vector<const TemporaryDist
                     assert(temp_chain_record.children.size() == 1);
                     assert(temp_chain_record.children[0].first == TEMP_NODE);
                     const TemporaryDistanceIndex::TemporaryNodeRecord& temp_node_record =
-                            temp_index->temp_node_records[temp_chain_record.children[0].second-min_node_id];
+                            temp_index->temp_node_records[temp_chain_record.children[0].second-temp_index->min_node_id];
 
                     record_t record_type = snarl_size_limit == 0 ? NODE : DISTANCED_NODE;
                     NodeRecordWriter node_record(snarl_tree_records->size(), 0, record_type, &snarl_tree_records, temp_node_record.node_id);
@@ -6292,35 +7975,20 @@ void SnarlDistanceIndex::get_snarl_tree_records(const vector<const TemporaryDist
 
                 const TemporaryDistanceIndex::TemporarySnarlRecord& temp_snarl_record = temp_index->temp_snarl_records[current_record_index.second];
                 record_to_offset.emplace(make_pair(temp_index_i,current_record_index), snarl_tree_records->size());
+                if (!temp_snarl_record.is_trivial && !temp_snarl_record.is_simple) {
+                    component_snarls.emplace_back(current_record_index.second);
+                }
 
-                SnarlRecordWriter snarl_record_constructor (temp_snarl_record.node_count, &snarl_tree_records, record_type);
+                SnarlRecordWriter snarl_record_constructor (temp_snarl_record.node_count, &snarl_tree_records, record_type,
+                    get_distance_width(temp_snarl_record, snarl_size_limit != 0 && temp_snarl_record.node_count < snarl_size_limit));
 
                 //Fill in snarl info
                 snarl_record_constructor.set_parent_record_offset(0);
 
-                //Add distances and record connectivity
-
-                if (snarl_size_limit != 0 ) {
-
-
-                    for (const auto& it : temp_snarl_record.distances) {
-                        const pair<size_t, bool> node_rank1 = it.first.first;
-                        const pair<size_t, bool> node_rank2 = it.first.second;
-                        const size_t distance = it.second;
-                        //If we are keeping track of distances and either this is a small enough snarl,
-                        //or the snarl is too big but we are looking at the boundaries
-#ifdef debug_distance_indexing
-                        assert(distance <= temp_snarl_record.max_distance);
-#endif
-                        if ((temp_snarl_record.node_count < snarl_size_limit)) {
-                            snarl_record_constructor.set_distance(node_rank1.first, node_rank1.second,
-                             node_rank2.first, node_rank2.second, distance);
-#ifdef debug_distance_indexing
-                            assert(snarl_record_constructor.get_distance(node_rank1.first, node_rank1.second,
-                                    node_rank2.first, node_rank2.second) == distance);
-#endif
-                        }
-                    }
+                //Distances get added later, if we are keeping track of distances and this is a small
+                //enough snarl
+                if (snarl_size_limit != 0 && temp_snarl_record.node_count < snarl_size_limit) {
+                    snarls_to_fill.emplace_back(snarl_record_constructor.record_offset, &temp_snarl_record);
                 }
 
 #ifdef debug_distance_indexing
@@ -6339,7 +8007,7 @@ void SnarlDistanceIndex::get_snarl_tree_records(const vector<const TemporaryDist
                      << temp_index->structure_start_end_as_string(current_record_index) << endl;
 #endif
                 const TemporaryDistanceIndex::TemporaryNodeRecord& temp_node_record =
-                        temp_index->temp_node_records[current_record_index.second-min_node_id];
+                        temp_index->temp_node_records[current_record_index.second-temp_index->min_node_id];
                 record_t record_type = snarl_size_limit == 0 ? NODE : DISTANCED_NODE;
                 NodeRecordWriter node_record(snarl_tree_records->size(), 0, record_type, &snarl_tree_records, temp_node_record.node_id);
                 node_record.set_node_id(temp_node_record.node_id);
@@ -6357,18 +8025,29 @@ void SnarlDistanceIndex::get_snarl_tree_records(const vector<const TemporaryDist
 #ifdef debug_distance_indexing
             cerr << "Finished translating " << temp_index->structure_start_end_as_string(current_record_index) << endl;
 #endif
+            if (temp_record_stack.size() == components_left) {
+                //That was the last record of this connected component
+#ifdef debug_distance_indexing
+                cerr << "Now filling in children of each snarl in the component" << endl;
+                cerr << "The index currently has size " << snarl_tree_records->size() << endl;
+#endif
+                for (size_t temp_snarl_i : component_snarls) {
+                    add_child_list(temp_index_i, temp_snarl_i);
+                }
+                component_snarls.clear();
+            }
         }
 #ifdef debug_distance_indexing
         cerr << "Adding roots" << endl;
 #endif
 
-        for (size_t component_num = 0 ; component_num < temp_index->components.size() ; component_num++){
-            const pair<temp_record_t, size_t>& component_index = temp_index->components[component_num];
+        for (const pair<temp_record_t, size_t>& component_index : temp_index->components) {
             //Let the root record know that it has another root
+            size_t component_num = first_component++;
             root_record.add_component(component_num,record_to_offset[make_pair(temp_index_i,component_index)]);
 
             SnarlTreeRecord record (record_to_offset[make_pair(temp_index_i, component_index)],
-                                    &snarl_tree_records);
+                                    snarl_tree_records.get_local());
             SnarlTreeRecordWriter record_constructor(record_to_offset[make_pair(temp_index_i, component_index)],
                                                               &snarl_tree_records);
 
@@ -6412,99 +8091,258 @@ void SnarlDistanceIndex::get_snarl_tree_records(const vector<const TemporaryDist
 
 
 #ifdef debug_distance_indexing
-    cerr << "Now filling in children of each snarl" << endl;
-    cerr << "The index currently has size " << snarl_tree_records->size() << endl;
-#endif
-
-    /* Now go through everything again and give everything children */
-    for (size_t temp_index_i = 0 ; temp_index_i < temporary_indexes.size() ; temp_index_i++) {
-        const TemporaryDistanceIndex* temp_index = temporary_indexes[temp_index_i];
-        for (size_t temp_snarl_i = 0 ; temp_snarl_i < temp_index->temp_snarl_records.size() ; temp_snarl_i ++) {
-            //Get the temporary index for this snarl
-            const TemporaryDistanceIndex::TemporarySnarlRecord& temp_snarl_record = temp_index->temp_snarl_records[temp_snarl_i];
-            if (!temp_snarl_record.is_trivial && !temp_snarl_record.is_simple) {
-                //And a constructor for the permanent record, which we've already created
-                SnarlRecordWriter snarl_record_constructor (&snarl_tree_records,
-                        record_to_offset[make_pair(temp_index_i, make_pair(TEMP_SNARL, temp_snarl_i))]);
-                //Now add the children and tell the record where to find them
-                snarl_record_constructor.set_child_record_pointer(snarl_tree_records->size());
-                for (pair<temp_record_t, size_t> child : temp_snarl_record.children) {
-                    snarl_record_constructor.add_child(record_to_offset[make_pair(temp_index_i, child)]);
-
-                    //Check if the child is a tip, and if so set start/end_tip connectivity of parent snarl
-                    if (child.first == TEMP_NODE) {
-                        auto temp_node_record = temp_index->temp_node_records[child.second-min_node_id];
-                        if (temp_node_record.is_tip) {
-                            if (temp_node_record.distance_left_start != std::numeric_limits<size_t>::max() ||
-                                 temp_node_record.distance_right_start != std::numeric_limits<size_t>::max()){
-                                snarl_record_constructor.set_start_tip_connected();
-                            }
-                            if (temp_node_record.distance_left_end != std::numeric_limits<size_t>::max() ||
-                                 temp_node_record.distance_right_end != std::numeric_limits<size_t>::max()){
-                                snarl_record_constructor.set_end_tip_connected();
-                            }
-                        }
-                    } else {
-                        auto temp_chain_record = temp_index->temp_chain_records[child.second];
-                        if (temp_chain_record.is_tip) {
-                            if (temp_chain_record.distance_left_start != std::numeric_limits<size_t>::max() ||
-                                 temp_chain_record.distance_right_start != std::numeric_limits<size_t>::max()){
-                                snarl_record_constructor.set_start_tip_connected();
-                            }
-                            if (temp_chain_record.distance_left_end != std::numeric_limits<size_t>::max() ||
-                                 temp_chain_record.distance_right_end != std::numeric_limits<size_t>::max()){
-                                snarl_record_constructor.set_end_tip_connected();
-                            }
-                        }
-                    }
+    cerr << "Filling in distances for " << snarls_to_fill.size() << " snarls" << endl;
+#endif
+
+    /* Fill in the snarl distance matrices. Each snarl only writes to its own distance matrix, and
+     * every matrix comes after its snarl's header, which is at least SNARL_RECORD_SIZE values wide,
+     * so no two snarls ever write to the same word of the index, even with packed distances. Nothing gets appended here, so
+     * the index doesn't move out from under us. */
+#pragma omp parallel for schedule(dynamic, 1)
+    for (size_t i = 0 ; i < snarls_to_fill.size() ; i++) {
+        SnarlRecordWriter snarl_record_constructor (&snarl_tree_records, snarls_to_fill[i].first);
+        const TemporaryDistanceIndex::TemporarySnarlRecord& temp_snarl_record = *snarls_to_fill[i].second;
+        for (const auto& it : temp_snarl_record.distances) {
+            const pair<size_t, bool>& node_rank1 = it.first.first;
+            const pair<size_t, bool>& node_rank2 = it.first.second;
+            const size_t distance = it.second;
+            //If the distance exceeded the limit, then it wasn't found in the first place
+            snarl_record_constructor.set_distance(node_rank1.first, node_rank1.second,
+                node_rank2.first, node_rank2.second, distance);
 #ifdef debug_distance_indexing
-                cerr << "       child " << temp_index->structure_start_end_as_string(child) << endl;
-                cerr << "        " << child.first << " " << child.second << endl;
-                cerr << "        Add child " << net_handle_as_string(get_net_handle_from_values(record_to_offset[make_pair(temp_index_i, child)], START_END))
-                     << "     at offset " << record_to_offset[make_pair(temp_index_i, child)]
-                     << "     to child list at offset " << snarl_tree_records->size() << endl;
+            assert(distance <= temp_snarl_record.max_distance);
+            if (snarl_record_constructor.get_record_type() != OVERSIZED_SNARL) {
+                assert(snarl_record_constructor.get_distance(node_rank1.first, node_rank1.second,
+                       node_rank2.first, node_rank2.second) ==  distance);
+            }
 #endif
-                }
+        }
+    }
+}
+
+
+
+void SnarlDistanceIndex::update_snarl_tree_records(const vector<const TemporaryDistanceIndex*>& temporary_indexes,
+                                                   const HandleGraph* graph, const vector<nid_t>& removed_nodes) {
+    if (snarl_tree_records->size() == 0) {
+        //There is nothing to keep
+        get_snarl_tree_records(temporary_indexes, graph);
+        return;
+    }
+
+    //Anything cached about the old contents is no longer right
+    distance_cache_generation = next_distance_cache_generation();
+
+    RootRecord old_root_record (get_root(), snarl_tree_records.get_local());
+    size_t old_component_count = old_root_record.get_connected_component_count();
+    size_t old_node_count = old_root_record.get_node_count();
+    nid_t old_min_node_id = old_root_record.get_min_node_id();
+    size_t old_root_size = ROOT_RECORD_SIZE + old_component_count + old_node_count*2;
+
+    /* Find the connected component of each node, from the offset of the record at the top of its snarl tree */
+    unordered_map<size_t, size_t> top_to_component;
+    for (size_t component_num = 0 ; component_num < old_component_count ; component_num++) {
+        top_to_component.emplace(snarl_tree_records->at(ROOT_RECORD_SIZE + component_num), component_num);
+    }
+    //Nodes usually share their parents, so remember the component of each parent we've walked up from
+    unordered_map<size_t, size_t> parent_to_component;
+    vector<size_t> node_components (old_node_count, std::numeric_limits<size_t>::max());
+    for (size_t i = 0 ; i < old_node_count ; i++) {
+        if (snarl_tree_records->at(get_node_pointer_offset(old_min_node_id + i, old_min_node_id, old_component_count)) == 0) {
+            //There is no node with this ID
+            continue;
+        }
+        net_handle_t child = get_node_net_handle(old_min_node_id + i);
+        net_handle_t parent = get_parent(child);
+        size_t parent_offset = get_record_offset(parent);
+        auto found = parent_to_component.find(parent_offset);
+        if (found != parent_to_component.end()) {
+            node_components[i] = found->second;
+            continue;
+        }
+        bool parent_is_root = is_root(parent);
+        while (!is_root(parent)) {
+            child = parent;
+            parent = get_parent(child);
+        }
+        //The top is either a child of the root or a root snarl
+        size_t component_num = top_to_component.at(get_record_offset(parent) == 0 ? get_record_offset(child)
+                                                                                   : get_record_offset(parent));
+        if (!parent_is_root) {
+            parent_to_component.emplace(parent_offset, component_num);
+        }
+        node_components[i] = component_num;
+    }
+
+    /* Drop every connected component that shares a node with a new one, or that was removed */
+    vector<bool> dropped (old_component_count, false);
+    auto drop_component_of = [&](nid_t node_id) {
+        if (node_id >= old_min_node_id && node_id < old_min_node_id + (nid_t) old_node_count
+                && node_components[node_id - old_min_node_id] != std::numeric_limits<size_t>::max()) {
+            dropped[node_components[node_id - old_min_node_id]] = true;
+        }
+    };
+    for (const TemporaryDistanceIndex* temp_index : temporary_indexes) {
+        for (const TemporaryDistanceIndex::TemporaryNodeRecord& temp_node_record : temp_index->temp_node_records) {
+            if (temp_node_record.node_id != 0) {
+                drop_component_of(temp_node_record.node_id);
             }
         }
     }
-#ifdef debug_distance_indexing
-    //Repack the vector to use fewer bits
-    //This doesn't actually get used anymore but keep it around in case I change things and can't
-    //predict the size anymore
-    size_t max_val = 0;
-    for (size_t i = 0 ; i < snarl_tree_records->size() ; i++ ) {
-        max_val = std::max(max_val, (size_t) snarl_tree_records->at(i));
+    for (const nid_t& node_id : removed_nodes) {
+        drop_component_of(node_id);
     }
-    size_t ideal_bit_width = std::max((size_t)log2(max_val)+1, (size_t)26);
-    if (ideal_bit_width < snarl_tree_records->width()) {
-        cerr << "Resetting bit width from " << snarl_tree_records->width() << " to " << ideal_bit_width << endl;
-        //snarl_tree_records->repack(ideal_bit_width, snarl_tree_records->size());
+
+    /* Work out the size of the new root record, the same way as get_snarl_tree_records() */
+    size_t total_component_count = 0;
+    handlegraph::nid_t min_node_id = 0;
+    handlegraph::nid_t max_node_id = 0;
+    size_t maximum_distance = 0;
+    size_t maximum_index_size = 0;
+    size_t maximum_tree_depth = old_root_record.get_max_tree_depth();
+    for (size_t component_num = 0 ; component_num < old_component_count ; component_num++) {
+        if (!dropped[component_num]) {
+            total_component_count++;
+        }
     }
-#endif
+    for (size_t i = 0 ; i < old_node_count ; i++) {
+        if (node_components[i] != std::numeric_limits<size_t>::max() && !dropped[node_components[i]]) {
+            nid_t node_id = old_min_node_id + i;
+            min_node_id = min_node_id == 0 ? node_id : std::min(min_node_id, node_id);
+            max_node_id = std::max(max_node_id, node_id);
+        }
+    }
+    for (const TemporaryDistanceIndex* temp_index : temporary_indexes) {
+        total_component_count += temp_index->root_structure_count;
+        min_node_id = min_node_id == 0 ? temp_index->min_node_id
+                                       : std::min(min_node_id, temp_index->min_node_id);
+        max_node_id = std::max(max_node_id, temp_index->max_node_id);
+        maximum_distance = std::max(temp_index->max_distance, maximum_distance);
+        maximum_index_size += temp_index->get_max_record_length();
+        maximum_tree_depth = std::max(maximum_tree_depth, temp_index->max_tree_depth);
+    }
+    size_t node_count = max_node_id-min_node_id+1;
+    size_t root_size = ROOT_RECORD_SIZE + total_component_count + node_count*2;
+    size_t old_size = snarl_tree_records->size();
+    maximum_index_size += root_size + old_size - old_root_size;
+
 #ifdef debug_distance_indexing
-    tuple<size_t, size_t, size_t> usage =get_usage();
-    cerr << "total\t" << snarl_tree_records->size() << endl;
-    cerr << "Usage: " << std::get<0>(usage) << " total bytes, " << std::get<1>(usage) << " free bytes " << std::get<2>(usage) << " reclaimable free bytes " << endl;
-    cerr << "bit width " << snarl_tree_records->width() << endl;
-    cerr << "Max value " << max_val << endl;
-    cerr << "Predicted size: " << maximum_index_size << " actual size: " <<  snarl_tree_records->size() << endl;
-    //assert(maximum_index_size == snarl_tree_records->size());
-    cerr << "Predicted size: " << maximum_index_size << " actual size: " <<  snarl_tree_records->size() << endl;
-    //assert(snarl_tree_records->size() <= maximum_index_size); 
-#endif
-#ifdef count_allocations
-    //tuple<size_t, size_t, size_t> usage =get_usage();
-    cerr << "total\t" << snarl_tree_records->size() << endl;
-    cerr << "Usage: " << std::get<0>(usage) << " total bytes, " << std::get<1>(usage) << " free bytes " << std::get<2>(usage) << " reclaimable free bytes " << endl;
-    cerr << "bit width " << snarl_tree_records->width() << endl;
-    cerr << "Max value " << max_val << endl;
-    cerr << "Predicted size: " << maximum_index_size << " actual size: " <<  snarl_tree_records->size() << endl;
+    cerr << "Updating " << std::count(dropped.begin(), dropped.end(), true) << " of " << old_component_count
+         << " connected components with " << temporary_indexes.size() << " temporary indexes" << endl;
 #endif
 
+    /* Find everything in the kept components that points to another record. Everything after the
+     * root moves over by the same amount, so these just get shifted. Pointers to the last child of a
+     * chain have two flag bits packed under them
+     */
+    vector<size_t> pointer_offsets;
+    vector<size_t> packed_pointer_offsets;
+    std::function<void(size_t)> find_pointers = [&](size_t record_offset) {
+        record_t type = SnarlTreeRecord(record_offset, snarl_tree_records.get_local()).get_record_type();
+        if (type == NODE || type == DISTANCED_NODE) {
+            pointer_offsets.emplace_back(record_offset + NODE_PARENT_OFFSET);
+        } else if (type == TRIVIAL_SNARL || type == DISTANCED_TRIVIAL_SNARL) {
+            pointer_offsets.emplace_back(record_offset + TRIVIAL_SNARL_PARENT_OFFSET);
+        } else if (type == SIMPLE_SNARL || type == DISTANCED_SIMPLE_SNARL) {
+            pointer_offsets.emplace_back(record_offset + SIMPLE_SNARL_PARENT_OFFSET);
+        } else if (type == CHAIN || type == DISTANCED_CHAIN || type == MULTICOMPONENT_CHAIN) {
+            pointer_offsets.emplace_back(record_offset + CHAIN_PARENT_OFFSET);
+            packed_pointer_offsets.emplace_back(record_offset + CHAIN_LAST_CHILD_OFFSET);
+            ChainRecord(record_offset, snarl_tree_records.get_local()).for_each_child([&](const net_handle_t& child) {
+                find_pointers(get_record_offset(child));
+                return true;
+            });
+        } else {
+            //Any other snarl, including a root snarl, has a list of its children
+            SnarlRecord snarl_record (record_offset, snarl_tree_records.get_local());
+            pointer_offsets.emplace_back(record_offset + SNARL_PARENT_OFFSET);
+            pointer_offsets.emplace_back(record_offset + SNARL_CHILD_RECORD_OFFSET);
+            size_t child_record_pointer = snarl_record.get_child_record_pointer();
+            for (size_t i = 0 ; i < snarl_record.get_node_count() ; i++) {
+                pointer_offsets.emplace_back(child_record_pointer + i);
+                find_pointers(snarl_tree_records->at(child_record_pointer + i));
+            }
+        }
+    };
+    for (size_t component_num = 0 ; component_num < old_component_count ; component_num++) {
+        if (!dropped[component_num]) {
+            find_pointers(snarl_tree_records->at(ROOT_RECORD_SIZE + component_num));
+        }
+    }
+    //Every node in a trivial snarl found its record again
+    std::sort(pointer_offsets.begin(), pointer_offsets.end());
+    pointer_offsets.erase(std::unique(pointer_offsets.begin(), pointer_offsets.end()), pointer_offsets.end());
+
+    //Take a copy of the old records and shift the pointers in it. This is unsigned arithmetic, so it
+    //still works if the root gets smaller
+    size_t shift = root_size - old_root_size;
+    vector<size_t> old_records (old_size);
+    for (size_t i = 0 ; i < old_size ; i++) {
+        old_records[i] = snarl_tree_records->at(i);
+    }
+    for (const size_t& offset : pointer_offsets) {
+        if (old_records[offset] != 0) {
+            //Pointers to the root stay where they are
+            old_records[offset] += shift;
+        }
+    }
+    for (const size_t& offset : packed_pointer_offsets) {
+        old_records[offset] = (((old_records[offset] >> 2) + shift) << 2) | (old_records[offset] & 3);
+    }
+
+    /* Make the new root, and put everything after the old root after it */
+    size_t max_dist_bit_width = bit_width(std::max(maximum_distance, (size_t) max_node_id));
+    size_t max_address_bit_width = bit_width(maximum_index_size);
+    size_t new_width = std::max(std::max(max_dist_bit_width, max_address_bit_width)+2, (size_t)26);
+    new_width = std::max(new_width, (size_t) snarl_tree_records->width());
+    if (new_width > 64) {
+        cerr << "The bit width for the distance index is greater than 64 bits, which may cause problems" << endl;
+    }
+    snarl_tree_records.reset();
+    snarl_tree_records.construct(get_prefix());
+    snarl_tree_records->width(new_width);
+    snarl_tree_records->reserve(maximum_index_size);
+
+    RootRecordWriter root_record(0, total_component_count, node_count, maximum_tree_depth, min_node_id, &snarl_tree_records);
+    snarl_tree_records->resize(root_size + old_size - old_root_size);
+    for (size_t i = old_root_size ; i < old_size ; i++) {
+        snarl_tree_records->at(i + shift) = old_records[i];
+    }
 
-}
+    size_t component_num = 0;
+    for (size_t old_component_num = 0 ; old_component_num < old_component_count ; old_component_num++) {
+        if (!dropped[old_component_num]) {
+            size_t record_offset = old_records[ROOT_RECORD_SIZE + old_component_num] + shift;
+            root_record.add_component(component_num, record_offset);
+            SnarlTreeRecord record (record_offset, snarl_tree_records.get_local());
+            SnarlTreeRecordWriter record_constructor (record_offset, &snarl_tree_records);
+            if (record.get_record_handle_type() == CHAIN_HANDLE || record.get_record_handle_type() == ROOT_HANDLE) {
+                record_constructor.set_rank_in_parent(component_num);
+            }
+            component_num++;
+        }
+    }
+    for (size_t i = 0 ; i < old_node_count ; i++) {
+        if (node_components[i] != std::numeric_limits<size_t>::max() && !dropped[node_components[i]]) {
+            size_t old_pointer_offset = get_node_pointer_offset(old_min_node_id + i, old_min_node_id, old_component_count);
+            size_t pointer_offset = get_node_pointer_offset(old_min_node_id + i, min_node_id, total_component_count);
+            snarl_tree_records->at(pointer_offset) = old_records[old_pointer_offset] + shift;
+            snarl_tree_records->at(pointer_offset + 1) = old_records[old_pointer_offset + 1];
+        }
+    }
+    old_records.clear();
+    old_records.shrink_to_fit();
 
+    /* And add the new components after everything else */
+    add_snarl_tree_records(temporary_indexes, component_num, graph);
+
+    if (use_root_distance_labels) {
+        build_root_distance_labels(graph);
+    }
+    if (use_snarl_maximum_distances) {
+        build_snarl_maximum_distances();
+    }
+}
 
 //TODO: Also need to go the other way, from final index to temporary one for merging
 
@@ -0,0 +1,321 @@
+#include "bdsg/internal/step_position_tree.hpp"
+
+#include <cassert>
+
+namespace bdsg {
+
+StepPositionTree::StepPositionTree() : root(new Leaf()) {
+    // Nothing to do
+}
+
+StepPositionTree::StepPositionTree(const StepPositionTree& other) : root(new Leaf()) {
+    append_all(other.root);
+}
+
+StepPositionTree::StepPositionTree(StepPositionTree&& other) : root(other.root), leaf_of(std::move(other.leaf_of)) {
+    // leave the other tree empty but usable
+    other.root = new Leaf();
+    other.leaf_of.clear();
+}
+
+StepPositionTree::~StepPositionTree() {
+    destroy(root);
+}
+
+StepPositionTree& StepPositionTree::operator=(const StepPositionTree& other) {
+    if (this != &other) {
+        clear();
+        append_all(other.root);
+    }
+    return *this;
+}
+
+StepPositionTree& StepPositionTree::operator=(StepPositionTree&& other) {
+    if (this != &other) {
+        std::swap(root, other.root);
+        std::swap(leaf_of, other.leaf_of);
+        other.clear();
+    }
+    return *this;
+}
+
+size_t StepPositionTree::size() const {
+    return root->count;
+}
+
+size_t StepPositionTree::bases() const {
+    return root->bases;
+}
+
+bool StepPositionTree::contains(const step_handle_t& step) const {
+    return leaf_of.count(step);
+}
+
+size_t StepPositionTree::rank_of(const step_handle_t& step) const {
+    const Leaf* leaf = leaf_of.at(step);
+    size_t rank = index_in_leaf(leaf, step);
+    // count everything to the left of the path up to the root
+    for (const Node* node = leaf; node->parent != nullptr; node = node->parent) {
+        for (const Node* sibling : node->parent->children) {
+            if (sibling == node) {
+                break;
+            }
+            rank += sibling->count;
+        }
+    }
+    return rank;
+}
+
+size_t StepPositionTree::position_of(const step_handle_t& step) const {
+    const Leaf* leaf = leaf_of.at(step);
+    size_t position = 0;
+    for (size_t i = 0, end = index_in_leaf(leaf, step); i < end; ++i) {
+        position += leaf->lengths[i];
+    }
+    // count everything to the left of the path up to the root
+    for (const Node* node = leaf; node->parent != nullptr; node = node->parent) {
+        for (const Node* sibling : node->parent->children) {
+            if (sibling == node) {
+                break;
+            }
+            position += sibling->bases;
+        }
+    }
+    return position;
+}
+
+step_handle_t StepPositionTree::step_at_rank(size_t rank) const {
+    auto location = locate_rank(rank);
+    return location.first->steps[location.second];
+}
+
+size_t StepPositionTree::rank_at_position(size_t position) const {
+    if (position >= root->bases) {
+        return root->count;
+    }
+    size_t rank = 0;
+    const Node* node = root;
+    while (!node->is_leaf) {
+        // skip over the children that end at or before the position
+        auto child = ((const Internal*) node)->children.begin();
+        while (position >= (*child)->bases) {
+            position -= (*child)->bases;
+            rank += (*child)->count;
+            ++child;
+        }
+        node = *child;
+    }
+    // and the same within the block, which skips empty steps too
+    const Leaf* leaf = (const Leaf*) node;
+    size_t i = 0;
+    while (position >= leaf->lengths[i]) {
+        position -= leaf->lengths[i];
+        ++i;
+    }
+    return rank + i;
+}
+
+void StepPositionTree::insert(size_t rank, const step_handle_t& step, size_t length) {
+    assert(!contains(step));
+    auto location = locate_rank(rank);
+    Leaf* leaf = location.first;
+    leaf->steps.insert(leaf->steps.begin() + location.second, step);
+    leaf->lengths.insert(leaf->lengths.begin() + location.second, length);
+    leaf_of[step] = leaf;
+    adjust_totals(leaf, 1, length);
+    if (leaf->steps.size() > MAX_BLOCK_SIZE) {
+        split(leaf);
+    }
+}
+
+void StepPositionTree::push_back(const step_handle_t& step, size_t length) {
+    insert(root->count, step, length);
+}
+
+void StepPositionTree::erase(const step_handle_t& step) {
+    Leaf* leaf = leaf_of.at(step);
+    size_t i = index_in_leaf(leaf, step);
+    size_t length = leaf->lengths[i];
+    leaf->steps.erase(leaf->steps.begin() + i);
+    leaf->lengths.erase(leaf->lengths.begin() + i);
+    leaf_of.erase(step);
+    adjust_totals(leaf, -1, -int64_t(length));
+    if (leaf->steps.empty() && leaf != root) {
+        remove_empty(leaf);
+    }
+}
+
+void StepPositionTree::clear() {
+    destroy(root);
+    root = new Leaf();
+    leaf_of.clear();
+}
+
+size_t StepPositionTree::memory_usage() const {
+    size_t total = sizeof(*this) + leaf_of.bucket_count() * sizeof(typename decltype(leaf_of)::value_type);
+    vector<const Node*> stack(1, root);
+    while (!stack.empty()) {
+        const Node* node = stack.back();
+        stack.pop_back();
+        if (node->is_leaf) {
+            const Leaf* leaf = (const Leaf*) node;
+            total += sizeof(Leaf) + leaf->steps.capacity() * sizeof(step_handle_t)
+                + leaf->lengths.capacity() * sizeof(size_t);
+        }
+        else {
+            const Internal* internal = (const Internal*) node;
+            total += sizeof(Internal) + internal->children.capacity() * sizeof(Node*);
+            stack.insert(stack.end(), internal->children.begin(), internal->children.end());
+        }
+    }
+    return total;
+}
+
+void StepPositionTree::destroy(Node* node) {
+    if (node->is_leaf) {
+        delete (Leaf*) node;
+    }
+    else {
+        for (Node* child : ((Internal*) node)->children) {
+            destroy(child);
+        }
+        delete (Internal*) node;
+    }
+}
+
+void StepPositionTree::append_all(const Node* node) {
+    if (node->is_leaf) {
+        const Leaf* leaf = (const Leaf*) node;
+        for (size_t i = 0; i < leaf->steps.size(); ++i) {
+            push_back(leaf->steps[i], leaf->lengths[i]);
+        }
+    }
+    else {
+        for (const Node* child : ((const Internal*) node)->children) {
+            append_all(child);
+        }
+    }
+}
+
+pair<StepPositionTree::Leaf*, size_t> StepPositionTree::locate_rank(size_t rank) const {
+    Node* node = root;
+    while (!node->is_leaf) {
+        // a rank one past the end goes at the end of the last child
+        const vector<Node*>& children = ((Internal*) node)->children;
+        size_t i = 0;
+        while (i + 1 < children.size() && rank >= children[i]->count) {
+            rank -= children[i]->count;
+            ++i;
+        }
+        node = children[i];
+    }
+    return make_pair((Leaf*) node, rank);
+}
+
+size_t StepPositionTree::index_in_leaf(const Leaf* leaf, const step_handle_t& step) {
+    size_t i = 0;
+    while (leaf->steps[i] != step) {
+        ++i;
+    }
+    return i;
+}
+
+size_t StepPositionTree::index_in_parent(const Node* node) {
+    const vector<Node*>& siblings = node->parent->children;
+    size_t i = 0;
+    while (siblings[i] != node) {
+        ++i;
+    }
+    return i;
+}
+
+void StepPositionTree::adjust_totals(Node* node, int64_t count_delta, int64_t bases_delta) {
+    for (; node != nullptr; node = node->parent) {
+        node->count += count_delta;
+        node->bases += bases_delta;
+    }
+}
+
+void StepPositionTree::split(Node* node) {
+    // move the back half of the node into a new sibling
+    Node* sibling;
+    if (node->is_leaf) {
+        Leaf* leaf = (Leaf*) node;
+        Leaf* new_leaf = new Leaf();
+        size_t half = leaf->steps.size() / 2;
+        new_leaf->steps.assign(leaf->steps.begin() + half, leaf->steps.end());
+        new_leaf->lengths.assign(leaf->lengths.begin() + half, leaf->lengths.end());
+        leaf->steps.resize(half);
+        leaf->lengths.resize(half);
+        for (size_t i = 0; i < new_leaf->steps.size(); ++i) {
+            leaf_of[new_leaf->steps[i]] = new_leaf;
+            new_leaf->bases += new_leaf->lengths[i];
+        }
+        new_leaf->count = new_leaf->steps.size();
+        sibling = new_leaf;
+    }
+    else {
+        Internal* internal = (Internal*) node;
+        Internal* new_internal = new Internal();
+        size_t half = internal->children.size() / 2;
+        new_internal->children.assign(internal->children.begin() + half, internal->children.end());
+        internal->children.resize(half);
+        for (Node* child : new_internal->children) {
+            child->parent = new_internal;
+            new_internal->count += child->count;
+            new_internal->bases += child->bases;
+        }
+        sibling = new_internal;
+    }
+    // the totals above the node don't change
+    node->count -= sibling->count;
+    node->bases -= sibling->bases;
+
+    if (node->parent == nullptr) {
+        // grow a new root over the two halves
+        Internal* new_root = new Internal();
+        new_root->children.push_back(node);
+        new_root->children.push_back(sibling);
+        new_root->count = node->count + sibling->count;
+        new_root->bases = node->bases + sibling->bases;
+        node->parent = new_root;
+        sibling->parent = new_root;
+        root = new_root;
+    }
+    else {
+        Internal* parent = node->parent;
+        parent->children.insert(parent->children.begin() + index_in_parent(node) + 1, sibling);
+        sibling->parent = parent;
+        if (parent->children.size() > MAX_BLOCK_SIZE) {
+            split(parent);
+        }
+    }
+}
+
+void StepPositionTree::remove_empty(Node* node) {
+    Internal* parent = node->parent;
+    parent->children.erase(parent->children.begin() + index_in_parent(node));
+    destroy(node);
+    if (parent->children.empty()) {
+        if (parent == root) {
+            // the whole tree is empty
+            delete parent;
+            root = new Leaf();
+        }
+        else {
+            remove_empty(parent);
+        }
+    }
+    else {
+        // don't leave a chain of single children at the top
+        while (!root->is_leaf && ((Internal*) root)->children.size() == 1) {
+            Internal* old_root = (Internal*) root;
+            root = old_root->children.front();
+            root->parent = nullptr;
+            old_root->children.clear();
+            delete old_root;
+        }
+    }
+}
+
+}
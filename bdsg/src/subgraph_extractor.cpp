@@ -0,0 +1,137 @@
+//
+//  subgraph_extractor.cpp
+//
+//  Contains the implementation of BatchSubgraphOverlay and SubgraphBatch
+//
+
+#include "bdsg/overlays/subgraph_extractor.hpp"
+
+#include <atomic>
+
+namespace bdsg {
+
+BatchSubgraphOverlay::BatchSubgraphOverlay(const SubgraphBatch& batch, size_t index) :
+    graph(batch.graph),
+    handles_begin(batch.handles.data() + batch.bounds.at(index)),
+    handles_end(batch.handles.data() + batch.bounds.at(index + 1)),
+    max_id(batch.id_ranges[index].second),
+    min_id(batch.id_ranges[index].first) {
+    // Nothing to do
+}
+
+bool BatchSubgraphOverlay::contains(const handle_t& handle) const {
+    return std::binary_search(handles_begin, handles_end, handlegraph::as_integer(graph->forward(handle)));
+}
+
+bool BatchSubgraphOverlay::has_node(nid_t node_id) const {
+    return node_id >= min_id && node_id <= max_id && graph->has_node(node_id) && contains(graph->get_handle(node_id));
+}
+
+handle_t BatchSubgraphOverlay::get_handle(const nid_t& node_id, bool is_reverse) const {
+    return graph->get_handle(node_id, is_reverse);
+}
+
+nid_t BatchSubgraphOverlay::get_id(const handle_t& handle) const {
+    return graph->get_id(handle);
+}
+
+bool BatchSubgraphOverlay::get_is_reverse(const handle_t& handle) const {
+    return graph->get_is_reverse(handle);
+}
+
+handle_t BatchSubgraphOverlay::flip(const handle_t& handle) const {
+    return graph->flip(handle);
+}
+
+size_t BatchSubgraphOverlay::get_length(const handle_t& handle) const {
+    return graph->get_length(handle);
+}
+
+string BatchSubgraphOverlay::get_sequence(const handle_t& handle) const {
+    return graph->get_sequence(handle);
+}
+
+bool BatchSubgraphOverlay::follow_edges_impl(const handle_t& handle, bool go_left, const std::function<bool(const handle_t&)>& iteratee) const {
+    return graph->follow_edges(handle, go_left, [&](const handle_t& next) {
+        if (contains(next)) {
+            return iteratee(next);
+        }
+        else {
+            return true;
+        }
+    });
+}
+
+bool BatchSubgraphOverlay::for_each_handle_impl(const std::function<bool(const handle_t&)>& iteratee, bool parallel) const {
+    size_t count = handles_end - handles_begin;
+    if (parallel) {
+        std::atomic<bool> keep_going(true);
+        #pragma omp parallel for
+        for (size_t i = 0; i < count; i++) {
+            if (keep_going && !iteratee(handlegraph::as_handle(handles_begin[i]))) {
+                keep_going = false;
+            }
+        }
+        return keep_going;
+    }
+    else {
+        for (size_t i = 0; i < count; i++) {
+            if (!iteratee(handlegraph::as_handle(handles_begin[i]))) {
+                return false;
+            }
+        }
+        return true;
+    }
+}
+
+char BatchSubgraphOverlay::get_base(const handle_t& handle, size_t index) const {
+    return graph->get_base(handle, index);
+}
+
+std::string BatchSubgraphOverlay::get_subsequence(const handle_t& handle, size_t index, size_t size) const {
+    return graph->get_subsequence(handle, index, size);
+}
+
+size_t BatchSubgraphOverlay::get_node_count(void) const {
+    return handles_end - handles_begin;
+}
+
+nid_t BatchSubgraphOverlay::min_node_id(void) const {
+    return min_id;
+}
+
+nid_t BatchSubgraphOverlay::max_node_id(void) const {
+    return max_id;
+}
+
+handle_t BatchSubgraphOverlay::get_underlying_handle(const handle_t& handle) const {
+    return handle;
+}
+
+size_t SubgraphBatch::size() const {
+    return id_ranges.size();
+}
+
+bool SubgraphBatch::empty() const {
+    return id_ranges.empty();
+}
+
+BatchSubgraphOverlay SubgraphBatch::get_subgraph(size_t index) const {
+    return BatchSubgraphOverlay(*this, index);
+}
+
+size_t SubgraphBatch::get_node_count(size_t index) const {
+    return bounds.at(index + 1) - bounds.at(index);
+}
+
+void SubgraphBatch::for_each_handle(size_t index, const std::function<void(const handle_t&)>& iteratee) const {
+    for (size_t i = bounds.at(index), end = bounds.at(index + 1); i < end; i++) {
+        iteratee(handlegraph::as_handle(handles[i]));
+    }
+}
+
+const HandleGraph* SubgraphBatch::get_graph() const {
+    return graph;
+}
+
+}
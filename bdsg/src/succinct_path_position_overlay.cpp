@@ -0,0 +1,298 @@
+#include "bdsg/overlays/succinct_path_position_overlay.hpp"
+
+#include "bdsg/internal/utility.hpp"
+
+#include <omp.h> // BINDER_IGNORE because Binder can't find this
+
+//#define debug
+
+namespace bdsg {
+
+SuccinctPositionOverlay::SuccinctPositionOverlay(const PathHandleGraph* graph, size_t steps_per_index,
+                                                 size_t concurrent_indexes, bool low_memory) : PackedPositionOverlay() {
+    // We can't just chain to the base class constructor with these arguments
+    // because we need virtual methods in this class to be available before the
+    // index build starts.
+    this->graph = graph;
+    this->steps_per_index = steps_per_index;
+    this->concurrent_indexes = concurrent_indexes;
+    this->low_memory = low_memory;
+
+    // Now do the index build
+    index_path_positions();
+}
+
+size_t SuccinctPositionOverlay::step_bit(size_t index_num, size_t rank) const {
+    // The support structure only holds a pointer to the vector, so we make it
+    // on the fly and don't have to re-point it when we are copied or moved.
+    const sdsl::sd_vector<>& step_starts = position_indexes[index_num].step_starts;
+    return sdsl::sd_vector<>::select_1_type(&step_starts).select(rank + 1);
+}
+
+size_t SuccinctPositionOverlay::bases_before(size_t index_num, size_t rank) const {
+    // Every bit before the step's 1 that isn't another step's 1 is a base.
+    return step_bit(index_num, rank) - rank;
+}
+
+size_t SuccinctPositionOverlay::get_path_length(const path_handle_t& path_handle) const {
+    const auto& range = path_range.at(as_integer(path_handle));
+    if (range.start == range.end) {
+        return 0;
+    }
+    step_handle_t step;
+    as_integers(step)[0] = indexes[range.index_number].steps_0.get(range.end - 1);
+    as_integers(step)[1] = indexes[range.index_number].steps_1.get(range.end - 1);
+    return bases_before(range.index_number, range.end - 1) - bases_before(range.index_number, range.start)
+        + get_length(get_handle_of_step(step));
+}
+
+size_t SuccinctPositionOverlay::get_position_of_step(const step_handle_t& step) const {
+    auto path = get_path_handle_of_step(step);
+    if (step == path_end(path)) {
+        return get_path_length(path);
+    }
+    else {
+        auto& range = path_range.at(as_integer(path));
+        const boomphf::mphf<step_handle_t, StepHash>& const_step_hash = indexes[range.index_number].step_hash.back();
+        // We can't use the lookup function on a const mphf, because it isn't
+        // marked const. But it is thread safe and really ought to be const. So
+        // we cast away the const here.
+        boomphf::mphf<step_handle_t, StepHash>& step_hash = const_cast<boomphf::mphf<step_handle_t, StepHash>&>(const_step_hash);
+        size_t rank = position_indexes[range.index_number].step_ranks.get(step_hash.lookup(step));
+        return bases_before(range.index_number, rank) - bases_before(range.index_number, range.start);
+    }
+}
+
+step_handle_t SuccinctPositionOverlay::get_step_at_position(const path_handle_t& path,
+                                                            const size_t& position) const {
+
+    const auto& range = path_range.at(as_integer(path));
+
+    // check if position it outside the range (handles edge case of an empty path too)
+    if (position >= get_path_length(path)) {
+        return path_end(path);
+    }
+
+    // Find the 0 for this base among all the bases in the index. The bits
+    // before it that aren't 0s are the 1s for the steps that start at or
+    // before it, and the last of those is the step that covers the base.
+    size_t base = bases_before(range.index_number, range.start) + position;
+    const sdsl::sd_vector<>& step_starts = position_indexes[range.index_number].step_starts;
+    size_t rank = sdsl::sd_vector<>::select_0_type(&step_starts).select(base + 1) - base - 1;
+
+    // unpack the integers at the same index into a step
+    step_handle_t step;
+    as_integers(step)[0] = indexes[range.index_number].steps_0.get(rank);
+    as_integers(step)[1] = indexes[range.index_number].steps_1.get(rank);
+    return step;
+}
+
+void SuccinctPositionOverlay::get_steps_at_positions(const path_handle_t& path,
+                                                     const vector<size_t>& sorted_positions,
+                                                     vector<step_handle_t>& out) const {
+
+    out.resize(sorted_positions.size());
+
+    // look everything up for the path just once
+    const auto& range = path_range.at(as_integer(path));
+    const PathIndex& index = indexes[range.index_number];
+    size_t path_length = get_path_length(path);
+    step_handle_t end = path_end(path);
+    if (path_length == 0) {
+        std::fill(out.begin(), out.end(), end);
+        return;
+    }
+    size_t path_bases_before = bases_before(range.index_number, range.start);
+    sdsl::sd_vector<>::select_0_type select_0(&position_indexes[range.index_number].step_starts);
+
+    for (size_t i = 0; i < sorted_positions.size(); i++) {
+        if (sorted_positions[i] >= path_length) {
+            out[i] = end;
+        }
+        else {
+            // see get_step_at_position()
+            size_t base = path_bases_before + sorted_positions[i];
+            size_t rank = select_0.select(base + 1) - base - 1;
+            as_integers(out[i])[0] = index.steps_0.get(rank);
+            as_integers(out[i])[1] = index.steps_1.get(rank);
+        }
+    }
+}
+
+void SuccinctPositionOverlay::get_positions_of_steps(const path_handle_t& path,
+                                                     const vector<step_handle_t>& steps,
+                                                     vector<size_t>& out) const {
+
+    out.resize(steps.size());
+
+    // look everything up for the path just once
+    const auto& range = path_range.at(as_integer(path));
+    const PathIndex& index = indexes[range.index_number];
+    const PathPositionIndex& position_index = position_indexes[range.index_number];
+    step_handle_t end = path_end(path);
+    size_t path_bases_before = range.start == range.end ? 0 : bases_before(range.index_number, range.start);
+    boomphf::mphf<step_handle_t, StepHash>* step_hash = nullptr;
+    if (!index.step_hash.empty()) {
+        // lookup should be const, see get_position_of_step()
+        step_hash = const_cast<boomphf::mphf<step_handle_t, StepHash>*>(&index.step_hash.back());
+    }
+    sdsl::sd_vector<>::select_1_type select_1(&position_index.step_starts);
+
+    for (size_t i = 0; i < steps.size(); i++) {
+        if (steps[i] == end) {
+            out[i] = get_path_length(path);
+        }
+        else {
+            size_t rank = position_index.step_ranks.get(step_hash->lookup(steps[i]));
+            out[i] = select_1.select(rank + 1) - rank - path_bases_before;
+        }
+    }
+}
+
+MemoryBreakdown SuccinctPositionOverlay::memory_breakdown() const {
+
+    size_t steps_mem = 0, step_hash_mem = 0, step_starts_mem = 0, step_ranks_mem = 0;
+    for (const PathIndex& index : indexes) {
+        steps_mem += index.steps_0.memory_usage() + index.steps_1.memory_usage();
+        for (const auto& step_hash : index.step_hash) {
+            // BBHash won't measure itself in a const context
+            step_hash_mem += const_cast<boomphf::mphf<step_handle_t, StepHash>&>(step_hash).totalBitSize() / 8;
+        }
+    }
+    for (const PathPositionIndex& position_index : position_indexes) {
+        step_starts_mem += sdsl::size_in_bytes(position_index.step_starts);
+        step_ranks_mem += position_index.step_ranks.memory_usage();
+    }
+
+    MemoryBreakdown index_breakdown("indexes");
+    index_breakdown.add("steps", steps_mem);
+    index_breakdown.add("step_hash", step_hash_mem);
+    index_breakdown.add("vector overhead", sizeof(indexes) + indexes.capacity() * sizeof(PathIndex));
+
+    MemoryBreakdown position_breakdown("position_indexes");
+    position_breakdown.add("step_starts", step_starts_mem);
+    position_breakdown.add("step_ranks", step_ranks_mem);
+    position_breakdown.add("vector overhead", sizeof(position_indexes) + position_indexes.capacity() * sizeof(PathPositionIndex));
+
+    MemoryBreakdown breakdown("SuccinctPositionOverlay");
+    breakdown.add(index_breakdown);
+    breakdown.add(position_breakdown);
+    breakdown.add("path_range", sizeof(path_range) + path_range.bucket_count() * sizeof(typename decltype(path_range)::value_type));
+    return breakdown;
+}
+
+uint32_t SuccinctPositionOverlay::get_magic_number() const {
+    return 2915480917ul;
+}
+
+void SuccinctPositionOverlay::serialize_members(ostream& out) const {
+    PackedPositionOverlay::serialize_members(out);
+    for (const PathPositionIndex& position_index : position_indexes) {
+        position_index.serialize(out);
+    }
+}
+
+void SuccinctPositionOverlay::deserialize_members(istream& in) {
+    // This sizes our indexes along with the base class's
+    PackedPositionOverlay::deserialize_members(in);
+    for (PathPositionIndex& position_index : position_indexes) {
+        position_index.deserialize(in);
+    }
+    if (!in) {
+        throw std::runtime_error("error:[SuccinctPositionOverlay] could not read indexes from stream");
+    }
+}
+
+void SuccinctPositionOverlay::PathPositionIndex::serialize(ostream& out) const {
+    step_starts.serialize(out);
+    step_ranks.serialize(out);
+}
+
+void SuccinctPositionOverlay::PathPositionIndex::deserialize(istream& in) {
+    step_starts.load(in);
+    step_ranks.deserialize(in);
+}
+
+void SuccinctPositionOverlay::set_index_count(size_t count) {
+    // Resize the base class indexes
+    PackedPositionOverlay::set_index_count(count);
+    // Resize our additional indexes
+    position_indexes.resize(count);
+}
+
+void SuccinctPositionOverlay::index_paths(size_t index_num, const std::vector<path_handle_t>::const_iterator& begin_path, const std::vector<path_handle_t>::const_iterator& end_path, size_t cumul_path_size, void** user_data_base) {
+    // Grab the indexes we are building into
+    auto& index = indexes[index_num];
+    auto& position_index = position_indexes[index_num];
+
+    // resize the vectors to the number of step handles
+    index.steps_0.resize(cumul_path_size);
+    index.steps_1.resize(cumul_path_size);
+    position_index.step_ranks.resize(cumul_path_size);
+
+#ifdef debug
+    #pragma omp critical (cerr)
+    std::cerr << "T" << omp_get_thread_num() << ": Sized index " << index_num << " for " << cumul_path_size << " steps" << std::endl;
+#endif
+
+    // Make a perfect minimal hash over the step handles on the selected paths
+    index.step_hash.emplace_back(cumul_path_size, BBHashHelper(graph, begin_path, end_path), threads_per_index, 2.0, false, false, hash_keys_cached());
+
+    // Walk a cursor through steps among the path set, and count up the bases
+    // so we know how long the bit vector needs to be.
+    size_t step_overall = 0;
+    size_t total_bases = 0;
+    for (size_t j = 0; j < end_path - begin_path; j++) {
+        // For each path we are indexing
+        auto& path_handle = *(begin_path + j);
+
+        // Make sure there's no user data
+        assert(*(user_data_base + j) == nullptr);
+
+        // Initialize a PathRange on the stack
+        PathRange range;
+
+        // Populate the index and start info
+        range.index_number = index_num;
+        range.start = step_overall;
+        for_each_step_in_path(path_handle, [&](const step_handle_t& step) {
+
+            // fill in the rank to step index
+            index.steps_0.set(step_overall, as_integers(step)[0]);
+            index.steps_1.set(step_overall, as_integers(step)[1]);
+
+            // fill in the step to rank index
+            position_index.step_ranks.set(index.step_hash.back().lookup(step), step_overall);
+
+            total_bases += get_length(get_handle_of_step(step));
+            ++step_overall;
+        });
+        // Populate the end info
+        range.end = step_overall;
+
+#ifdef debug
+        #pragma omp critical (cerr)
+        std::cerr << "T" << omp_get_thread_num() << ": Path " << get_path_name(path_handle) << " takes up range " << range.start << " to " << range.end << " in index " << range.index_number << std::endl;
+#endif
+
+        // Commit to the map from path to path range. We must protect all
+        // access in a critical section, not just the hash table lookup.
+        #pragma omp critical (path_range)
+        path_range.emplace(as_integer(path_handle), std::move(range));
+    }
+
+    // Now that we know the size, stream the steps back out of the index into
+    // the bit vector, so we never hold the uncompressed positions.
+    sdsl::sd_vector_builder builder(total_bases + cumul_path_size, cumul_path_size);
+    size_t bit = 0;
+    for (size_t i = 0; i < cumul_path_size; i++) {
+        step_handle_t step;
+        as_integers(step)[0] = index.steps_0.get(i);
+        as_integers(step)[1] = index.steps_1.get(i);
+        builder.set(bit);
+        bit += 1 + get_length(get_handle_of_step(step));
+    }
+    position_index.step_starts = sdsl::sd_vector<>(builder);
+}
+
+}
@@ -15,6 +15,7 @@
 #include <deque>
 #include <functional>
 #include <stdexcept>
+#include <atomic>
 
 #include <omp.h> // BINDER_IGNORE because Binder can't find this
 
@@ -23,14 +24,24 @@
 
 #include "bdsg/packed_graph.hpp"
 #include "bdsg/hash_graph.hpp"
+#include "bdsg/flat_hash_graph.hpp"
 #include "bdsg/snarl_distance_index.hpp"
 #include "bdsg/internal/packed_structs.hpp"
 #include "bdsg/internal/mapped_structs.hpp"
+#include "bdsg/internal/hash_map.hpp"
+#include "bdsg/internal/perf_counters.hpp"
 #include "bdsg/overlays/path_position_overlays.hpp"
 #include "bdsg/overlays/packed_path_position_overlay.hpp"
 #include "bdsg/overlays/packed_reference_path_overlay.hpp"
+#include "bdsg/overlays/succinct_path_position_overlay.hpp"
+#include "bdsg/overlays/lazy_path_position_overlay.hpp"
 #include "bdsg/overlays/vectorizable_overlays.hpp"
+#include "bdsg/overlays/overlay_helper.hpp"
 #include "bdsg/overlays/packed_subgraph_overlay.hpp"
+#include "bdsg/overlays/path_subgraph_overlay.hpp"
+#include "bdsg/overlays/strand_split_overlay.hpp"
+#include "bdsg/overlays/subgraph_extractor.hpp"
+#include "bdsg/internal/eades_algorithm.hpp"
 
 
 using namespace bdsg;
@@ -320,6 +331,16 @@ void test_mapped_structs() {
             // And to preload without crashing
             numbers_holder.preload();
             numbers_holder.preload(true);
+            
+            // And to give every kind of access hint without losing data,
+            // even the ones that would discard heap memory.
+            for (auto hint : {yomo::Manager::ACCESS_SEQUENTIAL, yomo::Manager::ACCESS_RANDOM,
+                              yomo::Manager::ACCESS_WILLNEED, yomo::Manager::ACCESS_DONTNEED,
+                              yomo::Manager::ACCESS_HUGEPAGE, yomo::Manager::ACCESS_NOHUGEPAGE,
+                              yomo::Manager::ACCESS_NORMAL}) {
+                numbers_holder.advise(hint);
+                verify_to(vec1, 1000, 1);
+            }
         }
         
         // We're going to need a temporary file
@@ -341,6 +362,12 @@ void test_mapped_structs() {
             numbers_holder.preload();
             numbers_holder.preload(true);
             
+            // File-backed memory can be dropped and paged back in.
+            numbers_holder.advise(yomo::Manager::ACCESS_DONTNEED);
+            verify_to(vec2, 1000, 1);
+            numbers_holder.advise(yomo::Manager::ACCESS_RANDOM);
+            verify_to(vec2, 1000, 1);
+            
             // We should still be able to modify it.
             vec2.resize(4000);
             fill_to(vec2, 4000, 2);
@@ -417,6 +444,119 @@ void test_mapped_structs() {
             verify_to(vec4, 4000, 2);
         }
         
+        {
+            // We can also read the file into memory without mapping it
+            bdsg::yomo::UniqueMappedPointer<V> copy_holder;
+            assert(lseek(tmpfd, 0, SEEK_SET) == 0);
+            copy_holder.load_unmapped(tmpfd, "GATTACA");
+            assert(copy_holder.get_usage() == numbers_holder.get_usage());
+            verify_to(*copy_holder, 4000, 2);
+            
+            // And changing it doesn't change the file
+            fill_to(*copy_holder, 4000, 5);
+            verify_to(*numbers_holder, 4000, 2);
+            
+            // The prefix still has to match
+            assert(lseek(tmpfd, 0, SEEK_SET) == 0);
+            bool threw = false;
+            try {
+                copy_holder.load_unmapped(tmpfd, "CATTAG");
+            } catch (std::runtime_error& e) {
+                threw = true;
+            }
+            assert(threw);
+            
+            // Pipes get read straight through
+            int pipe_fds[2];
+            assert(pipe(pipe_fds) == 0);
+            std::thread writer([&]() {
+                numbers_holder.save([&](const void* start, size_t length) {
+                    size_t written = 0;
+                    while (written < length) {
+                        ssize_t bytes = write(pipe_fds[1], (const char*) start + written, length - written);
+                        assert(bytes > 0);
+                        written += bytes;
+                    }
+                });
+                close(pipe_fds[1]);
+            });
+            copy_holder.load_unmapped(pipe_fds[0], "GATTACA");
+            writer.join();
+            close(pipe_fds[0]);
+            verify_to(*copy_holder, 4000, 2);
+            
+            // Files bigger than one read chunk get read in pieces
+            char big_filename[] = "tmpXXXXXX";
+            int big_fd = mkstemp(big_filename);
+            assert(big_fd != -1);
+            copy_holder->resize(3000000);
+            fill_to(*copy_holder, 3000000, 6);
+            copy_holder.save(big_fd);
+            copy_holder.reset();
+            assert(lseek(big_fd, 0, SEEK_SET) == 0);
+            copy_holder.load_unmapped(big_fd, "GATTACA");
+            verify_to(*copy_holder, 3000000, 6);
+            close(big_fd);
+            unlink(big_filename);
+        }
+        
+        {
+            // We can make chains out of huge pages, with space reserved
+            bdsg::yomo::UniqueMappedPointer<V> huge_holder;
+            huge_holder.construct_reserved(3 << 20, yomo::Manager::PAGES_HUGE_2MB, "GATTACA");
+            size_t huge_page = 2 << 20;
+            assert(get<0>(huge_holder.get_usage()) == 2 * huge_page);
+            huge_holder->resize(10000);
+            fill_to(*huge_holder, 10000, 7);
+            verify_to(*huge_holder, 10000, 7);
+            // Growing past the reservation adds whole pages
+            huge_holder->resize(1000000);
+            fill_to(*huge_holder, 1000000, 8);
+            verify_to(*huge_holder, 1000000, 8);
+            assert(get<0>(huge_holder.get_usage()) % huge_page == 0);
+            
+            // And move file-backed data into them
+            assert(lseek(tmpfd, 0, SEEK_SET) == 0);
+            huge_holder.load(tmpfd, "GATTACA");
+            huge_holder.dissociate(yomo::Manager::PAGES_HUGE_2MB);
+            verify_to(*huge_holder, 4000, 2);
+            huge_holder->resize(100000);
+            fill_to(*huge_holder, 100000, 9);
+            verify_to(*huge_holder, 100000, 9);
+            verify_to(*numbers_holder, 4000, 2);
+        }
+        
+        {
+            // Chains can be copied into memory on a NUMA node
+            size_t node_count = yomo::Manager::get_numa_node_count();
+            size_t local_node = yomo::Manager::get_local_numa_node();
+            assert(node_count >= 1);
+            assert(local_node < node_count);
+            
+            auto chain = yomo::Manager::create_chain("GATTACA");
+            int64_t* original = (int64_t*) yomo::Manager::allocate_from(chain, sizeof(int64_t));
+            *original = 12345;
+            auto replica = yomo::Manager::get_numa_replica_chain(chain, local_node);
+            int64_t* copy = (int64_t*) yomo::Manager::find_first_allocation(replica, sizeof(int64_t));
+            assert(copy != original);
+            assert(*copy == 12345);
+            *original = 0;
+            assert(*copy == 12345);
+            // The replica is a working chain
+            yomo::Manager::allocate_from(replica, 10000);
+            yomo::Manager::destroy_chain(replica);
+            yomo::Manager::destroy_chain(chain);
+            
+            // Pointers read from the replica for their node, if there is one
+            numbers_holder.replicate_numa();
+            verify_to(**numbers_holder.get_local(), 4000, 2);
+            if (node_count == 1) {
+                assert(numbers_holder.get_local() == &numbers_holder);
+            }
+            numbers_holder.drop_replicas();
+            assert(numbers_holder.get_local() == &numbers_holder);
+        }
+        
         close(tmpfd);
         unlink(filename);
     }
@@ -508,6 +648,15 @@ void test_mapped_structs() {
         fill_to(*vec, 1000, 1);
         verify_to(*vec, 1000, 1);
         
+        // We should be able to preload parts of it, including ranges that
+        // run off the end or are empty, without disturbing anything
+        vec->preload(10, 20);
+        vec->preload(500, 1000, true);
+        vec->preload(900, 2000, true);
+        vec->preload(30, 30, true);
+        vec->preload(2000, 3000);
+        verify_to(*vec, 1000, 1);
+        
         // We should pass heap verification
         vec.check_heap_integrity();
         
@@ -534,11 +683,104 @@ void test_mapped_structs() {
         }
         
         vec.reset();
-        
+
         close(tmpfd);
         unlink(filename);
     }
-    
+
+    {
+        // Make sure readers can follow pointers while a writer grows the chain
+
+        using A = bdsg::yomo::Allocator<int64_t>;
+        struct TwoVectors {
+            CompatVector<int64_t, A> fixed;
+            CompatVector<int64_t, A> growing;
+        };
+        bdsg::yomo::UniqueMappedPointer<TwoVectors> holder;
+        holder.construct();
+
+        holder->fixed.resize(1000);
+        fill_to(holder->fixed, 1000, 2);
+        size_t links_before = yomo::Manager::count_links();
+
+        atomic<bool> writing(true);
+#pragma omp parallel num_threads(4)
+        {
+            if (omp_get_thread_num() == 0) {
+                for (size_t i = 0; i < 100000; i++) {
+                    holder->growing.emplace_back(i);
+                }
+                writing = false;
+            } else {
+                do {
+                    verify_to(holder->fixed, 1000, 2);
+                } while (writing);
+            }
+        }
+
+        // The writer should have had to add links while the readers read
+        assert(yomo::Manager::count_links() > links_before);
+        verify_to(holder->fixed, 1000, 2);
+        for (size_t i = 0; i < 100000; i++) {
+            assert(holder->growing[i] == i);
+        }
+    }
+
+    {
+        // Grow and free many vectors at once, which fragments the chain's
+        // free space, and make sure the allocator keeps track of all of it
+
+        using A = bdsg::yomo::Allocator<int64_t>;
+        struct ManyVectors {
+            CompatVector<int64_t, A> vectors[16];
+        };
+        bdsg::yomo::UniqueMappedPointer<ManyVectors> holder;
+        holder.construct();
+
+        default_random_engine prng(43);
+        for (size_t round = 0; round < 5000; round++) {
+            auto& vec = holder->vectors[prng() % 16];
+            if (prng() % 8 == 0) {
+                vec.clear();
+                vec.shrink_to_fit();
+            } else {
+                size_t old_size = vec.size();
+                vec.resize(old_size + prng() % 200);
+                for (size_t i = old_size; i < vec.size(); i++) {
+                    vec[i] = i;
+                }
+                if (prng() % 4 == 0) {
+                    vec.shrink_to_fit();
+                }
+            }
+            if (round % 500 == 0) {
+                holder.check_heap_integrity();
+            }
+        }
+        holder.check_heap_integrity();
+        for (auto& vec : holder->vectors) {
+            for (size_t i = 0; i < vec.size(); i++) {
+                assert(vec[i] == i);
+            }
+        }
+
+        // Once everything is freed the free space should all run together
+        // to the end of the chain
+        for (auto& vec : holder->vectors) {
+            vec.clear();
+            vec.shrink_to_fit();
+        }
+        holder.check_heap_integrity();
+        auto total_free_reclaimable = holder.get_usage();
+        assert(get<1>(total_free_reclaimable) > 0);
+
+        // And a big allocation should be able to use it
+        size_t links_before = yomo::Manager::count_links();
+        holder->vectors[0].resize(get<1>(total_free_reclaimable) / sizeof(int64_t) / 4);
+        assert(yomo::Manager::count_links() == links_before);
+        holder.check_heap_integrity();
+    }
+
     assert(yomo::Manager::count_chains() == 0);
     assert(yomo::Manager::count_links() == 0);
     
@@ -651,6 +893,9 @@ void test_serializable_handle_graphs() {
     HashGraph hg_out, hg_in;
     implementations.emplace_back(&hg_out, &hg_in);
     
+    FlatHashGraph fhg_out, fhg_in;
+    implementations.emplace_back(&fhg_out, &fhg_in);
+    
     MappedPackedGraph mpg_in, mpg_out;
     implementations.emplace_back(&mpg_in, &mpg_out);
     
@@ -711,6 +956,9 @@ void test_deletable_handle_graphs() {
         HashGraph hg;
         implementations.push_back(&hg);
 
+        FlatHashGraph fhg;
+        implementations.push_back(&fhg);
+
         MappedPackedGraph mpg;
         implementations.push_back(&mpg);
 
@@ -1793,6 +2041,9 @@ void test_deletable_handle_graphs() {
         HashGraph hg;
         implementations.push_back(&hg);
 
+        FlatHashGraph fhg;
+        implementations.push_back(&fhg);
+
         MappedPackedGraph mpg;
         implementations.push_back(&mpg);
 
@@ -1989,6 +2240,9 @@ void test_deletable_handle_graphs() {
         HashGraph hg;
         implementations.push_back(&hg);
 
+        FlatHashGraph fhg;
+        implementations.push_back(&fhg);
+
         PackedGraph pg;
         implementations.push_back(&pg);
 
@@ -2033,6 +2287,9 @@ void test_deletable_handle_graphs() {
         HashGraph hg, hg2;
         implementations.push_back(make_pair(&hg, &hg2));
 
+        FlatHashGraph fhg, fhg2;
+        implementations.push_back(make_pair(&fhg, &fhg2));
+
         MappedPackedGraph mpg, mpg2;
         implementations.push_back(make_pair(&mpg, &mpg2));
 
@@ -2115,6 +2372,9 @@ void test_deletable_handle_graphs() {
         HashGraph hg;
         implementations.push_back(&hg);
 
+        FlatHashGraph fhg;
+        implementations.push_back(&fhg);
+
         MappedPackedGraph mpg;
         implementations.push_back(&mpg);
 
@@ -2218,6 +2478,9 @@ void test_deletable_handle_graphs() {
         
         HashGraph hg;
         implementations.push_back(&hg);
+
+        FlatHashGraph fhg;
+        implementations.push_back(&fhg);
         
         MappedPackedGraph mpg;
         implementations.push_back(&mpg);
@@ -2655,6 +2918,9 @@ void test_mutable_path_handle_graphs() {
         
         HashGraph hg, hg2;
         implementations.push_back(make_pair(&hg, &hg2));
+
+        FlatHashGraph fhg, fhg2;
+        implementations.push_back(make_pair(&fhg, &fhg2));
         
         PackedGraph pg, pg2;
         implementations.push_back(make_pair(&pg, &pg2));
@@ -2707,11 +2973,11 @@ void test_mutable_path_handle_graphs() {
 
 template<typename PackedVectorImpl>
 void test_packed_vector() {
-    enum vec_op_t {SET = 0, GET = 1, APPEND = 2, POP = 3, SERIALIZE = 4};
+    enum vec_op_t {SET = 0, GET = 1, APPEND = 2, POP = 3, SERIALIZE = 4, RANGE = 5};
     
     random_device rd;
     default_random_engine prng(rd());
-    uniform_int_distribution<int> op_distr(0, 4);
+    uniform_int_distribution<int> op_distr(0, 5);
     
     int num_runs = 1000;
     int num_ops = 200;
@@ -2788,6 +3054,29 @@ void test_packed_vector() {
                     break;
                 }
                     
+                case RANGE:
+                    if (!std_vec.empty()) {
+                        size_t begin = prng() % dyn_vec.size();
+                        size_t count = prng() % (dyn_vec.size() - begin + 1);
+                        vector<uint64_t> vals(count);
+                        for (size_t k = 0; k < count; k++) {
+                            vals[k] = next_val;
+                            std_vec[begin + k] = next_val;
+                            next_val++;
+                        }
+                        dyn_vec.set_range(begin, count, vals.data());
+                        
+                        begin = prng() % dyn_vec.size();
+                        count = prng() % (dyn_vec.size() - begin + 1);
+                        vals.assign(count, 0);
+                        dyn_vec.get_range(begin, count, vals.data());
+                        for (size_t k = 0; k < count; k++) {
+                            assert(vals[k] == std_vec[begin + k]);
+                        }
+                    }
+                    
+                    break;
+                    
                 default:
                     break;
             }
@@ -2799,12 +3088,89 @@ void test_packed_vector() {
     cerr << "PackedVector (" << typeid(PackedVectorImpl).name() << ") tests successful!" << endl;
 }
 
+template<typename Backend>
+void test_packed_vector_width_growth() {
+    {
+        // Reserving width should widen right away and never narrow
+        PackedVector<Backend> vec;
+        vec.append(1);
+        vec.reserve_width(20);
+        assert(vec.width() == 20);
+        vec.reserve_width(5);
+        assert(vec.width() == 20);
+        vec.append((1 << 20) - 1);
+        assert(vec.width() == 20);
+        assert(vec.get(0) == 1);
+        assert(vec.get(1) == (1 << 20) - 1);
+    }
+    
+    {
+        // Long vectors should get headroom when widening, but short ones not
+        PackedVector<Backend> short_vec;
+        short_vec.append(0);
+        short_vec.set(0, 1 << 15);
+        assert(short_vec.width() == 16);
+        
+        PackedVector<Backend> long_vec;
+        long_vec.resize(100000);
+        long_vec.set(50, 1 << 15);
+        assert(long_vec.width() > 16);
+        assert(long_vec.get(50) == 1 << 15);
+        assert(long_vec.get(51) == 0);
+        
+        // But not for narrow values
+        PackedVector<Backend> narrow_vec;
+        narrow_vec.resize(100000);
+        narrow_vec.set(50, 4);
+        assert(narrow_vec.width() == 3);
+        
+        // And never more than 64 bits
+        long_vec.set(60, std::numeric_limits<uint64_t>::max());
+        assert(long_vec.width() == 64);
+        assert(long_vec.get(60) == std::numeric_limits<uint64_t>::max());
+        assert(long_vec.get(50) == 1 << 15);
+    }
+    
+    {
+        // The builder should pack everything once, at the narrowest width
+        PackedVectorBuilder<Backend> builder;
+        vector<uint64_t> truth;
+        builder.reserve(10000);
+        for (uint64_t i = 0; i < 10000; i++) {
+            truth.push_back(i * 3);
+            builder.append(i * 3);
+        }
+        assert(builder.size() == truth.size());
+        
+        PackedVector<Backend> vec;
+        vec.append(std::numeric_limits<uint64_t>::max());
+        builder.finalize(vec);
+        assert(builder.size() == 0);
+        assert(vec.size() == truth.size());
+        assert(vec.width() == 15);
+        for (size_t i = 0; i < truth.size(); i++) {
+            assert(vec.get(i) == truth[i]);
+        }
+        
+        // And it should still work as a normal vector after
+        vec.append(1 << 20);
+        assert(vec.get(truth.size()) == 1 << 20);
+        assert(vec.get(truth.size() - 1) == truth.back());
+        
+        // Finalizing nothing should empty the vector
+        builder.finalize(vec);
+        assert(vec.empty());
+    }
+    
+    cerr << "PackedVector width growth tests successful!" << endl;
+}
+
 template<typename PagedVectorImpl>
 void test_paged_vector() {
-    enum vec_op_t {SET = 0, GET = 1, APPEND = 2, POP = 3, SERIALIZE = 4};
+    enum vec_op_t {SET = 0, GET = 1, APPEND = 2, POP = 3, SERIALIZE = 4, RANGE = 5};
     std::random_device rd;
     std::default_random_engine prng(rd());
-    std::uniform_int_distribution<int> op_distr(0, 4);
+    std::uniform_int_distribution<int> op_distr(0, 5);
     std::uniform_int_distribution<int> val_distr(0, 100);
     
     int num_runs = 200;
@@ -2882,6 +3248,46 @@ void test_paged_vector() {
                     break;
                 }
                     
+                case RANGE:
+                    if (!std_vec.empty()) {
+                        size_t begin = prng() % dyn_vec.size();
+                        size_t count = prng() % (dyn_vec.size() - begin + 1);
+                        vector<uint64_t> vals(count);
+                        for (size_t k = 0; k < count; k++) {
+                            vals[k] = next_val;
+                            std_vec[begin + k] = next_val;
+                            next_val = val_distr(prng);
+                        }
+                        dyn_vec.set_range(begin, count, vals.data());
+                        
+                        begin = prng() % dyn_vec.size();
+                        count = prng() % (dyn_vec.size() - begin + 1);
+                        vals.assign(count, 0);
+                        dyn_vec.get_range(begin, count, vals.data());
+                        for (size_t k = 0; k < count; k++) {
+                            assert(vals[k] == std_vec[begin + k]);
+                        }
+                        
+                        // scanning a range should see the same values
+                        size_t scanned = 0;
+                        assert(dyn_vec.for_each_in_range(begin, begin + count, [&](const uint64_t& val) {
+                            assert(val == std_vec[begin + scanned]);
+                            scanned++;
+                            return true;
+                        }));
+                        assert(scanned == count);
+                        if (count > 1) {
+                            scanned = 0;
+                            assert(!dyn_vec.for_each_in_range(begin, begin + count, [&](const uint64_t& val) {
+                                scanned++;
+                                return scanned < count / 2 + 1;
+                            }));
+                            assert(scanned == count / 2 + 1);
+                        }
+                    }
+                    
+                    break;
+                    
                 default:
                     break;
             }
@@ -2889,6 +3295,24 @@ void test_paged_vector() {
             assert(std_vec.empty() == dyn_vec.empty());
             assert(std_vec.size() == dyn_vec.size());
         }
+        
+        // iterating should see all the values, forward and backward
+        assert(std::equal(dyn_vec.begin(), dyn_vec.end(), std_vec.begin(), std_vec.end()));
+        assert(std::equal(dyn_vec.rbegin(), dyn_vec.rend(), std_vec.rbegin(), std_vec.rend()));
+        assert(dyn_vec.end() - dyn_vec.begin() == std_vec.size());
+        if (!std_vec.empty()) {
+            // and jumping around should too
+            auto it = dyn_vec.begin();
+            for (size_t k = 0; k < 10; k++) {
+                size_t idx = prng() % std_vec.size();
+                it += std::ptrdiff_t(idx) - (it - dyn_vec.begin());
+                assert(*it == std_vec[idx]);
+                assert(*(dyn_vec.rbegin() + (std_vec.size() - 1 - idx)) == std_vec[idx]);
+            }
+            it = dyn_vec.end();
+            --it;
+            assert(*it == std_vec.back());
+        }
     }
     cerr << "PagedVector (" << typeid(PagedVectorImpl).name() << ") tests successful!" << endl;
 }
@@ -3000,6 +3424,176 @@ void test_packed_deque() {
     cerr << "PackedDeque tests successful!" << endl;
 }
 
+template<typename Backend>
+void test_sparse_packed_deque() {
+    enum deque_op_t {SET = 0, SET_ZERO = 1, APPEND_LEFT = 2, DROP_LEFT = 3, APPEND_RIGHT = 4, DROP_RIGHT = 5,
+                     EXTEND_LEFT = 6, EXTEND_RIGHT = 7, SEEK = 8, SERIALIZE = 9, SHRINK = 10};
+    std::random_device rd;
+    std::default_random_engine prng(rd());
+    std::uniform_int_distribution<int> op_distr(0, 10);
+    
+    int num_runs = 50;
+    int num_ops = 200;
+    
+    auto check_equal = [](const std::deque<uint64_t>& std_deq, const SparsePackedDeque<Backend>& sparse_deq) {
+        assert(std_deq.size() == sparse_deq.size());
+        assert(std_deq.empty() == sparse_deq.empty());
+        for (size_t i = 0; i < std_deq.size(); i++) {
+            assert(std_deq[i] == sparse_deq.get(i));
+        }
+    };
+    
+    for (size_t i = 0; i < num_runs; i++) {
+        
+        uint64_t next_val = 1;
+        
+        std::deque<uint64_t> std_deq;
+        SparsePackedDeque<Backend> sparse_deq;
+        
+        for (size_t j = 0; j < num_ops; j++) {
+            
+            deque_op_t op = (deque_op_t) op_distr(prng);
+            switch (op) {
+                case SET:
+                case SET_ZERO:
+                    for (size_t k = 0; k < 5 && !std_deq.empty(); k++) {
+                        size_t idx = prng() % std_deq.size();
+                        uint64_t val = op == SET ? next_val++ : 0;
+                        std_deq[idx] = val;
+                        sparse_deq.set(idx, val);
+                    }
+                    break;
+                    
+                case APPEND_LEFT:
+                    std_deq.push_front(next_val);
+                    sparse_deq.append_front(next_val);
+                    next_val++;
+                    break;
+                    
+                case APPEND_RIGHT:
+                    std_deq.push_back(next_val);
+                    sparse_deq.append_back(next_val);
+                    next_val++;
+                    break;
+                    
+                case DROP_LEFT:
+                case DROP_RIGHT:
+                {
+                    size_t count = std_deq.empty() ? 0 : prng() % (std_deq.size() / 2 + 1);
+                    for (size_t k = 0; k < count; k++) {
+                        if (op == DROP_LEFT) {
+                            std_deq.pop_front();
+                        }
+                        else {
+                            std_deq.pop_back();
+                        }
+                    }
+                    if (op == DROP_LEFT) {
+                        sparse_deq.drop_front(count);
+                    }
+                    else {
+                        sparse_deq.drop_back(count);
+                    }
+                    if (!std_deq.empty() && prng() % 2 == 0) {
+                        std_deq.pop_back();
+                        sparse_deq.pop_back();
+                    }
+                    break;
+                }
+                    
+                case EXTEND_LEFT:
+                case EXTEND_RIGHT:
+                {
+                    // sometimes long enough to cross superblocks
+                    size_t count = prng() % 4 == 0 ? prng() % 100000 : prng() % 1000;
+                    for (size_t k = 0; k < count; k++) {
+                        if (op == EXTEND_LEFT) {
+                            std_deq.push_front(0);
+                        }
+                        else {
+                            std_deq.push_back(0);
+                        }
+                    }
+                    if (op == EXTEND_LEFT) {
+                        sparse_deq.extend_front(count);
+                    }
+                    else {
+                        sparse_deq.extend_back(count);
+                    }
+                    break;
+                }
+                    
+                case SEEK:
+                    for (size_t k = 0; k < 5 && !std_deq.empty(); k++) {
+                        size_t idx = prng() % std_deq.size();
+                        size_t next = idx;
+                        while (next < std_deq.size() && std_deq[next] == 0) {
+                            next++;
+                        }
+                        assert(sparse_deq.next_nonzero(idx) == next);
+                        size_t prev = idx + 1;
+                        while (prev > 0 && std_deq[prev - 1] == 0) {
+                            prev--;
+                        }
+                        assert(sparse_deq.prev_nonzero(idx) == (prev == 0 ? std_deq.size() : prev - 1));
+                    }
+                    assert(sparse_deq.next_nonzero(std_deq.size()) == std_deq.size());
+                    break;
+                    
+                case SERIALIZE:
+                {
+                    stringstream strm;
+                    
+                    sparse_deq.serialize(strm);
+                    strm.seekg(0);
+                    SparsePackedDeque<Backend> copy_deq(strm);
+                    check_equal(std_deq, copy_deq);
+                    break;
+                }
+                    
+                case SHRINK:
+                    sparse_deq.shrink_to_fit();
+                    check_equal(std_deq, sparse_deq);
+                    break;
+                    
+                default:
+                    break;
+            }
+            
+            assert(std_deq.size() == sparse_deq.size());
+            for (size_t k = 0; k < 10 && !std_deq.empty(); k++) {
+                size_t idx = prng() % std_deq.size();
+                assert(std_deq[idx] == sparse_deq.get(idx));
+            }
+        }
+        check_equal(std_deq, sparse_deq);
+    }
+    
+    // long runs of 0's take up almost no space
+    {
+        SparsePackedDeque<Backend> sparse_deq;
+        sparse_deq.append_back(1);
+        sparse_deq.extend_back(100000000);
+        sparse_deq.append_back(2);
+        sparse_deq.extend_front(100000000);
+        sparse_deq.append_front(3);
+        assert(sparse_deq.size() == 200000003);
+        assert(sparse_deq.memory_usage() < 1000000);
+        assert(sparse_deq.get(0) == 3);
+        assert(sparse_deq.get(100000001) == 1);
+        assert(sparse_deq.get(200000002) == 2);
+        assert(sparse_deq.get(150000000) == 0);
+        assert(sparse_deq.next_nonzero(1) == 100000001);
+        assert(sparse_deq.prev_nonzero(200000001) == 100000001);
+        sparse_deq.drop_front(sparse_deq.next_nonzero(1));
+        assert(sparse_deq.size() == 100000002);
+        assert(sparse_deq.get(0) == 1);
+        assert(sparse_deq.memory_usage() < 1000000);
+    }
+    cerr << "SparsePackedDeque tests successful!" << endl;
+}
+
+template<typename PackedSetImpl>
 void test_packed_set() {
     enum set_op_t {INSERT = 0, REMOVE = 1, FIND = 2};
     
@@ -3018,7 +3612,7 @@ void test_packed_set() {
         uint64_t next_val = 0;
         
         unordered_set<uint64_t> std_set;
-        PackedSet<> packed_set;
+        PackedSetImpl packed_set;
         
         for (size_t j = 0; j < num_ops; j++) {
             set_op_t op = (set_op_t) op_distr(prng);
@@ -3094,10 +3688,217 @@ void test_packed_set() {
             assert(std_set.empty() == packed_set.empty());
             assert(std_set.size() == packed_set.size());
         }
+        
+        unordered_set<uint64_t> iterated;
+        for (auto it = packed_set.begin(); it != packed_set.end(); ++it) {
+            assert(std_set.count(*it));
+            iterated.insert(*it);
+        }
+        assert(iterated.size() == std_set.size());
     }
     cerr << "PackedSet tests successful!" << endl;
 }
 
+template<typename Backend>
+void test_grouped_packed_set() {
+    
+    random_device rd;
+    default_random_engine prng(rd());
+    
+    // values across the whole 64-bit range, which don't share an anchor well
+    {
+        GroupedPackedSet<Backend> packed_set;
+        unordered_set<uint64_t> std_set;
+        for (size_t i = 0; i < 2000; i++) {
+            uint64_t val = prng() % 4 == 0 ? numeric_limits<uint64_t>::max() - prng() % 100 : ((uint64_t) prng() << 32) ^ prng();
+            packed_set.insert(val);
+            std_set.insert(val);
+        }
+        for (uint64_t val : {(uint64_t) 0, (uint64_t) 1, numeric_limits<uint64_t>::max()}) {
+            packed_set.insert(val);
+            std_set.insert(val);
+        }
+        assert(packed_set.size() == std_set.size());
+        for (uint64_t val : std_set) {
+            assert(packed_set.find(val));
+        }
+        for (size_t i = 0; i < 2000; i++) {
+            uint64_t val = ((uint64_t) prng() << 32) ^ prng();
+            assert(packed_set.find(val) == (bool) std_set.count(val));
+        }
+        
+        // copies are independent
+        GroupedPackedSet<Backend> copy = packed_set;
+        copy.remove(0);
+        assert(!copy.find(0));
+        assert(packed_set.find(0));
+        
+        packed_set.clear();
+        assert(packed_set.empty());
+        assert(!packed_set.find(1));
+        assert(packed_set.begin() == packed_set.end());
+    }
+    
+    // churn through a working set, as a visited set would, at different
+    // loads, to leave deleted slots behind
+    for (size_t window_size : {1, 13, 500, 1790}) {
+        GroupedPackedSet<Backend> packed_set;
+        std::deque<uint64_t> window;
+        for (uint64_t val = 1; val < 50000; val++) {
+            packed_set.insert(val);
+            window.push_back(val);
+            if (window.size() > window_size) {
+                packed_set.remove(window.front());
+                window.pop_front();
+            }
+            if (val % 997 == 0) {
+                assert(packed_set.size() == window.size());
+                assert(packed_set.find(window.front()));
+                assert(packed_set.find(window.back()));
+                assert(!packed_set.find(window.front() - 1));
+                assert(!packed_set.find(val + 1));
+            }
+        }
+        size_t count = 0;
+        for (auto it = packed_set.begin(); it != packed_set.end(); ++it) {
+            assert(*it >= window.front() && *it <= window.back());
+            count++;
+        }
+        assert(count == window.size());
+        for (uint64_t val : window) {
+            packed_set.remove(val);
+        }
+        assert(packed_set.empty());
+    }
+    
+    cerr << "GroupedPackedSet tests successful!" << endl;
+}
+
+void test_swiss_table() {
+    
+    random_device rd;
+    default_random_engine prng(rd());
+    
+    // random operations against the standard library
+    for (size_t run = 0; run < 20; run++) {
+        HashMapFor<STLBackend, SwissHashTables>::type<int64_t, string> swiss_map;
+        unordered_map<int64_t, string> std_map;
+        // vary how many keys there are to choose from, to get different
+        // mixes of hits, misses, and deleted slots
+        int64_t key_range = 1 << (run % 12 + 1);
+        for (size_t op = 0; op < 5000; op++) {
+            int64_t key = (int64_t) (prng() % key_range) - key_range / 2;
+            switch (prng() % 5) {
+            case 0:
+            {
+                string value = to_string(prng());
+                auto inserted = swiss_map.insert(make_pair(key, value));
+                auto std_inserted = std_map.insert(make_pair(key, value));
+                assert(inserted.second == std_inserted.second);
+                assert(inserted.first->first == key);
+                assert(inserted.first->second == std_inserted.first->second);
+                break;
+            }
+            case 1:
+                swiss_map[key] += "x";
+                std_map[key] += "x";
+                break;
+            case 2:
+                assert(swiss_map.erase(key) == std_map.erase(key));
+                break;
+            default:
+            {
+                auto it = swiss_map.find(key);
+                auto std_it = std_map.find(key);
+                assert((it == swiss_map.end()) == (std_it == std_map.end()));
+                if (it != swiss_map.end()) {
+                    assert(it->second == std_it->second);
+                    assert(swiss_map.at(key) == std_it->second);
+                }
+                assert(swiss_map.count(key) == std_map.count(key));
+                break;
+            }
+            }
+            assert(swiss_map.size() == std_map.size());
+        }
+        
+        size_t count = 0;
+        for (const auto& entry : swiss_map) {
+            assert(std_map.at(entry.first) == entry.second);
+            count++;
+        }
+        assert(count == std_map.size());
+        
+        // copies and moves keep the same entries
+        auto copy = swiss_map;
+        copy.rehash(0);
+        assert(copy.size() == std_map.size());
+        assert(copy.load_factor() <= copy.max_load_factor());
+        decltype(copy) moved = std::move(copy);
+        for (const auto& entry : std_map) {
+            assert(moved.at(entry.first) == entry.second);
+        }
+        
+        // and we can erase everything while iterating
+        auto it = swiss_map.begin();
+        while (it != swiss_map.end()) {
+            assert(std_map.erase(it->first));
+            it = swiss_map.erase(it);
+        }
+        assert(swiss_map.empty());
+        assert(std_map.empty());
+    }
+    
+    // missing keys throw
+    {
+        HashMapFor<STLBackend, SwissHashTables>::type<int64_t, int64_t> swiss_map;
+        bool caught = false;
+        try {
+            swiss_map.at(5);
+        } catch (const std::out_of_range& e) {
+            caught = true;
+        }
+        assert(caught);
+        
+        swiss_map.reserve(1000);
+        size_t buckets = swiss_map.bucket_count();
+        for (int64_t i = 0; i < 1000; i++) {
+            swiss_map[i] = i;
+        }
+        // reserving made enough room
+        assert(swiss_map.bucket_count() == buckets);
+        swiss_map.clear();
+        assert(swiss_map.empty());
+        assert(swiss_map.begin() == swiss_map.end());
+        assert(!swiss_map.count(1));
+    }
+    
+    // sets, with string keys
+    {
+        StringHashSetFor<STLBackend, SwissHashTables>::type<string> swiss_set;
+        unordered_set<string> std_set;
+        for (size_t i = 0; i < 3000; i++) {
+            string value = to_string(prng() % 2000);
+            assert(swiss_set.insert(value).second == std_set.insert(value).second);
+            if (i % 3 == 0) {
+                value = to_string(prng() % 2000);
+                assert(swiss_set.erase(value) == std_set.erase(value));
+            }
+        }
+        assert(swiss_set.size() == std_set.size());
+        for (const string& value : swiss_set) {
+            assert(std_set.count(value));
+        }
+    }
+    
+    // backends that need an allocator get the compact tables
+    static_assert(std::is_same<HashMapFor<MappedBackend, SwissHashTables>::type<int64_t, int64_t>,
+                               HashMapFor<MappedBackend>::type<int64_t, int64_t>>::value,
+                  "mapped tables must use the mapped allocator");
+    
+    cerr << "SwissTable tests successful!" << endl;
+}
+
 void test_packed_graph() {
     
     auto check_path = [&](MutablePathDeletableHandleGraph& graph, const path_handle_t& p, const vector<handle_t>& steps) {
@@ -3153,6 +3954,17 @@ void test_packed_graph() {
         else {
             assert(step == graph.path_front_end(p));
         }
+        
+        if (PackedGraph* packed = dynamic_cast<PackedGraph*>(&graph)) {
+            // the scanning walk should visit the same steps
+            size_t i = 0;
+            packed->for_each_step_in_path_fast(p, [&](const step_handle_t& here) {
+                assert(i < steps.size());
+                assert(packed->get_handle_of_step(here) == steps[i]);
+                i++;
+            });
+            assert(i == steps.size());
+        }
     };
     
     auto check_flips = [&](MutablePathDeletableHandleGraph& graph, const path_handle_t& p, const vector<handle_t>& steps) {
@@ -3550,16 +4362,365 @@ void test_packed_graph() {
         check_flips(graph, p0, {h3, h4, h5});
         check_flips(graph, p1, {h1, h3, h5});
     }
-    
-    cerr << "PackedGraph tests successful!" << endl;
-}
 
-void test_multithreaded_overlay_construction() {
-    HashGraph graph;
-    
-    std::string node_content = "GATTACACATTAG";
-    size_t node_count = 1000;
-    size_t true_path_length = node_count * node_content.size();
+    // sectioned serialization, loaded from both a stream and a file
+    {
+        PackedGraph graph;
+
+        vector<handle_t> handles;
+        for (size_t i = 0; i < 50; ++i) {
+            handles.push_back(graph.create_handle(string(1 + i % 7, "ACGT"[i % 4])));
+            if (i > 0) {
+                graph.create_edge(handles[i - 1], handles[i]);
+            }
+        }
+
+        vector<path_handle_t> paths;
+        for (size_t i = 0; i < 10; ++i) {
+            paths.push_back(graph.create_path_handle("path" + to_string(i), i % 2));
+            for (size_t j = i; j < handles.size(); j += i + 1) {
+                graph.append_step(paths.back(), j % 3 ? handles[j] : graph.flip(handles[j]));
+            }
+        }
+        graph.destroy_path(paths[3]);
+
+        auto check_copy = [&](const PackedGraph& copy) {
+            assert(copy.get_node_count() == graph.get_node_count());
+            assert(copy.get_edge_count() == graph.get_edge_count());
+            assert(copy.get_path_count() == graph.get_path_count());
+            for (handle_t h : handles) {
+                assert(copy.get_sequence(copy.get_handle(graph.get_id(h))) == graph.get_sequence(h));
+            }
+            graph.for_each_path_handle([&](const path_handle_t& path) {
+                path_handle_t copy_path = copy.get_path_handle(graph.get_path_name(path));
+                assert(copy.get_is_circular(copy_path) == graph.get_is_circular(path));
+                vector<pair<nid_t, bool>> steps, copy_steps;
+                graph.for_each_step_in_path(path, [&](const step_handle_t& step) {
+                    handle_t h = graph.get_handle_of_step(step);
+                    steps.emplace_back(graph.get_id(h), graph.get_is_reverse(h));
+                });
+                copy.for_each_step_in_path(copy_path, [&](const step_handle_t& step) {
+                    handle_t h = copy.get_handle_of_step(step);
+                    copy_steps.emplace_back(copy.get_id(h), copy.get_is_reverse(h));
+                });
+                assert(steps == copy_steps);
+            });
+        };
+
+        stringstream strm;
+        graph.serialize(strm);
+        strm.seekg(0);
+        PackedGraph from_stream;
+        from_stream.deserialize(strm);
+        check_copy(from_stream);
+
+        char filename[] = "tmpXXXXXX";
+        int fd = mkstemp(filename);
+        assert(fd != -1);
+        assert(close(fd) == 0);
+        graph.serialize(filename);
+        PackedGraph from_file;
+        from_file.deserialize(filename);
+        check_copy(from_file);
+        
+        {
+            // a stream that can't seek gets the same bytes
+            struct AppendingStreambuf : public std::streambuf {
+                string bytes;
+            protected:
+                std::streamsize xsputn(const char* s, std::streamsize n) {
+                    bytes.append(s, n);
+                    return n;
+                }
+                int_type overflow(int_type c) {
+                    if (!traits_type::eq_int_type(c, traits_type::eof())) {
+                        bytes.push_back(traits_type::to_char_type(c));
+                    }
+                    return traits_type::not_eof(c);
+                }
+            };
+            AppendingStreambuf appending;
+            ostream unseekable_out(&appending);
+            assert(unseekable_out.tellp() == std::streampos(-1));
+            graph.serialize(unseekable_out);
+            assert(appending.bytes == strm.str());
+        }
+        
+        {
+            // a truncated graph is an error, not a crash, from a stream or a file
+            string truncated = strm.str();
+            truncated.resize(truncated.size() / 2);
+            auto rejects = [&](const std::function<void(PackedGraph&)>& load) {
+                PackedGraph from_truncated;
+                try {
+                    load(from_truncated);
+                } catch (const std::runtime_error& e) {
+                    return true;
+                }
+                return false;
+            };
+            assert(rejects([&](PackedGraph& from_truncated) {
+                stringstream truncated_strm(truncated);
+                from_truncated.deserialize(truncated_strm);
+            }));
+            std::ofstream truncated_out(filename, std::ios_base::binary | std::ios_base::trunc);
+            truncated_out.write(truncated.data(), truncated.size());
+            truncated_out.close();
+            assert(rejects([&](PackedGraph& from_truncated) {
+                from_truncated.deserialize(filename);
+            }));
+        }
+        
+        if (block_compression_available()) {
+            // block-compressed serialization, with blocks small enough that
+            // the bigger sections are split across several of them
+            graph.set_serialization_compression(true, 64);
+            
+            stringstream compressed_strm;
+            graph.serialize(compressed_strm);
+            compressed_strm << "after";
+            compressed_strm.seekg(0);
+            PackedGraph from_compressed_stream;
+            from_compressed_stream.deserialize(compressed_strm);
+            check_copy(from_compressed_stream);
+            // the stream is left just after the graph
+            string after;
+            compressed_strm >> after;
+            assert(after == "after");
+            
+            graph.serialize(filename);
+            PackedGraph from_compressed_file;
+            from_compressed_file.deserialize(filename);
+            check_copy(from_compressed_file);
+            
+            // the graph doesn't have to be the last thing in the file
+            {
+                std::ofstream followed_out(filename, std::ios_base::binary | std::ios_base::trunc);
+                followed_out << compressed_strm.str();
+            }
+            PackedGraph from_followed_file;
+            from_followed_file.deserialize(filename);
+            check_copy(from_followed_file);
+            
+            // a truncated graph is an error, not a crash
+            string truncated = compressed_strm.str();
+            truncated.resize(truncated.size() / 2);
+            stringstream truncated_strm(truncated);
+            PackedGraph from_truncated;
+            bool caught = false;
+            try {
+                from_truncated.deserialize(truncated_strm);
+            } catch (const std::runtime_error& e) {
+                caught = true;
+            }
+            assert(caught);
+            
+            graph.set_serialization_compression(false);
+        }
+        unlink(filename);
+    }
+
+    // chunked and ranged iteration
+    {
+        PackedGraph graph;
+        for (nid_t id = 5; id < 5000; ++id) {
+            if (id % 7 != 0) {
+                graph.create_handle("A", id);
+            }
+        }
+
+        vector<atomic<int>> visits(5000);
+        for (auto& count : visits) {
+            count = 0;
+        }
+        graph.for_each_handle([&](const handle_t& h) {
+            visits[graph.get_id(h)]++;
+        }, true);
+        for (nid_t id = 0; id < visits.size(); ++id) {
+            assert(visits[id] == (id >= 5 && id % 7 != 0 ? 1 : 0));
+        }
+
+        atomic<size_t> seen(0);
+        bool finished = graph.for_each_handle([&](const handle_t& h) {
+            seen++;
+            return false;
+        }, true);
+        assert(!finished);
+        assert(seen < graph.get_node_count());
+
+        vector<nid_t> in_range;
+        graph.for_each_handle_in_range(1, 30, [&](const handle_t& h) {
+            in_range.push_back(graph.get_id(h));
+        });
+        assert(in_range == vector<nid_t>({5, 6, 8, 9, 10, 11, 12, 13, 15, 16, 17, 18, 19, 20, 22, 23, 24, 25, 26, 27, 29}));
+        in_range.clear();
+        graph.for_each_handle_in_range(4990, 6000, [&](const handle_t& h) {
+            in_range.push_back(graph.get_id(h));
+        });
+        assert(in_range == vector<nid_t>({4990, 4992, 4993, 4994, 4995, 4996, 4997, 4999}));
+    }
+
+    // bulk and parallel path construction
+    {
+        PackedGraph serial, bulk, parallel;
+
+        vector<vector<handle_t>> runs(8);
+        for (PackedGraph* graph : {&serial, &bulk, &parallel}) {
+            for (size_t i = 1; i <= 20; ++i) {
+                graph->create_handle("ACGT", i);
+            }
+        }
+        for (size_t i = 0; i < runs.size(); ++i) {
+            for (size_t j = 0; j < 30; ++j) {
+                runs[i].push_back(serial.get_handle(1 + (i * 7 + j * 3) % 20, (i + j) % 2));
+            }
+        }
+
+        vector<path_handle_t> parallel_paths;
+        for (size_t i = 0; i < runs.size(); ++i) {
+            string name = "path" + to_string(i);
+            path_handle_t serial_path = serial.create_path_handle(name, i == 2);
+            path_handle_t bulk_path = bulk.create_path_handle(name, i == 2);
+            parallel_paths.push_back(parallel.create_path_handle(name, i == 2));
+
+            serial.append_step(serial_path, runs[i].front());
+            bulk.append_step(bulk_path, runs[i].front());
+            parallel.append_step(parallel_paths.back(), runs[i].front());
+
+            for (size_t j = 1; j < runs[i].size(); ++j) {
+                serial.append_step(serial_path, runs[i][j]);
+            }
+            step_handle_t last = bulk.append_steps(bulk_path, vector<handle_t>(runs[i].begin() + 1, runs[i].end()));
+            assert(last == bulk.path_back(bulk_path));
+            assert(bulk.append_steps(bulk_path, vector<handle_t>()) == bulk.path_end(bulk_path));
+
+            runs[i].erase(runs[i].begin());
+        }
+        parallel.append_steps(parallel_paths, runs);
+
+        for (PackedGraph* graph : {&bulk, &parallel}) {
+            assert(graph->get_path_count() == serial.get_path_count());
+            serial.for_each_path_handle([&](const path_handle_t& path) {
+                path_handle_t other_path = graph->get_path_handle(serial.get_path_name(path));
+                assert(graph->get_step_count(other_path) == serial.get_step_count(path));
+                assert(graph->get_is_circular(other_path) == serial.get_is_circular(path));
+                vector<handle_t> steps, other_steps;
+                serial.for_each_step_in_path(path, [&](const step_handle_t& step) {
+                    steps.push_back(serial.get_handle_of_step(step));
+                });
+                graph->for_each_step_in_path(other_path, [&](const step_handle_t& step) {
+                    other_steps.push_back(graph->get_handle_of_step(step));
+                });
+                assert(steps == other_steps);
+                if (serial.get_is_circular(path)) {
+                    assert(graph->get_next_step(graph->path_back(other_path)) == graph->path_begin(other_path));
+                }
+            });
+            for (size_t i = 1; i <= 20; ++i) {
+                handle_t h = serial.get_handle(i);
+                assert(graph->get_step_count(graph->get_handle(i)) == serial.get_step_count(h));
+                graph->for_each_step_on_handle(graph->get_handle(i), [&](const step_handle_t& step) {
+                    assert(graph->get_id(graph->get_handle_of_step(step)) == i);
+                });
+            }
+        }
+    }
+
+    
+    // defragmentation can be turned off and done incrementally
+    {
+        PackedGraph graph;
+        HashGraph reference;
+        
+        graph.set_automatic_defragmentation(false);
+        for (MutablePathDeletableHandleGraph* g : vector<MutablePathDeletableHandleGraph*>{&graph, &reference}) {
+            vector<handle_t> handles;
+            for (size_t i = 0; i < 1000; ++i) {
+                handles.push_back(g->create_handle(i % 2 ? "GAT" : "TACA"));
+                if (i > 0) {
+                    g->create_edge(handles[i - 1], handles[i]);
+                }
+            }
+            for (size_t i = 0; i < 5; ++i) {
+                path_handle_t path = g->create_path_handle("path" + to_string(i));
+                for (size_t j = 0; j < 500; ++j) {
+                    g->append_step(path, handles[j]);
+                }
+                // delete most of each path's steps
+                g->rewrite_segment(g->path_begin(path), g->get_previous_step(g->path_back(path)), vector<handle_t>());
+            }
+            for (size_t i = 500; i < 1000; ++i) {
+                g->destroy_handle(handles[i]);
+            }
+        }
+        assert(graph.needs_defragmentation());
+        
+        size_t num_steps = 0;
+        while (graph.defragment_step(100)) {
+            assert(graph.needs_defragmentation());
+            ++num_steps;
+        }
+        // the work was split up between several calls
+        assert(num_steps > 1);
+        assert(!graph.needs_defragmentation());
+        assert(handlegraph::algorithms::are_equivalent_with_paths(&graph, &reference, true));
+    }
+    
+    // optimizing in parallel gives the same bits as optimizing on one thread
+    {
+        int backup_thread_count = omp_get_max_threads();
+        vector<string> serialized;
+        for (int thread_count : {1, 4}) {
+            omp_set_num_threads(thread_count);
+            
+            PackedGraph graph;
+            vector<handle_t> handles;
+            for (size_t i = 0; i < 3000; ++i) {
+                handles.push_back(graph.create_handle(string("GATTACA").substr(i % 5) + (i % 7 ? "A" : "N")));
+                if (i > 0) {
+                    graph.create_edge(handles[i - 1], handles[i]);
+                }
+                if (i > 10 && i % 3 == 0) {
+                    graph.create_edge(handles[i - 10], graph.flip(handles[i]));
+                }
+            }
+            for (size_t i = 0; i < 10; ++i) {
+                path_handle_t path = graph.create_path_handle("path" + to_string(i), i == 4);
+                for (size_t j = 100 * i; j < 100 * i + 1500; ++j) {
+                    graph.append_step(path, j % 2 ? handles[j] : graph.flip(handles[j]));
+                }
+            }
+            for (size_t i = 2500; i < 3000; i += 3) {
+                graph.destroy_handle(handles[i]);
+            }
+            graph.destroy_path(graph.get_path_handle("path7"));
+            graph.divide_handle(handles[50], vector<size_t>{2});
+            
+            vector<handle_t> order;
+            graph.for_each_handle([&](const handle_t& h) {
+                order.push_back(h);
+            });
+            reverse(order.begin(), order.end());
+            graph.apply_ordering(order, true);
+            graph.optimize();
+            
+            stringstream strm;
+            graph.serialize(strm);
+            serialized.push_back(strm.str());
+        }
+        assert(serialized[0] == serialized[1]);
+        omp_set_num_threads(backup_thread_count);
+    }
+
+    cerr << "PackedGraph tests successful!" << endl;
+}
+
+void test_multithreaded_overlay_construction() {
+    HashGraph graph;
+    
+    std::string node_content = "GATTACACATTAG";
+    size_t node_count = 1000;
+    size_t true_path_length = node_count * node_content.size();
     size_t path_count = 10;
     // We should coalesce 2 paths into each index.
     size_t steps_per_index = node_count * 2;
@@ -3624,6 +4785,81 @@ void test_multithreaded_overlay_construction() {
     cerr << "Multithreaded PackedPositionOverlay tests successful!" << endl;
 }
 
+void test_multithreaded_succinct_overlay_construction() {
+    HashGraph graph;
+    
+    std::string node_content = "GATTACACATTAG";
+    size_t node_count = 1000;
+    size_t true_path_length = node_count * node_content.size();
+    size_t path_count = 10;
+    // We should coalesce 2 paths into each index.
+    size_t steps_per_index = node_count * 2;
+    
+    // Make a long linear graph
+    std::vector<handle_t> nodes;
+    for (size_t i = 0; i < node_count; i++) {
+        nodes.push_back(graph.create_handle(node_content));
+        if (nodes.size() > 1) {
+            graph.create_edge(nodes[nodes.size() - 2], nodes[nodes.size() - 1]);
+        }
+    }
+    
+    // Make a bunch of paths and keep their names
+    std::vector<string> paths;
+    for (size_t i = 0; i < path_count; i++) {
+        string path_name = "path" + std::to_string(i);
+        paths.push_back(path_name);
+        path_handle_t path_handle = graph.create_path_handle(path_name);
+        for (auto& visit : nodes) {
+            graph.append_step(path_handle, visit);
+        }
+    }
+    
+    // Back up the thread count we have been using.
+    int backup_thread_count = omp_get_max_threads();
+    for (int thread_count = 1; thread_count <= 4; thread_count++) {
+        // Try this number of threads
+        omp_set_num_threads(thread_count);
+        
+        // Make overlays with this many threads for construction, including
+        // one that builds 2 indexes at a time and streams its hash keys
+        SuccinctPositionOverlay succinct_overlay(&graph, steps_per_index);
+        PackedPositionOverlay bounded_overlay(&graph, steps_per_index, 2, true);
+        
+        // Make sure they are right
+        for (PackedPositionOverlay* overlay_pointer : vector<PackedPositionOverlay*>{&succinct_overlay, &bounded_overlay}) {
+            auto& overlay = *overlay_pointer;
+            for (auto& path_name : paths) {
+                assert(overlay.has_path(path_name));
+                path_handle_t path_handle = overlay.get_path_handle(path_name);
+                // Make sure they have the right name and length.
+                assert(overlay.get_path_name(path_handle) == path_name);
+                assert(overlay.get_path_length(path_handle) == true_path_length);
+                for (size_t i = 0; i < true_path_length; i++) {
+                    // For each position
+                    // Figure out what node and orientation it should have.
+                    handle_t true_underlying_handle = nodes.at(i / node_content.size());
+                    // Find its step
+                    step_handle_t seen_step = overlay.get_step_at_position(path_handle, i);
+                    // Make sure it is on the right path
+                    assert(overlay.get_path_handle_of_step(seen_step) == path_handle);
+                    // Make sure it is the right node
+                    handle_t observed_handle = overlay.get_handle_of_step(seen_step);
+                    assert(overlay.get_underlying_handle(observed_handle) == true_underlying_handle);
+                    // Make sure the step is at the right place
+                    size_t true_step_start = i - (i % node_content.size());
+                    assert(overlay.get_position_of_step(seen_step) == true_step_start);
+                }
+            }
+        }
+        
+    }
+    // Go back to the default thread count.
+    omp_set_num_threads(backup_thread_count);
+    
+    cerr << "Multithreaded SuccinctPositionOverlay tests successful!" << endl;
+}
+
 void test_path_position_overlays() {
     
     vector<MutablePathDeletableHandleGraph*> implementations;
@@ -3662,9 +4898,11 @@ void test_path_position_overlays() {
             
             PositionOverlay basic_overlay(&graph);
             PackedPositionOverlay packed_overlay(&graph);
+            SuccinctPositionOverlay succinct_overlay(&graph);
             
             overlays.push_back(&basic_overlay);
             overlays.push_back(&packed_overlay);
+            overlays.push_back(&succinct_overlay);
             
             for (PathPositionHandleGraph* implementation : overlays) {
                 PathPositionHandleGraph& overlay = *implementation;
@@ -3776,58 +5014,420 @@ void test_path_position_overlays() {
             assert(overlay.get_step_at_position(p1, 17) == overlay.path_end(p1));
         }
     }
+
+    // steps on empty nodes take up no bases in the succinct overlay's coding
+    {
+        HashGraph graph;
+
+        handle_t h1 = graph.create_handle("GAT");
+        handle_t h2 = graph.create_handle("");
+        handle_t h3 = graph.create_handle("TACA");
+
+        path_handle_t p1 = graph.create_path_handle("p1");
+        step_handle_t s1 = graph.append_step(p1, h2);
+        step_handle_t s2 = graph.append_step(p1, h1);
+        step_handle_t s3 = graph.append_step(p1, h2);
+        step_handle_t s4 = graph.append_step(p1, h3);
+        step_handle_t s5 = graph.append_step(p1, h2);
+
+        path_handle_t p2 = graph.create_path_handle("p2");
+        step_handle_t s6 = graph.append_step(p2, h3);
+        step_handle_t s7 = graph.append_step(p2, h1);
+
+        // put both paths in one index
+        SuccinctPositionOverlay overlay(&graph, 1000);
+
+        assert(overlay.get_path_length(p1) == 7);
+        assert(overlay.get_path_length(p2) == 7);
+
+        assert(overlay.get_position_of_step(s1) == 0);
+        assert(overlay.get_position_of_step(s2) == 0);
+        assert(overlay.get_position_of_step(s3) == 3);
+        assert(overlay.get_position_of_step(s4) == 3);
+        assert(overlay.get_position_of_step(s5) == 7);
+        assert(overlay.get_position_of_step(s6) == 0);
+        assert(overlay.get_position_of_step(s7) == 4);
+
+        for (size_t i = 0; i < 3; i++) {
+            assert(overlay.get_step_at_position(p1, i) == s2);
+        }
+        for (size_t i = 3; i < 7; i++) {
+            assert(overlay.get_step_at_position(p1, i) == s4);
+            assert(overlay.get_step_at_position(p2, i) == (i < 4 ? s6 : s7));
+        }
+        assert(overlay.get_step_at_position(p1, 7) == overlay.path_end(p1));
+        assert(overlay.get_step_at_position(p2, 7) == overlay.path_end(p2));
+
+        SuccinctPositionOverlay copied = overlay;
+        assert(copied.get_step_at_position(p2, 5) == s7);
+        assert(copied.get_position_of_step(s4) == 3);
+    }
+
+    // batch queries agree with the single queries
+    {
+        HashGraph graph;
+
+        vector<handle_t> handles;
+        for (size_t i = 0; i < 200; i++) {
+            // including some empty nodes
+            handles.push_back(graph.create_handle(string(i % 5, "ACGT"[i % 4])));
+        }
+        path_handle_t p1 = graph.create_path_handle("p1");
+        path_handle_t p2 = graph.create_path_handle("p2");
+        path_handle_t p3 = graph.create_path_handle("p3");
+        for (size_t i = 0; i < handles.size(); i++) {
+            graph.append_step(p1, handles[i]);
+            graph.append_step(p2, handles[handles.size() - i - 1]);
+        }
+
+        // put some paths in the same index
+        PackedPositionOverlay packed_overlay(&graph, 300);
+        SuccinctPositionOverlay succinct_overlay(&graph, 300);
+
+        for (PackedPositionOverlay* overlay : vector<PackedPositionOverlay*>{&packed_overlay, &succinct_overlay}) {
+            for (path_handle_t path : {p1, p2, p3}) {
+                size_t path_length = overlay->get_path_length(path);
+                // dense, sparse, and past-the-end positions
+                for (size_t stride : {1, 7, 101}) {
+                    vector<size_t> positions;
+                    for (size_t i = 0; i < path_length + 3; i += stride) {
+                        positions.push_back(i);
+                    }
+                    vector<step_handle_t> steps;
+                    overlay->get_steps_at_positions(path, positions, steps);
+                    assert(steps.size() == positions.size());
+                    for (size_t i = 0; i < positions.size(); i++) {
+                        assert(steps[i] == overlay->get_step_at_position(path, positions[i]));
+                    }
+                }
+                // out of order positions
+                vector<size_t> positions{path_length / 2, 0, path_length, path_length / 3, path_length / 3};
+                vector<step_handle_t> steps;
+                overlay->get_steps_at_positions(path, positions, steps);
+                for (size_t i = 0; i < positions.size(); i++) {
+                    assert(steps[i] == overlay->get_step_at_position(path, positions[i]));
+                }
+
+                // and the other way around, including the end
+                steps.clear();
+                overlay->for_each_step_in_path(path, [&](const step_handle_t& step) {
+                    steps.push_back(step);
+                });
+                steps.push_back(overlay->path_end(path));
+                vector<size_t> step_positions;
+                overlay->get_positions_of_steps(path, steps, step_positions);
+                assert(step_positions.size() == steps.size());
+                for (size_t i = 0; i < steps.size(); i++) {
+                    assert(step_positions[i] == overlay->get_position_of_step(steps[i]));
+                }
+            }
+        }
+    }
     cerr << "PathPositionOverlay tests successful!" << endl;
 }
 
-void test_packed_reference_path_overlay() {
+void test_lazy_position_overlay() {
     
-    vector<MutablePathDeletableHandleGraph*> implementations;
-
-    HashGraph hg;
-    implementations.push_back(&hg);
-
-    PackedGraph pg;
-    implementations.push_back(&pg);
+    HashGraph graph;
     
-    MappedPackedGraph mpg;
-    implementations.push_back(&mpg);
+    vector<handle_t> handles;
+    for (size_t i = 0; i < 100; i++) {
+        handles.push_back(graph.create_handle(string(i % 6, "ACGT"[i % 4])));
+    }
+    vector<path_handle_t> paths;
+    for (size_t i = 0; i < 40; i++) {
+        path_handle_t path = graph.create_path_handle("path" + to_string(i));
+        for (size_t j = 0; j < i * 5; j++) {
+            graph.append_step(path, handles[(i * 7 + j) % handles.size()]);
+        }
+        paths.push_back(path);
+    }
     
-    for (MutablePathDeletableHandleGraph* implementation : implementations) {
-        
-        MutablePathDeletableHandleGraph& graph = *implementation;
-        
-        handle_t h1 = graph.create_handle("AAA");
-        handle_t h2 = graph.create_handle("A");
-        handle_t h3 = graph.create_handle("T");
-        handle_t h4 = graph.create_handle("AAAAA");
-        
-        graph.create_edge(h1, h2);
-        graph.create_edge(h1, h3);
-        graph.create_edge(h2, h4);
-        graph.create_edge(h3, h4);
-        
-        path_handle_t p1 = graph.create_path_handle("p1");
-        step_handle_t s1 = graph.append_step(p1, h1);
-        step_handle_t s2 = graph.append_step(p1, h2);
-        step_handle_t s3 = graph.append_step(p1, h4);
+    // The fully built overlay is the truth
+    PackedPositionOverlay truth(&graph);
+    
+    auto check_path = [&](const LazyPositionOverlay& overlay, const path_handle_t& path) {
+        size_t path_length = truth.get_path_length(path);
+        assert(overlay.get_path_length(path) == path_length);
+        for (size_t i = 0; i < path_length + 2; i++) {
+            assert(overlay.get_step_at_position(path, i) == truth.get_step_at_position(path, i));
+        }
+        truth.for_each_step_in_path(path, [&](const step_handle_t& step) {
+            assert(overlay.get_position_of_step(step) == truth.get_position_of_step(step));
+        });
+        assert(overlay.get_position_of_step(overlay.path_end(path)) == path_length);
+    };
+    
+    // paths are only indexed when they are queried
+    {
+        LazyPositionOverlay overlay(&graph);
+        assert(overlay.get_indexed_path_count() == 0);
+        check_path(overlay, paths[3]);
+        check_path(overlay, paths[0]);
+        assert(overlay.get_indexed_path_count() == 2);
+        check_path(overlay, paths[3]);
+        assert(overlay.get_indexed_path_count() == 2);
+        
+        // and can be built concurrently
+        #pragma omp parallel for
+        for (size_t i = 0; i < paths.size() * 4; i++) {
+            check_path(overlay, paths[i % paths.size()]);
+        }
+        assert(overlay.get_indexed_path_count() == paths.size());
         
-        path_handle_t p2 = graph.create_path_handle("p2");
-        step_handle_t s2_1 = graph.append_step(p2, graph.flip(h4));
-        step_handle_t s2_2 = graph.append_step(p2, graph.flip(h3));
-        step_handle_t s2_3 = graph.append_step(p2, graph.flip(h1));
+        vector<size_t> positions{0, 5, 17, 40, 1000};
+        vector<step_handle_t> steps;
+        overlay.get_steps_at_positions(paths[20], positions, steps);
+        for (size_t i = 0; i < positions.size(); i++) {
+            assert(steps[i] == truth.get_step_at_position(paths[20], positions[i]));
+        }
+    }
+    
+    // cold indexes are dropped to stay under a budget
+    {
+        LazyPositionOverlay overlay(&graph, 1);
+        for (const path_handle_t& path : paths) {
+            check_path(overlay, path);
+            // the newest index is kept even though it is over the budget
+            assert(overlay.get_indexed_path_count() == 1);
+        }
         
-        {
+        #pragma omp parallel for
+        for (size_t i = 0; i < paths.size() * 4; i++) {
+            check_path(overlay, paths[i % paths.size()]);
+        }
+        assert(overlay.get_indexed_path_count() == 1);
+    }
+    
+    // and a budget that fits some of the indexes keeps more than one
+    {
+        LazyPositionOverlay unlimited(&graph);
+        for (const path_handle_t& path : paths) {
+            check_path(unlimited, path);
+        }
+        size_t total = unlimited.memory_breakdown().find("indexes")->bytes;
         
-            PackedReferencePathOverlay overlay(&graph);
-                
-            assert(overlay.get_path_length(p1) == 9);
-            
-            assert(overlay.get_position_of_step(s1) == 0);
-            assert(overlay.get_position_of_step(s2) == 3);
-            assert(overlay.get_position_of_step(s3) == 4);
-            
-            assert(overlay.get_step_at_position(p1, 0) == s1);
-            assert(overlay.get_step_at_position(p1, 1) == s1);
+        LazyPositionOverlay overlay(&graph, total / 2);
+        for (const path_handle_t& path : paths) {
+            check_path(overlay, path);
+        }
+        assert(overlay.get_indexed_path_count() > 1);
+        assert(overlay.get_indexed_path_count() < paths.size());
+        assert(overlay.memory_breakdown().find("indexes")->bytes <= total / 2);
+    }
+    
+    cerr << "LazyPositionOverlay tests successful!" << endl;
+}
+
+void test_compact_mutable_position_overlay() {
+    
+    random_device rd;
+    default_random_engine prng(rd());
+    
+    // Apply the same edits to a MutablePositionOverlay and a
+    // CompactMutablePositionOverlay over identical graphs, and make sure they
+    // always agree.
+    HashGraph graph, compact_graph;
+    MutablePositionOverlay overlay(&graph);
+    CompactMutablePositionOverlay compact_overlay(&compact_graph);
+    
+    vector<MutablePathDeletableHandleGraph*> both{&overlay, &compact_overlay};
+    
+    // steps that are big enough to need several levels of blocks
+    for (MutablePathDeletableHandleGraph* g : both) {
+        for (size_t i = 0; i < 50; i++) {
+            g->create_handle(string(1 + i % 7, "ACGT"[i % 4]));
+        }
+        for (size_t i = 0; i < 3; i++) {
+            g->create_path_handle("path" + to_string(i));
+        }
+    }
+    uniform_int_distribution<nid_t> node_distr(1, 50);
+    for (size_t i = 0; i < 5000; i++) {
+        string path_name = "path" + to_string(i % 3);
+        nid_t node_id = node_distr(prng);
+        bool rev = i % 5 == 0;
+        for (MutablePathDeletableHandleGraph* g : both) {
+            g->append_step(g->get_path_handle(path_name), g->get_handle(node_id, rev));
+        }
+    }
+    
+    auto check_agreement = [&]() {
+        assert(overlay.get_path_count() == compact_overlay.get_path_count());
+        overlay.for_each_path_handle([&](const path_handle_t& path) {
+            path_handle_t compact_path = compact_overlay.get_path_handle(overlay.get_path_name(path));
+            size_t length = overlay.get_path_length(path);
+            assert(compact_overlay.get_path_length(compact_path) == length);
+            
+            step_handle_t step = overlay.path_begin(path);
+            step_handle_t compact_step = compact_overlay.path_begin(compact_path);
+            size_t true_position = 0;
+            while (step != overlay.path_end(path)) {
+                assert(compact_step != compact_overlay.path_end(compact_path));
+                assert(compact_overlay.get_id(compact_overlay.get_handle_of_step(compact_step)) ==
+                       overlay.get_id(overlay.get_handle_of_step(step)));
+                size_t position = overlay.get_position_of_step(step);
+                assert(position == true_position);
+                assert(compact_overlay.get_position_of_step(compact_step) == position);
+                size_t step_length = overlay.get_length(overlay.get_handle_of_step(step));
+                if (step_length != 0) {
+                    assert(compact_overlay.get_step_at_position(compact_path, position) == compact_step);
+                    assert(compact_overlay.get_step_at_position(compact_path, position + step_length - 1) == compact_step);
+                }
+                true_position += step_length;
+                step = overlay.get_next_step(step);
+                compact_step = compact_overlay.get_next_step(compact_step);
+            }
+            assert(compact_step == compact_overlay.path_end(compact_path));
+            assert(compact_overlay.get_step_at_position(compact_path, length) == compact_overlay.path_end(compact_path));
+            assert(compact_overlay.get_position_of_step(compact_overlay.path_end(compact_path)) == length);
+        });
+    };
+    
+    check_agreement();
+    
+    // Find the step of the given rank on the given path in the given graph
+    auto step_at_rank = [](MutablePathDeletableHandleGraph* g, const path_handle_t& path, size_t rank) {
+        step_handle_t step = g->path_begin(path);
+        for (size_t i = 0; i < rank; i++) {
+            step = g->get_next_step(step);
+        }
+        return step;
+    };
+    
+    uniform_int_distribution<int> op_distr(0, 5);
+    for (size_t op = 0; op < 300; op++) {
+        string path_name = "path" + to_string(op % 3);
+        size_t step_count = overlay.get_step_count(overlay.get_path_handle(path_name));
+        size_t rank = uniform_int_distribution<size_t>(0, step_count - 1)(prng);
+        size_t segment_length = uniform_int_distribution<size_t>(0, 10)(prng);
+        nid_t node_id = node_distr(prng);
+        int op_type = op_distr(prng);
+        vector<nid_t> replacement;
+        for (size_t i = uniform_int_distribution<size_t>(0, 5)(prng); i > 0; i--) {
+            replacement.push_back(node_distr(prng));
+        }
+        for (MutablePathDeletableHandleGraph* g : both) {
+            path_handle_t path = g->get_path_handle(path_name);
+            switch (op_type) {
+            case 0:
+                g->append_step(path, g->get_handle(node_id));
+                break;
+            case 1:
+                g->prepend_step(path, g->get_handle(node_id, true));
+                break;
+            case 2:
+            {
+                // split the node at a step, if it can be split
+                handle_t handle = g->get_handle_of_step(step_at_rank(g, path, rank));
+                if (g->get_length(handle) > 1) {
+                    g->divide_handle(handle, vector<size_t>{1});
+                }
+                break;
+            }
+            case 3:
+            {
+                // replace a run of steps with some other steps
+                step_handle_t begin = step_at_rank(g, path, rank);
+                step_handle_t end = begin;
+                for (size_t i = 0; i < segment_length && end != g->path_end(path); i++) {
+                    end = g->get_next_step(end);
+                }
+                vector<handle_t> new_segment;
+                for (nid_t id : replacement) {
+                    new_segment.push_back(g->get_handle(id));
+                }
+                g->rewrite_segment(begin, end, new_segment);
+                break;
+            }
+            case 4:
+                g->apply_orientation(g->flip(g->get_handle_of_step(step_at_rank(g, path, rank))));
+                break;
+            case 5:
+            {
+                // make a new short path and get rid of it again
+                path_handle_t temp = g->create_path_handle("temp");
+                g->append_step(temp, g->get_handle(node_id));
+                g->prepend_step(temp, g->get_handle(node_id));
+                assert(g->get_step_count(temp) == 2);
+                g->destroy_path(temp);
+                break;
+            }
+            }
+        }
+        if (op % 20 == 0) {
+            check_agreement();
+        }
+    }
+    check_agreement();
+    
+    // a copy should have its own index
+    {
+        CompactMutablePositionOverlay copied = compact_overlay;
+        path_handle_t path = copied.get_path_handle("path0");
+        assert(copied.get_path_length(path) == overlay.get_path_length(overlay.get_path_handle("path0")));
+        step_handle_t last = copied.path_back(path);
+        assert(copied.get_step_at_position(path, copied.get_position_of_step(last)) == last);
+    }
+    
+    // and a rebuild shouldn't change anything
+    overlay.optimize(false);
+    compact_overlay.optimize(false);
+    check_agreement();
+    assert(compact_overlay.index_memory_usage() > 0);
+    
+    cerr << "CompactMutablePositionOverlay tests successful!" << endl;
+}
+
+void test_packed_reference_path_overlay() {
+    
+    vector<MutablePathDeletableHandleGraph*> implementations;
+
+    HashGraph hg;
+    implementations.push_back(&hg);
+
+    PackedGraph pg;
+    implementations.push_back(&pg);
+    
+    MappedPackedGraph mpg;
+    implementations.push_back(&mpg);
+    
+    for (MutablePathDeletableHandleGraph* implementation : implementations) {
+        
+        MutablePathDeletableHandleGraph& graph = *implementation;
+        
+        handle_t h1 = graph.create_handle("AAA");
+        handle_t h2 = graph.create_handle("A");
+        handle_t h3 = graph.create_handle("T");
+        handle_t h4 = graph.create_handle("AAAAA");
+        
+        graph.create_edge(h1, h2);
+        graph.create_edge(h1, h3);
+        graph.create_edge(h2, h4);
+        graph.create_edge(h3, h4);
+        
+        path_handle_t p1 = graph.create_path_handle("p1");
+        step_handle_t s1 = graph.append_step(p1, h1);
+        step_handle_t s2 = graph.append_step(p1, h2);
+        step_handle_t s3 = graph.append_step(p1, h4);
+        
+        path_handle_t p2 = graph.create_path_handle("p2");
+        step_handle_t s2_1 = graph.append_step(p2, graph.flip(h4));
+        step_handle_t s2_2 = graph.append_step(p2, graph.flip(h3));
+        step_handle_t s2_3 = graph.append_step(p2, graph.flip(h1));
+        
+        {
+        
+            PackedReferencePathOverlay overlay(&graph);
+                
+            assert(overlay.get_path_length(p1) == 9);
+            
+            assert(overlay.get_position_of_step(s1) == 0);
+            assert(overlay.get_position_of_step(s2) == 3);
+            assert(overlay.get_position_of_step(s3) == 4);
+            
+            assert(overlay.get_step_at_position(p1, 0) == s1);
+            assert(overlay.get_step_at_position(p1, 1) == s1);
             assert(overlay.get_step_at_position(p1, 2) == s1);
             assert(overlay.get_step_at_position(p1, 3) == s2);
             assert(overlay.get_step_at_position(p1, 4) == s3);
@@ -3908,10 +5508,200 @@ void test_packed_reference_path_overlay() {
             // Should have the 2 original paths and the 100 new ones.
             assert(seen_paths.size() == 102);
         }
+        
+        {
+            // Only index the reference paths
+            path_handle_t ref = graph.create_path(PathSense::REFERENCE, "GRCh38", "chr1", 0, PathMetadata::NO_PHASE_BLOCK,
+                                                  PathMetadata::NO_SUBRANGE, false);
+            step_handle_t ref_1 = graph.append_step(ref, h4);
+            step_handle_t ref_2 = graph.append_step(ref, graph.flip(h2));
+            path_handle_t hap = graph.create_path(PathSense::HAPLOTYPE, "HG002", "chr1", 1, 0,
+                                                  PathMetadata::NO_SUBRANGE, false);
+            graph.append_step(hap, h1);
+            graph.append_step(hap, h2);
+            
+            std::unordered_set<PathSense> senses{PathSense::REFERENCE};
+            PackedReferencePathOverlay overlay(&graph, &senses, nullptr, nullptr, 10);
+            
+            assert(overlay.get_path_length(ref) == 6);
+            assert(overlay.get_position_of_step(ref_1) == 0);
+            assert(overlay.get_position_of_step(ref_2) == 5);
+            assert(overlay.get_step_at_position(ref, 5) == ref_2);
+            assert(overlay.get_path_handle_of_step(ref_2) == ref);
+            
+            // Steps on other paths aren't found
+            vector<step_handle_t> found;
+            overlay.for_each_step_on_handle(h2, [&](const step_handle_t& s) {
+                found.push_back(s);
+            });
+            assert(found == vector<step_handle_t>{ref_2});
+            found.clear();
+            overlay.for_each_step_on_handle(h1, [&](const step_handle_t& s) {
+                found.push_back(s);
+            });
+            assert(found.empty());
+            
+            // And they can't have position queries
+            bool caught = false;
+            try {
+                overlay.get_path_length(p1);
+            } catch (std::out_of_range& e) {
+                caught = true;
+            }
+            assert(caught);
+            
+            // Filtering on a sample works too
+            std::unordered_set<std::string> samples{"HG002"};
+            PackedReferencePathOverlay hap_overlay(&graph, nullptr, &samples);
+            assert(hap_overlay.get_path_length(hap) == 4);
+            found.clear();
+            hap_overlay.for_each_step_on_handle(h4, [&](const step_handle_t& s) {
+                found.push_back(s);
+            });
+            assert(found.empty());
+            
+            if (dynamic_cast<PackedGraph*>(&graph)) {
+                // A filtered index can be saved and loaded
+                stringstream strm;
+                overlay.serialize(strm);
+                PackedReferencePathOverlay loaded;
+                loaded.set_graph(&graph);
+                loaded.deserialize(strm);
+                assert(loaded.get_position_of_step(ref_2) == 5);
+                assert(loaded.get_step_at_position(ref, 2) == ref_1);
+            }
+        }
     }
     cerr << "PackedReferencePathOverlay tests successful!" << endl;
 }
 
+void test_position_overlay_serialization() {
+    
+    vector<MutablePathDeletableHandleGraph*> implementations;
+    
+    PackedGraph pg;
+    implementations.push_back(&pg);
+    
+    MappedPackedGraph mpg;
+    implementations.push_back(&mpg);
+    
+    for (MutablePathDeletableHandleGraph* implementation : implementations) {
+        
+        MutablePathDeletableHandleGraph& graph = *implementation;
+        
+        vector<handle_t> nodes;
+        for (size_t i = 0; i < 50; i++) {
+            nodes.push_back(graph.create_handle(string(1 + i % 4, "ACGT"[i % 4])));
+        }
+        for (size_t i = 0; i < 20; i++) {
+            path_handle_t path = graph.create_path_handle("path" + to_string(i));
+            for (size_t j = i; j < nodes.size(); j += 1 + i % 3) {
+                graph.append_step(path, j % 2 ? nodes[j] : graph.flip(nodes[j]));
+            }
+        }
+        graph.create_path_handle("empty");
+        
+        // Make sure a loaded overlay answers every query the same as the
+        // overlay that was saved
+        auto check_reload = [&](PackedPositionOverlay& built, PackedPositionOverlay& loaded) {
+            stringstream strm;
+            built.serialize(strm);
+            loaded.set_graph(&graph);
+            loaded.deserialize(strm);
+            
+            graph.for_each_path_handle([&](const path_handle_t& path) {
+                assert(loaded.get_path_length(path) == built.get_path_length(path));
+                graph.for_each_step_in_path(path, [&](const step_handle_t& step) {
+                    assert(loaded.get_position_of_step(step) == built.get_position_of_step(step));
+                    assert(loaded.get_path_handle_of_step(step) == path);
+                });
+                for (size_t i = 0; i <= built.get_path_length(path); i++) {
+                    assert(loaded.get_step_at_position(path, i) == built.get_step_at_position(path, i));
+                }
+            });
+            graph.for_each_handle([&](const handle_t& handle) {
+                vector<step_handle_t> built_steps, loaded_steps;
+                built.for_each_step_on_handle(handle, [&](const step_handle_t& step) {
+                    built_steps.push_back(step);
+                });
+                loaded.for_each_step_on_handle(handle, [&](const step_handle_t& step) {
+                    loaded_steps.push_back(step);
+                });
+                assert(built_steps == loaded_steps);
+            });
+        };
+        
+        {
+            PackedPositionOverlay built(&graph, 10);
+            PackedPositionOverlay loaded;
+            check_reload(built, loaded);
+        }
+        {
+            PackedReferencePathOverlay built(&graph, 10);
+            PackedReferencePathOverlay loaded;
+            check_reload(built, loaded);
+        }
+        {
+            SuccinctPositionOverlay built(&graph, 10);
+            SuccinctPositionOverlay loaded;
+            check_reload(built, loaded);
+        }
+        
+        // Loading the wrong type of index should fail
+        {
+            PackedPositionOverlay built(&graph);
+            stringstream strm;
+            built.serialize(strm);
+            SuccinctPositionOverlay loaded;
+            loaded.set_graph(&graph);
+            bool caught = false;
+            try {
+                loaded.deserialize(strm);
+            } catch (std::exception& e) {
+                caught = true;
+            }
+            assert(caught);
+        }
+        
+        // Loading onto a graph with different paths should fail
+        {
+            PackedPositionOverlay built(&graph);
+            stringstream strm;
+            built.serialize(strm);
+            
+            graph.append_step(graph.get_path_handle("path0"), nodes.front());
+            
+            PackedPositionOverlay loaded;
+            loaded.set_graph(&graph);
+            bool caught = false;
+            try {
+                loaded.deserialize(strm);
+            } catch (std::runtime_error& e) {
+                caught = true;
+            }
+            assert(caught);
+        }
+        
+        // Loading without a graph should fail
+        {
+            PackedPositionOverlay built(&graph);
+            stringstream strm;
+            built.serialize(strm);
+            
+            PackedPositionOverlay loaded;
+            bool caught = false;
+            try {
+                loaded.deserialize(strm);
+            } catch (std::runtime_error& e) {
+                caught = true;
+            }
+            assert(caught);
+        }
+    }
+    
+    cerr << "Position overlay serialization tests successful!" << endl;
+}
+
 void test_vectorizable_overlays() {
     
     vector<MutablePathDeletableHandleGraph*> implementations;
@@ -3981,222 +5771,1327 @@ void test_vectorizable_overlays() {
                 }
             });
     }
+    
+    {
+        // A graph big enough to be split up among threads when indexing
+        int backup_thread_count = omp_get_max_threads();
+        omp_set_num_threads(4);
+        
+        PackedGraph graph;
+        vector<handle_t> handles;
+        for (size_t i = 0; i < 20000; i++) {
+            handles.push_back(graph.create_handle(string(1 + (i * 7) % 13, "ACGT"[i % 4])));
+            if (i > 0) {
+                graph.create_edge(handles[i - 1], handles[i]);
+            }
+            if (i > 10) {
+                graph.create_edge(handles[i - 10], graph.flip(handles[i]));
+            }
+        }
+        
+        bdsg::VectorizableOverlay overlay(&graph);
+        
+        set<size_t> edge_ranks;
+        size_t edge_count = 0;
+        graph.for_each_edge([&](const edge_t& edge) {
+            size_t rank = overlay.edge_index(edge);
+            assert(rank >= 1);
+            edge_ranks.insert(rank);
+            ++edge_count;
+        });
+        assert(edge_ranks.size() == edge_count);
+        assert(*edge_ranks.rbegin() == edge_count);
+        
+        // nodes are laid out end to end in rank order
+        size_t offset = 0;
+        for (size_t rank = 1; rank <= handles.size(); rank++) {
+            nid_t node_id = overlay.rank_to_id(rank);
+            assert(overlay.id_to_rank(node_id) == rank);
+            assert(overlay.node_vector_offset(node_id) == offset);
+            assert(overlay.node_at_vector_offset(offset + 1) == node_id);
+            offset += graph.get_length(graph.get_handle(node_id));
+        }
+        
+        omp_set_num_threads(backup_thread_count);
+        
+        // and the parallel sort agrees with the serial one
+        vector<size_t> numbers;
+        default_random_engine prng(1234);
+        for (size_t i = 0; i < 100000; i++) {
+            numbers.push_back(prng() % 5000);
+        }
+        vector<size_t> expected = numbers;
+        std::sort(expected.begin(), expected.end());
+        parallel_sort(numbers.begin(), numbers.end());
+        assert(numbers == expected);
+    }
     cerr << "VectorizableOverlay tests successful!" << endl;
 }
 
-void test_packed_subgraph_overlay() {
+void test_packed_position_vectorizable_overlay() {
     
-    vector<MutablePathDeletableHandleGraph*> implementations;
-
-    HashGraph hg;
-    implementations.push_back(&hg);
+    PackedGraph graph;
+    vector<handle_t> handles;
+    for (size_t i = 0; i < 50; i++) {
+        handles.push_back(graph.create_handle(string(1 + (i * 5) % 7, "ACGT"[i % 4])));
+        if (i > 0) {
+            graph.create_edge(handles[i - 1], handles[i]);
+        }
+        if (i > 3) {
+            graph.create_edge(handles[i - 3], graph.flip(handles[i]));
+        }
+    }
+    for (size_t p = 0; p < 3; p++) {
+        path_handle_t path = graph.create_path_handle("path" + to_string(p), p == 2);
+        for (size_t i = p; i < handles.size(); i += p + 1) {
+            graph.append_step(path, p == 1 ? graph.flip(handles[i]) : handles[i]);
+        }
+    }
+    
+    // the fused overlay answers like the two overlays stacked up
+    PackedPositionOverlay position_overlay(&graph, 20);
+    PathPositionVectorizableOverlay stacked(&position_overlay);
+    PackedPositionVectorizableOverlay fused(&graph, 20);
+    
+    assert(fused.get_node_count() == graph.get_node_count());
+    assert(fused.get_path_count() == graph.get_path_count());
+    graph.for_each_handle([&](const handle_t& h) {
+        nid_t id = graph.get_id(h);
+        assert(fused.get_sequence(h) == graph.get_sequence(h));
+        assert(fused.id_to_rank(id) == stacked.id_to_rank(id));
+        assert(fused.node_vector_offset(id) == stacked.node_vector_offset(id));
+        assert(fused.node_at_vector_offset(fused.node_vector_offset(id) + 1) == id);
+        assert(fused.get_underlying_handle(h) == h);
+    });
+    graph.for_each_edge([&](const edge_t& e) {
+        assert(fused.edge_index(e) == stacked.edge_index(e));
+    });
+    graph.for_each_path_handle([&](const path_handle_t& path) {
+        assert(fused.get_path_length(path) == stacked.get_path_length(path));
+        vector<step_handle_t> steps;
+        vector<size_t> positions;
+        graph.for_each_step_in_path(path, [&](const step_handle_t& step) {
+            size_t position = fused.get_position_of_step(step);
+            assert(position == stacked.get_position_of_step(step));
+            assert(fused.get_step_at_position(path, position) == step);
+            steps.push_back(step);
+            positions.push_back(position);
+        });
+        vector<size_t> batch_positions;
+        fused.get_positions_of_steps(path, steps, batch_positions);
+        assert(batch_positions == positions);
+        vector<step_handle_t> batch_steps;
+        fused.get_steps_at_positions(path, positions, batch_steps);
+        assert(batch_steps == steps);
+        assert(fused.get_step_at_position(path, fused.get_path_length(path)) == graph.path_end(path));
+    });
+    
+    // the helper uses the fused overlay when neither interface is there, a
+    // single overlay when only one is, and nothing when both are
+    {
+        PathPositionVectorizableOverlayHelper helper;
+        const VectorizableHandleGraph* overlaid = helper.apply((const PathHandleGraph*) &graph);
+        assert(dynamic_cast<const PackedPositionVectorizableOverlay*>(overlaid) != nullptr);
+        assert(helper.get() == overlaid);
+        const PathPositionHandleGraph* positions = dynamic_cast<const PathPositionHandleGraph*>(overlaid);
+        assert(positions != nullptr);
+        assert(positions->get_path_length(graph.get_path_handle("path0")) ==
+               position_overlay.get_path_length(graph.get_path_handle("path0")));
+    }
+    {
+        PathPositionVectorizableOverlayHelper helper;
+        const VectorizableHandleGraph* overlaid = helper.apply((const PathHandleGraph*) &position_overlay);
+        assert(dynamic_cast<const PathPositionVectorizableOverlay*>(overlaid) != nullptr);
+        assert(dynamic_cast<const PackedPositionVectorizableOverlay*>(overlaid) == nullptr);
+    }
+    {
+        PathPositionVectorizableOverlayHelper helper;
+        assert(helper.apply((PathHandleGraph*) &fused) == &fused);
+    }
+    
+    cerr << "PackedPositionVectorizableOverlay tests successful!" << endl;
+}
 
-    PackedGraph pg;
-    implementations.push_back(&pg);
+template<typename Graph>
+void check_typed_strand_split_overlay(Graph& graph) {
     
-    MappedPackedGraph mpg;
-    implementations.push_back(&mpg);
+    handle_t h1 = graph.create_handle("GATT");
+    handle_t h2 = graph.create_handle("A");
+    handle_t h3 = graph.create_handle("CA");
+    handle_t h4 = graph.create_handle("TTCG");
     
-    for (MutablePathDeletableHandleGraph* implementation : implementations) {
+    graph.create_edge(h1, h2);
+    graph.create_edge(h1, graph.flip(h3));
+    graph.create_edge(h2, h4);
+    graph.create_edge(graph.flip(h3), h4);
+    graph.create_edge(h4, graph.flip(h4));
+    graph.create_edge(graph.flip(h1), h1);
+    
+    // The typed overlay must behave exactly like the generic one
+    StrandSplitOverlay generic(&graph);
+    TypedStrandSplitOverlay<Graph> typed(&graph);
+    
+    assert(typed.get_node_count() == generic.get_node_count());
+    assert(typed.min_node_id() == generic.min_node_id());
+    assert(typed.max_node_id() == generic.max_node_id());
+    
+    vector<handle_t> generic_handles, typed_handles, fast_handles;
+    generic.for_each_handle([&](const handle_t& h) {
+        generic_handles.push_back(h);
+    });
+    typed.for_each_handle([&](const handle_t& h) {
+        typed_handles.push_back(h);
+    });
+    typed.for_each_handle_fast([&](const handle_t& h) {
+        fast_handles.push_back(h);
+    });
+    assert(typed_handles == generic_handles);
+    assert(fast_handles == generic_handles);
+    std::atomic<size_t> parallel_count(0);
+    typed.for_each_handle([&](const handle_t& h) {
+        ++parallel_count;
+    }, true);
+    assert(parallel_count == generic_handles.size());
+    
+    for (handle_t forward : generic_handles) {
+        for (handle_t h : {forward, typed.flip(forward)}) {
+            assert(typed.has_node(typed.get_id(h)));
+            assert(typed.get_id(h) == generic.get_id(h));
+            assert(typed.get_is_reverse(h) == generic.get_is_reverse(h));
+            assert(typed.get_length(h) == generic.get_length(h));
+            assert(typed.get_sequence(h) == generic.get_sequence(h));
+            assert(typed.get_underlying_handle(h) == generic.get_underlying_handle(h));
+            for (bool go_left : {false, true}) {
+                vector<handle_t> generic_next, typed_next, fast_next;
+                generic.follow_edges(h, go_left, [&](const handle_t& next) {
+                    generic_next.push_back(next);
+                });
+                typed.follow_edges(h, go_left, [&](const handle_t& next) {
+                    typed_next.push_back(next);
+                });
+                typed.follow_edges_fast(h, go_left, [&](const handle_t& next) {
+                    fast_next.push_back(next);
+                });
+                assert(typed_next == generic_next);
+                assert(fast_next == generic_next);
+                assert(typed.get_degree(h, go_left) == generic.get_degree(h, go_left));
+                
+                // stopping early works
+                size_t seen = 0;
+                bool finished = typed.follow_edges_fast(h, go_left, [&](const handle_t& next) {
+                    ++seen;
+                    return false;
+                });
+                assert(finished == generic_next.empty());
+                assert(seen == std::min<size_t>(1, generic_next.size()));
+            }
+        }
+    }
+    assert(!typed.has_node((graph.max_node_id() + 1) << 1));
+}
 
-        MutablePathDeletableHandleGraph& graph = *implementation;
+void test_strand_split_overlay() {
+    {
+        PackedGraph graph;
+        check_typed_strand_split_overlay(graph);
+    }
+    {
+        HashGraph graph;
+        check_typed_strand_split_overlay(graph);
+    }
+    cerr << "StrandSplitOverlay tests successful!" << endl;
+}
+
+void test_is_single_stranded() {
+    
+    // check that an orientation has every node once and makes every edge non-reversing
+    auto check_orientation = [](const HandleGraph& graph, const vector<handle_t>& orientation) {
+        assert(orientation.size() == graph.get_node_count());
+        unordered_map<nid_t, bool> flipped;
+        for (const handle_t& handle : orientation) {
+            assert(!flipped.count(graph.get_id(handle)));
+            flipped[graph.get_id(handle)] = graph.get_is_reverse(handle);
+        }
+        graph.for_each_edge([&](const edge_t& edge) {
+            assert((graph.get_is_reverse(edge.first) != flipped.at(graph.get_id(edge.first))) ==
+                   (graph.get_is_reverse(edge.second) != flipped.at(graph.get_id(edge.second))));
+        });
+    };
+    
+    int backup_thread_count = omp_get_max_threads();
+    omp_set_num_threads(4);
+    default_random_engine prng(11);
+    
+    for (bool sparse_ids : {false, true}) {
+        PackedGraph graph;
+        assert(graph.is_single_stranded());
+        assert(bdsg::algorithms::parallel_is_single_stranded(&graph));
+        assert(bdsg::algorithms::parallel_single_stranded_orientation(&graph).empty());
+        
+        // chains of nodes in random orientations, joined as a single stranded
+        // graph would be after some nodes were flipped
+        vector<handle_t> handles;
+        for (size_t i = 0; i < 5000; ++i) {
+            handles.push_back(graph.create_handle("GATTACA", sparse_ids ? (i + 1) * 100 : i + 1));
+        }
+        vector<bool> secretly_flipped(handles.size());
+        for (size_t i = 0; i < handles.size(); ++i) {
+            secretly_flipped[i] = prng() % 2;
+        }
+        auto oriented = [&](size_t i) {
+            return secretly_flipped[i] ? graph.flip(handles[i]) : handles[i];
+        };
+        for (size_t i = 0; i < handles.size(); ++i) {
+            if (i % 500 != 0) {
+                graph.create_edge(oriented(i - 1), oriented(i));
+            }
+            if (i > 50 && prng() % 4 == 0) {
+                graph.create_edge(oriented(i), oriented(i - 1 - prng() % 50));
+            }
+        }
         
-        handle_t h1 = graph.create_handle("AAA");
-        handle_t h2 = graph.create_handle("A");
-        handle_t h3 = graph.create_handle("T");
-        handle_t h4 = graph.create_handle("AAAAA");
+        bool expect_single_stranded = true;
+        graph.for_each_edge([&](const edge_t& edge) {
+            expect_single_stranded = expect_single_stranded && graph.get_is_reverse(edge.first) == graph.get_is_reverse(edge.second);
+        });
+        assert(bdsg::algorithms::is_single_stranded(&graph) == expect_single_stranded);
+        assert(bdsg::algorithms::parallel_is_single_stranded(&graph) == expect_single_stranded);
+        assert(graph.is_single_stranded() == expect_single_stranded);
+        
+        auto orientation = bdsg::algorithms::parallel_single_stranded_orientation(&graph);
+        check_orientation(graph, orientation);
+        check_orientation(graph, bdsg::algorithms::single_stranded_orientation(&graph));
+        // handles come out in rank order, which here is ID order
+        for (size_t i = 1; i < orientation.size(); ++i) {
+            assert(graph.get_id(orientation[i - 1]) < graph.get_id(orientation[i]));
+        }
         
-        graph.create_edge(h1, h2);
-        graph.create_edge(h1, h3);
-        graph.create_edge(h2, h4);
-        graph.create_edge(h3, h4);
+        // and through the rank interface
+        bdsg::VectorizableOverlay ranked(&graph);
+        check_orientation(ranked, bdsg::algorithms::parallel_single_stranded_orientation(&ranked));
         
-        PackedSubgraphOverlay subgraph(&graph);
-        assert(subgraph.get_node_count() == 0);
-        subgraph.for_each_handle([&](const handle_t& h) {
-            assert(false);
-        });
-        assert(!subgraph.has_node(graph.get_id(h1)));
-        assert(!subgraph.has_node(graph.get_id(h2)));
-        assert(!subgraph.has_node(graph.get_id(h3)));
-        assert(!subgraph.has_node(graph.get_id(h4)));
-        
-        subgraph.add_node(h1);
-        
-        assert(subgraph.get_node_count() == 1);
-        bool found1 = false;
-        subgraph.for_each_handle([&](const handle_t& h) {
-            if (subgraph.get_id(h) == graph.get_id(h1)) {
-                found1 = true;
-                assert(graph.get_sequence(h) == graph.get_sequence(h1));
-            }
-            else {
-                assert(false);
+        // straighten out all the nodes we can see are flipped, which brings the
+        // cached answer around to single stranded
+        for (const handle_t& handle : orientation) {
+            if (graph.get_is_reverse(handle)) {
+                graph.apply_orientation(handle);
             }
-        });
-        assert(found1);
-        found1 = false;
-        
-        assert(subgraph.has_node(graph.get_id(h1)));
-        assert(!subgraph.has_node(graph.get_id(h2)));
-        assert(!subgraph.has_node(graph.get_id(h3)));
-        assert(!subgraph.has_node(graph.get_id(h4)));
-        
-        subgraph.follow_edges(h1, true, [&](const handle_t& h) {
-            assert(false);
-        });
-        subgraph.follow_edges(h1, false, [&](const handle_t& h) {
-            assert(false);
-        });
-        
-        assert(subgraph.get_degree(h1, true) == 0);
-        assert(subgraph.get_degree(h1, false) == 0);
+        }
+        assert(graph.is_single_stranded());
+        assert(bdsg::algorithms::parallel_is_single_stranded(&graph));
+        
+        // a non-reversing self loop keeps it on
+        graph.create_edge(handles[100], handles[100]);
+        assert(graph.is_single_stranded());
+        check_orientation(graph, bdsg::algorithms::parallel_single_stranded_orientation(&graph));
+        
+        // a reversing edge turns it off
+        graph.create_edge(handles[10], graph.flip(handles[4000]));
+        assert(!graph.is_single_stranded());
+        assert(!bdsg::algorithms::parallel_is_single_stranded(&graph));
+        // and there is no orientation that fixes it
+        assert(bdsg::algorithms::parallel_single_stranded_orientation(&graph).empty());
+        assert(bdsg::algorithms::single_stranded_orientation(&graph).empty());
+        
+        // removing it turns it back on
+        graph.destroy_edge(handles[10], graph.flip(handles[4000]));
+        assert(graph.is_single_stranded());
+        
+        // a reversing self loop has no orientation that fixes it either
+        graph.create_edge(handles[20], graph.flip(handles[20]));
+        assert(!graph.is_single_stranded());
+        assert(bdsg::algorithms::parallel_single_stranded_orientation(&graph).empty());
+        graph.destroy_handle(handles[20]);
+        assert(graph.is_single_stranded());
+    }
+    
+    for (bool reversing : {false, true}) {
+        // a graph mapped read-only can still answer, without remembering it
+        char filename[] = "tmpXXXXXX";
+        int fd = mkstemp(filename);
+        assert(fd != -1);
+        {
+            MappedPackedGraph mapped;
+            handle_t h1 = mapped.create_handle("GATTACA");
+            handle_t h2 = mapped.create_handle("CAT");
+            mapped.create_edge(h1, reversing ? mapped.flip(h2) : h2);
+            mapped.serialize(fd);
+        }
+        assert(close(fd) == 0);
         
-        subgraph.add_node(h4);
+        fd = open(filename, O_RDONLY);
+        assert(fd != -1);
+        {
+            MappedPackedGraph mapped;
+            mapped.deserialize(fd);
+            assert(mapped.is_single_stranded() == !reversing);
+            assert(mapped.is_single_stranded() == !reversing);
+        }
+        assert(close(fd) == 0);
+        unlink(filename);
+    }
+    
+    omp_set_num_threads(backup_thread_count);
+    
+    cerr << "Single stranded tests successful!" << endl;
+}
 
-        assert(subgraph.get_node_count() == 2);
-        bool found2 = false;
-        subgraph.for_each_handle([&](const handle_t& h) {
-            if (subgraph.get_id(h) == graph.get_id(h1)) {
-                found1 = true;
-                assert(graph.get_sequence(h) == graph.get_sequence(h1));
+void test_path_name_index() {
+    
+    PackedGraph graph;
+    handle_t h = graph.create_handle("GATTACA");
+    
+    // a mix of haplotypes from a few samples, and generic paths, some of
+    // which look like sample names
+    vector<path_handle_t> paths;
+    for (const string& sample : {"HG002", "HG00", "HG0021", "NA12878"}) {
+        for (int64_t haplotype : {1, 2}) {
+            for (const string& locus : {"chr1", "chr2", "chr10"}) {
+                paths.push_back(graph.create_path(PathSense::HAPLOTYPE, sample, locus, haplotype, 0,
+                                                  PathMetadata::NO_SUBRANGE, false));
+                graph.append_step(paths.back(), h);
             }
-            else if (subgraph.get_id(h) == graph.get_id(h4)) {
-                found2 = true;
-                assert(graph.get_sequence(h) == graph.get_sequence(h4));
+        }
+    }
+    for (const string& name : {"HG002", "HG002x", "chr1", "~unusual", "chr1[5]"}) {
+        paths.push_back(graph.create_path_handle(name));
+    }
+    
+    auto check_lookups = [&](const PackedGraph& graph) {
+        for (const path_handle_t& path : paths) {
+            string name = graph.get_path_name(path);
+            assert(graph.has_path(name));
+            assert(graph.get_path_handle(name) == path);
+        }
+        for (const string& name : {"", "HG", "HG002#", "HG002#1#chr", "chr", "chr1[5", "zzz", "HG002y", "\x01"}) {
+            assert(!graph.has_path(name));
+            bool caught = false;
+            try {
+                graph.get_path_handle(name);
             }
-            else {
-                assert(false);
+            catch (const std::out_of_range& e) {
+                caught = true;
             }
-        });
-        assert(found1);
-        assert(found2);
-        found1 = false;
-        found2 = false;
-        
-        assert(subgraph.has_node(graph.get_id(h1)));
-        assert(!subgraph.has_node(graph.get_id(h2)));
-        assert(!subgraph.has_node(graph.get_id(h3)));
-        assert(subgraph.has_node(graph.get_id(h4)));
-        
-        subgraph.follow_edges(h1, true, [&](const handle_t& h) {
-            assert(false);
-        });
-        subgraph.follow_edges(h1, false, [&](const handle_t& h) {
-            assert(false);
-        });
-        subgraph.follow_edges(h4, true, [&](const handle_t& h) {
-            assert(false);
-        });
-        subgraph.follow_edges(h4, false, [&](const handle_t& h) {
-            assert(false);
-        });
-        
+            assert(caught);
+        }
         
-        assert(subgraph.get_degree(h1, true) == 0);
-        assert(subgraph.get_degree(h1, false) == 0);
-        assert(subgraph.get_degree(h4, true) == 0);
-        assert(subgraph.get_degree(h4, false) == 0);
+        for (const string& prefix : {"", "H", "HG00", "HG002", "HG002#", "HG002#2#", "chr1", "~", "q"}) {
+            unordered_set<path_handle_t> expected;
+            for (const path_handle_t& path : paths) {
+                if (graph.get_path_name(path).compare(0, prefix.size(), prefix) == 0) {
+                    expected.insert(path);
+                }
+            }
+            unordered_set<path_handle_t> found;
+            graph.for_each_path_with_prefix(prefix, [&](const path_handle_t& path) {
+                assert(!found.count(path));
+                found.insert(path);
+                return true;
+            });
+            assert(found == expected);
+        }
         
-        subgraph.add_node(graph.flip(h2));
+        for (const unordered_set<string>& samples : vector<unordered_set<string>>{{"HG002"}, {"HG00", "NA12878"}, {"HG2"}}) {
+            unordered_set<string> loci{"chr1", "chr10"};
+            for (const unordered_set<string>* loci_ptr : {(const unordered_set<string>*) nullptr, (const unordered_set<string>*) &loci}) {
+                unordered_set<path_handle_t> expected;
+                graph.for_each_path_handle([&](const path_handle_t& path) {
+                    if (samples.count(graph.get_sample_name(path)) &&
+                        (!loci_ptr || loci_ptr->count(graph.get_locus_name(path)))) {
+                        expected.insert(path);
+                    }
+                });
+                unordered_set<path_handle_t> found;
+                graph.for_each_path_matching(nullptr, &samples, loci_ptr, [&](const path_handle_t& path) {
+                    found.insert(path);
+                });
+                assert(found == expected);
+            }
+        }
         
-        assert(subgraph.get_node_count() == 3);
-        bool found3 = false;
-        subgraph.for_each_handle([&](const handle_t& h) {
-            if (subgraph.get_id(h) == graph.get_id(h1)) {
-                found1 = true;
-                assert(graph.get_sequence(h) == graph.get_sequence(h1));
+        // stopping early works
+        size_t seen = 0;
+        assert(!graph.for_each_path_with_prefix("HG", [&](const path_handle_t& path) {
+            ++seen;
+            return seen < 3;
+        }));
+        assert(seen == 3);
+    };
+    
+    // without the index
+    check_lookups(graph);
+    
+    graph.index_path_names();
+    check_lookups(graph);
+    
+    // changing the paths drops the index, but lookups stay right
+    graph.destroy_path(paths[4]);
+    paths.erase(paths.begin() + 4);
+    check_lookups(graph);
+    paths.push_back(graph.create_path_handle("HG002#3#chr1"));
+    check_lookups(graph);
+    graph.index_path_names();
+    check_lookups(graph);
+    
+    // optimizing renumbers the paths and indexes them again
+    graph.optimize();
+    paths.clear();
+    graph.for_each_path_handle([&](const path_handle_t& path) {
+        paths.push_back(path);
+    });
+    check_lookups(graph);
+    
+    // loading indexes the paths
+    stringstream strm;
+    graph.serialize(strm);
+    strm.seekg(0);
+    PackedGraph loaded;
+    loaded.deserialize(strm);
+    for (path_handle_t& path : paths) {
+        path = loaded.get_path_handle(graph.get_path_name(path));
+    }
+    check_lookups(loaded);
+    
+    // and lookups can happen from many threads at once
+    vector<string> names;
+    for (const path_handle_t& path : paths) {
+        names.push_back(loaded.get_path_name(path));
+    }
+    atomic<size_t> found_count(0);
+#pragma omp parallel for
+    for (size_t i = 0; i < names.size() * 100; ++i) {
+        const string& name = names[i % names.size()];
+        if (loaded.has_path(name) && loaded.get_path_handle(name) == paths[i % names.size()]) {
+            ++found_count;
+        }
+    }
+    assert(found_count == names.size() * 100);
+    
+    cerr << "Path name index tests successful!" << endl;
+}
+
+void test_path_metadata_index() {
+    
+    PackedGraph graph;
+    handle_t h1 = graph.create_handle("GATTACA");
+    handle_t h2 = graph.create_handle("CAT");
+    graph.create_edge(h1, h2);
+    
+    default_random_engine prng(7);
+    vector<string> samples{"GRCh38", "CHM13", "HG002", "HG00", "NA12878"};
+    vector<string> loci{"chr1", "chr2", "chr7", "chrX"};
+    size_t created = 0;
+    auto create_paths = [&](size_t count) {
+        for (size_t i = 0; i < count; ++i, ++created) {
+            path_handle_t path;
+            switch (prng() % 3) {
+            case 0:
+                path = graph.create_path(PathSense::REFERENCE, samples[prng() % 2], loci[prng() % loci.size()],
+                                         created, PathMetadata::NO_PHASE_BLOCK,
+                                         PathMetadata::NO_SUBRANGE, false);
+                break;
+            case 1:
+                path = graph.create_path(PathSense::HAPLOTYPE, samples[prng() % samples.size()], loci[prng() % loci.size()],
+                                         prng() % 2 + 1, created, PathMetadata::NO_SUBRANGE, false);
+                break;
+            default:
+                path = graph.create_path_handle("generic" + std::to_string(created) + (prng() % 2 ? "#chr1" : ""));
+                break;
             }
-            else if (subgraph.get_id(h) == graph.get_id(h2)) {
-                found2 = true;
-                assert(graph.get_sequence(h) == graph.get_sequence(h2));
+            graph.append_step(path, prng() % 2 ? h1 : h2);
+        }
+    };
+    
+    auto check_queries = [&](const PackedGraph& graph) {
+        for (size_t trial = 0; trial < 30; ++trial) {
+            unordered_set<PathSense> query_senses;
+            unordered_set<string> query_samples, query_loci;
+            for (PathSense sense : {PathSense::GENERIC, PathSense::REFERENCE, PathSense::HAPLOTYPE}) {
+                if (prng() % 2) {
+                    query_senses.insert(sense);
+                }
             }
-            else if (subgraph.get_id(h) == graph.get_id(h4)) {
-                found3 = true;
-                assert(graph.get_sequence(h) == graph.get_sequence(h4));
+            for (const string& sample : samples) {
+                if (prng() % 3 == 0) {
+                    query_samples.insert(sample);
+                }
             }
-            else {
-                assert(false);
+            if (prng() % 4 == 0) {
+                query_samples.insert(PathMetadata::NO_SAMPLE_NAME);
+            }
+            for (const string& locus : loci) {
+                if (prng() % 2) {
+                    query_loci.insert(locus);
+                }
+            }
+            if (prng() % 4 == 0) {
+                query_loci.insert("chrUn");
             }
+            auto* senses_ptr = prng() % 2 ? &query_senses : nullptr;
+            auto* samples_ptr = prng() % 2 ? &query_samples : nullptr;
+            auto* loci_ptr = prng() % 2 ? &query_loci : nullptr;
+            
+            unordered_set<path_handle_t> expected;
+            graph.for_each_path_handle([&](const path_handle_t& path) {
+                string name = graph.get_path_name(path);
+                if ((!senses_ptr || senses_ptr->count(PathMetadata::parse_sense(name))) &&
+                    (!samples_ptr || samples_ptr->count(PathMetadata::parse_sample_name(name))) &&
+                    (!loci_ptr || loci_ptr->count(PathMetadata::parse_locus_name(name)))) {
+                    expected.insert(path);
+                }
+            });
+            unordered_set<path_handle_t> found;
+            graph.for_each_path_matching(senses_ptr, samples_ptr, loci_ptr, [&](const path_handle_t& path) {
+                assert(!found.count(path));
+                found.insert(path);
+            });
+            assert(found == expected);
+        }
+        
+        graph.for_each_path_handle([&](const path_handle_t& path) {
+            string name = graph.get_path_name(path);
+            assert(graph.get_sense(path) == PathMetadata::parse_sense(name));
+            assert(graph.get_sample_name(path) == PathMetadata::parse_sample_name(name));
+            assert(graph.get_locus_name(path) == PathMetadata::parse_locus_name(name));
         });
-        assert(found1);
-        assert(found2);
-        assert(found3);
-        found1 = false;
-        found2 = false;
-        found3 = false;
         
-        assert(subgraph.has_node(graph.get_id(h1)));
-        assert(subgraph.has_node(graph.get_id(h2)));
-        assert(!subgraph.has_node(graph.get_id(h3)));
-        assert(subgraph.has_node(graph.get_id(h4)));
+        for (PathSense sense : {PathSense::GENERIC, PathSense::REFERENCE, PathSense::HAPLOTYPE}) {
+            for (handle_t h : {h1, h2}) {
+                size_t expected = 0, found = 0;
+                graph.for_each_step_on_handle(h, [&](const step_handle_t& step) {
+                    if (PathMetadata::parse_sense(graph.get_path_name(graph.get_path_handle_of_step(step))) == sense) {
+                        ++expected;
+                    }
+                });
+                graph.for_each_step_of_sense(h, sense, [&](const step_handle_t& step) {
+                    assert(graph.get_sense(graph.get_path_handle_of_step(step)) == sense);
+                    ++found;
+                    return true;
+                });
+                assert(found == expected);
+            }
+        }
         
-        bool found4 = false;
-        subgraph.follow_edges(h1, true, [&](const handle_t& h) {
-            assert(false);
-        });
-        subgraph.follow_edges(h1, false, [&](const handle_t& h) {
-            if (subgraph.get_id(h) == graph.get_id(h2) && !graph.get_is_reverse(h)) {
-                found1 = true;
+        // stopping early works
+        unordered_set<PathSense> haplotypes{PathSense::HAPLOTYPE};
+        size_t seen = 0;
+        assert(!graph.for_each_path_matching(&haplotypes, nullptr, nullptr, [&](const path_handle_t& path) {
+            ++seen;
+            return seen < 5;
+        }));
+        assert(seen == 5);
+    };
+    
+    create_paths(2000);
+    check_queries(graph);
+    
+    // destroying paths and creating a few more uses the same index
+    vector<path_handle_t> to_destroy;
+    graph.for_each_path_handle([&](const path_handle_t& path) {
+        if (prng() % 10 == 0) {
+            to_destroy.push_back(path);
+        }
+    });
+    for (const path_handle_t& path : to_destroy) {
+        graph.destroy_path(path);
+    }
+    create_paths(100);
+    check_queries(graph);
+    
+    // and creating many more rebuilds it
+    create_paths(5000);
+    check_queries(graph);
+    
+    // the index is saved and loaded along with the graph
+    create_paths(10);
+    stringstream strm;
+    graph.serialize(strm);
+    strm.seekg(0);
+    PackedGraph loaded;
+    loaded.deserialize(strm);
+    check_queries(loaded);
+    
+    // renumbering the paths rebuilds the index
+    graph.optimize();
+    check_queries(graph);
+    graph.index_path_metadata();
+    check_queries(graph);
+    
+    {
+        // queries don't write to the graph, so they work on a graph mapped
+        // read-only, with or without an index saved in it
+        for (size_t path_count : {10, 3000}) {
+            char filename[] = "tmpXXXXXX";
+            int fd = mkstemp(filename);
+            assert(fd != -1);
+            {
+                MappedPackedGraph mapped;
+                handle_t h = mapped.create_handle("GATTACA");
+                for (size_t i = 0; i < path_count; ++i) {
+                    path_handle_t path = mapped.create_path(i % 2 ? PathSense::HAPLOTYPE : PathSense::REFERENCE,
+                                                            samples[i % samples.size()], loci[i % loci.size()], i + 1,
+                                                            PathMetadata::NO_PHASE_BLOCK, PathMetadata::NO_SUBRANGE, false);
+                    mapped.append_step(path, h);
+                }
+                mapped.serialize(fd);
             }
-            else {
-                assert(false);
+            assert(close(fd) == 0);
+            
+            fd = open(filename, O_RDONLY);
+            assert(fd != -1);
+            MappedPackedGraph mapped;
+            mapped.deserialize(fd);
+            unordered_set<PathSense> haplotypes{PathSense::HAPLOTYPE};
+            unordered_set<string> first_sample{samples.front()};
+            size_t found = 0;
+            mapped.for_each_path_matching(&haplotypes, nullptr, nullptr, [&](const path_handle_t& path) {
+                assert(mapped.get_sense(path) == PathSense::HAPLOTYPE);
+                ++found;
+            });
+            assert(found == path_count / 2);
+            found = 0;
+            mapped.for_each_path_matching(nullptr, &first_sample, nullptr, [&](const path_handle_t& path) {
+                ++found;
+            });
+            assert(found == (path_count + samples.size() - 1) / samples.size());
+            found = 0;
+            mapped.for_each_step_of_sense(mapped.get_handle(1), PathSense::REFERENCE, [&](const step_handle_t& step) {
+                ++found;
+                return true;
+            });
+            assert(found == (path_count + 1) / 2);
+            assert(close(fd) == 0);
+            unlink(filename);
+        }
+    }
+    
+    graph.clear();
+    unordered_set<PathSense> references{PathSense::REFERENCE};
+    assert(graph.for_each_path_matching(&references, nullptr, nullptr, [&](const path_handle_t& path) {
+        return false;
+    }));
+    
+    cerr << "Path metadata index tests successful!" << endl;
+}
+
+void test_sort_path_memberships() {
+    
+    PackedGraph graph;
+    vector<handle_t> handles;
+    for (size_t i = 0; i < 50; ++i) {
+        handles.push_back(graph.create_handle("GATT"));
+    }
+    default_random_engine prng(3);
+    vector<path_handle_t> paths;
+    for (size_t i = 0; i < 40; ++i) {
+        paths.push_back(graph.create_path_handle("path" + std::to_string(i)));
+        for (size_t j = 0; j < 100; ++j) {
+            handle_t h = handles[prng() % handles.size()];
+            graph.append_step(paths.back(), prng() % 2 ? graph.flip(h) : h);
+        }
+    }
+    // leave some holes in the memberships
+    for (size_t i = 0; i < paths.size(); i += 7) {
+        graph.destroy_path(paths[i]);
+    }
+    
+    auto get_visits = [&](const handle_t& h) {
+        vector<pair<string, vector<handle_t>>> visits;
+        graph.for_each_step_on_handle(h, [&](const step_handle_t& step) {
+            path_handle_t path = graph.get_path_handle_of_step(step);
+            // identify the step by the path and the steps leading up to it
+            vector<handle_t> prefix;
+            for (step_handle_t here = graph.path_begin(path); here != step; here = graph.get_next_step(here)) {
+                prefix.push_back(graph.get_handle_of_step(here));
             }
+            visits.emplace_back(graph.get_path_name(path), std::move(prefix));
         });
-        subgraph.follow_edges(h2, true, [&](const handle_t& h) {
-            if (subgraph.get_id(h) == graph.get_id(h1) && !graph.get_is_reverse(h)) {
-                found2 = true;
-            }
-            else {
-                assert(false);
-            }
+        std::sort(visits.begin(), visits.end());
+        return visits;
+    };
+    
+    graph.optimize();
+    vector<vector<pair<string, vector<handle_t>>>> all_visits;
+    for (const handle_t& h : handles) {
+        all_visits.push_back(get_visits(graph.get_handle(graph.get_id(h))));
+    }
+    
+    graph.sort_path_memberships();
+    for (size_t i = 0; i < handles.size(); ++i) {
+        handle_t h = graph.get_handle(graph.get_id(handles[i]));
+        assert(get_visits(h) == all_visits[i]);
+        assert(graph.get_step_count(h) == all_visits[i].size());
+        
+        // the steps come out in path handle order, and in order along each path
+        vector<step_handle_t> steps;
+        graph.for_each_step_on_handle(h, [&](const step_handle_t& step) {
+            steps.push_back(step);
         });
-        subgraph.follow_edges(h2, false, [&](const handle_t& h) {
-            if (subgraph.get_id(h) == graph.get_id(h4) && !graph.get_is_reverse(h)) {
-                found3 = true;
+        for (size_t j = 1; j < steps.size(); ++j) {
+            path_handle_t prev_path = graph.get_path_handle_of_step(steps[j - 1]);
+            path_handle_t path = graph.get_path_handle_of_step(steps[j]);
+            assert(as_integer(prev_path) <= as_integer(path));
+            if (prev_path == path) {
+                // the earlier step comes first along the path
+                bool found = false;
+                for (step_handle_t here = steps[j - 1]; here != graph.path_end(path); here = graph.get_next_step(here)) {
+                    if (here == steps[j]) {
+                        found = true;
+                        break;
+                    }
+                }
+                assert(found);
             }
-            else {
-                assert(false);
+        }
+    }
+    
+    // and the graph still works afterward
+    graph.append_step(graph.get_path_handle("path1"), graph.get_handle(graph.get_id(handles[0])));
+    assert(graph.get_step_count(graph.get_handle(graph.get_id(handles[0]))) == all_visits[0].size() + 1);
+    
+    cerr << "Sorted path membership tests successful!" << endl;
+}
+
+void test_path_compression() {
+    
+    PackedGraph graph;
+    vector<handle_t> handles;
+    for (size_t i = 0; i < 2000; ++i) {
+        handles.push_back(graph.create_handle("GATTACA"));
+        if (i > 0) {
+            graph.create_edge(handles[i - 1], handles[i]);
+        }
+    }
+    
+    // haplotypes that mostly follow the graph, with a few jumps and flips
+    default_random_engine prng(5);
+    for (size_t i = 0; i < 20; ++i) {
+        path_handle_t path = graph.create_path_handle("hap" + std::to_string(i));
+        for (size_t j = 0; j < handles.size(); ++j) {
+            size_t k = prng() % 100 == 0 ? prng() % handles.size() : j;
+            graph.append_step(path, prng() % 200 == 0 ? graph.flip(handles[k]) : handles[k]);
+        }
+    }
+    path_handle_t backward = graph.create_path_handle("backward");
+    for (size_t j = handles.size(); j > 0; --j) {
+        graph.append_step(backward, graph.flip(handles[j - 1]));
+    }
+    path_handle_t circular = graph.create_path_handle("circular", true);
+    for (size_t j = 0; j < 77; ++j) {
+        graph.append_step(circular, handles[j]);
+    }
+    path_handle_t single = graph.create_path_handle("single");
+    graph.append_step(single, handles[5]);
+    graph.create_path_handle("empty");
+    // and one with holes
+    path_handle_t holes = graph.create_path_handle("holes");
+    for (size_t j = 0; j < 100; ++j) {
+        graph.append_step(holes, handles[j]);
+    }
+    step_handle_t hole_begin = graph.get_next_step(graph.path_begin(holes));
+    step_handle_t hole_end = hole_begin;
+    for (size_t j = 0; j < 10; ++j) {
+        hole_end = graph.get_next_step(hole_end);
+    }
+    graph.rewrite_segment(hole_begin, hole_end, {});
+    
+    // record the paths by name and the steps on each node
+    auto get_contents = [](const PackedGraph& graph) {
+        map<string, vector<pair<nid_t, bool>>> contents;
+        graph.for_each_path_handle([&](const path_handle_t& path) {
+            auto& steps = contents[graph.get_path_name(path)];
+            graph.for_each_step_in_path(path, [&](const step_handle_t& step) {
+                handle_t h = graph.get_handle_of_step(step);
+                steps.emplace_back(graph.get_id(h), graph.get_is_reverse(h));
+            });
+            assert(graph.get_step_count(path) == steps.size());
+            // walk backward too
+            if (!steps.empty()) {
+                size_t count = 1;
+                step_handle_t step = graph.path_back(path);
+                while (graph.has_previous_step(step) && (!graph.get_is_circular(path) || count < steps.size())) {
+                    step = graph.get_previous_step(step);
+                    ++count;
+                }
+                assert(count == steps.size());
+                assert(graph.get_is_circular(path) == graph.has_next_step(graph.path_back(path)));
             }
         });
-        subgraph.follow_edges(h4, true, [&](const handle_t& h) {
-            if (subgraph.get_id(h) == graph.get_id(h2) && !graph.get_is_reverse(h)) {
-                found4 = true;
-            }
-            else {
-                assert(false);
-            }
+        map<nid_t, multiset<string>> visits;
+        graph.for_each_handle([&](const handle_t& h) {
+            auto& here = visits[graph.get_id(h)];
+            graph.for_each_step_on_handle(h, [&](const step_handle_t& step) {
+                assert(graph.get_id(graph.get_handle_of_step(step)) == graph.get_id(h));
+                here.insert(graph.get_path_name(graph.get_path_handle_of_step(step)));
+            });
         });
-        subgraph.follow_edges(h4, false, [&](const handle_t& h) {
-            assert(false);
+        return make_pair(contents, visits);
+    };
+    
+    graph.optimize(false);
+    auto expected = get_contents(graph);
+    size_t uncompressed_bytes = graph.memory_breakdown().find("paths")->bytes;
+    
+    graph.set_path_compression(true);
+    graph.optimize(false);
+    assert(get_contents(graph) == expected);
+    MemoryBreakdown breakdown = graph.memory_breakdown();
+    const MemoryBreakdown* paths_bytes = breakdown.find("paths");
+    assert(paths_bytes->find("compressed steps")->bytes > 0);
+    assert(paths_bytes->bytes * 3 < uncompressed_bytes);
+    
+    // compressed paths can be saved and loaded
+    stringstream strm;
+    graph.serialize(strm);
+    strm.seekg(0);
+    PackedGraph loaded;
+    loaded.deserialize(strm);
+    assert(get_contents(loaded) == expected);
+    assert(loaded.memory_breakdown().find("paths")->find("compressed steps")->bytes ==
+           paths_bytes->find("compressed steps")->bytes);
+    
+    // and changing them decompresses them
+    loaded.append_step(loaded.get_path_handle("hap3"), loaded.get_handle(7));
+    loaded.set_circularity(loaded.get_path_handle("circular"), false);
+    loaded.destroy_path(loaded.get_path_handle("hap4"));
+    auto changed = get_contents(loaded);
+    expected.first["hap3"].emplace_back(7, false);
+    assert(changed.first["hap3"] == expected.first["hap3"]);
+    assert(!loaded.get_is_circular(loaded.get_path_handle("circular")));
+    assert(changed.first["circular"] == expected.first["circular"]);
+    assert(!loaded.has_path("hap4"));
+    assert(changed.first["hap5"] == expected.first["hap5"]);
+    
+    // including changes to the nodes the paths visit
+    loaded.apply_orientation(loaded.get_handle(100, true));
+    loaded.divide_handle(loaded.get_handle(200), vector<size_t>{3});
+    changed = get_contents(loaded);
+    for (const auto& visit : changed.first["backward"]) {
+        assert(visit.second == (visit.first != 100));
+    }
+    assert(changed.first["backward"].size() == handles.size() + 1);
+    
+    // reassigning IDs works on the compressed paths
+    auto before = get_contents(graph);
+    graph.optimize(true);
+    auto reassigned = get_contents(graph);
+    for (auto& path : before.first) {
+        assert(reassigned.first.at(path.first).size() == path.second.size());
+    }
+    
+    cerr << "Path compression tests successful!" << endl;
+}
+
+void test_gfa_import() {
+
+    // integer segment names are used as IDs, and links can come before the
+    // segments they join
+    {
+        stringstream gfa;
+        gfa << "H\tVN:Z:1.0\n"
+            << "L\t1\t+\t2\t-\t0M\n"
+            << "S\t1\tGATT\n"
+            << "S\t2\tACNA\n"
+            << "S\t5\tCAT\n"
+            << "L\t2\t-\t5\t+\t*\n"
+            << "L\t5\t+\t5\t-\t0M\n"
+            << "P\tref\t1+,2-,5+\t*\n"
+            << "W\tsample\t1\tchr1\t0\t11\t>1<2>5\n"
+            << "W\tsample\t2\tchr1\t4\t*\t<2>5\n";
+
+        PackedGraph graph;
+        graph.load_gfa(gfa);
+
+        assert(graph.get_node_count() == 3);
+        assert(graph.get_edge_count() == 3);
+        assert(graph.get_sequence(graph.get_handle(2)) == "ACNA");
+        assert(graph.get_sequence(graph.get_handle(5, true)) == "ATG");
+        assert(graph.has_edge(graph.get_handle(1), graph.get_handle(2, true)));
+        assert(graph.has_edge(graph.get_handle(2, true), graph.get_handle(5)));
+        assert(graph.has_edge(graph.get_handle(5), graph.get_handle(5, true)));
+        assert(!graph.has_node(3));
+
+        vector<handle_t> expected {graph.get_handle(1), graph.get_handle(2, true), graph.get_handle(5)};
+        auto get_steps = [&](const path_handle_t& path) {
+            vector<handle_t> steps;
+            graph.for_each_step_in_path(path, [&](const step_handle_t& step) {
+                steps.push_back(graph.get_handle_of_step(step));
+            });
+            return steps;
+        };
+        assert(graph.get_path_count() == 3);
+        assert(get_steps(graph.get_path_handle("ref")) == expected);
+
+        size_t walks = 0;
+        unordered_set<PathSense> haplotype_sense {PathSense::HAPLOTYPE};
+        graph.for_each_path_matching(&haplotype_sense, nullptr, nullptr, [&](const path_handle_t& path) {
+            assert(graph.get_sample_name(path) == "sample");
+            assert(graph.get_locus_name(path) == "chr1");
+            if (graph.get_haplotype(path) == 1) {
+                assert(graph.get_subrange(path) == PathMetadata::NO_SUBRANGE);
+                assert(get_steps(path) == expected);
+            }
+            else {
+                assert(graph.get_haplotype(path) == 2);
+                assert(graph.get_subrange(path).first == 4);
+                assert(get_steps(path) == vector<handle_t>(expected.begin() + 1, expected.end()));
+            }
+            ++walks;
+        });
+        assert(walks == 2);
+
+        // loading again replaces the graph
+        stringstream other;
+        other << "S\t7\tA\n";
+        graph.load_gfa(other);
+        assert(graph.get_node_count() == 1);
+        assert(graph.get_path_count() == 0);
+        assert(graph.get_sequence(graph.get_handle(7)) == "A");
+    }
+
+    // other segment names are numbered in the order of the segments
+    {
+        stringstream gfa;
+        gfa << "S\tchr1_a\tGG\r\n"
+            << "S\t10\tCC\n"
+            << "S\tx\tTT\n"
+            << "L\tx\t-\tchr1_a\t+\t0M\n"
+            << "P\tsample#0#chr1\tchr1_a+,10+,x-\n";
+
+        PackedGraph graph;
+        graph.load_gfa(gfa);
+        assert(graph.get_node_count() == 3);
+        assert(graph.get_sequence(graph.get_handle(1)) == "GG");
+        assert(graph.get_sequence(graph.get_handle(2)) == "CC");
+        assert(graph.get_sequence(graph.get_handle(3)) == "TT");
+        assert(graph.has_edge(graph.get_handle(3, true), graph.get_handle(1)));
+        path_handle_t path = graph.get_path_handle("sample#0#chr1");
+        assert(graph.get_step_count(path) == 3);
+        assert(graph.get_handle_of_step(graph.path_back(path)) == graph.get_handle(3, true));
+    }
+
+    // a bigger graph comes back the same, across several batches of paths
+    {
+        PackedGraph built;
+        default_random_engine prng(41);
+        vector<handle_t> handles;
+        for (size_t i = 0; i < 3000; ++i) {
+            string seq;
+            for (size_t j = 0; j < 1 + prng() % 8; ++j) {
+                seq.push_back("ACGTN"[prng() % 5]);
+            }
+            handles.push_back(built.create_handle(seq, 2 * i + 1));
+        }
+        for (size_t i = 0; i < 6000; ++i) {
+            built.create_edge(prng() % 2 ? handles[prng() % handles.size()] : built.flip(handles[prng() % handles.size()]),
+                              prng() % 2 ? handles[prng() % handles.size()] : built.flip(handles[prng() % handles.size()]));
+        }
+        for (size_t i = 0; i < 50; ++i) {
+            path_handle_t path = built.create_path_handle("path" + std::to_string(i));
+            for (size_t j = 0; j < 200; ++j) {
+                built.append_step(path, prng() % 2 ? handles[prng() % handles.size()] : built.flip(handles[prng() % handles.size()]));
+            }
+        }
+
+        stringstream gfa;
+        built.for_each_handle([&](const handle_t& handle) {
+            gfa << "S\t" << built.get_id(handle) << "\t" << built.get_sequence(handle) << "\n";
+        });
+        built.for_each_edge([&](const edge_t& edge) {
+            gfa << "L\t" << built.get_id(edge.first) << "\t" << (built.get_is_reverse(edge.first) ? "-" : "+")
+                << "\t" << built.get_id(edge.second) << "\t" << (built.get_is_reverse(edge.second) ? "-" : "+") << "\t0M\n";
+        });
+        built.for_each_path_handle([&](const path_handle_t& path) {
+            gfa << "P\t" << built.get_path_name(path) << "\t";
+            bool first = true;
+            built.for_each_step_in_path(path, [&](const step_handle_t& step) {
+                handle_t handle = built.get_handle_of_step(step);
+                gfa << (first ? "" : ",") << built.get_id(handle) << (built.get_is_reverse(handle) ? "-" : "+");
+                first = false;
+            });
+            gfa << "\t*\n";
+        });
+        string text = gfa.str();
+
+        int backup_thread_count = omp_get_max_threads();
+        for (int threads : {1, 4}) {
+            omp_set_num_threads(threads);
+            stringstream in(text);
+            PackedGraph loaded;
+            loaded.load_gfa(in);
+            assert(handlegraph::algorithms::are_equivalent(&built, &loaded));
+            assert(loaded.get_path_count() == built.get_path_count());
+            built.for_each_path_handle([&](const path_handle_t& path) {
+                path_handle_t other = loaded.get_path_handle(built.get_path_name(path));
+                step_handle_t step = built.path_begin(path);
+                loaded.for_each_step_in_path(other, [&](const step_handle_t& other_step) {
+                    assert(loaded.get_handle_of_step(other_step) == built.get_handle_of_step(step));
+                    step = built.get_next_step(step);
+                });
+                assert(step == built.path_end(path));
+            });
+        }
+        omp_set_num_threads(backup_thread_count);
+    }
+
+    // unsupported or broken GFA is rejected
+    {
+        vector<string> bad {
+            "S\t1\tA\nS\t2\tC\nL\t1\t+\t2\t+\t5M\n",
+            "S\t1\tA\nL\t1\t+\t2\t+\t0M\n",
+            "S\t1\tA\nP\tp\t1+,3-\t*\n",
+            "S\t1\tA\nP\tp\t1+,1+\t0M,2M\n",
+            "S\t1\tA\nW\ts\t1\tc\t0\t*\t>1>2\n",
+            "S\t1\t*\tLN:i:4\n",
+            "S\t1\tA\nS\t1\tC\n",
+            "S\ta\tA\nS\ta\tC\n",
+            "S\t1\tA\nP\tp\t1+\nP\tp\t1-\n",
+            "S\t1\n"
+        };
+        for (const string& text : bad) {
+            stringstream in(text);
+            PackedGraph graph;
+            bool caught = false;
+            try {
+                graph.load_gfa(in);
+            } catch (std::runtime_error& e) {
+                caught = true;
+            }
+            assert(caught);
+        }
+    }
+
+    cerr << "GFA import tests successful!" << endl;
+}
+
+void test_eades_algorithm() {
+    
+    // check that a layout has every node once, and count its feedback arcs
+    auto count_feedback_arcs = [](const HandleGraph& graph, const vector<handle_t>& layout) {
+        assert(layout.size() == graph.get_node_count());
+        unordered_map<handle_t, size_t> position;
+        for (size_t i = 0; i < layout.size(); ++i) {
+            assert(!graph.get_is_reverse(layout[i]));
+            assert(!position.count(layout[i]));
+            position[layout[i]] = i;
+        }
+        size_t feedback_arcs = 0;
+        graph.for_each_edge([&](const edge_t& edge) {
+            // all the nodes are forward, so the edges must be too on one strand
+            edge_t forward = graph.get_is_reverse(edge.first) ? make_pair(graph.flip(edge.second), graph.flip(edge.first)) : edge;
+            if (position.at(forward.first) >= position.at(forward.second)) {
+                ++feedback_arcs;
+            }
+        });
+        return feedback_arcs;
+    };
+    
+    auto check_layouts = [&](const HandleGraph& graph, bool acyclic) {
+        vector<handle_t> streamed;
+        bdsg::algorithms::parallel_eades_algorithm(&graph, [&](const handle_t& handle) {
+            streamed.push_back(handle);
+        });
+        assert(streamed == bdsg::algorithms::parallel_eades_algorithm(&graph));
+        
+        size_t feedback_arcs = count_feedback_arcs(graph, streamed);
+        size_t serial_feedback_arcs = count_feedback_arcs(graph, bdsg::algorithms::eades_algorithm(&graph));
+        if (acyclic) {
+            assert(feedback_arcs == 0);
+            assert(serial_feedback_arcs == 0);
+        }
+        else {
+            // the greedy algorithm never needs more than half the edges
+            assert(feedback_arcs * 2 <= graph.get_edge_count());
+        }
+    };
+    
+    int backup_thread_count = omp_get_max_threads();
+    omp_set_num_threads(4);
+    default_random_engine prng(7);
+    
+    {
+        // lots of small layered components, with sparse IDs
+        HashGraph graph;
+        for (size_t component = 0; component < 50; ++component) {
+            vector<vector<handle_t>> layers(20);
+            for (size_t layer = 0; layer < layers.size(); ++layer) {
+                for (size_t i = 0; i < 100; ++i) {
+                    layers[layer].push_back(graph.create_handle("A", (component * 2000 + layer * 100 + i + 1) * 10));
+                    if (layer > 0) {
+                        for (size_t j = 0; j < 2; ++j) {
+                            graph.create_edge(layers[layer - 1][prng() % 100], layers[layer].back());
+                        }
+                    }
+                }
+            }
+        }
+        check_layouts(graph, true);
+        
+        // and through the rank interface
+        bdsg::VectorizableOverlay ranked(&graph);
+        check_layouts(ranked, true);
+    }
+    
+    {
+        // one big component with wide frontiers
+        HashGraph graph;
+        vector<vector<handle_t>> layers(35);
+        for (size_t layer = 0; layer < layers.size(); ++layer) {
+            for (size_t i = 0; i < 2000; ++i) {
+                layers[layer].push_back(graph.create_handle("A"));
+                if (layer > 0) {
+                    for (size_t j = 0; j < 2; ++j) {
+                        graph.create_edge(layers[layer - 1][prng() % 2000], layers[layer].back());
+                    }
+                }
+            }
+        }
+        check_layouts(graph, true);
+        
+        // add some cycles
+        for (size_t i = 0; i < 500; ++i) {
+            size_t from_layer = 1 + prng() % (layers.size() - 1);
+            size_t to_layer = prng() % from_layer;
+            graph.create_edge(layers[from_layer][prng() % 2000], layers[to_layer][prng() % 2000]);
+        }
+        graph.create_edge(layers[10][0], layers[10][0]);
+        check_layouts(graph, false);
+    }
+    
+    omp_set_num_threads(backup_thread_count);
+    
+    cerr << "Eades algorithm tests successful!" << endl;
+}
+
+void test_packed_subgraph_overlay() {
+    
+    vector<MutablePathDeletableHandleGraph*> implementations;
+
+    HashGraph hg;
+    implementations.push_back(&hg);
+
+    PackedGraph pg;
+    implementations.push_back(&pg);
+    
+    MappedPackedGraph mpg;
+    implementations.push_back(&mpg);
+    
+    for (MutablePathDeletableHandleGraph* implementation : implementations) {
+
+        MutablePathDeletableHandleGraph& graph = *implementation;
+        
+        handle_t h1 = graph.create_handle("AAA");
+        handle_t h2 = graph.create_handle("A");
+        handle_t h3 = graph.create_handle("T");
+        handle_t h4 = graph.create_handle("AAAAA");
+        
+        graph.create_edge(h1, h2);
+        graph.create_edge(h1, h3);
+        graph.create_edge(h2, h4);
+        graph.create_edge(h3, h4);
+        
+        PackedSubgraphOverlay subgraph(&graph);
+        assert(subgraph.get_node_count() == 0);
+        subgraph.for_each_handle([&](const handle_t& h) {
+            assert(false);
+        });
+        assert(!subgraph.has_node(graph.get_id(h1)));
+        assert(!subgraph.has_node(graph.get_id(h2)));
+        assert(!subgraph.has_node(graph.get_id(h3)));
+        assert(!subgraph.has_node(graph.get_id(h4)));
+        
+        subgraph.add_node(h1);
+        
+        assert(subgraph.get_node_count() == 1);
+        bool found1 = false;
+        subgraph.for_each_handle([&](const handle_t& h) {
+            if (subgraph.get_id(h) == graph.get_id(h1)) {
+                found1 = true;
+                assert(graph.get_sequence(h) == graph.get_sequence(h1));
+            }
+            else {
+                assert(false);
+            }
+        });
+        assert(found1);
+        found1 = false;
+        
+        assert(subgraph.has_node(graph.get_id(h1)));
+        assert(!subgraph.has_node(graph.get_id(h2)));
+        assert(!subgraph.has_node(graph.get_id(h3)));
+        assert(!subgraph.has_node(graph.get_id(h4)));
+        
+        subgraph.follow_edges(h1, true, [&](const handle_t& h) {
+            assert(false);
+        });
+        subgraph.follow_edges(h1, false, [&](const handle_t& h) {
+            assert(false);
         });
         
         assert(subgraph.get_degree(h1, true) == 0);
-        assert(subgraph.get_degree(h1, false) == 1);
-        assert(subgraph.get_degree(h2, true) == 1);
-        assert(subgraph.get_degree(h2, false) == 1);
-        assert(subgraph.get_degree(h4, true) == 1);
-        assert(subgraph.get_degree(h4, false) == 0);
+        assert(subgraph.get_degree(h1, false) == 0);
         
+        subgraph.add_node(h4);
+
+        assert(subgraph.get_node_count() == 2);
+        bool found2 = false;
+        subgraph.for_each_handle([&](const handle_t& h) {
+            if (subgraph.get_id(h) == graph.get_id(h1)) {
+                found1 = true;
+                assert(graph.get_sequence(h) == graph.get_sequence(h1));
+            }
+            else if (subgraph.get_id(h) == graph.get_id(h4)) {
+                found2 = true;
+                assert(graph.get_sequence(h) == graph.get_sequence(h4));
+            }
+            else {
+                assert(false);
+            }
+        });
         assert(found1);
         assert(found2);
-        assert(found3);
-        assert(found4);
         found1 = false;
         found2 = false;
-        found3 = false;
-        found4 = false;
         
-        subgraph.remove_node(h1);
+        assert(subgraph.has_node(graph.get_id(h1)));
+        assert(!subgraph.has_node(graph.get_id(h2)));
+        assert(!subgraph.has_node(graph.get_id(h3)));
+        assert(subgraph.has_node(graph.get_id(h4)));
         
-        assert(subgraph.get_node_count() == 2);
+        subgraph.follow_edges(h1, true, [&](const handle_t& h) {
+            assert(false);
+        });
+        subgraph.follow_edges(h1, false, [&](const handle_t& h) {
+            assert(false);
+        });
+        subgraph.follow_edges(h4, true, [&](const handle_t& h) {
+            assert(false);
+        });
+        subgraph.follow_edges(h4, false, [&](const handle_t& h) {
+            assert(false);
+        });
+        
+        
+        assert(subgraph.get_degree(h1, true) == 0);
+        assert(subgraph.get_degree(h1, false) == 0);
+        assert(subgraph.get_degree(h4, true) == 0);
+        assert(subgraph.get_degree(h4, false) == 0);
+        
+        subgraph.add_node(graph.flip(h2));
+        
+        assert(subgraph.get_node_count() == 3);
+        bool found3 = false;
         subgraph.for_each_handle([&](const handle_t& h) {
-            if (subgraph.get_id(h) == graph.get_id(h2)) {
+            if (subgraph.get_id(h) == graph.get_id(h1)) {
                 found1 = true;
+                assert(graph.get_sequence(h) == graph.get_sequence(h1));
+            }
+            else if (subgraph.get_id(h) == graph.get_id(h2)) {
+                found2 = true;
                 assert(graph.get_sequence(h) == graph.get_sequence(h2));
             }
             else if (subgraph.get_id(h) == graph.get_id(h4)) {
-                found2 = true;
+                found3 = true;
                 assert(graph.get_sequence(h) == graph.get_sequence(h4));
             }
             else {
@@ -4205,20 +7100,39 @@ void test_packed_subgraph_overlay() {
         });
         assert(found1);
         assert(found2);
+        assert(found3);
         found1 = false;
         found2 = false;
+        found3 = false;
         
-        assert(!subgraph.has_node(graph.get_id(h1)));
+        assert(subgraph.has_node(graph.get_id(h1)));
         assert(subgraph.has_node(graph.get_id(h2)));
         assert(!subgraph.has_node(graph.get_id(h3)));
         assert(subgraph.has_node(graph.get_id(h4)));
         
-        subgraph.follow_edges(h2, true, [&](const handle_t& h) {
+        bool found4 = false;
+        subgraph.follow_edges(h1, true, [&](const handle_t& h) {
             assert(false);
         });
+        subgraph.follow_edges(h1, false, [&](const handle_t& h) {
+            if (subgraph.get_id(h) == graph.get_id(h2) && !graph.get_is_reverse(h)) {
+                found1 = true;
+            }
+            else {
+                assert(false);
+            }
+        });
+        subgraph.follow_edges(h2, true, [&](const handle_t& h) {
+            if (subgraph.get_id(h) == graph.get_id(h1) && !graph.get_is_reverse(h)) {
+                found2 = true;
+            }
+            else {
+                assert(false);
+            }
+        });
         subgraph.follow_edges(h2, false, [&](const handle_t& h) {
             if (subgraph.get_id(h) == graph.get_id(h4) && !graph.get_is_reverse(h)) {
-                found1 = true;
+                found3 = true;
             }
             else {
                 assert(false);
@@ -4226,7 +7140,7 @@ void test_packed_subgraph_overlay() {
         });
         subgraph.follow_edges(h4, true, [&](const handle_t& h) {
             if (subgraph.get_id(h) == graph.get_id(h2) && !graph.get_is_reverse(h)) {
-                found2 = true;
+                found4 = true;
             }
             else {
                 assert(false);
@@ -4236,20 +7150,212 @@ void test_packed_subgraph_overlay() {
             assert(false);
         });
         
-        assert(subgraph.get_degree(h2, true) == 0);
+        assert(subgraph.get_degree(h1, true) == 0);
+        assert(subgraph.get_degree(h1, false) == 1);
+        assert(subgraph.get_degree(h2, true) == 1);
         assert(subgraph.get_degree(h2, false) == 1);
         assert(subgraph.get_degree(h4, true) == 1);
         assert(subgraph.get_degree(h4, false) == 0);
         
         assert(found1);
         assert(found2);
+        assert(found3);
+        assert(found4);
         found1 = false;
         found2 = false;
-    }
-    
+        found3 = false;
+        found4 = false;
+        
+        subgraph.remove_node(h1);
+        
+        assert(subgraph.get_node_count() == 2);
+        subgraph.for_each_handle([&](const handle_t& h) {
+            if (subgraph.get_id(h) == graph.get_id(h2)) {
+                found1 = true;
+                assert(graph.get_sequence(h) == graph.get_sequence(h2));
+            }
+            else if (subgraph.get_id(h) == graph.get_id(h4)) {
+                found2 = true;
+                assert(graph.get_sequence(h) == graph.get_sequence(h4));
+            }
+            else {
+                assert(false);
+            }
+        });
+        assert(found1);
+        assert(found2);
+        found1 = false;
+        found2 = false;
+        
+        assert(!subgraph.has_node(graph.get_id(h1)));
+        assert(subgraph.has_node(graph.get_id(h2)));
+        assert(!subgraph.has_node(graph.get_id(h3)));
+        assert(subgraph.has_node(graph.get_id(h4)));
+        
+        subgraph.follow_edges(h2, true, [&](const handle_t& h) {
+            assert(false);
+        });
+        subgraph.follow_edges(h2, false, [&](const handle_t& h) {
+            if (subgraph.get_id(h) == graph.get_id(h4) && !graph.get_is_reverse(h)) {
+                found1 = true;
+            }
+            else {
+                assert(false);
+            }
+        });
+        subgraph.follow_edges(h4, true, [&](const handle_t& h) {
+            if (subgraph.get_id(h) == graph.get_id(h2) && !graph.get_is_reverse(h)) {
+                found2 = true;
+            }
+            else {
+                assert(false);
+            }
+        });
+        subgraph.follow_edges(h4, false, [&](const handle_t& h) {
+            assert(false);
+        });
+        
+        assert(subgraph.get_degree(h2, true) == 0);
+        assert(subgraph.get_degree(h2, false) == 1);
+        assert(subgraph.get_degree(h4, true) == 1);
+        assert(subgraph.get_degree(h4, false) == 0);
+        
+        assert(found1);
+        assert(found2);
+        found1 = false;
+        found2 = false;
+        
+        {
+            ContiguousSubgraphOverlay empty(&graph, vector<handle_t>());
+            assert(empty.get_node_count() == 0);
+            empty.for_each_handle([&](const handle_t& h) {
+                assert(false);
+            });
+            assert(!empty.has_node(graph.get_id(h1)));
+        }
+        
+        {
+            // duplicates and either orientation are fine
+            ContiguousSubgraphOverlay contiguous(&graph, {h4, graph.flip(h2), h2, h1});
+            assert(contiguous.get_node_count() == 3);
+            assert(contiguous.has_node(graph.get_id(h1)));
+            assert(contiguous.has_node(graph.get_id(h2)));
+            assert(!contiguous.has_node(graph.get_id(h3)));
+            assert(contiguous.has_node(graph.get_id(h4)));
+            assert(!contiguous.has_node(contiguous.max_node_id() + 1));
+            assert(!contiguous.has_node(contiguous.min_node_id() - 1));
+            
+            // iteration is in the order of the backing handles
+            vector<handle_t> seen;
+            contiguous.for_each_handle([&](const handle_t& h) {
+                assert(!graph.get_is_reverse(h));
+                seen.push_back(h);
+            });
+            assert(seen.size() == 3);
+            for (size_t i = 1; i < seen.size(); i++) {
+                assert(handlegraph::as_integer(seen[i - 1]) < handlegraph::as_integer(seen[i]));
+            }
+            std::atomic<size_t> parallel_seen(0);
+            contiguous.for_each_handle([&](const handle_t& h) {
+                ++parallel_seen;
+            }, true);
+            assert(parallel_seen == 3);
+            
+            assert(contiguous.get_degree(h1, false) == 1);
+            assert(contiguous.get_degree(h1, true) == 0);
+            assert(contiguous.get_degree(h2, true) == 1);
+            assert(contiguous.get_degree(h2, false) == 1);
+            assert(contiguous.get_degree(h4, true) == 1);
+            assert(contiguous.get_degree(h4, false) == 0);
+            contiguous.follow_edges(h1, false, [&](const handle_t& h) {
+                assert(h == h2);
+            });
+            contiguous.follow_edges(h4, true, [&](const handle_t& h) {
+                assert(h == h2);
+            });
+        }
+    }
+    
     cerr << "PackedSubgraphOverlay tests successful!" << endl;
 }
 
+void test_path_subgraph_overlay() {
+    
+    HashGraph graph;
+    vector<handle_t> handles;
+    for (size_t i = 0; i < 6; ++i) {
+        handles.push_back(graph.create_handle("ACGT"));
+        if (i > 0) {
+            graph.create_edge(handles[i - 1], handles[i]);
+        }
+    }
+    
+    // two paths inside the subgraph, one of which visits a node twice, and
+    // one that leaves it
+    path_handle_t inside = graph.create_path_handle("inside");
+    for (size_t i : {0, 1, 2, 1}) {
+        graph.append_step(inside, handles[i]);
+    }
+    path_handle_t reverse = graph.create_path_handle("reverse");
+    for (size_t i : {2, 1}) {
+        graph.append_step(reverse, graph.flip(handles[i]));
+    }
+    path_handle_t outside = graph.create_path_handle("outside");
+    for (size_t i : {1, 2, 3, 4}) {
+        graph.append_step(outside, handles[i]);
+    }
+    
+    unordered_set<nid_t> node_subset;
+    for (size_t i : {0, 1, 2, 5}) {
+        node_subset.insert(graph.get_id(handles[i]));
+    }
+    
+    for (bool index_steps : {false, true}) {
+        PathSubgraphOverlay subgraph(&graph, &node_subset, index_steps);
+        
+        assert(subgraph.get_path_count() == 2);
+        assert(subgraph.has_path("inside"));
+        assert(subgraph.has_path("reverse"));
+        assert(!subgraph.has_path("outside"));
+        assert(subgraph.get_step_count(subgraph.get_path_handle("inside")) == 4);
+        
+        // only the steps of the contained paths are on the nodes
+        for (size_t i = 0; i < handles.size(); ++i) {
+            if (!subgraph.has_node(graph.get_id(handles[i]))) {
+                continue;
+            }
+            vector<step_handle_t> expected;
+            graph.for_each_step_on_handle(handles[i], [&](const step_handle_t& step) {
+                if (graph.get_path_handle_of_step(step) != outside) {
+                    expected.push_back(step);
+                }
+            });
+            vector<step_handle_t> found;
+            subgraph.for_each_step_on_handle(subgraph.get_handle(graph.get_id(handles[i])), [&](const step_handle_t& step) {
+                assert(subgraph.get_id(subgraph.get_handle_of_step(step)) == graph.get_id(handles[i]));
+                found.push_back(step);
+            });
+            std::sort(expected.begin(), expected.end());
+            std::sort(found.begin(), found.end());
+            assert(found == expected);
+        }
+        
+        // stopping early works
+        size_t visited = 0;
+        bool finished = subgraph.for_each_step_on_handle(subgraph.get_handle(graph.get_id(handles[1])), [&](const step_handle_t& step) {
+            visited++;
+            return false;
+        });
+        assert(!finished);
+        assert(visited == 1);
+        const PathHandleGraph& path_graph = subgraph;
+        assert(path_graph.get_step_count(subgraph.get_handle(graph.get_id(handles[1]))) == 3);
+        assert(path_graph.get_step_count(subgraph.get_handle(graph.get_id(handles[5]))) == 0);
+    }
+    
+    cerr << "PathSubgraphOverlay tests successful!" << endl;
+}
+
 void test_mapped_packed_graph() {
     auto check_graph = [](const MappedPackedGraph& mpg) {
         // Dump it into this map
@@ -4262,98 +7368,1813 @@ void test_mapped_packed_graph() {
         assert(graph_contents.at(1) == "GATTACA");
         assert(graph_contents.at(2) == "CATTAG");
     };
-
-    char filename[] = "tmpXXXXXX";
-    int fd = mkstemp(filename);
-    assert(fd != -1);
+
+    char filename[] = "tmpXXXXXX";
+    int fd = mkstemp(filename);
+    assert(fd != -1);
+    {
+        // Make a graph
+        MappedPackedGraph mpg;
+        // Give it a node
+        mpg.create_handle("GATTACA", 1);
+        // Save it to an FD
+        mpg.serialize(fd);
+        // Make sure write-back works
+        mpg.create_handle("CATTAG", 2);
+        
+        // Make sure it looks right now
+        check_graph(mpg);
+    }
+    {
+        // Make a graph again
+        MappedPackedGraph mpg;
+        // Load it from the fd
+        mpg.deserialize(fd);
+        // Make sure it looks right
+        check_graph(mpg);
+    }
+    assert(close(fd) == 0);
+    {
+        // Make a graph again
+        MappedPackedGraph mpg;
+        // Load it from the file
+        mpg.deserialize(filename);
+        // Make sure it looks right
+        check_graph(mpg);
+    }
+    {
+        // Make a graph again
+        MappedPackedGraph mpg;
+        // Load it from a stream
+        std::ifstream stream(filename);
+        mpg.deserialize(stream);
+        // Make sure it looks right
+        check_graph(mpg);
+    }
+    {
+        // Make a writable snapshot of the graph in the file
+        unique_ptr<MappedPackedGraph> mpg(new MappedPackedGraph());
+        mpg->deserialize(filename);
+        MappedPackedGraph snapshot;
+        snapshot.snapshot(*mpg);
+        check_graph(snapshot);
+
+        // Change it enough to grow past the file
+        snapshot.create_edge(snapshot.get_handle(1), snapshot.get_handle(2));
+        for (nid_t i = 3; i < 2000; i++) {
+            snapshot.create_handle("GATTACA", i);
+            snapshot.create_edge(snapshot.get_handle(i - 1), snapshot.get_handle(i));
+        }
+        assert(snapshot.get_node_count() == 1999);
+
+        // The original doesn't change
+        assert(mpg->get_node_count() == 2);
+        assert(!mpg->has_edge(mpg->get_handle(1), mpg->get_handle(2)));
+
+        // And the snapshot outlives it
+        mpg.reset();
+        check_graph(snapshot);
+        snapshot.apply_orientation(snapshot.get_handle(1, true));
+        assert(snapshot.has_edge(snapshot.get_handle(1, true), snapshot.get_handle(2)));
+        assert(snapshot.get_edge_count() == 1998);
+
+        // Snapshots of memory not backed by a file are copies
+        MappedPackedGraph copy;
+        copy.snapshot(snapshot);
+        snapshot.destroy_handle(snapshot.get_handle(1000));
+        assert(copy.get_node_count() == 1999);
+        assert(copy.has_node(1000));
+    }
+    {
+        // The file still has the graph from before the snapshot
+        MappedPackedGraph mpg;
+        mpg.deserialize(filename);
+        check_graph(mpg);
+        assert(mpg.get_node_count() == 2);
+        assert(mpg.get_edge_count() == 0);
+    }
+    {
+        // Checkpoint edits to the graph in the file
+        MappedPackedGraph mpg;
+        mpg.deserialize(filename);
+        mpg.create_edge(mpg.get_handle(1), mpg.get_handle(2));
+        assert(mpg.checkpoint(false) == 1);
+        for (nid_t i = 3; i < 1000; i++) {
+            mpg.create_handle("GATTACA", i);
+        }
+        assert(mpg.checkpoint() == 2);
+        
+        // The file has the checkpointed graph
+        MappedPackedGraph reloaded;
+        std::ifstream stream(filename);
+        reloaded.deserialize(stream);
+        check_graph(reloaded);
+        assert(reloaded.get_node_count() == 999);
+        assert(reloaded.has_edge(reloaded.get_handle(1), reloaded.get_handle(2)));
+        
+        // Graphs not in files have nothing to checkpoint
+        assert(reloaded.checkpoint() == 0);
+        
+        // Put the graph back how it was
+        for (nid_t i = 3; i < 1000; i++) {
+            mpg.destroy_handle(mpg.get_handle(i));
+        }
+        mpg.destroy_edge(mpg.get_handle(1), mpg.get_handle(2));
+        mpg.checkpoint(false);
+    }
+    {
+        // Fragment the graph in the file and then compact it
+        MappedPackedGraph mpg;
+        mpg.deserialize(filename);
+        for (nid_t i = 3; i < 5000; i++) {
+            mpg.create_handle("GATTACA", i);
+            mpg.create_edge(mpg.get_handle(i - 1), mpg.get_handle(i));
+        }
+        for (nid_t i = 3; i < 5000; i++) {
+            mpg.destroy_handle(mpg.get_handle(i));
+        }
+        mpg.create_edge(mpg.get_handle(1), mpg.get_handle(2));
+        
+        struct stat before;
+        assert(stat(filename, &before) == 0);
+        mpg.compact();
+        struct stat after;
+        assert(stat(filename, &after) == 0);
+        assert(after.st_size < before.st_size);
+        
+        // It still works, and keeps writing back to the file
+        check_graph(mpg);
+        assert(mpg.get_node_count() == 2);
+        assert(mpg.has_edge(mpg.get_handle(1), mpg.get_handle(2)));
+        mpg.create_handle("A", 3);
+    }
+    {
+        // The compacted graph loads again
+        MappedPackedGraph mpg;
+        mpg.deserialize(filename);
+        check_graph(mpg);
+        assert(mpg.get_node_count() == 3);
+        assert(mpg.get_edge_count() == 1);
+        
+        // Graphs in memory compact too
+        MappedPackedGraph copy;
+        copy.snapshot(mpg);
+        copy.compact();
+        check_graph(copy);
+        assert(copy.get_node_count() == 3);
+    }
+    {
+        // A file with the magic number from before the current layout, which
+        // among other things stores the ID to record map sparsely, has to be
+        // rejected rather than misread
+        fd = open(filename, O_RDWR);
+        assert(fd != -1);
+        uint32_t old_magic_number = htonl(672226447);
+        assert(pwrite(fd, &old_magic_number, sizeof(old_magic_number), 0) == sizeof(old_magic_number));
+        assert(close(fd) == 0);
+        
+        auto rejects = [](const std::function<void(MappedPackedGraph&)>& load) {
+            MappedPackedGraph mpg;
+            try {
+                load(mpg);
+            } catch (const std::exception& e) {
+                return true;
+            }
+            return false;
+        };
+        assert(rejects([&](MappedPackedGraph& mpg) {
+            mpg.deserialize(filename);
+        }));
+        assert(rejects([&](MappedPackedGraph& mpg) {
+            std::ifstream stream(filename);
+            mpg.deserialize(stream);
+        }));
+        fd = open(filename, O_RDONLY);
+        assert(fd != -1);
+        assert(rejects([&](MappedPackedGraph& mpg) {
+            mpg.deserialize(fd);
+        }));
+        assert(close(fd) == 0);
+    }
+    unlink(filename);
+    
+    cerr << "MappedPackedGraph tests successful!" << endl;
+}
+
+void test_hash_graph() {
+    
+    // make sure the copy and moves work as expected
+    
+    HashGraph g;
+    
+    handle_t h1 = g.create_handle("A");
+    handle_t h2 = g.create_handle("T");
+    handle_t h3 = g.create_handle("G");
+    
+    g.create_edge(h1, h2);
+    g.create_edge(h2, h3);
+    
+    path_handle_t p = g.create_path_handle("p");
+    g.append_step(p, h1);
+    g.append_step(p, h2);
+    g.append_step(p, h3);
+    
+    HashGraph g_copy_1 = g;
+    HashGraph g_copy_2(g);
+    HashGraph g_copy_3(g);
+    HashGraph g_copy_4(g);
+    
+    HashGraph g_move_1 = move(g_copy_3);
+    HashGraph g_move_2(move(g_copy_4));
+    
+    assert(handlegraph::algorithms::are_equivalent_with_paths(&g, &g_copy_1, true));
+    assert(handlegraph::algorithms::are_equivalent_with_paths(&g, &g_copy_2, true));
+    assert(handlegraph::algorithms::are_equivalent_with_paths(&g, &g_move_1, true));
+    assert(handlegraph::algorithms::are_equivalent_with_paths(&g, &g_move_2, true));
+    
+    // delete a handle on a path to trigger the occurrence index to be accessed
+    g_copy_1.destroy_handle(g_copy_1.get_handle(g.get_id(h2)));
+    g_copy_2.destroy_handle(g_copy_2.get_handle(g.get_id(h2)));
+    g_move_1.destroy_handle(g_move_1.get_handle(g.get_id(h2)));
+    g_move_2.destroy_handle(g_move_2.get_handle(g.get_id(h2)));
+    g.destroy_handle(h2);
+    
+    assert(handlegraph::algorithms::are_equivalent_with_paths(&g, &g_copy_1, true));
+    assert(handlegraph::algorithms::are_equivalent_with_paths(&g, &g_copy_2, true));
+    assert(handlegraph::algorithms::are_equivalent_with_paths(&g, &g_move_1, true));
+    assert(handlegraph::algorithms::are_equivalent_with_paths(&g, &g_move_2, true));
+    
+    // make a long path that spans several arena blocks, with circular paths
+    // and removed steps
+    {
+        HashGraph g;
+        handle_t h1 = g.create_handle("A");
+        handle_t h2 = g.create_handle("C");
+        g.create_edge(h1, h2);
+        g.create_edge(h2, h1);
+        path_handle_t p1 = g.create_path_handle("p1");
+        path_handle_t p2 = g.create_path_handle("p2", true);
+        vector<step_handle_t> steps;
+        for (size_t i = 0; i < 1000; ++i) {
+            steps.push_back(g.append_step(p1, i % 2 ? h2 : h1));
+            g.append_step(p2, i % 2 ? h1 : h2);
+        }
+        // steps are still valid after later ones are added
+        for (size_t i = 0; i < steps.size(); ++i) {
+            assert(g.get_handle_of_step(steps[i]) == (i % 2 ? h2 : h1));
+        }
+        // remove and reuse some steps
+        g.rewrite_segment(steps[10], steps[20], vector<handle_t>{h1, h2, h1});
+        g.rewrite_segment(steps[100], steps[102], vector<handle_t>());
+        assert(g.get_step_count(p1) == 1000 - 10 + 3 - 2);
+        assert(g.steps_of_handle(h1).size() + g.steps_of_handle(h2).size() == 2000 - 10 + 3 - 2);
+        
+        HashGraph copied(g);
+        assert(handlegraph::algorithms::are_equivalent_with_paths(&g, &copied, true));
+        stringstream strm;
+        g.serialize(strm);
+        HashGraph loaded;
+        loaded.deserialize(strm);
+        assert(handlegraph::algorithms::are_equivalent_with_paths(&g, &loaded, true));
+        
+        g.destroy_path(p1);
+        assert(g.steps_of_handle(h1).size() + g.steps_of_handle(h2).size() == 1000);
+        assert(g.get_step_count(p2) == 1000);
+        assert(g.get_handle_of_step(g.get_previous_step(g.path_begin(p2))) == h1);
+        
+        g.clear();
+        assert(g.get_path_count() == 0);
+    }
+    
+    cerr << "HashGraph tests successful!" << endl;
+}
+
+void test_graph_conversion() {
+    
+    // check that two graphs have the same nodes, edges and paths
+    auto check_same = [](const PathHandleGraph& a, const PathHandleGraph& b) {
+        assert(a.get_node_count() == b.get_node_count());
+        assert(a.get_edge_count() == b.get_edge_count());
+        assert(a.get_path_count() == b.get_path_count());
+        a.for_each_handle([&](const handle_t& handle) {
+            assert(b.has_node(a.get_id(handle)));
+            handle_t other = b.get_handle(a.get_id(handle));
+            assert(a.get_sequence(handle) == b.get_sequence(other));
+            for (bool is_reverse : {false, true}) {
+                for (bool go_left : {false, true}) {
+                    vector<pair<nid_t, bool>> a_next, b_next;
+                    a.follow_edges(is_reverse ? a.flip(handle) : handle, go_left, [&](const handle_t& next) {
+                        a_next.emplace_back(a.get_id(next), a.get_is_reverse(next));
+                    });
+                    b.follow_edges(is_reverse ? b.flip(other) : other, go_left, [&](const handle_t& next) {
+                        b_next.emplace_back(b.get_id(next), b.get_is_reverse(next));
+                    });
+                    sort(a_next.begin(), a_next.end());
+                    sort(b_next.begin(), b_next.end());
+                    assert(a_next == b_next);
+                }
+            }
+        });
+        size_t path_count = 0;
+        a.for_each_path_matching(nullptr, nullptr, nullptr, [&](const path_handle_t& path) {
+            string name = a.get_path_name(path);
+            assert(b.has_path(name));
+            path_handle_t other = b.get_path_handle(name);
+            assert(a.get_is_circular(path) == b.get_is_circular(other));
+            assert(a.get_sense(path) == b.get_sense(other));
+            vector<pair<nid_t, bool>> a_steps, b_steps;
+            for (handle_t handle : a.scan_path(path)) {
+                a_steps.emplace_back(a.get_id(handle), a.get_is_reverse(handle));
+            }
+            for (handle_t handle : b.scan_path(other)) {
+                b_steps.emplace_back(b.get_id(handle), b.get_is_reverse(handle));
+            }
+            assert(a_steps == b_steps);
+            path_count++;
+        });
+        size_t other_path_count = 0;
+        b.for_each_path_matching(nullptr, nullptr, nullptr, [&](const path_handle_t& path) {
+            other_path_count++;
+        });
+        assert(path_count == other_path_count);
+    };
+    
+    random_device rd;
+    default_random_engine prng(rd());
+    
+    HashGraph hash_graph;
+    vector<handle_t> nodes;
+    for (size_t i = 0; i < 300; i++) {
+        string sequence;
+        size_t length = 1 + prng() % 20;
+        for (size_t j = 0; j < length; j++) {
+            sequence.push_back("ACGTN"[prng() % 5]);
+        }
+        // leave big gaps in the IDs
+        nid_t id = i < 290 ? 1 + 3 * i : 1000000000 + i;
+        nodes.push_back(hash_graph.create_handle(sequence, id));
+    }
+    for (size_t i = 0; i < 700; i++) {
+        handle_t left = nodes[prng() % nodes.size()];
+        handle_t right = nodes[prng() % nodes.size()];
+        hash_graph.create_edge(prng() % 2 ? hash_graph.flip(left) : left, prng() % 2 ? hash_graph.flip(right) : right);
+    }
+    // reversing self edges on both sides
+    hash_graph.create_edge(nodes[5], hash_graph.flip(nodes[5]));
+    hash_graph.create_edge(hash_graph.flip(nodes[6]), nodes[6]);
+    
+    path_handle_t reference = hash_graph.create_path_handle("chr1");
+    path_handle_t circular = hash_graph.create_path_handle("loop", true);
+    path_handle_t haplotype = hash_graph.create_path(PathSense::HAPLOTYPE, "HG002", "chr1", 1, 0,
+                                                     PathMetadata::NO_SUBRANGE);
+    hash_graph.create_path_handle("empty");
+    for (size_t i = 0; i < 1000; i++) {
+        handle_t step = nodes[prng() % nodes.size()];
+        hash_graph.append_step(reference, step);
+        hash_graph.append_step(haplotype, hash_graph.flip(step));
+        if (i % 10 == 0) {
+            hash_graph.append_step(circular, step);
+        }
+    }
+    
+    PackedGraph packed = PackedGraph::from(hash_graph);
+    check_same(hash_graph, packed);
+    // the nodes come out in ID order
+    nid_t prev_id = 0;
+    packed.for_each_handle([&](const handle_t& handle) {
+        assert(packed.get_id(handle) > prev_id);
+        prev_id = packed.get_id(handle);
+    });
+    
+    // leave some deleted records behind before copying between backends
+    packed.set_automatic_defragmentation(false);
+    packed.destroy_handle(packed.get_handle(hash_graph.get_id(nodes[7])));
+    packed.destroy_path(packed.get_path_handle("empty"));
+    
+    MappedPackedGraph mapped = MappedPackedGraph::from(packed);
+    check_same(packed, mapped);
+    mapped.create_handle("GATTACA");
+    mapped.optimize();
+    
+    PackedGraph packed_again = PackedGraph::from(mapped);
+    check_same(mapped, packed_again);
+    packed_again.destroy_handle(packed_again.get_handle(hash_graph.get_id(nodes[8])));
+    
+    HashGraph hash_again = HashGraph::from(packed_again);
+    check_same(packed_again, hash_again);
+    check_same(mapped, HashGraph::from(mapped));
+    check_same(hash_graph, MappedPackedGraph::from(hash_graph));
+    
+    // compressed paths come along too
+    packed.set_path_compression(true);
+    packed.optimize();
+    check_same(packed, MappedPackedGraph::from(packed));
+    
+    // copying something empty makes something empty
+    assert(PackedGraph::from(HashGraph()).get_node_count() == 0);
+    assert(MappedPackedGraph::from(PackedGraph()).get_node_count() == 0);
+    
+    cerr << "Graph conversion tests successful!" << endl;
+}
+
+void test_hash_graph_concurrent_mutation() {
+    
+    int backup_thread_count = omp_get_max_threads();
+    omp_set_num_threads(8);
+    
+    // build the same graph serially and from several threads, each working
+    // on its own range of IDs, with edges and paths that cross into the
+    // neighboring ranges
+    size_t num_parts = 16;
+    size_t part_size = 200;
+    auto build = [&](HashGraph& g, bool parallel) {
+        g.set_concurrent_mutation(parallel);
+        assert(g.get_concurrent_mutation() == parallel);
+#pragma omp parallel for schedule(dynamic, 1) if (parallel)
+        for (size_t part = 0; part < num_parts; part++) {
+            for (size_t i = 0; i < part_size; i++) {
+                nid_t id = 1 + part * part_size + i;
+                g.create_handle(string(1 + id % 5, "ACGT"[id % 4]), id);
+            }
+        }
+#pragma omp parallel for schedule(dynamic, 1) if (parallel)
+        for (size_t part = 0; part < num_parts; part++) {
+            path_handle_t path = g.create_path_handle("part" + to_string(part));
+            for (size_t i = 0; i < part_size; i++) {
+                nid_t id = 1 + part * part_size + i;
+                nid_t next = 1 + (id % (num_parts * part_size));
+                g.create_edge(g.get_handle(id), g.get_handle(next, id % 3 == 0));
+                // and the same edge the other way around
+                g.create_edge(g.get_handle(next, id % 3 != 0), g.get_handle(id, true));
+                if (id % 7 == 0) {
+                    g.create_edge(g.get_handle(id), g.get_handle(id, true));
+                }
+                g.append_step(path, g.get_handle(id, i % 2));
+                g.prepend_step(path, g.get_handle(next));
+            }
+        }
+        // nodes with automatic IDs get distinct ones
+#pragma omp parallel for if (parallel)
+        for (size_t i = 0; i < 100; i++) {
+            g.create_handle("GATTACA");
+        }
+        g.set_concurrent_mutation(false);
+    };
+    
+    HashGraph serial, parallel;
+    build(serial, false);
+    build(parallel, true);
+    
+    assert(parallel.get_node_count() == serial.get_node_count());
+    assert(parallel.min_node_id() == serial.min_node_id());
+    assert(parallel.max_node_id() == serial.max_node_id());
+    assert(parallel.get_edge_count() == serial.get_edge_count());
+    serial.for_each_handle([&](const handle_t& h) {
+        nid_t id = serial.get_id(h);
+        assert(parallel.has_node(id));
+        handle_t other = parallel.get_handle(id);
+        assert(parallel.get_sequence(other) == serial.get_sequence(h));
+        for (bool go_left : {false, true}) {
+            set<handle_t> serial_next, parallel_next;
+            serial.follow_edges(h, go_left, [&](const handle_t& n) {
+                serial_next.insert(n);
+            });
+            parallel.follow_edges(other, go_left, [&](const handle_t& n) {
+                parallel_next.insert(n);
+            });
+            assert(serial_next == parallel_next);
+        }
+        assert(parallel.steps_of_handle(other).size() == serial.steps_of_handle(h).size());
+    });
+    serial.for_each_path_handle([&](const path_handle_t& p) {
+        path_handle_t other = parallel.get_path_handle(serial.get_path_name(p));
+        vector<handle_t> serial_steps, parallel_steps;
+        for (handle_t h : serial.scan_path(p)) {
+            serial_steps.push_back(h);
+        }
+        for (handle_t h : parallel.scan_path(other)) {
+            parallel_steps.push_back(h);
+        }
+        assert(serial_steps == parallel_steps);
+    });
+    
+    // copies keep the mode
+    parallel.set_concurrent_mutation(true);
+    HashGraph copy(parallel);
+    assert(copy.get_concurrent_mutation());
+    HashGraph moved(std::move(copy));
+    assert(moved.get_concurrent_mutation());
+    assert(moved.get_node_count() == serial.get_node_count());
+    
+    omp_set_num_threads(backup_thread_count);
+    
+    cerr << "HashGraph concurrent mutation tests successful!" << endl;
+}
+
+void test_flat_hash_graph() {
+    
+    // make the same edits to a HashGraph and a FlatHashGraph, so that we leave
+    // destroyed records and moved lists behind in the arenas
+    HashGraph hg;
+    FlatHashGraph fg;
+    
+    auto check_equivalent = [&](const FlatHashGraph& g) {
+        assert(handlegraph::algorithms::are_equivalent_with_paths(&hg, &g, true));
+        // every node is in the table, and no extra ones are iterated
+        size_t count = 0;
+        g.for_each_handle([&](const handle_t& h) {
+            assert(hg.has_node(g.get_id(h)));
+            ++count;
+        });
+        assert(count == hg.get_node_count());
+        assert(g.get_node_count() == hg.get_node_count());
+    };
+    
+    for (MutablePathDeletableHandleGraph* g : vector<MutablePathDeletableHandleGraph*>{&hg, &fg}) {
+        vector<handle_t> handles;
+        for (size_t i = 0; i < 500; ++i) {
+            handles.push_back(g->create_handle(string("ACGT").substr(i % 4) + "GATTACA"));
+        }
+        for (size_t i = 0; i + 1 < handles.size(); ++i) {
+            g->create_edge(handles[i], handles[i + 1]);
+            if (i % 3 == 0 && i + 7 < handles.size()) {
+                g->create_edge(handles[i], g->flip(handles[i + 7]));
+            }
+        }
+        path_handle_t p = g->create_path_handle("p");
+        for (size_t i = 0; i < handles.size(); i += 2) {
+            g->append_step(p, i % 4 ? handles[i] : g->flip(handles[i]));
+        }
+        for (size_t i = 1; i < handles.size(); i += 10) {
+            g->destroy_handle(handles[i]);
+        }
+        for (size_t i = 2; i < handles.size(); i += 10) {
+            g->divide_handle(g->flip(handles[i]), vector<size_t>{1, 4});
+            g->apply_orientation(g->flip(handles[i]));
+        }
+        g->truncate_handle(handles[498], true, 2);
+        g->truncate_handle(handles[497], false, 3);
+    }
+    check_equivalent(fg);
+    
+    FlatHashGraph copied(fg);
+    check_equivalent(copied);
+    FlatHashGraph moved(move(copied));
+    check_equivalent(moved);
+    
+    stringstream strm;
+    fg.serialize(strm);
+    FlatHashGraph loaded;
+    loaded.deserialize(strm);
+    check_equivalent(loaded);
+    
+    fg.optimize();
+    check_equivalent(fg);
+    
+    // put the nodes in reverse ID order, and then compact the IDs
+    vector<handle_t> order;
+    fg.for_each_handle([&](const handle_t& h) {
+        order.push_back(h);
+    });
+    sort(order.begin(), order.end(), [&](const handle_t& a, const handle_t& b) {
+        return fg.get_id(a) > fg.get_id(b);
+    });
+    assert(!fg.apply_ordering(order, false));
+    check_equivalent(fg);
+    vector<handle_t> iterated;
+    fg.for_each_handle([&](const handle_t& h) {
+        iterated.push_back(h);
+    });
+    assert(iterated == order);
+    
+    assert(fg.apply_ordering(order, true));
+    assert(fg.min_node_id() == 1);
+    assert(fg.max_node_id() == fg.get_node_count());
+    for (size_t i = 0; i < order.size(); ++i) {
+        handle_t h = fg.get_handle(i + 1);
+        assert(fg.get_sequence(h) == hg.get_sequence(order[i]));
+        assert(fg.get_degree(h, false) == hg.get_degree(order[i], false));
+        assert(fg.get_degree(h, true) == hg.get_degree(order[i], true));
+    }
+    assert(fg.get_step_count(fg.get_path_handle("p")) == hg.get_step_count(hg.get_path_handle("p")));
+    
+    fg.clear();
+    assert(fg.get_node_count() == 0);
+    assert(!fg.has_node(1));
+    
+    cerr << "FlatHashGraph tests successful!" << endl;
+}
+
+// Let the parallel path iteration tests compress paths, on graphs that can
+void compress_paths_if_possible(PackedGraph& graph) {
+    graph.set_path_compression(true);
+    graph.optimize();
+}
+
+template<typename GraphType>
+void compress_paths_if_possible(GraphType& graph) {
+    // Nothing to do
+}
+
+template<typename GraphType>
+void test_parallel_path_iteration() {
+    
+    GraphType g;
+    vector<handle_t> handles;
+    for (size_t i = 0; i < 50; i++) {
+        handles.push_back(g.create_handle("GATTACA"));
+    }
+    for (size_t i = 0; i < 300; i++) {
+        path_handle_t path = g.create_path_handle("short" + to_string(i));
+        for (size_t j = 0; j < (i * 37) % 50; j++) {
+            g.append_step(path, j % 3 ? handles[(i + j) % 50] : g.flip(handles[(i + j) % 50]));
+        }
+    }
+    path_handle_t long_path = g.create_path_handle("long");
+    for (size_t j = 0; j < 5000; j++) {
+        g.append_step(long_path, handles[j % 50]);
+    }
+    path_handle_t circular_path = g.create_path_handle("circular", true);
+    for (size_t j = 0; j < 3000; j++) {
+        g.append_step(circular_path, g.flip(handles[j % 50]));
+    }
+    
+    auto step_key = [&](const step_handle_t& step) {
+        return make_pair(as_integers(step)[0], as_integers(step)[1]);
+    };
+    
+    auto check = [&]() {
+        vector<int64_t> paths, parallel_paths;
+        g.for_each_path_handle([&](const path_handle_t& path) {
+            paths.push_back(as_integer(path));
+        });
+        assert(g.for_each_path_handle([&](const path_handle_t& path) {
+#pragma omp critical
+            parallel_paths.push_back(as_integer(path));
+            return true;
+        }, true));
+        sort(paths.begin(), paths.end());
+        sort(parallel_paths.begin(), parallel_paths.end());
+        assert(paths == parallel_paths);
+        assert(paths.size() == g.get_path_count());
+        
+        // Serial iteration through the new overload should be in order
+        vector<int64_t> serial_paths;
+        g.for_each_path_handle([&](const path_handle_t& path) {
+            serial_paths.push_back(as_integer(path));
+            return true;
+        }, false);
+        sort(serial_paths.begin(), serial_paths.end());
+        assert(serial_paths == paths);
+        
+        // Stopping early gets reported
+        atomic<size_t> visited(0);
+        assert(!g.for_each_path_handle([&](const path_handle_t& path) {
+            visited++;
+            return false;
+        }, true));
+        assert(visited >= 1 && visited < paths.size());
+        
+        g.for_each_path_handle([&](const path_handle_t& path) {
+            vector<pair<int64_t, int64_t>> steps, parallel_steps;
+            vector<handle_t> visits;
+            g.for_each_step_in_path(path, [&](const step_handle_t& step) {
+                steps.push_back(step_key(step));
+            });
+            unordered_map<handle_t, size_t> handle_counts;
+            g.for_each_step_in_path(path, [&](const step_handle_t& step) {
+                handle_counts[g.get_handle_of_step(step)]++;
+            });
+            assert(g.for_each_step_in_path(path, [&](const step_handle_t& step) {
+                handle_t visit = g.get_handle_of_step(step);
+#pragma omp critical
+                {
+                    parallel_steps.push_back(step_key(step));
+                    handle_counts[visit]--;
+                }
+                return true;
+            }, true));
+            assert(steps.size() == g.get_step_count(path));
+            sort(steps.begin(), steps.end());
+            sort(parallel_steps.begin(), parallel_steps.end());
+            assert(steps == parallel_steps);
+            for (auto& count : handle_counts) {
+                assert(count.second == 0);
+            }
+            
+            if (steps.size() > 4096) {
+                atomic<size_t> steps_visited(0);
+                assert(!g.for_each_step_in_path(path, [&](const step_handle_t& step) {
+                    steps_visited++;
+                    return false;
+                }, true));
+                assert(steps_visited >= 1 && steps_visited < steps.size());
+            }
+        });
+    };
+    
+    check();
+    
+    // Take out some steps, leaving holes in the path's records
+    step_handle_t segment_begin = g.path_begin(long_path);
+    for (size_t j = 0; j < 100; j++) {
+        segment_begin = g.get_next_step(segment_begin);
+    }
+    step_handle_t segment_end = segment_begin;
+    for (size_t j = 0; j < 1500; j++) {
+        segment_end = g.get_next_step(segment_end);
+    }
+    g.rewrite_segment(segment_begin, segment_end, {handles[7]});
+    assert(g.get_step_count(long_path) == 5000 - 1500 + 1);
+    check();
+    
+    compress_paths_if_possible(g);
+    check();
+    
+    cerr << "Parallel path iteration tests successful!" << endl;
+}
+
+template<typename GraphType>
+void test_fast_iteration() {
+    
+    GraphType g;
+    
+    handle_t h1 = g.create_handle("GATT");
+    handle_t h2 = g.create_handle("A");
+    handle_t h3 = g.create_handle("CA");
+    handle_t h4 = g.create_handle("T");
+    
+    g.create_edge(h1, h2);
+    g.create_edge(h1, g.flip(h3));
+    g.create_edge(h2, h4);
+    g.create_edge(g.flip(h3), h4);
+    g.create_edge(h4, h1);
+    
+    path_handle_t p1 = g.create_path_handle("p1");
+    g.append_step(p1, h1);
+    g.append_step(p1, h2);
+    g.append_step(p1, h4);
+    path_handle_t p2 = g.create_path_handle("p2");
+    g.append_step(p2, g.flip(h4));
+    g.append_step(p2, h3);
+    g.append_step(p2, g.flip(h1));
+    
+    // the fast paths should visit exactly what the std::function versions do
+    vector<handle_t> handles, fast_handles;
+    g.for_each_handle([&](const handle_t& h) {
+        handles.push_back(h);
+    });
+    g.for_each_handle_fast([&](const handle_t& h) {
+        fast_handles.push_back(h);
+    });
+    assert(handles == fast_handles);
+    assert(handles.size() == 4);
+    
+    for (const handle_t& h : handles) {
+        for (const handle_t& oriented : {h, g.flip(h)}) {
+            for (bool go_left : {false, true}) {
+                vector<handle_t> next, fast_next;
+                g.follow_edges(oriented, go_left, [&](const handle_t& n) {
+                    next.push_back(n);
+                });
+                g.follow_edges_fast(oriented, go_left, [&](const handle_t& n) {
+                    fast_next.push_back(n);
+                });
+                assert(next == fast_next);
+                assert(next.size() == g.get_degree(oriented, go_left));
+            }
+        }
+        
+        vector<step_handle_t> steps, fast_steps;
+        g.for_each_step_on_handle(h, [&](const step_handle_t& s) {
+            steps.push_back(s);
+        });
+        g.for_each_step_on_handle_fast(h, [&](const step_handle_t& s) {
+            fast_steps.push_back(s);
+        });
+        assert(steps == fast_steps);
+        assert(steps.size() == 2 || (g.get_id(h) != g.get_id(h1) && g.get_id(h) != g.get_id(h4)));
+    }
+    
+    // early stopping is honored with bool-returning iteratees
+    size_t count = 0;
+    assert(!g.for_each_handle_fast([&](const handle_t& h) {
+        count++;
+        return false;
+    }));
+    assert(count == 1);
+    count = 0;
+    assert(!g.follow_edges_fast(h1, false, [&](const handle_t& n) {
+        count++;
+        return false;
+    }));
+    assert(count == 1);
+    count = 0;
+    assert(!g.for_each_step_on_handle_fast(h1, [&](const step_handle_t& s) {
+        count++;
+        return false;
+    }));
+    assert(count == 1);
+    assert(g.follow_edges_fast(h1, true, [&](const handle_t& n) {
+        return true;
+    }));
+    
+    // sequences can be read without allocating a new string each time
+    string long_seq;
+    for (size_t i = 0; i < 2500; ++i) {
+        long_seq.push_back("ACGTTGCAN"[(i * 7) % 9]);
+    }
+    handle_t h5 = g.create_handle(long_seq);
+    string buffer;
+    for (const handle_t& h : {h1, g.flip(h3), h5, g.flip(h5)}) {
+        g.get_sequence_into(h, buffer);
+        assert(buffer == g.get_sequence(h));
+        string chunked;
+        assert(g.for_each_sequence_chunk(h, [&](const char* seq, size_t len) {
+            chunked.append(seq, len);
+        }));
+        assert(chunked == buffer);
+    }
+    assert(buffer.capacity() >= long_seq.size());
+    g.get_sequence_into(h2, buffer);
+    assert(buffer == "A");
+    count = 0;
+    assert(!g.for_each_sequence_chunk(g.flip(h5), [&](const char* seq, size_t len) {
+        count++;
+        return false;
+    }));
+    assert(count == 1);
+}
+
+template<typename GraphType>
+void test_batch_lookups() {
+    
+    GraphType g;
+    
+    // enough nodes to fill several prefetch windows, with gaps in the IDs
+    vector<nid_t> ids;
+    for (size_t i = 0; i < 200; i++) {
+        handle_t h = g.create_handle(string(1 + (i * 37) % 23, "ACGT"[i % 4]), 1 + 2 * i);
+        ids.push_back(g.get_id(h));
+    }
+    for (size_t i = 0; i < ids.size(); i++) {
+        handle_t h = g.get_handle(ids[i]);
+        for (size_t j : {i + 1, i + 7, i * 3}) {
+            if (j < ids.size() && j != i) {
+                g.create_edge(h, g.get_handle(ids[j], j % 2 == 0));
+            }
+        }
+    }
+    
+    // batches can be in any order and orientation, and repeat nodes
+    vector<nid_t> batch_ids;
+    for (size_t i = 0; i < 150; i++) {
+        batch_ids.push_back(ids[(i * 53) % ids.size()]);
+    }
+    vector<handle_t> batch;
+    g.get_handles(batch_ids, batch);
+    assert(batch.size() == batch_ids.size());
+    for (size_t i = 0; i < batch.size(); i++) {
+        assert(batch[i] == g.get_handle(batch_ids[i]));
+    }
+    g.get_handles(batch_ids, batch, true);
+    for (size_t i = 0; i < batch.size(); i++) {
+        assert(batch[i] == g.get_handle(batch_ids[i], true));
+        if (i % 3 == 0) {
+            batch[i] = g.flip(batch[i]);
+        }
+    }
+    
+    vector<size_t> lengths {5, 5};
+    g.get_sequences_lengths(batch, lengths);
+    assert(lengths.size() == batch.size());
+    for (size_t i = 0; i < batch.size(); i++) {
+        assert(lengths[i] == g.get_length(batch[i]));
+    }
+    
+    for (bool go_left : {false, true}) {
+        vector<vector<handle_t>> next(batch.size());
+        assert(g.follow_edges_batch(batch, go_left, [&](size_t i, const handle_t& n) {
+            next[i].push_back(n);
+        }));
+        for (size_t i = 0; i < batch.size(); i++) {
+            vector<handle_t> expected;
+            g.follow_edges(batch[i], go_left, [&](const handle_t& n) {
+                expected.push_back(n);
+            });
+            assert(next[i] == expected);
+        }
+    }
+    
+    // early stopping is honored
+    size_t count = 0;
+    assert(!g.follow_edges_batch(batch, false, [&](size_t i, const handle_t& n) {
+        count++;
+        return count < 40;
+    }));
+    assert(count == 40);
+    
+    // and empty batches are fine
+    vector<handle_t> empty;
+    g.get_sequences_lengths(empty, lengths);
+    assert(lengths.empty());
+    assert(g.follow_edges_batch(empty, false, [&](size_t i, const handle_t& n) {
+        return false;
+    }));
+}
+
+template<typename GraphType>
+void test_bulk_edges_and_chop() {
+    
+    // the edges of a graph by node ID, to compare graphs that hand out
+    // different handles
+    auto edges_of = [](const GraphType& g) {
+        set<tuple<nid_t, bool, nid_t, bool>> edges;
+        g.for_each_edge([&](const edge_t& e) {
+            edges.emplace(g.get_id(e.first), g.get_is_reverse(e.first), g.get_id(e.second), g.get_is_reverse(e.second));
+            edges.emplace(g.get_id(e.second), !g.get_is_reverse(e.second), g.get_id(e.first), !g.get_is_reverse(e.first));
+        });
+        return edges;
+    };
+    
+    vector<string> sequences {"ACGTACGTAC", "GGT", "T", "CCCCAAAAGGGGTTTTA", "ACGTTG", "GATTACA"};
+    GraphType bulk, single;
+    for (GraphType* g : {&bulk, &single}) {
+        for (size_t i = 0; i < sequences.size(); i++) {
+            g->create_handle(sequences[i], 2 * i + 1);
+        }
+        // a node that is gone before chopping
+        g->destroy_handle(g->create_handle("AAAAAAAAAAAA", 4));
+    }
+    
+    // edges in both orientations, with duplicates, reversing self edges,
+    // and edges that already exist
+    vector<tuple<nid_t, bool, nid_t, bool>> to_add {
+        make_tuple(1, false, 3, false), make_tuple(3, false, 5, false), make_tuple(5, false, 7, false),
+        make_tuple(7, false, 9, false), make_tuple(9, false, 11, false), make_tuple(1, false, 5, true),
+        make_tuple(5, false, 1, true), make_tuple(7, true, 7, false), make_tuple(9, false, 9, true),
+        make_tuple(11, false, 11, false), make_tuple(3, false, 5, false), make_tuple(5, true, 3, true),
+        make_tuple(11, true, 1, true)
+    };
+    single.create_edge(single.get_handle(1), single.get_handle(3));
+    bulk.create_edge(bulk.get_handle(1), bulk.get_handle(3));
+    vector<edge_t> edges;
+    for (auto& e : to_add) {
+        single.create_edge(single.get_handle(get<0>(e), get<1>(e)), single.get_handle(get<2>(e), get<3>(e)));
+        edges.emplace_back(bulk.get_handle(get<0>(e), get<1>(e)), bulk.get_handle(get<2>(e), get<3>(e)));
+    }
+    bulk.create_edges(edges);
+    bulk.create_edges(vector<edge_t>());
+    assert(edges_of(bulk) == edges_of(single));
+    assert(bulk.get_edge_count() == single.get_edge_count());
+    assert(bulk.get_edge_count() == 10);
+    assert(!bulk.is_single_stranded());
+    
+    // paths in both directions, one of them compressed
+    vector<vector<pair<nid_t, bool>>> walks {
+        {{1, false}, {3, false}, {5, false}, {7, false}, {9, false}, {11, false}},
+        {{11, true}, {9, true}, {9, false}, {7, false}, {7, true}, {5, true}, {3, true}, {1, true}},
+        {{3, false}}
+    };
+    vector<string> path_sequences;
+    for (GraphType* g : {&bulk, &single}) {
+        g->set_path_compression(true);
+        for (size_t i = 0; i < walks.size(); i++) {
+            path_handle_t p = g->create_path_handle("path" + to_string(i));
+            for (auto& step : walks[i]) {
+                g->append_step(p, g->get_handle(step.first, step.second));
+            }
+        }
+        g->optimize(false);
+    }
+    for (size_t i = 0; i < walks.size(); i++) {
+        string seq;
+        for (handle_t h : bulk.scan_path(bulk.get_path_handle("path" + to_string(i)))) {
+            seq += bulk.get_sequence(h);
+        }
+        path_sequences.push_back(seq);
+    }
+    
+    // dividing the nodes one at a time in ID order numbers the new pieces the
+    // same way that chopping does
+    size_t max_length = 4;
+    bulk.chop(max_length);
+    vector<nid_t> ids;
+    single.for_each_handle([&](const handle_t& h) {
+        ids.push_back(single.get_id(h));
+    });
+    sort(ids.begin(), ids.end());
+    for (nid_t id : ids) {
+        handle_t h = single.get_handle(id);
+        vector<size_t> offsets;
+        for (size_t offset = max_length; offset < single.get_length(h); offset += max_length) {
+            offsets.push_back(offset);
+        }
+        if (!offsets.empty()) {
+            single.divide_handle(h, offsets);
+        }
+    }
+    
+    assert(bulk.get_node_count() == single.get_node_count());
+    assert(bulk.min_node_id() == single.min_node_id());
+    assert(bulk.max_node_id() == single.max_node_id());
+    assert(bulk.get_edge_count() == single.get_edge_count());
+    assert(bulk.get_total_length() == single.get_total_length());
+    bulk.for_each_handle([&](const handle_t& h) {
+        assert(bulk.get_length(h) <= max_length);
+        assert(single.has_node(bulk.get_id(h)));
+        assert(bulk.get_sequence(h) == single.get_sequence(single.get_handle(bulk.get_id(h))));
+    });
+    assert(edges_of(bulk) == edges_of(single));
+    for (size_t i = 0; i < walks.size(); i++) {
+        path_handle_t p = bulk.get_path_handle("path" + to_string(i));
+        path_handle_t q = single.get_path_handle("path" + to_string(i));
+        assert(bulk.get_step_count(p) == single.get_step_count(q));
+        string seq;
+        vector<pair<nid_t, bool>> bulk_steps, single_steps;
+        for (handle_t h : bulk.scan_path(p)) {
+            seq += bulk.get_sequence(h);
+            bulk_steps.emplace_back(bulk.get_id(h), bulk.get_is_reverse(h));
+        }
+        for (handle_t h : single.scan_path(q)) {
+            single_steps.emplace_back(single.get_id(h), single.get_is_reverse(h));
+        }
+        assert(seq == path_sequences[i]);
+        assert(bulk_steps == single_steps);
+        // the steps are seen from the nodes too
+        for (auto& step : bulk_steps) {
+            bool found = false;
+            bulk.for_each_step_on_handle(bulk.get_handle(step.first), [&](const step_handle_t& s) {
+                found = found || bulk.get_path_handle_of_step(s) == p;
+            });
+            assert(found);
+        }
+    }
+    assert(bulk.get_step_count(bulk.get_path_handle("path0")) > walks[0].size());
+    
+    // chopping again to the same length changes nothing
+    auto before = edges_of(bulk);
+    bulk.chop(max_length);
+    assert(edges_of(bulk) == before);
+    assert(bulk.get_node_count() == single.get_node_count());
+    
+    // and the graph can still be edited and saved
+    bulk.create_edge(bulk.get_handle(bulk.max_node_id()), bulk.get_handle(1));
+    single.create_edge(single.get_handle(single.max_node_id()), single.get_handle(1));
+    stringstream strm;
+    bulk.serialize(strm);
+    GraphType loaded;
+    loaded.deserialize(strm);
+    assert(edges_of(loaded) == edges_of(single));
+    
+    bool caught = false;
+    try {
+        bulk.chop(0);
+    }
+    catch (std::runtime_error& e) {
+        caught = true;
+    }
+    assert(caught);
+    
+    cerr << "Bulk edge and chop tests successful!" << endl;
+}
+
+template<typename GraphType>
+void test_destroy_paths() {
+    
+    GraphType g;
+    vector<handle_t> handles;
+    for (size_t i = 0; i < 20; i++) {
+        handles.push_back(g.create_handle(string(1 + i % 3, "ACGT"[i % 4])));
+        if (i != 0) {
+            g.create_edge(handles[i - 1], handles[i]);
+        }
+    }
+    
+    // paths that share nodes, some of them visiting nodes more than once
+    // and in reverse
+    vector<path_handle_t> paths;
+    vector<vector<handle_t>> walks;
+    for (size_t i = 0; i < 30; i++) {
+        paths.push_back(g.create_path_handle("sample" + to_string(i) + "#1#chr" + to_string(i % 4)));
+        walks.emplace_back();
+        for (size_t j = i % 5; j < handles.size(); j += 1 + i % 3) {
+            walks.back().push_back(i % 2 ? g.flip(handles[j]) : handles[j]);
+        }
+        walks.back().push_back(handles[i % handles.size()]);
+        for (handle_t h : walks.back()) {
+            g.append_step(paths.back(), h);
+        }
+    }
+    
+    auto check = [&](const set<size_t>& destroyed) {
+        assert(g.get_path_count() == paths.size() - destroyed.size());
+        for (size_t i = 0; i < paths.size(); i++) {
+            string name = "sample" + to_string(i) + "#1#chr" + to_string(i % 4);
+            assert(g.has_path(name) == !destroyed.count(i));
+            if (destroyed.count(i)) {
+                continue;
+            }
+            path_handle_t p = g.get_path_handle(name);
+            vector<handle_t> walk;
+            for (handle_t h : g.scan_path(p)) {
+                walk.push_back(h);
+            }
+            assert(walk == walks[i]);
+        }
+        // the nodes only see the steps of the remaining paths
+        size_t num_steps = 0;
+        for (handle_t h : handles) {
+            g.for_each_step_on_handle(h, [&](const step_handle_t& step) {
+                assert(g.get_handle_of_step(step) == h || g.get_handle_of_step(step) == g.flip(h));
+                string name = g.get_path_name(g.get_path_handle_of_step(step));
+                assert(g.has_path(name));
+                num_steps++;
+            });
+        }
+        size_t expected_steps = 0;
+        for (size_t i = 0; i < paths.size(); i++) {
+            if (!destroyed.count(i)) {
+                expected_steps += walks[i].size();
+            }
+        }
+        assert(num_steps == expected_steps);
+    };
+    
+    // destroy a bunch at once, with repeats and out of order
+    set<size_t> destroyed {3, 7, 8, 0, 21, 29};
+    vector<path_handle_t> to_destroy;
+    for (size_t i : destroyed) {
+        to_destroy.push_back(paths[i]);
+    }
+    to_destroy.push_back(paths[7]);
+    std::reverse(to_destroy.begin(), to_destroy.end());
+    g.destroy_paths(to_destroy);
+    g.destroy_paths(vector<path_handle_t>());
+    check(destroyed);
+    
+    // and then most of the rest one at a time, which eventually compacts the
+    // path names without changing the other path handles
+    for (size_t i = 1; i < 25; i++) {
+        if (!destroyed.count(i)) {
+            g.destroy_path(paths[i]);
+            destroyed.insert(i);
+            check(destroyed);
+        }
+    }
+    // destroying the node drops the paths that were still on it
+    g.destroy_handle(handles[2]);
+    handles.erase(handles.begin() + 2);
+    for (size_t i = 0; i < paths.size(); i++) {
+        if (!destroyed.count(i)) {
+            for (handle_t h : walks[i]) {
+                if (g.get_id(h) == 3) {
+                    destroyed.insert(i);
+                    break;
+                }
+            }
+        }
+    }
+    check(destroyed);
+    
+    // everything survives a round trip and re-optimizing
+    stringstream strm;
+    g.serialize(strm);
+    GraphType loaded;
+    loaded.deserialize(strm);
+    g.optimize(false);
+    for (GraphType* graph : {&g, &loaded}) {
+        size_t count = 0;
+        graph->for_each_path_handle([&](const path_handle_t& p) {
+            count++;
+        });
+        assert(count == paths.size() - destroyed.size());
+    }
+    check(destroyed);
+    
+    cerr << "Destroy paths tests successful!" << endl;
+}
+
+template<typename GraphType>
+void test_packed_sequence_exceptions() {
+    
+    // long enough to span several words, with lengths that aren't multiples
+    // of a word, and with runs of ambiguity codes in and at the ends
+    vector<string> sequences{
+        "ACGTNNNNNACGTACGTTTGACCAGTRYSWKMBDHVACGTGGGACTTTACGGACTAGCATCNGA",
+        "NAACGGTTCAGTCAGTCAGGATCGATCGATCGATCNNNNNNNNNNNNNNNNNNNNNNNNNNNNNNNNNNNNNNNNNACGT",
+        "nnacgtRRrrACGT",
+        "GATTACAGATTACAGATTACAGATTACAGATT",
+        "XACGT.",
+        "C",
+        "N"
+    };
+    
+    auto expected = [](const string& seq) {
+        string normalized;
+        for (char c : seq) {
+            c = toupper(c);
+            normalized.push_back(string("ACGTRYSWKMBDHVN").find(c) == string::npos ? 'N' : c);
+        }
+        return normalized;
+    };
+    
+    auto check_graph = [&](const GraphType& g, const vector<handle_t>& handles, const vector<string>& seqs) {
+        for (size_t i = 0; i < handles.size(); ++i) {
+            for (bool is_reverse : {false, true}) {
+                handle_t h = is_reverse ? g.flip(handles[i]) : handles[i];
+                string seq = is_reverse ? reverse_complement(seqs[i]) : seqs[i];
+                assert(g.get_sequence(h) == seq);
+                for (size_t j = 0; j < seq.size(); ++j) {
+                    assert(g.get_base(h, j) == seq[j]);
+                }
+                for (size_t j = 0; j < seq.size(); j += 7) {
+                    for (size_t len : {1, 5, 32, 33, 100}) {
+                        assert(g.get_subsequence(h, j, len) == seq.substr(j, len));
+                    }
+                }
+            }
+        }
+    };
+    
+    GraphType g;
+    vector<handle_t> handles;
+    vector<string> seqs;
+    for (const string& seq : sequences) {
+        handles.push_back(g.create_handle(seq));
+        seqs.push_back(expected(seq));
+    }
+    check_graph(g, handles, seqs);
+    
+    // reverse complement some sequences in place
+    for (size_t i : {0, 2, 4}) {
+        handles[i] = g.apply_orientation(g.flip(handles[i]));
+        seqs[i] = reverse_complement(seqs[i]);
+    }
+    check_graph(g, handles, seqs);
+    
+    // divide nodes inside of exception runs, and flip one part
+    auto parts = g.divide_handle(handles[1], vector<size_t>{3, 50, 60});
+    handles[1] = parts[0];
+    string seq = seqs[1];
+    seqs[1] = seq.substr(0, 3);
+    handles.push_back(parts[1]);
+    seqs.push_back(seq.substr(3, 47));
+    handles.push_back(g.apply_orientation(g.flip(parts[2])));
+    seqs.push_back(reverse_complement(seq.substr(50, 10)));
+    handles.push_back(parts[3]);
+    seqs.push_back(seq.substr(60));
+    check_graph(g, handles, seqs);
+    
+    g.destroy_handle(handles[3]);
+    handles.erase(handles.begin() + 3);
+    seqs.erase(seqs.begin() + 3);
+    check_graph(g, handles, seqs);
+    
+    // the exceptions survive serialization
+    vector<nid_t> ids;
+    for (const handle_t& h : handles) {
+        ids.push_back(g.get_id(h));
+    }
+    stringstream strm;
+    g.serialize(strm);
+    GraphType loaded;
+    loaded.deserialize(strm);
+    vector<handle_t> loaded_handles;
+    for (nid_t id : ids) {
+        loaded_handles.push_back(loaded.get_handle(id));
+    }
+    check_graph(loaded, loaded_handles, seqs);
+    
+    // and compaction
+    g.optimize(false);
+    for (size_t i = 0; i < handles.size(); ++i) {
+        handles[i] = g.get_handle(ids[i]);
+    }
+    check_graph(g, handles, seqs);
+}
+
+template<typename GraphType>
+void test_sparse_node_ids() {
+    
+    // a few nodes at the start of the ID space, and a few a very long way along it
+    vector<nid_t> ids{1, 2, 3, 1000000000, 1000000001, 2000000000};
+    
+    GraphType g;
+    vector<handle_t> handles;
+    for (nid_t id : ids) {
+        handles.push_back(g.create_handle("GATTACA", id));
+    }
+    // and one below the existing ones, after trimming the start of the ID space
+    g.destroy_handle(handles[0]);
+    g.destroy_handle(handles[1]);
+    ids.erase(ids.begin(), ids.begin() + 2);
+    handles.erase(handles.begin(), handles.begin() + 2);
+    g.optimize(false);
+    handles.insert(handles.begin(), g.create_handle("CAT", 1));
+    ids.insert(ids.begin(), 1);
+    for (size_t i = 0; i < ids.size(); ++i) {
+        handles[i] = g.get_handle(ids[i]);
+    }
+    for (size_t i = 1; i < handles.size(); ++i) {
+        g.create_edge(handles[i - 1], handles[i]);
+    }
+    path_handle_t p = g.create_path_handle("p");
+    for (const handle_t& h : handles) {
+        g.append_step(p, h);
+    }
+    
+    auto check_graph = [&](const GraphType& g) {
+        assert(g.get_node_count() == ids.size());
+        assert(g.min_node_id() == 1);
+        assert(g.max_node_id() == 2000000000);
+        for (nid_t id : ids) {
+            assert(g.has_node(id));
+        }
+        for (nid_t id : {2, 4, 999999999, 1000000002, 1500000000, 2000000001}) {
+            assert(!g.has_node(id));
+        }
+        for (bool parallel : {false, true}) {
+            vector<nid_t> seen;
+            g.for_each_handle([&](const handle_t& h) {
+#pragma omp critical
+                seen.push_back(g.get_id(h));
+            }, parallel);
+            std::sort(seen.begin(), seen.end());
+            assert(seen == ids);
+        }
+        vector<nid_t> in_range;
+        g.for_each_handle_in_range(2, 1000000001, [&](const handle_t& h) {
+            in_range.push_back(g.get_id(h));
+        });
+        assert(in_range == vector<nid_t>({3, 1000000000}));
+        vector<nid_t> on_path;
+        g.for_each_step_in_path(g.get_path_handle("p"), [&](const step_handle_t& step) {
+            on_path.push_back(g.get_id(g.get_handle_of_step(step)));
+        });
+        assert(on_path == ids);
+        for (size_t i = 1; i < ids.size(); ++i) {
+            assert(g.has_edge(g.get_handle(ids[i - 1]), g.get_handle(ids[i])));
+        }
+    };
+    check_graph(g);
+    
+    // the empty ranges of IDs don't take up space
+    MemoryBreakdown breakdown = g.memory_breakdown();
+    assert(breakdown.find("nid_to_graph_iv")->bytes < 1000000);
+    
+    stringstream strm;
+    g.serialize(strm);
+    assert(strm.str().size() < 1000000);
+    GraphType loaded;
+    loaded.deserialize(strm);
+    check_graph(loaded);
+    
+    // the IDs survive the graph being rebuilt
+    g.optimize(false);
+    check_graph(g);
+    g.apply_ordering(vector<handle_t>{g.get_handle(2000000000), g.get_handle(3), g.get_handle(1),
+                                      g.get_handle(1000000001), g.get_handle(1000000000)}, false);
+    check_graph(g);
+    
+    // and moving them around keeps them sparse
+    g.reassign_node_ids([](const nid_t& id) {
+        if (id < 1000000000) {
+            return id + 1000000000;
+        }
+        else if (id < 2000000000) {
+            return id - 999999999;
+        }
+        return nid_t(5);
+    });
+    for (nid_t id : {1, 2, 5, 1000000001, 1000000003}) {
+        assert(g.has_node(id));
+    }
+    for (nid_t id : {3, 4, 1000000000, 2000000000}) {
+        assert(!g.has_node(id));
+    }
+    assert(g.get_node_count() == 5);
+    assert(g.max_node_id() == 1000000003);
+    assert(g.memory_breakdown().find("nid_to_graph_iv")->bytes < 1000000);
+    
+    // compacting them still works
+    vector<handle_t> order;
+    for (nid_t id : {1000000003, 1, 5, 2, 1000000001}) {
+        order.push_back(g.get_handle(id));
+    }
+    g.apply_ordering(order, true);
+    assert(g.min_node_id() == 1);
+    assert(g.max_node_id() == 5);
+    assert(g.get_sequence(g.get_handle(1)) == "GATTACA");
+    assert(g.get_sequence(g.get_handle(5)) == "CAT");
+}
+
+void test_memory_breakdown() {
+    
+    // make sure each component's bytes are the sum of its subcomponents
+    function<void(const MemoryBreakdown&)> check_sums = [&](const MemoryBreakdown& breakdown) {
+        if (breakdown.components.empty()) {
+            return;
+        }
+        size_t total = 0;
+        for (const MemoryBreakdown& component : breakdown.components) {
+            check_sums(component);
+            total += component.bytes;
+        }
+        assert(total == breakdown.bytes);
+    };
+    
+    auto fill_graph = [](MutablePathDeletableHandleGraph& g) {
+        handle_t prev = g.create_handle("GATTACA");
+        path_handle_t p = g.create_path_handle("p");
+        g.append_step(p, prev);
+        for (size_t i = 0; i < 1000; i++) {
+            handle_t next = g.create_handle("CATTAG");
+            g.create_edge(prev, next);
+            g.append_step(p, next);
+            prev = next;
+        }
+    };
+    
     {
-        // Make a graph
-        MappedPackedGraph mpg;
-        // Give it a node
-        mpg.create_handle("GATTACA", 1);
-        // Save it to an FD
-        mpg.serialize(fd);
-        // Make sure write-back works
-        mpg.create_handle("CATTAG", 2);
+        PackedGraph g;
+        MemoryBreakdown empty = g.memory_breakdown();
+        check_sums(empty);
+        fill_graph(g);
+        MemoryBreakdown full = g.memory_breakdown();
+        check_sums(full);
+        assert(full.name == "PackedGraph");
+        assert(full.bytes > empty.bytes);
+        for (const string& name : {"graph_iv", "edge_lists_iv", "seq_iv", "path membership", "paths", "path_id"}) {
+            assert(full.find(name) != nullptr);
+        }
+        assert(full.find("seq_iv")->bytes > empty.find("seq_iv")->bytes);
+        assert(full.find("paths")->bytes > empty.find("paths")->bytes);
+        assert(full.find("nonexistent") == nullptr);
         
-        // Make sure it looks right now
-        check_graph(mpg);
+        stringstream strm;
+        full.print(strm);
+        assert(strm.str().find("\tgraph_iv: ") != string::npos);
+        
+        PackedPositionOverlay overlay(&g);
+        MemoryBreakdown overlay_breakdown = overlay.memory_breakdown();
+        check_sums(overlay_breakdown);
+        assert(overlay_breakdown.find("indexes")->find("positions")->bytes > 0);
+        
+        PackedReferencePathOverlay ref_overlay(&g);
+        MemoryBreakdown ref_breakdown = ref_overlay.memory_breakdown();
+        check_sums(ref_breakdown);
+        assert(ref_breakdown.find("visit_indexes") != nullptr);
+        
+        SuccinctPositionOverlay succinct_overlay(&g);
+        MemoryBreakdown succinct_breakdown = succinct_overlay.memory_breakdown();
+        check_sums(succinct_breakdown);
+        assert(succinct_breakdown.find("position_indexes")->find("step_starts")->bytes > 0);
     }
     {
-        // Make a graph again
-        MappedPackedGraph mpg;
-        // Load it from the fd
-        mpg.deserialize(fd);
-        // Make sure it looks right
-        check_graph(mpg);
+        MappedPackedGraph g;
+        fill_graph(g);
+        MemoryBreakdown full = g.memory_breakdown();
+        check_sums(full);
+        assert(full.find("seq_iv")->bytes > 0);
+        assert(full.find("chain free space") != nullptr);
+        // the components should account for the whole chain
+        assert(full.bytes >= full.find("seq_iv")->bytes + full.find("graph_iv")->bytes);
     }
-    assert(close(fd) == 0);
     {
-        // Make a graph again
-        MappedPackedGraph mpg;
-        // Load it from the file
-        mpg.deserialize(filename);
-        // Make sure it looks right
-        check_graph(mpg);
+        HashGraph g;
+        MemoryBreakdown empty = g.memory_breakdown();
+        fill_graph(g);
+        MemoryBreakdown full = g.memory_breakdown();
+        check_sums(full);
+        assert(full.bytes > empty.bytes);
+        assert(full.find("graph")->find("sequences")->bytes >= 7 + 1000 * 6);
+        assert(full.find("paths")->find("steps")->bytes > 0);
     }
     {
-        // Make a graph again
-        MappedPackedGraph mpg;
-        // Load it from a stream
-        std::ifstream stream(filename);
-        mpg.deserialize(stream);
-        // Make sure it looks right
-        check_graph(mpg);
+        // short paths don't pay for room to grow
+        HashGraph g;
+        handle_t h = g.create_handle("GATTACA");
+        for (size_t i = 0; i < 100; i++) {
+            g.append_step(g.create_path_handle("fragment" + to_string(i)), h);
+        }
+        assert(g.memory_breakdown().find("paths")->find("steps")->bytes == 100 * sizeof(LinkedPathStep));
+    }
+    {
+        SnarlDistanceIndex index;
+        MemoryBreakdown breakdown = index.memory_breakdown();
+        check_sums(breakdown);
+        assert(breakdown.find("snarl_tree_records") != nullptr);
     }
-    unlink(filename);
     
-    cerr << "MappedPackedGraph tests successful!" << endl;
+    cerr << "Memory breakdown tests successful!" << endl;
 }
 
-void test_hash_graph() {
+// Fill in a temporary distance index for one new chain of nodes with the given
+// lengths, with the given forward and reverse loop distances, without needing
+// a snarl finder. Adds the nodes to the given graph.
+void make_linear_chain_temp_index(SnarlDistanceIndex::TemporaryDistanceIndex& temp_index, HashGraph& graph,
+                                  const vector<size_t>& lengths, const vector<size_t>& forward_loops,
+                                  const vector<size_t>& reverse_loops) {
+    using TemporaryDistanceIndex = SnarlDistanceIndex::TemporaryDistanceIndex;
     
-    // make sure the copy and moves work as expected
+    vector<handle_t> handles;
+    for (size_t i = 0; i < lengths.size(); i++) {
+        handles.push_back(graph.create_handle(string(lengths[i], 'A')));
+        if (handles.size() > 1) {
+            graph.create_edge(handles[handles.size() - 2], handles.back());
+        }
+    }
     
-    HashGraph g;
+    temp_index.min_node_id = graph.get_id(handles.front());
+    temp_index.max_node_id = graph.get_id(handles.back());
+    temp_index.root_structure_count = 1;
+    temp_index.max_tree_depth = 1;
+    temp_index.components.emplace_back(SnarlDistanceIndex::TEMP_CHAIN, 0);
+    temp_index.temp_chain_records.emplace_back();
+    TemporaryDistanceIndex::TemporaryChainRecord& chain = temp_index.temp_chain_records.back();
+    chain.start_node_id = temp_index.min_node_id;
+    chain.start_node_rev = false;
+    chain.end_node_id = temp_index.max_node_id;
+    chain.end_node_rev = false;
+    chain.end_node_length = lengths.back();
+    chain.parent = make_pair(SnarlDistanceIndex::TEMP_ROOT, 0);
+    chain.rank_in_parent = 0;
+    chain.reversed_in_parent = false;
+    chain.is_trivial = false;
+    size_t total_length = 0;
+    for (size_t i = 0; i < handles.size(); i++) {
+        chain.children.emplace_back(SnarlDistanceIndex::TEMP_NODE, graph.get_id(handles[i]));
+        chain.prefix_sum.push_back(total_length);
+        chain.max_prefix_sum.push_back(total_length);
+        chain.forward_loops.push_back(forward_loops[i]);
+        chain.backward_loops.push_back(reverse_loops[i]);
+        chain.chain_components.push_back(0);
+        
+        temp_index.temp_node_records.emplace_back();
+        TemporaryDistanceIndex::TemporaryNodeRecord& node = temp_index.temp_node_records.back();
+        node.node_id = graph.get_id(handles[i]);
+        node.parent = make_pair(SnarlDistanceIndex::TEMP_CHAIN, 0);
+        node.node_length = lengths[i];
+        node.rank_in_parent = i;
+        
+        total_length += lengths[i];
+    }
+    chain.min_length = total_length;
+    chain.max_length = total_length;
+    temp_index.max_distance = total_length;
+    temp_index.max_index_size = chain.get_max_record_length();
+}
+
+// Fill in a distance index for a graph that is one or more chains of nodes with
+// the given lengths and loop distances, split evenly among the chains. Adds the
+// nodes to the given empty graph.
+void make_linear_chain_index(SnarlDistanceIndex& index, HashGraph& graph, const vector<size_t>& lengths,
+                             const vector<size_t>& forward_loops, const vector<size_t>& reverse_loops,
+                             size_t chain_count = 1) {
+    using TemporaryDistanceIndex = SnarlDistanceIndex::TemporaryDistanceIndex;
     
-    handle_t h1 = g.create_handle("A");
-    handle_t h2 = g.create_handle("T");
-    handle_t h3 = g.create_handle("G");
+    // Each chain is its own connected component
+    vector<TemporaryDistanceIndex> temp_indexes(chain_count);
+    vector<const TemporaryDistanceIndex*> temp_index_pointers;
+    for (size_t c = 0; c < chain_count; c++) {
+        size_t first = lengths.size() * c / chain_count;
+        size_t last = lengths.size() * (c + 1) / chain_count;
+        make_linear_chain_temp_index(temp_indexes[c], graph,
+                                     vector<size_t>(lengths.begin() + first, lengths.begin() + last),
+                                     vector<size_t>(forward_loops.begin() + first, forward_loops.begin() + last),
+                                     vector<size_t>(reverse_loops.begin() + first, reverse_loops.begin() + last));
+        temp_index_pointers.push_back(&temp_indexes[c]);
+    }
+    index.get_snarl_tree_records(temp_index_pointers, &graph);
+}
+
+void test_neighborhood_extractor() {
     
-    g.create_edge(h1, h2);
-    g.create_edge(h2, h3);
+    // Find the distance out from a position to the start of every oriented
+    // handle the slow way, by relaxing edges until nothing changes.
+    auto reference_neighborhood = [](const HandleGraph& graph, const tuple<nid_t, bool, size_t>& position,
+                                     size_t max_distance) {
+        handle_t seed = graph.get_handle(get<0>(position), get<1>(position));
+        size_t offset = get<2>(position);
+        unordered_map<handle_t, size_t> distances;
+        deque<handle_t> queue;
+        auto reach = [&](const handle_t& from, size_t distance) {
+            graph.follow_edges(from, false, [&](const handle_t& next) {
+                if (distance <= max_distance && (!distances.count(next) || distances[next] > distance)) {
+                    distances[next] = distance;
+                    queue.push_back(next);
+                }
+            });
+        };
+        reach(seed, graph.get_length(seed) - offset);
+        reach(graph.flip(seed), offset + 1);
+        while (!queue.empty()) {
+            handle_t here = queue.front();
+            queue.pop_front();
+            reach(here, distances[here] + graph.get_length(here));
+        }
+        set<nid_t> found {graph.get_id(seed)};
+        for (auto& entry : distances) {
+            found.insert(graph.get_id(entry.first));
+        }
+        return found;
+    };
     
-    path_handle_t p = g.create_path_handle("p");
-    g.append_step(p, h1);
-    g.append_step(p, h2);
-    g.append_step(p, h3);
+    auto node_ids = [](const HandleGraph& subgraph) {
+        set<nid_t> found;
+        subgraph.for_each_handle([&](const handle_t& handle) {
+            found.insert(subgraph.get_id(handle));
+        });
+        return found;
+    };
     
-    HashGraph g_copy_1 = g;
-    HashGraph g_copy_2(g);
-    HashGraph g_copy_3(g);
-    HashGraph g_copy_4(g);
+    {
+        // Make a tangled graph with some reversing edges and cycles
+        PackedGraph graph;
+        default_random_engine gen(58);
+        vector<handle_t> handles;
+        for (size_t i = 0; i < 500; i++) {
+            handles.push_back(graph.create_handle(string(1 + gen() % 12, 'A')));
+        }
+        for (size_t i = 0; i + 1 < handles.size(); i++) {
+            graph.create_edge(handles[i], handles[i + 1]);
+            if (gen() % 4 == 0) {
+                handle_t other = handles[gen() % handles.size()];
+                graph.create_edge(handles[i], gen() % 2 ? graph.flip(other) : other);
+            }
+        }
+        
+        vector<tuple<nid_t, bool, size_t>> positions;
+        for (size_t i = 0; i < 300; i++) {
+            handle_t handle = handles[gen() % handles.size()];
+            positions.emplace_back(graph.get_id(handle), gen() % 2, gen() % graph.get_length(handle));
+        }
+        
+        NeighborhoodExtractor<PackedGraph> extractor(&graph);
+        NeighborhoodExtractor<> generic_extractor(&graph);
+        for (size_t max_distance : {0, 5, 40}) {
+            SubgraphBatch batch = extractor.extract(positions, max_distance);
+            SubgraphBatch serial_batch = generic_extractor.extract(positions, max_distance, numeric_limits<size_t>::max(), false);
+            assert(batch.size() == positions.size());
+            assert(batch.get_graph() == &graph);
+            for (size_t i = 0; i < positions.size(); i++) {
+                BatchSubgraphOverlay subgraph = batch.get_subgraph(i);
+                set<nid_t> expected = reference_neighborhood(graph, positions[i], max_distance);
+                assert(node_ids(subgraph) == expected);
+                assert(node_ids(serial_batch.get_subgraph(i)) == expected);
+                assert(subgraph.get_node_count() == expected.size());
+                assert(batch.get_node_count(i) == expected.size());
+                assert(subgraph.min_node_id() == *expected.begin());
+                assert(subgraph.max_node_id() == *expected.rbegin());
+                if (max_distance == 0) {
+                    assert(expected.size() == 1);
+                }
+                
+                // Check the overlay's view of the graph
+                for (const handle_t& handle : handles) {
+                    bool included = expected.count(graph.get_id(handle));
+                    assert(subgraph.has_node(graph.get_id(handle)) == included);
+                    if (!included) {
+                        continue;
+                    }
+                    for (bool go_left : {false, true}) {
+                        size_t expected_degree = 0;
+                        graph.follow_edges(handle, go_left, [&](const handle_t& next) {
+                            expected_degree += expected.count(graph.get_id(next));
+                        });
+                        assert(subgraph.get_degree(handle, go_left) == expected_degree);
+                    }
+                }
+                size_t parallel_count = 0;
+                subgraph.for_each_handle([&](const handle_t& handle) {
+                    #pragma omp critical
+                    parallel_count++;
+                }, true);
+                assert(parallel_count == expected.size());
+                
+                // The batch's iteration sees the same nodes
+                set<nid_t> batch_ids;
+                batch.for_each_handle(i, [&](const handle_t& handle) {
+                    assert(!graph.get_is_reverse(handle));
+                    batch_ids.insert(graph.get_id(handle));
+                });
+                assert(batch_ids == expected);
+            }
+        }
+        
+        // The edge limit stops the search
+        SubgraphBatch one_edge = extractor.extract(positions, 1000, 1);
+        for (size_t i = 0; i < positions.size(); i++) {
+            handle_t seed = graph.get_handle(get<0>(positions[i]));
+            set<nid_t> expected {graph.get_id(seed)};
+            for (bool go_left : {false, true}) {
+                graph.follow_edges(seed, go_left, [&](const handle_t& next) {
+                    expected.insert(graph.get_id(next));
+                });
+            }
+            assert(node_ids(one_edge.get_subgraph(i)) == expected);
+        }
+        
+        // Offsets must be on the node
+        bool caught = false;
+        try {
+            extractor.extract({make_tuple(graph.get_id(handles[0]), false, graph.get_length(handles[0]))}, 10);
+        } catch (const std::runtime_error& e) {
+            caught = true;
+        }
+        assert(caught);
+        
+        // No positions make no subgraphs
+        assert(extractor.extract({}, 10).empty());
+    }
     
-    HashGraph g_move_1 = move(g_copy_3);
-    HashGraph g_move_2(move(g_copy_4));
+    {
+        // With a distance index, we should get the same neighborhoods
+        vector<size_t> lengths, no_loops;
+        for (size_t i = 0; i < 200; i++) {
+            lengths.push_back(1 + (i * 7919) % 13);
+            no_loops.push_back(numeric_limits<size_t>::max());
+        }
+        SnarlDistanceIndex index;
+        HashGraph graph;
+        make_linear_chain_index(index, graph, lengths, no_loops, no_loops);
+        
+        vector<tuple<nid_t, bool, size_t>> positions;
+        for (size_t i = 0; i < 200; i += 7) {
+            positions.emplace_back(i + 1, i % 2, i % lengths[i]);
+        }
+        
+        NeighborhoodExtractor<HashGraph> extractor(&graph);
+        NeighborhoodExtractor<HashGraph> indexed_extractor(&graph, &index);
+        for (size_t max_distance : {0, 3, 25, 100}) {
+            for (size_t max_edges : {(size_t) 2, numeric_limits<size_t>::max()}) {
+                SubgraphBatch batch = extractor.extract(positions, max_distance, max_edges);
+                SubgraphBatch indexed_batch = indexed_extractor.extract(positions, max_distance, max_edges);
+                for (size_t i = 0; i < positions.size(); i++) {
+                    set<nid_t> expected = node_ids(batch.get_subgraph(i));
+                    if (max_edges == numeric_limits<size_t>::max()) {
+                        assert(expected == reference_neighborhood(graph, positions[i], max_distance));
+                    }
+                    assert(node_ids(indexed_batch.get_subgraph(i)) == expected);
+                }
+            }
+        }
+    }
     
-    assert(handlegraph::algorithms::are_equivalent_with_paths(&g, &g_copy_1, true));
-    assert(handlegraph::algorithms::are_equivalent_with_paths(&g, &g_copy_2, true));
-    assert(handlegraph::algorithms::are_equivalent_with_paths(&g, &g_move_1, true));
-    assert(handlegraph::algorithms::are_equivalent_with_paths(&g, &g_move_2, true));
+    cerr << "Neighborhood extractor tests successful!" << endl;
+}
+
+void test_perf_counters() {
     
-    // delete a handle on a path to trigger the occurrence index to be accessed
-    g_copy_1.destroy_handle(g_copy_1.get_handle(g.get_id(h2)));
-    g_copy_2.destroy_handle(g_copy_2.get_handle(g.get_id(h2)));
-    g_move_1.destroy_handle(g_move_1.get_handle(g.get_id(h2)));
-    g_move_2.destroy_handle(g_move_2.get_handle(g.get_id(h2)));
-    g.destroy_handle(h2);
+    perf::reset();
+    {
+        // Do some work that passes through the instrumented code
+        PackedGraph graph;
+        handle_t h1 = graph.create_handle("GATTACA");
+        handle_t h2 = graph.create_handle("CAT");
+        graph.create_edge(h1, h2);
+        assert(graph.get_sequence(h1) == "GATTACA");
+        size_t seen = 0;
+        graph.follow_edges(h1, false, [&](const handle_t& other) {
+            seen++;
+        });
+        assert(seen == 1);
+    }
     
-    assert(handlegraph::algorithms::are_equivalent_with_paths(&g, &g_copy_1, true));
-    assert(handlegraph::algorithms::are_equivalent_with_paths(&g, &g_copy_2, true));
-    assert(handlegraph::algorithms::are_equivalent_with_paths(&g, &g_move_1, true));
-    assert(handlegraph::algorithms::are_equivalent_with_paths(&g, &g_move_2, true));
+    perf::Snapshot totals = perf::snapshot();
+    if (perf::enabled()) {
+        assert(totals.counts[perf::GRAPH_GET_SEQUENCE] >= 1);
+        assert(totals.counts[perf::GRAPH_FOLLOW_EDGES] >= 1);
+    } else {
+        for (size_t i = 0; i < perf::EVENT_COUNT; i++) {
+            assert(totals.counts[i] == 0);
+            assert(totals.nanoseconds[i] == 0);
+        }
+    }
     
-    cerr << "HashGraph tests successful!" << endl;
+    // Events recorded by hand, including from other threads, get counted
+    perf::reset();
+    perf::record(perf::MANAGER_ALLOCATE, 100);
+    std::thread worker([&]() {
+        perf::record(perf::MANAGER_ALLOCATE, 50);
+    });
+    worker.join();
+    totals = perf::snapshot();
+    assert(totals.counts[perf::MANAGER_ALLOCATE] == 2);
+    assert(totals.nanoseconds[perf::MANAGER_ALLOCATE] == 150);
+    
+    std::string json = totals.to_json();
+    for (size_t i = 0; i < perf::EVENT_COUNT; i++) {
+        assert(json.find(string("\"") + perf::event_name((perf::event_t) i) + "\"") != string::npos);
+    }
+    
+    perf::reset();
+    totals = perf::snapshot();
+    assert(totals.counts[perf::MANAGER_ALLOCATE] == 0);
+    assert(totals.nanoseconds[perf::MANAGER_ALLOCATE] == 0);
+    
+    cerr << "Perf counter tests successful!" << endl;
 }
 
 void test_snarl_distance_index() {
@@ -4372,6 +9193,50 @@ void test_snarl_distance_index() {
         // It should be empty but working
         assert(index.get_max_tree_depth() == 0);
         
+        // The distance cache should start off and be able to be turned on
+        // and off without any lookups having happened.
+        assert(index.get_distance_cache_size() == 0);
+        assert(index.get_distance_cache_stats() == make_pair((size_t) 0, (size_t) 0));
+        index.set_distance_cache_size(1024);
+        assert(index.get_distance_cache_size() == 1024);
+        index.reset_distance_cache_stats();
+        assert(index.get_distance_cache_stats() == make_pair((size_t) 0, (size_t) 0));
+        index.set_distance_cache_size(0);
+        
+        // Walking the tree should find just the root
+        size_t visited = 0;
+        SnarlDistanceIndex::SnarlTreeCursor cursor(index);
+        while (cursor.next()) {
+            assert(index.is_root(cursor.get()));
+            assert(cursor.get_depth() == 0);
+            visited++;
+        }
+        assert(visited == 1);
+        assert(!cursor.next());
+        assert(index.for_each_child_inline(index.get_root(), [&](const net_handle_t& child) {
+            visited++;
+            return true;
+        }));
+        assert(visited == 1);
+        
+        // Batch distance queries should reject sources that aren't in the graph
+        bool caught = false;
+        try {
+            index.minimum_distances(5, false, 0, {});
+        } catch (const std::runtime_error& e) {
+            caught = true;
+        }
+        assert(caught);
+        
+        // So should shortest path walks
+        caught = false;
+        try {
+            SnarlDistanceIndex::ShortestPathCursor path_cursor(index, &empty_graph, 5, false, 6, false);
+        } catch (const std::runtime_error& e) {
+            caught = true;
+        }
+        assert(caught);
+        
         // Save it
         fd = mkstemp(filename);
         assert(fd != -1);
@@ -4386,6 +9251,15 @@ void test_snarl_distance_index() {
         
         // It should be empty but working
         assert(index2.get_max_tree_depth() == 0);
+        
+        // There are no connected components to prefetch
+        bool caught = false;
+        try {
+            index2.prefetch_component(0, true);
+        } catch (const std::runtime_error& e) {
+            caught = true;
+        }
+        assert(caught);
     }
     
     // Make the file un-writable.
@@ -4406,6 +9280,729 @@ void test_snarl_distance_index() {
     // And remove it
     unlink(filename);
     
+    {
+        // Make an index for one long chain
+        vector<size_t> lengths, forward_loops, reverse_loops;
+        for (size_t i = 0; i < 1000; i++) {
+            lengths.push_back(1 + (i * 7) % 5);
+            forward_loops.push_back(10 + (i * 7919) % 1009);
+            reverse_loops.push_back(10 + (i * 104729) % 997);
+        }
+        SnarlDistanceIndex index;
+        HashGraph graph;
+        make_linear_chain_index(index, graph, lengths, forward_loops, reverse_loops);
+        
+        // The one component's records should all be there to prefetch
+        assert(index.get_component_record_range(0).first > 0);
+        index.prefetch_component(0);
+        index.prefetch_component(0, true);
+        
+        net_handle_t chain = index.get_handle_from_connected_component(0);
+        assert(index.is_chain(chain));
+        vector<net_handle_t> nodes;
+        index.for_each_child(chain, [&](const net_handle_t& child) {
+            nodes.push_back(child);
+        });
+        assert(nodes.size() == lengths.size());
+        assert(index.get_forward_loop_value(nodes[500]) != std::numeric_limits<size_t>::max());
+        assert(index.get_reverse_loop_value(nodes[500]) != std::numeric_limits<size_t>::max());
+        assert(index.minimum_distance(1, false, 0, 1000, false, 0) == 
+               index.get_prefix_sum_value(nodes.back()));
+        
+        // Queries work the same on NUMA replicas
+        index.replicate_numa();
+        assert(index.minimum_distance(1, false, 0, 1000, false, 0) == 
+               index.get_prefix_sum_value(nodes.back()));
+        
+        {
+            // Batches of pairwise queries should match one query at a time
+            random_device rd;
+            default_random_engine gen(rd());
+            uniform_int_distribution<nid_t> id_distribution(1, 1000);
+            uniform_int_distribution<int> flip_distribution(0, 1);
+            size_t count = 2000;
+            vector<nid_t> ids1(count), ids2(count);
+            unique_ptr<bool[]> revs1(new bool[count]);
+            unique_ptr<bool[]> revs2(new bool[count]);
+            vector<size_t> offsets1(count), offsets2(count);
+            for (size_t i = 0; i < count; i++) {
+                ids1[i] = id_distribution(gen);
+                ids2[i] = id_distribution(gen);
+                revs1[i] = flip_distribution(gen);
+                revs2[i] = flip_distribution(gen);
+                offsets1[i] = uniform_int_distribution<size_t>(0, lengths[ids1[i] - 1] - 1)(gen);
+                offsets2[i] = uniform_int_distribution<size_t>(0, lengths[ids2[i] - 1] - 1)(gen);
+            }
+            for (bool parallel : {false, true}) {
+                vector<size_t> distances(count, 0);
+                index.minimum_distance_pairs(count, ids1.data(), revs1.get(), offsets1.data(),
+                                             ids2.data(), revs2.get(), offsets2.data(),
+                                             distances.data(), false, nullptr, parallel);
+                for (size_t i = 0; i < count; i++) {
+                    assert(distances[i] == index.minimum_distance(ids1[i], revs1[i], offsets1[i],
+                                                                  ids2[i], revs2[i], offsets2[i]));
+                }
+            }
+            
+            // Any bad ID in the batch should be rejected
+            ids2[count / 2] = 5000;
+            vector<size_t> distances(count, 0);
+            bool caught = false;
+            try {
+                index.minimum_distance_pairs(count, ids1.data(), revs1.get(), offsets1.data(),
+                                             ids2.data(), revs2.get(), offsets2.data(), distances.data());
+            } catch (const std::runtime_error& e) {
+                caught = true;
+            }
+            assert(caught);
+        }
+        
+        {
+            // Distances from ancestry codes should match the index, without needing it for a chain
+            random_device rd;
+            default_random_engine gen(rd());
+            uniform_int_distribution<nid_t> id_distribution(1, 1000);
+            uniform_int_distribution<int> flip_distribution(0, 1);
+            vector<AncestryCode> codes;
+            for (nid_t id = 1; id <= 1000; id++) {
+                codes.push_back(index.get_ancestry_code(id));
+                assert(codes.back().get_node_id() == id);
+            }
+            for (size_t i = 0; i < 2000; i++) {
+                // Use the same node some of the time
+                nid_t id1 = id_distribution(gen);
+                nid_t id2 = i % 4 == 0 ? id1 : id_distribution(gen);
+                bool rev1 = flip_distribution(gen);
+                bool rev2 = flip_distribution(gen);
+                size_t offset1 = uniform_int_distribution<size_t>(0, lengths[id1 - 1] - 1)(gen);
+                size_t offset2 = uniform_int_distribution<size_t>(0, lengths[id2 - 1] - 1)(gen);
+                for (bool unoriented : {false, true}) {
+                    size_t distance;
+                    assert(SnarlDistanceIndex::minimum_distance_from_codes(codes[id1 - 1], rev1, offset1,
+                                                                           codes[id2 - 1], rev2, offset2,
+                                                                           unoriented, distance));
+                    assert(distance == index.minimum_distance(id1, rev1, offset1, id2, rev2, offset2, unoriented));
+                    assert(index.minimum_distance(codes[id1 - 1], rev1, offset1, codes[id2 - 1], rev2, offset2,
+                                                  unoriented) == distance);
+                }
+            }
+            
+            // Codes should survive being saved
+            stringstream code_stream;
+            codes[500].serialize(code_stream);
+            AncestryCode loaded;
+            loaded.deserialize(code_stream);
+            assert(loaded.get_bytes() == codes[500].get_bytes());
+            assert(AncestryCode(codes[20].get_bytes()).get_bytes() == codes[20].get_bytes());
+            assert(index.minimum_distance(loaded, false, 0, codes[20], true, 0) ==
+                   index.minimum_distance(501, false, 0, 21, true, 0));
+            
+            // But not being cut off
+            vector<uint8_t> truncated(codes[500].get_bytes().begin(), codes[500].get_bytes().end() - 1);
+            bool caught = false;
+            try {
+                size_t distance;
+                SnarlDistanceIndex::minimum_distance_from_codes(AncestryCode(truncated), false, 0,
+                                                                codes[20], false, 0, false, distance);
+            } catch (const std::runtime_error& e) {
+                caught = true;
+            }
+            assert(caught);
+        }
+        
+        for (size_t sample_interval : {1, 7, 64, 5000}) {
+            SnarlDistanceIndex::ChainSkipIndex skip_index(index, chain, sample_interval);
+            assert(skip_index.get_node_count() == nodes.size());
+            
+            for (size_t i = 0; i < nodes.size(); i += 13) {
+                // We should be able to find each node's place in the chain
+                assert(skip_index.get_node_ordinal(nodes[i]) == i);
+                assert(skip_index.get_node_ordinal(index.flip(nodes[i])) == i);
+                
+                // And find the node at each offset
+                size_t start = index.get_prefix_sum_value(nodes[i]);
+                assert(index.canonical(skip_index.get_node_at_offset(start)) == index.canonical(nodes[i]));
+                assert(index.canonical(skip_index.get_node_at_offset(start + lengths[i] - 1)) == index.canonical(nodes[i]));
+                
+                // And the smallest loops between nodes
+                for (size_t j = i; j < nodes.size(); j += 97) {
+                    size_t min_forward = std::numeric_limits<size_t>::max();
+                    size_t min_reverse = std::numeric_limits<size_t>::max();
+                    for (size_t k = i; k <= j; k++) {
+                        min_forward = std::min(min_forward, index.get_forward_loop_value(nodes[k]));
+                        min_reverse = std::min(min_reverse, index.get_reverse_loop_value(nodes[k]));
+                    }
+                    assert(skip_index.get_min_loop_value(nodes[i], nodes[j]) == min_forward);
+                    assert(skip_index.get_min_loop_value(nodes[j], nodes[i], false) == min_reverse);
+                }
+            }
+            // Past the end of the chain we should get the last node
+            assert(index.canonical(skip_index.get_node_at_offset(1000000)) == index.canonical(nodes.back()));
+        }
+        
+        // Skip indexes are only for chains
+        bool caught = false;
+        try {
+            SnarlDistanceIndex::ChainSkipIndex skip_index(index, nodes.front());
+        } catch (const std::runtime_error& e) {
+            caught = true;
+        }
+        assert(caught);
+    }
+    
+    {
+        // Root distance labels should give the same distances as walking up the snarl tree
+        vector<size_t> lengths, forward_loops, reverse_loops;
+        for (size_t i = 0; i < 300; i++) {
+            lengths.push_back(1 + (i * 7) % 5);
+            forward_loops.push_back(10 + (i * 7919) % 1009);
+            reverse_loops.push_back(10 + (i * 104729) % 997);
+        }
+        SnarlDistanceIndex index;
+        HashGraph graph;
+        index.set_root_distance_labels(true);
+        make_linear_chain_index(index, graph, lengths, forward_loops, reverse_loops, 3);
+        assert(index.has_root_distance_labels());
+        assert(index.connected_component_count() == 3);
+        
+        // Each component's node records are numbered from its own first node,
+        // so every node has to come out with its own length and component
+        for (nid_t id = 1; id <= 300; id++) {
+            net_handle_t node = index.get_node_net_handle(id);
+            assert(index.minimum_length(node) == lengths[id - 1]);
+            assert(index.get_connected_component_number(node) ==
+                   index.get_connected_component_number(index.get_node_net_handle(1 + (id - 1) / 100 * 100)));
+        }
+        assert(index.get_connected_component_number(index.get_node_net_handle(1)) !=
+               index.get_connected_component_number(index.get_node_net_handle(101)));
+        assert(index.get_connected_component_number(index.get_node_net_handle(101)) !=
+               index.get_connected_component_number(index.get_node_net_handle(201)));
+        
+        random_device rd;
+        default_random_engine gen(rd());
+        uniform_int_distribution<nid_t> id_distribution(1, 300);
+        uniform_int_distribution<int> flip_distribution(0, 1);
+        vector<tuple<nid_t, bool, size_t, nid_t, bool, size_t, bool>> queries;
+        vector<size_t> labeled_distances;
+        for (size_t i = 0; i < 1000; i++) {
+            nid_t id1 = id_distribution(gen);
+            nid_t id2 = id_distribution(gen);
+            queries.emplace_back(id1, flip_distribution(gen), uniform_int_distribution<size_t>(0, lengths[id1 - 1] - 1)(gen),
+                                 id2, flip_distribution(gen), uniform_int_distribution<size_t>(0, lengths[id2 - 1] - 1)(gen),
+                                 flip_distribution(gen));
+            auto& q = queries.back();
+            labeled_distances.push_back(index.minimum_distance(get<0>(q), get<1>(q), get<2>(q),
+                                                               get<3>(q), get<4>(q), get<5>(q), get<6>(q)));
+            if ((get<0>(q) - 1) / 100 != (get<3>(q) - 1) / 100) {
+                // Different components can't reach each other
+                assert(labeled_distances.back() == std::numeric_limits<size_t>::max());
+            }
+        }
+        
+        // The labels come back when the index is loaded into something that wants them
+        stringstream index_stream;
+        index.serialize(index_stream);
+        SnarlDistanceIndex loaded;
+        loaded.set_root_distance_labels(true);
+        loaded.deserialize(index_stream);
+        assert(loaded.has_root_distance_labels());
+        
+        index.set_root_distance_labels(false);
+        assert(!index.has_root_distance_labels());
+        for (size_t i = 0; i < queries.size(); i++) {
+            auto& q = queries[i];
+            assert(index.minimum_distance(get<0>(q), get<1>(q), get<2>(q),
+                                          get<3>(q), get<4>(q), get<5>(q), get<6>(q)) == labeled_distances[i]);
+            assert(loaded.minimum_distance(get<0>(q), get<1>(q), get<2>(q),
+                                           get<3>(q), get<4>(q), get<5>(q), get<6>(q)) == labeled_distances[i]);
+        }
+    }
+    
+    {
+        // Updating some of the connected components should leave the others alone,
+        // and give the new ones the same distances as building them from scratch
+        using TemporaryDistanceIndex = SnarlDistanceIndex::TemporaryDistanceIndex;
+        auto make_loops = [](size_t count, size_t seed) {
+            vector<size_t> lengths, forward_loops, reverse_loops;
+            for (size_t i = 0; i < count; i++) {
+                lengths.push_back(1 + (i * seed) % 7);
+                forward_loops.push_back(10 + (i * 7919 * seed) % 1009);
+                reverse_loops.push_back(10 + (i * 104729 * seed) % 997);
+            }
+            return make_tuple(lengths, forward_loops, reverse_loops);
+        };
+        vector<size_t> lengths, forward_loops, reverse_loops;
+        tie(lengths, forward_loops, reverse_loops) = make_loops(300, 3);
+        SnarlDistanceIndex index;
+        HashGraph graph;
+        index.set_root_distance_labels(true);
+        make_linear_chain_index(index, graph, lengths, forward_loops, reverse_loops, 3);
+        
+        random_device rd;
+        default_random_engine gen(rd());
+        uniform_int_distribution<int> flip_distribution(0, 1);
+        // Get the distance between random positions on nodes in the given ranges,
+        // in the given index and a reference index with IDs shifted down by the given amount
+        auto check_distances = [&](const SnarlDistanceIndex& index, const SnarlDistanceIndex& reference,
+                                   const HandleGraph& graph, nid_t range1_start, nid_t range1_end,
+                                   nid_t range2_start, nid_t range2_end, nid_t shift) {
+            for (size_t i = 0; i < 200; i++) {
+                nid_t id1 = uniform_int_distribution<nid_t>(range1_start, range1_end)(gen);
+                nid_t id2 = uniform_int_distribution<nid_t>(range2_start, range2_end)(gen);
+                bool rev1 = flip_distribution(gen);
+                bool rev2 = flip_distribution(gen);
+                size_t offset1 = uniform_int_distribution<size_t>(0, graph.get_length(graph.get_handle(id1)) - 1)(gen);
+                size_t offset2 = uniform_int_distribution<size_t>(0, graph.get_length(graph.get_handle(id2)) - 1)(gen);
+                size_t expected = reference.minimum_distance(id1 - shift, rev1, offset1, id2 - shift, rev2, offset2);
+                assert(index.minimum_distance(id1, rev1, offset1, id2, rev2, offset2) == expected);
+            }
+        };
+        SnarlDistanceIndex original;
+        HashGraph original_graph;
+        make_linear_chain_index(original, original_graph, lengths, forward_loops, reverse_loops, 3);
+        
+        // Replace the middle chain with a longer one made of new nodes
+        for (nid_t id = 101; id <= 200; id++) {
+            graph.destroy_handle(graph.get_handle(id));
+        }
+        vector<size_t> new_lengths, new_forward_loops, new_reverse_loops;
+        tie(new_lengths, new_forward_loops, new_reverse_loops) = make_loops(150, 5);
+        TemporaryDistanceIndex new_chain;
+        make_linear_chain_temp_index(new_chain, graph, new_lengths, new_forward_loops, new_reverse_loops);
+        assert(new_chain.min_node_id == 301 && new_chain.max_node_id == 450);
+        index.update_snarl_tree_records({&new_chain}, &graph, {150});
+        assert(index.connected_component_count() == 3);
+        assert(!index.has_node(150));
+        assert(index.has_node(450));
+        assert(index.has_root_distance_labels());
+        
+        SnarlDistanceIndex fresh;
+        HashGraph fresh_graph;
+        make_linear_chain_index(fresh, fresh_graph, new_lengths, new_forward_loops, new_reverse_loops);
+        check_distances(index, original, graph, 1, 100, 1, 100, 0);
+        check_distances(index, original, graph, 201, 300, 201, 300, 0);
+        check_distances(index, original, graph, 1, 100, 201, 300, 0);
+        check_distances(index, fresh, graph, 301, 450, 301, 450, 300);
+        assert(index.minimum_distance(1, false, 0, 301, false, 0) == std::numeric_limits<size_t>::max());
+        
+        // Replace the first chain with one over the same node IDs, with different lengths
+        tie(new_lengths, new_forward_loops, new_reverse_loops) = make_loops(100, 11);
+        HashGraph edited_graph;
+        TemporaryDistanceIndex edited_chain;
+        make_linear_chain_temp_index(edited_chain, edited_graph, new_lengths, new_forward_loops, new_reverse_loops);
+        index.update_snarl_tree_records({&edited_chain}, &edited_graph);
+        assert(index.connected_component_count() == 3);
+        
+        SnarlDistanceIndex edited;
+        HashGraph edited_reference_graph;
+        make_linear_chain_index(edited, edited_reference_graph, new_lengths, new_forward_loops, new_reverse_loops);
+        check_distances(index, edited, edited_graph, 1, 100, 1, 100, 0);
+        check_distances(index, original, graph, 201, 300, 201, 300, 0);
+        check_distances(index, fresh, graph, 301, 450, 301, 450, 300);
+        
+        // And the updated index should still save and load
+        stringstream index_stream;
+        index.serialize(index_stream);
+        SnarlDistanceIndex loaded;
+        loaded.deserialize(index_stream);
+        check_distances(loaded, original, graph, 201, 300, 201, 300, 0);
+        check_distances(loaded, fresh, graph, 301, 450, 301, 450, 300);
+    }
+    
+    {
+        // Make a chain of node 1, a snarl, and a last node, where every child of the
+        // snarl is reachable from the start and reaches the end, and the children
+        // are also linked in order, so their distances get packed several to an entry
+        using TemporaryDistanceIndex = SnarlDistanceIndex::TemporaryDistanceIndex;
+        size_t child_count = 20;
+        vector<size_t> lengths {3};
+        for (size_t i = 0; i < child_count; i++) {
+            lengths.push_back(5 + (i * 7) % 5);
+        }
+        lengths.push_back(4);
+        HashGraph graph;
+        vector<handle_t> handles;
+        for (size_t length : lengths) {
+            handles.push_back(graph.create_handle(string(length, 'A')));
+        }
+        for (size_t i = 1; i <= child_count; i++) {
+            graph.create_edge(handles.front(), handles[i]);
+            graph.create_edge(handles[i], handles.back());
+            if (i < child_count) {
+                graph.create_edge(handles[i], handles[i + 1]);
+            }
+        }
+        nid_t last_id = child_count + 2;
+        
+        TemporaryDistanceIndex temp_index;
+        temp_index.min_node_id = 1;
+        temp_index.max_node_id = last_id;
+        temp_index.root_structure_count = 1;
+        temp_index.max_tree_depth = 2;
+        temp_index.components.emplace_back(SnarlDistanceIndex::TEMP_CHAIN, 0);
+        
+        temp_index.temp_snarl_records.emplace_back();
+        TemporaryDistanceIndex::TemporarySnarlRecord& snarl = temp_index.temp_snarl_records.back();
+        snarl.start_node_id = 1;
+        snarl.start_node_rev = false;
+        snarl.start_node_length = lengths.front();
+        snarl.end_node_id = last_id;
+        snarl.end_node_rev = false;
+        snarl.end_node_length = lengths.back();
+        snarl.node_count = child_count;
+        snarl.min_length = *std::min_element(lengths.begin() + 1, lengths.end() - 1);
+        snarl.max_length = 0;
+        for (size_t i = 1; i <= child_count; i++) {
+            snarl.max_length += lengths[i];
+        }
+        snarl.max_distance = snarl.max_length;
+        snarl.tree_depth = 1;
+        snarl.parent = make_pair(SnarlDistanceIndex::TEMP_CHAIN, 0);
+        snarl.rank_in_parent = 1;
+        snarl.reversed_in_parent = false;
+        snarl.is_trivial = false;
+        snarl.is_simple = false;
+        for (size_t i = 1; i <= child_count; i++) {
+            size_t distance = 0;
+            for (size_t j = i + 1; j <= child_count; j++) {
+                snarl.distances[make_pair(make_pair(i + 1, true), make_pair(j + 1, false))] = distance;
+                distance += lengths[j];
+            }
+        }
+        
+        temp_index.temp_chain_records.emplace_back();
+        TemporaryDistanceIndex::TemporaryChainRecord& chain = temp_index.temp_chain_records.back();
+        chain.start_node_id = 1;
+        chain.start_node_rev = false;
+        chain.end_node_id = last_id;
+        chain.end_node_rev = false;
+        chain.end_node_length = lengths.back();
+        chain.parent = make_pair(SnarlDistanceIndex::TEMP_ROOT, 0);
+        chain.rank_in_parent = 0;
+        chain.reversed_in_parent = false;
+        chain.is_trivial = false;
+        chain.children = {make_pair(SnarlDistanceIndex::TEMP_NODE, 1),
+                          make_pair(SnarlDistanceIndex::TEMP_SNARL, 0),
+                          make_pair(SnarlDistanceIndex::TEMP_NODE, last_id)};
+        chain.prefix_sum = {0, lengths.front() + snarl.min_length};
+        chain.max_prefix_sum = {0, lengths.front() + snarl.max_length};
+        chain.forward_loops = {std::numeric_limits<size_t>::max(), std::numeric_limits<size_t>::max()};
+        chain.backward_loops = chain.forward_loops;
+        chain.chain_components = {0, 0};
+        chain.min_length = lengths.front() + snarl.min_length + lengths.back();
+        chain.max_length = lengths.front() + snarl.max_length + lengths.back();
+        temp_index.max_distance = chain.max_length;
+        
+        for (size_t i = 0; i < lengths.size(); i++) {
+            temp_index.temp_node_records.emplace_back();
+            TemporaryDistanceIndex::TemporaryNodeRecord& node = temp_index.temp_node_records.back();
+            node.node_id = i + 1;
+            node.node_length = lengths[i];
+            if (i == 0 || i == lengths.size() - 1) {
+                node.parent = make_pair(SnarlDistanceIndex::TEMP_CHAIN, 0);
+                node.rank_in_parent = i == 0 ? 0 : 2;
+            } else {
+                node.parent = make_pair(SnarlDistanceIndex::TEMP_SNARL, 0);
+                node.rank_in_parent = i + 1;
+                node.distance_left_start = 0;
+                node.distance_right_end = 0;
+                snarl.children.emplace_back(SnarlDistanceIndex::TEMP_NODE, i + 1);
+            }
+        }
+        temp_index.max_index_size = chain.get_max_record_length() + snarl.get_max_record_length()
+                                  + child_count * TemporaryDistanceIndex::TemporaryNodeRecord::get_max_record_length();
+        
+        SnarlDistanceIndex index;
+        index.get_snarl_tree_records({&temp_index}, &graph);
+        
+        // Going forward from the start of one child to the start of a later
+        // one has to go through every child in between
+        auto check_distances = [&](const SnarlDistanceIndex& index) {
+            for (nid_t id1 = 2; id1 < last_id; id1++) {
+                size_t expected = 0;
+                for (nid_t id2 = id1 + 1; id2 < last_id; id2++) {
+                    expected += lengths[id2 - 2];
+                    assert(index.minimum_distance(id1, false, 0, id2, false, 0, false, &graph) == expected);
+                }
+                assert(index.minimum_distance(1, false, 0, id1, false, 0, false, &graph) == lengths.front());
+            }
+        };
+        check_distances(index);
+        
+        // Add a new component that needs a much wider index. The snarl's
+        // distances are still packed for the old width.
+        vector<size_t> new_lengths {2, 3, 4};
+        vector<size_t> no_loops (new_lengths.size(), std::numeric_limits<size_t>::max());
+        TemporaryDistanceIndex new_chain;
+        make_linear_chain_temp_index(new_chain, graph, new_lengths, no_loops, no_loops);
+        new_chain.max_distance = ((size_t) 1) << 40;
+        index.update_snarl_tree_records({&new_chain}, &graph);
+        assert(index.connected_component_count() == 2);
+        check_distances(index);
+        assert(index.minimum_distance(last_id + 1, false, 0, last_id + 3, false, 0, false, &graph) == 5);
+        
+        stringstream index_stream;
+        index.serialize(index_stream);
+        SnarlDistanceIndex loaded;
+        loaded.deserialize(index_stream);
+        check_distances(loaded);
+        
+        // An index with the magic number from before distances were packed
+        // has to be rejected rather than misread
+        string serialized = index_stream.str();
+        uint32_t old_magic_number = 1738636486;
+        for (size_t i = 0; i < 4; i++) {
+            serialized[i] = (char) ((old_magic_number >> (8 * (3 - i))) & 0xFF);
+        }
+        stringstream old_stream(serialized);
+        SnarlDistanceIndex old_loaded;
+        bool rejected = false;
+        try {
+            old_loaded.deserialize(old_stream);
+        } catch (const std::exception& e) {
+            rejected = true;
+        }
+        assert(rejected);
+        
+        // When one build makes several components, each snarl's list of
+        // children belongs to its own component, and not to the last one
+        TemporaryDistanceIndex side_chain;
+        make_linear_chain_temp_index(side_chain, graph, new_lengths, no_loops, no_loops);
+        SnarlDistanceIndex combined;
+        combined.get_snarl_tree_records({&temp_index, &side_chain}, &graph);
+        assert(combined.connected_component_count() == 2);
+        check_distances(combined);
+        
+        HashGraph side_graph;
+        TemporaryDistanceIndex side_chain_alone;
+        make_linear_chain_temp_index(side_chain_alone, side_graph, new_lengths, no_loops, no_loops);
+        SnarlDistanceIndex alone;
+        alone.get_snarl_tree_records({&side_chain_alone}, &side_graph);
+        std::pair<size_t, size_t> alone_range = alone.get_component_record_range(0);
+        
+        std::pair<size_t, size_t> snarl_range = combined.get_component_record_range(0);
+        std::pair<size_t, size_t> side_range = combined.get_component_record_range(1);
+        assert(snarl_range.second == side_range.first);
+        assert(side_range.second - side_range.first == alone_range.second - alone_range.first);
+        combined.prefetch_component(0, true);
+        combined.prefetch_component(1, true);
+    }
+    
+    {
+        // Make a chain of node 1, a snarl, and node 5, where the snarl has
+        // nodes 2, 3, and 4 and the longest way through it is 2 then 3
+        using TemporaryDistanceIndex = SnarlDistanceIndex::TemporaryDistanceIndex;
+        vector<size_t> lengths {3, 4, 5, 2, 3};
+        HashGraph graph;
+        vector<handle_t> handles;
+        for (size_t length : lengths) {
+            handles.push_back(graph.create_handle(string(length, 'A')));
+        }
+        graph.create_edge(handles[0], handles[1]);
+        graph.create_edge(handles[0], handles[2]);
+        graph.create_edge(handles[0], handles[3]);
+        graph.create_edge(handles[1], handles[2]);
+        graph.create_edge(handles[1], handles[4]);
+        graph.create_edge(handles[2], handles[4]);
+        graph.create_edge(handles[3], handles[4]);
+        
+        TemporaryDistanceIndex temp_index;
+        temp_index.min_node_id = 1;
+        temp_index.max_node_id = 5;
+        temp_index.root_structure_count = 1;
+        temp_index.max_tree_depth = 2;
+        temp_index.max_distance = 15;
+        temp_index.components.emplace_back(SnarlDistanceIndex::TEMP_CHAIN, 0);
+        
+        temp_index.temp_snarl_records.emplace_back();
+        TemporaryDistanceIndex::TemporarySnarlRecord& snarl = temp_index.temp_snarl_records.back();
+        snarl.start_node_id = 1;
+        snarl.start_node_rev = false;
+        snarl.start_node_length = lengths[0];
+        snarl.end_node_id = 5;
+        snarl.end_node_rev = false;
+        snarl.end_node_length = lengths[4];
+        snarl.node_count = 3;
+        snarl.min_length = lengths[3];
+        snarl.max_length = lengths[1] + lengths[2];
+        snarl.max_distance = snarl.max_length;
+        snarl.tree_depth = 1;
+        snarl.parent = make_pair(SnarlDistanceIndex::TEMP_CHAIN, 0);
+        snarl.rank_in_parent = 1;
+        snarl.reversed_in_parent = false;
+        snarl.is_trivial = false;
+        snarl.is_simple = false;
+        snarl.distances[make_pair(make_pair(2, true), make_pair(3, false))] = 0;
+        
+        temp_index.temp_chain_records.emplace_back();
+        TemporaryDistanceIndex::TemporaryChainRecord& chain = temp_index.temp_chain_records.back();
+        chain.start_node_id = 1;
+        chain.start_node_rev = false;
+        chain.end_node_id = 5;
+        chain.end_node_rev = false;
+        chain.end_node_length = lengths[4];
+        chain.parent = make_pair(SnarlDistanceIndex::TEMP_ROOT, 0);
+        chain.rank_in_parent = 0;
+        chain.reversed_in_parent = false;
+        chain.is_trivial = false;
+        chain.children = {make_pair(SnarlDistanceIndex::TEMP_NODE, 1),
+                          make_pair(SnarlDistanceIndex::TEMP_SNARL, 0),
+                          make_pair(SnarlDistanceIndex::TEMP_NODE, 5)};
+        chain.prefix_sum = {0, lengths[0] + snarl.min_length};
+        chain.max_prefix_sum = {0, lengths[0] + snarl.max_length};
+        chain.forward_loops = {std::numeric_limits<size_t>::max(), std::numeric_limits<size_t>::max()};
+        chain.backward_loops = chain.forward_loops;
+        chain.chain_components = {0, 0};
+        chain.min_length = lengths[0] + snarl.min_length + lengths[4];
+        chain.max_length = lengths[0] + snarl.max_length + lengths[4];
+        
+        for (size_t i = 0; i < lengths.size(); i++) {
+            temp_index.temp_node_records.emplace_back();
+            TemporaryDistanceIndex::TemporaryNodeRecord& node = temp_index.temp_node_records.back();
+            node.node_id = i + 1;
+            node.node_length = lengths[i];
+            if (i == 0 || i == 4) {
+                node.parent = make_pair(SnarlDistanceIndex::TEMP_CHAIN, 0);
+                node.rank_in_parent = i == 0 ? 0 : 2;
+            } else {
+                node.parent = make_pair(SnarlDistanceIndex::TEMP_SNARL, 0);
+                node.rank_in_parent = i + 1;
+                node.distance_left_start = 0;
+                node.distance_right_end = 0;
+                snarl.children.emplace_back(SnarlDistanceIndex::TEMP_NODE, i + 1);
+            }
+        }
+        temp_index.max_index_size = chain.get_max_record_length() + snarl.get_max_record_length()
+                                  + 3 * TemporaryDistanceIndex::TemporaryNodeRecord::get_max_record_length();
+        
+        SnarlDistanceIndex index;
+        index.get_snarl_tree_records({&temp_index}, &graph);
+        assert(index.minimum_distance(1, false, 0, 5, false, 0) == 5);
+        assert(index.minimum_distance(1, false, 0, 3, false, 0) == 3);
+        assert(index.maximum_distance(1, false, 0, 5, false, 0) == 12);
+        
+        vector<tuple<nid_t, bool, size_t>> targets {make_tuple(2, false, 1), make_tuple(3, false, 0),
+                                                    make_tuple(4, false, 1), make_tuple(5, false, 2),
+                                                    make_tuple(1, false, 2), make_tuple(3, true, 0)};
+        auto check_batch = [&](const SnarlDistanceIndex& index) {
+            for (nid_t source = 1; source <= 5; source++) {
+                vector<size_t> distances = index.maximum_distances(source, false, 0, targets);
+                assert(distances.size() == targets.size());
+                for (size_t i = 0; i < targets.size(); i++) {
+                    assert(distances[i] == index.maximum_distance(source, false, 0, get<0>(targets[i]),
+                                                                  get<1>(targets[i]), get<2>(targets[i])));
+                }
+            }
+        };
+        check_batch(index);
+        
+        // With the tables, the longest way from 1 to 3 goes through 2
+        index.set_snarl_maximum_distances(true);
+        assert(index.has_snarl_maximum_distances());
+        assert(index.maximum_distance(1, false, 0, 3, false, 0) == 7);
+        assert(index.maximum_distance(1, false, 0, 5, false, 0) == 12);
+        assert(index.maximum_distance(2, false, 0, 5, false, 0) == 9);
+        assert(index.minimum_distance(1, false, 0, 3, false, 0) == 3);
+        check_batch(index);
+        
+        // And they get rebuilt on load if wanted
+        stringstream index_stream;
+        index.serialize(index_stream);
+        SnarlDistanceIndex loaded;
+        loaded.set_snarl_maximum_distances(true);
+        loaded.deserialize(index_stream);
+        assert(loaded.maximum_distance(1, false, 0, 3, false, 0) == 7);
+        check_batch(loaded);
+        
+        index.set_snarl_maximum_distances(false);
+        assert(index.maximum_distance(1, false, 0, 3, false, 0) == 3);
+        
+        // Shortest path walks visit each handle on the path in order, with
+        // the distance to its start
+        using Walk = vector<pair<handle_t, size_t>>;
+        auto walk = [&](nid_t id1, bool rev1, nid_t id2, bool rev2, size_t distance_limit) {
+            Walk walked;
+            SnarlDistanceIndex::ShortestPathCursor cursor(index, &graph, id1, rev1, id2, rev2, distance_limit);
+            while (cursor.next()) {
+                walked.emplace_back(cursor.get(), cursor.get_distance());
+            }
+            assert(!cursor.next());
+            assert(cursor.get_path_length() == (walked.empty() ? std::numeric_limits<size_t>::max() : walked.back().second));
+            return walked;
+        };
+        size_t no_limit = std::numeric_limits<size_t>::max();
+        assert(walk(1, false, 5, false, no_limit) == Walk({{handles[0], 0}, {handles[3], 3}, {handles[4], 5}}));
+        assert(walk(1, false, 3, false, no_limit) == Walk({{handles[0], 0}, {handles[2], 3}}));
+        assert(walk(2, false, 5, false, no_limit) == Walk({{handles[1], 0}, {handles[4], 4}}));
+        assert(walk(2, false, 3, false, no_limit) == Walk({{handles[1], 0}, {handles[2], 4}}));
+        assert(walk(5, true, 1, true, no_limit) == Walk({{graph.flip(handles[4]), 0}, {graph.flip(handles[3]), 3},
+                                                         {graph.flip(handles[0]), 5}}));
+        assert(walk(3, false, 3, false, no_limit) == Walk({{handles[2], 0}}));
+        
+        // Paths longer than the limit aren't walked at all
+        assert(walk(1, false, 5, false, 5) == walk(1, false, 5, false, no_limit));
+        assert(walk(1, false, 5, false, 4).empty());
+        assert(walk(5, true, 1, true, 4).empty());
+        assert(walk(3, false, 3, false, 0).size() == 1);
+        
+        // And neither are paths that don't exist
+        assert(walk(2, false, 4, false, no_limit).empty());
+        assert(walk(5, false, 1, false, no_limit).empty());
+        assert(walk(1, true, 5, false, no_limit).empty());
+        
+        // Between every pair of oriented nodes, where the shortest paths here
+        // are all unique, the walk finds the same path as searching the graph,
+        // and so does the callback version
+        for (nid_t id1 = 1; id1 <= 5; id1++) {
+            for (nid_t id2 = 1; id2 <= 5; id2++) {
+                for (bool rev1 : {false, true}) {
+                    for (bool rev2 : {false, true}) {
+                        Walk searched;
+                        handlegraph::algorithms::for_each_handle_in_shortest_path(&graph, graph.get_handle(id1, rev1),
+                                                                                  graph.get_handle(id2, rev2),
+                                                                                  [&](const handle_t& h, size_t distance) {
+                            searched.emplace_back(h, distance);
+                            return true;
+                        });
+                        Walk walked = walk(id1, rev1, id2, rev2, no_limit);
+                        assert(walked == searched);
+                        assert(walked.empty() == (index.minimum_distance(id1, rev1, 0, id2, rev2, 0) == std::numeric_limits<size_t>::max()));
+                        
+                        Walk iterated;
+                        index.for_each_handle_in_shortest_path(id1, rev1, id2, rev2, &graph, [&](const handle_t h, size_t distance) {
+                            iterated.emplace_back(h, distance);
+                            return true;
+                        });
+                        assert(iterated == walked);
+                    }
+                }
+            }
+        }
+        
+        // The callback version stops when asked to
+        Walk iterated;
+        index.for_each_handle_in_shortest_path(1, false, 5, false, &graph, [&](const handle_t h, size_t distance) {
+            iterated.emplace_back(h, distance);
+            return iterated.size() < 2;
+        });
+        assert(iterated == Walk({{handles[0], 0}, {handles[3], 3}}));
+        
+        // A thread going back and forth between two indexes keeps its cached
+        // distances for both
+        index.set_distance_cache_size(1024);
+        loaded.set_distance_cache_size(1024);
+        for (size_t i = 0; i < 500; i++) {
+            assert(index.minimum_distance(2, false, 0, 3, false, 0) == 4);
+            assert(loaded.minimum_distance(2, false, 0, 3, false, 0) == 4);
+        }
+        for (const SnarlDistanceIndex* cached : {&index, &loaded}) {
+            pair<size_t, size_t> stats = cached->get_distance_cache_stats();
+            assert(stats.first > 0);
+            assert(stats.first > 10 * stats.second);
+        }
+        index.set_distance_cache_size(0);
+    }
+    
     cerr << "SnarlDistanceIndex tests successful!" << endl;
 }
 
@@ -4416,6 +10013,8 @@ int main(void) {
     test_packed_vector<PackedVector<>>();
     test_packed_vector<PackedVector<CompatBackend>>();
     test_packed_vector<PackedVector<MappedBackend>>();
+    test_packed_vector_width_growth<STLBackend>();
+    test_packed_vector_width_growth<MappedBackend>();
     test_paged_vector<PagedVector<1>>();
     test_paged_vector<PagedVector<2>>();
     test_paged_vector<PagedVector<3>>();
@@ -4423,18 +10022,68 @@ int main(void) {
     test_paged_vector<PagedVector<5>>();
     test_paged_vector<PagedVector<5, CompatBackend>>();
     test_paged_vector<PagedVector<5, MappedBackend>>();
+    test_paged_vector<RobustPagedVector<5>>();
+    test_paged_vector<RobustPagedVector<5, MappedBackend>>();
     test_packed_deque();
-    test_packed_set();
+    test_sparse_packed_deque<STLBackend>();
+    test_sparse_packed_deque<MappedBackend>();
+    test_packed_set<PackedSet<>>();
+    test_packed_set<GroupedPackedSet<>>();
+    test_packed_set<GroupedPackedSet<MappedBackend>>();
+    test_grouped_packed_set<STLBackend>();
+    test_grouped_packed_set<MappedBackend>();
+    test_swiss_table();
     test_deletable_handle_graphs();
     test_mutable_path_handle_graphs();
     test_serializable_handle_graphs();
     test_packed_graph();
     test_path_position_overlays();
+    test_compact_mutable_position_overlay();
+    test_lazy_position_overlay();
     test_packed_reference_path_overlay();
+    test_position_overlay_serialization();
     test_vectorizable_overlays();
+    test_packed_position_vectorizable_overlay();
     test_packed_subgraph_overlay();
+    test_path_subgraph_overlay();
+    test_strand_split_overlay();
+    test_is_single_stranded();
+    test_path_name_index();
+    test_path_metadata_index();
+    test_sort_path_memberships();
+    test_path_compression();
+    test_gfa_import();
+    test_eades_algorithm();
     test_multithreaded_overlay_construction();
+    test_multithreaded_succinct_overlay_construction();
     test_mapped_packed_graph();
     test_hash_graph();
+    test_hash_graph_concurrent_mutation();
+    test_graph_conversion();
+    test_flat_hash_graph();
+    test_fast_iteration<PackedGraph>();
+    test_fast_iteration<MappedPackedGraph>();
+    test_fast_iteration<HashGraph>();
+    test_fast_iteration<FlatHashGraph>();
+    test_batch_lookups<PackedGraph>();
+    test_batch_lookups<MappedPackedGraph>();
+    test_bulk_edges_and_chop<PackedGraph>();
+    test_bulk_edges_and_chop<MappedPackedGraph>();
+    test_destroy_paths<PackedGraph>();
+    test_destroy_paths<MappedPackedGraph>();
+    test_parallel_path_iteration<PackedGraph>();
+    test_parallel_path_iteration<MappedPackedGraph>();
+    test_parallel_path_iteration<HashGraph>();
+    test_parallel_path_iteration<FlatHashGraph>();
+    cerr << "Fast iteration tests successful!" << endl;
+    test_packed_sequence_exceptions<PackedGraph>();
+    test_packed_sequence_exceptions<MappedPackedGraph>();
+    cerr << "Packed sequence exception tests successful!" << endl;
+    test_sparse_node_ids<PackedGraph>();
+    test_sparse_node_ids<MappedPackedGraph>();
+    cerr << "Sparse node ID tests successful!" << endl;
+    test_memory_breakdown();
+    test_perf_counters();
     test_snarl_distance_index();
+    test_neighborhood_extractor();
 }
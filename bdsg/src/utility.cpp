@@ -137,6 +137,36 @@ string format_memory(size_t s) {
     }
 }
 
+MemoryBreakdown::MemoryBreakdown(const string& name, size_t bytes) : name(name), bytes(bytes) {
+    // Nothing to do!
+}
+
+MemoryBreakdown& MemoryBreakdown::add(const MemoryBreakdown& component) {
+    bytes += component.bytes;
+    components.push_back(component);
+    return *this;
+}
+
+MemoryBreakdown& MemoryBreakdown::add(const string& name, size_t bytes) {
+    return add(MemoryBreakdown(name, bytes));
+}
+
+const MemoryBreakdown* MemoryBreakdown::find(const string& name) const {
+    for (const MemoryBreakdown& component : components) {
+        if (component.name == name) {
+            return &component;
+        }
+    }
+    return nullptr;
+}
+
+void MemoryBreakdown::print(ostream& out, size_t indent) const {
+    out << string(indent, '\t') << name << ": " << format_memory(bytes) << endl;
+    for (const MemoryBreakdown& component : components) {
+        component.print(out, indent + 1);
+    }
+}
+
 int get_thread_count(void) {
     int thread_count = 1;
 #pragma omp parallel
@@ -147,4 +177,8 @@ int get_thread_count(void) {
     return thread_count;
 }
 
+int get_thread_num(void) {
+    return omp_get_thread_num();
+}
+
 }
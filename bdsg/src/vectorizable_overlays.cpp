@@ -2,6 +2,8 @@
 #include "handlegraph/util.hpp"
 #include "bdsg/internal/utility.hpp"
 
+#include <omp.h> // BINDER_IGNORE because Binder can't find this
+
 namespace bdsg {
 
 VectorizableOverlay::VectorizableOverlay(const HandleGraph* graph) :
@@ -133,45 +135,34 @@ void VectorizableOverlay::index_nodes_and_edges() {
         rank_to_node[slot] = underlying_graph->get_id(handle);
     }, true);
     
-    vector<pair<pair<nid_t, bool>, pair<nid_t, bool>>> edge_buffer;
-    
-    // Do our node sort in parallel with our edge scan and sort.
-    // TODO: Make each sort parallel instead with C++17?
-    #pragma omp parallel
-    {
-        #pragma omp single
-        {
-            #pragma omp task
-            {
-                // Sort the handles by node ID, ascending.
-                // This means the minimal perfect hash function should always see the same
-                // input, so it should always produce the same ordering.
-                std::sort(rank_to_node.begin(), rank_to_node.end());
-            }
-            
-            #pragma omp task
-            {
-                // We also need to do the edges. We need to impose an arbitrary order besed
-                // entirely on node IDs and orientations.
-                // TODO: It would be nice to do this in parallel, but we'd really want an
-                // overall edge count forst, and most graph implementations seem to
-                // implement that as a serial scan of the graph, so it wouldn't really
-                // help.
-                // TODO: Can we use the one parallel loop over the nodes to
-                // replace this somehow?
-                edge_to_rank.reset();
-                underlying_graph->for_each_edge([&](const edge_t& edge) {
-                    // Fill the buffer with ID, orientation representations of the edges.
-                    edge_buffer.push_back(canonicalize_edge(edge));
-                });
-            
-                // Sort edges in some consistent order, so we always feed the same thing to
-                // the minimal perfect hash function for the same graph.
-                std::sort(edge_buffer.begin(), edge_buffer.end());
-            }
-            #pragma omp taskwait
-        }
+    // Sort the handles by node ID, ascending.
+    // This means the minimal perfect hash function should always see the same
+    // input, so it should always produce the same ordering.
+    parallel_sort(rank_to_node.begin(), rank_to_node.end());
+    
+    // We also need to do the edges. We need to impose an arbitrary order besed
+    // entirely on node IDs and orientations. We scan them in parallel into a
+    // buffer per thread, and then put the buffers together.
+    edge_to_rank.reset();
+    vector<vector<pair<pair<nid_t, bool>, pair<nid_t, bool>>>> thread_edge_buffers(get_thread_count());
+    underlying_graph->for_each_edge([&](const edge_t& edge) {
+        // Fill the buffer with ID, orientation representations of the edges.
+        thread_edge_buffers[omp_get_thread_num()].push_back(canonicalize_edge(edge));
+    }, true);
+    vector<size_t> buffer_starts(thread_edge_buffers.size() + 1, 0);
+    for (size_t i = 0; i < thread_edge_buffers.size(); i++) {
+        buffer_starts[i + 1] = buffer_starts[i] + thread_edge_buffers[i].size();
     }
+    vector<pair<pair<nid_t, bool>, pair<nid_t, bool>>> edge_buffer(buffer_starts.back());
+    #pragma omp parallel for
+    for (size_t i = 0; i < thread_edge_buffers.size(); i++) {
+        std::copy(thread_edge_buffers[i].begin(), thread_edge_buffers[i].end(), edge_buffer.begin() + buffer_starts[i]);
+        vector<pair<pair<nid_t, bool>, pair<nid_t, bool>>>().swap(thread_edge_buffers[i]);
+    }
+    
+    // Sort edges in some consistent order, so we always feed the same thing to
+    // the minimal perfect hash function for the same graph.
+    parallel_sort(edge_buffer.begin(), edge_buffer.end());
     
     // Make edge PMHF. Does its own threading. Do it first so we can drop the edge buffer.
     // note: we're mapping to 0-based rank, so need to add one after lookup
@@ -210,12 +201,51 @@ void VectorizableOverlay::index_nodes_and_edges() {
     }, true);
     
     
-    // Index our node offsets along the linearized sequence
+    // Index our node offsets along the linearized sequence. First turn the
+    // lengths into offsets with a parallel prefix sum: each thread sums a
+    // chunk, then offsets its chunk by the chunks before it.
+    size_t chunk_count = std::max<size_t>(1, std::min<size_t>(get_thread_count(), node_lengths.size()));
+    vector<size_t> chunk_bounds(chunk_count + 1);
+    for (size_t i = 0; i <= chunk_count; i++) {
+        chunk_bounds[i] = (node_lengths.size() * i) / chunk_count;
+    }
+    vector<size_t> chunk_offsets(chunk_count + 1, 0);
+    #pragma omp parallel for
+    for (size_t i = 0; i < chunk_count; i++) {
+        size_t total = 0;
+        for (size_t j = chunk_bounds[i]; j < chunk_bounds[i + 1]; j++) {
+            // Make each entry the exclusive sum within the chunk
+            size_t length = node_lengths[j];
+            node_lengths[j] = total;
+            total += length;
+        }
+        chunk_offsets[i + 1] = total;
+    }
+    for (size_t i = 0; i < chunk_count; i++) {
+        chunk_offsets[i + 1] += chunk_offsets[i];
+    }
+    #pragma omp parallel for
+    for (size_t i = 0; i < chunk_count; i++) {
+        for (size_t j = chunk_bounds[i]; j < chunk_bounds[i + 1]; j++) {
+            node_lengths[j] += chunk_offsets[i];
+        }
+    }
+    // Rank 0 is the empty placeholder, so ranks from 1 now hold their offsets.
+    std::vector<size_t>& node_offsets = node_lengths;
+    
+    // Then mark the offsets. Each thread takes a range of whole words of the
+    // bit vector, so no two threads write to the same word.
     sdsl::util::assign(s_bv, sdsl::bit_vector(seq_length));
-    seq_length = 0;
-    for (size_t node_rank = 1; node_rank < rank_to_node.size(); ++node_rank) {
-        s_bv[seq_length] = 1;
-        seq_length += node_lengths[node_rank];
+    size_t words = (s_bv.size() + 63) / 64;
+    size_t word_chunk_count = std::max<size_t>(1, std::min<size_t>(get_thread_count(), words));
+    #pragma omp parallel for
+    for (size_t i = 0; i < word_chunk_count; i++) {
+        size_t bit_start = ((words * i) / word_chunk_count) * 64;
+        size_t bit_end = std::min(((words * (i + 1)) / word_chunk_count) * 64, s_bv.size());
+        auto it = std::lower_bound(node_offsets.begin() + 1, node_offsets.end(), bit_start);
+        for (; it != node_offsets.end() && *it < bit_end; ++it) {
+            s_bv[*it] = 1;
+        }
     }
     node_lengths.clear();
     
@@ -368,5 +398,48 @@ step_handle_t PathPositionVectorizableOverlay::get_step_at_position(const path_h
     return underlying_path_position_graph->get_step_at_position(path, position);
 }
 
+PackedPositionVectorizableOverlay::PackedPositionVectorizableOverlay(const PathHandleGraph* path_graph,
+                                                                     size_t steps_per_index,
+                                                                     size_t concurrent_indexes,
+                                                                     bool low_memory) :
+    PathVectorizableOverlay::PathVectorizableOverlay(path_graph),
+    position_overlay(path_graph, steps_per_index, concurrent_indexes, low_memory) {
+    assert(underlying_graph != nullptr);
+    assert(underlying_path_graph != nullptr);
+}
+
+PackedPositionVectorizableOverlay::PackedPositionVectorizableOverlay() {
+        
+}
+    
+PackedPositionVectorizableOverlay::~PackedPositionVectorizableOverlay() {
+        
+}
+
+size_t PackedPositionVectorizableOverlay::get_path_length(const path_handle_t& path_handle) const {
+    return position_overlay.PackedPositionOverlay::get_path_length(path_handle);
+}
+
+size_t PackedPositionVectorizableOverlay::get_position_of_step(const step_handle_t& step) const {
+    return position_overlay.PackedPositionOverlay::get_position_of_step(step);
+}
+    
+step_handle_t PackedPositionVectorizableOverlay::get_step_at_position(const path_handle_t& path,
+                                                                      const size_t& position) const {
+    return position_overlay.PackedPositionOverlay::get_step_at_position(path, position);
+}
+
+void PackedPositionVectorizableOverlay::get_steps_at_positions(const path_handle_t& path,
+                                                               const vector<size_t>& sorted_positions,
+                                                               vector<step_handle_t>& out) const {
+    position_overlay.PackedPositionOverlay::get_steps_at_positions(path, sorted_positions, out);
+}
+
+void PackedPositionVectorizableOverlay::get_positions_of_steps(const path_handle_t& path,
+                                                               const vector<step_handle_t>& steps,
+                                                               vector<size_t>& out) const {
+    position_overlay.PackedPositionOverlay::get_positions_of_steps(path, steps, out);
+}
+
 
 }